@@ -0,0 +1,741 @@
+//! ALSA side of the OpenASIO ALSA drivers: the capture/playback PCM pair, its hardware
+//! setup, and how the RT thread waits for, moves and recovers wakeups.
+//!
+//! The engine is chosen by `OPENASIO_ALSA`, a `,`-separated option list read when the
+//! driver is created:
+//! - `blocking` (default): a blocking read on capture, then a blocking write on playback.
+//!   Each direction recovers from its own xruns.
+//! - `poll`: capture and playback are linked (`snd_pcm_link`), so they start, stop and
+//!   prepare as one. The RT thread waits on the descriptors of both with a single `poll()`
+//!   until capture has a wakeup to read and playback has room for one, then services
+//!   capture before playback; neither call blocks. An xrun in either direction restarts the
+//!   pair on silence, which keeps the two in step.
+//!
+//! Either engine recovers an xrun with `snd_pcm_recover` (which also resumes a suspended
+//! device) and restarts playback on `periods - 1` wakeups of silence, the wakeup in
+//! progress being the last. The frames this cost, taken from the PCMs' stop and start
+//! timestamps, come out of [`Duplex::take_gap`] for the next period's `oa_time_info`. A
+//! device that cannot be restarted leaves [`Duplex::failed`] set.
+//! - `periods=N` (2 to [`MAX_PERIODS`], default 2) is how many wakeups the device ring holds.
+//! - `shared` or `shared=N` (1 to `evloop::MAX_LOOPS`): streams give up their own RT thread
+//!   and join one of N loop threads shared by every instance of the driver in the process
+//!   (`openasio_rt::evloop`). Each loop polls all its PCM pairs at once and services every
+//!   ready one in turn. It runs on the poll engine: `shared` implies `poll`, and asking for
+//!   `blocking` as well is an error.
+//! - `autotune`: the drivers search the smallest period and ring ([`TUNE_PERIODS`]) that
+//!   stream without xruns (`openasio_rt::tune`), in place of the host's buffer_frames and
+//!   `periods=`, and remember it per device.
+//!
+//! The drivers keep their format tables, staging buffers and host callbacks; [`Duplex`]
+//! owns the PCMs and everything that touches them on the RT thread. Its own buffers (the
+//! silence it prefills with, the poll descriptors) are laid out in the stream's arena
+//! with the drivers' ([`Duplex::plan`], [`Duplex::place`]).
+#![allow(clippy::missing_safety_doc)]
+use alsa::pcm::{Access, Format, Frames, HwParams, State, TstampType, PCM};
+use alsa::poll::{self, pollfd, Descriptors};
+use alsa::{Direction, ValueOr};
+use openasio_rt::arena::{Arena, Buf, Part, Plan};
+use openasio_rt::clock::{self, Gap, Stamp};
+use openasio_rt::evloop::{self, Arm};
+use openasio_rt::stats::{StreamStats, Xrun};
+use openasio_sys as sys;
+use std::cell::Cell;
+use std::os::raw::c_void;
+
+type Result<T> = std::result::Result<T, String>;
+
+/// Engine options, read by [`Options::from_env`].
+pub const OPTIONS_ENV: &str = "OPENASIO_ALSA";
+
+pub const DEFAULT_PERIODS: u32 = 2;
+pub const MAX_PERIODS: u32 = 16;
+/// Ring sizes the autotuner tries with every period size.
+pub const TUNE_PERIODS: &[u32] = &[2, 3];
+
+/// Upper bound on waiting for a wakeup before the RT thread re-checks its gate.
+const WAIT_MS: u32 = 100;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Engine {
+    Blocking,
+    Poll,
+}
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct Options {
+    pub engine: Engine,
+    /// Wakeups in the device ring.
+    pub periods: u32,
+    pub autotune: bool,
+    /// Shared loops to spread streams over; 0 gives each stream its own RT thread.
+    pub shared: u32,
+}
+
+impl Default for Options {
+    fn default() -> Options {
+        Options { engine: Engine::Blocking, periods: DEFAULT_PERIODS, autotune: false, shared: 0 }
+    }
+}
+
+impl Options {
+    pub fn parse(spec: &str) -> Result<Options> {
+        let mut o = Options::default();
+        let mut blocking = false;
+        for opt in spec.split(',').map(str::trim).filter(|s| !s.is_empty()) {
+            match opt.split_once('=') {
+                None if opt == "blocking" => blocking = true,
+                None if opt == "poll" => o.engine = Engine::Poll,
+                None if opt == "autotune" => o.autotune = true,
+                None if opt == "shared" => o.shared = 1,
+                Some(("shared", n)) => {
+                    let max = evloop::MAX_LOOPS as u32;
+                    o.shared = n
+                        .parse()
+                        .ok()
+                        .filter(|n| (1..=max).contains(n))
+                        .ok_or(format!("shared={n}: expected 1 to {max}"))?
+                }
+                Some(("periods", n)) => {
+                    o.periods = n
+                        .parse()
+                        .ok()
+                        .filter(|n| (2..=MAX_PERIODS).contains(n))
+                        .ok_or(format!("periods={n}: expected 2 to {MAX_PERIODS}"))?
+                }
+                _ => return Err(format!("unknown option {opt:?}")),
+            }
+        }
+        if o.shared > 0 {
+            if blocking {
+                return Err("shared loops run on the poll engine, not blocking".into());
+            }
+            o.engine = Engine::Poll;
+        } else if blocking {
+            o.engine = Engine::Blocking;
+        }
+        Ok(o)
+    }
+
+    /// `OPENASIO_ALSA`, or the defaults if it is unset.
+    pub fn from_env() -> Result<Options> {
+        match std::env::var(OPTIONS_ENV) {
+            Ok(spec) => Options::parse(&spec).map_err(|e| format!("{OPTIONS_ENV}: {e}")),
+            Err(_) => Ok(Options::default()),
+        }
+    }
+}
+
+/// Hardware parameters of a stream; both directions share all but the channel count.
+pub struct Setup {
+    pub rate: u32,
+    /// 0 if the pair has no capture PCM.
+    pub in_channels: u32,
+    pub out_channels: u32,
+    pub format: Format,
+    pub sample_bytes: usize,
+    pub access: Access,
+    /// Frames per wakeup: the stream's period, or a batch of them.
+    pub period: u32,
+}
+
+/// One wakeup of device samples: interleaved bytes, or one plane pointer per channel for
+/// `RWNonInterleaved` access.
+pub enum Samples<'a> {
+    Interleaved(&'a mut [u8]),
+    Planar(&'a mut [*mut u8]),
+}
+
+pub struct Duplex {
+    pub cap: Option<PCM>,
+    pub pb: Option<PCM>,
+    opts: Options,
+    linked: bool,
+    access: Access,
+    rate: u32,
+    period: usize,
+    sample_bytes: usize,
+    frame_bytes: usize, // playback
+    silence: Buf<u8>,   // one wakeup of playback, for prefills
+    silence_planes: Buf<*const u8>,
+    fds: Buf<pollfd>, // capture's descriptors, then playback's (poll engine)
+    cap_fds: usize,
+    pb_fds: usize,
+    waiting: Buf<pollfd>, // descriptors of the directions not ready yet, reused every wait
+    armed_cap: usize,     // how many of the last arm's descriptors are capture's
+    gap: Cell<Gap>,       // what recoveries cost since the last take_gap
+    failed: Cell<bool>,
+}
+
+/// Where [`Duplex::plan`] put the engine's buffers, for [`Duplex::place`].
+pub struct Parts {
+    silence: Part<u8>,
+    silence_planes: Part<*const u8>,
+    fds: Part<pollfd>,
+    waiting: Part<pollfd>,
+}
+
+/// An xrun (EPIPE) or a suspended device (ESTRPIPE): what [`Duplex::recover`] handles.
+pub fn is_xrun(e: &alsa::Error) -> bool {
+    let errno = e.errno();
+    errno == nix::errno::Errno::EPIPE as i32 || errno == nix::errno::Errno::ESTRPIPE as i32
+}
+
+// Where a PCM stood when it stopped: the time, and how far the hardware pointer was past
+// the application's. Positive: captured frames not read, or frames played past the last
+// write; negative: playback still queued. A PCM still running is taken as of now, as it is
+// about to be dropped.
+fn halted(pcm: &PCM, dir: Direction) -> (u64, i64) {
+    let Ok(status) = pcm.status() else {
+        return (clock::monotonic_ns(), 0);
+    };
+    let at = match status.get_state() {
+        State::XRun | State::Suspended => clock::timespec_ns(&status.get_trigger_htstamp()),
+        _ => clock::timespec_ns(&status.get_htstamp()),
+    };
+    let ahead = match dir {
+        Direction::Capture => status.get_avail() as i64,
+        Direction::Playback => -(status.get_delay() as i64),
+    };
+    (if at == 0 { clock::monotonic_ns() } else { at }, ahead)
+}
+
+// When a PCM last started running.
+fn started(pcm: &PCM) -> u64 {
+    let at = pcm.status().map_or(0, |s| clock::timespec_ns(&s.get_trigger_htstamp()));
+    if at == 0 { clock::monotonic_ns() } else { at }
+}
+
+pub fn accepts_access(pcm: &PCM, access: Access) -> bool {
+    HwParams::any(pcm)
+        .map(|hwp| hwp.test_access(access).is_ok())
+        .unwrap_or(false)
+}
+
+/// `(min, max)` frames per wakeup `hwp` takes with a ring of `periods` of them, for the
+/// buffer_frames range of `query_config_space`.
+pub fn period_range(hwp: &HwParams, periods: u32) -> Option<(u32, u32)> {
+    let max = hwp
+        .get_period_size_max()
+        .ok()?
+        .min(hwp.get_buffer_size_max().ok()? / periods.max(1) as Frames);
+    let min = hwp.get_period_size_min().ok()?.max(1);
+    Some((min.clamp(0, u32::MAX as Frames) as u32, max.clamp(0, u32::MAX as Frames) as u32))
+}
+
+/// Points the mmap channel `areas` at the interleaved frames at `base`.
+pub fn publish_areas(areas: &mut [sys::oa_mmap_channel], base: *mut u8, sample_bytes: usize) {
+    let step = (areas.len() * sample_bytes) as u32;
+    for (c, area) in areas.iter_mut().enumerate() {
+        area.addr = base.wrapping_add(c * sample_bytes) as *mut c_void;
+        area.step = step;
+    }
+}
+
+fn hw_setup(pcm: &PCM, channels: u32, s: &Setup, periods: u32, engine: Engine) -> Result<()> {
+    let hwp = HwParams::any(pcm).map_err(|e| e.to_string())?;
+    hwp.set_access(s.access).map_err(|e| e.to_string())?;
+    hwp.set_channels(channels).map_err(|e| e.to_string())?;
+    hwp.set_rate(s.rate, ValueOr::Nearest).map_err(|e| e.to_string())?;
+    hwp.set_format(s.format).map_err(|e| e.to_string())?;
+    let period = s.period as Frames;
+    hwp.set_period_size(period, ValueOr::Nearest)
+        .map_err(|e| e.to_string())?;
+    hwp.set_buffer_size(period * periods as Frames)
+        .map_err(|e| e.to_string())?;
+    pcm.hw_params(&hwp).map_err(|e| e.to_string())?;
+    // Nearest may round to another rate or period; these PCMs carry native samples with no
+    // float stage to convert on, and the callers size every wakeup, buffer and latency by
+    // `s.period`, so either is a refusal rather than a silently different stream. A tuner
+    // then moves on to its next profile.
+    let current = pcm.hw_params_current().map_err(|e| e.to_string())?;
+    let rate = current.get_rate().map_err(|e| e.to_string())?;
+    if rate != s.rate {
+        return Err(format!("device runs at {rate} Hz, not {} Hz", s.rate));
+    }
+    let granted = current.get_period_size().map_err(|e| e.to_string())?;
+    if granted != period {
+        return Err(format!("device wakes every {granted} frames, not {period}"));
+    }
+
+    let swp = pcm.sw_params_current().map_err(|e| e.to_string())?;
+    // The blocking engine lets the first full wakeup start playback; the poll engine starts
+    // the linked pair itself, so no write ever does.
+    let start = match engine {
+        Engine::Blocking => period,
+        Engine::Poll => swp.get_boundary().map_err(|e| e.to_string())?,
+    };
+    swp.set_start_threshold(start).map_err(|e| e.to_string())?;
+    swp.set_avail_min(period).map_err(|e| e.to_string())?;
+    // Status snapshots carry a CLOCK_MONOTONIC timestamp of the hardware pointer.
+    swp.set_tstamp_mode(true).map_err(|e| e.to_string())?;
+    swp.set_tstamp_type(TstampType::Monotonic)
+        .map_err(|e| e.to_string())?;
+    pcm.sw_params(&swp).map_err(|e| e.to_string())?;
+    Ok(())
+}
+
+// Device position relative to the first frame of the current wakeup. For capture `read` is
+// how many of its frames have already been read from the device.
+fn stamp(pcm: &PCM, dir: Direction, read: usize) -> Option<Stamp> {
+    let status = pcm.status().ok()?;
+    let host_ns = clock::timespec_ns(&status.get_htstamp());
+    if host_ns == 0 {
+        return None;
+    }
+    let offset = match dir {
+        Direction::Capture => read as i64 + status.get_avail() as i64,
+        Direction::Playback => -(status.get_delay() as i64),
+    };
+    Some(Stamp {
+        host_ns,
+        device_ns: clock::timespec_ns(&status.get_audio_htstamp()),
+        offset,
+        hardware: true,
+    })
+}
+
+impl Duplex {
+    pub fn new(opts: Options) -> Duplex {
+        Duplex {
+            cap: None,
+            pb: None,
+            opts,
+            linked: false,
+            access: Access::RWInterleaved,
+            rate: 0,
+            period: 0,
+            sample_bytes: 0,
+            frame_bytes: 0,
+            silence: Buf::default(),
+            silence_planes: Buf::default(),
+            fds: Buf::default(),
+            cap_fds: 0,
+            pb_fds: 0,
+            waiting: Buf::default(),
+            armed_cap: 0,
+            gap: Cell::new(Gap::default()),
+            failed: Cell::new(false),
+        }
+    }
+
+    pub fn options(&self) -> Options {
+        self.opts
+    }
+
+    /// Ring size for the next configure.
+    pub fn set_periods(&mut self, periods: u32) {
+        self.opts.periods = periods.clamp(2, MAX_PERIODS);
+    }
+
+    /// Frames of playback queued ahead of the wakeup being written: the rest of the ring.
+    pub fn output_latency(&self, wake_frames: u32) -> u32 {
+        wake_frames * (self.opts.periods - 1)
+    }
+
+    /// Opens playback on `name`, plus capture if `capture`, keeping handles that are
+    /// already open. Returns an `OA_*` code.
+    pub fn open(&mut self, name: &str, capture: bool) -> i32 {
+        if self.pb.is_none() {
+            match PCM::new(name, Direction::Playback, false) {
+                Ok(p) => self.pb = Some(p),
+                Err(_) => return sys::OA_ERR_DEVICE,
+            }
+        }
+        if !capture {
+            self.cap = None;
+            self.linked = false;
+        } else if self.cap.is_none() {
+            match PCM::new(name, Direction::Capture, false) {
+                Ok(c) => self.cap = Some(c),
+                Err(_) => return sys::OA_ERR_DEVICE,
+            }
+        }
+        sys::OA_OK
+    }
+
+    pub fn close(&mut self) {
+        self.cap = None;
+        self.pb = None;
+        self.linked = false;
+        self.fds = Buf::default();
+        (self.cap_fds, self.pb_fds) = (0, 0);
+    }
+
+    /// Stops both PCMs immediately; the handles stay open for the next configure.
+    pub fn halt(&self) {
+        for pcm in [self.pb.as_ref(), self.cap.as_ref()].into_iter().flatten() {
+            let _ = pcm.drop();
+        }
+    }
+
+    /// Stops both PCMs and prepares them again: same hardware parameters, ready to start.
+    pub fn rewind(&self) -> bool {
+        [self.pb.as_ref(), self.cap.as_ref()]
+            .into_iter()
+            .flatten()
+            .all(|pcm| pcm.drop().and_then(|_| pcm.prepare()).is_ok())
+    }
+
+    /// Applies `s` to the open PCMs, with a ring of `Options::periods` wakeups. Fails if a
+    /// PCM would run at another rate or period than `s` asks for; on error the PCMs are left
+    /// unconfigured. The stream runs once the driver has [`Duplex::place`]d the engine's
+    /// buffers in its arena.
+    pub fn configure(&mut self, s: &Setup) -> Result<()> {
+        if s.period == 0 {
+            return Err("invalid buffer size".into());
+        }
+        let Some(pb) = self.pb.as_ref() else {
+            return Err("device not open".into());
+        };
+        if self.linked {
+            if let Some(cap) = self.cap.as_ref() {
+                let _ = cap.unlink();
+            }
+            self.linked = false;
+        }
+        let (periods, engine) = (self.opts.periods, self.opts.engine);
+        if let Some(cap) = self.cap.as_ref() {
+            hw_setup(cap, s.in_channels, s, periods, engine)?;
+        }
+        hw_setup(pb, s.out_channels, s, periods, engine)?;
+
+        (self.cap_fds, self.pb_fds) = (0, 0);
+        if engine == Engine::Poll {
+            // Without a link (PCMs on different cards) both are still started back to back
+            // and serviced from the one poll.
+            self.linked = self.cap.as_ref().is_some_and(|cap| cap.link(pb).is_ok());
+            self.cap_fds = self.cap.as_ref().map_or(0, |cap| cap.count());
+            self.pb_fds = pb.count();
+        }
+
+        self.access = s.access;
+        self.rate = s.rate;
+        self.period = s.period as usize;
+        self.sample_bytes = s.sample_bytes;
+        self.frame_bytes = s.out_channels as usize * s.sample_bytes;
+        Ok(())
+    }
+
+    /// Lays out the engine's buffers for wakeups of `period` frames in the stream's `plan`,
+    /// after a [`Duplex::configure`] (which `period` may exceed, to reserve room for it).
+    pub fn plan(&self, plan: &mut Plan, period: usize) -> Parts {
+        let fds = self.cap_fds + self.pb_fds;
+        Parts {
+            silence: plan.buf(period * self.frame_bytes),
+            silence_planes: plan.buf(self.frame_bytes / self.sample_bytes.max(1)),
+            fds: plan.buf(fds),
+            waiting: plan.buf(fds),
+        }
+    }
+
+    /// Cuts the buffers [`Duplex::plan`] laid out from the stream's `arena` (mapped zeroed)
+    /// and fetches the PCMs' poll descriptors into them.
+    pub fn place(&mut self, arena: &Arena, parts: Parts) -> Result<()> {
+        self.silence = arena.get(parts.silence);
+        self.silence_planes = arena.get(parts.silence_planes);
+        self.fds = arena.get(parts.fds);
+        self.waiting = arena.get(parts.waiting);
+        let plane_bytes = self.period * self.sample_bytes;
+        for (c, plane) in self.silence_planes.iter_mut().enumerate() {
+            *plane = self.silence[c * plane_bytes..].as_ptr();
+        }
+        let (cap_fds, pb_fds) = self.fds.split_at_mut(self.cap_fds);
+        if let (Some(cap), false) = (self.cap.as_ref(), cap_fds.is_empty()) {
+            self.cap_fds = cap.fill(cap_fds).map_err(|e| e.to_string())?;
+        }
+        if let (Some(pb), false) = (self.pb.as_ref(), pb_fds.is_empty()) {
+            self.pb_fds = pb.fill(pb_fds).map_err(|e| e.to_string())?;
+        }
+        Ok(())
+    }
+
+    // Writes up to `limit` wakeups of silence into the free part of the playback ring.
+    // Returns the frames written.
+    fn prefill(&self, limit: usize) -> Option<usize> {
+        let pb = self.pb.as_ref()?;
+        let frames = self.period;
+        let periods = (pb.avail_update().ok()? as usize / frames.max(1)).min(limit);
+        let io = pb.io_bytes();
+        let ok = (0..periods).all(|_| {
+            let res = match self.access {
+                Access::MMapInterleaved => io.mmap(frames, |buf| {
+                    buf.fill(0);
+                    buf.len() / self.frame_bytes.max(1)
+                }),
+                Access::RWNonInterleaved => unsafe { io.writen(&self.silence_planes, frames) },
+                _ => io.writei(&self.silence),
+            };
+            res.is_ok()
+        });
+        ok.then_some(periods * frames)
+    }
+
+    /// Starts the prepared PCMs on a full ring of silence, so the first wakeup has the
+    /// whole ring of headroom.
+    pub fn start(&self) -> bool {
+        self.gap.set(Gap::default());
+        self.failed.set(false);
+        self.prefill(usize::MAX).is_some() && self.trigger()
+    }
+
+    // Starts capture (and with it a linked playback), then playback if it is still waiting.
+    fn trigger(&self) -> bool {
+        if let Some(cap) = self.cap.as_ref() {
+            if cap.start().is_err() {
+                return false;
+            }
+        }
+        match self.pb.as_ref() {
+            Some(pb) => pb.state() != State::Prepared || pb.start().is_ok(),
+            None => false,
+        }
+    }
+
+    /// Recovers from an xrun in the direction of `xrun` (`errno` from the failed call) and
+    /// counts it. The blocking engine restarts that direction alone; the poll engine
+    /// restarts the pair. Playback restarts one wakeup short of a full ring of silence,
+    /// which the wakeup in progress tops up. False, with [`Duplex::failed`] set, if the
+    /// device did not come back.
+    pub fn recover(&self, xrun: Xrun, errno: i32, stats: &StreamStats) -> bool {
+        stats.xrun(xrun);
+        let poll = self.opts.engine == Engine::Poll;
+        let cap = self.cap.as_ref().filter(|_| poll || xrun == Xrun::Overrun);
+        let pb = self.pb.as_ref().filter(|_| poll || xrun == Xrun::Underrun);
+        let cap_halt = cap.map(|c| halted(c, Direction::Capture));
+        let pb_halt = pb.map(|p| halted(p, Direction::Playback));
+        let failing = if xrun == Xrun::Overrun { cap } else { pb };
+        // snd_pcm_recover prepares after EPIPE and resumes a suspended device first.
+        let mut ok = failing.is_some_and(|pcm| pcm.recover(errno, true).is_ok());
+        let mut preroll = 0;
+        if ok {
+            ok = match (poll, xrun) {
+                (true, _) => {
+                    let filled = self.rewind().then(|| self.prefill(self.opts.periods as usize - 1)).flatten();
+                    preroll = filled.unwrap_or(0);
+                    filled.is_some() && self.trigger()
+                }
+                (false, Xrun::Overrun) => cap.is_some_and(|c| c.start().is_ok()),
+                // Playback starts once the prefill reaches the start threshold.
+                (false, Xrun::Underrun) => {
+                    let filled = self.prefill(self.opts.periods as usize - 1);
+                    preroll = filled.unwrap_or(0);
+                    filled.is_some()
+                }
+            };
+        }
+        if !ok {
+            self.failed.set(true);
+            return false;
+        }
+        let mut gap = Gap::default();
+        if let (Some(c), Some((at, ahead))) = (cap, cap_halt) {
+            let stopped = clock::ns_frames(started(c).saturating_sub(at), self.rate);
+            gap.in_dropped = (ahead.max(0) as u32).saturating_add(stopped);
+        }
+        if let (Some(p), Some((at, ahead))) = (pb, pb_halt) {
+            // A blocking playback still waiting for its threshold starts with the next write.
+            let start = if p.state() == State::Running { started(p) } else { clock::monotonic_ns() };
+            let stopped = clock::ns_frames(start.saturating_sub(at), self.rate);
+            gap.out_dropped = (-ahead).max(0) as u32;
+            gap.out_inserted = (ahead.max(0) as u32).saturating_add(stopped).saturating_add(preroll as u32);
+        }
+        let mut total = self.gap.get();
+        total.add(gap);
+        self.gap.set(total);
+        true
+    }
+
+    // An error from a PCM call in the direction of `xrun`: an xrun is recovered (true if it
+    // was); a device that went away or was left unusable fails the stream.
+    fn fault(&self, xrun: Xrun, e: &alsa::Error, stats: &StreamStats) -> bool {
+        if is_xrun(e) {
+            return self.recover(xrun, e.errno(), stats);
+        }
+        let errno = e.errno();
+        if errno == nix::errno::Errno::ENODEV as i32 || errno == nix::errno::Errno::EBADFD as i32 {
+            self.failed.set(true);
+        }
+        false
+    }
+
+    /// What recoveries cost the stream since the last call, for the next period's
+    /// [`clock::StreamClock::discontinuity`].
+    pub fn take_gap(&self) -> Gap {
+        self.gap.take()
+    }
+
+    /// A recovery could not restart the device, or it went away; the stream needs the host
+    /// to reset it. Cleared by [`Duplex::start`].
+    pub fn failed(&self) -> bool {
+        self.failed.get()
+    }
+
+    /// Waits until the next wakeup can be serviced: a wakeup to read from capture and room
+    /// for one in playback. False on timeout or after a recovered xrun; the caller then
+    /// resyncs its clock and goes back to its gate.
+    pub fn wait(&mut self, stats: &StreamStats) -> bool {
+        match self.opts.engine {
+            Engine::Poll => self.poll_ready(stats),
+            // Blocking reads and writes wait by themselves.
+            Engine::Blocking if self.access != Access::MMapInterleaved => true,
+            Engine::Blocking => {
+                self.cap.as_ref().map_or(true, |cap| self.mmap_wait(cap, Xrun::Overrun, stats))
+                    && self.pb.as_ref().is_some_and(|pb| self.mmap_wait(pb, Xrun::Underrun, stats))
+            }
+        }
+    }
+
+    fn mmap_wait(&self, pcm: &PCM, xrun: Xrun, stats: &StreamStats) -> bool {
+        let res = pcm.avail_update().and_then(|avail| {
+            if avail >= self.period as Frames {
+                Ok(true)
+            } else {
+                pcm.wait(Some(WAIT_MS))
+            }
+        });
+        match res {
+            Ok(ready) => ready,
+            Err(e) => {
+                self.fault(xrun, &e, stats);
+                false
+            }
+        }
+    }
+
+    fn poll_ready(&mut self, stats: &StreamStats) -> bool {
+        let mut waiting = std::mem::take(&mut self.waiting);
+        let ready = loop {
+            let mut n = 0;
+            let armed = self.arm_with(stats, |own| {
+                waiting[n..n + own.len()].copy_from_slice(own);
+                n += own.len();
+            });
+            match armed {
+                Some(Arm::Ready) => break true,
+                Some(_) => {}
+                None => break false,
+            }
+            match poll::poll(&mut waiting[..n], WAIT_MS as i32) {
+                Ok(0) | Err(_) => break false,
+                Ok(_) => {}
+            }
+            self.events(&waiting[..n]);
+        };
+        self.waiting = waiting;
+        ready
+    }
+
+    /// Poll engine, without waiting: `Ready` once capture has a wakeup to read and playback
+    /// room for one, else `Wait` with the descriptors of the directions still short appended
+    /// to `fds` (a ready direction would wake the poll straight away). None after a
+    /// recovered xrun. This is what a shared loop calls in place of [`Duplex::wait`].
+    pub fn arm(&mut self, fds: &mut Vec<pollfd>, stats: &StreamStats) -> Option<Arm> {
+        self.arm_with(stats, |own| fds.extend_from_slice(own))
+    }
+
+    // `arm`, handing each short direction's descriptors to `add`.
+    fn arm_with(&mut self, stats: &StreamStats, mut add: impl FnMut(&[pollfd])) -> Option<Arm> {
+        let frames = self.period as Frames;
+        let mut added = 0;
+        self.armed_cap = 0;
+        let sides = [
+            (self.cap.as_ref(), &self.fds[..self.cap_fds], Xrun::Overrun),
+            (self.pb.as_ref(), &self.fds[self.cap_fds..self.cap_fds + self.pb_fds], Xrun::Underrun),
+        ];
+        for (pcm, own, xrun) in sides {
+            let Some(pcm) = pcm else { continue };
+            match pcm.avail_update() {
+                Ok(avail) if avail >= frames => {}
+                Ok(_) => {
+                    add(own);
+                    added += own.len();
+                }
+                Err(e) => {
+                    self.fault(xrun, &e, stats);
+                    return None;
+                }
+            }
+            if xrun == Xrun::Overrun {
+                self.armed_cap = added;
+            }
+        }
+        Some(if added == 0 { Arm::Ready } else { Arm::Wait })
+    }
+
+    /// The descriptors [`Duplex::arm`] appended came back from a poll. Plugins need their
+    /// events translated; readiness itself is taken from the next `arm`, which also reports
+    /// xruns.
+    pub fn events(&self, fds: &[pollfd]) {
+        let (cap_fds, pb_fds) = fds.split_at(self.armed_cap.min(fds.len()));
+        if let (Some(cap), false) = (self.cap.as_ref(), cap_fds.is_empty()) {
+            let _ = cap.revents(cap_fds);
+        }
+        if let (Some(pb), false) = (self.pb.as_ref(), pb_fds.is_empty()) {
+            let _ = pb.revents(pb_fds);
+        }
+    }
+
+    /// Reads a wakeup of `frames` from capture and returns the frames read. After an
+    /// overrun the blocking engine restarts capture and reads its first wakeup; the poll
+    /// engine restarts the pair and returns 0, and the caller skips the wakeup.
+    pub fn read(&self, mut buf: Samples, frames: usize, stats: &StreamStats) -> usize {
+        let Some(cap) = self.cap.as_ref() else {
+            return 0;
+        };
+        let read = |buf: &mut Samples| {
+            let io = cap.io_bytes();
+            match buf {
+                Samples::Interleaved(bytes) => io.readi(bytes),
+                Samples::Planar(planes) => unsafe { io.readn(planes, frames) },
+            }
+        };
+        match read(&mut buf) {
+            Ok(n) => n.min(frames),
+            Err(e) => {
+                let again = self.fault(Xrun::Overrun, &e, stats) && self.opts.engine == Engine::Blocking;
+                if again { read(&mut buf).map_or(0, |n| n.min(frames)) } else { 0 }
+            }
+        }
+    }
+
+    /// Writes a wakeup of `frames` to playback. True if it hit an underrun; the wakeup is
+    /// then written again behind the silence playback restarted on.
+    pub fn write(&self, mut buf: Samples, frames: usize, stats: &StreamStats) -> bool {
+        let Some(pb) = self.pb.as_ref() else {
+            return false;
+        };
+        let write = |buf: &mut Samples| {
+            let io = pb.io_bytes();
+            match buf {
+                Samples::Interleaved(bytes) => io.writei(bytes),
+                Samples::Planar(planes) => unsafe {
+                    let planes = std::slice::from_raw_parts(planes.as_ptr() as *const *const u8, planes.len());
+                    io.writen(planes, frames)
+                },
+            }
+        };
+        match write(&mut buf) {
+            Err(e) if is_xrun(&e) => {
+                if self.recover(Xrun::Underrun, e.errno(), stats) {
+                    let _ = write(&mut buf);
+                }
+                true
+            }
+            Err(e) => {
+                self.fault(Xrun::Underrun, &e, stats);
+                false
+            }
+            Ok(_) => false,
+        }
+    }
+
+    /// Stamp of the current wakeup, from capture if the stream has it. `read` is how many
+    /// of its frames were already read from capture.
+    pub fn stamp(&self, read: usize) -> Option<Stamp> {
+        match (self.cap.as_ref(), self.pb.as_ref()) {
+            (Some(cap), _) => stamp(cap, Direction::Capture, read),
+            (None, Some(pb)) => stamp(pb, Direction::Playback, 0),
+            (None, None) => None,
+        }
+    }
+}
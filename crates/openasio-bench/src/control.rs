@@ -0,0 +1,90 @@
+//! Microbenchmarks of the control-plane primitives (`openasio_control.h`) as the RT side
+//! calls them, each set against the callback budget: the share of one period it costs.
+
+use crate::kernels::measure;
+use crate::record::{Record, Sink};
+use openasio_sys::control as c;
+use std::os::raw::c_void;
+
+/// Parameter change, state snapshot and 16-channel meter, sized as a host would use them.
+const COMMAND_BYTES: usize = 16;
+const SNAPSHOT_BYTES: usize = 256;
+const METER_BYTES: usize = 64;
+
+/// One operation (or push/pop pair) of each primitive, in ns. The queue is drained as it is
+/// filled, so every push finds room.
+fn run_op(name: &str) -> Option<f64> {
+    let mut item = [0u8; SNAPSHOT_BYTES];
+    let p = item.as_mut_ptr() as *mut c_void;
+    unsafe {
+        Some(match name {
+            "queue_spsc" | "queue_mpsc" => {
+                let mode = if name == "queue_spsc" { c::OA_QUEUE_SPSC } else { c::OA_QUEUE_MPSC };
+                let mut q = std::ptr::null_mut();
+                if c::oa_queue_create(COMMAND_BYTES as u32, 256, mode, &mut q) < 0 { return None; }
+                let ns = measure(1, || { c::oa_queue_push(q, p); c::oa_queue_pop(q, p); });
+                c::oa_queue_destroy(q);
+                ns
+            }
+            "triple_publish" | "triple_read" => {
+                let mut t = std::ptr::null_mut();
+                if c::oa_triple_create(SNAPSHOT_BYTES as u32, std::ptr::null(), &mut t) < 0 { return None; }
+                let ns = if name == "triple_publish" {
+                    measure(1, || {
+                        std::ptr::copy_nonoverlapping(p as *const u8, c::oa_triple_write_buffer(t) as *mut u8, SNAPSHOT_BYTES);
+                        c::oa_triple_publish(t);
+                    })
+                } else {
+                    // Worst case for the reader: a new snapshot every time.
+                    measure(1, || {
+                        c::oa_triple_publish(t);
+                        let mut fresh = 0;
+                        std::ptr::copy_nonoverlapping(c::oa_triple_read(t, &mut fresh) as *const u8, p as *mut u8, SNAPSHOT_BYTES);
+                    })
+                };
+                c::oa_triple_destroy(t);
+                ns
+            }
+            "seqlock_write" | "seqlock_read" => {
+                let mut s = std::ptr::null_mut();
+                if c::oa_seqlock_create(METER_BYTES as u32, &mut s) < 0 { return None; }
+                let ns = if name == "seqlock_write" {
+                    measure(1, || c::oa_seqlock_write(s, p))
+                } else {
+                    measure(1, || { c::oa_seqlock_read(s, p); })
+                };
+                c::oa_seqlock_destroy(s);
+                ns
+            }
+            _ => return None,
+        })
+    }
+}
+
+const OPS: &[(&str, usize)] = &[
+    ("queue_spsc", COMMAND_BYTES),
+    ("queue_mpsc", COMMAND_BYTES),
+    ("triple_publish", SNAPSHOT_BYTES),
+    ("triple_read", SNAPSHOT_BYTES),
+    ("seqlock_write", METER_BYTES),
+    ("seqlock_read", METER_BYTES),
+];
+
+/// Times each primitive and reports it as parts per million of a `frames` period at `rate`.
+pub fn run(sink: &mut Sink, frames: u32, rate: u32) {
+    let period_ns = frames as f64 * 1e9 / rate as f64;
+    for &(name, bytes) in OPS {
+        let Some(ns) = run_op(name) else { continue };
+        let ppm = ns * 1e6 / period_ns;
+        eprintln!("control {name:<15} {bytes:>4} B: {ns:.1} ns, {ppm:.2} ppm of a {frames}-frame period at {rate} Hz");
+        sink.emit(
+            Record::new("control")
+                .set("op", name)
+                .set("bytes", bytes)
+                .set("ns_per_op", ns)
+                .set("frames", frames)
+                .set("sample_rate", rate)
+                .set("budget_ppm", ppm),
+        );
+    }
+}
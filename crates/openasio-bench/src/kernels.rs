@@ -0,0 +1,191 @@
+//! Microbenchmarks of the conversion and interleave kernels (`openasio_convert.h`) and the
+//! sample-rate converter (`openasio_resample.h`) at every SIMD level the CPU supports, on
+//! period-sized blocks that stay in cache.
+
+use crate::record::{Record, Sink};
+use openasio_sys::convert::{self as cv, oa_simd_level};
+use openasio_sys::resample as rs;
+use openasio_sys::{self as sys, oa_sample_format as F};
+use std::os::raw::c_void;
+use std::time::Instant;
+
+const LEVELS: &[(oa_simd_level, &str)] = &[
+    (cv::OA_SIMD_SCALAR, "scalar"),
+    (cv::OA_SIMD_SSE2, "sse2"),
+    (cv::OA_SIMD_AVX2, "avx2"),
+    (cv::OA_SIMD_NEON, "neon"),
+];
+
+/// Each measurement repeats a kernel for at least this long; the best of `ROUNDS` counts.
+const MIN_ROUND_NS: u128 = 20_000_000;
+const ROUNDS: usize = 5;
+
+/// Buffers for one block of `frames` x `channels`, wide enough for any sample format.
+struct Block {
+    frames: usize,
+    channels: usize,
+    f32s: Vec<f32>,
+    raw: Vec<u8>,  // device samples, up to 4 bytes each
+    planes: Vec<f32>,
+}
+
+impl Block {
+    fn new(frames: usize, channels: usize) -> Block {
+        let n = frames * channels;
+        // A ramp over the full scale, so clipping and rounding paths all run.
+        let f32s = (0..n).map(|i| (i as f32 / n as f32) * 2.2 - 1.1).collect();
+        Block { frames, channels, f32s, raw: vec![0; n * 4], planes: vec![0.0; n] }
+    }
+
+    fn samples(&self) -> usize {
+        self.frames * self.channels
+    }
+}
+
+/// Best time per sample of `f`, in ns.
+pub fn measure(samples: usize, mut f: impl FnMut()) -> f64 {
+    let mut reps = 1u64;
+    let mut best = f64::INFINITY;
+    for _ in 0..ROUNDS {
+        loop {
+            let t0 = Instant::now();
+            for _ in 0..reps {
+                f();
+            }
+            let dt = t0.elapsed().as_nanos();
+            if dt >= MIN_ROUND_NS {
+                best = best.min(dt as f64 / (reps as f64 * samples as f64));
+                break;
+            }
+            reps = reps.saturating_mul(2);
+        }
+    }
+    best
+}
+
+fn run_kernel(name: &str, b: &mut Block) -> Option<f64> {
+    let n = b.samples();
+    let (fr, ch) = (b.frames, b.channels);
+    let from = |fmt: F, b: &mut Block| {
+        measure(n, || unsafe {
+            cv::oa_convert_from_f32(fmt, b.raw.as_mut_ptr() as *mut c_void, b.f32s.as_ptr(), n, std::ptr::null_mut());
+        })
+    };
+    let to = |fmt: F, b: &mut Block| {
+        unsafe { cv::oa_convert_from_f32(fmt, b.raw.as_mut_ptr() as *mut c_void, b.f32s.as_ptr(), n, std::ptr::null_mut()) };
+        measure(n, || unsafe {
+            cv::oa_convert_to_f32(b.f32s.as_mut_ptr(), fmt, b.raw.as_ptr() as *const c_void, n);
+        })
+    };
+    let plane_ptrs = |b: &mut Block| -> Vec<*mut f32> {
+        (0..ch).map(|c| unsafe { b.planes.as_mut_ptr().add(c * fr) }).collect()
+    };
+    Some(match name {
+        "f32_to_i16" => from(F::OA_SAMPLE_I16, b),
+        "f32_to_i16_dither" => {
+            let mut d = cv::oa_dither { state: 0 };
+            unsafe { cv::oa_dither_init(&mut d, 1) };
+            measure(n, || unsafe {
+                cv::oa_convert_from_f32(F::OA_SAMPLE_I16, b.raw.as_mut_ptr() as *mut c_void, b.f32s.as_ptr(), n, &mut d);
+            })
+        }
+        "f32_to_i24_3le" => from(F::OA_SAMPLE_I24_3LE, b),
+        "f32_to_i24_in_32" => from(F::OA_SAMPLE_I24_IN_32, b),
+        "f32_to_i32" => from(F::OA_SAMPLE_I32, b),
+        "i16_to_f32" => to(F::OA_SAMPLE_I16, b),
+        "i24_3le_to_f32" => to(F::OA_SAMPLE_I24_3LE, b),
+        "i24_in_32_to_f32" => to(F::OA_SAMPLE_I24_IN_32, b),
+        "i32_to_f32" => to(F::OA_SAMPLE_I32, b),
+        "interleave_f32" => {
+            let planes = plane_ptrs(b);
+            let dst = b.f32s.as_mut_ptr();
+            measure(n, || unsafe { cv::oa_interleave_f32(dst, planes.as_ptr() as *const *const f32, ch as u32, fr) })
+        }
+        "deinterleave_f32" => {
+            let planes = plane_ptrs(b);
+            let src = b.f32s.as_ptr();
+            measure(n, || unsafe { cv::oa_deinterleave_f32(planes.as_ptr(), src, ch as u32, fr) })
+        }
+        "interleave_i24_3le" => {
+            let planes: Vec<*const c_void> = (0..ch).map(|c| unsafe { b.planes.as_ptr().add(c * fr) } as *const c_void).collect();
+            let dst = b.raw.as_mut_ptr() as *mut c_void;
+            measure(n, || unsafe { cv::oa_interleave_bytes(dst, planes.as_ptr(), ch as u32, fr, 3) })
+        }
+        "resample_48k_44k1" => resample(b, 48000, 44100, rs::OA_RESAMPLE_MEDIUM, 0)?,
+        "resample_48k_44k1_high" => resample(b, 48000, 44100, rs::OA_RESAMPLE_HIGH, 0)?,
+        "resample_drift" => resample(b, 48000, 48000, rs::OA_RESAMPLE_MEDIUM, rs::OA_RESAMPLE_VARIABLE)?,
+        _ => return None,
+    })
+}
+
+/// Time per output sample of converting one block from `in_rate` to `out_rate`; the
+/// variable-ratio case runs at a 100 ppm trim so it interpolates phases.
+fn resample(b: &mut Block, in_rate: u32, out_rate: u32, quality: rs::oa_resample_quality, flags: u32) -> Option<f64> {
+    let (fr, ch) = (b.frames, b.channels);
+    let mut r = std::ptr::null_mut();
+    if unsafe { rs::oa_resampler_create(ch as u32, in_rate, out_rate, quality, flags, &mut r) } != sys::OA_OK {
+        return None;
+    }
+    if flags & rs::OA_RESAMPLE_VARIABLE != 0 {
+        unsafe { rs::oa_resampler_set_trim(r, 1.0001) };
+    }
+    let input: Vec<f32> = b.f32s.iter().cycle().take((fr * in_rate as usize / out_rate as usize + 64) * ch).copied().collect();
+    let out = b.planes.as_mut_ptr();
+    let ns = measure(b.samples(), || unsafe {
+        let need = rs::oa_resampler_input_for(r, fr);
+        let (mut used, mut done) = (0, 0);
+        rs::oa_resampler_process(r, input.as_ptr(), need, &mut used, out, fr, &mut done);
+    });
+    unsafe { rs::oa_resampler_destroy(r) };
+    Some(ns)
+}
+
+const KERNELS: &[&str] = &[
+    "f32_to_i16",
+    "f32_to_i16_dither",
+    "f32_to_i24_3le",
+    "f32_to_i24_in_32",
+    "f32_to_i32",
+    "i16_to_f32",
+    "i24_3le_to_f32",
+    "i24_in_32_to_f32",
+    "i32_to_f32",
+    "interleave_f32",
+    "deinterleave_f32",
+    "interleave_i24_3le",
+    "resample_48k_44k1",
+    "resample_48k_44k1_high",
+    "resample_drift",
+];
+
+/// Runs every kernel at every supported SIMD level for each `(frames, channels)` shape,
+/// then restores the level the library picked.
+pub fn run(sink: &mut Sink, shapes: &[(usize, usize)]) {
+    let auto = unsafe { cv::oa_convert_simd_level() };
+    for &(level, level_name) in LEVELS {
+        if unsafe { cv::oa_convert_set_simd_level(level) } != sys::OA_OK {
+            continue;
+        }
+        for &(frames, channels) in shapes {
+            let mut b = Block::new(frames, channels);
+            for name in KERNELS {
+                let Some(ns) = run_kernel(name, &mut b) else { continue };
+                eprintln!(
+                    "kernel {name:<22} {level_name:<6} {frames:>5}x{channels}: {ns:.3} ns/sample, {:.0} Msamples/s",
+                    1e3 / ns
+                );
+                sink.emit(
+                    Record::new("kernel")
+                        .set("kernel", *name)
+                        .set("simd", level_name)
+                        .set("simd_default", level == auto)
+                        .set("frames", frames)
+                        .set("channels", channels)
+                        .set("ns_per_sample", ns)
+                        .set("msamples_per_s", 1e3 / ns),
+                );
+            }
+        }
+    }
+    unsafe { cv::oa_convert_set_simd_level(auto) };
+}
@@ -0,0 +1,519 @@
+//! openasio-bench: latency, jitter and kernel benchmarks for OpenASIO drivers, written as
+//! JSON lines so that runs on different hardware and kernels can be compared.
+//!
+//! For each driver library it streams a sweep of sample rates and buffer sizes under a
+//! minimal host and records callback interval jitter, xruns and the latency the driver
+//! reports. With `--loopback` (an output wired back to an input) it also sends an impulse
+//! every quarter second and times its return, which gives the true round trip to set
+//! against `get_latency`. The conversion and interleave kernels are timed at every SIMD
+//! level the CPU has, and the control-plane primitives against a period's budget. A
+//! human-readable summary goes to stderr.
+mod control;
+mod kernels;
+mod record;
+
+use openasio_sys as sys;
+use record::{Record, Sink};
+use std::ffi::CString;
+use std::os::raw::c_void;
+use std::process::ExitCode;
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+use std::time::Duration;
+
+const USAGE: &str = "usage: openasio-bench [options] [driver.so ...]
+  --device NAME      device passed to open_device (default: driver default)
+  --rates LIST       comma-separated sample rates to sweep (default: driver default)
+  --frames LIST      comma-separated buffer sizes to sweep (default 64,128,256,512)
+  --seconds N        streaming time per sweep point (default 5)
+  --in N / --out N   channel counts (default: driver default config)
+  --loopback OUT:IN  time an impulse from output channel OUT back to input IN (0-based)
+  --threshold X      input level that counts as the impulse's arrival (default 0.1)
+  --fifo PRIO        ask for SCHED_FIFO at PRIO on the driver thread
+  --kernels          also benchmark the conversion, resampler and control-plane kernels
+                     (always run without drivers)
+  --json FILE        write the JSON lines to FILE instead of stdout
+  --label TEXT       tag stored in every record, e.g. a host or kernel build name";
+
+/// Interval histogram: 10 us bins up to 50 ms, as in openasio-rtcheck.
+const BIN_NS: u64 = 10_000;
+const BINS: usize = 5000;
+/// Round trips kept per sweep point (four per second of streaming fills this in 4 min).
+const MAX_TRIPS: usize = 1024;
+const IMPULSE: f32 = 0.9;
+const NONE: u64 = u64::MAX;
+
+#[allow(clippy::declare_interior_mutable_const)]
+const ZERO: AtomicU32 = AtomicU32::new(0);
+
+/// Measurement state of one sweep point. Written only by the RT thread, without
+/// allocation; the control thread reads it after stop().
+struct Probe {
+    rate: u64,
+    loopback: Option<(usize, usize)>,
+    threshold: f32,
+    interval: u64, // frames between impulses
+    callbacks: AtomicU64,
+    last_ns: AtomicU64,
+    last_frames: AtomicU64,
+    jitter: [AtomicU32; BINS], // |interval - duration of the previous callback's frames|
+    underruns: AtomicU32,
+    overruns: AtomicU32,
+    position: AtomicU64,  // frames processed so far
+    sent: AtomicU64,      // position of the impulse in flight, NONE if none
+    next_send: AtomicU64,
+    trips: [AtomicU32; MAX_TRIPS],
+    trip_count: AtomicU32,
+    misses: AtomicU32,
+}
+
+impl Probe {
+    fn new(rate: u32, loopback: Option<(usize, usize)>, threshold: f32) -> Probe {
+        let interval = rate as u64 / 4;
+        Probe {
+            rate: rate as u64,
+            loopback,
+            threshold,
+            interval,
+            callbacks: AtomicU64::new(0),
+            last_ns: AtomicU64::new(0),
+            last_frames: AtomicU64::new(0),
+            jitter: [ZERO; BINS],
+            underruns: AtomicU32::new(0),
+            overruns: AtomicU32::new(0),
+            position: AtomicU64::new(0),
+            sent: AtomicU64::new(NONE),
+            next_send: AtomicU64::new(interval),
+            trips: [ZERO; MAX_TRIPS],
+            trip_count: AtomicU32::new(0),
+            misses: AtomicU32::new(0),
+        }
+    }
+
+    /// Looks for the impulse in this period's input, then sends the next one if due.
+    unsafe fn loopback(&self, inp: *const f32, out: *mut f32, frames: usize, cfg: &sys::oa_stream_config) {
+        let Some((och_sel, ich_sel)) = self.loopback else { return };
+        let (ich, och) = (cfg.in_channels as usize, cfg.out_channels as usize);
+        let pos = self.position.load(Ordering::Relaxed);
+        let sent = self.sent.load(Ordering::Relaxed);
+        if sent != NONE && !inp.is_null() {
+            let arrived = (0..frames).find(|&f| (*inp.add(f * ich + ich_sel)).abs() >= self.threshold);
+            if let Some(f) = arrived {
+                let n = self.trip_count.load(Ordering::Relaxed) as usize;
+                if n < MAX_TRIPS {
+                    self.trips[n].store((pos + f as u64 - sent) as u32, Ordering::Relaxed);
+                    self.trip_count.store(n as u32 + 1, Ordering::Relaxed);
+                }
+                self.sent.store(NONE, Ordering::Relaxed);
+            } else if pos + frames as u64 - sent > self.interval {
+                self.misses.fetch_add(1, Ordering::Relaxed);
+                self.sent.store(NONE, Ordering::Relaxed);
+            }
+        }
+        if self.sent.load(Ordering::Relaxed) == NONE && pos >= self.next_send.load(Ordering::Relaxed) && !out.is_null() {
+            *out.add(och_sel.min(och.saturating_sub(1))) = IMPULSE;
+            self.sent.store(pos, Ordering::Relaxed);
+            self.next_send.store(pos + self.interval, Ordering::Relaxed);
+        }
+    }
+}
+
+fn now_ns() -> u64 {
+    let mut ts = libc::timespec { tv_sec: 0, tv_nsec: 0 };
+    unsafe {
+        libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts);
+    }
+    ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+}
+
+unsafe extern "C" fn process(
+    user: *mut c_void,
+    inp: *const c_void,
+    out: *mut c_void,
+    frames: u32,
+    time: *const sys::oa_time_info,
+    cfg: *const sys::oa_stream_config,
+) -> sys::oa_bool {
+    let p = &*(user as *const Probe);
+    let t0 = now_ns();
+    let n = p.callbacks.fetch_add(1, Ordering::Relaxed);
+    let last = p.last_ns.swap(t0, Ordering::Relaxed);
+    let last_frames = p.last_frames.swap(frames as u64, Ordering::Relaxed);
+    if n > 0 {
+        // Callback sizes may vary (cpal), so each interval is held against the frames the
+        // previous callback covered.
+        let nominal = last_frames * 1_000_000_000 / p.rate.max(1);
+        let dev = t0.saturating_sub(last).abs_diff(nominal);
+        let i = ((dev / BIN_NS) as usize).min(BINS - 1);
+        p.jitter[i].fetch_add(1, Ordering::Relaxed);
+    }
+    if !time.is_null() {
+        p.underruns.store((*time).underruns, Ordering::Relaxed);
+        p.overruns.store((*time).overruns, Ordering::Relaxed);
+    }
+    if !out.is_null() && !cfg.is_null() {
+        let cfg = &*cfg;
+        std::ptr::write_bytes(out as *mut f32, 0, frames as usize * cfg.out_channels as usize);
+        p.loopback(inp as *const f32, out as *mut f32, frames as usize, cfg);
+    }
+    p.position.fetch_add(frames as u64, Ordering::Relaxed);
+    sys::OA_TRUE
+}
+
+/// (p50, p99, max) in microseconds, at bin resolution.
+fn summarize(hist: &[AtomicU32; BINS]) -> (f64, f64, f64) {
+    let counts: Vec<u64> = hist.iter().map(|b| b.load(Ordering::Relaxed) as u64).collect();
+    let total: u64 = counts.iter().sum();
+    let us = |i: usize| ((i as u64 + 1) * BIN_NS) as f64 / 1000.0;
+    let pct = |p: f64| {
+        let want = ((total as f64) * p).ceil().max(1.0) as u64;
+        let mut seen = 0;
+        for (i, c) in counts.iter().enumerate() {
+            seen += c;
+            if seen >= want {
+                return us(i);
+            }
+        }
+        0.0
+    };
+    let max = counts.iter().rposition(|c| *c > 0).map_or(0.0, us);
+    (pct(0.50), pct(0.99), max)
+}
+
+struct Args {
+    drivers: Vec<String>,
+    device: Option<String>,
+    rates: Vec<u32>,
+    frames: Vec<u32>,
+    seconds: f64,
+    in_ch: Option<u16>,
+    out_ch: Option<u16>,
+    loopback: Option<(usize, usize)>,
+    threshold: f32,
+    fifo: Option<i32>,
+    kernels: bool,
+    json: Option<String>,
+    label: Option<String>,
+}
+
+fn parse_list(s: &str, flag: &str) -> Result<Vec<u32>, String> {
+    s.split(',').map(|v| v.trim().parse().map_err(|_| format!("{flag}: bad value {v}"))).collect()
+}
+
+fn parse_args() -> Result<Args, String> {
+    let mut a = Args {
+        drivers: Vec::new(),
+        device: None,
+        rates: Vec::new(),
+        frames: vec![64, 128, 256, 512],
+        seconds: 5.0,
+        in_ch: None,
+        out_ch: None,
+        loopback: None,
+        threshold: 0.1,
+        fifo: None,
+        kernels: false,
+        json: None,
+        label: None,
+    };
+    let mut it = std::env::args().skip(1);
+    fn val<T: std::str::FromStr>(it: &mut impl Iterator<Item = String>, flag: &str) -> Result<T, String> {
+        it.next()
+            .and_then(|v| v.parse().ok())
+            .ok_or_else(|| format!("{flag} needs a value"))
+    }
+    while let Some(arg) = it.next() {
+        match arg.as_str() {
+            "--device" => a.device = Some(val(&mut it, &arg)?),
+            "--rates" => a.rates = parse_list(&val::<String>(&mut it, &arg)?, &arg)?,
+            "--frames" => a.frames = parse_list(&val::<String>(&mut it, &arg)?, &arg)?,
+            "--seconds" => a.seconds = val(&mut it, &arg)?,
+            "--in" => a.in_ch = Some(val(&mut it, &arg)?),
+            "--out" => a.out_ch = Some(val(&mut it, &arg)?),
+            "--loopback" => {
+                let v: String = val(&mut it, &arg)?;
+                let pair = v.split_once(':').and_then(|(o, i)| Some((o.parse().ok()?, i.parse().ok()?)));
+                a.loopback = Some(pair.ok_or(format!("--loopback wants OUT:IN, not {v}"))?);
+            }
+            "--threshold" => a.threshold = val(&mut it, &arg)?,
+            "--fifo" => a.fifo = Some(val(&mut it, &arg)?),
+            "--kernels" => a.kernels = true,
+            "--json" => a.json = Some(val(&mut it, &arg)?),
+            "--label" => a.label = Some(val(&mut it, &arg)?),
+            "-h" | "--help" => return Err(String::new()),
+            s if s.starts_with("--") => return Err(format!("unknown option {s}")),
+            s => a.drivers.push(s.to_string()),
+        }
+    }
+    if a.frames.is_empty() || a.frames.contains(&0) {
+        return Err("--frames needs sizes above 0".into());
+    }
+    a.kernels |= a.drivers.is_empty();
+    Ok(a)
+}
+
+fn check(what: &str, rc: i32) -> Result<(), String> {
+    if rc == sys::OA_OK {
+        Ok(())
+    } else {
+        Err(format!("{what} failed ({rc})"))
+    }
+}
+
+fn read_trim(path: &str) -> Option<String> {
+    std::fs::read_to_string(path).ok().map(|s| s.trim().to_string())
+}
+
+/// What the results depend on besides the driver: kernel, CPU and its frequency policy.
+fn environment() -> Record {
+    let mut u: libc::utsname = unsafe { std::mem::zeroed() };
+    let field = |f: &[libc::c_char]| unsafe { std::ffi::CStr::from_ptr(f.as_ptr()) }.to_string_lossy().into_owned();
+    let (release, version, machine, node) = if unsafe { libc::uname(&mut u) } == 0 {
+        (field(&u.release), field(&u.version), field(&u.machine), field(&u.nodename))
+    } else {
+        Default::default()
+    };
+    let cpu = std::fs::read_to_string("/proc/cpuinfo").ok().and_then(|s| {
+        s.lines()
+            .find(|l| l.starts_with("model name") || l.starts_with("Model"))
+            .and_then(|l| l.split_once(':'))
+            .map(|(_, v)| v.trim().to_string())
+    });
+    let secs = std::time::SystemTime::now().duration_since(std::time::UNIX_EPOCH).map_or(0, |d| d.as_secs());
+    Record::new("env")
+        .set("tool_version", env!("CARGO_PKG_VERSION"))
+        .set("unix_time", secs)
+        .set("host", node)
+        .set("kernel", release)
+        .set("kernel_version", version)
+        .set("machine", machine)
+        .set("cpu", cpu)
+        .set("cpus", std::thread::available_parallelism().map_or(1, |n| n.get()))
+        .set("governor", read_trim("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor"))
+        .set("simd", unsafe { sys::convert::oa_convert_simd_level() })
+}
+
+/// Streams one sweep point and returns its record.
+unsafe fn run_point(
+    a: &Args,
+    path: &str,
+    drv: *mut sys::oa_driver,
+    probe: &Probe,
+    cfg: &sys::oa_stream_config,
+) -> Result<Record, String> {
+    let vt = &*(*drv).vt;
+    let start = vt.start.ok_or("driver has no start")?;
+    check("start", start(drv, cfg))?;
+    std::thread::sleep(Duration::from_secs_f64(a.seconds));
+    // Measured before stop: cpal derives the figure from the running stream.
+    let (mut in_lat, mut out_lat) = (0u32, 0u32);
+    let lat_ok = vt.get_latency.map_or(false, |f| f(drv, &mut in_lat, &mut out_lat) == sys::OA_OK);
+    let stats = sys::oa_vt_get!(vt, get_stream_stats).and_then(|get| {
+        let mut s = std::mem::MaybeUninit::<sys::oa_stream_stats>::zeroed();
+        (*s.as_mut_ptr()).struct_size = std::mem::size_of::<sys::oa_stream_stats>() as u32;
+        (get(drv, s.as_mut_ptr()) == sys::OA_OK).then(|| s.assume_init())
+    });
+    if let Some(stop) = vt.stop {
+        stop(drv);
+    }
+
+    let callbacks = probe.callbacks.load(Ordering::Relaxed);
+    let expected = a.seconds * cfg.sample_rate as f64 / cfg.buffer_frames as f64;
+    let (overruns, underruns) = match &stats {
+        Some(s) => (s.overruns, s.underruns),
+        None => (probe.overruns.load(Ordering::Relaxed), probe.underruns.load(Ordering::Relaxed)),
+    };
+    let (j50, j99, jmax) = summarize(&probe.jitter);
+    let period_us = cfg.buffer_frames as f64 * 1e6 / cfg.sample_rate as f64;
+    eprintln!(
+        "{path}: {} Hz x {} ({period_us:.0} us): {callbacks} callbacks ({expected:.0} expected), jitter p50 {j50:.0} us, p99 {j99:.0} us, max {jmax:.0} us; overruns {overruns}, underruns {underruns}",
+        cfg.sample_rate, cfg.buffer_frames
+    );
+    let mut r = Record::new("stream")
+        .set("driver", path)
+        .set("device", a.device.clone())
+        .set("sample_rate", cfg.sample_rate)
+        .set("buffer_frames", cfg.buffer_frames)
+        .set("in_channels", cfg.in_channels)
+        .set("out_channels", cfg.out_channels)
+        .set("seconds", a.seconds)
+        .set("callbacks", callbacks)
+        .set("callbacks_expected", expected)
+        .set("jitter_p50_us", j50)
+        .set("jitter_p99_us", j99)
+        .set("jitter_max_us", jmax)
+        .set("overruns", overruns)
+        .set("underruns", underruns)
+        .set("xruns_per_min", (overruns + underruns) as f64 * 60.0 / a.seconds)
+        .set("reported_in_frames", lat_ok.then_some(in_lat))
+        .set("reported_out_frames", lat_ok.then_some(out_lat));
+    if let Some(s) = &stats {
+        r = r
+            .set("driver_jitter_max_us", s.jitter_ns_max as f64 / 1000.0)
+            .set("driver_load_max_pct", s.load_permille_max as f64 / 10.0);
+    }
+    if a.loopback.is_some() {
+        let n = (probe.trip_count.load(Ordering::Relaxed) as usize).min(MAX_TRIPS);
+        let mut trips: Vec<u32> = probe.trips[..n].iter().map(|t| t.load(Ordering::Relaxed)).collect();
+        trips.sort_unstable();
+        let misses = probe.misses.load(Ordering::Relaxed);
+        let median = trips.get(n / 2).copied();
+        let reported = lat_ok.then_some(in_lat + out_lat);
+        match median {
+            Some(m) => eprintln!(
+                "  round trip: median {m} frames ({:.2} ms), min {}, max {}; driver reports {}; {misses} missed",
+                m as f64 * 1e3 / cfg.sample_rate as f64,
+                trips[0],
+                trips[n - 1],
+                reported.map_or("nothing".to_string(), |r| format!("{r} frames")),
+            ),
+            None => eprintln!("  round trip: no impulse came back ({misses} sent); is the loopback wired?"),
+        }
+        r = r
+            .set("trips", n)
+            .set("trip_misses", misses)
+            .set("trip_min_frames", trips.first().copied())
+            .set("trip_median_frames", median)
+            .set("trip_max_frames", trips.last().copied())
+            .set("trip_median_ms", median.map(|m| m as f64 * 1e3 / cfg.sample_rate as f64))
+            .set("reported_total_frames", reported)
+            .set("unreported_frames", median.zip(reported).map(|(m, r)| m as i64 - r as i64).map(|d| d as i32));
+    }
+    Ok(r)
+}
+
+/// Loads `path`, records what it is, and runs the sweep on it.
+fn run_driver(a: &Args, path: &str, sink: &mut Sink) -> Result<(), String> {
+    let lib = unsafe { sys::loader::DriverLib::load(path) }.map_err(|e| e.to_string())?;
+    let callbacks = sys::oa_host_callbacks {
+        process: Some(process),
+        latency_changed: None,
+        reset_request: None,
+        devices_changed: None,
+        process_batch: None,
+    };
+    // Swapped per sweep point while the driver is stopped; the driver keeps `user` itself.
+    let probe = Box::into_raw(Box::new(Probe::new(48000, a.loopback, a.threshold)));
+    let rt = sys::oa_rt_params {
+        struct_size: std::mem::size_of::<sys::oa_rt_params>() as u32,
+        policy: if a.fifo.is_some() { sys::OA_RT_POLICY_FIFO } else { sys::OA_RT_POLICY_DEFAULT },
+        priority: a.fifo.unwrap_or(0),
+        ..Default::default()
+    };
+    let params = sys::oa_create_params {
+        struct_size: std::mem::size_of::<sys::oa_create_params>() as u32,
+        host: &callbacks,
+        host_user: probe as *mut c_void,
+        rt: if a.fifo.is_some() { &rt } else { std::ptr::null() },
+        host_size: std::mem::size_of::<sys::oa_host_callbacks>() as u32,
+    };
+    let mut drv: *mut sys::oa_driver = std::ptr::null_mut();
+    check("openasio_driver_create", unsafe { (lib.create)(&params, &mut drv) })?;
+    let vt = unsafe { &*(*drv).vt };
+    let result = (|| unsafe {
+        let name = a.device.as_deref().map(|d| CString::new(d).unwrap());
+        let open = vt.open_device.ok_or("driver has no open_device")?;
+        check("open_device", open(drv, name.as_ref().map_or(std::ptr::null(), |n| n.as_ptr())))?;
+        let mut base = sys::oa_stream_config {
+            sample_rate: 48000,
+            buffer_frames: 128,
+            in_channels: 0,
+            out_channels: 2,
+            format: sys::oa_sample_format::OA_SAMPLE_F32,
+            layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+        };
+        if let Some(get) = vt.get_default_config {
+            check("get_default_config", get(drv, &mut base))?;
+        }
+        // The probe reads and writes interleaved floats, which every driver accepts.
+        base.format = sys::oa_sample_format::OA_SAMPLE_F32;
+        base.layout = sys::oa_buffer_layout::OA_BUF_INTERLEAVED;
+        base.in_channels = a.in_ch.unwrap_or(base.in_channels);
+        base.out_channels = a.out_ch.unwrap_or(base.out_channels);
+        if let Some((o, i)) = a.loopback {
+            if i >= base.in_channels as usize || o >= base.out_channels as usize {
+                return Err(format!(
+                    "--loopback {o}:{i} needs more channels than in {} / out {}",
+                    base.in_channels, base.out_channels
+                ));
+            }
+        }
+        let caps = vt.get_caps.map_or(0, |f| f(drv));
+        sink.emit(
+            Record::new("driver")
+                .set("driver", path)
+                .set("device", a.device.clone())
+                .set("caps", caps)
+                .set("default_rate", base.sample_rate)
+                .set("default_frames", base.buffer_frames),
+        );
+        let rates = if a.rates.is_empty() { vec![base.sample_rate] } else { a.rates.clone() };
+        for &rate in &rates {
+            for &frames in &a.frames {
+                let cfg = sys::oa_stream_config { sample_rate: rate, buffer_frames: frames, ..base };
+                *probe = Probe::new(rate, a.loopback, a.threshold);
+                match run_point(a, path, drv, &*probe, &cfg) {
+                    Ok(r) => sink.emit(r),
+                    Err(e) => {
+                        eprintln!("{path}: {rate} Hz x {frames}: {e}");
+                        sink.emit(
+                            Record::new("error")
+                                .set("driver", path)
+                                .set("sample_rate", rate)
+                                .set("buffer_frames", frames)
+                                .set("error", e),
+                        );
+                    }
+                }
+            }
+        }
+        if let Some(close) = vt.close_device {
+            close(drv);
+        }
+        Ok::<_, String>(())
+    })();
+    unsafe {
+        (lib.destroy)(drv);
+        drop(Box::from_raw(probe));
+    }
+    result
+}
+
+fn main() -> ExitCode {
+    let args = match parse_args() {
+        Ok(a) => a,
+        Err(e) => {
+            if !e.is_empty() {
+                eprintln!("openasio-bench: {e}");
+            }
+            eprintln!("{USAGE}");
+            return ExitCode::from(2);
+        }
+    };
+    let mut sink = match Sink::new(args.json.as_deref(), args.label.clone()) {
+        Ok(s) => s,
+        Err(e) => {
+            eprintln!("openasio-bench: {e}");
+            return ExitCode::from(2);
+        }
+    };
+    sink.emit(environment());
+    let mut failed = false;
+    for path in &args.drivers {
+        if let Err(e) = run_driver(&args, path, &mut sink) {
+            eprintln!("openasio-bench: {path}: {e}");
+            sink.emit(Record::new("error").set("driver", path.as_str()).set("error", e));
+            failed = true;
+        }
+    }
+    if args.kernels {
+        // Period-sized stereo blocks, and a wide interface's worth of channels.
+        kernels::run(&mut sink, &[(128, 2), (512, 2), (128, 16)]);
+        // The tightest budget in common use.
+        control::run(&mut sink, 64, 48000);
+    }
+    if failed {
+        ExitCode::from(1)
+    } else {
+        ExitCode::SUCCESS
+    }
+}
@@ -0,0 +1,120 @@
+//! Results as JSON lines: one self-contained object per line, so runs from different
+//! machines can be concatenated and filtered with standard tools.
+
+use std::fmt::Write as _;
+use std::io::Write;
+
+pub enum Value {
+    Str(String),
+    Int(i64),
+    Num(f64),
+    Bool(bool),
+    Null,
+}
+
+impl From<&str> for Value {
+    fn from(s: &str) -> Value {
+        Value::Str(s.to_string())
+    }
+}
+impl From<String> for Value {
+    fn from(s: String) -> Value {
+        Value::Str(s)
+    }
+}
+impl From<bool> for Value {
+    fn from(b: bool) -> Value {
+        Value::Bool(b)
+    }
+}
+impl From<f64> for Value {
+    fn from(v: f64) -> Value {
+        if v.is_finite() { Value::Num(v) } else { Value::Null }
+    }
+}
+macro_rules! int_value {
+    ($($t:ty),*) => {$(
+        impl From<$t> for Value {
+            fn from(v: $t) -> Value { Value::Int(v as i64) }
+        }
+    )*};
+}
+int_value!(i32, u16, u32, u64, usize);
+impl<T: Into<Value>> From<Option<T>> for Value {
+    fn from(v: Option<T>) -> Value {
+        v.map_or(Value::Null, Into::into)
+    }
+}
+
+/// One line of output. Fields keep their insertion order.
+pub struct Record(Vec<(&'static str, Value)>);
+
+impl Record {
+    pub fn new(kind: &str) -> Record {
+        Record(vec![("kind", kind.into())])
+    }
+
+    pub fn set(mut self, key: &'static str, value: impl Into<Value>) -> Record {
+        self.0.push((key, value.into()));
+        self
+    }
+
+    fn to_json(&self) -> String {
+        let mut s = String::from("{");
+        for (i, (k, v)) in self.0.iter().enumerate() {
+            if i > 0 {
+                s.push(',');
+            }
+            quote(&mut s, k);
+            s.push(':');
+            match v {
+                Value::Str(t) => quote(&mut s, t),
+                Value::Int(n) => write!(s, "{n}").unwrap(),
+                Value::Num(x) => write!(s, "{x}").unwrap(),
+                Value::Bool(b) => write!(s, "{b}").unwrap(),
+                Value::Null => s.push_str("null"),
+            }
+        }
+        s.push('}');
+        s
+    }
+}
+
+fn quote(s: &mut String, text: &str) {
+    s.push('"');
+    for c in text.chars() {
+        match c {
+            '"' => s.push_str("\\\""),
+            '\\' => s.push_str("\\\\"),
+            '\n' => s.push_str("\\n"),
+            c if (c as u32) < 0x20 => write!(s, "\\u{:04x}", c as u32).unwrap(),
+            c => s.push(c),
+        }
+    }
+    s.push('"');
+}
+
+/// Where records go; every record carries the run's label.
+pub struct Sink {
+    out: Box<dyn Write>,
+    label: Option<String>,
+}
+
+impl Sink {
+    pub fn new(path: Option<&str>, label: Option<String>) -> Result<Sink, String> {
+        let out: Box<dyn Write> = match path {
+            Some(p) => Box::new(std::fs::File::create(p).map_err(|e| format!("{p}: {e}"))?),
+            None => Box::new(std::io::stdout()),
+        };
+        Ok(Sink { out, label })
+    }
+
+    pub fn emit(&mut self, r: Record) {
+        let r = match &self.label {
+            Some(l) => r.set("label", l.as_str()),
+            None => r,
+        };
+        let _ = writeln!(self.out, "{}", r.to_json());
+        let _ = self.out.flush();
+    }
+}
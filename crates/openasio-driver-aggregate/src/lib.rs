@@ -0,0 +1,967 @@
+//! OpenASIO aggregate driver: several OpenASIO drivers streamed as one device.
+//!
+//! `open_device` takes a `;`-separated member list, each entry `path/to/driver.so` or
+//! `path/to/driver.so=device` (the name passed to that driver's `open_device`). The first
+//! member is the clock master: the host's `process` runs on its RT thread, with the members'
+//! channels concatenated in list order. Every other member trades its frames with the master
+//! through one SPSC ring per direction; the reading side of each ring resamples by the
+//! measured drift (`openasio_rt::ring::DriftReader`), so interfaces on their own crystals
+//! follow the master instead of slipping. Their RT threads only move frames.
+#![allow(clippy::missing_safety_doc)]
+use openasio_rt::clock;
+use openasio_rt::devices::{self, Device};
+use openasio_rt::ring::{DriftReader, Ring};
+use openasio_rt::space;
+use openasio_rt::stats::{StreamStats, Xrun};
+use openasio_sys as sys;
+use std::cell::UnsafeCell;
+use std::ffi::{CStr, CString};
+use std::mem::{offset_of, size_of};
+use std::os::raw::c_void;
+use std::ptr;
+use std::slice;
+use std::sync::atomic::{AtomicBool, AtomicU32, Ordering};
+
+type Result<T> = std::result::Result<T, String>;
+
+const CAPS: u32 = sys::OA_CAP_OUTPUT
+    | sys::OA_CAP_INPUT
+    | sys::OA_CAP_FULL_DUPLEX
+    | sys::OA_CAP_SET_SAMPLERATE
+    | sys::OA_CAP_SET_BUFFRAMES
+    | sys::OA_CAP_TIME_INFO_EX;
+
+/// Member list used when the host opens the default device.
+const SPEC_ENV: &str = "OPENASIO_AGGREGATE";
+
+/// Largest period staged without reallocating; members such as cpal pick their own block
+/// size, which may exceed the configured one.
+const MAX_PERIOD_FRAMES: usize = 8192;
+
+/// Frames between a secondary member and the master, one ring per direction. Each end has
+/// a single thread: `master` is only touched by the master's RT thread, `member` only by
+/// the member's.
+struct Link {
+    /// Member capture -> master.
+    capture: Option<Ring>,
+    /// Master playback -> member.
+    playback: Option<Ring>,
+    master: UnsafeCell<MasterEnd>,
+    member: UnsafeCell<MemberEnd>,
+    /// Playback ring ran dry; stored by the member thread, folded into the stats by the master.
+    underruns: AtomicU32,
+}
+
+struct MasterEnd {
+    reader: DriftReader,
+    /// The member's channels of one period, interleaved.
+    stage: Vec<f32>,
+    seen_underruns: u32,
+}
+
+struct MemberEnd {
+    reader: DriftReader,
+}
+
+// SAFETY: the rings are SPSC between the two threads and each end is single-threaded.
+unsafe impl Sync for Link {}
+
+/// One underlying driver. Boxed, so the `host_user` it was created with stays valid.
+struct Member {
+    lib: sys::loader::DriverLib,
+    drv: *mut sys::oa_driver,
+    callbacks: sys::oa_host_callbacks,
+    agg: *mut Driver,
+    caps: u32,
+    /// Channels this member streams, from its default config.
+    in_channels: u16,
+    out_channels: u16,
+    default_cfg: sys::oa_stream_config,
+    /// First aggregate channel of this member.
+    in_base: usize,
+    out_base: usize,
+    /// None for the master.
+    link: Option<Link>,
+}
+
+impl Member {
+    fn vt(&self) -> &sys::oa_driver_vtable {
+        unsafe { &*(*self.drv).vt }
+    }
+
+    unsafe fn start(&self, cfg: &sys::oa_stream_config) -> i32 {
+        let member_cfg = sys::oa_stream_config {
+            in_channels: self.in_channels,
+            out_channels: self.out_channels,
+            format: sys::oa_sample_format::OA_SAMPLE_F32,
+            layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+            ..*cfg
+        };
+        match self.vt().start {
+            Some(start) => start(self.drv, &member_cfg),
+            None => sys::OA_ERR_UNSUPPORTED,
+        }
+    }
+
+    unsafe fn stop(&self) {
+        if let Some(stop) = self.vt().stop {
+            stop(self.drv);
+        }
+    }
+
+    /// Frames the member adds on each side: its own latency plus what waits in its rings.
+    unsafe fn latency(&self) -> Option<(u32, u32)> {
+        let (mut input, mut output) = (0u32, 0u32);
+        if (self.vt().get_latency?)(self.drv, &mut input, &mut output) < 0 {
+            return None;
+        }
+        if let Some(link) = self.link.as_ref() {
+            input += (*link.master.get()).reader.fill_frames.load(Ordering::Relaxed);
+            output += (*link.member.get()).reader.fill_frames.load(Ordering::Relaxed);
+        }
+        Some((input, output))
+    }
+}
+
+impl Drop for Member {
+    fn drop(&mut self) {
+        if self.drv.is_null() {
+            return;
+        }
+        unsafe {
+            self.stop();
+            if let Some(close) = self.vt().close_device {
+                close(self.drv);
+            }
+            (self.lib.destroy)(self.drv);
+        }
+    }
+}
+
+struct DriverState {
+    host: sys::oa_host_callbacks,
+    host_user: *mut c_void,
+    rt_req: Option<sys::oa_rt_params>,
+    /// Master first.
+    members: Vec<Box<Member>>,
+    cfg: sys::oa_stream_config,
+    stats: StreamStats,
+    position: u64,
+    /// Frames per period the staging buffers hold.
+    max_frames: usize,
+    /// Aggregate period, interleaved; host planes point into `*_planar` for planar streams.
+    in_buf: Vec<f32>,
+    out_buf: Vec<f32>,
+    in_planar: Vec<f32>,
+    out_planar: Vec<f32>,
+    in_planes: Vec<*mut f32>,
+    out_planes: Vec<*mut f32>,
+    running: AtomicBool,
+}
+
+#[repr(C)]
+struct Driver {
+    /// Must stay first: hosts reach the vtable through `oa_driver::vt`.
+    base: sys::oa_driver,
+    vt: sys::oa_driver_vtable,
+    state: DriverState,
+}
+
+impl DriverState {
+    fn channel_totals(&self) -> (usize, usize) {
+        self.members.iter().fold((0, 0), |(i, o), m| {
+            (i + m.in_channels as usize, o + m.out_channels as usize)
+        })
+    }
+
+    /// Sizes the staging buffers and rings for `cfg`. All members must be stopped.
+    fn prepare(&mut self, cfg: &sys::oa_stream_config) -> Result<()> {
+        let frames = (cfg.buffer_frames as usize).max(MAX_PERIOD_FRAMES);
+        let ich = cfg.in_channels as usize;
+        let och = cfg.out_channels as usize;
+        self.cfg = *cfg;
+        self.max_frames = frames;
+        self.position = 0;
+        self.stats.reset(cfg.sample_rate, cfg.buffer_frames);
+        self.in_buf.resize(frames * ich, 0.0);
+        self.out_buf.resize(frames * och, 0.0);
+        let planar = cfg.layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+        self.in_planar.resize(if planar { frames * ich } else { 0 }, 0.0);
+        self.out_planar.resize(if planar { frames * och } else { 0 }, 0.0);
+        // Plane pointers stay fixed for the stream, `max_frames` apart.
+        let base = self.in_planar.as_mut_ptr();
+        self.in_planes = (0..ich).map(|c| base.wrapping_add(c * frames)).collect();
+        let base = self.out_planar.as_mut_ptr();
+        self.out_planes = (0..och).map(|c| base.wrapping_add(c * frames)).collect();
+
+        let ring_frames = 4 * frames;
+        let (mut in_base, mut out_base) = (0, 0);
+        for (i, m) in self.members.iter_mut().enumerate() {
+            m.in_base = in_base;
+            m.out_base = out_base;
+            in_base += m.in_channels as usize;
+            out_base += m.out_channels as usize;
+            if i == 0 {
+                continue;
+            }
+            let (mi, mo) = (m.in_channels as usize, m.out_channels as usize);
+            let rate = cfg.sample_rate;
+            m.link = Some(Link {
+                capture: (mi > 0).then(|| Ring::new(mi, ring_frames)),
+                playback: (mo > 0).then(|| Ring::new(mo, ring_frames)),
+                master: UnsafeCell::new(MasterEnd {
+                    reader: DriftReader::new(mi, rate, rate)?,
+                    stage: vec![0.0; frames * mi.max(mo)],
+                    seen_underruns: 0,
+                }),
+                member: UnsafeCell::new(MemberEnd {
+                    reader: DriftReader::new(mo, rate, rate)?,
+                }),
+                underruns: AtomicU32::new(0),
+            });
+        }
+        Ok(())
+    }
+
+    /// Secondaries first, so their rings are filling by the master's first period.
+    unsafe fn start_members(&mut self) -> i32 {
+        for m in self.members.iter().skip(1) {
+            let rc = m.start(&self.cfg);
+            if rc < 0 {
+                self.stop_members();
+                return rc;
+            }
+        }
+        self.running.store(true, Ordering::Release);
+        let rc = self.members[0].start(&self.cfg);
+        if rc < 0 {
+            self.stop_members();
+        }
+        rc
+    }
+
+    unsafe fn stop_members(&mut self) {
+        self.running.store(false, Ordering::Release);
+        for m in self.members.iter() {
+            m.stop();
+        }
+    }
+
+    /// The master's time for the aggregate period, with the members' xruns folded in.
+    unsafe fn time_info(&mut self, master_caps: u32, time: *const sys::oa_time_info, frames: usize) -> sys::oa_time_info {
+        let mut ti = sys::oa_time_info {
+            host_time_ns: clock::monotonic_ns(),
+            device_time_ns: 0,
+            underruns: self.stats.underruns(),
+            overruns: self.stats.overruns(),
+            struct_size: size_of::<sys::oa_time_info>() as u32,
+            flags: 0,
+            frame_position: self.position,
+            rate_ratio: 1.0,
+            in_dropped: 0,
+            out_dropped: 0,
+            out_inserted: 0,
+        };
+        self.position += frames as u64;
+        if time.is_null() {
+            return ti;
+        }
+        let t = &*time;
+        ti.host_time_ns = t.host_time_ns;
+        ti.device_time_ns = t.device_time_ns;
+        ti.underruns = ti.underruns.wrapping_add(t.underruns);
+        ti.overruns = ti.overruns.wrapping_add(t.overruns);
+        if master_caps & sys::OA_CAP_TIME_INFO_EX == 0 {
+            return ti;
+        }
+        let covers = |end: usize| t.struct_size as usize >= end;
+        if covers(offset_of!(sys::oa_time_info, rate_ratio) + size_of::<f64>()) {
+            ti.flags = t.flags;
+            ti.rate_ratio = t.rate_ratio;
+        }
+        // The master's gaps are the stream's; the other members' are absorbed by their rings.
+        if covers(size_of::<sys::oa_time_info>()) {
+            (ti.in_dropped, ti.out_dropped, ti.out_inserted) = (t.in_dropped, t.out_dropped, t.out_inserted);
+        }
+        ti
+    }
+}
+
+impl Drop for DriverState {
+    fn drop(&mut self) {
+        unsafe { self.stop_members() };
+    }
+}
+
+/// Copies `frames` frames of `src` (`src_ch` wide) to channels `base..` of `dst` (`dst_ch`
+/// wide); channels past the end of `dst` are dropped.
+fn scatter(dst: &mut [f32], dst_ch: usize, base: usize, src: &[f32], src_ch: usize, frames: usize) {
+    let n = src_ch.min(dst_ch.saturating_sub(base));
+    if n == 0 {
+        return;
+    }
+    for f in 0..frames {
+        dst[f * dst_ch + base..][..n].copy_from_slice(&src[f * src_ch..][..n]);
+    }
+}
+
+/// The reverse of [`scatter`]: channels `base..` of `src` into `dst`, silence where `src`
+/// has none.
+fn gather(dst: &mut [f32], dst_ch: usize, src: &[f32], src_ch: usize, base: usize, frames: usize) {
+    let n = dst_ch.min(src_ch.saturating_sub(base));
+    for f in 0..frames {
+        let d = &mut dst[f * dst_ch..][..dst_ch];
+        d[..n].copy_from_slice(&src[f * src_ch + base..][..n]);
+        d[n..].fill(0.0);
+    }
+}
+
+/// One aggregate period on the master's RT thread.
+unsafe fn master_period(
+    d: &mut Driver,
+    master: &Member,
+    in_ptr: *const c_void,
+    out_ptr: *mut c_void,
+    frames: usize,
+    time: *const sys::oa_time_info,
+) -> sys::oa_bool {
+    let st = &mut d.state;
+    let frames = frames.min(st.max_frames);
+    let ich = st.cfg.in_channels as usize;
+    let och = st.cfg.out_channels as usize;
+    let (mi, mo) = (master.in_channels as usize, master.out_channels as usize);
+
+    // Capture: the master's channels as delivered, every other member's through its ring.
+    st.in_buf[..frames * ich].fill(0.0);
+    if !in_ptr.is_null() && mi > 0 {
+        let src = slice::from_raw_parts(in_ptr as *const f32, frames * mi);
+        scatter(&mut st.in_buf, ich, master.in_base, src, mi, frames);
+    }
+    for m in st.members.iter().skip(1) {
+        let Some(link) = m.link.as_ref() else { continue };
+        let end = &mut *link.master.get();
+        let underruns = link.underruns.load(Ordering::Relaxed);
+        if underruns != end.seen_underruns {
+            end.seen_underruns = underruns;
+            st.stats.xrun(Xrun::Underrun);
+        }
+        if let Some(ring) = link.capture.as_ref() {
+            if !end.reader.read(ring, &mut end.stage, frames) {
+                st.stats.xrun(Xrun::Overrun);
+            }
+            scatter(&mut st.in_buf, ich, m.in_base, &end.stage, m.in_channels as usize, frames);
+        }
+    }
+
+    let ti = st.time_info(master.caps, time, frames);
+    st.out_buf[..frames * och].fill(0.0);
+    let planar = st.cfg.layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+    let mut keep = sys::OA_TRUE;
+    if let Some(cb) = st.host.process {
+        let (inp, outp): (*const c_void, *mut c_void) = if planar {
+            sys::convert::oa_deinterleave_f32(st.in_planes.as_ptr(), st.in_buf.as_ptr(), ich as u32, frames);
+            for p in st.out_planes.iter() {
+                slice::from_raw_parts_mut(*p, frames).fill(0.0);
+            }
+            (st.in_planes.as_ptr() as *const c_void, st.out_planes.as_mut_ptr() as *mut c_void)
+        } else {
+            (st.in_buf.as_ptr() as *const c_void, st.out_buf.as_mut_ptr() as *mut c_void)
+        };
+        let t0 = st.stats.begin();
+        keep = cb(
+            st.host_user,
+            if ich == 0 { ptr::null() } else { inp },
+            outp,
+            frames as u32,
+            &ti as *const _,
+            &st.cfg as *const _,
+        );
+        st.stats.end(t0);
+        if planar {
+            sys::convert::oa_interleave_f32(
+                st.out_buf.as_mut_ptr(),
+                st.out_planes.as_ptr() as *const *const f32,
+                och as u32,
+                frames,
+            );
+        }
+    }
+
+    // Playback: the master's channels straight out, everyone else's into its ring. A full
+    // ring means the member stalled; its reader drops the backlog once it runs again.
+    if !out_ptr.is_null() && mo > 0 {
+        let dst = slice::from_raw_parts_mut(out_ptr as *mut f32, frames * mo);
+        gather(dst, mo, &st.out_buf, och, master.out_base, frames);
+    }
+    for m in st.members.iter().skip(1) {
+        let Some(link) = m.link.as_ref() else { continue };
+        let Some(ring) = link.playback.as_ref() else { continue };
+        let end = &mut *link.master.get();
+        let mo = m.out_channels as usize;
+        gather(&mut end.stage, mo, &st.out_buf, och, m.out_base, frames);
+        ring.push(&end.stage[..frames * mo]);
+    }
+    keep
+}
+
+unsafe extern "C" fn master_process(
+    user: *mut c_void,
+    in_ptr: *const c_void,
+    out_ptr: *mut c_void,
+    frames: u32,
+    time: *const sys::oa_time_info,
+    _cfg: *const sys::oa_stream_config,
+) -> sys::oa_bool {
+    let master = &*(user as *const Member);
+    let d = &mut *master.agg;
+    if !d.state.running.load(Ordering::Acquire) {
+        if !out_ptr.is_null() {
+            slice::from_raw_parts_mut(out_ptr as *mut f32, frames as usize * master.out_channels as usize).fill(0.0);
+        }
+        return sys::OA_TRUE;
+    }
+    master_period(d, master, in_ptr, out_ptr, frames as usize, time)
+}
+
+/// A secondary member's period: capture into its ring, playback out of the other one.
+unsafe extern "C" fn member_process(
+    user: *mut c_void,
+    in_ptr: *const c_void,
+    out_ptr: *mut c_void,
+    frames: u32,
+    _time: *const sys::oa_time_info,
+    _cfg: *const sys::oa_stream_config,
+) -> sys::oa_bool {
+    let m = &*(user as *const Member);
+    let frames = frames as usize;
+    let link = m.link.as_ref();
+    if let (Some(ring), false) = (link.and_then(|l| l.capture.as_ref()), in_ptr.is_null()) {
+        // A full ring means the master stalled; the frames that do not fit are lost.
+        ring.push(slice::from_raw_parts(in_ptr as *const f32, frames * m.in_channels as usize));
+    }
+    if out_ptr.is_null() || m.out_channels == 0 {
+        return sys::OA_TRUE;
+    }
+    let dst = slice::from_raw_parts_mut(out_ptr as *mut f32, frames * m.out_channels as usize);
+    match link.and_then(|l| l.playback.as_ref().map(|r| (l, r))) {
+        Some((link, ring)) => {
+            if !(*link.member.get()).reader.read(ring, dst, frames) {
+                let u = &link.underruns;
+                u.store(u.load(Ordering::Relaxed).wrapping_add(1), Ordering::Relaxed);
+            }
+        }
+        None => dst.fill(0.0),
+    }
+    sys::OA_TRUE
+}
+
+unsafe extern "C" fn member_reset_request(user: *mut c_void) {
+    let m = &*(user as *const Member);
+    let st = &(*m.agg).state;
+    if let Some(cb) = st.host.reset_request {
+        cb(st.host_user);
+    }
+}
+
+/// A member's device list changed; the aggregate may have lost or regained a member.
+unsafe extern "C" fn member_devices_changed(user: *mut c_void) {
+    let m = &*(user as *const Member);
+    let st = &(*m.agg).state;
+    if let Some(cb) = st.host.devices_changed {
+        cb(st.host_user);
+    }
+}
+
+/// `path[=device]` entries, `;`-separated.
+fn parse_spec(spec: &str) -> Vec<(&str, Option<&str>)> {
+    spec.split(';')
+        .map(str::trim)
+        .filter(|e| !e.is_empty())
+        .map(|e| match e.split_once('=') {
+            Some((path, dev)) => (path.trim(), Some(dev.trim())),
+            None => (e, None),
+        })
+        .collect()
+}
+
+unsafe fn load_member(
+    agg: *mut Driver,
+    path: &str,
+    device: Option<&str>,
+    master: bool,
+) -> Result<Box<Member>> {
+    let lib = sys::loader::DriverLib::load(path).map_err(|e| format!("{path}: {e}"))?;
+    let mut m = Box::new(Member {
+        lib,
+        drv: ptr::null_mut(),
+        callbacks: sys::oa_host_callbacks {
+            process: Some(if master { master_process } else { member_process }),
+            latency_changed: None,
+            reset_request: Some(member_reset_request),
+            devices_changed: Some(member_devices_changed),
+            process_batch: None,
+        },
+        agg,
+        caps: 0,
+        in_channels: 0,
+        out_channels: 0,
+        default_cfg: sys::oa_stream_config {
+            sample_rate: 48000,
+            buffer_frames: 128,
+            in_channels: 0,
+            out_channels: 0,
+            format: sys::oa_sample_format::OA_SAMPLE_F32,
+            layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+        },
+        in_base: 0,
+        out_base: 0,
+        link: None,
+    });
+    let rt = (*agg).state.rt_req;
+    let params = sys::oa_create_params {
+        struct_size: size_of::<sys::oa_create_params>() as u32,
+        host: &m.callbacks,
+        host_user: &*m as *const Member as *mut c_void,
+        rt: rt.as_ref().map_or(ptr::null(), |r| r as *const _),
+        host_size: size_of::<sys::oa_host_callbacks>() as u32,
+    };
+    let mut drv = ptr::null_mut();
+    let rc = (m.lib.create)(&params, &mut drv);
+    if rc < 0 || drv.is_null() {
+        return Err(format!("{path}: openasio_driver_create rc={rc}"));
+    }
+    m.drv = drv;
+
+    let vt = m.vt();
+    let name = device.map(|d| CString::new(d).map_err(|e| e.to_string())).transpose()?;
+    let rc = match vt.open_device {
+        Some(open) => open(m.drv, name.as_ref().map_or(ptr::null(), |n| n.as_ptr())),
+        None => sys::OA_ERR_UNSUPPORTED,
+    };
+    if rc < 0 {
+        return Err(format!("{path}: open_device rc={rc}"));
+    }
+    let caps = vt.get_caps.map_or(0, |f| f(m.drv));
+    let mut cfg = m.default_cfg;
+    if let Some(get) = vt.get_default_config {
+        if get(m.drv, &mut cfg) < 0 {
+            return Err(format!("{path}: get_default_config failed"));
+        }
+    }
+    m.caps = caps;
+    m.default_cfg = cfg;
+    m.in_channels = if caps & sys::OA_CAP_INPUT != 0 { cfg.in_channels } else { 0 };
+    m.out_channels = if caps & sys::OA_CAP_OUTPUT != 0 { cfg.out_channels } else { 0 };
+    Ok(m)
+}
+
+unsafe extern "C" fn get_caps(_: *mut sys::oa_driver) -> u32 {
+    CAPS
+}
+
+unsafe extern "C" fn query_devices(_selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
+    // The only device is the member list the environment names, if any.
+    let list = std::env::var(SPEC_ENV).map(|s| s + "\n").unwrap_or_default();
+    let bytes = list.as_bytes();
+    let n = bytes.len().min(len.saturating_sub(1));
+    if n > 0 {
+        ptr::copy_nonoverlapping(bytes.as_ptr(), buf as *mut u8, n);
+    }
+    if len > 0 {
+        *buf.add(n) = 0;
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn enumerate_devices(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_device_info,
+    capacity: u32,
+    count: *mut u32,
+) -> i32 {
+    // Same single entry as query_devices; channel counts are known once it is open.
+    let d = &*(selfp as *const Driver);
+    let list: Vec<Device> = std::env::var(SPEC_ENV)
+        .map(|spec| {
+            let (ins, outs) = d.state.channel_totals();
+            let description = format!("{} members", parse_spec(&spec).len());
+            Device {
+                name: spec,
+                description,
+                in_channels: ins as u16,
+                out_channels: outs as u16,
+                default: true,
+            }
+        })
+        .into_iter()
+        .collect();
+    devices::write(list.iter().map(|dev| (1, dev)), out, capacity, count)
+}
+
+unsafe extern "C" fn open_device(selfp: *mut sys::oa_driver, name: *const i8) -> i32 {
+    let agg = selfp as *mut Driver;
+    let d = &mut *agg;
+    d.state.stop_members();
+    d.state.members.clear();
+    let spec = if name.is_null() {
+        match std::env::var(SPEC_ENV) {
+            Ok(s) => s,
+            Err(_) => return sys::OA_ERR_DEVICE,
+        }
+    } else {
+        CStr::from_ptr(name).to_string_lossy().to_string()
+    };
+    let entries = parse_spec(&spec);
+    if entries.is_empty() {
+        return sys::OA_ERR_DEVICE;
+    }
+    for (i, (path, device)) in entries.into_iter().enumerate() {
+        match load_member(agg, path, device, i == 0) {
+            Ok(m) => d.state.members.push(m),
+            Err(e) => {
+                eprintln!("openasio-aggregate: {e}");
+                d.state.members.clear();
+                return sys::OA_ERR_DEVICE;
+            }
+        }
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn close_device(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.stop_members();
+    d.state.members.clear();
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_default_config(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_config,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let d = &*(selfp as *mut Driver);
+    let Some(master) = d.state.members.first() else {
+        return sys::OA_ERR_DEVICE;
+    };
+    let (ich, och) = d.state.channel_totals();
+    *out = sys::oa_stream_config {
+        in_channels: ich as u16,
+        out_channels: och as u16,
+        format: sys::oa_sample_format::OA_SAMPLE_F32,
+        layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+        ..master.default_cfg
+    };
+    sys::OA_OK
+}
+
+unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let cfg = *cfg;
+    let d = &mut *(selfp as *mut Driver);
+    if d.state.members.is_empty() {
+        return sys::OA_ERR_DEVICE;
+    }
+    let (ich, och) = d.state.channel_totals();
+    if cfg.format != sys::oa_sample_format::OA_SAMPLE_F32
+        || cfg.in_channels as usize > ich
+        || cfg.out_channels as usize > och
+        || cfg.buffer_frames == 0
+    {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    d.state.stop_members();
+    if let Err(e) = d.state.prepare(&cfg) {
+        eprintln!("openasio-aggregate: {e}");
+        return sys::OA_ERR_BACKEND;
+    }
+    d.state.start_members()
+}
+
+unsafe extern "C" fn stop(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.stop_members();
+    sys::OA_OK
+}
+
+/// The slowest member on each side.
+unsafe extern "C" fn get_latency(
+    selfp: *mut sys::oa_driver,
+    in_lat: *mut u32,
+    out_lat: *mut u32,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    let (mut input, mut output) = (0, 0);
+    for m in d.state.members.iter() {
+        if let Some((i, o)) = m.latency() {
+            if m.in_channels > 0 {
+                input = input.max(i);
+            }
+            if m.out_channels > 0 {
+                output = output.max(o);
+            }
+        }
+    }
+    if !in_lat.is_null() {
+        *in_lat = if d.state.cfg.in_channels > 0 { input } else { 0 };
+    }
+    if !out_lat.is_null() {
+        *out_lat = output;
+    }
+    sys::OA_OK
+}
+
+/// A change while running restarts every member with the new setting. The host hears the
+/// nominal latency before the master resumes; get_latency measures it again after that.
+unsafe fn reconfigure(selfp: *mut Driver, cfg: sys::oa_stream_config) -> i32 {
+    let d = &mut *selfp;
+    if !d.state.running.load(Ordering::Acquire) {
+        // Takes effect with the next start(), whose config the host passes along.
+        d.state.cfg = cfg;
+        return sys::OA_OK;
+    }
+    let old = d.state.cfg;
+    if cfg.sample_rate == old.sample_rate && cfg.buffer_frames == old.buffer_frames {
+        return sys::OA_OK;
+    }
+    d.state.stop_members();
+    if let Some(cb) = d.state.host.latency_changed {
+        let input = if cfg.in_channels > 0 { cfg.buffer_frames } else { 0 };
+        cb(d.state.host_user, input, cfg.buffer_frames);
+    }
+    let rc = match d.state.prepare(&cfg) {
+        Ok(()) => d.state.start_members(),
+        Err(e) => {
+            eprintln!("openasio-aggregate: {e}");
+            sys::OA_ERR_BACKEND
+        }
+    };
+    if rc < 0 {
+        // Keep streaming on the old settings if the members still take them.
+        if d.state.prepare(&old).is_ok() {
+            let _ = d.state.start_members();
+        }
+    }
+    rc
+}
+
+unsafe extern "C" fn set_sr(selfp: *mut sys::oa_driver, sr: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if sr == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let cfg = sys::oa_stream_config {
+        sample_rate: sr,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn set_buf(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if frames == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let cfg = sys::oa_stream_config {
+        buffer_frames: frames,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn get_supported_formats(
+    _: *mut sys::oa_driver,
+    native: *mut u32,
+    supported: *mut u32,
+) -> i32 {
+    // Members are always streamed as float32.
+    let f32_bit = sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32);
+    if !native.is_null() {
+        *native = f32_bit;
+    }
+    if !supported.is_null() {
+        *supported = f32_bit;
+    }
+    sys::OA_OK
+}
+
+/// The thread that runs `process` is the master's.
+unsafe extern "C" fn get_rt_info(selfp: *mut sys::oa_driver, out: *mut sys::oa_rt_info) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    let Some(master) = d.state.members.first() else {
+        return sys::OA_ERR_STATE;
+    };
+    match sys::oa_vt_get!(master.vt(), get_rt_info) {
+        Some(get) => get(master.drv, out),
+        None => sys::OA_ERR_UNSUPPORTED,
+    }
+}
+
+unsafe extern "C" fn get_stream_stats(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_stats,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    d.state.stats.write(out)
+}
+
+/// The master's thread, which runs `process`; a master without the entry still gives the deadline.
+unsafe extern "C" fn get_thread_params(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_thread_params,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if !d.state.running.load(Ordering::Acquire) {
+        return sys::OA_ERR_STATE;
+    }
+    let Some(master) = d.state.members.first() else {
+        return sys::OA_ERR_STATE;
+    };
+    match sys::oa_vt_get!(master.vt(), get_thread_params) {
+        Some(get) => get(master.drv, out),
+        None => {
+            let cfg = &d.state.cfg;
+            openasio_rt::write_thread_params(&openasio_rt::thread_params(None, cfg.sample_rate, cfg.buffer_frames), out)
+        }
+    }
+}
+
+/// Rates and buffer sizes every member accepts, with the channel totals of the member list.
+/// A member without the entry only vouches for its default rate. Only the open list can be
+/// asked, since members are loaded by open_device.
+unsafe extern "C" fn query_config_space(
+    selfp: *mut sys::oa_driver,
+    device: *const i8,
+    out: *mut sys::oa_config_space,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if !device.is_null() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    let d = &*(selfp as *mut Driver);
+    if d.state.members.is_empty() {
+        return sys::OA_ERR_DEVICE;
+    }
+    let mut sp = space::empty();
+    sp.flags = sys::OA_CONFIG_RATE_CONTINUOUS;
+    sp.rate_max = u32::MAX;
+    space::set_rates(&mut sp, space::COMMON_RATES.iter().copied());
+    sp.buffer_frames_min = 1;
+    sp.buffer_frames_max = u32::MAX;
+    sp.buffer_frames_step = 1;
+    for m in d.state.members.iter() {
+        let mut ms = space::empty();
+        let queried = match sys::oa_vt_get!(m.vt(), query_config_space) {
+            Some(query) => query(m.drv, ptr::null(), &mut ms) >= 0,
+            None => false,
+        };
+        if !queried {
+            ms = sp;
+            ms.flags = 0;
+            space::set_rates(&mut ms, [m.default_cfg.sample_rate]);
+        }
+        ms.native_formats = u32::MAX;
+        ms.supported_formats = u32::MAX;
+        ms.layouts = u32::MAX;
+        space::narrow(&mut sp, &ms);
+    }
+    let (ich, och) = d.state.channel_totals();
+    sp.in_channels = space::channel_bits(0, ich as u32);
+    sp.out_channels = space::channel_bits(0, och as u32);
+    sp.in_channels_max = ich as u32;
+    sp.out_channels_max = och as u32;
+    sp.native_formats = sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32);
+    sp.supported_formats = sp.native_formats;
+    sp.layouts = sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_INTERLEAVED)
+        | sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+    space::write(&sp, out)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_create(
+    params: *const sys::oa_create_params,
+    out: *mut *mut sys::oa_driver,
+) -> i32 {
+    if params.is_null() || out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let p = &*params;
+    if p.host.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+
+    let mut drv = Box::new(Driver {
+        base: sys::oa_driver { vt: ptr::null() },
+        vt: sys::oa_driver_vtable {
+            struct_size: size_of::<sys::oa_driver_vtable>() as u32,
+            get_caps: Some(get_caps),
+            query_devices: Some(query_devices),
+            open_device: Some(open_device),
+            close_device: Some(close_device),
+            get_default_config: Some(get_default_config),
+            start: Some(start),
+            stop: Some(stop),
+            get_latency: Some(get_latency),
+            set_sample_rate: Some(set_sr),
+            set_buffer_frames: Some(set_buf),
+            mmap_enable: None,
+            mmap_begin_period: None,
+            mmap_commit_period: None,
+            get_supported_formats: Some(get_supported_formats),
+            get_rt_info: Some(get_rt_info),
+            get_stream_stats: Some(get_stream_stats),
+            get_thread_params: Some(get_thread_params),
+            query_config_space: Some(query_config_space),
+            enumerate_devices: Some(enumerate_devices),
+            // Members start and stop together through start()/stop().
+            prepare: None,
+            pause: None,
+            resume: None,
+            // The master's period is the host's: one process() per member period.
+            set_batch_periods: None,
+            set_host_scratch: None,
+            get_stream_memory: None,
+        },
+        state: DriverState {
+            host: openasio_rt::host_callbacks(p),
+            host_user: p.host_user,
+            // Passed on to every member: the master runs `process`, the others feed it.
+            rt_req: openasio_rt::requested(p),
+            members: Vec::new(),
+            cfg: sys::oa_stream_config {
+                sample_rate: 48000,
+                buffer_frames: 128,
+                in_channels: 0,
+                out_channels: 2,
+                format: sys::oa_sample_format::OA_SAMPLE_F32,
+                layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+            },
+            stats: StreamStats::default(),
+            position: 0,
+            max_frames: 0,
+            in_buf: Vec::new(),
+            out_buf: Vec::new(),
+            in_planar: Vec::new(),
+            out_planar: Vec::new(),
+            in_planes: Vec::new(),
+            out_planes: Vec::new(),
+            running: AtomicBool::new(false),
+        },
+    });
+    drv.base.vt = &drv.vt;
+    *out = Box::into_raw(drv) as *mut sys::oa_driver;
+    sys::OA_OK
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_destroy(driver: *mut sys::oa_driver) {
+    if !driver.is_null() {
+        let _ = Box::from_raw(driver as *mut Driver);
+    }
+}
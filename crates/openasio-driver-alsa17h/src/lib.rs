@@ -1,50 +1,190 @@
 //! OpenASIO driver for AMD Family 17h HDA controllers (ALSA backend, full-duplex)
+//!
+//! The PCM pair and its engine (`OPENASIO_ALSA`) come from `openasio-alsa`.
 #![allow(clippy::missing_safety_doc)]
+use alsa::device_name::HintIter;
 use alsa::pcm::{Access, Format, HwParams, PCM};
-use alsa::{Direction as PcmDir, ValueOr};
+use alsa::Direction as PcmDir;
+use openasio_alsa::{self as engine, Duplex, Samples, Setup};
 use openasio_sys as sys;
-use std::sync::atomic::{AtomicBool, AtomicU32, Ordering};
-use std::{ffi::CStr, os::raw::c_void, ptr, time::Instant};
+use openasio_rt::arena::{Buf, Memory, Plan};
+use openasio_rt::batch::{self, Batch};
+use openasio_rt::clock::{Stamp, StreamClock};
+use openasio_rt::devices::{self, Device, DeviceCache};
+use openasio_rt::evloop::{self, Arm, Worker};
+use openasio_rt::gate::Gate;
+use openasio_rt::space;
+use openasio_rt::stats::{StreamStats, Xrun};
+use openasio_rt::tune::{self, Stepper, Tuner};
+use std::sync::{Mutex, MutexGuard};
+use std::{ffi::CStr, os::raw::c_void, ptr};
 
 const CAP_OUTPUT: u32 = 1 << 0;
 const CAP_INPUT: u32 = 1 << 1;
 const CAP_FULL_DUPLEX: u32 = 1 << 2;
 const CAP_SET_SR: u32 = 1 << 3;
 const CAP_SET_BF: u32 = 1 << 4;
-const CAPS: u32 = CAP_OUTPUT | CAP_INPUT | CAP_FULL_DUPLEX | CAP_SET_SR | CAP_SET_BF;
+const CAP_MMAP: u32 = 1 << 5;
+const CAP_TIME_INFO_EX: u32 = 1 << 6;
+const CAP_BATCH: u32 = 1 << 7;
+const CAPS: u32 = CAP_OUTPUT
+    | CAP_INPUT
+    | CAP_FULL_DUPLEX
+    | CAP_SET_SR
+    | CAP_SET_BF
+    | CAP_MMAP
+    | CAP_TIME_INFO_EX
+    | CAP_BATCH;
 
-struct Io {
-    cap: Option<PCM>,
-    pb: Option<PCM>,
-}
+const TUNE_KEY: &str = "alsa17h"; // this driver's profiles in the autotune store
+
+// Stream formats and the ALSA format each one is streamed as (no conversion in this driver).
+const FORMATS: &[(sys::oa_sample_format, Format, u16)] = &[
+    (sys::oa_sample_format::OA_SAMPLE_F32, Format::float(), 32),
+    (sys::oa_sample_format::OA_SAMPLE_I16, Format::s16(), 16),
+    (sys::oa_sample_format::OA_SAMPLE_I24_3LE, Format::S243LE, 24),
+    (sys::oa_sample_format::OA_SAMPLE_I24_IN_32, Format::s24(), 24),
+    (sys::oa_sample_format::OA_SAMPLE_I32, Format::s32(), 32),
+];
 
 struct DriverState {
     host: *const sys::oa_host_callbacks,
     host_user: *mut c_void,
+    callbacks: sys::oa_host_callbacks, // copy of *host up to host_size, for the 1.1 entries
     dev_name: Option<String>,
-    io: Io,
+    io: Duplex,
     cfg: sys::oa_stream_config,
-    time0: Instant,
-    underruns: AtomicU32,
-    overruns: AtomicU32,
-    in_buf: Vec<f32>,  // interleaved
-    out_buf: Vec<f32>, // interleaved
-    running: AtomicBool,
-    worker: Option<std::thread::JoinHandle<()>>,
+    clock: StreamClock,
+    stats: StreamStats,
+    sample_bytes: usize,
+    native_formats: u32, // OA_FORMAT_BIT mask, 0 until probed
+    in_buf: Buf<f32>,  // raw device samples, one plane per channel if non-interleaved
+    out_buf: Buf<f32>, // raw device samples, one plane per channel if non-interleaved
+    hw_planar: bool,   // device opened RWNonInterleaved (planes go to ALSA as-is)
+    in_planes: Buf<*mut u8>,  // channel planes in in_buf, built once in start()
+    out_planes: Buf<*mut u8>, // channel planes in out_buf
+    stage: Buf<f32>, // interleaved period for the transpose when planar access is refused
+    memory: Memory,  // the arena all of the stream's buffers are cut from
+    mmap: MmapState,
+    batch_periods: u32, // periods per wakeup asked for by set_batch_periods
+    batch: Batch,       // the stream's batch; empty unless it runs host.process_batch
+    autotune: bool,     // OPENASIO_ALSA autotune, until the host sets buffer_frames itself
+    tune: Option<Tuner>, // the running stream's search, with autotune
+    steps: Option<Stepper>, // applies the tuner's steps off the RT thread
+    control: Mutex<()>,     // held by a tuner step and the host calls that could meet one
+    rt_req: Option<sys::oa_rt_params>, // oa_create_params.rt, applied on the worker
+    rt_info: Option<sys::oa_rt_info>,  // granted to the running worker
+    gate: Gate,                        // worker runs, is parked (prepared/paused) or exits
+    worker: Option<Worker>,
+    hotplug: Option<devices::Notify>, // host.devices_changed, if the host is new enough
+    devices: Option<DeviceCache>,     // built by the first enumeration
+}
+
+// Zero-copy state: channel areas of the period currently handed to the host.
+struct MmapState {
+    enabled: bool,
+    in_areas: Buf<sys::oa_mmap_channel>,
+    out_areas: Buf<sys::oa_mmap_channel>,
+    frames: u32, // frames in the open period (0 outside host.process)
+    committed: Option<u32>,
 }
 
 #[repr(C)]
 struct Driver {
+    base: sys::oa_driver, // first: hosts reach the vtable through `oa_driver::vt`
     vt: sys::oa_driver_vtable,
     state: DriverState,
 }
 
 impl DriverState {
     fn stop_worker(&mut self) {
-        self.running.store(false, Ordering::Release);
-        if let Some(handle) = self.worker.take() {
-            let _ = handle.join();
+        // A tuner step in progress completes first; none follows.
+        if let Some(steps) = self.steps.as_ref() {
+            let _control = self.control();
+            steps.quit();
+        }
+        self.gate.stop();
+        if let Some(worker) = self.worker.take() {
+            worker.finish();
         }
+        self.steps = None;
+        self.rt_info = None;
+        if let Some(t) = self.tune.as_ref().filter(|t| t.settled()) {
+            tune::save(TUNE_KEY, self.device_key(), self.cfg.sample_rate, t.profile());
+        }
+    }
+
+    fn device_key(&self) -> &str {
+        self.dev_name.as_deref().unwrap_or("default")
+    }
+
+    // RT, after a wakeup went wrong: the next period reports what the recovery cost, plus
+    // `unplayed` frames of this wakeup's output that never reached the device. A device
+    // that could not be restarted stops the worker and asks the host for a reset.
+    fn recovered(&mut self, unplayed: u32) {
+        let mut gap = self.io.take_gap();
+        gap.out_dropped = gap.out_dropped.saturating_add(unplayed);
+        self.clock.discontinuity(gap);
+        if self.io.failed() {
+            self.gate.stop();
+            if let Some(cb) = self.callbacks.reset_request {
+                unsafe { cb(self.host_user) };
+            }
+        }
+    }
+
+    // A fresh search for a stream at `rate`, from the profile saved for it.
+    fn start_tuner(&mut self, rate: u32) {
+        self.tune = self.autotune.then(|| {
+            Tuner::new(rate, engine::TUNE_PERIODS, tune::load(TUNE_KEY, self.device_key(), rate))
+        });
+    }
+
+    // The prepared stream runs `cfg`, apart from a tuned period.
+    fn runs(&self, cfg: &sys::oa_stream_config) -> bool {
+        let frames = if self.tune.is_some() {
+            self.cfg.buffer_frames
+        } else {
+            cfg.buffer_frames
+        };
+        self.cfg == sys::oa_stream_config { buffer_frames: frames, ..*cfg }
+    }
+
+    // Frames the device moves per wakeup: a period, or a whole batch.
+    fn wake_frames(&self) -> u32 {
+        self.cfg.buffer_frames * self.batch.len().max(1) as u32
+    }
+
+    // Latency reported to the host in frames: one wakeup in, the rest of the ring out.
+    fn latency(&self) -> (u32, u32) {
+        let input = if self.cfg.in_channels > 0 {
+            self.wake_frames()
+        } else {
+            0
+        };
+        (input, self.io.output_latency(self.wake_frames()))
+    }
+
+    // Opens the device (plus capture if `capture`), keeping handles that are already open.
+    fn open_pcms(&mut self, capture: bool) -> i32 {
+        let name = self.dev_name.as_deref().unwrap_or("default");
+        self.io.open(name, capture)
+    }
+
+    // Keeps a tuner step from running until the guard is dropped.
+    fn control(&self) -> MutexGuard<'_, ()> {
+        self.control.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    // A worker exists and waits in the gate: the stream is prepared or paused.
+    fn parked(&self) -> bool {
+        self.worker.is_some() && self.gate.is_parked()
+    }
+
+    fn device_cache(&mut self) -> &DeviceCache {
+        let hotplug = self.hotplug;
+        self.devices
+            .get_or_insert_with(|| DeviceCache::new(devices::ALSA_DEV_DIR, scan_devices, hotplug))
     }
 }
 
@@ -58,9 +198,45 @@ unsafe extern "C" fn get_caps(_: *mut sys::oa_driver) -> u32 {
     CAPS
 }
 
-unsafe extern "C" fn query_devices(_selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
-    // Minimal enumeration: typical HDA device nodes; host may pass exact ALSA "hw:X,Y"
-    let list = "default\nhw:0,0\nhw:1,0\n";
+// "default" and every hw: PCM in the ALSA hints, with their channel limits. Without hints
+// it falls back to the typical HDA nodes; hosts may still pass any exact ALSA "hw:X,Y".
+fn scan_devices() -> Vec<Device> {
+    let mut found = vec![("default".to_string(), "Default ALSA device".to_string())];
+    if let Ok(iter) = HintIter::new_str(None, "pcm") {
+        for hint in iter {
+            let Some(name) = hint.name else { continue };
+            if name.starts_with("hw:") && !found.iter().any(|(n, _)| *n == name) {
+                found.push((name, hint.desc.unwrap_or_default().replace('\n', " ")));
+            }
+        }
+    }
+    if found.len() == 1 {
+        found.extend(["hw:0,0", "hw:1,0"].map(|n| (n.to_string(), String::new())));
+    }
+    found
+        .into_iter()
+        .enumerate()
+        .map(|(i, (name, description))| Device {
+            in_channels: max_channels(&name, PcmDir::Capture),
+            out_channels: max_channels(&name, PcmDir::Playback),
+            default: i == 0,
+            name,
+            description,
+        })
+        .collect()
+}
+
+// 0 if the direction is missing or the device is busy.
+fn max_channels(name: &str, dir: PcmDir) -> u16 {
+    PCM::new(name, dir, true)
+        .ok()
+        .and_then(|pcm| HwParams::any(&pcm).ok()?.get_channels_max().ok())
+        .map_or(0, |c| c.min(u16::MAX as u32) as u16)
+}
+
+unsafe extern "C" fn query_devices(selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    let list = s.state.device_cache().names();
     let bytes = list.as_bytes();
     let n = bytes.len().min(len.saturating_sub(1));
     if n > 0 {
@@ -72,139 +248,374 @@ unsafe extern "C" fn query_devices(_selfp: *mut sys::oa_driver, buf: *mut i8, le
     sys::OA_OK
 }
 
+unsafe extern "C" fn enumerate_devices(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_device_info,
+    capacity: u32,
+    count: *mut u32,
+) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    s.state.device_cache().write(out, capacity, count)
+}
+
 unsafe extern "C" fn open_device(selfp: *mut sys::oa_driver, name: *const i8) -> i32 {
     let s = &mut *(selfp as *mut Driver);
+    s.state.stop_worker();
+    s.state.memory.release();
+    s.state.io.close();
     s.state.dev_name = if name.is_null() {
         None
     } else {
         Some(CStr::from_ptr(name).to_string_lossy().to_string())
     };
+    s.state.native_formats = 0;
     sys::OA_OK
 }
 
 unsafe extern "C" fn close_device(selfp: *mut sys::oa_driver) -> i32 {
     let s = &mut *(selfp as *mut Driver);
     s.state.stop_worker();
-    s.state.io.cap = None;
-    s.state.io.pb = None;
+    s.state.memory.release();
+    s.state.io.close();
     sys::OA_OK
 }
 
-fn hw_setup(pcm: &PCM, dir: PcmDir, cfg: &sys::oa_stream_config) -> Result<(), String> {
-    let hwp = HwParams::any(pcm).map_err(|e| e.to_string())?;
-    hwp.set_access(Access::RWInterleaved)
-        .map_err(|e| e.to_string())?;
-    hwp.set_channels(match dir {
-        PcmDir::Capture => cfg.in_channels as u32,
-        PcmDir::Playback => cfg.out_channels as u32,
-    })
-    .map_err(|e| e.to_string())?;
-    hwp.set_rate(cfg.sample_rate as u32, ValueOr::Nearest)
-        .map_err(|e| e.to_string())?;
-    hwp.set_format(Format::float()).map_err(|e| e.to_string())?;
-    let period = cfg.buffer_frames as i64;
-    hwp.set_period_size(period, ValueOr::Nearest)
-        .map_err(|e| e.to_string())?;
-    hwp.set_buffer_size(period * 2).map_err(|e| e.to_string())?; // 2 periods buffer
-    pcm.hw_params(&hwp).map_err(|e| e.to_string())?;
-
-    let swp = pcm.sw_params_current().map_err(|e| e.to_string())?;
-    swp.set_start_threshold(period).map_err(|e| e.to_string())?;
-    swp.set_avail_min(period).map_err(|e| e.to_string())?;
-    pcm.sw_params(&swp).map_err(|e| e.to_string())?;
-    Ok(())
+fn format_entry(f: sys::oa_sample_format) -> Option<&'static (sys::oa_sample_format, Format, u16)> {
+    FORMATS.iter().find(|e| e.0 == f)
 }
 
-unsafe fn driver_thread(selfp: *mut Driver) {
-    loop {
-        let driver = &mut *selfp;
-        if !driver.state.running.load(Ordering::Acquire) {
-            break;
-        }
+fn probe_formats(pcm: &PCM) -> u32 {
+    match HwParams::any(pcm) {
+        Ok(hwp) => FORMATS
+            .iter()
+            .filter(|e| hwp.test_format(e.1).is_ok())
+            .fold(0, |mask, e| mask | sys::oa_format_bit(e.0)),
+        Err(_) => 0,
+    }
+}
 
-        let frames = driver.state.cfg.buffer_frames as usize;
-        let ich = driver.state.cfg.in_channels as usize;
-        let och = driver.state.cfg.out_channels as usize;
-        let interleaved = matches!(
-            driver.state.cfg.layout,
-            sys::oa_buffer_layout::OA_BUF_INTERLEAVED
-        );
+// What one direction of `pcm` accepts, in the terms of configure: the period is the stream's
+// buffer_frames and the ring holds `periods` of them. Channels land in the `dir` fields.
+fn probe_space(pcm: &PCM, dir: PcmDir, periods: u32) -> Option<sys::oa_config_space> {
+    let hwp = HwParams::any(pcm).ok()?;
+    let mut sp = space::empty();
+    let (lo, hi) = (hwp.get_rate_min().ok()?, hwp.get_rate_max().ok()?);
+    // Plugins that resample (plughw, dmix) take odd rates as well as the standard ones.
+    if lo < hi && hwp.test_rate(lo + 1).is_ok() && hwp.test_rate(hi - 1).is_ok() {
+        sp.flags |= sys::OA_CONFIG_RATE_CONTINUOUS;
+        sp.rate_min = lo;
+        sp.rate_max = hi;
+    }
+    space::set_rates(
+        &mut sp,
+        space::COMMON_RATES.iter().copied().filter(|&r| hwp.test_rate(r).is_ok()),
+    );
+    (sp.buffer_frames_min, sp.buffer_frames_max) = engine::period_range(&hwp, periods)?;
+    sp.buffer_frames_step = 1; // set_period_size rounds to the nearest size the device takes
+    let (cmin, cmax) = (hwp.get_channels_min().ok()?, hwp.get_channels_max().ok()?);
+    let channels = (cmin..=cmax.min(63))
+        .filter(|&c| hwp.test_channels(c).is_ok())
+        .fold(0, |mask, c| mask | space::channel_bits(c, c));
+    match dir {
+        PcmDir::Capture => (sp.in_channels, sp.in_channels_max) = (channels, cmax),
+        PcmDir::Playback => (sp.out_channels, sp.out_channels_max) = (channels, cmax),
+    }
+    sp.native_formats = probe_formats(pcm);
+    sp.supported_formats = sp.native_formats;
+    // Planar streams work everywhere: without planar access they are transposed.
+    sp.layouts = sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_INTERLEAVED)
+        | sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+    Some(sp)
+}
+
+// View of a 4-byte staging buffer as raw device bytes.
+fn as_bytes_mut(buf: &mut [f32], len: usize) -> &mut [u8] {
+    let len = len.min(std::mem::size_of_val(buf));
+    unsafe { std::slice::from_raw_parts_mut(buf.as_mut_ptr() as *mut u8, len) }
+}
 
-        if let Some(cap) = driver.state.io.cap.as_ref() {
-            let res = cap
-                .io_f32()
-                .and_then(|io| io.readi(&mut driver.state.in_buf[..frames * ich]));
-            if let Err(e) = res {
-                if e.errno() == nix::errno::Errno::EPIPE as i32 {
-                    let _ = cap.prepare();
-                    driver.state.underruns.fetch_add(1, Ordering::Relaxed);
-                }
+// The channel planes of `buf`, each on its own cache lines.
+fn plane_ptrs(planes: &mut [*mut u8], buf: &mut Buf<f32>) {
+    for (c, p) in planes.iter_mut().enumerate() {
+        *p = buf.plane(c) as *mut u8;
+    }
+}
+
+// Runs host.process with the device areas open; returns the frames to commit.
+unsafe fn mmap_dispatch(
+    selfp: *mut Driver,
+    out: &mut [u8],
+    in_frames: Option<usize>,
+    stamp: Option<Stamp>,
+) -> usize {
+    let driver = &mut *selfp;
+    let bytes = driver.state.sample_bytes;
+    let och = driver.state.cfg.out_channels as usize;
+    let mut frames = (out.len() / (och * bytes).max(1)).min(driver.state.cfg.buffer_frames as usize);
+    if let Some(n) = in_frames {
+        frames = frames.min(n);
+    }
+    engine::publish_areas(&mut driver.state.mmap.out_areas, out.as_mut_ptr(), bytes);
+    driver.state.mmap.frames = frames as u32;
+    driver.state.mmap.committed = None;
+
+    let ti = driver.state.clock.time_info(
+        stamp,
+        driver.state.stats.underruns(),
+        driver.state.stats.overruns(),
+    );
+    driver.state.clock.advance(frames as u32);
+    if !driver.state.host.is_null() {
+        if let Some(cb) = (*driver.state.host).process {
+            let t0 = driver.state.stats.begin();
+            let keep = cb(
+                driver.state.host_user,
+                ptr::null(),
+                ptr::null_mut(),
+                frames as u32,
+                &ti as *const _,
+                &driver.state.cfg as *const _,
+            );
+            driver.state.stats.end(t0);
+            // The committed frames still play; the thread exits before the next wakeup.
+            if keep == sys::OA_FALSE {
+                driver.state.gate.stop();
             }
         }
+    }
+
+    driver.state.mmap.frames = 0;
+    match driver.state.mmap.committed.take() {
+        Some(n) => n as usize,
+        None => {
+            out[..frames * och * bytes].fill(0);
+            frames
+        }
+    }
+}
+
+unsafe fn mmap_cycle(selfp: *mut Driver) {
+    let driver = &mut *selfp;
+    let frames = driver.state.cfg.buffer_frames as usize;
+    let ich = driver.state.cfg.in_channels as usize;
+    if !driver.state.io.wait(&driver.state.stats) {
+        driver.state.recovered(0);
+        return;
+    }
+    let pb = match driver.state.io.pb.as_ref() {
+        Some(pb) => pb,
+        None => return,
+    };
+    let stamp = driver.state.io.stamp(0);
+    let bytes = driver.state.sample_bytes;
+    let pb_io = pb.io_bytes();
+    let res = match driver.state.io.cap.as_ref() {
+        Some(cap) => cap.io_bytes().mmap(frames, |inp| {
+            let avail = inp.len() / (ich * bytes);
+            engine::publish_areas(&mut (*selfp).state.mmap.in_areas, inp.as_mut_ptr(), bytes);
+            pb_io
+                .mmap(frames, |out| mmap_dispatch(selfp, out, Some(avail), stamp))
+                .unwrap_or(avail)
+        }),
+        None => pb_io.mmap(frames, |out| mmap_dispatch(selfp, out, None, stamp)),
+    };
+    if let Err(e) = res {
+        if engine::is_xrun(&e) {
+            // The wakeup's output was never committed.
+            driver.state.io.recover(Xrun::Underrun, e.errno(), &driver.state.stats);
+            driver.state.recovered(frames as u32);
+        }
+    }
+}
 
-        let ti = sys::oa_time_info {
-            host_time_ns: driver.state.time0.elapsed().as_nanos() as u64,
-            device_time_ns: 0,
-            underruns: driver.state.underruns.load(Ordering::Relaxed),
-            overruns: driver.state.overruns.load(Ordering::Relaxed),
+unsafe fn driver_thread(selfp: *mut Driver) {
+    while (*selfp).state.gate.proceed() {
+        cycle(selfp);
+    }
+}
+
+// One wakeup: waits for the device, moves the period through the host, then autotunes.
+unsafe fn cycle(selfp: *mut Driver) {
+    let driver = &mut *selfp;
+    if driver.state.mmap.enabled {
+        mmap_cycle(selfp);
+        autotune(selfp);
+        return;
+    }
+
+    let frames = driver.state.wake_frames() as usize;
+    let ich = driver.state.cfg.in_channels as usize;
+    let och = driver.state.cfg.out_channels as usize;
+    let interleaved = matches!(
+        driver.state.cfg.layout,
+        sys::oa_buffer_layout::OA_BUF_INTERLEAVED
+    );
+
+    let bytes = driver.state.sample_bytes;
+    let hw_planar = driver.state.hw_planar;
+    // Capture first, then playback; with the poll engine neither call blocks.
+    if !driver.state.io.wait(&driver.state.stats) {
+        driver.state.recovered(0);
+        return;
+    }
+    if driver.state.io.cap.is_some() {
+        let s = &mut driver.state;
+        let read = if hw_planar {
+            s.io.read(Samples::Planar(&mut s.in_planes), frames, &s.stats)
+        } else if interleaved {
+            s.io.read(Samples::Interleaved(as_bytes_mut(&mut s.in_buf, frames * ich * bytes)), frames, &s.stats)
+        } else {
+            let read = s.io.read(Samples::Interleaved(as_bytes_mut(&mut s.stage, frames * ich * bytes)), frames, &s.stats);
+            sys::convert::oa_deinterleave_bytes(
+                s.in_planes.as_ptr() as *const *mut c_void,
+                s.stage.as_ptr() as *const c_void,
+                ich as u32,
+                frames,
+                bytes as u32,
+            );
+            read
         };
-        if !driver.state.host.is_null() {
-            let host = &*driver.state.host;
-            if let Some(cb) = host.process {
-                let in_ptr: *const c_void;
-                let out_ptr: *mut c_void;
-                if interleaved {
-                    in_ptr = if ich > 0 {
-                        driver.state.in_buf.as_ptr() as *const c_void
-                    } else {
-                        ptr::null()
-                    };
-                    out_ptr = driver.state.out_buf.as_mut_ptr() as *mut c_void;
-                } else {
-                    let mut in_planes: Vec<*const f32> = (0..ich)
-                        .map(|c| driver.state.in_buf.as_ptr().wrapping_add(c))
-                        .collect();
-                    let mut out_planes: Vec<*mut f32> = (0..och)
-                        .map(|c| driver.state.out_buf.as_mut_ptr().wrapping_add(c))
-                        .collect();
-                    in_ptr = if ich > 0 {
-                        in_planes.as_ptr() as *const c_void
-                    } else {
-                        ptr::null()
-                    };
-                    out_ptr = out_planes.as_mut_ptr() as *mut c_void;
-                }
-                cb(
-                    driver.state.host_user,
-                    in_ptr,
-                    out_ptr,
-                    frames as u32,
-                    &ti as *const _,
-                    &driver.state.cfg as *const _,
-                );
-            }
+        // The wakeup was lost to an overrun; the next one reports the gap.
+        if read < frames {
+            s.recovered(0);
+            return;
         }
+    }
 
-        if let Some(pb) = driver.state.io.pb.as_ref() {
-            let res = pb
-                .io_f32()
-                .and_then(|io| io.writei(&driver.state.out_buf[..frames * och]));
-            if let Err(e) = res {
-                if e.errno() == nix::errno::Errno::EPIPE as i32 {
-                    let _ = pb.prepare();
-                    driver.state.underruns.fetch_add(1, Ordering::Relaxed);
-                }
-            }
+    let stamp = driver.state.io.stamp(frames);
+    let mut keep = sys::OA_TRUE;
+    if let Some(cb) = driver.state.callbacks.process_batch.filter(|_| !driver.state.batch.is_empty()) {
+        let s = &mut driver.state;
+        s.batch.stamp(&mut s.clock, stamp, s.stats.underruns(), s.stats.overruns());
+        let t0 = s.stats.begin();
+        keep = cb(s.host_user, s.batch.as_ptr(), s.batch.len() as u32, &s.cfg as *const _);
+        s.stats.end(t0);
+    } else if !driver.state.host.is_null() {
+        let ti = driver.state.clock.time_info(
+            stamp,
+            driver.state.stats.underruns(),
+            driver.state.stats.overruns(),
+        );
+        driver.state.clock.advance(frames as u32);
+        let host = &*driver.state.host;
+        if let Some(cb) = host.process {
+            let in_ptr: *const c_void = if ich == 0 {
+                ptr::null()
+            } else if interleaved {
+                driver.state.in_buf.as_ptr() as *const c_void
+            } else {
+                driver.state.in_planes.as_ptr() as *const c_void
+            };
+            let out_ptr: *mut c_void = if interleaved {
+                driver.state.out_buf.as_mut_ptr() as *mut c_void
+            } else {
+                driver.state.out_planes.as_mut_ptr() as *mut c_void
+            };
+            let t0 = driver.state.stats.begin();
+            keep = cb(
+                driver.state.host_user,
+                in_ptr,
+                out_ptr,
+                frames as u32,
+                &ti as *const _,
+                &driver.state.cfg as *const _,
+            );
+            driver.state.stats.end(t0);
         }
     }
+
+    let s = &mut driver.state;
+    let xrun = if hw_planar {
+        s.io.write(Samples::Planar(&mut s.out_planes), frames, &s.stats)
+    } else if interleaved {
+        s.io.write(Samples::Interleaved(as_bytes_mut(&mut s.out_buf, frames * och * bytes)), frames, &s.stats)
+    } else {
+        sys::convert::oa_interleave_bytes(
+            s.stage.as_mut_ptr() as *mut c_void,
+            s.out_planes.as_ptr() as *const *const c_void,
+            och as u32,
+            frames,
+            bytes as u32,
+        );
+        s.io.write(Samples::Interleaved(as_bytes_mut(&mut s.stage, frames * och * bytes)), frames, &s.stats)
+    };
+    if xrun {
+        s.recovered(0);
+    }
+    // The host ended the stream: this wakeup's output still goes out, then the thread exits.
+    if keep == sys::OA_FALSE {
+        s.gate.stop();
+        return;
+    }
+    autotune(selfp);
+}
+
+// RT, after a wakeup: feeds the tuner and hands a step to the stream's Stepper. The stream
+// runs on the old profile until retune() parks it.
+unsafe fn autotune(selfp: *mut Driver) {
+    let s = &mut (*selfp).state;
+    let Some(steps) = s.steps.as_ref().filter(|st| st.ready()) else {
+        return;
+    };
+    let frames = s.wake_frames();
+    let xruns = s.stats.overruns().wrapping_add(s.stats.underruns());
+    let load = s.stats.load_last();
+    if s.tune.as_mut().and_then(|t| t.observe(frames, xruns, load)).is_some() {
+        steps.request();
+    }
+}
+
+// Tuner thread: reconfigure for the profile the tuner stepped to. The worker is parked
+// while the PCMs are set up again and restarted, then the host hears the new latency. A
+// device that refuses the step stops the stream and asks the host for a reset. False while
+// the host has the stream paused.
+unsafe fn retune(selfp: *mut Driver) -> bool {
+    let control = (*selfp).state.control();
+    let s = &mut (*selfp).state;
+    if !s.steps.as_ref().is_some_and(Stepper::pending) {
+        return true;
+    }
+    if !s.gate.pause() {
+        return !s.gate.is_parked();
+    }
+    s.io.halt();
+    let cfg = s.cfg;
+    let stepped = configure_tuned(s, &cfg) == sys::OA_OK && s.io.start();
+    if stepped {
+        s.clock.resync();
+        s.gate.run();
+        if let Some(worker) = s.worker.as_ref() {
+            worker.wake();
+        }
+    } else {
+        s.gate.stop();
+    }
+    let (input, output) = s.latency();
+    // The host may call back in from its callbacks.
+    drop(control);
+    if !stepped {
+        if let Some(cb) = s.callbacks.reset_request {
+            cb(s.host_user);
+        }
+    } else if let Some(cb) = s.callbacks.latency_changed {
+        cb(s.host_user, input, output);
+    }
+    true
 }
 
 unsafe extern "C" fn get_default_config(
-    _selfp: *mut sys::oa_driver,
+    selfp: *mut sys::oa_driver,
     out: *mut sys::oa_stream_config,
 ) -> i32 {
+    let s = &*(selfp as *mut Driver);
     (*out).sample_rate = 48000;
-    (*out).buffer_frames = 128;
+    // With autotune, the period that device last settled on.
+    (*out).buffer_frames = s
+        .state
+        .autotune
+        .then(|| tune::load(TUNE_KEY, s.state.device_key(), 48000))
+        .flatten()
+        .map_or(128, |p| p.frames);
     (*out).in_channels = 2;
     (*out).out_channels = 2;
     (*out).format = sys::oa_sample_format::OA_SAMPLE_F32;
@@ -212,89 +623,628 @@ unsafe extern "C" fn get_default_config(
     sys::OA_OK
 }
 
-unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
-    if cfg.is_null() {
-        return sys::OA_ERR_INVALID_ARG;
+// Applies `cfg` to the open PCMs and sizes the period buffers for it. The worker must be
+// stopped; on error the PCMs are left unconfigured.
+fn configure(s: &mut DriverState, cfg: &sys::oa_stream_config) -> i32 {
+    let entry = match format_entry(cfg.format) {
+        Some(e) => e,
+        None => return sys::OA_ERR_UNSUPPORTED,
+    };
+    let Some(pb) = s.io.pb.as_ref() else {
+        return sys::OA_ERR_STATE;
+    };
+    let cap = s.io.cap.as_ref();
+    let mut native = probe_formats(pb);
+    if let Some(c) = cap {
+        native &= probe_formats(c);
     }
-    let cfg = &*cfg;
-    let s = &mut *(selfp as *mut Driver);
-    s.state.stop_worker();
-    s.state.io.pb = None;
-    s.state.io.cap = None;
-    s.state.cfg = *cfg;
-    s.state.time0 = Instant::now();
-    s.state.underruns.store(0, Ordering::Relaxed);
-    s.state.overruns.store(0, Ordering::Relaxed);
-    let name = s
-        .state
-        .dev_name
-        .clone()
-        .unwrap_or_else(|| "default".to_string());
+    s.native_formats = native;
+    if native & sys::oa_format_bit(cfg.format) == 0 {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    s.sample_bytes = sys::oa_sample_bytes(entry.0) as usize;
 
-    let pb = match PCM::new(&name, PcmDir::Playback, false) {
-        Ok(p) => p,
-        Err(_) => return sys::OA_ERR_DEVICE,
+    let mmap = s.mmap.enabled;
+    // Planar streams use planar device access when both directions take it; otherwise
+    // the driver transposes once per period. mmap areas describe either layout.
+    let planar = cfg.layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+    let hw_planar = planar
+        && !mmap
+        && engine::accepts_access(pb, Access::RWNonInterleaved)
+        && cap.map_or(true, |c| engine::accepts_access(c, Access::RWNonInterleaved));
+    let access = if mmap {
+        Access::MMapInterleaved
+    } else if hw_planar {
+        Access::RWNonInterleaved
+    } else {
+        Access::RWInterleaved
     };
-    let cap = if cfg.in_channels > 0 {
-        match PCM::new(&name, PcmDir::Capture, false) {
-            Ok(c) => Some(c),
-            Err(_) => return sys::OA_ERR_DEVICE,
+    // A batch the device cannot fit into its ring is halved until it does.
+    let wanted = batch::effective(s.batch_periods, &s.callbacks, mmap);
+    let mut periods = wanted;
+    loop {
+        let setup = Setup {
+            rate: cfg.sample_rate,
+            in_channels: cfg.in_channels as u32,
+            out_channels: cfg.out_channels as u32,
+            format: entry.1,
+            sample_bytes: s.sample_bytes,
+            access,
+            period: cfg.buffer_frames * periods,
+        };
+        if s.io.configure(&setup).is_ok() {
+            break;
         }
+        if periods == 1 {
+            return sys::OA_ERR_BACKEND;
+        }
+        periods /= 2;
+    }
+
+    // Buffers hold a wakeup's worth of frames; a batch is cut out of them.
+    let frames = (cfg.buffer_frames * periods) as usize;
+    let ich = cfg.in_channels as usize;
+    let och = cfg.out_channels as usize;
+    let sample_bytes = s.sample_bytes;
+    let layout = |frames: usize| {
+        let plane_words = (frames * sample_bytes).div_ceil(4);
+        let mut plan = Plan::new();
+        let parts = (
+            plan.planes::<f32>(ich.max(1), plane_words),
+            plan.planes::<f32>(och, plane_words),
+            plan.buf::<*mut u8>(ich),
+            plan.buf::<*mut u8>(och),
+            plan.buf::<f32>(if planar && !hw_planar { frames * ich.max(och) } else { 0 }),
+            plan.buf::<sys::oa_mmap_channel>(ich),
+            plan.buf::<sys::oa_mmap_channel>(och),
+            s.io.plan(&mut plan, frames),
+        );
+        (plan, parts)
+    };
+    let (mut plan, (in_buf, out_buf, in_planes, out_planes, stage, in_areas, out_areas, engine)) = layout(frames);
+    // With autotune the mapping has room for wakeups of the longest period on the ladder,
+    // so the tuner's steps cut it again in place.
+    if let Some(t) = s.tune.as_ref() {
+        plan.reserve(layout(t.max_frames() as usize * wanted as usize).0.bytes());
+    }
+    let arena = match s.memory.map(plan, s.rt_req.map_or(0, |r| r.flags)) {
+        Ok(arena) => arena,
+        Err(e) => {
+            eprintln!("openasio-alsa17h: {e}");
+            return sys::OA_ERR_BACKEND;
+        }
+    };
+    if let Err(e) = s.io.place(arena, engine) {
+        eprintln!("openasio-alsa17h: {e}");
+        return sys::OA_ERR_BACKEND;
+    }
+    s.in_buf = arena.get(in_buf);
+    s.out_buf = arena.get(out_buf);
+    s.in_planes = arena.get(in_planes);
+    s.out_planes = arena.get(out_planes);
+    s.stage = arena.get(stage);
+    // Zeroed areas are empty until the first period publishes the device's.
+    s.mmap.in_areas = arena.get(in_areas);
+    s.mmap.out_areas = arena.get(out_areas);
+    plane_ptrs(&mut s.in_planes, &mut s.in_buf);
+    plane_ptrs(&mut s.out_planes, &mut s.out_buf);
+    s.hw_planar = hw_planar;
+    s.mmap.frames = 0;
+    s.batch = if periods > 1 {
+        let input = (s.in_buf.as_mut_ptr() as *mut u8, ich, s.in_buf.stride() * 4);
+        let output = (s.out_buf.as_mut_ptr() as *mut u8, och, s.out_buf.stride() * 4);
+        Batch::new(periods as usize, cfg.buffer_frames, s.sample_bytes, planar, input, output)
     } else {
-        None
+        Batch::default()
     };
+    s.cfg = *cfg;
+    s.clock = StreamClock::new(cfg.sample_rate, frames as u32);
+    s.stats.reset(cfg.sample_rate, frames as u32);
+    sys::OA_OK
+}
+
+// configure() for `cfg`, or with a tuner for its current profile in place of the period
+// and ring size. A profile the device refuses is dropped for the next one up.
+fn configure_tuned(s: &mut DriverState, cfg: &sys::oa_stream_config) -> i32 {
+    let Some(mut profile) = s.tune.as_ref().map(Tuner::profile) else {
+        return configure(s, cfg);
+    };
+    loop {
+        s.io.set_periods(profile.periods);
+        let tuned = sys::oa_stream_config {
+            buffer_frames: profile.frames,
+            ..*cfg
+        };
+        let rc = configure(s, &tuned);
+        if rc != sys::OA_ERR_BACKEND {
+            return rc;
+        }
+        match s.tune.as_mut().and_then(Tuner::refused) {
+            Some(next) => profile = next,
+            None => return rc,
+        }
+    }
+}
+
+// A stream on a shared loop: due once Duplex::arm finds both directions ready.
+struct Shared(*mut Driver);
 
-    if let Some(ref c) = cap {
-        if hw_setup(c, PcmDir::Capture, cfg).is_err() {
+// SAFETY: the driver outlives its registration (stop_worker leaves the loop first).
+unsafe impl Send for Shared {}
+
+impl evloop::Client for Shared {
+    fn gate(&self) -> &Gate {
+        unsafe { &(*self.0).state.gate }
+    }
+
+    fn arm(&mut self, fds: &mut Vec<libc::pollfd>) -> Arm {
+        let s = unsafe { &mut (*self.0).state };
+        s.io.arm(fds, &s.stats).unwrap_or_else(|| {
+            s.recovered(0);
+            Arm::At(0)
+        })
+    }
+
+    fn events(&mut self, fds: &[libc::pollfd]) {
+        unsafe { (*self.0).state.io.events(fds) }
+    }
+
+    fn service(&mut self) {
+        unsafe { cycle(self.0) }
+    }
+}
+
+// Starts the RT thread on the configured PCMs, or joins a shared loop, parked until go().
+unsafe fn spawn_worker(selfp: *mut Driver) -> i32 {
+    let s = &mut *selfp;
+    s.state.gate.park();
+    if s.state.tune.is_some() {
+        let driver_ptr = selfp as usize;
+        match Stepper::spawn("openasio-alsa17h-tune", move || unsafe { retune(driver_ptr as *mut Driver) }) {
+            Ok(steps) => s.state.steps = Some(steps),
+            Err(e) => {
+                eprintln!("openasio-alsa17h: {e}");
+                s.state.gate.stop();
+                return sys::OA_ERR_BACKEND;
+            }
+        }
+    }
+    let shared = s.state.io.options().shared;
+    if shared > 0 {
+        return match Worker::shared(shared, s.state.rt_req.as_ref(), Box::new(Shared(selfp))) {
+            Ok((worker, info)) => {
+                s.state.worker = Some(worker);
+                s.state.rt_info = Some(info);
+                sys::OA_OK
+            }
+            Err(e) => {
+                eprintln!("openasio-alsa17h: {e}");
+                s.state.gate.stop();
+                sys::OA_ERR_BACKEND
+            }
+        };
+    }
+    let driver_ptr = selfp as usize;
+    let rt_req = s.state.rt_req;
+    let (rt_tx, rt_rx) = std::sync::mpsc::sync_channel(1);
+    let spawned = std::thread::Builder::new()
+        .name("openasio-alsa17h".into())
+        .spawn(move || unsafe {
+            let _ = rt_tx.send(openasio_rt::apply(rt_req.as_ref()));
+            driver_thread(driver_ptr as *mut Driver);
+        });
+    match spawned {
+        Ok(handle) => s.state.worker = Some(Worker::Thread(handle)),
+        Err(_) => {
+            s.state.gate.stop();
             return sys::OA_ERR_BACKEND;
         }
     }
-    if hw_setup(&pb, PcmDir::Playback, cfg).is_err() {
+    // Policy, affinity and locking are in place before the first host.process.
+    s.state.rt_info = rt_rx.recv().ok();
+    sys::OA_OK
+}
+
+// Starts the prepared PCMs on a full buffer of silence and lets the parked worker run, so
+// the first period has a whole buffer of headroom.
+unsafe fn go(selfp: *mut Driver) -> i32 {
+    let s = &mut (*selfp).state;
+    if !s.io.start() {
         return sys::OA_ERR_BACKEND;
     }
+    s.clock.resync();
+    s.gate.run();
+    if let Some(worker) = s.worker.as_ref() {
+        worker.wake();
+    }
+    // A step handed over while the host had the stream paused runs now.
+    if let Some(steps) = s.steps.as_ref() {
+        steps.kick();
+    }
+    sys::OA_OK
+}
 
-    let frames = cfg.buffer_frames as usize;
-    let ich = cfg.in_channels as usize;
-    let och = cfg.out_channels as usize;
-    s.state.in_buf.resize(frames * ich.max(1), 0.0);
-    s.state.out_buf.resize(frames * och, 0.0);
-    s.state.io.pb = Some(pb);
-    s.state.io.cap = cap;
-    s.state.running.store(true, Ordering::Release);
-    let driver_ptr = selfp as *mut Driver as usize;
-    s.state.worker = Some(std::thread::spawn(move || unsafe {
-        driver_thread(driver_ptr as *mut Driver);
-    }));
+// Opens and configures the device for `cfg` and spawns the worker parked.
+unsafe fn prepare_stream(selfp: *mut Driver, cfg: &sys::oa_stream_config) -> i32 {
+    let s = &mut *selfp;
+    if format_entry(cfg.format).is_none() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    s.state.stop_worker();
+    s.state.io.halt();
+    // stop() keeps the handles, so a restart only re-runs hw_params on them.
+    let rc = s.state.open_pcms(cfg.in_channels > 0);
+    if rc != sys::OA_OK {
+        return rc;
+    }
+    s.state.start_tuner(cfg.sample_rate);
+    let rc = configure_tuned(&mut s.state, cfg);
+    if rc != sys::OA_OK {
+        s.state.io.close();
+        return rc;
+    }
+    let rc = spawn_worker(selfp);
+    if rc != sys::OA_OK {
+        s.state.io.close();
+    }
+    rc
+}
+
+unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let selfp = selfp as *mut Driver;
+    let s = &mut *selfp;
+    // A prepared or paused stream on the same config only has to be started.
+    let resumed = {
+        let _control = (*selfp).state.control();
+        (s.state.parked() && s.state.runs(&*cfg)).then(|| go(selfp))
+    };
+    let rc = match resumed {
+        Some(rc) => rc,
+        None => {
+            let rc = prepare_stream(selfp, &*cfg);
+            if rc != sys::OA_OK {
+                return rc;
+            }
+            go(selfp)
+        }
+    };
+    if rc != sys::OA_OK {
+        s.state.stop_worker();
+        s.state.memory.release();
+        s.state.io.halt();
+    }
+    rc
+}
+
+unsafe extern "C" fn prepare(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    prepare_stream(selfp as *mut Driver, &*cfg)
+}
 
+unsafe extern "C" fn pause(selfp: *mut sys::oa_driver) -> i32 {
+    let _control = (*(selfp as *mut Driver)).state.control();
+    let s = &mut *(selfp as *mut Driver);
+    if !s.state.gate.pause() {
+        return sys::OA_ERR_STATE;
+    }
+    if !s.state.io.rewind() {
+        return sys::OA_ERR_BACKEND;
+    }
     sys::OA_OK
 }
 
+unsafe extern "C" fn resume(selfp: *mut sys::oa_driver) -> i32 {
+    let selfp = selfp as *mut Driver;
+    let _control = (*selfp).state.control();
+    if !(*selfp).state.parked() {
+        return sys::OA_ERR_STATE;
+    }
+    go(selfp)
+}
+
 unsafe extern "C" fn stop(selfp: *mut sys::oa_driver) -> i32 {
     let s = &mut *(selfp as *mut Driver);
     s.state.stop_worker();
-    s.state.io.pb = None;
-    s.state.io.cap = None;
+    s.state.memory.release();
+    s.state.io.halt();
     sys::OA_OK
 }
 
 unsafe extern "C" fn get_latency(
-    _: *mut sys::oa_driver,
+    selfp: *mut sys::oa_driver,
     in_lat: *mut u32,
     out_lat: *mut u32,
 ) -> i32 {
+    let s = &*(selfp as *mut Driver);
+    let _control = s.state.control();
+    let (input, output) = s.state.latency();
     if !in_lat.is_null() {
-        *in_lat = 0;
+        *in_lat = input;
     }
     if !out_lat.is_null() {
-        *out_lat = 0;
+        *out_lat = output;
+    }
+    sys::OA_OK
+}
+
+// Switches a running, prepared or paused stream to `cfg`: the open PCMs are re-prepared
+// with the new hardware parameters and reopened only if the device refuses that. The host
+// hears about the new latency before the RT thread resumes; a stream that was not running
+// stays parked.
+unsafe fn reconfigure(selfp: *mut Driver, cfg: sys::oa_stream_config) -> i32 {
+    let s = &mut *selfp;
+    // No tuner step moves the stream while its state is read.
+    let control = (*selfp).state.control();
+    let running = s.state.gate.is_running();
+    let streaming = s.state.worker.is_some() && (running || s.state.gate.is_parked());
+    if !streaming {
+        // Takes effect with the next start(), whose config the host passes along.
+        s.state.cfg = cfg;
+        return sys::OA_OK;
+    }
+    let old = s.state.cfg;
+    // set_buf to the tuned period still has to end the search.
+    let searching = s.state.tune.is_some() && !s.state.autotune;
+    if cfg.sample_rate == old.sample_rate && cfg.buffer_frames == old.buffer_frames && !searching {
+        return sys::OA_OK;
+    }
+    if let Some(steps) = s.state.steps.as_ref() {
+        steps.quit();
+    }
+    drop(control);
+
+    s.state.stop_worker();
+    s.state.io.halt();
+    if cfg.sample_rate != old.sample_rate || !s.state.autotune {
+        s.state.start_tuner(cfg.sample_rate);
+    }
+    let mut rc = configure_tuned(&mut s.state, &cfg);
+    if rc != sys::OA_OK {
+        s.state.io.close();
+        rc = s.state.open_pcms(cfg.in_channels > 0);
+        if rc == sys::OA_OK {
+            rc = configure_tuned(&mut s.state, &cfg);
+        }
+    }
+    if rc != sys::OA_OK {
+        // Keep the stream alive on the old settings if the device still takes them.
+        s.state.io.close();
+        if s.state.open_pcms(old.in_channels > 0) == sys::OA_OK
+            && configure(&mut s.state, &old) == sys::OA_OK
+            && spawn_worker(selfp) == sys::OA_OK
+            && (!running || go(selfp) == sys::OA_OK)
+        {
+            return rc;
+        }
+        s.state.stop_worker();
+        s.state.memory.release();
+        s.state.io.close();
+        return rc;
+    }
+
+    if !s.state.host.is_null() {
+        if let Some(cb) = (*s.state.host).latency_changed {
+            let (input, output) = s.state.latency();
+            cb(s.state.host_user, input, output);
+        }
+    }
+    let mut rc = spawn_worker(selfp);
+    if rc == sys::OA_OK && running {
+        rc = go(selfp);
+    }
+    if rc != sys::OA_OK {
+        s.state.stop_worker();
+        s.state.memory.release();
+        s.state.io.close();
+    }
+    rc
+}
+
+unsafe extern "C" fn set_sr(selfp: *mut sys::oa_driver, sr: u32) -> i32 {
+    let s = &*(selfp as *mut Driver);
+    if sr == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let cfg = sys::oa_stream_config {
+        sample_rate: sr,
+        ..s.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+// A period the host picks itself ends autotuning for this driver instance.
+unsafe extern "C" fn set_buf(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    if frames == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    s.state.autotune = false;
+    let cfg = sys::oa_stream_config {
+        buffer_frames: frames,
+        ..s.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn mmap_enable(selfp: *mut sys::oa_driver, enable: sys::oa_bool) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    if s.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    s.state.mmap.enabled = enable != sys::OA_FALSE;
+    sys::OA_OK
+}
+
+unsafe extern "C" fn mmap_begin_period(
+    selfp: *mut sys::oa_driver,
+    period: *mut sys::oa_mmap_period,
+) -> i32 {
+    if period.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let s = &mut *(selfp as *mut Driver);
+    let mm = &s.state.mmap;
+    if mm.frames == 0 {
+        return sys::OA_ERR_STATE;
+    }
+    let ich = if s.state.io.cap.is_some() {
+        mm.in_areas.len()
+    } else {
+        0
+    };
+    *period = sys::oa_mmap_period {
+        struct_size: std::mem::size_of::<sys::oa_mmap_period>() as u32,
+        frames: mm.frames,
+        in_channels: ich as u16,
+        out_channels: mm.out_areas.len() as u16,
+        sample_bits: format_entry(s.state.cfg.format).map_or(32, |e| e.2),
+        sample_bytes: s.state.sample_bytes as u16,
+        flags: if s.state.cfg.format == sys::oa_sample_format::OA_SAMPLE_F32 {
+            sys::OA_MMAP_FLOAT
+        } else {
+            0
+        },
+        in_: if ich > 0 { mm.in_areas.as_ptr() } else { ptr::null() },
+        out: mm.out_areas.as_ptr(),
+    };
+    sys::OA_OK
+}
+
+unsafe extern "C" fn mmap_commit_period(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    let mm = &mut s.state.mmap;
+    if mm.frames == 0 {
+        return sys::OA_ERR_STATE;
+    }
+    if frames > mm.frames {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    mm.committed = Some(frames);
+    sys::OA_OK
+}
+
+unsafe extern "C" fn set_batch_periods(selfp: *mut sys::oa_driver, periods: u32) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    if !batch::valid(periods) {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if periods > 1 && s.state.callbacks.process_batch.is_none() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    if s.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
     }
+    s.state.batch_periods = periods;
     sys::OA_OK
 }
-unsafe extern "C" fn set_sr(_: *mut sys::oa_driver, _: u32) -> i32 {
-    sys::OA_ERR_UNSUPPORTED
+
+unsafe extern "C" fn set_host_scratch(selfp: *mut sys::oa_driver, bytes: usize) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    if s.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    s.state.memory.set_host_scratch(bytes)
 }
-unsafe extern "C" fn set_buf(_: *mut sys::oa_driver, _: u32) -> i32 {
-    sys::OA_ERR_UNSUPPORTED
+
+unsafe extern "C" fn get_stream_memory(selfp: *mut sys::oa_driver, out: *mut sys::oa_stream_memory) -> i32 {
+    let s = &*(selfp as *mut Driver);
+    s.state.memory.write(out)
+}
+
+unsafe extern "C" fn get_supported_formats(
+    selfp: *mut sys::oa_driver,
+    native: *mut u32,
+    supported: *mut u32,
+) -> i32 {
+    let s = &mut *(selfp as *mut Driver);
+    if s.state.native_formats == 0 && s.state.io.pb.is_none() {
+        let name = s.state.dev_name.as_deref().unwrap_or("default");
+        let pb = match PCM::new(name, PcmDir::Playback, true) {
+            Ok(p) => p,
+            Err(_) => return sys::OA_ERR_DEVICE,
+        };
+        let mut mask = probe_formats(&pb);
+        if let Ok(cap) = PCM::new(name, PcmDir::Capture, true) {
+            mask &= probe_formats(&cap);
+        }
+        s.state.native_formats = mask;
+    }
+    // Everything start() accepts is streamed without conversion.
+    if !native.is_null() {
+        *native = s.state.native_formats;
+    }
+    if !supported.is_null() {
+        *supported = s.state.native_formats;
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_rt_info(selfp: *mut sys::oa_driver, out: *mut sys::oa_rt_info) -> i32 {
+    let s = &*(selfp as *mut Driver);
+    match &s.state.rt_info {
+        Some(info) => openasio_rt::write_info(info, out),
+        None => sys::OA_ERR_STATE,
+    }
+}
+
+unsafe extern "C" fn get_stream_stats(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_stats,
+) -> i32 {
+    let s = &*(selfp as *mut Driver);
+    s.state.stats.write(out)
+}
+
+unsafe extern "C" fn get_thread_params(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_thread_params,
+) -> i32 {
+    let s = &*(selfp as *mut Driver);
+    let _control = s.state.control();
+    let Some(info) = &s.state.rt_info else {
+        return sys::OA_ERR_STATE;
+    };
+    let params = openasio_rt::thread_params(Some(info), s.state.cfg.sample_rate, s.state.wake_frames());
+    openasio_rt::write_thread_params(&params, out)
+}
+
+// The open device answers from the handles it holds, so a running stream is not touched;
+// anything else is opened non-blocking just for the probe.
+unsafe extern "C" fn query_config_space(
+    selfp: *mut sys::oa_driver,
+    device: *const i8,
+    out: *mut sys::oa_config_space,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let s = &*(selfp as *mut Driver);
+    let named = (!device.is_null()).then(|| CStr::from_ptr(device).to_string_lossy().to_string());
+    let own = named.is_none() || named == s.state.dev_name;
+    let name = named
+        .as_deref()
+        .or(s.state.dev_name.as_deref())
+        .unwrap_or("default");
+    let periods = s.state.io.options().periods;
+    let probe = |held: Option<&PCM>, dir: PcmDir| match held.filter(|_| own) {
+        Some(pcm) => probe_space(pcm, dir, periods),
+        None => PCM::new(name, dir, true).ok().and_then(|pcm| probe_space(&pcm, dir, periods)),
+    };
+    let Some(mut sp) = probe(s.state.io.pb.as_ref(), PcmDir::Playback) else {
+        return sys::OA_ERR_DEVICE;
+    };
+    if let Some(cap) = probe(s.state.io.cap.as_ref(), PcmDir::Capture) {
+        space::narrow(&mut sp, &cap);
+        sp.in_channels = cap.in_channels;
+        sp.in_channels_max = cap.in_channels_max;
+    }
+    sp.in_channels |= 1; // playback only
+    space::write(&sp, out)
 }
 
 #[no_mangle]
@@ -309,7 +1259,11 @@ pub unsafe extern "C" fn openasio_driver_create(
     if p.host.is_null() {
         return sys::OA_ERR_INVALID_ARG;
     }
-    let drv = Box::new(Driver {
+    let Ok(options) = engine::Options::from_env() else {
+        return sys::OA_ERR_INVALID_ARG;
+    };
+    let mut drv = Box::new(Driver {
+        base: sys::oa_driver { vt: ptr::null() },
         vt: sys::oa_driver_vtable {
             struct_size: std::mem::size_of::<sys::oa_driver_vtable>() as u32,
             get_caps: Some(get_caps),
@@ -322,15 +1276,28 @@ pub unsafe extern "C" fn openasio_driver_create(
             get_latency: Some(get_latency),
             set_sample_rate: Some(set_sr),
             set_buffer_frames: Some(set_buf),
+            mmap_enable: Some(mmap_enable),
+            mmap_begin_period: Some(mmap_begin_period),
+            mmap_commit_period: Some(mmap_commit_period),
+            get_supported_formats: Some(get_supported_formats),
+            get_rt_info: Some(get_rt_info),
+            get_stream_stats: Some(get_stream_stats),
+            get_thread_params: Some(get_thread_params),
+            query_config_space: Some(query_config_space),
+            enumerate_devices: Some(enumerate_devices),
+            prepare: Some(prepare),
+            pause: Some(pause),
+            resume: Some(resume),
+            set_batch_periods: Some(set_batch_periods),
+            set_host_scratch: Some(set_host_scratch),
+            get_stream_memory: Some(get_stream_memory),
         },
         state: DriverState {
             host: p.host,
             host_user: p.host_user,
+            callbacks: openasio_rt::host_callbacks(p),
             dev_name: None,
-            io: Io {
-                cap: None,
-                pb: None,
-            },
+            io: Duplex::new(options),
             cfg: sys::oa_stream_config {
                 sample_rate: 48000,
                 buffer_frames: 128,
@@ -339,15 +1306,39 @@ pub unsafe extern "C" fn openasio_driver_create(
                 format: sys::oa_sample_format::OA_SAMPLE_F32,
                 layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
             },
-            time0: Instant::now(),
-            underruns: AtomicU32::new(0),
-            overruns: AtomicU32::new(0),
-            in_buf: Vec::new(),
-            out_buf: Vec::new(),
-            running: AtomicBool::new(false),
+            clock: StreamClock::new(48000, 128),
+            stats: StreamStats::default(),
+            sample_bytes: 4,
+            native_formats: 0,
+            in_buf: Buf::default(),
+            out_buf: Buf::default(),
+            hw_planar: false,
+            in_planes: Buf::default(),
+            out_planes: Buf::default(),
+            stage: Buf::default(),
+            memory: Memory::default(),
+            mmap: MmapState {
+                enabled: false,
+                in_areas: Buf::default(),
+                out_areas: Buf::default(),
+                frames: 0,
+                committed: None,
+            },
+            batch_periods: 1,
+            batch: Batch::default(),
+            autotune: options.autotune,
+            tune: None,
+            steps: None,
+            control: Mutex::new(()),
+            rt_req: openasio_rt::requested(p),
+            rt_info: None,
+            gate: Gate::new(),
             worker: None,
+            hotplug: devices::Notify::from_host(&openasio_rt::host_callbacks(p), p.host_user),
+            devices: None,
         },
     });
+    drv.base.vt = &drv.vt;
     *out = Box::into_raw(drv) as *mut sys::oa_driver;
     sys::OA_OK
 }
@@ -0,0 +1,463 @@
+//! openasio-bridge: runs one OpenASIO driver on behalf of hosts in other processes, such
+//! as sandboxed plugin hosts loading `libopenasio_driver_bridge.so`.
+//!
+//! Clients connect to a UNIX socket, one at a time; each connection gets its own driver
+//! instance, closed when it hangs up. The driver's RT thread copies each period into the
+//! stream mapping, wakes the client, and waits for its output until a share of the period
+//! (`--budget`) has passed; a client that misses it plays a period of silence.
+use openasio_driver_bridge::proto::{self, Layout, Mapping, Msg};
+use openasio_rt::clock;
+use openasio_sys as sys;
+use std::ffi::CString;
+use std::mem::size_of;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+use std::os::raw::c_void;
+use std::ptr;
+use std::sync::atomic::Ordering;
+
+const USAGE: &str = "usage: openasio-bridge <driver.so> [options]
+  --socket PATH   where clients connect (default: $OPENASIO_BRIDGE, else
+                  $XDG_RUNTIME_DIR/openasio-bridge.sock)
+  --budget PCT    share of a period the client has to return its output (default 75)
+  --fifo PRIO     ask for SCHED_FIFO at PRIO on the driver thread
+  --mlock         ask for mlockall and a pre-faulted stack on the driver thread";
+
+/// Largest mapping a client may ask for.
+const MAX_MAPPING: usize = 64 << 20;
+
+/// Capabilities the bridge carries; sample rate and buffer size changes restart the stream.
+const CAPS: u32 = sys::OA_CAP_OUTPUT
+    | sys::OA_CAP_INPUT
+    | sys::OA_CAP_FULL_DUPLEX
+    | sys::OA_CAP_SET_SAMPLERATE
+    | sys::OA_CAP_SET_BUFFRAMES
+    | sys::OA_CAP_TIME_INFO_EX;
+
+#[derive(Default)]
+struct Args {
+    driver: String,
+    socket: Option<String>,
+    budget: u32,
+    fifo: Option<i32>,
+    mlock: bool,
+}
+
+fn parse_args() -> Result<Args, String> {
+    let mut a = Args { budget: 75, ..Default::default() };
+    let mut it = std::env::args().skip(1);
+    fn val<T: std::str::FromStr>(it: &mut impl Iterator<Item = String>, flag: &str) -> Result<T, String> {
+        it.next()
+            .and_then(|v| v.parse().ok())
+            .ok_or_else(|| format!("{flag} needs a value"))
+    }
+    while let Some(arg) = it.next() {
+        match arg.as_str() {
+            "--socket" => a.socket = Some(val(&mut it, &arg)?),
+            "--budget" => a.budget = val(&mut it, &arg)?,
+            "--fifo" => a.fifo = Some(val(&mut it, &arg)?),
+            "--mlock" => a.mlock = true,
+            "-h" | "--help" => return Err(String::new()),
+            s if s.starts_with("--") => return Err(format!("unknown option {s}")),
+            s if a.driver.is_empty() => a.driver = s.to_string(),
+            s => return Err(format!("unexpected argument {s}")),
+        }
+    }
+    if a.driver.is_empty() {
+        return Err("missing driver library".into());
+    }
+    if !(1..=100).contains(&a.budget) {
+        return Err("--budget must be within 1..100".into());
+    }
+    Ok(a)
+}
+
+/// The driver instance of one connection. Boxed, so the `host_user` it was created with
+/// stays valid.
+struct Session {
+    lib: sys::loader::DriverLib,
+    drv: *mut sys::oa_driver,
+    callbacks: sys::oa_host_callbacks,
+    rt: Option<sys::oa_rt_params>,
+    budget: u32,
+    /// The stream's mapping and where its buffers are. Only replaced while stopped, so the
+    /// RT thread can use it without a lock.
+    map: Option<Mapping>,
+    layout: Option<Layout>,
+    cfg: sys::oa_stream_config,
+    running: bool,
+    /// The period last published.
+    seq: u32,
+}
+
+impl Session {
+    fn vt(&self) -> &sys::oa_driver_vtable {
+        unsafe { &*(*self.drv).vt }
+    }
+
+    unsafe fn stop(&mut self) {
+        if !self.running {
+            return;
+        }
+        if let Some(stop) = self.vt().stop {
+            stop(self.drv);
+        }
+        self.running = false;
+        if let Some(map) = &self.map {
+            map.header().stopped.store(1, Ordering::Release);
+            proto::futex_wake(&map.header().published);
+        }
+    }
+}
+
+impl Drop for Session {
+    fn drop(&mut self) {
+        unsafe {
+            self.stop();
+            if let Some(close) = self.vt().close_device {
+                close(self.drv);
+            }
+            (self.lib.destroy)(self.drv);
+        }
+    }
+}
+
+/// Copies `bytes` of every channel (`plane` apart in the mapping) or the interleaved block.
+unsafe fn copy_in(dst: *mut u8, src: *const c_void, planar: bool, channels: usize, bytes: usize, plane: usize) {
+    if src.is_null() {
+        return;
+    }
+    if planar {
+        let planes = src as *const *const u8;
+        for c in 0..channels {
+            ptr::copy_nonoverlapping(*planes.add(c), dst.add(c * plane), bytes);
+        }
+    } else {
+        ptr::copy_nonoverlapping(src as *const u8, dst, bytes * channels);
+    }
+}
+
+unsafe fn copy_out(dst: *mut c_void, src: *const u8, planar: bool, channels: usize, bytes: usize, plane: usize) {
+    if dst.is_null() {
+        return;
+    }
+    if planar {
+        let planes = dst as *const *mut u8;
+        for c in 0..channels {
+            ptr::copy_nonoverlapping(src.add(c * plane), *planes.add(c), bytes);
+        }
+    } else {
+        ptr::copy_nonoverlapping(src, dst as *mut u8, bytes * channels);
+    }
+}
+
+unsafe fn silence_out(dst: *mut c_void, cfg: &sys::oa_stream_config, planar: bool, frames: usize) {
+    if dst.is_null() {
+        return;
+    }
+    let channels = cfg.out_channels as usize;
+    if planar {
+        let planes = dst as *const *mut u8;
+        for c in 0..channels {
+            proto::silence(*planes.add(c), cfg.format, frames);
+        }
+    } else {
+        proto::silence(dst as *mut u8, cfg.format, frames * channels);
+    }
+}
+
+unsafe extern "C" fn bridge_process(
+    user: *mut c_void,
+    in_ptr: *const c_void,
+    out_ptr: *mut c_void,
+    frames: u32,
+    time: *const sys::oa_time_info,
+    cfg: *const sys::oa_stream_config,
+) -> i32 {
+    let entered = clock::monotonic_ns();
+    let s = &mut *(user as *mut Session);
+    let cfg = &*cfg;
+    let planar = cfg.layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+    let frames = frames.min(s.cfg.buffer_frames) as usize;
+    let (Some(map), Some(layout)) = (&s.map, &s.layout) else {
+        silence_out(out_ptr, cfg, planar, frames);
+        return sys::OA_TRUE;
+    };
+    let h = map.header();
+    if h.finished.load(Ordering::Acquire) != 0 {
+        silence_out(out_ptr, cfg, planar, frames);
+        return sys::OA_FALSE;
+    }
+    let bytes = frames * sys::oa_sample_bytes(cfg.format) as usize;
+    s.seq = s.seq.wrapping_add(1);
+    let k = s.seq;
+    let slot = (k & 1) as usize;
+    copy_in(map.at(layout.input[slot]), in_ptr, planar, cfg.in_channels as usize, bytes, layout.plane);
+    let meta = map.slot(slot);
+    meta.frames = frames as u32;
+    if !time.is_null() {
+        meta.time = *time;
+        // A driver built before the recovery fields leaves them out.
+        if (meta.time.struct_size as usize) < size_of::<sys::oa_time_info>() {
+            (meta.time.in_dropped, meta.time.out_dropped, meta.time.out_inserted) = (0, 0, 0);
+        }
+    }
+    h.published.store(k, Ordering::Release);
+    proto::futex_wake(&h.published);
+
+    let period_ns = frames as u64 * 1_000_000_000 / cfg.sample_rate.max(1) as u64;
+    let deadline = entered + period_ns * s.budget as u64 / 100;
+    loop {
+        let done = h.completed.load(Ordering::Acquire);
+        if done == k {
+            copy_out(out_ptr, map.at(layout.output[slot]), planar, cfg.out_channels as usize, bytes, layout.plane);
+            return sys::OA_TRUE;
+        }
+        let now = clock::monotonic_ns();
+        if now >= deadline {
+            break;
+        }
+        proto::futex_wait(&h.completed, done, deadline - now);
+    }
+    h.misses.fetch_add(1, Ordering::Release);
+    silence_out(out_ptr, cfg, planar, frames);
+    sys::OA_TRUE
+}
+
+unsafe extern "C" fn bridge_latency_changed(user: *mut c_void, input: u32, output: u32) {
+    let s = &*(user as *const Session);
+    if let Some(map) = &s.map {
+        let h = map.header();
+        h.latency_in.store(input, Ordering::Relaxed);
+        h.latency_out.store(output, Ordering::Relaxed);
+        h.latency_seq.fetch_add(1, Ordering::Release);
+    }
+}
+
+unsafe extern "C" fn bridge_reset_request(user: *mut c_void) {
+    let s = &*(user as *const Session);
+    if let Some(map) = &s.map {
+        map.header().resets.fetch_add(1, Ordering::Release);
+    }
+}
+
+unsafe fn create_session(a: &Args) -> Result<Box<Session>, String> {
+    let lib = sys::loader::DriverLib::load(&a.driver).map_err(|e| format!("{}: {e}", a.driver))?;
+    let mut s = Box::new(Session {
+        lib,
+        drv: ptr::null_mut(),
+        callbacks: sys::oa_host_callbacks {
+            process: Some(bridge_process),
+            latency_changed: Some(bridge_latency_changed),
+            reset_request: Some(bridge_reset_request),
+            devices_changed: None,
+            process_batch: None,
+        },
+        rt: (a.fifo.is_some() || a.mlock).then(|| sys::oa_rt_params {
+            struct_size: size_of::<sys::oa_rt_params>() as u32,
+            policy: if a.fifo.is_some() { sys::OA_RT_POLICY_FIFO } else { sys::OA_RT_POLICY_DEFAULT },
+            priority: a.fifo.unwrap_or(0),
+            flags: if a.mlock { sys::OA_RT_MLOCK | sys::OA_RT_PREFAULT } else { 0 },
+            ..Default::default()
+        }),
+        budget: a.budget,
+        map: None,
+        layout: None,
+        cfg: sys::oa_stream_config {
+            sample_rate: 48000,
+            buffer_frames: 128,
+            in_channels: 0,
+            out_channels: 0,
+            format: sys::oa_sample_format::OA_SAMPLE_F32,
+            layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+        },
+        running: false,
+        seq: 0,
+    });
+    let params = sys::oa_create_params {
+        struct_size: size_of::<sys::oa_create_params>() as u32,
+        host: &s.callbacks,
+        host_user: &mut *s as *mut Session as *mut c_void,
+        rt: s.rt.as_ref().map_or(ptr::null(), |r| r as *const _),
+        host_size: size_of::<sys::oa_host_callbacks>() as u32,
+    };
+    let mut drv = ptr::null_mut();
+    let rc = (s.lib.create)(&params, &mut drv);
+    if rc < 0 || drv.is_null() {
+        return Err(format!("{}: openasio_driver_create rc={rc}", a.driver));
+    }
+    s.drv = drv;
+    Ok(s)
+}
+
+fn device_name(msg: &Msg) -> Option<CString> {
+    let text = msg.text();
+    (!text.is_empty()).then(|| CString::new(text).ok()).flatten()
+}
+
+/// Answers one request. `None` closes the connection.
+unsafe fn handle(s: &mut Session, msg: &Msg) -> Option<(Msg, Option<OwnedFd>)> {
+    let vt = &*(*s.drv).vt;
+    let mut reply = Msg::new(msg.op);
+    let mut fd = None;
+    reply.rc = match msg.op {
+        proto::OP_HELLO if msg.a == proto::VERSION => {
+            reply.a = vt.get_caps.map_or(0, |f| f(s.drv)) & CAPS;
+            sys::OA_OK
+        }
+        proto::OP_HELLO => return None,
+        proto::OP_DEVICES => {
+            let mut buf = vec![0u8; proto::TEXT_MAX];
+            let rc = match vt.query_devices {
+                Some(q) => q(s.drv, buf.as_mut_ptr() as *mut i8, buf.len()),
+                None => sys::OA_ERR_UNSUPPORTED,
+            };
+            reply.text.copy_from_slice(&buf);
+            reply.text[proto::TEXT_MAX - 1] = 0;
+            rc
+        }
+        proto::OP_OPEN => {
+            s.stop();
+            let name = device_name(msg);
+            match vt.open_device {
+                Some(open) => open(s.drv, name.as_ref().map_or(ptr::null(), |n| n.as_ptr())),
+                None => sys::OA_ERR_UNSUPPORTED,
+            }
+        }
+        proto::OP_CLOSE => {
+            s.stop();
+            vt.close_device.map_or(sys::OA_OK, |close| close(s.drv))
+        }
+        proto::OP_DEFAULT_CONFIG => {
+            let mut cfg = s.cfg;
+            let rc = match vt.get_default_config {
+                Some(get) => get(s.drv, &mut cfg),
+                None => sys::OA_ERR_UNSUPPORTED,
+            };
+            reply.cfg = (&cfg).into();
+            rc
+        }
+        proto::OP_FORMATS => match sys::oa_vt_get!(vt, get_supported_formats) {
+            Some(get) => get(s.drv, &mut reply.a, &mut reply.b),
+            None => {
+                reply.b = sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32);
+                sys::OA_OK
+            }
+        },
+        proto::OP_CONFIG_SPACE => match sys::oa_vt_get!(vt, query_config_space) {
+            Some(query) => {
+                let name = device_name(msg);
+                reply.space.struct_size = size_of::<sys::oa_config_space>() as u32;
+                query(s.drv, name.as_ref().map_or(ptr::null(), |n| n.as_ptr()), &mut reply.space)
+            }
+            None => sys::OA_ERR_UNSUPPORTED,
+        },
+        proto::OP_MAP => {
+            s.stop();
+            match msg.cfg.config().and_then(|cfg| Some((cfg, Layout::new(&cfg)?))) {
+                Some((cfg, layout)) if layout.size <= MAX_MAPPING => {
+                    s.map = None;
+                    s.layout = None;
+                    match Mapping::create(layout.size) {
+                        Ok((map, memfd)) => {
+                            map.init();
+                            s.map = Some(map);
+                            s.layout = Some(layout);
+                            s.cfg = cfg;
+                            s.seq = 0;
+                            reply.b = layout.size as u32;
+                            fd = Some(memfd);
+                            sys::OA_OK
+                        }
+                        Err(e) => {
+                            eprintln!("openasio-bridge: stream mapping: {e}");
+                            sys::OA_ERR_BACKEND
+                        }
+                    }
+                }
+                _ => sys::OA_ERR_UNSUPPORTED,
+            }
+        }
+        proto::OP_START if s.map.is_some() && !s.running => match vt.start {
+            Some(start) => {
+                let rc = start(s.drv, &s.cfg);
+                s.running = rc == sys::OA_OK;
+                rc
+            }
+            None => sys::OA_ERR_UNSUPPORTED,
+        },
+        proto::OP_START => sys::OA_ERR_STATE,
+        proto::OP_STOP => {
+            s.stop();
+            sys::OA_OK
+        }
+        proto::OP_LATENCY => match vt.get_latency {
+            Some(get) => get(s.drv, &mut reply.a, &mut reply.b),
+            None => sys::OA_ERR_UNSUPPORTED,
+        },
+        _ => sys::OA_ERR_INVALID_ARG,
+    };
+    Some((reply, fd))
+}
+
+fn serve(conn: OwnedFd, a: &Args) -> Result<(), String> {
+    let mut session = unsafe { create_session(a)? };
+    loop {
+        let Some((msg, _)) = proto::recv(&conn).map_err(|e| e.to_string())? else {
+            return Ok(());
+        };
+        let Some((reply, fd)) = (unsafe { handle(&mut session, &msg) }) else {
+            return Err("client speaks another protocol version".into());
+        };
+        proto::send(&conn, &reply, fd.as_ref().map(|f| f.as_raw_fd())).map_err(|e| e.to_string())?;
+    }
+}
+
+fn listen(path: &str) -> Result<OwnedFd, String> {
+    unsafe {
+        let fd = libc::socket(libc::AF_UNIX, libc::SOCK_SEQPACKET | libc::SOCK_CLOEXEC, 0);
+        if fd < 0 {
+            return Err(format!("socket: {}", std::io::Error::last_os_error()));
+        }
+        let fd = OwnedFd::from_raw_fd(fd);
+        let addr = proto::address(path).ok_or_else(|| format!("socket path too long: {path}"))?;
+        // A socket left behind by an earlier server.
+        let _ = std::fs::remove_file(path);
+        if libc::bind(fd.as_raw_fd(), &addr as *const _ as *const libc::sockaddr, size_of::<libc::sockaddr_un>() as u32) != 0
+            || libc::listen(fd.as_raw_fd(), 4) != 0
+        {
+            return Err(format!("{path}: {}", std::io::Error::last_os_error()));
+        }
+        Ok(fd)
+    }
+}
+
+fn main() {
+    let args = match parse_args() {
+        Ok(a) => a,
+        Err(e) => {
+            if !e.is_empty() {
+                eprintln!("openasio-bridge: {e}");
+            }
+            eprintln!("{USAGE}");
+            std::process::exit(2);
+        }
+    };
+    let path = args.socket.clone().unwrap_or_else(proto::socket_path);
+    let listener = match listen(&path) {
+        Ok(l) => l,
+        Err(e) => {
+            eprintln!("openasio-bridge: {e}");
+            std::process::exit(1);
+        }
+    };
+    eprintln!("openasio-bridge: serving {} on {path}", args.driver);
+    loop {
+        let fd = unsafe { libc::accept4(listener.as_raw_fd(), ptr::null_mut(), ptr::null_mut(), libc::SOCK_CLOEXEC) };
+        if fd < 0 {
+            continue;
+        }
+        if let Err(e) = serve(unsafe { OwnedFd::from_raw_fd(fd) }, &args) {
+            eprintln!("openasio-bridge: {e}");
+        }
+    }
+}
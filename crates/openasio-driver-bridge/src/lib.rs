@@ -0,0 +1,696 @@
+//! OpenASIO bridge driver: the driver ABI for hosts that cannot open audio devices
+//! themselves, such as sandboxed plugin hosts, backed by a driver running in an
+//! `openasio-bridge` server process.
+//!
+//! Control calls are messages on the server's UNIX socket (`OPENASIO_BRIDGE`, else
+//! `$XDG_RUNTIME_DIR/openasio-bridge.sock`), connected on first use; device names pass
+//! through to the server's driver unchanged. Each stream gets a shared mapping from the
+//! server: its driver thread copies a period in, wakes this driver's thread through a
+//! futex, and copies the output back once `process` has run on the mapping in place. A
+//! period not returned within the server's budget plays as silence and counts as an
+//! underrun here; a host that falls further behind skips to the latest period.
+//!
+//! Sample rate and buffer size changes restart the stream on the server. mmap, batching
+//! and prepare/pause/resume are not bridged.
+#![allow(clippy::missing_safety_doc)]
+use openasio_rt::devices::{self, Device};
+use openasio_rt::gate::Gate;
+use openasio_rt::space;
+use openasio_rt::stats::{StreamStats, Xrun};
+use openasio_sys as sys;
+use proto::{Layout, Mapping, Msg};
+use std::ffi::CStr;
+use std::mem::size_of;
+use std::os::fd::{FromRawFd, OwnedFd};
+use std::os::raw::c_void;
+use std::ptr;
+use std::sync::atomic::Ordering;
+
+#[doc(hidden)]
+pub mod proto;
+
+/// Capabilities passed on from the server's driver.
+const CAPS: u32 = sys::OA_CAP_OUTPUT
+    | sys::OA_CAP_INPUT
+    | sys::OA_CAP_FULL_DUPLEX
+    | sys::OA_CAP_SET_SAMPLERATE
+    | sys::OA_CAP_SET_BUFFRAMES
+    | sys::OA_CAP_TIME_INFO_EX;
+
+/// How long a control call waits for the server.
+const REPLY_TIMEOUT_S: libc::time_t = 5;
+
+/// How often the driver thread looks at its gate while no period arrives.
+const IDLE_NS: u64 = 100_000_000;
+
+struct Conn {
+    sock: OwnedFd,
+    caps: u32,
+}
+
+impl Conn {
+    fn connect(path: &str) -> Result<Conn, String> {
+        let addr = proto::address(path).ok_or_else(|| format!("socket path too long: {path}"))?;
+        let sock = unsafe {
+            let fd = libc::socket(libc::AF_UNIX, libc::SOCK_SEQPACKET | libc::SOCK_CLOEXEC, 0);
+            if fd < 0 {
+                return Err(format!("socket: {}", std::io::Error::last_os_error()));
+            }
+            let sock = OwnedFd::from_raw_fd(fd);
+            if libc::connect(fd, &addr as *const _ as *const libc::sockaddr, size_of::<libc::sockaddr_un>() as u32) != 0 {
+                return Err(format!("{path}: {}", std::io::Error::last_os_error()));
+            }
+            let tv = libc::timeval { tv_sec: REPLY_TIMEOUT_S, tv_usec: 0 };
+            libc::setsockopt(
+                fd,
+                libc::SOL_SOCKET,
+                libc::SO_RCVTIMEO,
+                &tv as *const _ as *const c_void,
+                size_of::<libc::timeval>() as u32,
+            );
+            sock
+        };
+        let mut conn = Conn { sock, caps: 0 };
+        let mut hello = Msg::new(proto::OP_HELLO);
+        hello.a = proto::VERSION;
+        let (reply, _) = conn.call(&hello)?;
+        if reply.rc != sys::OA_OK {
+            return Err(format!("{path}: server refused the connection (rc={})", reply.rc));
+        }
+        conn.caps = reply.a & CAPS;
+        Ok(conn)
+    }
+
+    fn call(&self, msg: &Msg) -> Result<(Box<Msg>, Option<OwnedFd>), String> {
+        proto::send(&self.sock, msg, None).map_err(|e| e.to_string())?;
+        match proto::recv(&self.sock).map_err(|e| e.to_string())? {
+            Some((reply, fd)) if reply.op == msg.op => Ok((reply, fd)),
+            Some(_) => Err("out-of-order reply".into()),
+            None => Err("server hung up".into()),
+        }
+    }
+}
+
+/// The running stream's mapping and the period pointers into each of its slots.
+struct Stream {
+    map: Mapping,
+    layout: Layout,
+    /// One pointer per channel, for planar streams.
+    in_planes: [Vec<*mut u8>; 2],
+    out_planes: [Vec<*mut u8>; 2],
+}
+
+impl Stream {
+    fn new(map: Mapping, layout: Layout, cfg: &sys::oa_stream_config) -> Stream {
+        let planes = |base: [usize; 2], channels: u16| {
+            base.map(|b| (0..channels as usize).map(|c| map.at(b + c * layout.plane)).collect())
+        };
+        Stream {
+            in_planes: planes(layout.input, cfg.in_channels),
+            out_planes: planes(layout.output, cfg.out_channels),
+            map,
+            layout,
+        }
+    }
+
+    /// The buffers of `slot` as `process` takes them.
+    fn buffers(&self, slot: usize, planar: bool) -> (*const c_void, *mut c_void) {
+        if planar {
+            (self.in_planes[slot].as_ptr() as *const c_void, self.out_planes[slot].as_ptr() as *mut c_void)
+        } else {
+            (self.map.at(self.layout.input[slot]) as *const c_void, self.map.at(self.layout.output[slot]) as *mut c_void)
+        }
+    }
+}
+
+struct DriverState {
+    host: sys::oa_host_callbacks,
+    host_user: *mut c_void,
+    /// Connected on first use; dropped when the server goes away.
+    conn: Option<Conn>,
+    cfg: sys::oa_stream_config,
+    stream: Option<Stream>,
+    stats: StreamStats,
+    rt_req: Option<sys::oa_rt_params>,
+    rt_info: Option<sys::oa_rt_info>,
+    gate: Gate,
+    worker: Option<std::thread::JoinHandle<()>>,
+}
+
+#[repr(C)]
+struct Driver {
+    /// Must stay first: hosts reach the vtable through `oa_driver::vt`.
+    base: sys::oa_driver,
+    vt: sys::oa_driver_vtable,
+    state: DriverState,
+}
+
+impl DriverState {
+    fn connect(&mut self) -> Result<&Conn, i32> {
+        if self.conn.is_none() {
+            match Conn::connect(&proto::socket_path()) {
+                Ok(conn) => self.conn = Some(conn),
+                Err(e) => {
+                    eprintln!("openasio-bridge: {e}");
+                    return Err(sys::OA_ERR_BACKEND);
+                }
+            }
+        }
+        self.conn.as_ref().ok_or(sys::OA_ERR_BACKEND)
+    }
+
+    /// Sends one request, connecting first if need be. Transport failures are reported
+    /// here and come back as `OA_ERR_BACKEND`; the server's own result is in the reply.
+    fn request(&mut self, msg: &Msg) -> Result<(Box<Msg>, Option<OwnedFd>), i32> {
+        match self.connect()?.call(msg) {
+            Ok(reply) => Ok(reply),
+            Err(e) => {
+                eprintln!("openasio-bridge: {e}");
+                self.conn = None;
+                Err(sys::OA_ERR_BACKEND)
+            }
+        }
+    }
+
+    /// The server's result for a request whose reply carries nothing else.
+    fn simple(&mut self, msg: &Msg) -> i32 {
+        self.request(msg).map_or_else(|rc| rc, |(reply, _)| reply.rc)
+    }
+
+    fn device_names(&mut self) -> Result<Vec<String>, i32> {
+        let (reply, _) = self.request(&Msg::new(proto::OP_DEVICES))?;
+        if reply.rc != sys::OA_OK {
+            return Err(reply.rc);
+        }
+        Ok(reply.text().lines().filter(|l| !l.is_empty()).map(str::to_string).collect())
+    }
+
+    fn config_space(&mut self, device: &str) -> Result<sys::oa_config_space, i32> {
+        let (reply, _) = self.request(&Msg::new(proto::OP_CONFIG_SPACE).with_text(device))?;
+        if reply.rc != sys::OA_OK {
+            return Err(reply.rc);
+        }
+        Ok(reply.space)
+    }
+
+    /// Stops the server's stream first, so its driver thread is not left waiting on ours.
+    fn end_stream(&mut self) {
+        if self.worker.is_some() && self.conn.is_some() {
+            let _ = self.request(&Msg::new(proto::OP_STOP));
+        }
+        self.gate.stop();
+        if let Some(st) = &self.stream {
+            proto::futex_wake(&st.map.header().published);
+        }
+        if let Some(handle) = self.worker.take() {
+            let _ = handle.join();
+        }
+        self.rt_info = None;
+        self.stream = None;
+    }
+}
+
+impl Drop for DriverState {
+    fn drop(&mut self) {
+        self.end_stream();
+    }
+}
+
+/// Counts an xrun for each step `now` is ahead of `*seen`.
+fn count_xruns(stats: &StreamStats, kind: Xrun, seen: &mut u32, now: u32) {
+    for _ in 0..now.wrapping_sub(*seen).min(1024) {
+        stats.xrun(kind);
+    }
+    *seen = now;
+}
+
+unsafe fn driver_thread(selfp: *mut Driver) {
+    let d = &mut *selfp;
+    let DriverState { host, host_user, cfg, stream, stats, gate, .. } = &mut d.state;
+    let Some(st) = stream.as_ref() else {
+        return;
+    };
+    let h = st.map.header();
+    let planar = cfg.layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+    let mut seen = h.published.load(Ordering::Acquire);
+    let mut latency_seq = h.latency_seq.load(Ordering::Acquire);
+    let mut resets = h.resets.load(Ordering::Acquire);
+    let mut misses = h.misses.load(Ordering::Acquire);
+    // The server driver's own xrun counts, from its first period on.
+    let mut device: Option<(u32, u32)> = None;
+    while gate.proceed() {
+        let k = h.published.load(Ordering::Acquire);
+        if k == seen {
+            if h.stopped.load(Ordering::Acquire) != 0 {
+                break;
+            }
+            proto::futex_wait(&h.published, k, IDLE_NS);
+            continue;
+        }
+        seen = k;
+        let l = h.latency_seq.load(Ordering::Acquire);
+        if l != latency_seq {
+            latency_seq = l;
+            if let Some(cb) = host.latency_changed {
+                cb(*host_user, h.latency_in.load(Ordering::Relaxed), h.latency_out.load(Ordering::Relaxed));
+            }
+        }
+        let r = h.resets.load(Ordering::Acquire);
+        if r != resets {
+            resets = r;
+            if let Some(cb) = host.reset_request {
+                cb(*host_user);
+            }
+        }
+        count_xruns(stats, Xrun::Underrun, &mut misses, h.misses.load(Ordering::Acquire));
+
+        let slot = (k & 1) as usize;
+        let meta = st.map.slot(slot);
+        let frames = meta.frames.min(cfg.buffer_frames);
+        let mut ti = meta.time;
+        match &mut device {
+            Some((under, over)) => {
+                count_xruns(stats, Xrun::Underrun, under, ti.underruns);
+                count_xruns(stats, Xrun::Overrun, over, ti.overruns);
+            }
+            None => device = Some((ti.underruns, ti.overruns)),
+        }
+        ti.underruns = stats.underruns();
+        ti.overruns = stats.overruns();
+
+        let (in_ptr, out_ptr) = st.buffers(slot, planar);
+        let mut keep = sys::OA_TRUE;
+        if let Some(cb) = host.process {
+            let t0 = stats.begin();
+            keep = cb(
+                *host_user,
+                if cfg.in_channels == 0 { ptr::null() } else { in_ptr },
+                out_ptr,
+                frames,
+                &ti,
+                cfg as *const _,
+            );
+            stats.end(t0);
+        }
+        if keep == sys::OA_FALSE {
+            h.finished.store(1, Ordering::Release);
+        }
+        h.completed.store(k, Ordering::Release);
+        proto::futex_wake(&h.completed);
+        if keep == sys::OA_FALSE {
+            gate.stop();
+        }
+    }
+}
+
+unsafe fn spawn_worker(selfp: *mut Driver) -> i32 {
+    let d = &mut *selfp;
+    d.state.gate.run();
+    let driver_ptr = selfp as usize;
+    let rt_req = d.state.rt_req;
+    let (rt_tx, rt_rx) = std::sync::mpsc::sync_channel(1);
+    let spawned = std::thread::Builder::new()
+        .name("openasio-bridge".into())
+        .spawn(move || unsafe {
+            let _ = rt_tx.send(openasio_rt::apply(rt_req.as_ref()));
+            driver_thread(driver_ptr as *mut Driver);
+        });
+    match spawned {
+        Ok(handle) => d.state.worker = Some(handle),
+        Err(_) => {
+            d.state.gate.stop();
+            return sys::OA_ERR_BACKEND;
+        }
+    }
+    d.state.rt_info = rt_rx.recv().ok();
+    sys::OA_OK
+}
+
+/// Maps a new stream from the server, starts the thread waiting on it, then the server's
+/// driver.
+unsafe fn start_stream(selfp: *mut Driver, cfg: &sys::oa_stream_config) -> i32 {
+    let s = &mut (*selfp).state;
+    s.end_stream();
+    let Some(layout) = Layout::new(cfg) else {
+        return sys::OA_ERR_UNSUPPORTED;
+    };
+    let mut msg = Msg::new(proto::OP_MAP);
+    msg.cfg = cfg.into();
+    let (reply, fd) = match s.request(&msg) {
+        Ok(r) => r,
+        Err(rc) => return rc,
+    };
+    if reply.rc != sys::OA_OK {
+        return reply.rc;
+    }
+    let map = match fd {
+        Some(fd) if reply.b as usize == layout.size => Mapping::open(&fd, layout.size).map_err(|e| e.to_string()),
+        _ => Err("server sent no usable stream mapping".into()),
+    };
+    match map {
+        Ok(map) if map.valid() => s.stream = Some(Stream::new(map, layout, cfg)),
+        Ok(_) => {
+            eprintln!("openasio-bridge: stream mapping from another protocol version");
+            return sys::OA_ERR_BACKEND;
+        }
+        Err(e) => {
+            eprintln!("openasio-bridge: {e}");
+            return sys::OA_ERR_BACKEND;
+        }
+    }
+    s.cfg = *cfg;
+    s.stats.reset(cfg.sample_rate, cfg.buffer_frames);
+    let rc = spawn_worker(selfp);
+    if rc != sys::OA_OK {
+        s.end_stream();
+        return rc;
+    }
+    let rc = s.simple(&Msg::new(proto::OP_START));
+    if rc != sys::OA_OK {
+        s.end_stream();
+    }
+    rc
+}
+
+unsafe extern "C" fn get_caps(selfp: *mut sys::oa_driver) -> u32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.connect().map_or(0, |c| c.caps)
+}
+
+unsafe extern "C" fn query_devices(selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    let (reply, _) = match d.state.request(&Msg::new(proto::OP_DEVICES)) {
+        Ok(r) => r,
+        Err(rc) => return rc,
+    };
+    let list = reply.text();
+    let bytes = list.as_bytes();
+    let n = bytes.len().min(len.saturating_sub(1));
+    if n > 0 {
+        ptr::copy_nonoverlapping(bytes.as_ptr(), buf as *mut u8, n);
+    }
+    if len > 0 {
+        *buf.add(n) = 0;
+    }
+    reply.rc
+}
+
+/// The server driver's device names, with channel counts from their config spaces.
+unsafe extern "C" fn enumerate_devices(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_device_info,
+    capacity: u32,
+    count: *mut u32,
+) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    let names = match d.state.device_names() {
+        Ok(n) => n,
+        Err(rc) => return rc,
+    };
+    let list: Vec<Device> = names
+        .into_iter()
+        .enumerate()
+        .map(|(i, name)| {
+            let sp = d.state.config_space(&name).unwrap_or_default();
+            Device {
+                description: format!("{name} (bridged)"),
+                name,
+                in_channels: sp.in_channels_max.min(u16::MAX as u32) as u16,
+                out_channels: sp.out_channels_max.min(u16::MAX as u32) as u16,
+                default: i == 0,
+            }
+        })
+        .collect();
+    devices::write(list.iter().enumerate().map(|(i, dev)| (i as u32 + 1, dev)), out, capacity, count)
+}
+
+unsafe extern "C" fn open_device(selfp: *mut sys::oa_driver, name: *const i8) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    let name = if name.is_null() { String::new() } else { CStr::from_ptr(name).to_string_lossy().into_owned() };
+    if name.len() >= proto::TEXT_MAX {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    d.state.simple(&Msg::new(proto::OP_OPEN).with_text(&name))
+}
+
+unsafe extern "C" fn close_device(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    if d.state.conn.is_none() {
+        return sys::OA_OK;
+    }
+    d.state.simple(&Msg::new(proto::OP_CLOSE))
+}
+
+unsafe extern "C" fn get_default_config(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_config,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let d = &mut *(selfp as *mut Driver);
+    match d.state.request(&Msg::new(proto::OP_DEFAULT_CONFIG)) {
+        Ok((reply, _)) if reply.rc != sys::OA_OK => reply.rc,
+        Ok((reply, _)) => match reply.cfg.config() {
+            Some(cfg) => {
+                *out = cfg;
+                sys::OA_OK
+            }
+            None => sys::OA_ERR_DEVICE,
+        },
+        Err(rc) => rc,
+    }
+}
+
+unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    start_stream(selfp as *mut Driver, &*cfg)
+}
+
+unsafe extern "C" fn stop(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_latency(
+    selfp: *mut sys::oa_driver,
+    in_lat: *mut u32,
+    out_lat: *mut u32,
+) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    let (reply, _) = match d.state.request(&Msg::new(proto::OP_LATENCY)) {
+        Ok(r) => r,
+        Err(rc) => return rc,
+    };
+    if !in_lat.is_null() {
+        *in_lat = reply.a;
+    }
+    if !out_lat.is_null() {
+        *out_lat = reply.b;
+    }
+    reply.rc
+}
+
+/// A running stream restarts on `cfg`, and the host hears the latency the server's driver
+/// reports for it; the old config comes back if the server refuses the new one.
+unsafe fn reconfigure(selfp: *mut Driver, cfg: sys::oa_stream_config) -> i32 {
+    let d = &mut *selfp;
+    if d.state.worker.is_none() {
+        // Takes effect with the next start(), whose config the host passes along.
+        d.state.cfg = cfg;
+        return sys::OA_OK;
+    }
+    let old = d.state.cfg;
+    if cfg.sample_rate == old.sample_rate && cfg.buffer_frames == old.buffer_frames {
+        return sys::OA_OK;
+    }
+    let rc = start_stream(selfp, &cfg);
+    if rc != sys::OA_OK {
+        start_stream(selfp, &old);
+        return rc;
+    }
+    if let Some(cb) = d.state.host.latency_changed {
+        let (mut input, mut output) = (0, 0);
+        if get_latency(selfp as *mut sys::oa_driver, &mut input, &mut output) == sys::OA_OK {
+            cb(d.state.host_user, input, output);
+        }
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn set_sr(selfp: *mut sys::oa_driver, sr: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if sr == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let cfg = sys::oa_stream_config {
+        sample_rate: sr,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn set_buf(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if frames == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if frames > proto::MAX_FRAMES {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    let cfg = sys::oa_stream_config {
+        buffer_frames: frames,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn get_supported_formats(
+    selfp: *mut sys::oa_driver,
+    native: *mut u32,
+    supported: *mut u32,
+) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    let (reply, _) = match d.state.request(&Msg::new(proto::OP_FORMATS)) {
+        Ok(r) => r,
+        Err(rc) => return rc,
+    };
+    if !native.is_null() {
+        *native = reply.a;
+    }
+    if !supported.is_null() {
+        *supported = reply.b;
+    }
+    reply.rc
+}
+
+unsafe extern "C" fn get_rt_info(selfp: *mut sys::oa_driver, out: *mut sys::oa_rt_info) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    match &d.state.rt_info {
+        Some(info) => openasio_rt::write_info(info, out),
+        None => sys::OA_ERR_STATE,
+    }
+}
+
+/// Callback timing is this process's; xruns include the periods the server played as
+/// silence because the host missed them.
+unsafe extern "C" fn get_stream_stats(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_stats,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    d.state.stats.write(out)
+}
+
+unsafe extern "C" fn get_thread_params(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_thread_params,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    let Some(info) = &d.state.rt_info else {
+        return sys::OA_ERR_STATE;
+    };
+    let params = openasio_rt::thread_params(Some(info), d.state.cfg.sample_rate, d.state.cfg.buffer_frames);
+    openasio_rt::write_thread_params(&params, out)
+}
+
+/// The server driver's space, less what the mapping cannot carry.
+unsafe extern "C" fn query_config_space(
+    selfp: *mut sys::oa_driver,
+    device: *const i8,
+    out: *mut sys::oa_config_space,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let d = &mut *(selfp as *mut Driver);
+    let device = if device.is_null() { String::new() } else { CStr::from_ptr(device).to_string_lossy().into_owned() };
+    let mut sp = match d.state.config_space(&device) {
+        Ok(sp) => sp,
+        Err(rc) => return rc,
+    };
+    sp.buffer_frames_max = sp.buffer_frames_max.min(proto::MAX_FRAMES);
+    sp.in_channels_max = sp.in_channels_max.min(proto::MAX_CHANNELS as u32);
+    sp.out_channels_max = sp.out_channels_max.min(proto::MAX_CHANNELS as u32);
+    sp.struct_size = size_of::<sys::oa_config_space>() as u32;
+    space::write(&sp, out)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_create(
+    params: *const sys::oa_create_params,
+    out: *mut *mut sys::oa_driver,
+) -> i32 {
+    if params.is_null() || out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let p = &*params;
+    if p.host.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let mut drv = Box::new(Driver {
+        base: sys::oa_driver { vt: ptr::null() },
+        vt: sys::oa_driver_vtable {
+            struct_size: size_of::<sys::oa_driver_vtable>() as u32,
+            get_caps: Some(get_caps),
+            query_devices: Some(query_devices),
+            open_device: Some(open_device),
+            close_device: Some(close_device),
+            get_default_config: Some(get_default_config),
+            start: Some(start),
+            stop: Some(stop),
+            get_latency: Some(get_latency),
+            set_sample_rate: Some(set_sr),
+            set_buffer_frames: Some(set_buf),
+            mmap_enable: None,
+            mmap_begin_period: None,
+            mmap_commit_period: None,
+            get_supported_formats: Some(get_supported_formats),
+            get_rt_info: Some(get_rt_info),
+            get_stream_stats: Some(get_stream_stats),
+            get_thread_params: Some(get_thread_params),
+            query_config_space: Some(query_config_space),
+            enumerate_devices: Some(enumerate_devices),
+            prepare: None,
+            pause: None,
+            resume: None,
+            set_batch_periods: None,
+            set_host_scratch: None,
+            get_stream_memory: None,
+        },
+        state: DriverState {
+            host: openasio_rt::host_callbacks(p),
+            host_user: p.host_user,
+            conn: None,
+            cfg: sys::oa_stream_config {
+                sample_rate: 48000,
+                buffer_frames: 128,
+                in_channels: 2,
+                out_channels: 2,
+                format: sys::oa_sample_format::OA_SAMPLE_F32,
+                layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+            },
+            stream: None,
+            stats: StreamStats::default(),
+            rt_req: openasio_rt::requested(p),
+            rt_info: None,
+            gate: Gate::new(),
+            worker: None,
+        },
+    });
+    drv.base.vt = &drv.vt;
+    *out = Box::into_raw(drv) as *mut sys::oa_driver;
+    sys::OA_OK
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_destroy(driver: *mut sys::oa_driver) {
+    if !driver.is_null() {
+        let _ = Box::from_raw(driver as *mut Driver);
+    }
+}
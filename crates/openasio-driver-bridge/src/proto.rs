@@ -0,0 +1,461 @@
+//! What the bridge server and its clients share: fixed-size control messages on a UNIX
+//! SOCK_SEQPACKET socket, and the stream mapping both processes exchange periods through.
+//!
+//! The mapping is a sealed memfd the server creates per stream and passes with SCM_RIGHTS:
+//! a header of futex words, then two slots of input and output buffers. The server
+//! publishes period `k` in slot `k & 1` and bumps `published`; the client runs `process`
+//! on the slot in place and stores `k` in `completed`. The server never reads anything
+//! from the mapping but `completed` and the output bytes, so a misbehaving client can cost
+//! it a period of silence, nothing more.
+use openasio_sys as sys;
+use std::mem::{size_of, zeroed};
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd, RawFd};
+use std::ptr;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+pub const VERSION: u32 = 2; // 2: oa_time_info carries the recovery gap
+pub const MAGIC: u32 = u32::from_le_bytes(*b"OAbr");
+
+/// Socket the client connects to: `OPENASIO_BRIDGE`, else one in the runtime directory.
+pub fn socket_path() -> String {
+    if let Ok(path) = std::env::var("OPENASIO_BRIDGE") {
+        return path;
+    }
+    match std::env::var("XDG_RUNTIME_DIR") {
+        Ok(dir) => format!("{dir}/openasio-bridge.sock"),
+        Err(_) => format!("/tmp/openasio-bridge-{}.sock", unsafe { libc::getuid() }),
+    }
+}
+
+/// The socket address of `path`; `None` if it does not fit.
+pub fn address(path: &str) -> Option<libc::sockaddr_un> {
+    let mut addr: libc::sockaddr_un = unsafe { zeroed() };
+    addr.sun_family = libc::AF_UNIX as libc::sa_family_t;
+    if path.len() >= addr.sun_path.len() {
+        return None;
+    }
+    for (d, b) in addr.sun_path.iter_mut().zip(path.bytes()) {
+        *d = b as libc::c_char;
+    }
+    Some(addr)
+}
+
+// Requests; the reply echoes `op` with `rc` and the fields noted.
+pub const OP_HELLO: u32 = 1; // a = VERSION -> a = the driver's caps
+pub const OP_DEVICES: u32 = 2; // -> text = newline-separated device names
+pub const OP_OPEN: u32 = 3; // text = device, empty for the default
+pub const OP_CLOSE: u32 = 4;
+pub const OP_DEFAULT_CONFIG: u32 = 5; // -> cfg
+pub const OP_FORMATS: u32 = 6; // -> a = native, b = supported
+pub const OP_CONFIG_SPACE: u32 = 7; // text = device -> space
+pub const OP_MAP: u32 = 8; // cfg -> the stream mapping's fd, b = its size
+pub const OP_STOP: u32 = 9;
+pub const OP_LATENCY: u32 = 10; // -> a = input, b = output
+pub const OP_START: u32 = 11; // starts the mapped stream, once the client waits on it
+
+pub const TEXT_MAX: usize = 4096;
+
+/// `oa_stream_config` with its enums as plain integers, so that any bytes a peer sends are
+/// a valid message.
+#[repr(C)]
+#[derive(Clone, Copy, Debug, Default)]
+pub struct WireConfig {
+    pub sample_rate: u32,
+    pub buffer_frames: u32,
+    pub in_channels: u16,
+    pub out_channels: u16,
+    pub format: u32,
+    pub layout: u32,
+}
+
+impl From<&sys::oa_stream_config> for WireConfig {
+    fn from(c: &sys::oa_stream_config) -> Self {
+        WireConfig {
+            sample_rate: c.sample_rate,
+            buffer_frames: c.buffer_frames,
+            in_channels: c.in_channels,
+            out_channels: c.out_channels,
+            format: c.format as u32,
+            layout: c.layout as u32,
+        }
+    }
+}
+
+impl WireConfig {
+    pub fn config(&self) -> Option<sys::oa_stream_config> {
+        use sys::oa_sample_format::*;
+        let format = [OA_SAMPLE_F32, OA_SAMPLE_I16, OA_SAMPLE_U16, OA_SAMPLE_I32, OA_SAMPLE_I24_3LE, OA_SAMPLE_I24_IN_32]
+            .into_iter()
+            .find(|f| *f as u32 == self.format)?;
+        let layout = [sys::oa_buffer_layout::OA_BUF_INTERLEAVED, sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED]
+            .into_iter()
+            .find(|l| *l as u32 == self.layout)?;
+        Some(sys::oa_stream_config {
+            sample_rate: self.sample_rate,
+            buffer_frames: self.buffer_frames,
+            in_channels: self.in_channels,
+            out_channels: self.out_channels,
+            format,
+            layout,
+        })
+    }
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct Msg {
+    pub op: u32,
+    pub rc: i32,
+    pub a: u32,
+    pub b: u32,
+    pub cfg: WireConfig,
+    pub space: sys::oa_config_space,
+    pub text: [u8; TEXT_MAX],
+}
+
+impl Msg {
+    pub fn new(op: u32) -> Msg {
+        Msg { op, ..unsafe { zeroed() } }
+    }
+
+    /// The text up to its first NUL; a peer's unterminated text is cut at the buffer end.
+    pub fn text(&self) -> String {
+        let end = self.text.iter().position(|&b| b == 0).unwrap_or(TEXT_MAX);
+        String::from_utf8_lossy(&self.text[..end]).into_owned()
+    }
+
+    pub fn with_text(mut self, s: &str) -> Msg {
+        let n = s.len().min(TEXT_MAX - 1);
+        self.text[..n].copy_from_slice(&s.as_bytes()[..n]);
+        self.text[n] = 0;
+        self
+    }
+}
+
+/// Sends `msg`, with `fd` attached if given.
+pub fn send(sock: &OwnedFd, msg: &Msg, fd: Option<RawFd>) -> std::io::Result<()> {
+    unsafe {
+        let mut iov = libc::iovec { iov_base: msg as *const Msg as *mut libc::c_void, iov_len: size_of::<Msg>() };
+        let mut ctrl = [0u64; 4];
+        let mut hdr: libc::msghdr = zeroed();
+        hdr.msg_iov = &mut iov;
+        hdr.msg_iovlen = 1;
+        if let Some(fd) = fd {
+            hdr.msg_control = ctrl.as_mut_ptr() as *mut libc::c_void;
+            hdr.msg_controllen = libc::CMSG_SPACE(size_of::<RawFd>() as u32) as _;
+            let c = libc::CMSG_FIRSTHDR(&hdr);
+            (*c).cmsg_level = libc::SOL_SOCKET;
+            (*c).cmsg_type = libc::SCM_RIGHTS;
+            (*c).cmsg_len = libc::CMSG_LEN(size_of::<RawFd>() as u32) as _;
+            ptr::write_unaligned(libc::CMSG_DATA(c) as *mut RawFd, fd);
+        }
+        if libc::sendmsg(sock.as_raw_fd(), &hdr, libc::MSG_NOSIGNAL) != size_of::<Msg>() as isize {
+            return Err(std::io::Error::last_os_error());
+        }
+    }
+    Ok(())
+}
+
+/// Receives one message and the fd attached to it. `Ok(None)` when the peer hung up.
+pub fn recv(sock: &OwnedFd) -> std::io::Result<Option<(Box<Msg>, Option<OwnedFd>)>> {
+    let mut msg = Box::new(Msg::new(0));
+    unsafe {
+        let mut iov = libc::iovec { iov_base: &mut *msg as *mut Msg as *mut libc::c_void, iov_len: size_of::<Msg>() };
+        let mut ctrl = [0u64; 4];
+        let mut hdr: libc::msghdr = zeroed();
+        hdr.msg_iov = &mut iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = ctrl.as_mut_ptr() as *mut libc::c_void;
+        hdr.msg_controllen = size_of_val(&ctrl) as _;
+        let n = libc::recvmsg(sock.as_raw_fd(), &mut hdr, libc::MSG_CMSG_CLOEXEC);
+        if n < 0 {
+            return Err(std::io::Error::last_os_error());
+        }
+        let mut fd = None;
+        let mut c = libc::CMSG_FIRSTHDR(&hdr);
+        while !c.is_null() {
+            if (*c).cmsg_level == libc::SOL_SOCKET && (*c).cmsg_type == libc::SCM_RIGHTS {
+                fd = Some(OwnedFd::from_raw_fd(ptr::read_unaligned(libc::CMSG_DATA(c) as *const RawFd)));
+            }
+            c = libc::CMSG_NXTHDR(&hdr, c);
+        }
+        if n == 0 {
+            return Ok(None);
+        }
+        if n as usize != size_of::<Msg>() {
+            return Err(std::io::Error::new(std::io::ErrorKind::InvalidData, "short bridge message"));
+        }
+        Ok(Some((msg, fd)))
+    }
+}
+
+/// Shared futex word operations; the mapping is shared between processes, so these are
+/// not FUTEX_PRIVATE.
+pub fn futex_wait(word: &AtomicU32, expected: u32, timeout_ns: u64) {
+    let ts = libc::timespec {
+        tv_sec: (timeout_ns / 1_000_000_000) as libc::time_t,
+        tv_nsec: (timeout_ns % 1_000_000_000) as libc::c_long,
+    };
+    unsafe {
+        libc::syscall(libc::SYS_futex, word.as_ptr(), libc::FUTEX_WAIT, expected, &ts as *const libc::timespec, 0, 0);
+    }
+}
+
+pub fn futex_wake(word: &AtomicU32) {
+    unsafe {
+        libc::syscall(libc::SYS_futex, word.as_ptr(), libc::FUTEX_WAKE, i32::MAX, 0, 0, 0);
+    }
+}
+
+/// Per-slot data the server writes before publishing a period.
+#[repr(C)]
+pub struct Slot {
+    pub frames: u32,
+    pub time: sys::oa_time_info,
+}
+
+#[repr(C)]
+pub struct Header {
+    pub magic: u32,
+    pub version: u32,
+    /// Futex: the last period the server published.
+    pub published: AtomicU32,
+    /// Futex: the last period the client completed.
+    pub completed: AtomicU32,
+    /// Set by the server once its stream stopped.
+    pub stopped: AtomicU32,
+    /// Set by the client once `process` returned OA_FALSE.
+    pub finished: AtomicU32,
+    /// Periods the client did not complete in time; they played as silence.
+    pub misses: AtomicU32,
+    /// Bumped after each `latency_changed` the server's driver reported.
+    pub latency_seq: AtomicU32,
+    pub latency_in: AtomicU32,
+    pub latency_out: AtomicU32,
+    /// `reset_request`s from the server's driver.
+    pub resets: AtomicU32,
+    pub slots: [Slot; 2],
+}
+
+/// Where the buffers of a stream sit in its mapping. Both sides derive it from the config.
+#[derive(Clone, Copy, Debug)]
+pub struct Layout {
+    /// Bytes of one channel's period in a planar buffer.
+    pub plane: usize,
+    pub input: [usize; 2],
+    pub output: [usize; 2],
+    pub size: usize,
+}
+
+pub const MAX_CHANNELS: u16 = 256;
+pub const MAX_FRAMES: u32 = 65536;
+
+impl Layout {
+    /// None for a config the bridge does not carry.
+    pub fn new(cfg: &sys::oa_stream_config) -> Option<Layout> {
+        if cfg.buffer_frames == 0 || cfg.buffer_frames > MAX_FRAMES || cfg.in_channels > MAX_CHANNELS || cfg.out_channels > MAX_CHANNELS {
+            return None;
+        }
+        let plane = cfg.buffer_frames as usize * sys::oa_sample_bytes(cfg.format) as usize;
+        let region = |ch: u16| (plane * ch as usize).next_multiple_of(64);
+        let mut at = size_of::<Header>().next_multiple_of(64);
+        let mut take = |bytes: usize| {
+            let start = at;
+            at += bytes;
+            start
+        };
+        let input = [take(region(cfg.in_channels)), take(region(cfg.in_channels))];
+        let output = [take(region(cfg.out_channels)), take(region(cfg.out_channels))];
+        Some(Layout { plane, input, output, size: at.next_multiple_of(4096) })
+    }
+}
+
+/// A stream mapping, unmapped on drop.
+pub struct Mapping {
+    base: *mut u8,
+    len: usize,
+}
+
+// SAFETY: shared memory; all concurrent access goes through the header's atomics.
+unsafe impl Send for Mapping {}
+unsafe impl Sync for Mapping {}
+
+impl Mapping {
+    /// A zeroed, sealed memfd of `len` bytes mapped here; the fd goes to the client. The
+    /// seals keep the client from shrinking the file under the server (SIGBUS).
+    pub fn create(len: usize) -> std::io::Result<(Mapping, OwnedFd)> {
+        unsafe {
+            let fd = libc::memfd_create(c"openasio-bridge".as_ptr(), libc::MFD_CLOEXEC | libc::MFD_ALLOW_SEALING);
+            if fd < 0 {
+                return Err(std::io::Error::last_os_error());
+            }
+            let fd = OwnedFd::from_raw_fd(fd);
+            if libc::ftruncate(fd.as_raw_fd(), len as libc::off_t) != 0
+                || libc::fcntl(fd.as_raw_fd(), libc::F_ADD_SEALS, libc::F_SEAL_SHRINK | libc::F_SEAL_GROW | libc::F_SEAL_SEAL) != 0
+            {
+                return Err(std::io::Error::last_os_error());
+            }
+            let map = Mapping::map(&fd, len)?;
+            Ok((map, fd))
+        }
+    }
+
+    /// Maps a mapping received from the server, which must be at least `len` bytes.
+    pub fn open(fd: &OwnedFd, len: usize) -> std::io::Result<Mapping> {
+        unsafe {
+            let mut st: libc::stat = zeroed();
+            if libc::fstat(fd.as_raw_fd(), &mut st) != 0 {
+                return Err(std::io::Error::last_os_error());
+            }
+            if (st.st_size as usize) < len {
+                return Err(std::io::Error::new(std::io::ErrorKind::InvalidData, "bridge mapping too small"));
+            }
+            Mapping::map(fd, len)
+        }
+    }
+
+    unsafe fn map(fd: &OwnedFd, len: usize) -> std::io::Result<Mapping> {
+        let p = libc::mmap(ptr::null_mut(), len, libc::PROT_READ | libc::PROT_WRITE, libc::MAP_SHARED | libc::MAP_POPULATE, fd.as_raw_fd(), 0);
+        if p == libc::MAP_FAILED {
+            return Err(std::io::Error::last_os_error());
+        }
+        // Both RT threads touch every page each period; keep them resident where allowed.
+        libc::mlock(p, len);
+        Ok(Mapping { base: p as *mut u8, len })
+    }
+
+    pub fn header(&self) -> &Header {
+        unsafe { &*(self.base as *const Header) }
+    }
+
+    /// The slot's metadata; only the server writes it, only while the slot is not published.
+    #[allow(clippy::mut_from_ref)]
+    pub unsafe fn slot(&self, i: usize) -> &mut Slot {
+        &mut *ptr::addr_of_mut!((*(self.base as *mut Header)).slots[i])
+    }
+
+    pub fn at(&self, offset: usize) -> *mut u8 {
+        debug_assert!(offset <= self.len);
+        self.base.wrapping_add(offset)
+    }
+
+    /// Marks a new mapping valid. Server side, before sending it.
+    pub fn init(&self) {
+        let h = self.base as *mut Header;
+        unsafe {
+            (*h).magic = MAGIC;
+            (*h).version = VERSION;
+        }
+    }
+
+    pub fn valid(&self) -> bool {
+        let h = self.header();
+        h.magic == MAGIC && h.version == VERSION && h.published.load(Ordering::Acquire) == 0
+    }
+}
+
+impl Drop for Mapping {
+    fn drop(&mut self) {
+        unsafe { libc::munmap(self.base as *mut libc::c_void, self.len) };
+    }
+}
+
+/// Writes `samples` samples of silence in `format` to `dst`.
+pub unsafe fn silence(dst: *mut u8, format: sys::oa_sample_format, samples: usize) {
+    if format == sys::oa_sample_format::OA_SAMPLE_U16 {
+        let words = std::slice::from_raw_parts_mut(dst as *mut u16, samples);
+        words.fill(0x8000);
+    } else {
+        ptr::write_bytes(dst, 0, samples * sys::oa_sample_bytes(format) as usize);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn pair() -> (OwnedFd, OwnedFd) {
+        let mut fds = [0; 2];
+        assert_eq!(unsafe { libc::socketpair(libc::AF_UNIX, libc::SOCK_SEQPACKET | libc::SOCK_CLOEXEC, 0, fds.as_mut_ptr()) }, 0);
+        unsafe { (OwnedFd::from_raw_fd(fds[0]), OwnedFd::from_raw_fd(fds[1])) }
+    }
+
+    const CFG: sys::oa_stream_config = sys::oa_stream_config {
+        sample_rate: 48000,
+        buffer_frames: 100,
+        in_channels: 3,
+        out_channels: 2,
+        format: sys::oa_sample_format::OA_SAMPLE_I24_3LE,
+        layout: sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED,
+    };
+
+    #[test]
+    fn configs_cross_as_integers_and_bad_ones_are_refused() {
+        let wire = WireConfig::from(&CFG);
+        let back = wire.config().unwrap();
+        assert_eq!((back.sample_rate, back.buffer_frames, back.in_channels, back.out_channels), (48000, 100, 3, 2));
+        assert_eq!((back.format, back.layout), (CFG.format, CFG.layout));
+        assert!(WireConfig { format: 99, ..wire }.config().is_none());
+        assert!(WireConfig { layout: 7, ..wire }.config().is_none());
+
+        assert_eq!(Msg::new(OP_OPEN).with_text("hw:1").text(), "hw:1");
+        let long = "x".repeat(TEXT_MAX + 10);
+        assert_eq!(Msg::new(OP_OPEN).with_text(&long).text().len(), TEXT_MAX - 1);
+        let mut raw = Msg::new(OP_OPEN);
+        raw.text.fill(b'y'); // a peer's text without a NUL
+        assert_eq!(raw.text().len(), TEXT_MAX);
+    }
+
+    #[test]
+    fn messages_carry_the_mapping_to_the_client() {
+        let (server, client) = pair();
+        let layout = Layout::new(&CFG).unwrap();
+        let (map, fd) = Mapping::create(layout.size).unwrap();
+        map.init();
+        let reply = Msg { rc: sys::OA_OK, b: layout.size as u32, cfg: WireConfig::from(&CFG), ..Msg::new(OP_MAP) };
+        send(&server, &reply, Some(fd.as_raw_fd())).unwrap();
+        send(&server, &Msg::new(OP_STOP), None).unwrap();
+
+        let (msg, fd) = recv(&client).unwrap().unwrap();
+        assert_eq!((msg.op, msg.rc, msg.b as usize), (OP_MAP, sys::OA_OK, layout.size));
+        let theirs = Mapping::open(fd.as_ref().unwrap(), msg.b as usize).unwrap();
+        assert!(theirs.valid());
+        // One mapping seen from both sides.
+        unsafe { *map.at(layout.output[1]) = 0x5a };
+        assert_eq!(unsafe { *theirs.at(layout.output[1]) }, 0x5a);
+        map.header().published.store(1, Ordering::Release);
+        assert!(!theirs.valid(), "a mapping in use is not a fresh one");
+        // The client can neither resize the file nor ask for more than there is.
+        let fd = fd.unwrap();
+        assert_ne!(unsafe { libc::ftruncate(fd.as_raw_fd(), 64) }, 0);
+        assert_ne!(unsafe { libc::ftruncate(fd.as_raw_fd(), 2 * layout.size as libc::off_t) }, 0);
+        assert!(Mapping::open(&fd, layout.size + 1).is_err());
+
+        let (msg, fd) = recv(&client).unwrap().unwrap();
+        assert!(msg.op == OP_STOP && fd.is_none());
+        drop(server);
+        assert!(recv(&client).unwrap().is_none(), "hang-up");
+    }
+
+    #[test]
+    fn layouts_keep_every_buffer_on_its_own_lines() {
+        let l = Layout::new(&CFG).unwrap();
+        assert_eq!(l.plane, 300);
+        let regions = [(l.input[0], 900), (l.input[1], 900), (l.output[0], 600), (l.output[1], 600)];
+        let mut end = size_of::<Header>();
+        for (start, bytes) in regions {
+            assert!(start % 64 == 0 && start >= end);
+            end = start + bytes;
+        }
+        assert!(l.size % 4096 == 0 && l.size >= end);
+        assert!(Layout::new(&sys::oa_stream_config { buffer_frames: 0, ..CFG }).is_none());
+        assert!(Layout::new(&sys::oa_stream_config { buffer_frames: MAX_FRAMES + 1, ..CFG }).is_none());
+        assert!(Layout::new(&sys::oa_stream_config { out_channels: MAX_CHANNELS + 1, ..CFG }).is_none());
+
+        let mut buf = [0xffu8; 8];
+        unsafe { silence(buf.as_mut_ptr(), sys::oa_sample_format::OA_SAMPLE_U16, 2) };
+        assert_eq!(buf, [0, 0x80, 0, 0x80, 0xff, 0xff, 0xff, 0xff]);
+        unsafe { silence(buf.as_mut_ptr(), sys::oa_sample_format::OA_SAMPLE_I24_3LE, 2) };
+        assert_eq!(buf, [0, 0, 0, 0, 0, 0, 0xff, 0xff]);
+    }
+}
@@ -1,10 +1,17 @@
 //! CPAL-backed OpenASIO driver (v1.0.0). Full-duplex with interleaved & non-interleaved support.
 use cpal::traits::{DeviceTrait, HostTrait, StreamTrait};
+use openasio_rt::arena::{Buf, Memory, Plan};
+use openasio_rt::clock::{self, Stamp, StreamClock};
+use openasio_rt::devices::{self, Device, DeviceCache};
+use openasio_rt::resample::{self, Resampler};
+use openasio_rt::ring;
+use openasio_rt::space;
+use openasio_rt::stats::{StreamStats, Xrun};
 use openasio_sys as sys;
 use std::ffi::CStr;
 use std::os::raw::c_void;
-use std::sync::atomic::{AtomicU32, AtomicUsize, Ordering};
-use std::time::Instant;
+use std::sync::atomic::{AtomicBool, AtomicU32, Ordering};
+use std::time::Duration;
 
 struct DriverState {
     host: sys::oa_host_callbacks,
@@ -14,17 +21,76 @@ struct DriverState {
     out_stream: Option<cpal::Stream>,
     in_stream: Option<cpal::Stream>,
     cfg: sys::oa_stream_config,
-    time0: Instant,
-    underruns: AtomicU32,
-    overruns: AtomicU32,
+    clock: StreamClock, // position and smoothed period times; no hardware stamps via cpal
+    stats: StreamStats, // overruns are written by the input callback, all else by the output one
 
-    // Input staging (latest block). We keep interleaved f32 internally.
-    in_buf: Vec<f32>,
-    in_seq: AtomicUsize,
+    // Capture reaches the output callback through a wait-free SPSC ring; `drift` drains it
+    // at a trimmed rate so the two device clocks can differ, converting from the input
+    // device's rate. in_buf is the interleaved block handed to the host.
+    ring: ring::Ring,
+    drift: ring::DriftReader,
+    duplex: bool, // an input stream feeds `ring`
+    in_buf: Buf<f32>,
+    // Output device opened at another rate than cfg.sample_rate: the host renders into
+    // out_stage at its rate and out_conv converts that to the device's.
+    out_conv: Option<Resampler>,
+    out_stage: Buf<f32>,
+    out_conv_lat: u32, // out_conv's delay, in host frames
+    // Device-side delays in frames, measured from the callback timestamps.
+    in_dev_lat: AtomicU32,
+    out_dev_lat: AtomicU32,
+    running: AtomicBool,
+
+    // Non-interleaved staging, its planes laid out once in start().
+    in_planar: Buf<f32>,
+    in_planes: Buf<*mut f32>,
+    out_planar: Buf<f32>,
+    out_planes: Buf<*mut f32>,
+    // All buffers above come from one arena sized in start(), for `max_frames` device
+    // frames per piece of a callback; `rt_flags` (oa_create_params.rt) choose its pages.
+    memory: Memory,
+    max_frames: usize,
+    rt_flags: u32,
+
+    hotplug: Option<devices::Notify>, // host.devices_changed, if the host has it
+    devices: Option<DeviceCache>,     // built on the first query; cpal's ALSA backend, so /dev/snd is watched
+}
+
+impl DriverState {
+    fn device_cache(&mut self)->&DeviceCache {
+        let hotplug = self.hotplug;
+        self.devices.get_or_insert_with(|| DeviceCache::new(devices::ALSA_DEV_DIR, scan_devices, hotplug))
+    }
+}
+
+// Largest callback we stage in one piece. CPAL picks the size with BufferSize::Default;
+// anything bigger is rendered in pieces of this size.
+const MAX_CALLBACK_FRAMES: usize = 8192;
+
+// Ring depth: several of the largest blocks either stream may deliver.
+const RING_FRAMES: usize = 4 * MAX_CALLBACK_FRAMES;
+
+// Rate to open `dev` at for a stream at `rate`: the rate itself if the device takes it with
+// `channels` channels, else its default rate if the resampler can bridge the two.
+fn device_rate(dev: &cpal::Device, output: bool, channels: u16, rate: u32)->Option<u32>{
+    if rate_supported(dev, output, channels, rate) { return Some(rate); }
+    let default = if output { dev.default_output_config() } else { dev.default_input_config() };
+    let native = default.ok()?.sample_rate().0;
+    let max = resample::MAX_RATIO as u64;
+    (native as u64 <= rate as u64 * max && rate as u64 <= native as u64 * max).then_some(native)
+}
+
+fn to_frames(d: Option<Duration>, rate: u32) -> Option<u32> {
+    d.map(|d| (d.as_secs_f64() * rate as f64).round() as u32)
+}
+
+// Points `planes` at the planes of `buf`.
+fn layout_planes(buf: &mut Buf<f32>, planes: &mut [*mut f32]) {
+    for (c, p) in planes.iter_mut().enumerate() { *p = buf.plane(c); }
 }
 
 #[repr(C)]
-struct Driver { vt: sys::oa_driver_vtable, state: DriverState }
+struct Driver { base: sys::oa_driver, vt: sys::oa_driver_vtable, state: DriverState } // `base` first: hosts read `oa_driver::vt`
 
 #[derive(Copy, Clone)]
 struct DriverPtr(*mut Driver);
@@ -45,23 +111,43 @@ unsafe impl Send for DriverPtr {}
 unsafe impl Sync for DriverPtr {}
 
 unsafe extern "C" fn get_caps(_selfp:*mut sys::oa_driver)->u32 {
-    (sys::OA_CAP_OUTPUT | sys::OA_CAP_INPUT | sys::OA_CAP_FULL_DUPLEX) as u32
+    (sys::OA_CAP_OUTPUT | sys::OA_CAP_INPUT | sys::OA_CAP_FULL_DUPLEX | sys::OA_CAP_SET_SAMPLERATE | sys::OA_CAP_SET_BUFFRAMES) as u32 | sys::OA_CAP_TIME_INFO_EX
 }
 
-unsafe extern "C" fn query_devices(_selfp:*mut sys::oa_driver, buf:*mut i8, len: usize)->i32{
+// Output devices; input channels come from the input device of the same name, as in find_devices.
+fn scan_devices()->Vec<Device>{
     let host = cpal::default_host();
-    let mut names = String::new();
-    if let Ok(mut devs) = host.output_devices(){
-        while let Some(d)=devs.next(){ if let Ok(n)=d.name(){ names.push_str(&n); names.push('\n'); } }
+    let default_out = host.default_output_device().and_then(|d| d.name().ok());
+    let inputs: Vec<(String, u16)> = host.input_devices().map(|it| it.filter_map(|d| {
+        let ch = d.default_input_config().map(|c| c.channels()).unwrap_or(0);
+        d.name().ok().map(|n| (n, ch))
+    }).collect()).unwrap_or_default();
+    let mut out = Vec::new();
+    if let Ok(it) = host.output_devices(){
+        for d in it {
+            let Ok(name) = d.name() else { continue };
+            let in_channels = inputs.iter().find(|(n, _)| *n==name).map(|(_, ch)| *ch).unwrap_or(0);
+            let out_channels = d.default_output_config().map(|c| c.channels()).unwrap_or(0);
+            let default = default_out.as_deref()==Some(name.as_str());
+            out.push(Device{ name, in_channels, out_channels, default, ..Default::default() });
+        }
     }
+    out
+}
+
+unsafe extern "C" fn query_devices(selfp:*mut sys::oa_driver, buf:*mut i8, len: usize)->i32{
+    let s = &mut *(selfp as *mut Driver);
+    let mut names = s.state.device_cache().names();
+    if !names.is_empty(){ names.push('\n'); }
     let bytes = names.as_bytes(); let n = bytes.len().min(len.saturating_sub(1));
     if n>0 { std::ptr::copy_nonoverlapping(bytes.as_ptr(), buf as *mut u8, n); }
     if len>0 { *buf.add(n) = 0; }
     sys::OA_OK
 }
 
-unsafe extern "C" fn open_device(selfp:*mut sys::oa_driver, name:*const i8)->i32{
-    let s = &mut *(selfp as *mut Driver);
+// Output device by (partial) name or the default, plus the input device of the same name
+// or else the default input.
+unsafe fn find_devices(name:*const i8)->(Option<cpal::Device>, Option<cpal::Device>){
     let host = cpal::default_host();
 
     // Output device
@@ -80,8 +166,17 @@ unsafe extern "C" fn open_device(selfp:*mut sys::oa_driver, name:*const i8)->i32
         }
         found.or_else(|| host.default_input_device())
     } else { host.default_input_device() };
+    (out, inp)
+}
 
-    match (out, inp) {
+unsafe extern "C" fn enumerate_devices(selfp:*mut sys::oa_driver, out:*mut sys::oa_device_info, capacity:u32, count:*mut u32)->i32{
+    let s = &mut *(selfp as *mut Driver);
+    s.state.device_cache().write(out, capacity, count)
+}
+
+unsafe extern "C" fn open_device(selfp:*mut sys::oa_driver, name:*const i8)->i32{
+    let s = &mut *(selfp as *mut Driver);
+    match find_devices(name) {
         (Some(o), i) => { s.state.out_device = Some(o); s.state.in_device = i; 0 }
         _ => sys::OA_ERR_DEVICE,
     }
@@ -108,14 +203,68 @@ unsafe extern "C" fn get_default_config(selfp:*mut sys::oa_driver, out:*mut sys:
     } else { sys::OA_ERR_DEVICE }
 }
 
-unsafe extern "C" fn start(selfp:*mut sys::oa_driver, cfg:*const sys::oa_stream_config)->i32{
+// Builds both streams for `cfg` and leaves them paused (prepared); play_streams starts them.
+unsafe fn prepare_streams(selfp:*mut sys::oa_driver, cfg:*const sys::oa_stream_config)->i32{
     let s = &mut *(selfp as *mut Driver);
+    if (*cfg).format != sys::oa_sample_format::OA_SAMPLE_F32 { return sys::OA_ERR_UNSUPPORTED; }
     let out_dev = match &s.state.out_device{ Some(d)=>d.clone(), None=>return sys::OA_ERR_DEVICE };
     let in_dev = s.state.in_device.clone();
+    // Old streams must be gone before the buffers they use are replaced.
+    s.state.out_stream=None; s.state.in_stream=None;
 
     s.state.cfg = *cfg;
-    s.state.in_buf.resize(((*cfg).buffer_frames as usize) * ((*cfg).in_channels as usize).max(1), 0.0);
-    s.state.in_seq.store(0, std::sync::atomic::Ordering::Relaxed);
+    let rate = (*cfg).sample_rate;
+    let (in_ch, out_ch) = ((*cfg).in_channels as usize, (*cfg).out_channels as usize);
+    // Devices that do not take the stream's rate run at their own, converted here.
+    let Some(out_rate) = device_rate(&out_dev, true, (*cfg).out_channels, rate) else { return sys::OA_ERR_UNSUPPORTED; };
+    let in_rate = match &in_dev {
+        Some(id) if in_ch > 0 => match device_rate(id, false, (*cfg).in_channels, rate) { Some(r) => r, None => return sys::OA_ERR_UNSUPPORTED },
+        _ => rate,
+    };
+    // max_frames counts device frames; the host's blocks grow by the rate ratio.
+    let max_frames = ((*cfg).buffer_frames as usize).max(MAX_CALLBACK_FRAMES);
+    let host_frames = (max_frames * rate as usize).div_ceil(out_rate as usize) + 2;
+    s.state.out_conv = None;
+    if out_rate != rate {
+        match Resampler::new(out_ch, rate, out_rate, resample::MEDIUM, false) {
+            Ok(r) => {
+                s.state.out_conv_lat = (r.latency() as u64 * rate as u64).div_ceil(out_rate as u64) as u32;
+                s.state.out_conv = Some(r);
+            }
+            Err(e) => { eprintln!("openasio-cpal: {e}"); return sys::OA_ERR_UNSUPPORTED; }
+        }
+    }
+    let planar = matches!((*cfg).layout, sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+    let mut plan = Plan::new();
+    let out_stage = plan.buf::<f32>(if out_rate != rate { host_frames * out_ch } else { 0 });
+    let in_buf = plan.buf::<f32>(host_frames * in_ch.max(1));
+    let in_planar = plan.planes::<f32>(if planar { in_ch } else { 0 }, host_frames);
+    let out_planar = plan.planes::<f32>(if planar { out_ch } else { 0 }, host_frames);
+    let (in_planes, out_planes) = (plan.buf::<*mut f32>(in_ch), plan.buf::<*mut f32>(out_ch));
+    let st = &mut s.state;
+    let arena = match st.memory.map(plan, st.rt_flags) {
+        Ok(arena) => arena,
+        Err(e) => { eprintln!("openasio-cpal: {e}"); return sys::OA_ERR_BACKEND; }
+    };
+    st.out_stage = arena.get(out_stage);
+    st.in_buf = arena.get(in_buf);
+    st.in_planar = arena.get(in_planar);
+    st.out_planar = arena.get(out_planar);
+    st.in_planes = arena.get(in_planes);
+    st.out_planes = arena.get(out_planes);
+    layout_planes(&mut st.in_planar, &mut st.in_planes);
+    layout_planes(&mut st.out_planar, &mut st.out_planes);
+    st.max_frames = max_frames;
+    s.state.ring = ring::Ring::new(in_ch, RING_FRAMES.max(4 * max_frames));
+    s.state.drift = match ring::DriftReader::new(in_ch, in_rate, rate) {
+        Ok(d) => d,
+        Err(e) => { eprintln!("openasio-cpal: {e}"); return sys::OA_ERR_UNSUPPORTED; }
+    };
+    s.state.duplex = false;
+    s.state.clock = StreamClock::new((*cfg).sample_rate, (*cfg).buffer_frames);
+    s.state.stats.reset((*cfg).sample_rate, (*cfg).buffer_frames);
+    s.state.in_dev_lat.store(0, Ordering::Relaxed);
+    s.state.out_dev_lat.store(0, Ordering::Relaxed);
 
     // Build input stream if available
     if let (Some(id), in_ch) = (in_dev, (*cfg).in_channels) {
@@ -123,28 +272,29 @@ unsafe extern "C" fn start(selfp:*mut sys::oa_driver, cfg:*const sys::oa_stream_
             if let Ok(dc)=id.default_input_config(){
                 let mut sc: cpal::StreamConfig = dc.into();
                 sc.channels = in_ch;
-                sc.sample_rate = cpal::SampleRate((*cfg).sample_rate);
+                sc.sample_rate = cpal::SampleRate(in_rate);
                 sc.buffer_size = cpal::BufferSize::Default;
                 let state_ptr = DriverPtr(selfp as *mut Driver);
                 let istream = id.build_input_stream(&sc,
                     {
                         let state_ptr = state_ptr;
-                        move |data:&[f32], _| unsafe {
+                        move |data:&[f32], info: &cpal::InputCallbackInfo| unsafe {
                             state_ptr.with(|st| {
-                                // store latest
-                                let frames = data.len() / (st.state.cfg.in_channels as usize).max(1);
-                                let len = frames * (st.state.cfg.in_channels as usize).max(1);
-                                if st.state.in_buf.len() < len { st.state.in_buf.resize(len, 0.0); }
-                                st.state.in_buf[..len].copy_from_slice(&data[..len]);
-                                st.state.in_seq.fetch_add(1, std::sync::atomic::Ordering::Relaxed);
+                                let st = &st.state;
+                                let frames = data.len() / st.ring.channels();
+                                if st.ring.push(data) < frames { st.stats.xrun(Xrun::Overrun); }
+                                let ts = info.timestamp();
+                                let lat = to_frames(ts.callback.duration_since(&ts.capture), st.cfg.sample_rate);
+                                st.in_dev_lat.store(lat.unwrap_or(frames as u32), Ordering::Relaxed);
                             });
                         }
                     },
                     move |err| { eprintln!("openasio-cpal input error: {err}"); },
                     None
                 ).expect("build_input_stream");
-                istream.play().expect("input play");
+                let _ = istream.pause(); // some backends run a stream as soon as it is built
                 s.state.in_stream = Some(istream);
+                s.state.duplex = true;
             }
         }
     }
@@ -153,92 +303,87 @@ unsafe extern "C" fn start(selfp:*mut sys::oa_driver, cfg:*const sys::oa_stream_
     let mut out_cfg = out_dev.default_output_config().expect("default output config");
     let mut sc: cpal::StreamConfig = out_cfg.clone().into();
     sc.channels = (*cfg).out_channels;
-    sc.sample_rate = cpal::SampleRate((*cfg).sample_rate);
+    sc.sample_rate = cpal::SampleRate(out_rate);
     sc.buffer_size = cpal::BufferSize::Default;
     let state_ptr = DriverPtr(selfp as *mut Driver);
 
     let ostream = out_dev.build_output_stream(&sc,
         {
             let state_ptr = state_ptr;
-            move |data:&mut [f32], _| unsafe {
+            move |block:&mut [f32], info: &cpal::OutputCallbackInfo| unsafe {
                 state_ptr.with(|st| {
                     let out_ch = (st.state.cfg.out_channels as usize).max(1);
-                    let frames = (data.len() / out_ch) as u32;
+                    // A block larger than start() staged for is rendered piece by piece.
+                    for data in block.chunks_mut(st.state.max_frames * out_ch) {
+                        // Host frames: the device's count, or what the converter needs to fill it.
+                        let dev_frames = data.len() / out_ch;
+                        let frames = st.state.out_conv.as_ref().map_or(dev_frames, |c| c.input_for(dev_frames)) as u32;
+                        let ts = info.timestamp();
+                        let lat = to_frames(ts.playback.duration_since(&ts.callback), st.state.cfg.sample_rate);
+                        st.state.out_dev_lat.store(lat.unwrap_or(frames), Ordering::Relaxed);
 
-                    // Prepare input pointers based on layout
-                    let mut in_planes: Vec<*const f32> = Vec::new();
-                    let in_ptr: *const c_void = if matches!(st.state.cfg.layout, sys::oa_buffer_layout::OA_BUF_INTERLEAVED) {
-                        if st.state.cfg.in_channels > 0 {
+                        let planar = matches!(st.state.cfg.layout, sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+                        let in_ch = st.state.cfg.in_channels as usize;
+                        let frames_usize = frames as usize;
+
+                        if in_ch > 0 {
+                            let st = &mut st.state;
+                            if !st.duplex {
+                                st.in_buf[..frames_usize * in_ch].fill(0.0);
+                            } else if !st.drift.read(&st.ring, &mut st.in_buf, frames_usize) {
+                                st.stats.xrun(Xrun::Underrun);
+                            }
+                        }
+                        let in_ptr: *const c_void = if in_ch == 0 {
+                            std::ptr::null()
+                        } else if !planar {
                             st.state.in_buf.as_ptr() as *const c_void
                         } else {
-                            std::ptr::null()
-                        }
-                    } else if st.state.cfg.in_channels == 0 {
-                        std::ptr::null()
-                    } else {
-                        let ch = st.state.cfg.in_channels as usize;
-                        in_planes.resize(ch, std::ptr::null());
-                        for c in 0..ch {
-                            // deinterleave view: plane c points to first sample of that channel
-                            // We'll assume host reads strided by ch; for strict non-interleaved we'd keep true planes.
-                            in_planes[c] = unsafe { st.state.in_buf.as_ptr().add(c) };
-                        }
-                        in_planes.as_ptr() as *const c_void
-                    };
+                            let st = &mut st.state;
+                            sys::convert::oa_deinterleave_f32(st.in_planes.as_ptr(), st.in_buf.as_ptr(), in_ch as u32, frames_usize);
+                            st.in_planes.as_ptr() as *const c_void
+                        };
+                        let out_ptr: *mut c_void = if !planar {
+                            if st.state.out_conv.is_some() { st.state.out_stage.as_mut_ptr() as *mut c_void } else { data.as_mut_ptr() as *mut c_void }
+                        } else {
+                            st.state.out_planes.as_mut_ptr() as *mut c_void
+                        };
 
-                    if matches!(st.state.cfg.layout, sys::oa_buffer_layout::OA_BUF_INTERLEAVED) {
                         if let Some(cb) = st.state.host.process {
-                            let ti = sys::oa_time_info {
-                                host_time_ns: st.state.time0.elapsed().as_nanos() as u64,
-                                device_time_ns: 0,
-                                underruns: st.state.underruns.load(Ordering::Relaxed),
-                                overruns: st.state.overruns.load(Ordering::Relaxed),
+                            // Input frames were sampled in_lat ago; output ones play out_lat from now.
+                            let st_ = &mut st.state;
+                            let offset = if st_.duplex {
+                                (st_.in_dev_lat.load(Ordering::Relaxed) + st_.drift.fill_frames.load(Ordering::Relaxed)) as i64
+                            } else {
+                                -(st_.out_dev_lat.load(Ordering::Relaxed) as i64)
                             };
+                            let stamp = Stamp { host_ns: clock::monotonic_ns(), device_ns: 0, offset, hardware: false };
+                            let ti = st_.clock.time_info(Some(stamp), st_.stats.underruns(), st_.stats.overruns());
+                            st_.clock.advance(frames);
+                            let t0 = st.state.stats.begin();
                             let _keep = cb(
                                 st.state.host_user,
                                 in_ptr,
-                                data.as_mut_ptr() as *mut c_void,
+                                out_ptr,
                                 frames,
                                 &ti as *const _,
                                 &st.state.cfg as *const _,
                             );
+                            st.state.stats.end(t0);
                         }
-                    } else {
-                        // Non-interleaved: provide channel planes pointing into a staging area.
-                        // For simplicity, we reuse a scratch buffer then interleave after callback.
-                        static mut SCRATCH: Vec<f32> = Vec::new();
-                        let ch = st.state.cfg.out_channels as usize;
-                        let frames_usize = frames as usize;
-                        let needed = frames_usize * ch;
-                        unsafe {
-                            if SCRATCH.len() < needed {
-                                SCRATCH.resize(needed, 0.0);
-                            }
-                            let mut planes: Vec<*mut f32> = Vec::with_capacity(ch);
-                            for c in 0..ch {
-                                planes.push(SCRATCH.as_mut_ptr().add(c * frames_usize));
-                            }
-                            if let Some(cb) = st.state.host.process {
-                                let ti = sys::oa_time_info {
-                                    host_time_ns: st.state.time0.elapsed().as_nanos() as u64,
-                                    device_time_ns: 0,
-                                    underruns: st.state.underruns.load(Ordering::Relaxed),
-                                    overruns: st.state.overruns.load(Ordering::Relaxed),
-                                };
-                                let _keep = cb(
-                                    st.state.host_user,
-                                    in_ptr,
-                                    planes.as_mut_ptr() as *mut c_void,
-                                    frames,
-                                    &ti as *const _,
-                                    &st.state.cfg as *const _,
-                                );
-                            }
-                            for f in 0..frames_usize {
-                                for c in 0..ch {
-                                    data[f * ch + c] = *SCRATCH.as_ptr().add(c * frames_usize + f);
-                                }
-                            }
+                        let st = &mut st.state;
+                        if planar {
+                            let dst = if st.out_conv.is_some() { st.out_stage.as_mut_ptr() } else { data.as_mut_ptr() };
+                            sys::convert::oa_interleave_f32(
+                                dst,
+                                st.out_planes.as_ptr() as *const *const f32,
+                                st.out_planes.len() as u32,
+                                frames_usize,
+                            );
+                        }
+                        if let Some(conv) = st.out_conv.as_mut() {
+                            let (_, done) = conv.process(&st.out_stage[..frames_usize * out_ch], data);
+                            data[done * out_ch..].fill(0.0);
                         }
                     }
                 });
@@ -246,30 +391,176 @@ unsafe extern "C" fn start(selfp:*mut sys::oa_driver, cfg:*const sys::oa_stream_
         },
         move |err| { eprintln!("openasio-cpal output error: {err}"); }, None
     ).expect("build_output_stream");
-    ostream.play().expect("output play");
+    let _ = ostream.pause();
     s.state.out_stream = Some(ostream);
     sys::OA_OK
 }
 
+// Input first, so the ring has capture by the time output asks for it. cpal owns the device
+// buffers, so there is no silence to pre-fill here.
+unsafe fn play_streams(s:&mut Driver)->i32{
+    s.state.clock.resync(); // the callbacks are idle until play()
+    let played = s.state.in_stream.as_ref().map_or(Ok(()), |st| st.play())
+        .and_then(|_| s.state.out_stream.as_ref().map_or(Ok(()), |st| st.play()));
+    if played.is_err(){ return sys::OA_ERR_BACKEND; }
+    s.state.running.store(true, Ordering::Release);
+    sys::OA_OK
+}
+
+// Streams exist but are paused: prepared, or paused after running.
+fn parked(st:&DriverState)->bool{ st.out_stream.is_some() && !st.running.load(Ordering::Acquire) }
+
+unsafe extern "C" fn start(selfp:*mut sys::oa_driver, cfg:*const sys::oa_stream_config)->i32{
+    if cfg.is_null(){ return sys::OA_ERR_INVALID_ARG; }
+    let s = &mut *(selfp as *mut Driver);
+    if !(parked(&s.state) && s.state.cfg == *cfg) {
+        let rc = prepare_streams(selfp, cfg);
+        if rc != sys::OA_OK { return rc; }
+    }
+    let rc = play_streams(s);
+    if rc != sys::OA_OK { let _ = stop(selfp); }
+    rc
+}
+
+unsafe extern "C" fn prepare(selfp:*mut sys::oa_driver, cfg:*const sys::oa_stream_config)->i32{
+    if cfg.is_null(){ return sys::OA_ERR_INVALID_ARG; }
+    prepare_streams(selfp, cfg)
+}
+
+unsafe extern "C" fn pause(selfp:*mut sys::oa_driver)->i32{
+    let s = &mut *(selfp as *mut Driver);
+    if !s.state.running.load(Ordering::Acquire) { return sys::OA_ERR_STATE; }
+    let paused = s.state.out_stream.as_ref().map_or(Ok(()), |st| st.pause())
+        .and_then(|_| s.state.in_stream.as_ref().map_or(Ok(()), |st| st.pause()));
+    if paused.is_err(){ return sys::OA_ERR_UNSUPPORTED; } // backend cannot pause; still running
+    s.state.running.store(false, Ordering::Release);
+    sys::OA_OK
+}
+
+unsafe extern "C" fn resume(selfp:*mut sys::oa_driver)->i32{
+    let s = &mut *(selfp as *mut Driver);
+    if !parked(&s.state) { return sys::OA_ERR_STATE; }
+    play_streams(s)
+}
+
 unsafe extern "C" fn stop(selfp:*mut sys::oa_driver)->i32{
     let s = &mut *(selfp as *mut Driver);
     s.state.out_stream=None; s.state.in_stream=None;
+    s.state.running.store(false, Ordering::Release);
+    s.state.memory.release();
     sys::OA_OK
 }
 
-unsafe extern "C" fn get_latency(_:*mut sys::oa_driver, in_lat:*mut u32, out_lat:*mut u32)->i32{
-    if !in_lat.is_null(){ *in_lat = 0; } // CPAL doesn't expose stable latency here
-    if !out_lat.is_null(){ *out_lat = 0; }
+unsafe extern "C" fn set_host_scratch(selfp:*mut sys::oa_driver, bytes:usize)->i32{
+    let st = &mut (*(selfp as *mut Driver)).state;
+    if st.out_stream.is_some() { return sys::OA_ERR_STATE; }
+    st.memory.set_host_scratch(bytes)
+}
+
+// The staging buffers' arena and the host's scratch; cpal's own buffers are elsewhere.
+unsafe extern "C" fn get_stream_memory(selfp:*mut sys::oa_driver, out:*mut sys::oa_stream_memory)->i32{
+    (*(selfp as *mut Driver)).state.memory.write(out)
+}
+
+// Measured while running: device delay from the cpal timestamps, plus on the input side
+// the frames held in the duplex ring. OA_ERR_STATE while stopped.
+unsafe extern "C" fn get_latency(selfp:*mut sys::oa_driver, in_lat:*mut u32, out_lat:*mut u32)->i32{
+    let st = &(*(selfp as *mut Driver)).state;
+    if !st.running.load(Ordering::Acquire) { return sys::OA_ERR_STATE; }
+    let ring = if st.duplex { st.drift.fill_frames.load(Ordering::Relaxed) } else { 0 };
+    let conv = if st.out_conv.is_some() { st.out_conv_lat } else { 0 };
+    if !in_lat.is_null(){ *in_lat = st.in_dev_lat.load(Ordering::Relaxed) + ring; }
+    if !out_lat.is_null(){ *out_lat = st.out_dev_lat.load(Ordering::Relaxed) + conv; }
     sys::OA_OK
 }
-unsafe extern "C" fn set_sr(_: *mut sys::oa_driver, _:u32)->i32{ sys::OA_ERR_UNSUPPORTED }
-unsafe extern "C" fn set_buf(_: *mut sys::oa_driver, _:u32)->i32{ sys::OA_ERR_UNSUPPORTED }
+unsafe extern "C" fn get_supported_formats(_:*mut sys::oa_driver, native:*mut u32, supported:*mut u32)->i32{
+    // Streams are always built as f32.
+    let f32_bit = sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32);
+    if !native.is_null(){ *native = f32_bit; }
+    if !supported.is_null(){ *supported = f32_bit; }
+    sys::OA_OK
+}
+unsafe extern "C" fn get_stream_stats(selfp:*mut sys::oa_driver, out:*mut sys::oa_stream_stats)->i32{
+    (*(selfp as *mut Driver)).state.stats.write(out)
+}
+// Only the deadline is known: cpal chooses how its stream threads are scheduled.
+unsafe extern "C" fn get_thread_params(selfp:*mut sys::oa_driver, out:*mut sys::oa_thread_params)->i32{
+    let st = &(*(selfp as *mut Driver)).state;
+    if !st.running.load(Ordering::Acquire) { return sys::OA_ERR_STATE; }
+    openasio_rt::write_thread_params(&openasio_rt::thread_params(None, st.cfg.sample_rate, st.cfg.buffer_frames), out)
+}
+// cpal cannot retune a live stream, so a change while running rebuilds both streams. The host
+// hears the nominal latency before they come back; get_latency measures it again after that.
+// Prepared or paused streams are rebuilt paused.
+unsafe fn reconfigure(selfp:*mut sys::oa_driver, cfg: sys::oa_stream_config)->i32{
+    let s = &mut *(selfp as *mut Driver);
+    if s.state.out_stream.is_none() { s.state.cfg = cfg; return sys::OA_OK; }
+    if cfg.sample_rate == s.state.cfg.sample_rate && cfg.buffer_frames == s.state.cfg.buffer_frames { return sys::OA_OK; }
+    let running = s.state.running.load(Ordering::Acquire);
+    let _ = stop(selfp);
+    if let Some(cb) = s.state.host.latency_changed {
+        cb(s.state.host_user, if cfg.in_channels > 0 { cfg.buffer_frames } else { 0 }, cfg.buffer_frames);
+    }
+    if running { start(selfp, &cfg) } else { prepare_streams(selfp, &cfg) }
+}
+// One direction of `dev` from cpal's config ranges, over all sample formats as in
+// rate_supported. buffer_frames is nominal; cpal picks the callback size.
+fn range_space(dev: &cpal::Device, output: bool)->Option<sys::oa_config_space>{
+    let ranges: Vec<_> = if output { dev.supported_output_configs().ok()?.collect() } else { dev.supported_input_configs().ok()?.collect() };
+    let mut sp = space::empty();
+    let (mut lo, mut hi, mut channels, mut max_ch) = (u32::MAX, 0, 0u64, 0u32);
+    for r in &ranges {
+        lo = lo.min(r.min_sample_rate().0); hi = hi.max(r.max_sample_rate().0);
+        channels |= space::channel_bits(r.channels() as u32, r.channels() as u32); max_ch = max_ch.max(r.channels() as u32);
+    }
+    if ranges.iter().any(|r| r.min_sample_rate().0 == lo && r.max_sample_rate().0 == hi && lo < hi) {
+        sp.flags |= sys::OA_CONFIG_RATE_CONTINUOUS; sp.rate_min = lo; sp.rate_max = hi;
+    }
+    space::set_rates(&mut sp, space::COMMON_RATES.iter().copied().filter(|&rate| ranges.iter().any(|r| (r.min_sample_rate().0..=r.max_sample_rate().0).contains(&rate))));
+    sp.buffer_frames_min = 1; sp.buffer_frames_max = MAX_CALLBACK_FRAMES as u32; sp.buffer_frames_step = 1;
+    if output { (sp.out_channels, sp.out_channels_max) = (channels, max_ch); } else { (sp.in_channels, sp.in_channels_max) = (channels, max_ch); }
+    sp.native_formats = sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32); sp.supported_formats = sp.native_formats;
+    sp.layouts = sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_INTERLEAVED) | sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+    Some(sp)
+}
+unsafe extern "C" fn query_config_space(selfp:*mut sys::oa_driver, device:*const i8, out:*mut sys::oa_config_space)->i32{
+    if out.is_null(){ return sys::OA_ERR_INVALID_ARG; }
+    let st = &(*(selfp as *mut Driver)).state;
+    // Querying cpal's ranges does not touch a running stream.
+    let (od, id) = if device.is_null() && st.out_device.is_some() { (st.out_device.clone(), st.in_device.clone()) } else { find_devices(device) };
+    let Some(mut sp) = od.as_ref().and_then(|d| range_space(d, true)) else { return sys::OA_ERR_DEVICE; };
+    if let Some(cap) = id.as_ref().and_then(|d| range_space(d, false)) {
+        space::narrow(&mut sp, &cap); sp.in_channels = cap.in_channels; sp.in_channels_max = cap.in_channels_max;
+    }
+    sp.in_channels |= 1; // output only
+    space::write(&sp, out)
+}
+fn rate_supported(dev: &cpal::Device, output: bool, channels: u16, rate: u32)->bool{
+    let fits = |r: cpal::SupportedStreamConfigRange| r.channels() == channels && (r.min_sample_rate().0..=r.max_sample_rate().0).contains(&rate);
+    if output { dev.supported_output_configs().map_or(false, |mut it| it.any(fits)) }
+    else { dev.supported_input_configs().map_or(false, |mut it| it.any(fits)) }
+}
+unsafe extern "C" fn set_sr(selfp: *mut sys::oa_driver, sr:u32)->i32{
+    let st = &(*(selfp as *mut Driver)).state;
+    let cfg = sys::oa_stream_config{ sample_rate: sr, ..st.cfg };
+    // Refuse up front: building a stream at an unsupported rate would fail after the old one is gone.
+    let out_ok = st.out_device.as_ref().map_or(false, |d| device_rate(d, true, cfg.out_channels, sr).is_some());
+    let in_ok = cfg.in_channels == 0 || st.in_device.as_ref().map_or(true, |d| device_rate(d, false, cfg.in_channels, sr).is_some());
+    if sr == 0 || !out_ok || !in_ok { return sys::OA_ERR_UNSUPPORTED; }
+    reconfigure(selfp, cfg)
+}
+unsafe extern "C" fn set_buf(selfp: *mut sys::oa_driver, frames:u32)->i32{
+    if frames == 0 { return sys::OA_ERR_INVALID_ARG; }
+    let cfg = sys::oa_stream_config{ buffer_frames: frames, ..(*(selfp as *mut Driver)).state.cfg };
+    reconfigure(selfp, cfg)
+}
 
 #[no_mangle]
 pub unsafe extern "C" fn openasio_driver_create(params:*const sys::oa_create_params, out:*mut *mut sys::oa_driver)->i32{
     if params.is_null()||out.is_null(){ return sys::OA_ERR_INVALID_ARG; }
     let p=&*params;
-    let drv = Box::new(Driver{
+    let mut drv = Box::new(Driver{
+        base: sys::oa_driver{ vt: std::ptr::null() },
         vt: sys::oa_driver_vtable{
             struct_size: std::mem::size_of::<sys::oa_driver_vtable>() as u32,
             get_caps: Some(get_caps),
@@ -279,15 +570,32 @@ pub unsafe extern "C" fn openasio_driver_create(params:*const sys::oa_create_par
             get_default_config: Some(get_default_config),
             start: Some(start), stop: Some(stop),
             get_latency: Some(get_latency), set_sample_rate: Some(set_sr), set_buffer_frames: Some(set_buf),
+            mmap_enable: None, mmap_begin_period: None, mmap_commit_period: None,
+            get_supported_formats: Some(get_supported_formats),
+            get_rt_info: None, // stream threads belong to cpal
+            get_stream_stats: Some(get_stream_stats),
+            get_thread_params: Some(get_thread_params),
+            query_config_space: Some(query_config_space),
+            enumerate_devices: Some(enumerate_devices),
+            prepare: Some(prepare), pause: Some(pause), resume: Some(resume),
+            set_batch_periods: None, // cpal picks the callback size
+            set_host_scratch: Some(set_host_scratch),
+            get_stream_memory: Some(get_stream_memory),
         },
         state: DriverState{
-            host: *p.host, host_user: p.host_user,
+            host: openasio_rt::host_callbacks(p), host_user: p.host_user,
             out_device: None, in_device: None, out_stream: None, in_stream: None,
             cfg: sys::oa_stream_config{ sample_rate:48000, buffer_frames:256, in_channels:0, out_channels:2, format: sys::oa_sample_format::OA_SAMPLE_F32, layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED },
-            time0: Instant::now(), underruns: AtomicU32::new(0), overruns: AtomicU32::new(0),
-            in_buf: Vec::new(), in_seq: AtomicUsize::new(0),
+            clock: StreamClock::new(48000, 256), stats: StreamStats::default(),
+            ring: ring::Ring::new(1, 2), drift: ring::DriftReader::new(1, 48000, 48000).expect("unity-ratio converter"), duplex: false, in_buf: Buf::default(),
+            out_conv: None, out_stage: Buf::default(), out_conv_lat: 0,
+            in_dev_lat: AtomicU32::new(0), out_dev_lat: AtomicU32::new(0), running: AtomicBool::new(false),
+            in_planar: Buf::default(), in_planes: Buf::default(), out_planar: Buf::default(), out_planes: Buf::default(),
+            memory: Memory::default(), max_frames: MAX_CALLBACK_FRAMES, rt_flags: openasio_rt::requested(p).map_or(0, |rt| rt.flags),
+            hotplug: devices::Notify::from_host(&openasio_rt::host_callbacks(p), p.host_user), devices: None,
         },
     });
+    drv.base.vt = &drv.vt;
     *out = Box::into_raw(drv) as *mut sys::oa_driver; sys::OA_OK
 }
 #[no_mangle] pub unsafe extern "C" fn openasio_driver_destroy(driver:*mut sys::oa_driver){ if !driver.is_null(){ let _ = Box::from_raw(driver as *mut Driver); } }
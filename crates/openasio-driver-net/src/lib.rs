@@ -0,0 +1,1248 @@
+//! OpenASIO network driver: RTP/AES67 streams over UDP multicast (or unicast), paced by the
+//! PTP media clock.
+//!
+//! The device name is a `,`-separated option list (`open_device(NULL)` reads it from
+//! `OPENASIO_NET`, else `rx=239.69.0.1:5004,tx=239.69.0.2:5004`):
+//! - `rx=ADDR:PORT` receives the capture stream, `tx=ADDR:PORT` sends the playback stream;
+//!   a stream without the matching address has no channels that way. `iface=NAME` picks the
+//!   interface for multicast, `ttl=N` (default 8) and `dscp=N` (default 34, AF41) mark the
+//!   packets sent.
+//! - `ptime_us=N` (125 to 4000, default 1000) is the packet time, which must be whole frames
+//!   at the stream's rate; `encoding=L24|L16` (default L24) and `pt=N` (default 97) the
+//!   payload.
+//! - `jitter_us=N` fixes the receive buffer; `auto` (default) starts at two packets and grows
+//!   with the largest transit seen, up to `jitter_max_us=N` (default 20000). The depth is
+//!   part of the input latency.
+//! - `rx_offset=N` is the sender's RTP timestamp offset (SDP `a=mediaclk:direct=N`); without
+//!   it the driver anchors on the first packet, and again after 16 misplaced packets in a
+//!   row. Packets sent carry the media clock with offset 0.
+//! - `clock=tai|monotonic|/dev/ptpN` is the media clock (default `tai`, which a PTP daemon
+//!   keeps on the grandmaster); `txtime` launches each packet at its media time with
+//!   SO_TXTIME (needs the etf qdisc); `hwts` asks the NIC for receive timestamps (needs
+//!   `iface` and CAP_NET_ADMIN), falling back to software ones.
+//! - `rate=N`, `frames=N`, `channels=IN:OUT` set the default config (48000 Hz, 128 frames,
+//!   2 channels each way the device has).
+//!
+//! The driver thread wakes when the media clock reaches the end of each period, drains the
+//! receive socket with recvmmsg into the jitter buffer, runs `process`, and sends the
+//! period's complete packets with one sendmmsg. Every format and layout but U16 is
+//! supported, through float32; there is no mmap mode.
+#![allow(clippy::missing_safety_doc)]
+use media::{frame_at, ns_at, MediaClock, Reading};
+use openasio_rt::arena::{Buf, Memory, Plan};
+use openasio_rt::batch::{self, Batch};
+use openasio_rt::clock::{self, Stamp, StreamClock};
+use openasio_rt::devices::{self, Device};
+use openasio_rt::gate::Gate;
+use openasio_rt::space;
+use openasio_rt::stats::{StreamStats, Xrun};
+use openasio_sys::convert as cv;
+use openasio_sys as sys;
+use rtp::{Encoding, Jitter, Placed};
+use sock::{Arrival, Iface, Receiver, Sender};
+use std::ffi::CStr;
+use std::mem::size_of;
+use std::net::SocketAddrV4;
+use std::os::raw::c_void;
+use std::ptr;
+use std::sync::atomic::{AtomicU32, Ordering};
+
+mod media;
+mod rtp;
+mod sock;
+
+type Result<T> = std::result::Result<T, String>;
+
+const CAPS: u32 = sys::OA_CAP_OUTPUT
+    | sys::OA_CAP_INPUT
+    | sys::OA_CAP_FULL_DUPLEX
+    | sys::OA_CAP_SET_SAMPLERATE
+    | sys::OA_CAP_SET_BUFFRAMES
+    | sys::OA_CAP_TIME_INFO_EX
+    | sys::OA_CAP_BATCH;
+
+/// Options used when the host opens the default device.
+const SPEC_ENV: &str = "OPENASIO_NET";
+const DEFAULT_SPEC: &str = "rx=239.69.0.1:5004,tx=239.69.0.2:5004";
+
+/// The rates AES67 and its common profiles use.
+const RATES: &[u32] = &[44100, 48000, 88200, 96000, 192000];
+const MAX_FRAMES: u32 = 16384;
+const MAX_CHANNELS: u16 = 64;
+/// Misplaced packets in a row that make the receiver lock onto the stream again.
+const RELOCK_PACKETS: u32 = 16;
+
+/// Stream formats and their sample width in bits.
+const FORMATS: &[(sys::oa_sample_format, u16)] = &[
+    (sys::oa_sample_format::OA_SAMPLE_F32, 32),
+    (sys::oa_sample_format::OA_SAMPLE_I16, 16),
+    (sys::oa_sample_format::OA_SAMPLE_I24_3LE, 24),
+    (sys::oa_sample_format::OA_SAMPLE_I24_IN_32, 24),
+    (sys::oa_sample_format::OA_SAMPLE_I32, 32),
+];
+
+fn format_entry(f: sys::oa_sample_format) -> Option<&'static (sys::oa_sample_format, u16)> {
+    FORMATS.iter().find(|e| e.0 == f)
+}
+
+fn format_mask() -> u32 {
+    FORMATS.iter().fold(0, |m, e| m | sys::oa_format_bit(e.0))
+}
+
+/// A parsed device name.
+#[derive(Clone, Debug)]
+struct Options {
+    rx: Option<SocketAddrV4>,
+    tx: Option<SocketAddrV4>,
+    iface: Option<String>,
+    ttl: u32,
+    dscp: u32,
+    ptime_us: u32,
+    encoding: Encoding,
+    payload_type: u8,
+    /// None: adaptive.
+    jitter_us: Option<u32>,
+    jitter_max_us: u32,
+    rx_offset: Option<u32>,
+    clock: String,
+    txtime: bool,
+    hwts: bool,
+    rate: Option<u32>,
+    frames: Option<u32>,
+    channels: Option<(u16, u16)>,
+}
+
+impl Default for Options {
+    fn default() -> Self {
+        Options {
+            rx: None,
+            tx: None,
+            iface: None,
+            ttl: 8,
+            dscp: 34,
+            ptime_us: 1000,
+            encoding: Encoding::L24,
+            payload_type: 97,
+            jitter_us: None,
+            jitter_max_us: 20000,
+            rx_offset: None,
+            clock: "tai".into(),
+            txtime: false,
+            hwts: false,
+            rate: None,
+            frames: None,
+            channels: None,
+        }
+    }
+}
+
+impl Options {
+    /// Frames per packet at `rate`, if the packet time is whole frames.
+    fn packet_frames(&self, rate: u32) -> Option<u32> {
+        let scaled = rate as u64 * self.ptime_us as u64;
+        (scaled % 1_000_000 == 0).then_some((scaled / 1_000_000) as u32)
+    }
+
+    fn rates(&self) -> impl Iterator<Item = u32> + '_ {
+        RATES.iter().copied().filter(|&r| self.packet_frames(r).is_some())
+    }
+
+    /// Most channels whose packets fit in an Ethernet frame at `rate`.
+    fn max_channels(&self, rate: u32) -> u16 {
+        let row = self.packet_frames(rate).unwrap_or(1) as usize * self.encoding.bytes();
+        (((sock::MAX_PACKET - rtp::HEADER) / row) as u16).min(MAX_CHANNELS)
+    }
+}
+
+fn parse_options(spec: &str) -> Result<Options> {
+    fn value<T: std::str::FromStr>(key: &str, v: &str) -> Result<T> {
+        v.parse().map_err(|_| format!("bad value for {key}: {v}"))
+    }
+    let mut o = Options::default();
+    for item in spec.split(',').map(str::trim).filter(|i| !i.is_empty()) {
+        match item.split_once('=') {
+            None => match item {
+                "txtime" => o.txtime = true,
+                "hwts" => o.hwts = true,
+                _ => return Err(format!("unknown option {item}")),
+            },
+            Some((key, v)) => match key.trim() {
+                "rx" => o.rx = Some(value(key, v)?),
+                "tx" => o.tx = Some(value(key, v)?),
+                "iface" => o.iface = Some(v.to_string()),
+                "ttl" => o.ttl = value(key, v)?,
+                "dscp" => o.dscp = value(key, v)?,
+                "ptime_us" => o.ptime_us = value(key, v)?,
+                "encoding" => o.encoding = Encoding::parse(v).ok_or(format!("unknown encoding {v}"))?,
+                "pt" => o.payload_type = value(key, v)?,
+                "jitter_us" if v == "auto" => o.jitter_us = None,
+                "jitter_us" => o.jitter_us = Some(value(key, v)?),
+                "jitter_max_us" => o.jitter_max_us = value(key, v)?,
+                "rx_offset" => o.rx_offset = Some(value(key, v)?),
+                "clock" => o.clock = v.to_string(),
+                "rate" => o.rate = Some(value(key, v)?),
+                "frames" => o.frames = Some(value(key, v)?),
+                "channels" => {
+                    let pair = v.split_once(':').ok_or(format!("channels wants IN:OUT, not {v}"))?;
+                    o.channels = Some((value(key, pair.0)?, value(key, pair.1)?));
+                }
+                _ => return Err(format!("unknown option {key}")),
+            },
+        }
+    }
+    if !(125..=4000).contains(&o.ptime_us) {
+        return Err("ptime_us must be within 125..4000".into());
+    }
+    if o.payload_type > 127 || o.dscp > 63 || o.ttl > 255 {
+        return Err("pt, dscp or ttl out of range".into());
+    }
+    if o.rx.is_none() && o.tx.is_none() {
+        return Err("no rx or tx address".into());
+    }
+    if o.rates().next().is_none() {
+        return Err(format!("ptime_us={} is not whole frames at any rate", o.ptime_us));
+    }
+    Ok(o)
+}
+
+fn sleep_until(ns: u64) {
+    let ts = libc::timespec {
+        tv_sec: (ns / 1_000_000_000) as libc::time_t,
+        tv_nsec: (ns % 1_000_000_000) as libc::c_long,
+    };
+    unsafe {
+        while libc::clock_nanosleep(libc::CLOCK_MONOTONIC, libc::TIMER_ABSTIME, &ts, ptr::null_mut()) == libc::EINTR {}
+    }
+}
+
+/// Receive side of a stream.
+struct Rx {
+    sock: Receiver,
+    jitter: Jitter,
+    decoded: Buf<f32>,
+    /// Stream locked onto, and its RTP timestamp offset from the media clock.
+    ssrc: Option<u32>,
+    offset: Option<u32>,
+    fixed_offset: bool,
+    misplaced: u32,
+    /// Periods starting before this media frame may be missing frames without an overrun:
+    /// the stream was not locked yet, or the buffer just grew.
+    counted_from: u64,
+    /// Adaptive depth: the largest transit seen, frames after a packet's last one.
+    adaptive: bool,
+    max_transit: u64,
+    depth_max: u32,
+}
+
+/// Send side of a stream: the period's samples are cut into packets of `pkt` frames, the
+/// remainder carried over to the next period.
+struct Tx {
+    sock: Sender,
+    held: Buf<f32>,
+    held_frames: usize,
+    /// Media frame of `held`'s first frame.
+    ts: u64,
+    seq: u16,
+    ssrc: u32,
+}
+
+struct Net {
+    encoding: Encoding,
+    payload_type: u8,
+    pkt: u32,
+    rx: Option<Rx>,
+    tx: Option<Tx>,
+    /// Integer stage of the payload conversions.
+    ints: Buf<i32>,
+    /// Media frame at which the next wakeup is due: the end of its capture period.
+    due: u64,
+}
+
+struct DriverState {
+    host: sys::oa_host_callbacks,
+    host_user: *mut c_void,
+    /// Open device; None while closed.
+    opts: Option<Options>,
+    iface: Option<Iface>,
+    media: Option<MediaClock>,
+    cfg: sys::oa_stream_config,
+    clock: StreamClock,
+    stats: StreamStats,
+    sample_bytes: usize,
+    interleaved: bool,
+    /// Stream samples of one wakeup, one plane per channel if planar.
+    in_buf: Buf<f32>,
+    out_buf: Buf<f32>,
+    in_planes: Buf<*mut u8>,
+    out_planes: Buf<*mut u8>,
+    raw: Buf<u8>,   // the interleaved side of a planar transpose
+    stage: Buf<f32>, // a wakeup as interleaved float
+    /// The arena of the buffers above and of the payload buffers in `net`.
+    memory: Memory,
+    net: Option<Net>,
+    /// Receive buffer depth in frames; the driver thread grows it while get_latency reads it.
+    depth: AtomicU32,
+    batch_periods: u32,
+    batch: Batch,
+    rt_req: Option<sys::oa_rt_params>,
+    rt_info: Option<sys::oa_rt_info>,
+    gate: Gate,
+    worker: Option<std::thread::JoinHandle<()>>,
+}
+
+#[repr(C)]
+struct Driver {
+    /// Must stay first: hosts reach the vtable through `oa_driver::vt`.
+    base: sys::oa_driver,
+    vt: sys::oa_driver_vtable,
+    state: DriverState,
+}
+
+impl DriverState {
+    fn stop_worker(&mut self) {
+        self.gate.stop();
+        if let Some(handle) = self.worker.take() {
+            let _ = handle.join();
+        }
+        self.rt_info = None;
+    }
+
+    /// Stops streaming and closes the sockets.
+    fn end_stream(&mut self) {
+        self.stop_worker();
+        self.memory.release();
+        self.net = None;
+    }
+
+    fn parked(&self) -> bool {
+        self.worker.is_some() && self.gate.is_parked()
+    }
+
+    /// Frames moved per wakeup: a period, or a whole batch.
+    fn wake_frames(&self) -> u32 {
+        self.cfg.buffer_frames * self.batch.len().max(1) as u32
+    }
+
+    /// Capture waits out the receive buffer behind the period; playback leaves one wakeup
+    /// after it is processed.
+    fn latency(&self) -> (u32, u32) {
+        let input = if self.cfg.in_channels > 0 { self.depth.load(Ordering::Relaxed) + self.wake_frames() } else { 0 };
+        (input, self.wake_frames())
+    }
+
+    fn default_config(&self) -> Option<sys::oa_stream_config> {
+        let o = self.opts.as_ref()?;
+        let two = |addr: Option<SocketAddrV4>| if addr.is_some() { 2 } else { 0 };
+        let (in_ch, out_ch) = o.channels.unwrap_or((two(o.rx), two(o.tx)));
+        Some(sys::oa_stream_config {
+            sample_rate: o.rate.unwrap_or(if o.packet_frames(48000).is_some() { 48000 } else { o.rates().next()? }),
+            buffer_frames: o.frames.unwrap_or(128),
+            in_channels: in_ch,
+            out_channels: out_ch,
+            format: sys::oa_sample_format::OA_SAMPLE_F32,
+            layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+        })
+    }
+
+    /// A late wakeup: an xrun in every direction the stream has.
+    fn xrun(&mut self) {
+        if self.cfg.in_channels > 0 {
+            self.stats.xrun(Xrun::Overrun);
+        }
+        if self.cfg.out_channels > 0 {
+            self.stats.xrun(Xrun::Underrun);
+        }
+        self.clock.resync();
+    }
+
+    /// Sleeps until the media clock reaches the next wakeup. A wakeup more than one period
+    /// late is an xrun, and the timeline restarts at the current media time.
+    fn wait(&mut self) -> Reading {
+        let Some(media) = self.media.as_ref() else { return Reading::default() };
+        let rate = self.cfg.sample_rate;
+        let due = self.net.as_ref().map_or(0, |n| n.due);
+        let target = ns_at(due, rate);
+        let mut r = media.read();
+        while r.media < target {
+            sleep_until(r.mono_at(target));
+            r = media.read();
+        }
+        let now = frame_at(r.media, rate);
+        if now > due + self.wake_frames() as u64 {
+            self.xrun();
+            let depth = self.depth.load(Ordering::Relaxed) as u64;
+            let net = self.net.as_mut().unwrap();
+            net.due = now;
+            if let Some(rx) = net.rx.as_mut() {
+                rx.counted_from = now.saturating_sub(depth);
+            }
+        }
+        r
+    }
+
+    /// Drains the receive socket into the jitter buffer, for the period delivered at `due`.
+    /// Returns true if the adaptive depth grew.
+    fn receive(&mut self, r: &Reading) -> bool {
+        let rate = self.cfg.sample_rate;
+        let ich = self.cfg.in_channels as usize;
+        let frames = self.wake_frames() as u64;
+        let phc = self.media.as_ref().is_some_and(MediaClock::is_phc);
+        let Some(net) = self.net.as_mut() else { return false };
+        // With rx and tx on one group, the host hears its own stream too.
+        let own = net.tx.as_ref().map(|tx| tx.ssrc);
+        let Some(rx) = net.rx.as_mut() else { return false };
+        let row = ich * net.encoding.bytes();
+        let mut depth = self.depth.load(Ordering::Relaxed);
+        let grown = depth;
+        loop {
+            let count = rx.sock.recv();
+            if count == 0 {
+                break;
+            }
+            for i in 0..count {
+                let (data, arrival) = rx.sock.packet(i);
+                let Some((h, payload)) = rtp::parse(data) else { continue };
+                if h.payload_type != net.payload_type || Some(h.ssrc) == own || payload.is_empty() || payload.len() % row != 0 {
+                    continue;
+                }
+                let pf = payload.len() / row;
+                let arrived = match arrival {
+                    Some(Arrival::Hardware(t)) if phc => t,
+                    Some(Arrival::Hardware(t)) => r.from_tai(t),
+                    Some(Arrival::Software(t)) => r.from_realtime(t),
+                    None => r.media,
+                };
+                let arrived = frame_at(arrived, rate);
+                let placed = if *rx.ssrc.get_or_insert(h.ssrc) != h.ssrc {
+                    Placed::Early
+                } else {
+                    let offset = *rx.offset.get_or_insert_with(|| {
+                        // Lock on as if this packet had just been sent.
+                        let at = arrived.saturating_sub(pf as u64);
+                        rx.counted_from = at;
+                        h.timestamp.wrapping_sub(at as u32)
+                    });
+                    let playout = net.due.saturating_sub(depth as u64 + frames);
+                    // Media frame of the first sample, unwrapped around the playout point.
+                    let delta = h.timestamp.wrapping_sub(offset).wrapping_sub(playout as u32) as i32 as i64;
+                    let at = playout as i64 + delta;
+                    if at < 0 {
+                        Placed::Late
+                    } else {
+                        let at = at as u64;
+                        let transit = arrived.saturating_sub(at + pf as u64);
+                        if rx.adaptive && transit > rx.max_transit {
+                            rx.max_transit = transit;
+                            let needed = (transit + pf as u64).div_ceil(net.pkt as u64) * net.pkt as u64;
+                            depth = depth.max(needed.min(rx.depth_max as u64) as u32);
+                        }
+                        let samples = &mut rx.decoded[..pf * ich];
+                        rtp::decode(net.encoding, samples, payload, &mut net.ints);
+                        let playout = net.due.saturating_sub(depth as u64 + frames);
+                        rx.jitter.write(at, samples, playout)
+                    }
+                };
+                if placed == Placed::All {
+                    rx.misplaced = 0;
+                } else {
+                    rx.misplaced += 1;
+                    if rx.misplaced >= RELOCK_PACKETS {
+                        rx.misplaced = 0;
+                        rx.ssrc = None;
+                        if !rx.fixed_offset {
+                            rx.offset = None;
+                        }
+                        self.stats.xrun(Xrun::Overrun);
+                    }
+                }
+            }
+        }
+        if depth == grown {
+            return false;
+        }
+        // The periods the growth skips back over play as silence, not as an overrun.
+        rx.counted_from = net.due.saturating_sub(depth as u64);
+        self.depth.store(depth, Ordering::Relaxed);
+        self.clock.resync();
+        true
+    }
+
+    /// The buffered capture period into `in_buf`, in the stream's format and layout.
+    unsafe fn capture(&mut self) {
+        let frames = self.wake_frames() as usize;
+        let ich = self.cfg.in_channels as usize;
+        let depth = self.depth.load(Ordering::Relaxed) as u64;
+        let Some(rx) = self.net.as_mut().and_then(|n| {
+            let at = n.due.saturating_sub(depth + frames as u64);
+            n.rx.as_mut().map(|rx| (rx, at))
+        }) else {
+            return;
+        };
+        let (rx, at) = rx;
+        let missing = rx.jitter.read(at, &mut self.stage[..frames * ich]);
+        if missing > 0 && rx.ssrc.is_some() && at >= rx.counted_from {
+            self.stats.xrun(Xrun::Overrun);
+        }
+        let samples = frames * ich;
+        if self.interleaved {
+            cv::oa_convert_from_f32(self.cfg.format, self.in_buf.as_mut_ptr() as *mut c_void, self.stage.as_ptr(), samples, ptr::null_mut());
+        } else {
+            cv::oa_convert_from_f32(self.cfg.format, self.raw.as_mut_ptr() as *mut c_void, self.stage.as_ptr(), samples, ptr::null_mut());
+            cv::oa_deinterleave_bytes(
+                self.in_planes.as_ptr() as *const *mut c_void,
+                self.raw.as_ptr() as *const c_void,
+                ich as u32,
+                frames,
+                self.sample_bytes as u32,
+            );
+        }
+    }
+
+    /// The period the host produced, sent as the packets it completes. Drops when the socket
+    /// buffer is full count as an underrun.
+    unsafe fn transmit(&mut self, r: &Reading) {
+        let frames = self.wake_frames() as usize;
+        let och = self.cfg.out_channels as usize;
+        let rate = self.cfg.sample_rate;
+        let samples = frames * och;
+        let src = if self.interleaved {
+            self.out_buf.as_ptr() as *const c_void
+        } else {
+            cv::oa_interleave_bytes(
+                self.raw.as_mut_ptr() as *mut c_void,
+                self.out_planes.as_ptr() as *const *const c_void,
+                och as u32,
+                frames,
+                self.sample_bytes as u32,
+            );
+            self.raw.as_ptr() as *const c_void
+        };
+        cv::oa_convert_to_f32(self.stage.as_mut_ptr(), self.cfg.format, src, samples);
+        let Some(net) = self.net.as_mut() else { return };
+        let Some(tx) = net.tx.as_mut() else { return };
+        // The period plays one wakeup after it was processed.
+        let at = net.due + frames as u64;
+        if tx.held_frames > 0 && tx.ts + tx.held_frames as u64 != at {
+            tx.held_frames = 0;
+        }
+        if tx.held_frames == 0 {
+            tx.ts = at;
+        }
+        let pkt = net.pkt as usize;
+        let payload = pkt * och * net.encoding.bytes();
+        let (mut queued, mut dropped) = (0, 0);
+        let mut done = 0;
+        while done < frames {
+            let take = (pkt - tx.held_frames).min(frames - done);
+            tx.held[tx.held_frames * och..][..take * och].copy_from_slice(&self.stage[done * och..][..take * och]);
+            tx.held_frames += take;
+            done += take;
+            if tx.held_frames < pkt {
+                break;
+            }
+            if queued == tx.sock.capacity() {
+                dropped += queued - tx.sock.send(queued);
+                queued = 0;
+            }
+            let buf = tx.sock.packet_mut(queued);
+            rtp::write_header(buf, net.payload_type, tx.seq, tx.ts as u32, tx.ssrc);
+            rtp::encode(net.encoding, &mut buf[rtp::HEADER..][..payload], &tx.held, &mut net.ints);
+            tx.sock.prepare(queued, rtp::HEADER + payload, r.tai_at(ns_at(tx.ts, rate)));
+            tx.seq = tx.seq.wrapping_add(1);
+            tx.ts += pkt as u64;
+            tx.held_frames = 0;
+            queued += 1;
+        }
+        if queued > 0 {
+            dropped += queued - tx.sock.send(queued);
+        }
+        if dropped > 0 {
+            self.stats.xrun(Xrun::Underrun);
+        }
+    }
+}
+
+impl Drop for DriverState {
+    fn drop(&mut self) {
+        self.end_stream();
+    }
+}
+
+fn plane_ptrs(planes: &mut [*mut u8], buf: &mut Buf<f32>) {
+    for (c, p) in planes.iter_mut().enumerate() {
+        *p = buf.plane(c) as *mut u8;
+    }
+}
+
+fn frames_at(us: u32, rate: u32) -> u64 {
+    (us as u64 * rate as u64).div_ceil(1_000_000)
+}
+
+/// An SSRC that differs between streams and hosts.
+fn new_ssrc() -> u32 {
+    let x = clock::monotonic_ns() ^ ((std::process::id() as u64) << 32);
+    let x = x.wrapping_mul(0x9e37_79b9_7f4a_7c15);
+    (x >> 32) as u32
+}
+
+/// Checks `cfg`, opens the sockets and sizes the buffers for a new stream. The worker must
+/// be stopped.
+fn configure(s: &mut DriverState, cfg: &sys::oa_stream_config) -> i32 {
+    let Some(opts) = s.opts.clone() else {
+        return sys::OA_ERR_DEVICE;
+    };
+    if format_entry(cfg.format).is_none() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    let Some(pkt) = opts.packet_frames(cfg.sample_rate).filter(|_| RATES.contains(&cfg.sample_rate)) else {
+        return sys::OA_ERR_UNSUPPORTED;
+    };
+    let max_ch = opts.max_channels(cfg.sample_rate);
+    if !(1..=MAX_FRAMES).contains(&cfg.buffer_frames)
+        || cfg.in_channels > max_ch
+        || cfg.out_channels > max_ch
+        || cfg.in_channels + cfg.out_channels == 0
+        || (cfg.in_channels > 0 && opts.rx.is_none())
+        || (cfg.out_channels > 0 && opts.tx.is_none())
+    {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    s.net = None;
+
+    let periods = batch::effective(s.batch_periods, &s.host, false);
+    let frames = (cfg.buffer_frames * periods) as usize;
+    let (ich, och) = (cfg.in_channels as usize, cfg.out_channels as usize);
+    let rate = cfg.sample_rate;
+    let depth_max = (frames_at(opts.jitter_max_us, rate) / pkt as u64).max(1) as u32 * pkt;
+    let depth = match opts.jitter_us {
+        Some(us) => (frames_at(us, rate).div_ceil(pkt as u64).max(1) as u32 * pkt).min(depth_max),
+        None => (2 * pkt).min(depth_max),
+    };
+    let opened = (|| -> Result<(Option<Receiver>, Option<Sender>)> {
+        let iface = s.iface.as_ref();
+        let rx = match opts.rx {
+            Some(addr) if ich > 0 => Some(Receiver::open(addr, iface, opts.hwts)?),
+            _ => None,
+        };
+        let tx = match opts.tx {
+            Some(addr) if och > 0 => Some(Sender::open(addr, iface, opts.ttl, opts.dscp, opts.txtime, frames / pkt as usize + 1)?),
+            _ => None,
+        };
+        Ok((rx, tx))
+    })();
+    let (rx, tx) = match opened {
+        Ok(socks) => socks,
+        Err(e) => {
+            eprintln!("openasio-net: {e}");
+            return sys::OA_ERR_DEVICE;
+        }
+    };
+    if rx.as_ref().is_some_and(|r| opts.hwts && !r.hardware) {
+        eprintln!("openasio-net: no hardware receive timestamps, using software ones");
+    }
+    if tx.as_ref().is_some_and(|t| opts.txtime && !t.txtime) {
+        eprintln!("openasio-net: SO_TXTIME refused, sending without launch times");
+    }
+    // The largest packet a sender may use, in frames of this stream's capture.
+    let rx_pkt_max = if ich > 0 { (sock::MAX_PACKET - rtp::HEADER) / (ich * opts.encoding.bytes()) } else { 0 };
+    let bytes = sys::oa_sample_bytes(cfg.format) as usize;
+    let plane_words = (frames * bytes).div_ceil(4);
+    let mut plan = Plan::new();
+    let in_buf = plan.planes::<f32>(ich, plane_words);
+    let out_buf = plan.planes::<f32>(och, plane_words);
+    let (in_planes, out_planes) = (plan.buf::<*mut u8>(ich), plan.buf::<*mut u8>(och));
+    let raw = plan.buf::<u8>(frames * ich.max(och) * bytes);
+    let stage = plan.buf::<f32>(frames * ich.max(och));
+    let decoded = plan.buf::<f32>(if rx.is_some() { rx_pkt_max * ich } else { 0 });
+    let held = plan.buf::<f32>(if tx.is_some() { pkt as usize * och } else { 0 });
+    let ints = plan.buf::<i32>((rx_pkt_max * ich).max(pkt as usize * och));
+    let arena = match s.memory.map(plan, s.rt_req.map_or(0, |r| r.flags)) {
+        Ok(arena) => arena,
+        Err(e) => {
+            eprintln!("openasio-net: {e}");
+            return sys::OA_ERR_BACKEND;
+        }
+    };
+    let rx = rx.map(|sock| Rx {
+        sock,
+        jitter: Jitter::new(ich, depth_max as usize + 2 * frames + rx_pkt_max),
+        decoded: arena.get(decoded),
+        ssrc: None,
+        offset: opts.rx_offset,
+        fixed_offset: opts.rx_offset.is_some(),
+        misplaced: 0,
+        counted_from: 0,
+        adaptive: opts.jitter_us.is_none(),
+        max_transit: 0,
+        depth_max,
+    });
+    let tx = tx.map(|sock| Tx { sock, held: arena.get(held), held_frames: 0, ts: 0, seq: 0, ssrc: new_ssrc() });
+
+    let ints = arena.get(ints);
+    s.in_buf = arena.get(in_buf);
+    s.out_buf = arena.get(out_buf);
+    s.in_planes = arena.get(in_planes);
+    s.out_planes = arena.get(out_planes);
+    s.raw = arena.get(raw);
+    s.stage = arena.get(stage);
+    plane_ptrs(&mut s.in_planes, &mut s.in_buf);
+    plane_ptrs(&mut s.out_planes, &mut s.out_buf);
+    s.sample_bytes = bytes;
+    s.interleaved = cfg.layout == sys::oa_buffer_layout::OA_BUF_INTERLEAVED;
+    s.net = Some(Net {
+        encoding: opts.encoding,
+        payload_type: opts.payload_type,
+        pkt,
+        rx,
+        tx,
+        ints,
+        due: 0,
+    });
+    s.depth.store(if ich > 0 { depth } else { 0 }, Ordering::Relaxed);
+    s.batch = if periods > 1 {
+        let input = (s.in_buf.as_mut_ptr() as *mut u8, ich, s.in_buf.stride() * 4);
+        let output = (s.out_buf.as_mut_ptr() as *mut u8, och, s.out_buf.stride() * 4);
+        Batch::new(periods as usize, cfg.buffer_frames, bytes, !s.interleaved, input, output)
+    } else {
+        Batch::default()
+    };
+    s.cfg = *cfg;
+    s.clock = StreamClock::new(rate, frames as u32);
+    s.stats.reset(rate, frames as u32);
+    sys::OA_OK
+}
+
+unsafe fn driver_thread(selfp: *mut Driver) {
+    loop {
+        let d = &mut *selfp;
+        if !d.state.gate.proceed() {
+            break;
+        }
+        let s = &mut d.state;
+        let frames = s.wake_frames() as usize;
+        let r = s.wait();
+        let grew = s.receive(&r);
+        if grew {
+            if let Some(cb) = s.host.latency_changed {
+                let (input, output) = s.latency();
+                cb(s.host_user, input, output);
+            }
+        }
+        s.capture();
+        // When the media clock reached the end of the capture period (or the start of the
+        // playback one), on CLOCK_MONOTONIC and as PTP time.
+        let due = s.net.as_ref().map_or(0, |n| n.due);
+        let due_ns = ns_at(due, s.cfg.sample_rate);
+        let depth = s.depth.load(Ordering::Relaxed) as i64;
+        let offset = if s.cfg.in_channels > 0 { depth + frames as i64 } else { -(frames as i64) };
+        let stamp = Some(Stamp { host_ns: r.mono_at(due_ns), device_ns: due_ns, offset, hardware: true });
+
+        let mut keep = sys::OA_TRUE;
+        if !s.batch.is_empty() {
+            s.batch.stamp(&mut s.clock, stamp, s.stats.underruns(), s.stats.overruns());
+            if let Some(cb) = s.host.process_batch {
+                let t0 = s.stats.begin();
+                keep = cb(s.host_user, s.batch.as_ptr(), s.batch.len() as u32, &s.cfg);
+                s.stats.end(t0);
+            }
+        } else {
+            let ti = s.clock.time_info(stamp, s.stats.underruns(), s.stats.overruns());
+            s.clock.advance(frames as u32);
+            let (in_ptr, out_ptr): (*const c_void, *mut c_void) = if s.interleaved {
+                (s.in_buf.as_ptr() as *const c_void, s.out_buf.as_mut_ptr() as *mut c_void)
+            } else {
+                (s.in_planes.as_ptr() as *const c_void, s.out_planes.as_mut_ptr() as *mut c_void)
+            };
+            if let Some(cb) = s.host.process {
+                let t0 = s.stats.begin();
+                keep = cb(
+                    s.host_user,
+                    if s.cfg.in_channels == 0 { ptr::null() } else { in_ptr },
+                    out_ptr,
+                    frames as u32,
+                    &ti as *const _,
+                    &s.cfg as *const _,
+                );
+                s.stats.end(t0);
+            }
+        }
+        s.transmit(&r);
+        if let Some(net) = s.net.as_mut() {
+            net.due += frames as u64;
+        }
+        if keep == sys::OA_FALSE {
+            s.gate.stop();
+        }
+    }
+}
+
+// Starts the driver thread, parked until go().
+unsafe fn spawn_worker(selfp: *mut Driver) -> i32 {
+    let d = &mut *selfp;
+    d.state.gate.park();
+    let driver_ptr = selfp as usize;
+    let rt_req = d.state.rt_req;
+    let (rt_tx, rt_rx) = std::sync::mpsc::sync_channel(1);
+    let spawned = std::thread::Builder::new()
+        .name("openasio-net".into())
+        .spawn(move || unsafe {
+            let _ = rt_tx.send(openasio_rt::apply(rt_req.as_ref()));
+            driver_thread(driver_ptr as *mut Driver);
+        });
+    match spawned {
+        Ok(handle) => d.state.worker = Some(handle),
+        Err(_) => {
+            d.state.gate.stop();
+            return sys::OA_ERR_BACKEND;
+        }
+    }
+    d.state.rt_info = rt_rx.recv().ok();
+    sys::OA_OK
+}
+
+/// Lets the parked thread run, one wakeup from the current media time. Packets held from
+/// before a pause are dropped, as their timestamps have passed.
+unsafe fn go(selfp: *mut Driver) -> i32 {
+    let s = &mut (*selfp).state;
+    let (Some(media), Some(net)) = (s.media.as_ref(), s.net.as_mut()) else {
+        return sys::OA_ERR_STATE;
+    };
+    let frames = s.cfg.buffer_frames as u64 * s.batch.len().max(1) as u64;
+    net.due = frame_at(media.read().media, s.cfg.sample_rate) + frames;
+    if let Some(rx) = net.rx.as_mut() {
+        rx.jitter.clear();
+        rx.counted_from = net.due;
+    }
+    if let Some(tx) = net.tx.as_mut() {
+        tx.held_frames = 0;
+    }
+    s.clock.resync();
+    s.gate.run();
+    sys::OA_OK
+}
+
+unsafe fn prepare_stream(selfp: *mut Driver, cfg: &sys::oa_stream_config) -> i32 {
+    let d = &mut *selfp;
+    d.state.end_stream();
+    let rc = configure(&mut d.state, cfg);
+    if rc != sys::OA_OK {
+        return rc;
+    }
+    let rc = spawn_worker(selfp);
+    if rc != sys::OA_OK {
+        d.state.end_stream();
+    }
+    rc
+}
+
+unsafe extern "C" fn get_caps(_: *mut sys::oa_driver) -> u32 {
+    CAPS
+}
+
+/// The device `open_device(NULL)` opens.
+fn default_spec() -> String {
+    std::env::var(SPEC_ENV).unwrap_or_else(|_| DEFAULT_SPEC.into())
+}
+
+unsafe extern "C" fn query_devices(_selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
+    let list = format!("{}\n", default_spec());
+    let bytes = list.as_bytes();
+    let n = bytes.len().min(len.saturating_sub(1));
+    if n > 0 {
+        ptr::copy_nonoverlapping(bytes.as_ptr(), buf as *mut u8, n);
+    }
+    if len > 0 {
+        *buf.add(n) = 0;
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn enumerate_devices(
+    _selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_device_info,
+    capacity: u32,
+    count: *mut u32,
+) -> i32 {
+    let name = default_spec();
+    let (in_channels, out_channels) = match parse_options(&name) {
+        Ok(o) => (if o.rx.is_some() { 2 } else { 0 }, if o.tx.is_some() { 2 } else { 0 }),
+        Err(_) => (0, 0),
+    };
+    let dev = Device { name, description: "RTP/AES67 network streams".into(), in_channels, out_channels, default: true };
+    devices::write(std::iter::once((1, &dev)), out, capacity, count)
+}
+
+unsafe extern "C" fn open_device(selfp: *mut sys::oa_driver, name: *const i8) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    d.state.opts = None;
+    d.state.iface = None;
+    d.state.media = None;
+    let named = (!name.is_null()).then(|| CStr::from_ptr(name).to_string_lossy().to_string());
+    let spec = match named.filter(|n| !n.is_empty()) {
+        Some(n) => n,
+        None => default_spec(),
+    };
+    // The interface and the clock are looked up here, so a typo fails now rather than at start().
+    let opened = parse_options(&spec).and_then(|o| {
+        let iface = o.iface.as_deref().map(Iface::lookup).transpose()?;
+        let media = MediaClock::open(&o.clock)?;
+        Ok((o, iface, media))
+    });
+    match opened {
+        Ok((opts, iface, media)) => {
+            d.state.opts = Some(opts);
+            d.state.iface = iface;
+            d.state.media = Some(media);
+            sys::OA_OK
+        }
+        Err(e) => {
+            eprintln!("openasio-net: {e}");
+            sys::OA_ERR_DEVICE
+        }
+    }
+}
+
+unsafe extern "C" fn close_device(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    d.state.opts = None;
+    d.state.iface = None;
+    d.state.media = None;
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_default_config(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_config,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let d = &*(selfp as *mut Driver);
+    match d.state.default_config() {
+        Some(cfg) => {
+            *out = cfg;
+            sys::OA_OK
+        }
+        None => sys::OA_ERR_DEVICE,
+    }
+}
+
+unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let selfp = selfp as *mut Driver;
+    let d = &mut *selfp;
+    if !(d.state.parked() && d.state.cfg == *cfg) {
+        let rc = prepare_stream(selfp, &*cfg);
+        if rc != sys::OA_OK {
+            return rc;
+        }
+    }
+    go(selfp)
+}
+
+unsafe extern "C" fn prepare(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    prepare_stream(selfp as *mut Driver, &*cfg)
+}
+
+/// Parks the thread; nothing is sent, and packets received meanwhile are stale on resume.
+unsafe extern "C" fn pause(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    if !d.state.gate.pause() {
+        return sys::OA_ERR_STATE;
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn resume(selfp: *mut sys::oa_driver) -> i32 {
+    let selfp = selfp as *mut Driver;
+    if !(*selfp).state.parked() {
+        return sys::OA_ERR_STATE;
+    }
+    go(selfp)
+}
+
+unsafe extern "C" fn stop(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_latency(
+    selfp: *mut sys::oa_driver,
+    in_lat: *mut u32,
+    out_lat: *mut u32,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    let (input, output) = d.state.latency();
+    if !in_lat.is_null() {
+        *in_lat = input;
+    }
+    if !out_lat.is_null() {
+        *out_lat = output;
+    }
+    sys::OA_OK
+}
+
+/// A running, prepared or paused stream is restarted on `cfg` with new sockets; the host
+/// hears the new latency before the thread resumes, and a parked stream stays parked.
+unsafe fn reconfigure(selfp: *mut Driver, cfg: sys::oa_stream_config) -> i32 {
+    let d = &mut *selfp;
+    let running = d.state.gate.is_running();
+    if !(d.state.worker.is_some() && (running || d.state.gate.is_parked())) {
+        // Takes effect with the next start(), whose config the host passes along.
+        d.state.cfg = cfg;
+        return sys::OA_OK;
+    }
+    let old = d.state.cfg;
+    if cfg.sample_rate == old.sample_rate && cfg.buffer_frames == old.buffer_frames {
+        return sys::OA_OK;
+    }
+    let mut rc = prepare_stream(selfp, &cfg);
+    if rc == sys::OA_OK {
+        if let Some(cb) = d.state.host.latency_changed {
+            let (input, output) = d.state.latency();
+            cb(d.state.host_user, input, output);
+        }
+    } else if prepare_stream(selfp, &old) != sys::OA_OK {
+        return rc;
+    }
+    if running {
+        let started = go(selfp);
+        if rc == sys::OA_OK {
+            rc = started;
+        }
+    }
+    rc
+}
+
+unsafe extern "C" fn set_sr(selfp: *mut sys::oa_driver, sr: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if !RATES.contains(&sr) {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    let cfg = sys::oa_stream_config {
+        sample_rate: sr,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn set_buf(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if frames == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if frames > MAX_FRAMES {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    let cfg = sys::oa_stream_config {
+        buffer_frames: frames,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn set_batch_periods(selfp: *mut sys::oa_driver, periods: u32) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    if !batch::valid(periods) {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if periods > 1 && d.state.host.process_batch.is_none() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    if d.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    d.state.batch_periods = periods;
+    sys::OA_OK
+}
+
+unsafe extern "C" fn set_host_scratch(selfp: *mut sys::oa_driver, bytes: usize) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    if d.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    d.state.memory.set_host_scratch(bytes)
+}
+
+unsafe extern "C" fn get_stream_memory(selfp: *mut sys::oa_driver, out: *mut sys::oa_stream_memory) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    d.state.memory.write(out)
+}
+
+/// Every format is converted to and from the wire's L16/L24, so none is native.
+unsafe extern "C" fn get_supported_formats(
+    _: *mut sys::oa_driver,
+    native: *mut u32,
+    supported: *mut u32,
+) -> i32 {
+    if !native.is_null() {
+        *native = 0;
+    }
+    if !supported.is_null() {
+        *supported = format_mask();
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_rt_info(selfp: *mut sys::oa_driver, out: *mut sys::oa_rt_info) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    match &d.state.rt_info {
+        Some(info) => openasio_rt::write_info(info, out),
+        None => sys::OA_ERR_STATE,
+    }
+}
+
+unsafe extern "C" fn get_stream_stats(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_stats,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    d.state.stats.write(out)
+}
+
+unsafe extern "C" fn get_thread_params(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_thread_params,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    let Some(info) = &d.state.rt_info else {
+        return sys::OA_ERR_STATE;
+    };
+    let params = openasio_rt::thread_params(Some(info), d.state.cfg.sample_rate, d.state.wake_frames());
+    openasio_rt::write_thread_params(&params, out)
+}
+
+/// The rates at which the packet time is whole frames; channels up to what fits in a packet
+/// at the default rate, each way the device has an address.
+unsafe extern "C" fn query_config_space(
+    _selfp: *mut sys::oa_driver,
+    device: *const i8,
+    out: *mut sys::oa_config_space,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let spec = if device.is_null() {
+        default_spec()
+    } else {
+        CStr::from_ptr(device).to_string_lossy().to_string()
+    };
+    let Ok(o) = parse_options(&spec) else {
+        return sys::OA_ERR_DEVICE;
+    };
+    let rate = o.rate.filter(|&r| o.packet_frames(r).is_some()).unwrap_or_else(|| o.rates().next().unwrap_or(48000));
+    let ch = o.max_channels(rate) as u32;
+    let (in_max, out_max) = (if o.rx.is_some() { ch } else { 0 }, if o.tx.is_some() { ch } else { 0 });
+    let mut sp = space::empty();
+    space::set_rates(&mut sp, o.rates());
+    sp.buffer_frames_min = 1;
+    sp.buffer_frames_max = MAX_FRAMES;
+    sp.buffer_frames_step = 1;
+    sp.in_channels = space::channel_bits(0, in_max);
+    sp.out_channels = space::channel_bits(0, out_max);
+    sp.in_channels_max = in_max;
+    sp.out_channels_max = out_max;
+    sp.native_formats = 0;
+    sp.supported_formats = format_mask();
+    sp.layouts = sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_INTERLEAVED)
+        | sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+    space::write(&sp, out)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_create(
+    params: *const sys::oa_create_params,
+    out: *mut *mut sys::oa_driver,
+) -> i32 {
+    if params.is_null() || out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let p = &*params;
+    if p.host.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let cfg = sys::oa_stream_config {
+        sample_rate: 48000,
+        buffer_frames: 128,
+        in_channels: 2,
+        out_channels: 2,
+        format: sys::oa_sample_format::OA_SAMPLE_F32,
+        layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+    };
+    let mut drv = Box::new(Driver {
+        base: sys::oa_driver { vt: ptr::null() },
+        vt: sys::oa_driver_vtable {
+            struct_size: size_of::<sys::oa_driver_vtable>() as u32,
+            get_caps: Some(get_caps),
+            query_devices: Some(query_devices),
+            open_device: Some(open_device),
+            close_device: Some(close_device),
+            get_default_config: Some(get_default_config),
+            start: Some(start),
+            stop: Some(stop),
+            get_latency: Some(get_latency),
+            set_sample_rate: Some(set_sr),
+            set_buffer_frames: Some(set_buf),
+            mmap_enable: None,
+            mmap_begin_period: None,
+            mmap_commit_period: None,
+            get_supported_formats: Some(get_supported_formats),
+            get_rt_info: Some(get_rt_info),
+            get_stream_stats: Some(get_stream_stats),
+            get_thread_params: Some(get_thread_params),
+            query_config_space: Some(query_config_space),
+            enumerate_devices: Some(enumerate_devices),
+            prepare: Some(prepare),
+            pause: Some(pause),
+            resume: Some(resume),
+            set_batch_periods: Some(set_batch_periods),
+            set_host_scratch: Some(set_host_scratch),
+            get_stream_memory: Some(get_stream_memory),
+        },
+        state: DriverState {
+            host: openasio_rt::host_callbacks(p),
+            host_user: p.host_user,
+            opts: None,
+            iface: None,
+            media: None,
+            cfg,
+            clock: StreamClock::new(48000, 128),
+            stats: StreamStats::default(),
+            sample_bytes: 4,
+            interleaved: true,
+            in_buf: Buf::default(),
+            out_buf: Buf::default(),
+            in_planes: Buf::default(),
+            out_planes: Buf::default(),
+            raw: Buf::default(),
+            stage: Buf::default(),
+            memory: Memory::default(),
+            net: None,
+            depth: AtomicU32::new(0),
+            batch_periods: 1,
+            batch: Batch::default(),
+            rt_req: openasio_rt::requested(p),
+            rt_info: None,
+            gate: Gate::new(),
+            worker: None,
+        },
+    });
+    drv.base.vt = &drv.vt;
+    *out = Box::into_raw(drv) as *mut sys::oa_driver;
+    sys::OA_OK
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_destroy(driver: *mut sys::oa_driver) {
+    if !driver.is_null() {
+        let _ = Box::from_raw(driver as *mut Driver);
+    }
+}
@@ -0,0 +1,105 @@
+//! The media clock of AES67: PTP time counted in sample periods since the epoch. A PTP
+//! daemon (ptp4l, with phc2sys for the system clock) disciplines the NIC's hardware clock and
+//! CLOCK_TAI; the driver only reads them. Streams sleep on CLOCK_MONOTONIC, so each wakeup
+//! samples the clocks side by side and converts between them.
+use std::ffi::CString;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+
+type Result<T> = std::result::Result<T, String>;
+
+pub struct MediaClock {
+    id: libc::clockid_t,
+    /// The PTP hardware clock device, open while its dynamic clock id is in use.
+    phc: Option<OwnedFd>,
+}
+
+/// The clocks read at one instant.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct Reading {
+    pub mono: u64,
+    pub media: u64,
+    pub realtime: u64,
+    pub tai: u64,
+}
+
+fn now(id: libc::clockid_t) -> u64 {
+    let mut ts = libc::timespec { tv_sec: 0, tv_nsec: 0 };
+    unsafe { libc::clock_gettime(id, &mut ts) };
+    openasio_rt::clock::timespec_ns(&ts)
+}
+
+impl MediaClock {
+    /// `tai` (the PTP-disciplined system clock), `monotonic` (free-running, for a network
+    /// without PTP), or a PHC device such as `/dev/ptp0`.
+    pub fn open(spec: &str) -> Result<MediaClock> {
+        match spec {
+            "tai" => Ok(MediaClock { id: libc::CLOCK_TAI, phc: None }),
+            "monotonic" => Ok(MediaClock { id: libc::CLOCK_MONOTONIC, phc: None }),
+            path if path.starts_with('/') => {
+                let c = CString::new(path).map_err(|_| format!("bad clock {path}"))?;
+                let fd = unsafe { libc::open(c.as_ptr(), libc::O_RDONLY | libc::O_CLOEXEC) };
+                if fd < 0 {
+                    return Err(format!("{path}: {}", std::io::Error::last_os_error()));
+                }
+                let fd = unsafe { OwnedFd::from_raw_fd(fd) };
+                // FD_TO_CLOCKID from the kernel's posix-timers: CLOCKFD with the fd inverted.
+                let id = ((!fd.as_raw_fd()) << 3) | 3;
+                let mut ts = libc::timespec { tv_sec: 0, tv_nsec: 0 };
+                if unsafe { libc::clock_gettime(id, &mut ts) } != 0 {
+                    return Err(format!("{path} is not a clock"));
+                }
+                Ok(MediaClock { id, phc: Some(fd) })
+            }
+            _ => Err(format!("unknown clock {spec}")),
+        }
+    }
+
+    /// True for a PHC, whose time hardware receive timestamps are already in.
+    pub fn is_phc(&self) -> bool {
+        self.phc.is_some()
+    }
+
+    /// Monotonic time is the midpoint of two reads around the media clock's.
+    pub fn read(&self) -> Reading {
+        let before = now(libc::CLOCK_MONOTONIC);
+        let media = now(self.id);
+        let after = now(libc::CLOCK_MONOTONIC);
+        Reading {
+            mono: before + (after - before) / 2,
+            media,
+            realtime: now(libc::CLOCK_REALTIME),
+            tai: now(libc::CLOCK_TAI),
+        }
+    }
+}
+
+impl Reading {
+    /// CLOCK_MONOTONIC time at which the media clock shows `media_ns`.
+    pub fn mono_at(&self, media_ns: u64) -> u64 {
+        (self.mono as i128 + media_ns as i128 - self.media as i128).max(0) as u64
+    }
+
+    /// CLOCK_TAI time at which the media clock shows `media_ns`, for SO_TXTIME.
+    pub fn tai_at(&self, media_ns: u64) -> u64 {
+        (self.tai as i128 + media_ns as i128 - self.media as i128).max(0) as u64
+    }
+
+    /// Media time of a software receive timestamp (CLOCK_REALTIME).
+    pub fn from_realtime(&self, ns: u64) -> u64 {
+        (self.media as i128 + ns as i128 - self.realtime as i128).max(0) as u64
+    }
+
+    /// Media time of a hardware receive timestamp, which a PTP daemon keeps on TAI.
+    pub fn from_tai(&self, ns: u64) -> u64 {
+        (self.media as i128 + ns as i128 - self.tai as i128).max(0) as u64
+    }
+}
+
+/// Media frame at `ns`, and the first nanosecond of a frame: `frame_at(ns_at(f)) == f`.
+pub fn frame_at(ns: u64, rate: u32) -> u64 {
+    (ns as u128 * rate as u128 / 1_000_000_000) as u64
+}
+
+pub fn ns_at(frame: u64, rate: u32) -> u64 {
+    (frame as u128 * 1_000_000_000).div_ceil(rate as u128) as u64
+}
@@ -0,0 +1,261 @@
+//! RTP framing (RFC 3550) of AES67 streams, 16 or 24-bit big-endian linear PCM (RFC 3551
+//! L16, RFC 3190 L24), and the jitter buffer that places received packets on the media clock.
+use openasio_sys::convert as cv;
+
+pub const HEADER: usize = 12;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Encoding {
+    L16,
+    L24,
+}
+
+impl Encoding {
+    pub fn parse(s: &str) -> Option<Encoding> {
+        match s {
+            "L16" | "l16" => Some(Encoding::L16),
+            "L24" | "l24" => Some(Encoding::L24),
+            _ => None,
+        }
+    }
+
+    pub fn bytes(self) -> usize {
+        match self {
+            Encoding::L16 => 2,
+            Encoding::L24 => 3,
+        }
+    }
+}
+
+/// The fields of a received header this driver looks at.
+#[derive(Clone, Copy, Debug)]
+pub struct Header {
+    pub payload_type: u8,
+    pub timestamp: u32,
+    pub ssrc: u32,
+}
+
+pub fn write_header(buf: &mut [u8], payload_type: u8, seq: u16, timestamp: u32, ssrc: u32) {
+    buf[0] = 0x80; // version 2, no padding, extension or CSRCs
+    buf[1] = payload_type & 0x7f;
+    buf[2..4].copy_from_slice(&seq.to_be_bytes());
+    buf[4..8].copy_from_slice(&timestamp.to_be_bytes());
+    buf[8..12].copy_from_slice(&ssrc.to_be_bytes());
+}
+
+/// Header and payload of a version 2 packet, past any CSRCs, extension and padding.
+pub fn parse(packet: &[u8]) -> Option<(Header, &[u8])> {
+    if packet.len() < HEADER || packet[0] >> 6 != 2 {
+        return None;
+    }
+    let mut start = HEADER + 4 * (packet[0] & 0x0f) as usize;
+    if packet[0] & 0x10 != 0 {
+        let ext = packet.get(start + 2..start + 4)?;
+        start += 4 + 4 * u16::from_be_bytes([ext[0], ext[1]]) as usize;
+    }
+    let mut end = packet.len();
+    if packet[0] & 0x20 != 0 {
+        end = end.checked_sub(*packet.last()? as usize)?;
+    }
+    let payload = packet.get(start..end)?;
+    let header = Header {
+        payload_type: packet[1] & 0x7f,
+        timestamp: u32::from_be_bytes([packet[4], packet[5], packet[6], packet[7]]),
+        ssrc: u32::from_be_bytes([packet[8], packet[9], packet[10], packet[11]]),
+    };
+    Some((header, payload))
+}
+
+/// float32 samples to network order, through the SDK's rounding and clamping kernels.
+pub fn encode(enc: Encoding, dst: &mut [u8], src: &[f32], scratch: &mut [i32]) {
+    let n = src.len();
+    let ints = &mut scratch[..n];
+    unsafe {
+        match enc {
+            Encoding::L16 => cv::oa_f32_to_i16(ints.as_mut_ptr() as *mut i16, src.as_ptr(), n),
+            Encoding::L24 => cv::oa_f32_to_i24_in_32(ints.as_mut_ptr(), src.as_ptr(), n),
+        }
+    }
+    match enc {
+        Encoding::L16 => {
+            let words = unsafe { std::slice::from_raw_parts(ints.as_ptr() as *const i16, n) };
+            for (d, v) in dst.chunks_exact_mut(2).zip(words) {
+                d.copy_from_slice(&v.to_be_bytes());
+            }
+        }
+        Encoding::L24 => {
+            for (d, v) in dst.chunks_exact_mut(3).zip(ints.iter()) {
+                d.copy_from_slice(&v.to_be_bytes()[1..]);
+            }
+        }
+    }
+}
+
+/// Network order to float32; `dst.len()` samples.
+pub fn decode(enc: Encoding, dst: &mut [f32], src: &[u8], scratch: &mut [i32]) {
+    let n = dst.len();
+    let ints = &mut scratch[..n];
+    match enc {
+        Encoding::L16 => {
+            let words = unsafe { std::slice::from_raw_parts_mut(ints.as_mut_ptr() as *mut i16, n) };
+            for (w, s) in words.iter_mut().zip(src.chunks_exact(2)) {
+                *w = i16::from_be_bytes([s[0], s[1]]);
+            }
+            unsafe { cv::oa_i16_to_f32(dst.as_mut_ptr(), words.as_ptr(), n) };
+        }
+        Encoding::L24 => {
+            for (w, s) in ints.iter_mut().zip(src.chunks_exact(3)) {
+                *w = i32::from_be_bytes([s[0], s[1], s[2], 0]) >> 8;
+            }
+            unsafe { cv::oa_i24_in_32_to_f32(dst.as_mut_ptr(), ints.as_ptr(), n) };
+        }
+    }
+}
+
+/// Which part of a packet the jitter buffer kept.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Placed {
+    All,
+    /// Some or all frames were already played out.
+    Late,
+    /// Too far ahead of the playout point for the buffer.
+    Early,
+}
+
+/// Received frames by media-clock position. Each slot remembers which frame it holds, so a
+/// lost packet plays as silence rather than as whatever the slot held a lap earlier.
+pub struct Jitter {
+    samples: Vec<f32>,
+    stamps: Vec<u64>, // media frame + 1, 0 = empty
+    mask: u64,
+    channels: usize,
+}
+
+impl Jitter {
+    /// At least `min_frames` frames (rounded up to a power of two) of `channels`.
+    pub fn new(channels: usize, min_frames: usize) -> Jitter {
+        let cap = min_frames.max(2).next_power_of_two();
+        Jitter { samples: vec![0.0; cap * channels], stamps: vec![0; cap], mask: cap as u64 - 1, channels }
+    }
+
+    pub fn capacity(&self) -> u64 {
+        self.mask + 1
+    }
+
+    /// Stores interleaved `src` as the frames from media frame `at` on; `playout` is the
+    /// next frame to be read.
+    pub fn write(&mut self, at: u64, src: &[f32], playout: u64) -> Placed {
+        let ch = self.channels;
+        let frames = (src.len() / ch) as u64;
+        if at + frames > playout + self.capacity() {
+            return Placed::Early;
+        }
+        let skip = playout.saturating_sub(at).min(frames);
+        for f in skip..frames {
+            let pos = at + f;
+            let slot = (pos & self.mask) as usize;
+            self.samples[slot * ch..][..ch].copy_from_slice(&src[f as usize * ch..][..ch]);
+            self.stamps[slot] = pos + 1;
+        }
+        if skip > 0 { Placed::Late } else { Placed::All }
+    }
+
+    /// Moves the frames from media frame `at` on into `dst`, silence where none arrived.
+    /// Returns the number of missing frames.
+    pub fn read(&mut self, at: u64, dst: &mut [f32]) -> usize {
+        let ch = self.channels;
+        let mut missing = 0;
+        for (f, out) in dst.chunks_exact_mut(ch).enumerate() {
+            let pos = at + f as u64;
+            let slot = (pos & self.mask) as usize;
+            if self.stamps[slot] == pos + 1 {
+                out.copy_from_slice(&self.samples[slot * ch..][..ch]);
+                self.stamps[slot] = 0;
+            } else {
+                out.fill(0.0);
+                missing += 1;
+            }
+        }
+        missing
+    }
+
+    pub fn clear(&mut self) {
+        self.stamps.fill(0);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn headers_round_trip_past_csrcs_extension_and_padding() {
+        let mut packet = vec![0u8; HEADER];
+        write_header(&mut packet, 0xe1, 7, 0x1234_5678, 0xdead_beef);
+        packet.extend_from_slice(&[1, 2, 3]);
+        let (h, payload) = parse(&packet).unwrap();
+        assert_eq!((h.payload_type, h.timestamp, h.ssrc, payload), (0x61, 0x1234_5678, 0xdead_beef, &[1, 2, 3][..]));
+
+        // Two CSRCs, a one-word extension and three bytes of padding around the payload.
+        packet[0] |= 0x02 | 0x10 | 0x20;
+        let mut framed = packet[..HEADER].to_vec();
+        framed.extend_from_slice(&[0; 8]);
+        framed.extend_from_slice(&[0xbe, 0xde, 0, 1, 9, 9, 9, 9]);
+        framed.extend_from_slice(&[1, 2, 3, 0, 0, 3]);
+        assert_eq!(parse(&framed).unwrap().1, [1, 2, 3]);
+
+        assert!(parse(&packet[..HEADER - 1]).is_none(), "short");
+        assert!(parse(&framed[..HEADER + 10]).is_none(), "extension past the end");
+        let mut v1 = framed.clone();
+        v1[0] = (v1[0] & 0x3f) | 0x40;
+        assert!(parse(&v1).is_none(), "version 1");
+        let mut padded = framed.clone();
+        *padded.last_mut().unwrap() = 200;
+        assert!(parse(&padded).is_none(), "padding longer than the packet");
+    }
+
+    #[test]
+    fn l16_and_l24_are_big_endian_and_round_trip() {
+        let src = [0.0, 0.5, -1.0, 1.0, -0.25];
+        let (mut scratch, mut back) = ([0i32; 5], [0f32; 5]);
+        let mut wire = [0u8; 5 * 3];
+        encode(Encoding::L16, &mut wire[..10], &src, &mut scratch);
+        assert_eq!(wire[..10], [0, 0, 0x40, 0, 0x80, 0, 0x7f, 0xff, 0xe0, 0]);
+        decode(Encoding::L16, &mut back, &wire[..10], &mut scratch);
+        assert!(back.iter().zip(&src).all(|(b, s)| (b - s).abs() <= 1.0 / 32768.0));
+
+        encode(Encoding::L24, &mut wire, &src, &mut scratch);
+        assert_eq!(wire[3..9], [0x40, 0, 0, 0x80, 0, 0]);
+        assert_eq!(wire[9..12], [0x7f, 0xff, 0xff]);
+        decode(Encoding::L24, &mut back, &wire, &mut scratch);
+        assert!(back.iter().zip(&src).all(|(b, s)| (b - s).abs() <= 1.0 / 8388608.0));
+        assert_eq!((Encoding::parse("l24"), Encoding::parse("L32")), (Some(Encoding::L24), None));
+    }
+
+    #[test]
+    fn the_jitter_buffer_places_packets_on_the_media_clock() {
+        let mut j = Jitter::new(2, 6);
+        assert_eq!(j.capacity(), 8);
+        let frames = |first: u32, n: u32| -> Vec<f32> { (first..first + n).flat_map(|f| [f as f32, -(f as f32)]).collect() };
+
+        // Out of order is fine; one partly played out is kept from the playout point on.
+        assert_eq!(j.write(104, &frames(104, 2), 100), Placed::All);
+        assert_eq!(j.write(100, &frames(100, 2), 100), Placed::All);
+        assert_eq!(j.write(106, &frames(106, 4), 100), Placed::Early);
+        let mut out = vec![9.0; 12];
+        assert_eq!(j.read(100, &mut out), 2, "frames 102 and 103 never came");
+        assert_eq!(out, [100.0, -100.0, 101.0, -101.0, 0.0, 0.0, 0.0, 0.0, 104.0, -104.0, 105.0, -105.0]);
+
+        assert_eq!(j.write(104, &frames(104, 4), 106), Placed::Late);
+        let mut out = vec![9.0; 4];
+        assert_eq!(j.read(106, &mut out), 0);
+        assert_eq!(out, [106.0, -106.0, 107.0, -107.0]);
+        // A slot read once, or a lap old, plays as silence.
+        assert_eq!(j.read(106, &mut out), 2);
+        assert_eq!(j.write(108, &frames(108, 1), 108), Placed::All);
+        assert_eq!(j.read(116, &mut out[..2]), 1);
+        j.write(117, &frames(117, 1), 117);
+        j.clear();
+        assert_eq!(j.read(117, &mut out[..2]), 1);
+    }
+}
@@ -0,0 +1,286 @@
+//! UDP sockets of a stream: multicast membership, batched I/O through recvmmsg/sendmmsg,
+//! receive timestamps (software, or the NIC's with `hwts`) and SO_TXTIME launch times.
+//! Both sockets are non-blocking; the driver thread polls them once per wakeup.
+use std::ffi::CString;
+use std::mem::{size_of, zeroed};
+use std::net::{Ipv4Addr, SocketAddrV4};
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+use std::ptr;
+
+type Result<T> = std::result::Result<T, String>;
+
+/// Largest payload plus RTP header in a 1500-byte Ethernet frame (IPv4 and UDP headers out).
+pub const MAX_PACKET: usize = 1500 - 20 - 8;
+/// Datagrams per recvmmsg call.
+pub const RX_BATCH: usize = 64;
+/// Room for one scm_timestamping control message.
+const RX_CTRL: usize = 64;
+
+fn errno() -> String {
+    std::io::Error::last_os_error().to_string()
+}
+
+/// A local interface: multicast traffic goes out of and is joined on it.
+#[derive(Clone, Debug)]
+pub struct Iface {
+    pub name: String,
+    pub index: u32,
+}
+
+impl Iface {
+    pub fn lookup(name: &str) -> Result<Iface> {
+        let c = CString::new(name).map_err(|_| format!("bad interface name {name}"))?;
+        let index = unsafe { libc::if_nametoindex(c.as_ptr()) };
+        if index == 0 {
+            return Err(format!("no interface {name}"));
+        }
+        Ok(Iface { name: name.to_string(), index })
+    }
+}
+
+fn sockaddr(a: SocketAddrV4) -> libc::sockaddr_in {
+    let mut sa: libc::sockaddr_in = unsafe { zeroed() };
+    sa.sin_family = libc::AF_INET as libc::sa_family_t;
+    sa.sin_port = a.port().to_be();
+    sa.sin_addr.s_addr = u32::from(*a.ip()).to_be();
+    sa
+}
+
+fn set_opt<T>(fd: &OwnedFd, level: i32, name: i32, value: &T) -> Result<()> {
+    let rc = unsafe {
+        libc::setsockopt(fd.as_raw_fd(), level, name, value as *const T as *const libc::c_void, size_of::<T>() as libc::socklen_t)
+    };
+    if rc == 0 { Ok(()) } else { Err(errno()) }
+}
+
+fn udp_socket() -> Result<OwnedFd> {
+    let fd = unsafe { libc::socket(libc::AF_INET, libc::SOCK_DGRAM | libc::SOCK_NONBLOCK | libc::SOCK_CLOEXEC, 0) };
+    if fd < 0 {
+        return Err(format!("socket: {}", errno()));
+    }
+    Ok(unsafe { OwnedFd::from_raw_fd(fd) })
+}
+
+fn mreqn(group: Ipv4Addr, iface: Option<&Iface>) -> libc::ip_mreqn {
+    libc::ip_mreqn {
+        imr_multiaddr: libc::in_addr { s_addr: u32::from(group).to_be() },
+        imr_address: libc::in_addr { s_addr: 0 },
+        imr_ifindex: iface.map_or(0, |i| i.index as i32),
+    }
+}
+
+/// Turns on hardware receive timestamps for every packet on `iface` (needs CAP_NET_ADMIN).
+fn enable_hw_stamps(fd: &OwnedFd, iface: &Iface) -> Result<()> {
+    let mut cfg = libc::hwtstamp_config { flags: 0, tx_type: libc::HWTSTAMP_TX_OFF as i32, rx_filter: libc::HWTSTAMP_FILTER_ALL as i32 };
+    let mut req: libc::ifreq = unsafe { zeroed() };
+    for (d, s) in req.ifr_name.iter_mut().zip(iface.name.bytes().take(libc::IFNAMSIZ - 1)) {
+        *d = s as libc::c_char;
+    }
+    req.ifr_ifru.ifru_data = &mut cfg as *mut _ as *mut libc::c_char;
+    if unsafe { libc::ioctl(fd.as_raw_fd(), libc::SIOCSHWTSTAMP, &mut req) } != 0 {
+        return Err(errno());
+    }
+    Ok(())
+}
+
+/// When a datagram arrived: on CLOCK_REALTIME (software), or on the NIC's clock, which a
+/// PTP daemon keeps on TAI.
+#[derive(Clone, Copy, Debug)]
+pub enum Arrival {
+    Software(u64),
+    Hardware(u64),
+}
+
+pub struct Receiver {
+    fd: OwnedFd,
+    bufs: Vec<u8>,
+    ctrl: Vec<u8>,
+    iov: Vec<libc::iovec>,
+    msgs: Vec<libc::mmsghdr>,
+    /// The NIC timestamps packets; software stamps otherwise.
+    pub hardware: bool,
+}
+
+// SAFETY: the raw pointers point into the receiver's own heap buffers.
+unsafe impl Send for Receiver {}
+
+impl Receiver {
+    /// Binds `addr`'s port and, for a multicast address, joins the group on `iface` (the
+    /// routing table's choice without one).
+    pub fn open(addr: SocketAddrV4, iface: Option<&Iface>, hw: bool) -> Result<Receiver> {
+        let fd = udp_socket()?;
+        let one: libc::c_int = 1;
+        set_opt(&fd, libc::SOL_SOCKET, libc::SO_REUSEADDR, &one)?;
+        // A few hundred milliseconds of packets, so a late wakeup loses nothing.
+        let rcvbuf: libc::c_int = 1 << 20;
+        let _ = set_opt(&fd, libc::SOL_SOCKET, libc::SO_RCVBUF, &rcvbuf);
+        let bind_to = if addr.ip().is_multicast() { addr } else { SocketAddrV4::new(Ipv4Addr::UNSPECIFIED, addr.port()) };
+        let sa = sockaddr(bind_to);
+        if unsafe { libc::bind(fd.as_raw_fd(), &sa as *const _ as *const libc::sockaddr, size_of::<libc::sockaddr_in>() as u32) } != 0 {
+            return Err(format!("bind {bind_to}: {}", errno()));
+        }
+        if addr.ip().is_multicast() {
+            set_opt(&fd, libc::IPPROTO_IP, libc::IP_ADD_MEMBERSHIP, &mreqn(*addr.ip(), iface)).map_err(|e| format!("join {}: {e}", addr.ip()))?;
+        }
+        let soft = libc::SOF_TIMESTAMPING_RX_SOFTWARE | libc::SOF_TIMESTAMPING_SOFTWARE;
+        let hard = libc::SOF_TIMESTAMPING_RX_HARDWARE | libc::SOF_TIMESTAMPING_RAW_HARDWARE;
+        let hardware = hw && iface.is_some_and(|i| enable_hw_stamps(&fd, i).is_ok());
+        let flags: libc::c_uint = if hardware { soft | hard } else { soft };
+        set_opt(&fd, libc::SOL_SOCKET, libc::SO_TIMESTAMPING, &flags)?;
+
+        let mut r = Receiver {
+            fd,
+            bufs: vec![0; RX_BATCH * MAX_PACKET],
+            ctrl: vec![0; RX_BATCH * RX_CTRL],
+            iov: Vec::with_capacity(RX_BATCH),
+            msgs: Vec::with_capacity(RX_BATCH),
+            hardware,
+        };
+        for i in 0..RX_BATCH {
+            r.iov.push(libc::iovec { iov_base: r.bufs[i * MAX_PACKET..].as_mut_ptr() as *mut libc::c_void, iov_len: MAX_PACKET });
+        }
+        for i in 0..RX_BATCH {
+            let mut m: libc::mmsghdr = unsafe { zeroed() };
+            m.msg_hdr.msg_iov = &mut r.iov[i];
+            m.msg_hdr.msg_iovlen = 1;
+            m.msg_hdr.msg_control = r.ctrl[i * RX_CTRL..].as_mut_ptr() as *mut libc::c_void;
+            r.msgs.push(m);
+        }
+        Ok(r)
+    }
+
+    /// Takes up to `RX_BATCH` queued datagrams in one call; 0 when none are left.
+    pub fn recv(&mut self) -> usize {
+        for m in &mut self.msgs {
+            m.msg_hdr.msg_controllen = RX_CTRL as _;
+            m.msg_hdr.msg_flags = 0;
+        }
+        let n = unsafe { libc::recvmmsg(self.fd.as_raw_fd(), self.msgs.as_mut_ptr(), RX_BATCH as u32, libc::MSG_DONTWAIT, ptr::null_mut()) };
+        n.max(0) as usize
+    }
+
+    /// Datagram `i` of the last `recv`, with its timestamp if the kernel attached one.
+    pub fn packet(&self, i: usize) -> (&[u8], Option<Arrival>) {
+        let m = &self.msgs[i];
+        let data = &self.bufs[i * MAX_PACKET..][..(m.msg_len as usize).min(MAX_PACKET)];
+        let mut arrival = None;
+        unsafe {
+            let mut c = libc::CMSG_FIRSTHDR(&m.msg_hdr);
+            while !c.is_null() {
+                if (*c).cmsg_level == libc::SOL_SOCKET && (*c).cmsg_type == libc::SCM_TIMESTAMPING {
+                    // struct scm_timestamping: software, (deprecated), raw hardware.
+                    let ts = std::slice::from_raw_parts(libc::CMSG_DATA(c) as *const libc::timespec, 3);
+                    let ns = |t: &libc::timespec| t.tv_sec as u64 * 1_000_000_000 + t.tv_nsec as u64;
+                    arrival = if self.hardware && ns(&ts[2]) != 0 {
+                        Some(Arrival::Hardware(ns(&ts[2])))
+                    } else if ns(&ts[0]) != 0 {
+                        Some(Arrival::Software(ns(&ts[0])))
+                    } else {
+                        None
+                    };
+                }
+                c = libc::CMSG_NXTHDR(&m.msg_hdr, c);
+            }
+        }
+        (data, arrival)
+    }
+}
+
+pub struct Sender {
+    fd: OwnedFd,
+    // Unconnected, so an ICMP error from a missing receiver cannot fail a later send.
+    dest: Box<libc::sockaddr_in>,
+    bufs: Vec<u8>,
+    ctrl: Vec<u8>,
+    iov: Vec<libc::iovec>,
+    msgs: Vec<libc::mmsghdr>,
+    /// Packets carry an SO_TXTIME launch time on CLOCK_TAI.
+    pub txtime: bool,
+}
+
+// SAFETY: as for Receiver.
+unsafe impl Send for Sender {}
+
+const TX_CTRL: usize = 32; // CMSG_SPACE(sizeof(u64)), rounded up
+
+impl Sender {
+    /// Sends to `dest` from `iface` with `ttl` and DSCP `dscp`, at most `capacity` packets
+    /// per batch. A refused SO_TXTIME leaves `txtime` false rather than failing.
+    pub fn open(dest: SocketAddrV4, iface: Option<&Iface>, ttl: u32, dscp: u32, txtime: bool, capacity: usize) -> Result<Sender> {
+        let fd = udp_socket()?;
+        let tos: libc::c_int = (dscp << 2) as libc::c_int;
+        let _ = set_opt(&fd, libc::IPPROTO_IP, libc::IP_TOS, &tos);
+        if dest.ip().is_multicast() {
+            set_opt(&fd, libc::IPPROTO_IP, libc::IP_MULTICAST_IF, &mreqn(Ipv4Addr::UNSPECIFIED, iface)).map_err(|e| format!("multicast interface: {e}"))?;
+            let ttl = ttl as libc::c_int;
+            set_opt(&fd, libc::IPPROTO_IP, libc::IP_MULTICAST_TTL, &ttl)?;
+            // Also heard on this host, by a receiver on the same group.
+            let one: libc::c_int = 1;
+            set_opt(&fd, libc::IPPROTO_IP, libc::IP_MULTICAST_LOOP, &one)?;
+        }
+        let txtime = txtime && set_opt(&fd, libc::SOL_SOCKET, libc::SO_TXTIME, &libc::sock_txtime { clockid: libc::CLOCK_TAI, flags: 0 }).is_ok();
+
+        let mut s = Sender {
+            fd,
+            dest: Box::new(sockaddr(dest)),
+            bufs: vec![0; capacity * MAX_PACKET],
+            ctrl: vec![0; capacity * TX_CTRL],
+            iov: Vec::with_capacity(capacity),
+            msgs: Vec::with_capacity(capacity),
+            txtime,
+        };
+        for i in 0..capacity {
+            s.iov.push(libc::iovec { iov_base: s.bufs[i * MAX_PACKET..].as_mut_ptr() as *mut libc::c_void, iov_len: 0 });
+        }
+        for i in 0..capacity {
+            let mut m: libc::mmsghdr = unsafe { zeroed() };
+            m.msg_hdr.msg_name = &mut *s.dest as *mut _ as *mut libc::c_void;
+            m.msg_hdr.msg_namelen = size_of::<libc::sockaddr_in>() as u32;
+            m.msg_hdr.msg_iov = &mut s.iov[i];
+            m.msg_hdr.msg_iovlen = 1;
+            if txtime {
+                m.msg_hdr.msg_control = s.ctrl[i * TX_CTRL..].as_mut_ptr() as *mut libc::c_void;
+                m.msg_hdr.msg_controllen = unsafe { libc::CMSG_SPACE(size_of::<u64>() as u32) } as _;
+            }
+            s.msgs.push(m);
+        }
+        Ok(s)
+    }
+
+    pub fn capacity(&self) -> usize {
+        self.msgs.len()
+    }
+
+    /// Buffer of packet `i` of the next batch.
+    pub fn packet_mut(&mut self, i: usize) -> &mut [u8] {
+        &mut self.bufs[i * MAX_PACKET..][..MAX_PACKET]
+    }
+
+    /// Sets packet `i`'s length and, with `txtime`, when it leaves (CLOCK_TAI ns).
+    pub fn prepare(&mut self, i: usize, len: usize, launch_tai_ns: u64) {
+        self.iov[i].iov_len = len;
+        if self.txtime {
+            unsafe {
+                let c = libc::CMSG_FIRSTHDR(&self.msgs[i].msg_hdr);
+                (*c).cmsg_level = libc::SOL_SOCKET;
+                (*c).cmsg_type = libc::SCM_TXTIME;
+                (*c).cmsg_len = libc::CMSG_LEN(size_of::<u64>() as u32) as _;
+                ptr::write_unaligned(libc::CMSG_DATA(c) as *mut u64, launch_tai_ns);
+            }
+        }
+    }
+
+    /// Sends packets `0..n` with as few sendmmsg calls as the kernel allows. Returns how many
+    /// went out; the rest are dropped when the socket buffer is full.
+    pub fn send(&mut self, n: usize) -> usize {
+        let mut sent = 0;
+        while sent < n {
+            let rc = unsafe { libc::sendmmsg(self.fd.as_raw_fd(), self.msgs[sent..].as_mut_ptr(), (n - sent) as u32, libc::MSG_DONTWAIT) };
+            if rc <= 0 {
+                break;
+            }
+            sent += rc as usize;
+        }
+        sent
+    }
+}
@@ -0,0 +1,1380 @@
+//! OpenASIO null driver: the full driver lifecycle with no hardware behind it, for offline
+//! rendering and CI.
+//!
+//! The device name is a `,`-separated option list (`open_device(NULL)` reads it from
+//! `OPENASIO_NULL`, else `paced`):
+//! - `paced` (default): periods follow a simulated clock, with `jitter_us=N` of random extra
+//!   wake-up delay, `ppm=X` of crystal error and `xrun_every=N` injected xruns, each of which
+//!   stalls the clock for one period. A host more than one period late underruns as on a
+//!   real device.
+//! - `freewheel`: no clock; `process` runs back to back as fast as the host returns, which
+//!   measures its throughput in periods per second. `xrun_every` is still honoured.
+//! - `in=FILE.wav` feeds capture from a WAV file (16/24/32-bit integer or float), silence
+//!   once it ends or from the start with `loop`. `out=FILE.wav` records playback as 32-bit
+//!   float; each new stream rewrites it. File I/O runs on the driver thread, so a
+//!   file-backed stream is not RT-clean.
+//! - `rate=N`, `frames=N`, `channels=IN:OUT` set the default config (the input file's rate
+//!   and channels otherwise, 48000 Hz, 128 frames, 2:2), `seed=N` the jitter sequence.
+//! - `shared` or `shared=N`: the stream joins one of N loop threads shared by all null
+//!   devices in the process (`openasio_rt::evloop`) instead of getting its own; the loop
+//!   sleeps until the earliest period due.
+//!
+//! Every format and layout the ABI defines except U16 is native, mmap included. Batched
+//! streams (`set_batch_periods`) run one simulated wakeup per batch. If `process` returns
+//! `OA_FALSE` the driver thread finishes the period and exits; `stop()` then wraps up the
+//! files. A stream's buffers, and the host scratch of `set_host_scratch`, share one
+//! pre-faulted arena (`openasio_rt::arena`).
+#![allow(clippy::missing_safety_doc)]
+use openasio_rt::arena::{Buf, Memory, Plan};
+use openasio_rt::batch::{self, Batch};
+use openasio_rt::clock::{self, Gap, Stamp, StreamClock};
+use openasio_rt::devices::{self, Device};
+use openasio_rt::evloop::{self, Arm, Worker};
+use openasio_rt::gate::Gate;
+use openasio_rt::space;
+use openasio_rt::stats::{StreamStats, Xrun};
+use openasio_sys::convert as cv;
+use openasio_sys as sys;
+use std::ffi::CStr;
+use std::mem::size_of;
+use std::os::raw::c_void;
+use std::ptr;
+
+mod wav;
+
+type Result<T> = std::result::Result<T, String>;
+
+const CAPS: u32 = sys::OA_CAP_OUTPUT
+    | sys::OA_CAP_INPUT
+    | sys::OA_CAP_FULL_DUPLEX
+    | sys::OA_CAP_SET_SAMPLERATE
+    | sys::OA_CAP_SET_BUFFRAMES
+    | sys::OA_CAP_MMAP
+    | sys::OA_CAP_TIME_INFO_EX
+    | sys::OA_CAP_BATCH;
+
+/// Options used when the host opens the default device.
+const SPEC_ENV: &str = "OPENASIO_NULL";
+
+const MIN_RATE: u32 = 1000;
+const MAX_RATE: u32 = 768_000;
+const MAX_FRAMES: u32 = 65536;
+const MAX_CHANNELS: u16 = 64;
+
+/// Stream formats and their sample width in bits.
+const FORMATS: &[(sys::oa_sample_format, u16)] = &[
+    (sys::oa_sample_format::OA_SAMPLE_F32, 32),
+    (sys::oa_sample_format::OA_SAMPLE_I16, 16),
+    (sys::oa_sample_format::OA_SAMPLE_I24_3LE, 24),
+    (sys::oa_sample_format::OA_SAMPLE_I24_IN_32, 24),
+    (sys::oa_sample_format::OA_SAMPLE_I32, 32),
+];
+
+fn format_entry(f: sys::oa_sample_format) -> Option<&'static (sys::oa_sample_format, u16)> {
+    FORMATS.iter().find(|e| e.0 == f)
+}
+
+fn format_mask() -> u32 {
+    FORMATS.iter().fold(0, |m, e| m | sys::oa_format_bit(e.0))
+}
+
+/// A parsed device name.
+#[derive(Clone, Debug, Default)]
+struct Options {
+    freewheel: bool,
+    input: Option<String>,
+    output: Option<String>,
+    looped: bool,
+    jitter_us: u32,
+    ppm: f64,
+    xrun_every: u64,
+    seed: u64,
+    rate: Option<u32>,
+    frames: Option<u32>,
+    channels: Option<(u16, u16)>,
+    shared: u32,
+}
+
+fn parse_options(spec: &str) -> Result<Options> {
+    fn value<T: std::str::FromStr>(key: &str, v: &str) -> Result<T> {
+        v.parse().map_err(|_| format!("bad value for {key}: {v}"))
+    }
+    let mut o = Options::default();
+    for item in spec.split(',').map(str::trim).filter(|i| !i.is_empty()) {
+        match item.split_once('=') {
+            None => match item {
+                "paced" => o.freewheel = false,
+                "freewheel" => o.freewheel = true,
+                "loop" => o.looped = true,
+                "shared" => o.shared = 1,
+                _ => return Err(format!("unknown option {item}")),
+            },
+            Some((key, v)) => match key.trim() {
+                "in" => o.input = Some(v.to_string()),
+                "out" => o.output = Some(v.to_string()),
+                "jitter_us" => o.jitter_us = value(key, v)?,
+                "ppm" => o.ppm = value(key, v)?,
+                "xrun_every" => o.xrun_every = value(key, v)?,
+                "seed" => o.seed = value(key, v)?,
+                "shared" => o.shared = value(key, v)?,
+                "rate" => o.rate = Some(value(key, v)?),
+                "frames" => o.frames = Some(value(key, v)?),
+                "channels" => {
+                    let pair = v.split_once(':').ok_or(format!("channels wants IN:OUT, not {v}"))?;
+                    o.channels = Some((value(key, pair.0)?, value(key, pair.1)?));
+                }
+                _ => return Err(format!("unknown option {key}")),
+            },
+        }
+    }
+    if o.ppm.abs() >= 1e5 {
+        return Err("ppm must be within +-100000".into());
+    }
+    if o.shared as usize > evloop::MAX_LOOPS {
+        return Err(format!("shared must be 1 to {}", evloop::MAX_LOOPS));
+    }
+    Ok(o)
+}
+
+/// Timeline of the simulated device. Period `k` is due at `base + k * period` on
+/// CLOCK_MONOTONIC; `periods` also counts in freewheel mode, for the xrun schedule. A
+/// batched stream's period here is the whole batch.
+struct Sim {
+    period_ns: f64, // on the simulated crystal, so `ppm` shows up as drift
+    base_ns: f64,
+    periods: u64,
+    jitter_ns: u64,
+    xrun_every: u64,
+    rng: u64,
+    wake_ns: Option<u64>, // wake-up time of the next period, once drawn
+}
+
+impl Sim {
+    fn new(cfg: &sys::oa_stream_config, frames: u32, o: &Options) -> Sim {
+        let nominal = frames as f64 * 1e9 / cfg.sample_rate.max(1) as f64;
+        Sim {
+            period_ns: nominal / (1.0 + o.ppm * 1e-6),
+            base_ns: 0.0,
+            periods: 0,
+            jitter_ns: o.jitter_us as u64 * 1000,
+            xrun_every: o.xrun_every,
+            // xorshift must not start at zero
+            rng: o.seed.wrapping_mul(0x9e37_79b9_7f4a_7c15) | 1,
+            wake_ns: None,
+        }
+    }
+
+    /// Restarts the timeline now, keeping the period count (start, resume).
+    fn rebase(&mut self) {
+        self.base_ns = clock::monotonic_ns() as f64 - self.periods as f64 * self.period_ns;
+        self.wake_ns = None;
+    }
+
+    /// True for the period that gets an injected xrun.
+    fn xrun_due(&self) -> bool {
+        self.xrun_every > 0 && self.periods > 0 && self.periods % self.xrun_every == 0
+    }
+
+    /// The device lost a period: everything after it is due one period later.
+    fn stall(&mut self) -> u64 {
+        self.base_ns += self.period_ns;
+        self.period_ns as u64
+    }
+
+    fn jitter(&mut self) -> u64 {
+        if self.jitter_ns == 0 {
+            return 0;
+        }
+        let mut x = self.rng;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        self.rng = x;
+        x % (self.jitter_ns + 1)
+    }
+
+    fn due(&self) -> f64 {
+        self.base_ns + self.periods as f64 * self.period_ns
+    }
+
+    /// When the next period is due plus the simulated wake-up delay, which is drawn once.
+    fn wake_at(&mut self) -> u64 {
+        match self.wake_ns {
+            Some(ns) => ns,
+            None => {
+                let ns = self.due() as u64 + self.jitter();
+                *self.wake_ns.insert(ns)
+            }
+        }
+    }
+
+    /// Sleeps until [`Sim::wake_at`]. Returns when the period was due, and if the host had
+    /// fallen so far behind that the two-period buffer ran dry, by how many nanoseconds the
+    /// timeline then moved to restart at the current time.
+    fn wait(&mut self) -> (u64, Option<u64>) {
+        let due = self.due();
+        let wake = self.wake_at();
+        if clock::monotonic_ns() < wake {
+            sleep_until(wake); // a shared loop only calls in once it is time
+        }
+        self.wake_ns = None;
+        let now = clock::monotonic_ns() as f64;
+        if now <= due + self.period_ns {
+            return (due as u64, None);
+        }
+        self.base_ns = now - self.periods as f64 * self.period_ns;
+        (now as u64, Some((now - due) as u64))
+    }
+
+    fn advance(&mut self) {
+        self.periods += 1;
+    }
+}
+
+fn sleep_until(ns: u64) {
+    let ts = libc::timespec {
+        tv_sec: (ns / 1_000_000_000) as libc::time_t,
+        tv_nsec: (ns % 1_000_000_000) as libc::c_long,
+    };
+    unsafe {
+        while libc::clock_nanosleep(libc::CLOCK_MONOTONIC, libc::TIMER_ABSTIME, &ts, ptr::null_mut()) == libc::EINTR {}
+    }
+}
+
+/// Files and the scratch they are converted through, sized per stream.
+#[derive(Default)]
+struct Files {
+    input: Option<wav::Reader>,
+    output: Option<wav::Writer>,
+    raw: Buf<u8>,       // file frames, or the interleaved side of a planar transpose
+    file_f32: Buf<f32>, // a period of the input file as float
+    stage: Buf<f32>,    // a period as interleaved float at the stream's channel count
+}
+
+// Zero-copy state: the period buffers are the "device" areas, published once per stream.
+struct MmapState {
+    enabled: bool,
+    in_areas: Buf<sys::oa_mmap_channel>,
+    out_areas: Buf<sys::oa_mmap_channel>,
+    frames: u32, // frames in the open period (0 outside host.process)
+    committed: Option<u32>,
+}
+
+struct DriverState {
+    host: sys::oa_host_callbacks,
+    host_user: *mut c_void,
+    /// Open device; None while closed.
+    opts: Option<Options>,
+    /// Rate and channels of the open device's input file.
+    in_file: Option<(u32, u16)>,
+    cfg: sys::oa_stream_config,
+    clock: StreamClock,
+    stats: StreamStats,
+    sim: Sim,
+    freewheel: bool,
+    sample_bytes: usize,
+    /// Interleaved buffers: always in mmap mode, else unless the layout is planar.
+    interleaved: bool,
+    /// Stream samples of one period, one plane per channel if planar. These and every other
+    /// per-stream buffer are cut from `memory`'s arena.
+    in_buf: Buf<f32>,
+    out_buf: Buf<f32>,
+    in_planes: Buf<*mut u8>,
+    out_planes: Buf<*mut u8>,
+    memory: Memory,
+    files: Files,
+    looped: bool,
+    mmap: MmapState,
+    /// Periods per wakeup asked for by set_batch_periods, and the running stream's batch
+    /// (empty unless it delivers through host.process_batch).
+    batch_periods: u32,
+    batch: Batch,
+    rt_req: Option<sys::oa_rt_params>,
+    rt_info: Option<sys::oa_rt_info>,
+    gate: Gate,
+    worker: Option<Worker>,
+}
+
+#[repr(C)]
+struct Driver {
+    /// Must stay first: hosts reach the vtable through `oa_driver::vt`.
+    base: sys::oa_driver,
+    vt: sys::oa_driver_vtable,
+    state: DriverState,
+}
+
+impl DriverState {
+    fn stop_worker(&mut self) {
+        self.gate.stop();
+        if let Some(worker) = self.worker.take() {
+            worker.finish();
+        }
+        self.rt_info = None;
+    }
+
+    /// Stops streaming and completes the output file.
+    fn end_stream(&mut self) {
+        self.stop_worker();
+        self.memory.release();
+        self.files.input = None;
+        self.files.output = None;
+    }
+
+    fn parked(&self) -> bool {
+        self.worker.is_some() && self.gate.is_parked()
+    }
+
+    /// Frames moved per wakeup: a period, or a whole batch.
+    fn wake_frames(&self) -> u32 {
+        self.cfg.buffer_frames * self.batch.len().max(1) as u32
+    }
+
+    /// The simulated device buffers two wakeups: one being processed, one in flight.
+    fn latency(&self) -> (u32, u32) {
+        let input = if self.cfg.in_channels > 0 { self.wake_frames() } else { 0 };
+        (input, self.wake_frames())
+    }
+
+    fn default_config(&self) -> Option<sys::oa_stream_config> {
+        let o = self.opts.as_ref()?;
+        let (in_ch, out_ch) = o.channels.unwrap_or((self.in_file.map_or(2, |f| f.1), 2));
+        Some(sys::oa_stream_config {
+            sample_rate: o.rate.or(self.in_file.map(|f| f.0)).unwrap_or(48000),
+            buffer_frames: o.frames.unwrap_or(128),
+            in_channels: in_ch,
+            out_channels: out_ch,
+            format: sys::oa_sample_format::OA_SAMPLE_F32,
+            layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+        })
+    }
+
+    /// The period's injected xrun, if it has one: before its wake-up time is drawn, which
+    /// the stall pushes back by a period.
+    fn inject_xrun(&mut self) {
+        if self.sim.xrun_due() {
+            let lost_ns = if self.freewheel { 0 } else { self.sim.stall() };
+            self.xrun(lost_ns);
+        }
+    }
+
+    /// An xrun in every direction the stream has, which cost `lost_ns` of the simulated
+    /// timeline: input the host never sees and silence played ahead of its next output.
+    /// The timing loop starts over.
+    fn xrun(&mut self, lost_ns: u64) {
+        let lost = clock::ns_frames(lost_ns, self.cfg.sample_rate);
+        let mut gap = Gap::default();
+        if self.cfg.in_channels > 0 {
+            self.stats.xrun(Xrun::Overrun);
+            gap.in_dropped = lost;
+        }
+        if self.cfg.out_channels > 0 {
+            self.stats.xrun(Xrun::Underrun);
+            gap.out_inserted = lost;
+        }
+        self.clock.discontinuity(gap);
+    }
+}
+
+impl Drop for DriverState {
+    fn drop(&mut self) {
+        self.end_stream();
+    }
+}
+
+fn plane_ptrs(planes: &mut [*mut u8], buf: &mut Buf<f32>) {
+    for (c, p) in planes.iter_mut().enumerate() {
+        *p = buf.plane(c) as *mut u8;
+    }
+}
+
+fn publish_areas(areas: &mut [sys::oa_mmap_channel], base: *mut f32, sample_bytes: usize) {
+    let step = (areas.len() * sample_bytes) as u32;
+    for (c, area) in areas.iter_mut().enumerate() {
+        *area = sys::oa_mmap_channel {
+            addr: (base as *mut u8).wrapping_add(c * sample_bytes) as *mut c_void,
+            step,
+        };
+    }
+}
+
+/// Checks `cfg`, sizes the period buffers and opens the files for a new stream. The
+/// worker must be stopped.
+fn configure(s: &mut DriverState, cfg: &sys::oa_stream_config) -> i32 {
+    let Some(opts) = s.opts.clone() else {
+        return sys::OA_ERR_DEVICE;
+    };
+    if format_entry(cfg.format).is_none() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    if !(MIN_RATE..=MAX_RATE).contains(&cfg.sample_rate)
+        || !(1..=MAX_FRAMES).contains(&cfg.buffer_frames)
+        || cfg.in_channels > MAX_CHANNELS
+        || cfg.out_channels > MAX_CHANNELS
+        || cfg.in_channels + cfg.out_channels == 0
+    {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    s.files.input = None;
+    s.files.output = None;
+    let opened = (|| -> Result<(Option<wav::Reader>, Option<wav::Writer>)> {
+        let input = match &opts.input {
+            Some(path) if cfg.in_channels > 0 => Some(wav::Reader::open(path)?),
+            _ => None,
+        };
+        let output = match &opts.output {
+            Some(path) if cfg.out_channels > 0 => Some(wav::Writer::create(path, cfg.out_channels, cfg.sample_rate)?),
+            _ => None,
+        };
+        Ok((input, output))
+    })();
+    let (input, output) = match opened {
+        Ok(files) => files,
+        Err(e) => {
+            eprintln!("openasio-null: {e}");
+            return sys::OA_ERR_DEVICE;
+        }
+    };
+
+    // The buffers and the simulated clock work in wakeups; a batch is cut out of them.
+    let periods = batch::effective(s.batch_periods, &s.host, s.mmap.enabled);
+    let frames = (cfg.buffer_frames * periods) as usize;
+    let (ich, och) = (cfg.in_channels as usize, cfg.out_channels as usize);
+    let bytes = sys::oa_sample_bytes(cfg.format) as usize;
+    let plane_words = (frames * bytes).div_ceil(4);
+    let file_ch = input.as_ref().map_or(0, |r| r.channels as usize);
+    let file_bytes = input.as_ref().map_or(0, |r| r.frame_bytes());
+    let mut plan = Plan::new();
+    let in_buf = plan.planes::<f32>(ich, plane_words);
+    let out_buf = plan.planes::<f32>(och, plane_words);
+    let in_planes = plan.buf::<*mut u8>(ich);
+    let out_planes = plan.buf::<*mut u8>(och);
+    let in_areas = plan.buf::<sys::oa_mmap_channel>(ich);
+    let out_areas = plan.buf::<sys::oa_mmap_channel>(och);
+    let raw = plan.buf::<u8>((frames * file_bytes).max(frames * ich.max(och) * bytes));
+    let file_f32 = plan.buf::<f32>(frames * file_ch);
+    let stage = plan.buf::<f32>(frames * ich.max(och));
+    let arena = match s.memory.map(plan, s.rt_req.map_or(0, |r| r.flags)) {
+        Ok(arena) => arena,
+        Err(e) => {
+            eprintln!("openasio-null: {e}");
+            return sys::OA_ERR_BACKEND;
+        }
+    };
+    s.sample_bytes = bytes;
+    s.interleaved = s.mmap.enabled || cfg.layout == sys::oa_buffer_layout::OA_BUF_INTERLEAVED;
+    // Zero is silence in every format, so capture without a file needs no further writes.
+    s.in_buf = arena.get(in_buf);
+    s.out_buf = arena.get(out_buf);
+    s.in_planes = arena.get(in_planes);
+    s.out_planes = arena.get(out_planes);
+    s.mmap.in_areas = arena.get(in_areas);
+    s.mmap.out_areas = arena.get(out_areas);
+    s.files.raw = arena.get(raw);
+    s.files.file_f32 = arena.get(file_f32);
+    s.files.stage = arena.get(stage);
+    plane_ptrs(&mut s.in_planes, &mut s.in_buf);
+    plane_ptrs(&mut s.out_planes, &mut s.out_buf);
+    s.files.input = input;
+    s.files.output = output;
+    s.looped = opts.looped;
+    publish_areas(&mut s.mmap.in_areas, s.in_buf.as_mut_ptr(), bytes);
+    publish_areas(&mut s.mmap.out_areas, s.out_buf.as_mut_ptr(), bytes);
+    s.mmap.frames = 0;
+    s.batch = if periods > 1 {
+        let input = (s.in_buf.as_mut_ptr() as *mut u8, ich, s.in_buf.stride() * 4);
+        let output = (s.out_buf.as_mut_ptr() as *mut u8, och, s.out_buf.stride() * 4);
+        Batch::new(periods as usize, cfg.buffer_frames, bytes, !s.interleaved, input, output)
+    } else {
+        Batch::default()
+    };
+    s.freewheel = opts.freewheel;
+    s.sim = Sim::new(cfg, frames as u32, &opts);
+    s.cfg = *cfg;
+    s.clock = StreamClock::new(cfg.sample_rate, frames as u32);
+    s.stats.reset(cfg.sample_rate, frames as u32);
+    sys::OA_OK
+}
+
+/// Next period of the input file into the capture buffer, at the stream's channel count.
+unsafe fn read_input(s: &mut DriverState, frames: usize) {
+    let Files { input, raw, file_f32, stage, .. } = &mut s.files;
+    let Some(reader) = input.as_mut() else { return };
+    let fch = reader.channels as usize;
+    let ich = s.cfg.in_channels as usize;
+    let got = reader.read(raw, frames, s.looped);
+    cv::oa_convert_to_f32(file_f32.as_mut_ptr(), reader.format, raw.as_ptr() as *const c_void, got * fch);
+    file_f32[got * fch..frames * fch].fill(0.0);
+    // File channels past the stream's are dropped, missing ones are silent.
+    let n = fch.min(ich);
+    for i in 0..frames {
+        let dst = &mut stage[i * ich..][..ich];
+        dst[..n].copy_from_slice(&file_f32[i * fch..][..n]);
+        dst[n..].fill(0.0);
+    }
+    let samples = frames * ich;
+    if s.interleaved {
+        cv::oa_convert_from_f32(s.cfg.format, s.in_buf.as_mut_ptr() as *mut c_void, stage.as_ptr(), samples, ptr::null_mut());
+    } else {
+        cv::oa_convert_from_f32(s.cfg.format, raw.as_mut_ptr() as *mut c_void, stage.as_ptr(), samples, ptr::null_mut());
+        cv::oa_deinterleave_bytes(
+            s.in_planes.as_ptr() as *const *mut c_void,
+            raw.as_ptr() as *const c_void,
+            ich as u32,
+            frames,
+            s.sample_bytes as u32,
+        );
+    }
+}
+
+/// The period the host produced, appended to the output file as float.
+unsafe fn write_output(s: &mut DriverState, frames: usize) {
+    let Files { output, raw, stage, .. } = &mut s.files;
+    let Some(writer) = output.as_mut() else { return };
+    let och = s.cfg.out_channels as usize;
+    let samples = frames * och;
+    let src = if s.interleaved {
+        s.out_buf.as_ptr() as *const c_void
+    } else {
+        cv::oa_interleave_bytes(
+            raw.as_mut_ptr() as *mut c_void,
+            s.out_planes.as_ptr() as *const *const c_void,
+            och as u32,
+            frames,
+            s.sample_bytes as u32,
+        );
+        raw.as_ptr() as *const c_void
+    };
+    cv::oa_convert_to_f32(stage.as_mut_ptr(), s.cfg.format, src, samples);
+    writer.write(&stage[..samples]);
+}
+
+/// The device clock is the frame count, also in freewheel mode.
+fn set_device_time(ti: &mut sys::oa_time_info, rate: u32) {
+    ti.device_time_ns = (ti.frame_position as u128 * 1_000_000_000 / rate as u128) as u64;
+    ti.flags |= sys::OA_TIME_DEVICE_TIME;
+}
+
+unsafe fn driver_thread(selfp: *mut Driver) {
+    while (*selfp).state.gate.proceed() {
+        period(selfp);
+    }
+}
+
+// One wakeup: waits for it on the simulated clock, then moves it through the host.
+unsafe fn period(selfp: *mut Driver) {
+    let s = &mut (*selfp).state;
+    let frames = s.wake_frames() as usize;
+    if s.sim.wake_ns.is_none() {
+        s.inject_xrun();
+    }
+    let stamp = if s.freewheel {
+        None
+    } else {
+        let (due, late) = s.sim.wait();
+        if let Some(lost_ns) = late {
+            s.xrun(lost_ns);
+        }
+        // Capture: the period was sampled just before it was due. Playback: it starts
+        // playing once the one in flight has.
+        let offset = if s.cfg.in_channels > 0 { frames as i64 } else { -(frames as i64) };
+        Some(Stamp { host_ns: due, device_ns: 0, offset, hardware: true })
+    };
+    s.sim.advance();
+    read_input(s, frames);
+    if !s.batch.is_empty() {
+        let rate = s.cfg.sample_rate;
+        for ti in s.batch.stamp(&mut s.clock, stamp, s.stats.underruns(), s.stats.overruns()) {
+            set_device_time(ti, rate);
+        }
+        let mut keep = sys::OA_TRUE;
+        if let Some(cb) = s.host.process_batch {
+            let t0 = s.stats.begin();
+            keep = cb(s.host_user, s.batch.as_ptr(), s.batch.len() as u32, &s.cfg);
+            s.stats.end(t0);
+        }
+        write_output(s, frames);
+        if keep == sys::OA_FALSE {
+            s.gate.stop();
+        }
+        return;
+    }
+
+    let mut ti = s.clock.time_info(stamp, s.stats.underruns(), s.stats.overruns());
+    set_device_time(&mut ti, s.cfg.sample_rate);
+    s.clock.advance(frames as u32);
+
+    let mmap = s.mmap.enabled;
+    let ich = s.cfg.in_channels as usize;
+    let (in_ptr, out_ptr): (*const c_void, *mut c_void) = if mmap {
+        s.mmap.frames = frames as u32;
+        s.mmap.committed = None;
+        (ptr::null(), ptr::null_mut())
+    } else if s.interleaved {
+        (s.in_buf.as_ptr() as *const c_void, s.out_buf.as_mut_ptr() as *mut c_void)
+    } else {
+        (s.in_planes.as_ptr() as *const c_void, s.out_planes.as_mut_ptr() as *mut c_void)
+    };
+    let mut keep = sys::OA_TRUE;
+    if let Some(cb) = s.host.process {
+        let t0 = s.stats.begin();
+        keep = cb(
+            s.host_user,
+            if ich == 0 && !mmap { ptr::null() } else { in_ptr },
+            out_ptr,
+            frames as u32,
+            &ti as *const _,
+            &s.cfg as *const _,
+        );
+        s.stats.end(t0);
+    }
+    if mmap {
+        // Frames past the committed count play as silence.
+        let done = s.mmap.committed.take().unwrap_or(0) as usize;
+        let row = s.cfg.out_channels as usize * s.sample_bytes;
+        let out = std::slice::from_raw_parts_mut(s.out_buf.as_mut_ptr() as *mut u8, frames * row);
+        out[done * row..].fill(0);
+        s.mmap.frames = 0;
+    }
+    write_output(s, frames);
+    if keep == sys::OA_FALSE {
+        s.gate.stop();
+    }
+}
+
+// A stream on a shared loop: due when the simulated clock says so, at once in freewheel.
+struct Shared(*mut Driver);
+
+// SAFETY: the driver outlives its registration (stop_worker leaves the loop first).
+unsafe impl Send for Shared {}
+
+impl evloop::Client for Shared {
+    fn gate(&self) -> &Gate {
+        unsafe { &(*self.0).state.gate }
+    }
+
+    fn arm(&mut self, _fds: &mut Vec<libc::pollfd>) -> Arm {
+        let s = unsafe { &mut (*self.0).state };
+        if s.freewheel {
+            return Arm::Ready;
+        }
+        if s.sim.wake_ns.is_none() {
+            s.inject_xrun();
+        }
+        let wake = s.sim.wake_at();
+        if clock::monotonic_ns() >= wake { Arm::Ready } else { Arm::At(wake) }
+    }
+
+    fn service(&mut self) {
+        unsafe { period(self.0) }
+    }
+}
+
+// Starts the driver thread, or joins a shared loop, parked until go().
+unsafe fn spawn_worker(selfp: *mut Driver) -> i32 {
+    let d = &mut *selfp;
+    d.state.gate.park();
+    let shared = d.state.opts.as_ref().map_or(0, |o| o.shared);
+    if shared > 0 {
+        return match Worker::shared(shared, d.state.rt_req.as_ref(), Box::new(Shared(selfp))) {
+            Ok((worker, info)) => {
+                d.state.worker = Some(worker);
+                d.state.rt_info = Some(info);
+                sys::OA_OK
+            }
+            Err(e) => {
+                eprintln!("openasio-null: {e}");
+                d.state.gate.stop();
+                sys::OA_ERR_BACKEND
+            }
+        };
+    }
+    let driver_ptr = selfp as usize;
+    let rt_req = d.state.rt_req;
+    let (rt_tx, rt_rx) = std::sync::mpsc::sync_channel(1);
+    let spawned = std::thread::Builder::new()
+        .name("openasio-null".into())
+        .spawn(move || unsafe {
+            let _ = rt_tx.send(openasio_rt::apply(rt_req.as_ref()));
+            driver_thread(driver_ptr as *mut Driver);
+        });
+    match spawned {
+        Ok(handle) => d.state.worker = Some(Worker::Thread(handle)),
+        Err(_) => {
+            d.state.gate.stop();
+            return sys::OA_ERR_BACKEND;
+        }
+    }
+    d.state.rt_info = rt_rx.recv().ok();
+    sys::OA_OK
+}
+
+/// Lets the parked thread run, with the simulated clock starting now.
+unsafe fn go(selfp: *mut Driver) -> i32 {
+    let s = &mut (*selfp).state;
+    s.sim.rebase();
+    s.clock.resync();
+    s.gate.run();
+    if let Some(worker) = s.worker.as_ref() {
+        worker.wake();
+    }
+    sys::OA_OK
+}
+
+unsafe fn prepare_stream(selfp: *mut Driver, cfg: &sys::oa_stream_config) -> i32 {
+    let d = &mut *selfp;
+    d.state.end_stream();
+    let rc = configure(&mut d.state, cfg);
+    if rc != sys::OA_OK {
+        return rc;
+    }
+    let rc = spawn_worker(selfp);
+    if rc != sys::OA_OK {
+        d.state.end_stream();
+    }
+    rc
+}
+
+unsafe extern "C" fn get_caps(_: *mut sys::oa_driver) -> u32 {
+    CAPS
+}
+
+const DEVICES: &[(&str, &str)] = &[
+    ("paced", "Null device on a simulated clock"),
+    ("freewheel", "Null device, periods back to back"),
+];
+
+unsafe extern "C" fn query_devices(_selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
+    let list: String = DEVICES.iter().map(|(name, _)| format!("{name}\n")).collect();
+    let bytes = list.as_bytes();
+    let n = bytes.len().min(len.saturating_sub(1));
+    if n > 0 {
+        ptr::copy_nonoverlapping(bytes.as_ptr(), buf as *mut u8, n);
+    }
+    if len > 0 {
+        *buf.add(n) = 0;
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn enumerate_devices(
+    _selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_device_info,
+    capacity: u32,
+    count: *mut u32,
+) -> i32 {
+    let list: Vec<Device> = DEVICES
+        .iter()
+        .enumerate()
+        .map(|(i, (name, description))| Device {
+            name: name.to_string(),
+            description: description.to_string(),
+            in_channels: 2,
+            out_channels: 2,
+            default: i == 0,
+        })
+        .collect();
+    devices::write(list.iter().enumerate().map(|(i, dev)| (i as u32 + 1, dev)), out, capacity, count)
+}
+
+unsafe extern "C" fn open_device(selfp: *mut sys::oa_driver, name: *const i8) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    d.state.opts = None;
+    d.state.in_file = None;
+    let named = (!name.is_null()).then(|| CStr::from_ptr(name).to_string_lossy().to_string());
+    let spec = match named.filter(|n| !n.is_empty()) {
+        Some(n) => n,
+        None => std::env::var(SPEC_ENV).unwrap_or_else(|_| "paced".into()),
+    };
+    // The input file is opened here too, so a bad path fails now rather than at start().
+    let opened = parse_options(&spec).and_then(|o| match &o.input {
+        Some(path) => wav::Reader::open(path).map(|r| (Some((r.rate, r.channels)), o)),
+        None => Ok((None, o)),
+    });
+    match opened {
+        Ok((in_file, opts)) => {
+            d.state.opts = Some(opts);
+            d.state.in_file = in_file;
+            sys::OA_OK
+        }
+        Err(e) => {
+            eprintln!("openasio-null: {e}");
+            sys::OA_ERR_DEVICE
+        }
+    }
+}
+
+unsafe extern "C" fn close_device(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    d.state.opts = None;
+    d.state.in_file = None;
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_default_config(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_config,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let d = &*(selfp as *mut Driver);
+    match d.state.default_config() {
+        Some(cfg) => {
+            *out = cfg;
+            sys::OA_OK
+        }
+        None => sys::OA_ERR_DEVICE,
+    }
+}
+
+unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let selfp = selfp as *mut Driver;
+    let d = &mut *selfp;
+    if !(d.state.parked() && d.state.cfg == *cfg) {
+        let rc = prepare_stream(selfp, &*cfg);
+        if rc != sys::OA_OK {
+            return rc;
+        }
+    }
+    go(selfp)
+}
+
+unsafe extern "C" fn prepare(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    prepare_stream(selfp as *mut Driver, &*cfg)
+}
+
+/// Parks the thread; the output file is complete up to here.
+unsafe extern "C" fn pause(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    if !d.state.gate.pause() {
+        return sys::OA_ERR_STATE;
+    }
+    if let Some(w) = d.state.files.output.as_mut() {
+        w.finish();
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn resume(selfp: *mut sys::oa_driver) -> i32 {
+    let selfp = selfp as *mut Driver;
+    if !(*selfp).state.parked() {
+        return sys::OA_ERR_STATE;
+    }
+    go(selfp)
+}
+
+unsafe extern "C" fn stop(selfp: *mut sys::oa_driver) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    d.state.end_stream();
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_latency(
+    selfp: *mut sys::oa_driver,
+    in_lat: *mut u32,
+    out_lat: *mut u32,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    let (input, output) = d.state.latency();
+    if !in_lat.is_null() {
+        *in_lat = input;
+    }
+    if !out_lat.is_null() {
+        *out_lat = output;
+    }
+    sys::OA_OK
+}
+
+/// A running, prepared or paused stream is restarted on `cfg`, with fresh files; the host
+/// hears the new latency before the thread resumes, and a parked stream stays parked.
+unsafe fn reconfigure(selfp: *mut Driver, cfg: sys::oa_stream_config) -> i32 {
+    let d = &mut *selfp;
+    let running = d.state.gate.is_running();
+    if !(d.state.worker.is_some() && (running || d.state.gate.is_parked())) {
+        // Takes effect with the next start(), whose config the host passes along.
+        d.state.cfg = cfg;
+        return sys::OA_OK;
+    }
+    let old = d.state.cfg;
+    if cfg.sample_rate == old.sample_rate && cfg.buffer_frames == old.buffer_frames {
+        return sys::OA_OK;
+    }
+    let mut rc = prepare_stream(selfp, &cfg);
+    if rc == sys::OA_OK {
+        if let Some(cb) = d.state.host.latency_changed {
+            let (input, output) = d.state.latency();
+            cb(d.state.host_user, input, output);
+        }
+    } else if prepare_stream(selfp, &old) != sys::OA_OK {
+        return rc;
+    }
+    if running {
+        let started = go(selfp);
+        if rc == sys::OA_OK {
+            rc = started;
+        }
+    }
+    rc
+}
+
+unsafe extern "C" fn set_sr(selfp: *mut sys::oa_driver, sr: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if !(MIN_RATE..=MAX_RATE).contains(&sr) {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    let cfg = sys::oa_stream_config {
+        sample_rate: sr,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn set_buf(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    if frames == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if frames > MAX_FRAMES {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    let cfg = sys::oa_stream_config {
+        buffer_frames: frames,
+        ..d.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn mmap_enable(selfp: *mut sys::oa_driver, enable: sys::oa_bool) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    if d.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    d.state.mmap.enabled = enable != sys::OA_FALSE;
+    sys::OA_OK
+}
+
+unsafe extern "C" fn mmap_begin_period(
+    selfp: *mut sys::oa_driver,
+    period: *mut sys::oa_mmap_period,
+) -> i32 {
+    if period.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let d = &*(selfp as *mut Driver);
+    let mm = &d.state.mmap;
+    if mm.frames == 0 {
+        return sys::OA_ERR_STATE;
+    }
+    let cfg = &d.state.cfg;
+    *period = sys::oa_mmap_period {
+        struct_size: size_of::<sys::oa_mmap_period>() as u32,
+        frames: mm.frames,
+        in_channels: cfg.in_channels,
+        out_channels: cfg.out_channels,
+        sample_bits: format_entry(cfg.format).map_or(32, |e| e.1),
+        sample_bytes: d.state.sample_bytes as u16,
+        flags: if cfg.format == sys::oa_sample_format::OA_SAMPLE_F32 { sys::OA_MMAP_FLOAT } else { 0 },
+        in_: if cfg.in_channels > 0 { mm.in_areas.as_ptr() } else { ptr::null() },
+        out: if cfg.out_channels > 0 { mm.out_areas.as_ptr() } else { ptr::null() },
+    };
+    sys::OA_OK
+}
+
+unsafe extern "C" fn mmap_commit_period(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    let mm = &mut d.state.mmap;
+    if mm.frames == 0 {
+        return sys::OA_ERR_STATE;
+    }
+    if frames > mm.frames {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    mm.committed = Some(frames);
+    sys::OA_OK
+}
+
+unsafe extern "C" fn set_batch_periods(selfp: *mut sys::oa_driver, periods: u32) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    if !batch::valid(periods) {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if periods > 1 && d.state.host.process_batch.is_none() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    if d.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    d.state.batch_periods = periods;
+    sys::OA_OK
+}
+
+unsafe extern "C" fn set_host_scratch(selfp: *mut sys::oa_driver, bytes: usize) -> i32 {
+    let d = &mut *(selfp as *mut Driver);
+    if d.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    d.state.memory.set_host_scratch(bytes)
+}
+
+unsafe extern "C" fn get_stream_memory(selfp: *mut sys::oa_driver, out: *mut sys::oa_stream_memory) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    d.state.memory.write(out)
+}
+
+unsafe extern "C" fn get_supported_formats(
+    _: *mut sys::oa_driver,
+    native: *mut u32,
+    supported: *mut u32,
+) -> i32 {
+    if !native.is_null() {
+        *native = format_mask();
+    }
+    if !supported.is_null() {
+        *supported = format_mask();
+    }
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_rt_info(selfp: *mut sys::oa_driver, out: *mut sys::oa_rt_info) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    match &d.state.rt_info {
+        Some(info) => openasio_rt::write_info(info, out),
+        None => sys::OA_ERR_STATE,
+    }
+}
+
+unsafe extern "C" fn get_stream_stats(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_stats,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    d.state.stats.write(out)
+}
+
+/// In freewheel mode the period is nominal: the thread never waits for it.
+unsafe extern "C" fn get_thread_params(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_thread_params,
+) -> i32 {
+    let d = &*(selfp as *mut Driver);
+    let Some(info) = &d.state.rt_info else {
+        return sys::OA_ERR_STATE;
+    };
+    let params = openasio_rt::thread_params(Some(info), d.state.cfg.sample_rate, d.state.wake_frames());
+    openasio_rt::write_thread_params(&params, out)
+}
+
+/// The same for every device name that parses: any rate in range, any buffer size, up to
+/// `MAX_CHANNELS` each way.
+unsafe extern "C" fn query_config_space(
+    _selfp: *mut sys::oa_driver,
+    device: *const i8,
+    out: *mut sys::oa_config_space,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    if !device.is_null() && parse_options(&CStr::from_ptr(device).to_string_lossy()).is_err() {
+        return sys::OA_ERR_DEVICE;
+    }
+    let mut sp = space::empty();
+    sp.flags = sys::OA_CONFIG_RATE_CONTINUOUS;
+    sp.rate_min = MIN_RATE;
+    sp.rate_max = MAX_RATE;
+    space::set_rates(&mut sp, space::COMMON_RATES.iter().copied());
+    sp.buffer_frames_min = 1;
+    sp.buffer_frames_max = MAX_FRAMES;
+    sp.buffer_frames_step = 1;
+    sp.in_channels = space::channel_bits(0, MAX_CHANNELS as u32);
+    sp.out_channels = space::channel_bits(0, MAX_CHANNELS as u32);
+    sp.in_channels_max = MAX_CHANNELS as u32;
+    sp.out_channels_max = MAX_CHANNELS as u32;
+    sp.native_formats = format_mask();
+    sp.supported_formats = format_mask();
+    sp.layouts = sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_INTERLEAVED)
+        | sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+    space::write(&sp, out)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_create(
+    params: *const sys::oa_create_params,
+    out: *mut *mut sys::oa_driver,
+) -> i32 {
+    if params.is_null() || out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let p = &*params;
+    if p.host.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let cfg = sys::oa_stream_config {
+        sample_rate: 48000,
+        buffer_frames: 128,
+        in_channels: 2,
+        out_channels: 2,
+        format: sys::oa_sample_format::OA_SAMPLE_F32,
+        layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+    };
+    let mut drv = Box::new(Driver {
+        base: sys::oa_driver { vt: ptr::null() },
+        vt: sys::oa_driver_vtable {
+            struct_size: size_of::<sys::oa_driver_vtable>() as u32,
+            get_caps: Some(get_caps),
+            query_devices: Some(query_devices),
+            open_device: Some(open_device),
+            close_device: Some(close_device),
+            get_default_config: Some(get_default_config),
+            start: Some(start),
+            stop: Some(stop),
+            get_latency: Some(get_latency),
+            set_sample_rate: Some(set_sr),
+            set_buffer_frames: Some(set_buf),
+            mmap_enable: Some(mmap_enable),
+            mmap_begin_period: Some(mmap_begin_period),
+            mmap_commit_period: Some(mmap_commit_period),
+            get_supported_formats: Some(get_supported_formats),
+            get_rt_info: Some(get_rt_info),
+            get_stream_stats: Some(get_stream_stats),
+            get_thread_params: Some(get_thread_params),
+            query_config_space: Some(query_config_space),
+            enumerate_devices: Some(enumerate_devices),
+            prepare: Some(prepare),
+            pause: Some(pause),
+            resume: Some(resume),
+            set_batch_periods: Some(set_batch_periods),
+            set_host_scratch: Some(set_host_scratch),
+            get_stream_memory: Some(get_stream_memory),
+        },
+        state: DriverState {
+            host: openasio_rt::host_callbacks(p),
+            host_user: p.host_user,
+            opts: None,
+            in_file: None,
+            cfg,
+            clock: StreamClock::new(48000, 128),
+            stats: StreamStats::default(),
+            sim: Sim::new(&cfg, cfg.buffer_frames, &Options::default()),
+            freewheel: false,
+            sample_bytes: 4,
+            interleaved: true,
+            in_buf: Buf::default(),
+            out_buf: Buf::default(),
+            in_planes: Buf::default(),
+            out_planes: Buf::default(),
+            memory: Memory::default(),
+            files: Files::default(),
+            looped: false,
+            mmap: MmapState {
+                enabled: false,
+                in_areas: Buf::default(),
+                out_areas: Buf::default(),
+                frames: 0,
+                committed: None,
+            },
+            batch_periods: 1,
+            batch: Batch::default(),
+            rt_req: openasio_rt::requested(p),
+            rt_info: None,
+            gate: Gate::new(),
+            worker: None,
+        },
+    });
+    drv.base.vt = &drv.vt;
+    *out = Box::into_raw(drv) as *mut sys::oa_driver;
+    sys::OA_OK
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openasio_driver_destroy(driver: *mut sys::oa_driver) {
+    if !driver.is_null() {
+        let _ = Box::from_raw(driver as *mut Driver);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::ffi::CString;
+    use std::sync::atomic::{AtomicU32, AtomicU64, Ordering::Relaxed};
+    use std::time::{Duration, Instant};
+
+    /// What the driver thread showed the host.
+    #[derive(Default)]
+    struct Seen {
+        periods: AtomicU64,
+        frames: AtomicU32,
+        rate: AtomicU32,
+        latency_calls: AtomicU32,
+        latency: AtomicU64, // input << 32 | output
+    }
+
+    unsafe extern "C" fn process(
+        user: *mut c_void,
+        _in: *const c_void,
+        out: *mut c_void,
+        frames: u32,
+        _time: *const sys::oa_time_info,
+        cfg: *const sys::oa_stream_config,
+    ) -> sys::oa_bool {
+        let (seen, cfg) = (&*(user as *const Seen), &*cfg);
+        std::slice::from_raw_parts_mut(out as *mut f32, (frames * cfg.out_channels as u32) as usize).fill(0.25);
+        seen.frames.store(frames, Relaxed);
+        seen.rate.store(cfg.sample_rate, Relaxed);
+        seen.periods.fetch_add(1, Relaxed);
+        sys::OA_TRUE
+    }
+
+    unsafe extern "C" fn latency_changed(user: *mut c_void, input: u32, output: u32) {
+        let seen = &*(user as *const Seen);
+        seen.latency.store((input as u64) << 32 | output as u64, Relaxed);
+        seen.latency_calls.fetch_add(1, Relaxed);
+    }
+
+    const CFG: sys::oa_stream_config = sys::oa_stream_config {
+        sample_rate: 48000,
+        buffer_frames: 128,
+        in_channels: 2,
+        out_channels: 2,
+        format: sys::oa_sample_format::OA_SAMPLE_F32,
+        layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+    };
+
+    /// A null device opened on `spec`, closed and destroyed on drop.
+    struct Device {
+        drv: *mut sys::oa_driver,
+        seen: Box<Seen>,
+        _host: Box<sys::oa_host_callbacks>,
+    }
+
+    impl Device {
+        fn open(spec: &str) -> Device {
+            let host = Box::new(sys::oa_host_callbacks {
+                process: Some(process),
+                latency_changed: Some(latency_changed),
+                reset_request: None,
+                devices_changed: None,
+                process_batch: None,
+            });
+            let seen = Box::<Seen>::default();
+            let params = sys::oa_create_params {
+                struct_size: size_of::<sys::oa_create_params>() as u32,
+                host: &*host,
+                host_user: &*seen as *const Seen as *mut c_void,
+                rt: ptr::null(),
+                host_size: size_of::<sys::oa_host_callbacks>() as u32,
+            };
+            let mut drv = ptr::null_mut();
+            unsafe {
+                assert_eq!(openasio_driver_create(&params, &mut drv), sys::OA_OK);
+                let name = CString::new(spec).unwrap();
+                assert_eq!(open_device(drv, name.as_ptr()), sys::OA_OK);
+            }
+            Device { drv, seen, _host: host }
+        }
+
+        /// Blocks until `n` more periods than `from` have run.
+        fn wait_periods(&self, from: u64, n: u64) {
+            let deadline = Instant::now() + Duration::from_secs(10);
+            while self.seen.periods.load(Relaxed) < from + n {
+                assert!(Instant::now() < deadline, "stream stalled");
+                std::thread::sleep(Duration::from_millis(1));
+            }
+        }
+
+        fn periods(&self) -> u64 {
+            self.seen.periods.load(Relaxed)
+        }
+
+        fn latency(&self) -> (u32, (u32, u32)) {
+            let l = self.seen.latency.load(Relaxed);
+            (self.seen.latency_calls.load(Relaxed), ((l >> 32) as u32, l as u32))
+        }
+    }
+
+    impl Drop for Device {
+        fn drop(&mut self) {
+            unsafe {
+                stop(self.drv);
+                close_device(self.drv);
+                openasio_driver_destroy(self.drv);
+            }
+        }
+    }
+
+    #[test]
+    fn a_running_stream_switches_period_and_rate_in_place() {
+        let dev = Device::open("freewheel");
+        // Before start() a change only waits for the next stream.
+        assert_eq!(unsafe { set_sr(dev.drv, 44100) }, sys::OA_OK);
+        assert_eq!(unsafe { start(dev.drv, &CFG) }, sys::OA_OK);
+        dev.wait_periods(0, 10);
+        assert_eq!(dev.latency().0, 0);
+
+        // The host hears the new latency before set_* returns, and process() only runs
+        // on the new settings from then on.
+        assert_eq!(unsafe { set_buf(dev.drv, 256) }, sys::OA_OK);
+        assert_eq!(dev.latency(), (1, (256, 256)));
+        let p = dev.periods();
+        dev.wait_periods(p, 2);
+        assert_eq!(dev.seen.frames.load(Relaxed), 256);
+
+        assert_eq!(unsafe { set_sr(dev.drv, 96000) }, sys::OA_OK);
+        assert_eq!(dev.latency(), (2, (256, 256)));
+        let p = dev.periods();
+        dev.wait_periods(p, 2);
+        assert_eq!((dev.seen.rate.load(Relaxed), dev.seen.frames.load(Relaxed)), (96000, 256));
+
+        // No-op and refused changes leave the stream running as it was.
+        assert_eq!(unsafe { set_sr(dev.drv, 96000) }, sys::OA_OK);
+        assert_eq!(unsafe { set_sr(dev.drv, 100) }, sys::OA_ERR_UNSUPPORTED);
+        assert_eq!(unsafe { set_buf(dev.drv, MAX_FRAMES + 1) }, sys::OA_ERR_UNSUPPORTED);
+        assert_eq!(dev.latency().0, 2);
+        let p = dev.periods();
+        dev.wait_periods(p, 2);
+        assert_eq!((dev.seen.rate.load(Relaxed), dev.seen.frames.load(Relaxed)), (96000, 256));
+    }
+
+    #[test]
+    fn freewheel_outruns_the_clock_and_paced_keeps_it() {
+        // Four seconds of 128-frame periods at 48 kHz, in well under that.
+        let dev = Device::open("freewheel");
+        let t = Instant::now();
+        assert_eq!(unsafe { start(dev.drv, &CFG) }, sys::OA_OK);
+        dev.wait_periods(0, 1500);
+        assert!(t.elapsed() < Duration::from_secs(2), "freewheel took {:?}", t.elapsed());
+        drop(dev);
+
+        let dev = Device::open("paced");
+        assert_eq!(unsafe { start(dev.drv, &CFG) }, sys::OA_OK);
+        std::thread::sleep(Duration::from_millis(300));
+        let periods = dev.periods(); // 112.5 on time
+        assert!((56..=170).contains(&periods), "{periods} periods in 300 ms");
+    }
+
+    #[test]
+    fn out_records_every_period_the_host_rendered() {
+        let path = std::env::temp_dir().join(format!("openasio-null-{}.wav", std::process::id()));
+        let dev = Device::open(&format!("freewheel,out={}", path.display()));
+        assert_eq!(unsafe { start(dev.drv, &CFG) }, sys::OA_OK);
+        dev.wait_periods(0, 50);
+        assert_eq!(unsafe { stop(dev.drv) }, sys::OA_OK);
+        let periods = dev.periods();
+
+        let mut file = wav::Reader::open(path.to_str().unwrap()).unwrap();
+        assert_eq!((file.rate, file.channels, file.format), (48000, 2, sys::oa_sample_format::OA_SAMPLE_F32));
+        let frames = periods as usize * 128;
+        let mut data = vec![0u8; (frames + 1) * file.frame_bytes()];
+        assert_eq!(file.read(&mut data, frames + 1, false), frames);
+        assert!(data[..frames * 8].chunks_exact(4).all(|b| f32::from_le_bytes(b.try_into().unwrap()) == 0.25));
+        std::fs::remove_file(&path).unwrap();
+    }
+}
@@ -0,0 +1,176 @@
+//! RIFF/WAVE files behind the null device's `in=` and `out=` options.
+//!
+//! The reader takes 16-, 24- and 32-bit integer PCM and 32-bit float, plain or
+//! WAVE_FORMAT_EXTENSIBLE, and hands out raw frames in the matching `oa_sample_format`.
+//! The writer always produces 32-bit float, which holds every stream format up to 24 bits
+//! exactly; its header is patched on [`Writer::finish`].
+use openasio_sys::oa_sample_format as F;
+use std::fs::File;
+use std::io::{BufReader, BufWriter, Read, Seek, SeekFrom, Write};
+
+type Result<T> = std::result::Result<T, String>;
+
+const TAG_PCM: u16 = 1;
+const TAG_FLOAT: u16 = 3;
+const TAG_EXTENSIBLE: u16 = 0xfffe;
+const HEADER_BYTES: u64 = 44;
+
+pub struct Reader {
+    file: BufReader<File>,
+    pub channels: u16,
+    pub rate: u32,
+    pub format: F,
+    data_start: u64,
+    data_len: u64, // bytes
+    pos: u64,      // bytes of data read
+}
+
+fn u16_at(b: &[u8], at: usize) -> u16 {
+    u16::from_le_bytes([b[at], b[at + 1]])
+}
+
+fn u32_at(b: &[u8], at: usize) -> u32 {
+    u32::from_le_bytes([b[at], b[at + 1], b[at + 2], b[at + 3]])
+}
+
+impl Reader {
+    pub fn open(path: &str) -> Result<Reader> {
+        let fail = |e: std::io::Error| format!("{path}: {e}");
+        let mut file = BufReader::new(File::open(path).map_err(fail)?);
+        let mut riff = [0u8; 12];
+        file.read_exact(&mut riff).map_err(fail)?;
+        if &riff[0..4] != b"RIFF" || &riff[8..12] != b"WAVE" {
+            return Err(format!("{path}: not a RIFF/WAVE file"));
+        }
+        let mut fmt: Option<(u16, u16, u32, u16)> = None;
+        loop {
+            let mut head = [0u8; 8];
+            file.read_exact(&mut head).map_err(|_| format!("{path}: no data chunk"))?;
+            let len = u32_at(&head, 4) as u64;
+            match &head[0..4] {
+                b"fmt " => {
+                    let mut body = vec![0u8; len as usize];
+                    file.read_exact(&mut body).map_err(fail)?;
+                    if body.len() < 16 {
+                        return Err(format!("{path}: short fmt chunk"));
+                    }
+                    let mut tag = u16_at(&body, 0);
+                    if tag == TAG_EXTENSIBLE && body.len() >= 26 {
+                        tag = u16_at(&body, 24); // first two bytes of the subformat GUID
+                    }
+                    fmt = Some((tag, u16_at(&body, 2), u32_at(&body, 4), u16_at(&body, 14)));
+                    if len % 2 == 1 {
+                        file.seek_relative(1).map_err(fail)?;
+                    }
+                }
+                b"data" => {
+                    let (tag, channels, rate, bits) = fmt.ok_or(format!("{path}: data before fmt"))?;
+                    let format = match (tag, bits) {
+                        (TAG_PCM, 16) => F::OA_SAMPLE_I16,
+                        (TAG_PCM, 24) => F::OA_SAMPLE_I24_3LE,
+                        (TAG_PCM, 32) => F::OA_SAMPLE_I32,
+                        (TAG_FLOAT, 32) => F::OA_SAMPLE_F32,
+                        _ => return Err(format!("{path}: unsupported encoding (tag {tag}, {bits} bits)")),
+                    };
+                    if channels == 0 {
+                        return Err(format!("{path}: no channels"));
+                    }
+                    let data_start = file.stream_position().map_err(fail)?;
+                    // Streamed writers leave the size at 0 or all ones; the data then runs to EOF.
+                    let data_len = if len == 0 || len == u32::MAX as u64 {
+                        file.get_ref().metadata().map_err(fail)?.len().saturating_sub(data_start)
+                    } else {
+                        len
+                    };
+                    return Ok(Reader { file, channels, rate, format, data_start, data_len, pos: 0 });
+                }
+                _ => file.seek_relative((len + (len & 1)) as i64).map_err(fail)?,
+            }
+        }
+    }
+
+    pub fn frame_bytes(&self) -> usize {
+        self.channels as usize * openasio_sys::oa_sample_bytes(self.format) as usize
+    }
+
+    /// Reads up to `frames` frames into `buf`, starting over at the end of the data if
+    /// `looped`. Returns the frames read; fewer than asked means the data has ended.
+    pub fn read(&mut self, buf: &mut [u8], frames: usize, looped: bool) -> usize {
+        let fb = self.frame_bytes();
+        let want = frames * fb;
+        let mut got = 0;
+        while got < want {
+            if self.pos >= self.data_len {
+                if !looped || self.data_len < fb as u64 || self.file.seek(SeekFrom::Start(self.data_start)).is_err() {
+                    break;
+                }
+                self.pos = 0;
+            }
+            let n = ((want - got) as u64).min(self.data_len - self.pos) as usize;
+            match self.file.read(&mut buf[got..got + n]) {
+                Ok(0) | Err(_) => self.data_len = self.pos, // shorter than its header says
+                Ok(n) => {
+                    got += n;
+                    self.pos += n as u64;
+                }
+            }
+        }
+        got / fb
+    }
+}
+
+pub struct Writer {
+    file: BufWriter<File>,
+    channels: u16,
+    rate: u32,
+    data_bytes: u64,
+}
+
+impl Writer {
+    /// Creates (or truncates) `path` with a 32-bit float header.
+    pub fn create(path: &str, channels: u16, rate: u32) -> Result<Writer> {
+        let file = File::create(path).map_err(|e| format!("{path}: {e}"))?;
+        let mut w = Writer { file: BufWriter::new(file), channels, rate, data_bytes: 0 };
+        w.header().map_err(|e| format!("{path}: {e}"))?;
+        Ok(w)
+    }
+
+    fn header(&mut self) -> std::io::Result<()> {
+        let data = self.data_bytes.min((u32::MAX as u64) - HEADER_BYTES) as u32;
+        let block = self.channels as u32 * 4;
+        let mut h = Vec::with_capacity(HEADER_BYTES as usize);
+        h.extend_from_slice(b"RIFF");
+        h.extend_from_slice(&(data + HEADER_BYTES as u32 - 8).to_le_bytes());
+        h.extend_from_slice(b"WAVEfmt ");
+        h.extend_from_slice(&16u32.to_le_bytes());
+        h.extend_from_slice(&TAG_FLOAT.to_le_bytes());
+        h.extend_from_slice(&self.channels.to_le_bytes());
+        h.extend_from_slice(&self.rate.to_le_bytes());
+        h.extend_from_slice(&(self.rate * block).to_le_bytes());
+        h.extend_from_slice(&(block as u16).to_le_bytes());
+        h.extend_from_slice(&32u16.to_le_bytes());
+        h.extend_from_slice(b"data");
+        h.extend_from_slice(&data.to_le_bytes());
+        self.file.write_all(&h)
+    }
+
+    /// Appends interleaved samples.
+    pub fn write(&mut self, samples: &[f32]) -> bool {
+        let bytes = unsafe { std::slice::from_raw_parts(samples.as_ptr() as *const u8, samples.len() * 4) };
+        self.data_bytes += bytes.len() as u64;
+        self.file.write_all(bytes).is_ok()
+    }
+
+    /// Writes the sizes into the header and flushes, leaving the file open for more.
+    pub fn finish(&mut self) -> bool {
+        let done = self.file.seek(SeekFrom::Start(0)).and_then(|_| self.header());
+        let end = self.file.seek(SeekFrom::Start(HEADER_BYTES + self.data_bytes));
+        done.and(end).and_then(|_| self.file.flush()).is_ok()
+    }
+}
+
+impl Drop for Writer {
+    fn drop(&mut self) {
+        self.finish();
+    }
+}
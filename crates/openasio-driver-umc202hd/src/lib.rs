@@ -1,62 +1,261 @@
 //! OpenASIO driver specialized for the Behringer UMC202HD USB interface (ALSA backend).
+//!
+//! The PCM pair and its engine (`OPENASIO_ALSA`) come from `openasio-alsa`.
 #![allow(clippy::missing_safety_doc)]
 use alsa::device_name::HintIter;
 use alsa::pcm::{Access, Format, HwParams, PCM};
-use alsa::{Direction as PcmDir, ValueOr};
+use alsa::Direction as PcmDir;
+use openasio_alsa::{self as engine, Duplex, Samples, Setup};
 use openasio_sys as sys;
+use sys::convert;
 use std::ffi::CStr;
 use std::os::raw::c_void;
 use std::ptr;
-use std::sync::atomic::{AtomicBool, AtomicU32, Ordering};
-use std::time::Instant;
+use std::sync::{Mutex, MutexGuard};
+use openasio_rt::arena::{Buf, Memory, Plan};
+use openasio_rt::clock::StreamClock;
+use openasio_rt::devices::{self, Device, DeviceCache};
+use openasio_rt::evloop::{self, Arm, Worker};
+use openasio_rt::gate::Gate;
+use openasio_rt::space;
+use openasio_rt::stats::{StreamStats, Xrun};
+use openasio_rt::tune::{self, Stepper, Tuner};
 
 type Result<T> = std::result::Result<T, String>;
 
 const CAP_OUTPUT: u32 = sys::OA_CAP_OUTPUT as u32;
 const CAP_INPUT: u32 = sys::OA_CAP_INPUT as u32;
 const CAP_FULL_DUPLEX: u32 = sys::OA_CAP_FULL_DUPLEX as u32;
-const CAPS: u32 = CAP_OUTPUT | CAP_INPUT | CAP_FULL_DUPLEX;
+const CAP_SET_SR: u32 = sys::OA_CAP_SET_SAMPLERATE as u32;
+const CAP_SET_BF: u32 = sys::OA_CAP_SET_BUFFRAMES as u32;
+const CAP_MMAP: u32 = sys::OA_CAP_MMAP as u32;
+const CAP_TIME_INFO_EX: u32 = sys::OA_CAP_TIME_INFO_EX;
+const CAPS: u32 = CAP_OUTPUT
+    | CAP_INPUT
+    | CAP_FULL_DUPLEX
+    | CAP_SET_SR
+    | CAP_SET_BF
+    | CAP_MMAP
+    | CAP_TIME_INFO_EX;
 
+/// This driver's profiles in the autotune store.
+const TUNE_KEY: &str = "umc202hd";
 const SUPPORTED_SAMPLE_RATES: &[u32] = &[44100, 48000, 88200, 96000, 176400, 192000];
 
-struct Io {
-    cap: Option<PCM>,
-    pb: Option<PCM>,
+/// Formats the host can stream without conversion, with their ALSA equivalents.
+/// `OA_SAMPLE_F32` is always accepted (converted from S32) even when not native.
+const NATIVE_FORMATS: &[(sys::oa_sample_format, Format)] = &[
+    (sys::oa_sample_format::OA_SAMPLE_I16, Format::s16()),
+    (sys::oa_sample_format::OA_SAMPLE_I24_3LE, Format::S243LE),
+    (sys::oa_sample_format::OA_SAMPLE_I24_IN_32, Format::s24()),
+    (sys::oa_sample_format::OA_SAMPLE_I32, Format::s32()),
+    (sys::oa_sample_format::OA_SAMPLE_F32, Format::float()),
+];
+
+/// Device-side encoding chosen at `start()`.
+#[derive(Clone, Copy)]
+struct HwFormat {
+    format: Format,
+    bytes: usize,
+    bits: u16,
+    /// Host buffers are the hardware buffers; no per-sample conversion.
+    passthrough: bool,
+}
+
+impl HwFormat {
+    fn for_stream(format: sys::oa_sample_format) -> Option<HwFormat> {
+        let alsa = NATIVE_FORMATS.iter().find(|(f, _)| *f == format)?.1;
+        let bits = match format {
+            sys::oa_sample_format::OA_SAMPLE_I24_3LE | sys::oa_sample_format::OA_SAMPLE_I24_IN_32 => 24,
+            f => (sys::oa_sample_bytes(f) * 8) as u16,
+        };
+        Some(HwFormat {
+            format: alsa,
+            bytes: sys::oa_sample_bytes(format) as usize,
+            bits,
+            passthrough: true,
+        })
+    }
+
+    /// float32 streams run the device at S32 and convert in the driver thread.
+    fn converted_f32() -> HwFormat {
+        HwFormat {
+            format: Format::s32(),
+            bytes: 4,
+            bits: 32,
+            passthrough: false,
+        }
+    }
 }
 
 struct DriverState {
     host: sys::oa_host_callbacks,
     host_user: *mut c_void,
     dev_name: Option<String>,
-    io: Io,
+    io: Duplex,
     cfg: sys::oa_stream_config,
-    time0: Instant,
-    underruns: AtomicU32,
-    overruns: AtomicU32,
-    in_hw: Vec<i32>,
-    in_buf: Vec<f32>,
-    out_buf: Vec<f32>,
-    out_hw: Vec<i32>,
-    scratch_out: Vec<f32>,
-    in_planes: Vec<*const f32>,
-    out_planes: Vec<*mut f32>,
-    running: AtomicBool,
-    worker: Option<std::thread::JoinHandle<()>>,
+    /// Frame position and smoothed period timestamps for `oa_time_info`.
+    clock: StreamClock,
+    /// Callback timing and xruns for `get_stream_stats` (also feeds `oa_time_info`).
+    stats: StreamStats,
+    hw: HwFormat,
+    /// OA_FORMAT_BIT mask of native formats (0 until probed).
+    native_formats: u32,
+    /// Period buffers, each with room for one plane per channel. All four sample buffers
+    /// have the same plane stride, so planes of one map onto planes of another.
+    in_hw: Buf<i32>,
+    in_buf: Buf<f32>,
+    out_buf: Buf<f32>,
+    out_hw: Buf<i32>,
+    scratch_in: Buf<f32>,
+    scratch_out: Buf<f32>,
+    /// Host-facing planes (in `in_buf`/`scratch_out`) for non-interleaved streams.
+    in_planes: Buf<*mut f32>,
+    out_planes: Buf<*mut f32>,
+    /// Device opened with RWNonInterleaved: `in_hw`/`out_hw` hold one plane per channel.
+    hw_planar: bool,
+    hw_in_planes: Buf<*mut u8>,
+    hw_out_planes: Buf<*mut u8>,
+    /// The arena every buffer above is cut from, plus the host's scratch.
+    memory: Memory,
+    mmap: MmapState,
+    /// Host's `oa_create_params.rt`, applied by the worker before its first period.
+    rt_req: Option<sys::oa_rt_params>,
+    /// What the running worker was granted (None while stopped).
+    rt_info: Option<sys::oa_rt_info>,
+    /// Whether the worker runs periods, is parked (prepared or paused) or exits.
+    gate: Gate,
+    worker: Option<Worker>,
+    /// `host.devices_changed`, if the host is new enough to have it.
+    hotplug: Option<devices::Notify>,
+    /// Device list behind `query_devices`/`enumerate_devices`, built on first use.
+    devices: Option<DeviceCache>,
+    /// OPENASIO_ALSA `autotune`, until the host sets buffer_frames itself.
+    autotune: bool,
+    /// The running stream's period search, with autotune.
+    tune: Option<Tuner>,
+    /// Applies the tuner's steps off the RT thread while a tuned stream has a worker.
+    steps: Option<Stepper>,
+    /// Held by a tuner step and by the host calls that could meet one on a live stream.
+    control: Mutex<()>,
+}
+
+/// Zero-copy state: channel areas of the period currently handed to the host.
+struct MmapState {
+    enabled: bool,
+    in_areas: Buf<sys::oa_mmap_channel>,
+    out_areas: Buf<sys::oa_mmap_channel>,
+    /// Frames in the open period (0 outside `host.process`).
+    frames: u32,
+    committed: Option<u32>,
 }
 
 #[repr(C)]
 struct Driver {
+    /// Must stay first: hosts reach the vtable through `oa_driver::vt`.
+    base: sys::oa_driver,
     vt: sys::oa_driver_vtable,
     state: DriverState,
 }
 
 impl DriverState {
+    /// Time info for a period of `frames` about to be processed, then moves the position
+    /// past it. `read` is how many of its frames came from the capture device.
+    fn period_time(&mut self, frames: usize, read: usize) -> sys::oa_time_info {
+        let stamp = self.io.stamp(read);
+        let ti = self.clock.time_info(
+            stamp,
+            self.stats.underruns(),
+            self.stats.overruns(),
+        );
+        self.clock.advance(frames as u32);
+        ti
+    }
+
     fn stop_worker(&mut self) {
-        self.running.store(false, Ordering::Release);
-        if let Some(handle) = self.worker.take() {
-            let _ = handle.join();
+        // A tuner step in progress completes first; none follows.
+        if let Some(steps) = self.steps.as_ref() {
+            let _control = self.control();
+            steps.quit();
+        }
+        self.gate.stop();
+        if let Some(worker) = self.worker.take() {
+            worker.finish();
+        }
+        self.steps = None;
+        self.rt_info = None;
+        if let Some(t) = self.tune.as_ref().filter(|t| t.settled()) {
+            tune::save(TUNE_KEY, &self.device_key(), self.cfg.sample_rate, t.profile());
         }
     }
+
+    fn device_key(&self) -> String {
+        self.dev_name.clone().unwrap_or_else(default_device_name)
+    }
+
+    /// RT, after a wakeup went wrong: the next period reports what the recovery cost, plus
+    /// `unplayed` frames of this wakeup's output that never reached the device. A device
+    /// that could not be restarted stops the worker and asks the host for a reset.
+    fn recovered(&mut self, unplayed: u32) {
+        let mut gap = self.io.take_gap();
+        gap.out_dropped = gap.out_dropped.saturating_add(unplayed);
+        self.clock.discontinuity(gap);
+        if self.io.failed() {
+            self.gate.stop();
+            if let Some(cb) = self.host.reset_request {
+                unsafe { cb(self.host_user) };
+            }
+        }
+    }
+
+    /// A fresh search for a stream at `rate`, from the profile saved for it.
+    fn start_tuner(&mut self, rate: u32) {
+        self.tune = self.autotune.then(|| {
+            Tuner::new(rate, engine::TUNE_PERIODS, tune::load(TUNE_KEY, &self.device_key(), rate))
+        });
+    }
+
+    /// The prepared stream runs `cfg`, apart from a tuned period.
+    fn runs(&self, cfg: &sys::oa_stream_config) -> bool {
+        let frames = if self.tune.is_some() {
+            self.cfg.buffer_frames
+        } else {
+            cfg.buffer_frames
+        };
+        self.cfg == sys::oa_stream_config { buffer_frames: frames, ..*cfg }
+    }
+
+    /// Latency reported to the host in frames: one period in, the rest of the ring out.
+    fn latency(&self) -> (u32, u32) {
+        let input = if self.cfg.in_channels > 0 {
+            self.cfg.buffer_frames
+        } else {
+            0
+        };
+        (input, self.io.output_latency(self.cfg.buffer_frames))
+    }
+
+    /// Opens the device (plus capture if `capture`), keeping handles that are already open.
+    fn open_pcms(&mut self, capture: bool) -> i32 {
+        let name = self.dev_name.clone().unwrap_or_else(default_device_name);
+        self.io.open(&name, capture)
+    }
+
+    fn device_cache(&mut self) -> &DeviceCache {
+        let hotplug = self.hotplug;
+        self.devices
+            .get_or_insert_with(|| DeviceCache::new(devices::ALSA_DEV_DIR, scan_devices, hotplug))
+    }
+
+    /// Keeps a tuner step from running until the guard is dropped.
+    fn control(&self) -> MutexGuard<'_, ()> {
+        self.control.lock().unwrap_or_else(|e| e.into_inner())
+    }
+
+    /// A worker exists and waits in the gate: the stream is prepared or paused.
+    fn parked(&self) -> bool {
+        self.worker.is_some() && self.gate.is_parked()
+    }
 }
 
 impl Drop for DriverState {
@@ -80,200 +279,494 @@ fn hint_matches_umc202hd(name: Option<&str>, desc: Option<&str>) -> bool {
         .any(|s| s.contains(needle))
 }
 
-fn enumerate_umc202hd_devices() -> Vec<String> {
-    let mut out = Vec::new();
+/// UMC202HD PCMs in the ALSA hints, sorted; the first is the default. The interface is
+/// stereo both ways, so channel counts need no probing.
+fn scan_devices() -> Vec<Device> {
+    let mut out: Vec<Device> = Vec::new();
     if let Ok(iter) = HintIter::new_str(None, "pcm") {
         for hint in iter {
-            let name = hint.name.clone();
-            let desc = hint.desc.clone();
-            if hint_matches_umc202hd(name.as_deref(), desc.as_deref()) {
-                if let Some(n) = name {
-                    out.push(n);
+            if hint_matches_umc202hd(hint.name.as_deref(), hint.desc.as_deref()) {
+                if let Some(name) = hint.name {
+                    out.push(Device {
+                        name,
+                        description: hint.desc.unwrap_or_default().replace('\n', " "),
+                        in_channels: 2,
+                        out_channels: 2,
+                        default: false,
+                    });
                 }
             }
         }
     }
     if out.is_empty() {
-        out.push("hw:UMC202HD".to_string());
+        out.push(Device {
+            name: "hw:UMC202HD".to_string(),
+            in_channels: 2,
+            out_channels: 2,
+            ..Default::default()
+        });
     }
-    out.sort();
-    out.dedup();
+    out.sort_by(|a, b| a.name.cmp(&b.name));
+    out.dedup_by(|a, b| a.name == b.name);
+    out[0].default = true;
     out
 }
 
 fn default_device_name() -> String {
-    enumerate_umc202hd_devices()
-        .into_iter()
-        .next()
-        .unwrap_or_else(|| "hw:UMC202HD".to_string())
-}
-
-fn hw_setup(pcm: &PCM, dir: PcmDir, cfg: &sys::oa_stream_config) -> Result<()> {
-    let hwp = HwParams::any(pcm).map_err(|e| e.to_string())?;
-    hwp.set_access(Access::RWInterleaved)
-        .map_err(|e| e.to_string())?;
-    let channels = match dir {
-        PcmDir::Capture => cfg.in_channels,
-        PcmDir::Playback => cfg.out_channels,
-    } as u32;
-    hwp.set_channels(channels).map_err(|e| e.to_string())?;
-    hwp.set_rate(cfg.sample_rate, ValueOr::Nearest)
-        .map_err(|e| e.to_string())?;
-    hwp.set_format(Format::s32()).map_err(|e| e.to_string())?;
-    let period = cfg.buffer_frames as i64;
-    if period <= 0 {
-        return Err("invalid buffer size".into());
-    }
-    hwp.set_period_size(period, ValueOr::Nearest)
-        .map_err(|e| e.to_string())?;
-    hwp.set_buffer_size(period * 2).map_err(|e| e.to_string())?;
-    pcm.hw_params(&hwp).map_err(|e| e.to_string())?;
-
-    let swp = pcm.sw_params_current().map_err(|e| e.to_string())?;
-    swp.set_start_threshold(period).map_err(|e| e.to_string())?;
-    swp.set_avail_min(period).map_err(|e| e.to_string())?;
-    pcm.sw_params(&swp).map_err(|e| e.to_string())?;
-    Ok(())
+    scan_devices().swap_remove(0).name
 }
 
-fn i32_to_f32(src: &[i32], dst: &mut [f32]) {
-    const SCALE: f32 = 1.0 / 2147483648.0;
-    for (s, d) in src.iter().zip(dst.iter_mut()) {
-        *d = (*s as f32) * SCALE;
+fn probe_formats(pcm: &PCM) -> u32 {
+    let hwp = match HwParams::any(pcm) {
+        Ok(h) => h,
+        Err(_) => return 0,
+    };
+    NATIVE_FORMATS
+        .iter()
+        .filter(|(_, f)| hwp.test_format(*f).is_ok())
+        .fold(0, |mask, (f, _)| mask | sys::oa_format_bit(*f))
+}
+
+/// Native formats of `name`, intersecting playback and (if present) capture.
+fn probe_device_formats(name: &str) -> Option<u32> {
+    let pb = PCM::new(name, PcmDir::Playback, true).ok()?;
+    let mut mask = probe_formats(&pb);
+    if let Ok(cap) = PCM::new(name, PcmDir::Capture, true) {
+        mask &= probe_formats(&cap);
     }
+    Some(mask)
 }
 
-fn f32_to_i32(src: &[f32], dst: &mut [i32]) {
-    const MAX: f32 = 2147483647.0;
-    for (s, d) in src.iter().zip(dst.iter_mut()) {
-        let mut v = *s;
-        if v >= 1.0 {
-            *d = i32::MAX;
-        } else if v <= -1.0 {
-            *d = i32::MIN;
-        } else {
-            v *= MAX;
-            *d = v.round() as i32;
+/// What one direction of `pcm` accepts within the UMC202HD rules of `validate_config`.
+/// The period is the stream's buffer_frames and the ring holds `periods`, as in `configure`.
+fn probe_space(pcm: &PCM, dir: PcmDir, periods: u32) -> Option<sys::oa_config_space> {
+    let hwp = HwParams::any(pcm).ok()?;
+    let mut sp = space::empty();
+    space::set_rates(
+        &mut sp,
+        SUPPORTED_SAMPLE_RATES.iter().copied().filter(|&r| hwp.test_rate(r).is_ok()),
+    );
+    (sp.buffer_frames_min, sp.buffer_frames_max) = engine::period_range(&hwp, periods)?;
+    sp.buffer_frames_step = 1; // set_period_size rounds to the nearest size the device takes
+    let stereo = if hwp.test_channels(2).is_ok() { space::channel_bits(2, 2) } else { 0 };
+    match dir {
+        PcmDir::Capture => (sp.in_channels, sp.in_channels_max) = (stereo, 2),
+        PcmDir::Playback => (sp.out_channels, sp.out_channels_max) = (stereo, 2),
+    }
+    sp.native_formats = probe_formats(pcm);
+    sp.supported_formats = sp.native_formats | sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32);
+    sp.layouts = sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_INTERLEAVED)
+        | sys::oa_layout_bit(sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED);
+    Some(sp)
+}
+
+/// Reinterprets the 4-byte hardware staging buffer as raw bytes for native formats.
+fn hw_bytes_mut(buf: &mut [i32], len: usize) -> &mut [u8] {
+    let len = len.min(std::mem::size_of_val(buf));
+    unsafe { std::slice::from_raw_parts_mut(buf.as_mut_ptr() as *mut u8, len) }
+}
+
+/// Per-channel pointers to the planes of `buf`.
+fn plane_ptrs<T, P>(planes: &mut [*mut P], buf: &mut Buf<T>) {
+    for (c, p) in planes.iter_mut().enumerate() {
+        *p = buf.plane(c) as *mut P;
+    }
+}
+
+/// The same plane table viewed as read-only, as `writen`/`interleave` expect it.
+fn out_planes_const<T>(planes: &[*mut T]) -> &[*const T] {
+    unsafe { std::slice::from_raw_parts(planes.as_ptr() as *const *const T, planes.len()) }
+}
+
+/// Runs `host.process` with the playback area (and the capture area published by the
+/// caller) open. Returns the frames to commit.
+unsafe fn mmap_dispatch(selfp: *mut Driver, out: &mut [u8], in_frames: Option<usize>) -> usize {
+    let driver = &mut *selfp;
+    let bytes = driver.state.hw.bytes;
+    let och = driver.state.cfg.out_channels as usize;
+    let mut frames = out.len() / (och * bytes).max(1);
+    if let Some(n) = in_frames {
+        frames = frames.min(n);
+    }
+    frames = frames.min(driver.state.cfg.buffer_frames as usize);
+    engine::publish_areas(&mut driver.state.mmap.out_areas, out.as_mut_ptr(), bytes);
+    driver.state.mmap.frames = frames as u32;
+    driver.state.mmap.committed = None;
+
+    // The capture area starts at the application pointer, so nothing of it is read yet.
+    let ti = driver.state.period_time(frames, 0);
+    if let Some(cb) = driver.state.host.process {
+        let t0 = driver.state.stats.begin();
+        let keep = cb(
+            driver.state.host_user,
+            ptr::null(),
+            ptr::null_mut(),
+            frames as u32,
+            &ti as *const _,
+            &driver.state.cfg as *const _,
+        );
+        driver.state.stats.end(t0);
+        if keep == sys::OA_FALSE {
+            driver.state.gate.stop();
+        }
+    }
+
+    driver.state.mmap.frames = 0;
+    match driver.state.mmap.committed.take() {
+        Some(n) => n as usize,
+        None => {
+            out[..frames * och * bytes].fill(0);
+            frames
         }
     }
 }
 
-unsafe fn driver_thread(selfp: *mut Driver) {
-    loop {
-        let driver = &mut *selfp;
-        if !driver.state.running.load(Ordering::Acquire) {
-            break;
+/// One period in mmap mode: the host reads and writes the DMA areas directly.
+unsafe fn mmap_cycle(selfp: *mut Driver) {
+    let driver = &mut *selfp;
+    let frames = driver.state.cfg.buffer_frames as usize;
+    let ich = driver.state.cfg.in_channels as usize;
+    if !driver.state.io.wait(&driver.state.stats) {
+        driver.state.recovered(0);
+        return;
+    }
+    let pb = match driver.state.io.pb.as_ref() {
+        Some(pb) => pb,
+        None => return,
+    };
+    let bytes = driver.state.hw.bytes;
+    let pb_io = pb.io_bytes();
+    let res = match driver.state.io.cap.as_ref() {
+        Some(cap) => cap.io_bytes().mmap(frames, |inp| {
+            let avail = inp.len() / (ich * bytes);
+            engine::publish_areas(&mut (*selfp).state.mmap.in_areas, inp.as_mut_ptr(), bytes);
+            pb_io
+                .mmap(frames, |out| mmap_dispatch(selfp, out, Some(avail)))
+                .unwrap_or(avail)
+        }),
+        None => pb_io.mmap(frames, |out| mmap_dispatch(selfp, out, None)),
+    };
+    if let Err(e) = res {
+        if engine::is_xrun(&e) {
+            // The period's output was never committed.
+            driver.state.io.recover(Xrun::Underrun, e.errno(), &driver.state.stats);
+            driver.state.recovered(frames as u32);
         }
+    }
+}
 
-        let frames = driver.state.cfg.buffer_frames as usize;
-        let ich = driver.state.cfg.in_channels as usize;
-        let och = driver.state.cfg.out_channels as usize;
-        let interleaved = matches!(
-            driver.state.cfg.layout,
-            sys::oa_buffer_layout::OA_BUF_INTERLEAVED
+/// One period for native formats: the host reads and writes the hardware buffers as-is
+/// (or, for planar streams on interleaved-only hardware, byte planes transposed once).
+unsafe fn passthrough_cycle(selfp: *mut Driver, hw: &HwFormat) {
+    let driver = &mut *selfp;
+    let frames = driver.state.cfg.buffer_frames as usize;
+    let ich = driver.state.cfg.in_channels as usize;
+    let och = driver.state.cfg.out_channels as usize;
+    let planar = driver.state.cfg.layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+    let hw_planar = driver.state.hw_planar;
+    let in_len = frames * ich * hw.bytes;
+    let out_len = frames * och * hw.bytes;
+
+    if !driver.state.io.wait(&driver.state.stats) {
+        driver.state.recovered(0);
+        return;
+    }
+    let mut read = 0;
+    if driver.state.io.cap.is_some() {
+        let s = &mut driver.state;
+        read = if hw_planar {
+            s.io.read(Samples::Planar(&mut s.hw_in_planes), frames, &s.stats)
+        } else {
+            s.io.read(Samples::Interleaved(hw_bytes_mut(&mut s.in_hw, in_len)), frames, &s.stats)
+        };
+        // The period was lost to an overrun; the next one reports the gap.
+        if read < frames {
+            driver.state.recovered(0);
+            return;
+        }
+        if planar && !hw_planar {
+            convert::oa_deinterleave_bytes(
+                driver.state.in_planes.as_ptr() as *const *mut c_void,
+                driver.state.in_hw.as_ptr() as *const c_void,
+                ich as u32,
+                frames,
+                hw.bytes as u32,
+            );
+        }
+    }
+    if planar && !hw_planar {
+        driver.state.scratch_out[..frames * och].fill(0.0);
+    } else {
+        hw_bytes_mut(&mut driver.state.out_hw, out_len).fill(0);
+    }
+
+    let ti = driver.state.period_time(frames, read);
+
+    if let Some(cb) = driver.state.host.process {
+        let (in_ptr, out_ptr): (*const c_void, *mut c_void) = if !planar {
+            (
+                driver.state.in_hw.as_ptr() as *const c_void,
+                driver.state.out_hw.as_mut_ptr() as *mut c_void,
+            )
+        } else if hw_planar {
+            (
+                driver.state.hw_in_planes.as_ptr() as *const c_void,
+                driver.state.hw_out_planes.as_mut_ptr() as *mut c_void,
+            )
+        } else {
+            (
+                driver.state.in_planes.as_ptr() as *const c_void,
+                driver.state.out_planes.as_mut_ptr() as *mut c_void,
+            )
+        };
+        let in_ptr = if driver.state.io.cap.is_some() {
+            in_ptr
+        } else {
+            ptr::null()
+        };
+        let t0 = driver.state.stats.begin();
+        let keep = cb(
+            driver.state.host_user,
+            in_ptr,
+            out_ptr,
+            frames as u32,
+            &ti as *const _,
+            &driver.state.cfg as *const _,
         );
+        driver.state.stats.end(t0);
+        if keep == sys::OA_FALSE {
+            driver.state.gate.stop();
+            return;
+        }
+    }
 
-        if let Some(cap) = driver.state.io.cap.as_ref() {
-            let total = frames * ich;
-            let res = cap
-                .io_i32()
-                .and_then(|io| io.readi(&mut driver.state.in_hw[..total]));
-            match res {
-                Ok(read) => {
-                    let samples = read * ich;
-                    i32_to_f32(
-                        &driver.state.in_hw[..samples],
-                        &mut driver.state.in_buf[..samples],
-                    );
-                    if samples < total {
-                        driver.state.in_buf[samples..total].fill(0.0);
-                    }
-                }
-                Err(e) => {
-                    if e.errno() == nix::errno::Errno::EPIPE as i32 {
-                        let _ = cap.prepare();
-                        driver.state.overruns.fetch_add(1, Ordering::Relaxed);
-                    }
-                    driver.state.in_buf[..total].fill(0.0);
-                }
-            }
+    let s = &mut driver.state;
+    let xrun = if hw_planar {
+        s.io.write(Samples::Planar(&mut s.hw_out_planes), frames, &s.stats)
+    } else {
+        let buf = hw_bytes_mut(&mut s.out_hw, out_len);
+        if planar {
+            convert::oa_interleave_bytes(
+                buf.as_mut_ptr() as *mut c_void,
+                s.out_planes.as_ptr() as *const *const c_void,
+                och as u32,
+                frames,
+                hw.bytes as u32,
+            );
         }
+        s.io.write(Samples::Interleaved(buf), frames, &s.stats)
+    };
+    if xrun {
+        s.recovered(0);
+    }
+}
+
+unsafe fn driver_thread(selfp: *mut Driver) {
+    while (*selfp).state.gate.proceed() {
+        cycle(selfp);
+    }
+}
+
+/// One wakeup: waits for the device, moves the period through the host, then autotunes.
+unsafe fn cycle(selfp: *mut Driver) {
+    let driver = &mut *selfp;
+    if driver.state.mmap.enabled {
+        mmap_cycle(selfp);
+        autotune(selfp);
+        return;
+    }
+
+    let frames = driver.state.cfg.buffer_frames as usize;
+    let ich = driver.state.cfg.in_channels as usize;
+    let och = driver.state.cfg.out_channels as usize;
+    let interleaved = matches!(
+        driver.state.cfg.layout,
+        sys::oa_buffer_layout::OA_BUF_INTERLEAVED
+    );
 
+    let hw = driver.state.hw;
+    if hw.passthrough {
+        passthrough_cycle(selfp, &hw);
+        autotune(selfp);
+        return;
+    }
+    let hw_planar = driver.state.hw_planar;
+
+    // Capture first, then playback; with the poll engine neither call blocks.
+    if !driver.state.io.wait(&driver.state.stats) {
+        driver.state.recovered(0);
+        return;
+    }
+    let mut read = 0;
+    if driver.state.io.cap.is_some() {
+        let total = frames * ich;
+        let s = &mut driver.state;
+        read = if hw_planar {
+            s.io.read(Samples::Planar(&mut s.hw_in_planes), frames, &s.stats)
+        } else {
+            s.io.read(Samples::Interleaved(hw_bytes_mut(&mut s.in_hw, total * 4)), frames, &s.stats)
+        };
+        // The period was lost to an overrun; the next one reports the gap.
+        if read < frames {
+            driver.state.recovered(0);
+            return;
+        }
         if interleaved {
-            driver.state.out_buf[..frames * och].fill(0.0);
+            convert::i32_to_f32(
+                &driver.state.in_hw[..total],
+                &mut driver.state.in_buf[..total],
+            );
+        } else if hw_planar {
+            // Device planes map 1:1 onto the host planes; convert them in one pass,
+            // padding included.
+            let planes = ich * driver.state.in_hw.stride();
+            convert::i32_to_f32(
+                &driver.state.in_hw[..planes],
+                &mut driver.state.in_buf[..planes],
+            );
         } else {
-            driver.state.scratch_out[..frames * och].fill(0.0);
+            convert::i32_to_f32(
+                &driver.state.in_hw[..total],
+                &mut driver.state.scratch_in[..total],
+            );
+            convert::deinterleave_f32(
+                &driver.state.in_planes,
+                driver.state.scratch_in.as_ptr(),
+                frames,
+            );
         }
+    }
 
-        let ti = sys::oa_time_info {
-            host_time_ns: driver.state.time0.elapsed().as_nanos() as u64,
-            device_time_ns: 0,
-            underruns: driver.state.underruns.load(Ordering::Relaxed),
-            overruns: driver.state.overruns.load(Ordering::Relaxed),
-        };
+    if interleaved {
+        driver.state.out_buf[..frames * och].fill(0.0);
+    } else {
+        driver.state.scratch_out[..frames * och].fill(0.0);
+    }
 
-        if let Some(cb) = driver.state.host.process {
-            let in_ptr: *const c_void = if ich == 0 {
-                ptr::null()
-            } else if interleaved {
-                driver.state.in_buf.as_ptr() as *const c_void
-            } else {
-                driver.state.in_planes.as_ptr() as *const c_void
-            };
-            let out_ptr: *mut c_void = if interleaved {
-                driver.state.out_buf.as_mut_ptr() as *mut c_void
-            } else {
-                driver.state.out_planes.as_mut_ptr() as *mut c_void
-            };
-            let keep = cb(
-                driver.state.host_user,
-                in_ptr,
-                out_ptr,
-                frames as u32,
-                &ti as *const _,
-                &driver.state.cfg as *const _,
-            );
-            if keep == sys::OA_FALSE {
-                driver.state.running.store(false, Ordering::Release);
-                continue;
-            }
+    let ti = driver.state.period_time(frames, read);
+
+    if let Some(cb) = driver.state.host.process {
+        let in_ptr: *const c_void = if ich == 0 {
+            ptr::null()
+        } else if interleaved {
+            driver.state.in_buf.as_ptr() as *const c_void
+        } else {
+            driver.state.in_planes.as_ptr() as *const c_void
+        };
+        let out_ptr: *mut c_void = if interleaved {
+            driver.state.out_buf.as_mut_ptr() as *mut c_void
+        } else {
+            driver.state.out_planes.as_mut_ptr() as *mut c_void
+        };
+        let t0 = driver.state.stats.begin();
+        let keep = cb(
+            driver.state.host_user,
+            in_ptr,
+            out_ptr,
+            frames as u32,
+            &ti as *const _,
+            &driver.state.cfg as *const _,
+        );
+        driver.state.stats.end(t0);
+        if keep == sys::OA_FALSE {
+            driver.state.gate.stop();
+            return;
         }
+    }
 
+    let total = frames * och;
+    if hw_planar {
+        let planes = och * driver.state.out_hw.stride();
+        convert::f32_to_i32(
+            &driver.state.scratch_out[..planes],
+            &mut driver.state.out_hw[..planes],
+        );
+    } else {
         if !interleaved {
-            let frames_usize = frames;
-            for f in 0..frames_usize {
-                for c in 0..och {
-                    let plane = driver.state.scratch_out.as_ptr().add(c * frames_usize);
-                    driver.state.out_buf[f * och + c] = *plane.add(f);
-                }
-            }
+            convert::interleave_f32(
+                driver.state.out_buf.as_mut_ptr(),
+                out_planes_const(&driver.state.out_planes),
+                frames,
+            );
         }
-
-        f32_to_i32(
-            &driver.state.out_buf[..frames * och],
-            &mut driver.state.out_hw[..frames * och],
+        convert::f32_to_i32(
+            &driver.state.out_buf[..total],
+            &mut driver.state.out_hw[..total],
         );
+    }
 
-        if let Some(pb) = driver.state.io.pb.as_ref() {
-            let res = pb
-                .io_i32()
-                .and_then(|io| io.writei(&driver.state.out_hw[..frames * och]));
-            if let Err(e) = res {
-                if e.errno() == nix::errno::Errno::EPIPE as i32 {
-                    let _ = pb.prepare();
-                    driver.state.underruns.fetch_add(1, Ordering::Relaxed);
-                }
-            }
+    let s = &mut driver.state;
+    let xrun = if hw_planar {
+        s.io.write(Samples::Planar(&mut s.hw_out_planes), frames, &s.stats)
+    } else {
+        s.io.write(Samples::Interleaved(hw_bytes_mut(&mut s.out_hw, total * 4)), frames, &s.stats)
+    };
+    if xrun {
+        s.recovered(0);
+    }
+    autotune(selfp);
+}
+
+/// RT, after a wakeup: feeds the tuner and hands a step to the stream's [`Stepper`]. The
+/// stream runs on the old profile until [`retune`] parks it.
+unsafe fn autotune(selfp: *mut Driver) {
+    let s = &mut (*selfp).state;
+    let Some(steps) = s.steps.as_ref().filter(|st| st.ready()) else {
+        return;
+    };
+    let frames = s.cfg.buffer_frames;
+    let xruns = s.stats.overruns().wrapping_add(s.stats.underruns());
+    let load = s.stats.load_last();
+    if s.tune.as_mut().and_then(|t| t.observe(frames, xruns, load)).is_some() {
+        steps.request();
+    }
+}
+
+/// Tuner thread: moves the running stream to the profile its tuner stepped to. The worker
+/// is parked while the PCMs are set up again and restarted, then the host hears the new
+/// latency. A device that refuses the step stops the stream and asks the host for a reset.
+/// False while the host has the stream paused.
+unsafe fn retune(selfp: *mut Driver) -> bool {
+    let control = (*selfp).state.control();
+    let driver = &mut *selfp;
+    if !driver.state.steps.as_ref().is_some_and(Stepper::pending) {
+        return true;
+    }
+    if !driver.state.gate.pause() {
+        return !driver.state.gate.is_parked();
+    }
+    driver.state.io.halt();
+    let cfg = driver.state.cfg;
+    let stepped = configure_tuned(driver, &cfg) == sys::OA_OK && driver.state.io.start();
+    if stepped {
+        driver.state.clock.resync();
+        driver.state.gate.run();
+        if let Some(worker) = driver.state.worker.as_ref() {
+            worker.wake();
+        }
+    } else {
+        driver.state.gate.stop();
+    }
+    let (input, output) = driver.state.latency();
+    // The host may call back in from its callbacks.
+    drop(control);
+    if !stepped {
+        if let Some(cb) = driver.state.host.reset_request {
+            cb(driver.state.host_user);
         }
+    } else if let Some(cb) = driver.state.host.latency_changed {
+        cb(driver.state.host_user, input, output);
     }
+    true
 }
 
 unsafe extern "C" fn get_caps(_: *mut sys::oa_driver) -> u32 {
     CAPS
 }
 
-unsafe extern "C" fn query_devices(_selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
-    let names = enumerate_umc202hd_devices().join("\n");
+unsafe extern "C" fn query_devices(selfp: *mut sys::oa_driver, buf: *mut i8, len: usize) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    let names = driver.state.device_cache().names();
     let bytes = names.as_bytes();
     let n = bytes.len().min(len.saturating_sub(1));
     if n > 0 {
@@ -285,6 +778,16 @@ unsafe extern "C" fn query_devices(_selfp: *mut sys::oa_driver, buf: *mut i8, le
     sys::OA_OK
 }
 
+unsafe extern "C" fn enumerate_devices(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_device_info,
+    capacity: u32,
+    count: *mut u32,
+) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    driver.state.device_cache().write(out, capacity, count)
+}
+
 unsafe extern "C" fn open_device(selfp: *mut sys::oa_driver, name: *const i8) -> i32 {
     let driver = &mut *(selfp as *mut Driver);
     let chosen = if name.is_null() {
@@ -292,27 +795,38 @@ unsafe extern "C" fn open_device(selfp: *mut sys::oa_driver, name: *const i8) ->
     } else {
         CStr::from_ptr(name).to_string_lossy().to_string()
     };
+    driver.state.stop_worker();
+    driver.state.memory.release();
+    driver.state.io.close();
     driver.state.dev_name = Some(chosen);
+    driver.state.native_formats = 0;
     sys::OA_OK
 }
 
 unsafe extern "C" fn close_device(selfp: *mut sys::oa_driver) -> i32 {
     let driver = &mut *(selfp as *mut Driver);
     driver.state.stop_worker();
-    driver.state.io.cap = None;
-    driver.state.io.pb = None;
+    driver.state.memory.release();
+    driver.state.io.close();
     sys::OA_OK
 }
 
 unsafe extern "C" fn get_default_config(
-    _selfp: *mut sys::oa_driver,
+    selfp: *mut sys::oa_driver,
     out: *mut sys::oa_stream_config,
 ) -> i32 {
     if out.is_null() {
         return sys::OA_ERR_INVALID_ARG;
     }
+    let driver = &*(selfp as *mut Driver);
     (*out).sample_rate = 48000;
-    (*out).buffer_frames = 128;
+    // With autotune, the period the device last settled on at that rate.
+    (*out).buffer_frames = driver
+        .state
+        .autotune
+        .then(|| tune::load(TUNE_KEY, &driver.state.device_key(), 48000))
+        .flatten()
+        .map_or(128, |p| p.frames);
     (*out).in_channels = 2;
     (*out).out_channels = 2;
     (*out).format = sys::oa_sample_format::OA_SAMPLE_F32;
@@ -322,7 +836,9 @@ unsafe extern "C" fn get_default_config(
 
 fn validate_config(cfg: &sys::oa_stream_config) -> Result<()> {
     if cfg.format != sys::oa_sample_format::OA_SAMPLE_F32 {
-        return Err("UMC202HD driver only supports float32".into());
+        if HwFormat::for_stream(cfg.format).is_none() {
+            return Err("unsupported sample format".into());
+        }
     }
     if cfg.out_channels != 2 {
         return Err("UMC202HD playback requires 2 channels".into());
@@ -339,96 +855,338 @@ fn validate_config(cfg: &sys::oa_stream_config) -> Result<()> {
     Ok(())
 }
 
-unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
-    if cfg.is_null() {
-        return sys::OA_ERR_INVALID_ARG;
+/// Applies `cfg` to the open PCMs and sizes the period buffers for it. The worker must be
+/// stopped; on error the PCMs are left unconfigured.
+unsafe fn configure(driver: &mut Driver, cfg: &sys::oa_stream_config) -> i32 {
+    let Some(pb) = driver.state.io.pb.as_ref() else {
+        return sys::OA_ERR_STATE;
+    };
+    let cap = driver.state.io.cap.as_ref();
+    let mut native = probe_formats(pb);
+    if let Some(c) = cap {
+        native &= probe_formats(c);
     }
-    let cfg = &*cfg;
-    let driver = &mut *(selfp as *mut Driver);
-    if validate_config(cfg).is_err() {
+    driver.state.native_formats = native;
+    let hw = if cfg.format == sys::oa_sample_format::OA_SAMPLE_F32 {
+        HwFormat::converted_f32()
+    } else if native & sys::oa_format_bit(cfg.format) != 0 {
+        match HwFormat::for_stream(cfg.format) {
+            Some(hw) => hw,
+            None => return sys::OA_ERR_UNSUPPORTED,
+        }
+    } else {
         return sys::OA_ERR_UNSUPPORTED;
-    }
+    };
 
-    driver.state.stop_worker();
-    driver.state.io.cap = None;
-    driver.state.io.pb = None;
+    let mmap = driver.state.mmap.enabled;
+    // Planar streams get planar device access when both directions accept it; otherwise
+    // the thread transposes once per period. mmap areas describe either layout.
+    let planar = cfg.layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+    let hw_planar = planar
+        && !mmap
+        && engine::accepts_access(pb, Access::RWNonInterleaved)
+        && cap.map_or(true, |c| engine::accepts_access(c, Access::RWNonInterleaved));
+    let access = if mmap {
+        Access::MMapInterleaved
+    } else if hw_planar {
+        Access::RWNonInterleaved
+    } else {
+        Access::RWInterleaved
+    };
+    let setup = Setup {
+        rate: cfg.sample_rate,
+        in_channels: cfg.in_channels as u32,
+        out_channels: cfg.out_channels as u32,
+        format: hw.format,
+        sample_bytes: hw.bytes,
+        access,
+        period: cfg.buffer_frames,
+    };
+    if driver.state.io.configure(&setup).is_err() {
+        return sys::OA_ERR_BACKEND;
+    }
 
-    let name = driver
-        .state
-        .dev_name
-        .clone()
-        .unwrap_or_else(default_device_name);
+    let frames = cfg.buffer_frames as usize;
+    let ich = cfg.in_channels as usize;
+    let och = cfg.out_channels as usize;
 
-    let pb = match PCM::new(&name, PcmDir::Playback, false) {
-        Ok(p) => p,
-        Err(_) => return sys::OA_ERR_DEVICE,
+    let scratch_ich = if planar && !hw_planar && !hw.passthrough { ich } else { 0 };
+    let s = &mut driver.state;
+    let layout = |frames: usize| {
+        let mut plan = Plan::new();
+        let parts = (
+            plan.planes::<i32>(ich.max(1), frames),
+            plan.planes::<f32>(ich.max(1), frames),
+            plan.planes::<f32>(och, frames),
+            plan.planes::<i32>(och, frames),
+            plan.planes::<f32>(och, frames),
+            plan.planes::<f32>(scratch_ich, frames),
+            (plan.buf::<*mut f32>(ich), plan.buf::<*mut f32>(och)),
+            (plan.buf::<*mut u8>(ich), plan.buf::<*mut u8>(och)),
+            (plan.buf::<sys::oa_mmap_channel>(ich), plan.buf::<sys::oa_mmap_channel>(och)),
+            s.io.plan(&mut plan, frames),
+        );
+        (plan, parts)
     };
-    let cap = if cfg.in_channels > 0 {
-        match PCM::new(&name, PcmDir::Capture, false) {
-            Ok(c) => Some(c),
-            Err(_) => return sys::OA_ERR_DEVICE,
+    let (mut plan, parts) = layout(frames);
+    let (in_hw, in_buf, out_buf, out_hw, scratch_out, scratch_in, planes, hw_planes, areas, engine) = parts;
+    let ((in_planes, out_planes), (hw_in_planes, hw_out_planes), (in_areas, out_areas)) = (planes, hw_planes, areas);
+    // With autotune the mapping has room for the longest period on the ladder, so the
+    // tuner's steps cut it again in place.
+    if let Some(t) = s.tune.as_ref() {
+        plan.reserve(layout(t.max_frames() as usize).0.bytes());
+    }
+    let arena = match s.memory.map(plan, s.rt_req.map_or(0, |r| r.flags)) {
+        Ok(arena) => arena,
+        Err(e) => {
+            eprintln!("openasio-umc202hd: {e}");
+            return sys::OA_ERR_BACKEND;
         }
-    } else {
-        None
     };
-
-    if hw_setup(&pb, PcmDir::Playback, cfg).is_err() {
+    if let Err(e) = s.io.place(arena, engine) {
+        eprintln!("openasio-umc202hd: {e}");
         return sys::OA_ERR_BACKEND;
     }
-    if let Some(ref c) = cap {
-        if hw_setup(c, PcmDir::Capture, cfg).is_err() {
+    s.in_hw = arena.get(in_hw);
+    s.in_buf = arena.get(in_buf);
+    s.out_buf = arena.get(out_buf);
+    s.out_hw = arena.get(out_hw);
+    s.scratch_out = arena.get(scratch_out);
+    s.scratch_in = arena.get(scratch_in);
+    s.in_planes = arena.get(in_planes);
+    s.out_planes = arena.get(out_planes);
+    s.hw_in_planes = arena.get(hw_in_planes);
+    s.hw_out_planes = arena.get(hw_out_planes);
+    // Zeroed areas are empty until the first period publishes the device's.
+    s.mmap.in_areas = arena.get(in_areas);
+    s.mmap.out_areas = arena.get(out_areas);
+    // Host planes are float-sized even when they carry narrower native samples.
+    plane_ptrs(&mut s.in_planes, &mut s.in_buf);
+    plane_ptrs(&mut s.out_planes, &mut s.scratch_out);
+    plane_ptrs(&mut s.hw_in_planes, &mut s.in_hw);
+    plane_ptrs(&mut s.hw_out_planes, &mut s.out_hw);
+    s.hw_planar = hw_planar;
+    s.mmap.frames = 0;
+
+    driver.state.hw = hw;
+    driver.state.cfg = *cfg;
+    driver.state.clock = StreamClock::new(cfg.sample_rate, cfg.buffer_frames);
+    driver.state.stats.reset(cfg.sample_rate, cfg.buffer_frames);
+    sys::OA_OK
+}
+
+/// A stream on a shared loop: due once [`Duplex::arm`] finds both directions ready.
+struct Shared(*mut Driver);
+
+// SAFETY: the driver outlives its registration (stop_worker leaves the loop first).
+unsafe impl Send for Shared {}
+
+impl evloop::Client for Shared {
+    fn gate(&self) -> &Gate {
+        unsafe { &(*self.0).state.gate }
+    }
+
+    fn arm(&mut self, fds: &mut Vec<libc::pollfd>) -> Arm {
+        let s = unsafe { &mut (*self.0).state };
+        s.io.arm(fds, &s.stats).unwrap_or_else(|| {
+            s.recovered(0);
+            Arm::At(0)
+        })
+    }
+
+    fn events(&mut self, fds: &[libc::pollfd]) {
+        unsafe { (*self.0).state.io.events(fds) }
+    }
+
+    fn service(&mut self) {
+        unsafe { cycle(self.0) }
+    }
+}
+
+/// Starts the RT thread on the configured PCMs, or joins a shared loop, parked until [`go`].
+unsafe fn spawn_worker(selfp: *mut Driver) -> i32 {
+    let driver = &mut *selfp;
+    driver.state.gate.park();
+    if driver.state.tune.is_some() {
+        let driver_ptr = selfp as usize;
+        match Stepper::spawn("openasio-umc202hd-tune", move || unsafe { retune(driver_ptr as *mut Driver) }) {
+            Ok(steps) => driver.state.steps = Some(steps),
+            Err(e) => {
+                eprintln!("openasio-umc202hd: {e}");
+                driver.state.gate.stop();
+                return sys::OA_ERR_BACKEND;
+            }
+        }
+    }
+    let shared = driver.state.io.options().shared;
+    if shared > 0 {
+        let client = Box::new(Shared(selfp));
+        return match Worker::shared(shared, driver.state.rt_req.as_ref(), client) {
+            Ok((worker, info)) => {
+                driver.state.worker = Some(worker);
+                driver.state.rt_info = Some(info);
+                sys::OA_OK
+            }
+            Err(e) => {
+                eprintln!("openasio-umc202hd: {e}");
+                driver.state.gate.stop();
+                sys::OA_ERR_BACKEND
+            }
+        };
+    }
+    let driver_ptr = selfp as usize;
+    let rt_req = driver.state.rt_req;
+    let (rt_tx, rt_rx) = std::sync::mpsc::sync_channel(1);
+    let spawned = std::thread::Builder::new()
+        .name("openasio-umc202hd".into())
+        .spawn(move || unsafe {
+            let _ = rt_tx.send(openasio_rt::apply(rt_req.as_ref()));
+            driver_thread(driver_ptr as *mut Driver);
+        });
+    match spawned {
+        Ok(handle) => driver.state.worker = Some(Worker::Thread(handle)),
+        Err(_) => {
+            driver.state.gate.stop();
             return sys::OA_ERR_BACKEND;
         }
     }
+    // Policy, affinity and locking are in place before the first host.process.
+    driver.state.rt_info = rt_rx.recv().ok();
+    sys::OA_OK
+}
 
-    let frames = cfg.buffer_frames as usize;
-    let ich = cfg.in_channels as usize;
-    let och = cfg.out_channels as usize;
+/// Starts the prepared PCMs on a full buffer of silence and lets the parked worker run, so
+/// the first period has a whole buffer of headroom.
+unsafe fn go(selfp: *mut Driver) -> i32 {
+    let state = &mut (*selfp).state;
+    if !state.io.start() {
+        return sys::OA_ERR_BACKEND;
+    }
+    state.clock.resync();
+    state.gate.run();
+    if let Some(worker) = state.worker.as_ref() {
+        worker.wake();
+    }
+    // A step handed over while the host had the stream paused runs now.
+    if let Some(steps) = state.steps.as_ref() {
+        steps.kick();
+    }
+    sys::OA_OK
+}
 
-    driver.state.in_hw.resize(frames * ich.max(1), 0);
-    driver.state.in_buf.resize(frames * ich.max(1), 0.0);
-    driver.state.out_buf.resize(frames * och, 0.0);
-    driver.state.out_hw.resize(frames * och, 0);
-    driver.state.scratch_out.resize(frames * och, 0.0);
-    driver.state.in_planes.clear();
-    if ich > 0 {
-        for c in 0..ich {
-            let ptr = driver.state.in_buf.as_ptr().wrapping_add(c);
-            driver.state.in_planes.push(ptr);
+/// configure() for `cfg`, or with a tuner for its current profile in place of the period
+/// and ring size. A profile the device refuses is dropped for the next one up.
+unsafe fn configure_tuned(driver: &mut Driver, cfg: &sys::oa_stream_config) -> i32 {
+    let Some(mut profile) = driver.state.tune.as_ref().map(Tuner::profile) else {
+        return configure(driver, cfg);
+    };
+    loop {
+        driver.state.io.set_periods(profile.periods);
+        let tuned = sys::oa_stream_config {
+            buffer_frames: profile.frames,
+            ..*cfg
+        };
+        let rc = configure(driver, &tuned);
+        if rc != sys::OA_ERR_BACKEND {
+            return rc;
         }
+        match driver.state.tune.as_mut().and_then(Tuner::refused) {
+            Some(next) => profile = next,
+            None => return rc,
+        }
+    }
+}
+
+/// Opens and configures the device for `cfg` and spawns the worker parked.
+unsafe fn prepare_stream(selfp: *mut Driver, cfg: &sys::oa_stream_config) -> i32 {
+    let driver = &mut *selfp;
+    if validate_config(cfg).is_err() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+
+    driver.state.stop_worker();
+    driver.state.io.halt();
+    // stop() keeps the handles, so a restart only re-runs hw_params on them.
+    let rc = driver.state.open_pcms(cfg.in_channels > 0);
+    if rc != sys::OA_OK {
+        return rc;
+    }
+    driver.state.start_tuner(cfg.sample_rate);
+    let rc = configure_tuned(driver, cfg);
+    if rc != sys::OA_OK {
+        driver.state.io.close();
+        return rc;
+    }
+    let rc = spawn_worker(selfp);
+    if rc != sys::OA_OK {
+        driver.state.io.close();
+    }
+    rc
+}
+
+unsafe extern "C" fn start(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
     }
-    driver.state.out_planes.clear();
-    if och > 0 {
-        for c in 0..och {
-            let ptr = driver
-                .state
-                .scratch_out
-                .as_mut_ptr()
-                .wrapping_add(c * frames);
-            driver.state.out_planes.push(ptr);
+    let selfp = selfp as *mut Driver;
+    let driver = &mut *selfp;
+    // A prepared or paused stream on the same config only has to be started.
+    let resumed = {
+        let _control = (*selfp).state.control();
+        (driver.state.parked() && driver.state.runs(&*cfg)).then(|| go(selfp))
+    };
+    let rc = match resumed {
+        Some(rc) => rc,
+        None => {
+            let rc = prepare_stream(selfp, &*cfg);
+            if rc != sys::OA_OK {
+                return rc;
+            }
+            go(selfp)
         }
+    };
+    if rc != sys::OA_OK {
+        driver.state.stop_worker();
+        driver.state.memory.release();
+        driver.state.io.halt();
     }
+    rc
+}
 
-    driver.state.cfg = *cfg;
-    driver.state.time0 = Instant::now();
-    driver.state.underruns.store(0, Ordering::Relaxed);
-    driver.state.overruns.store(0, Ordering::Relaxed);
-    driver.state.io.pb = Some(pb);
-    driver.state.io.cap = cap;
-    driver.state.running.store(true, Ordering::Release);
-    let driver_ptr = selfp as *mut Driver;
-    driver.state.worker = Some(std::thread::spawn(move || unsafe {
-        driver_thread(driver_ptr);
-    }));
+unsafe extern "C" fn prepare(selfp: *mut sys::oa_driver, cfg: *const sys::oa_stream_config) -> i32 {
+    if cfg.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    prepare_stream(selfp as *mut Driver, &*cfg)
+}
 
+/// Parks the worker after its current period and rewinds the PCMs; they stay configured.
+unsafe extern "C" fn pause(selfp: *mut sys::oa_driver) -> i32 {
+    let _control = (*(selfp as *mut Driver)).state.control();
+    let driver = &mut *(selfp as *mut Driver);
+    if !driver.state.gate.pause() {
+        return sys::OA_ERR_STATE;
+    }
+    if !driver.state.io.rewind() {
+        return sys::OA_ERR_BACKEND;
+    }
     sys::OA_OK
 }
 
+unsafe extern "C" fn resume(selfp: *mut sys::oa_driver) -> i32 {
+    let selfp = selfp as *mut Driver;
+    let _control = (*selfp).state.control();
+    if !(*selfp).state.parked() {
+        return sys::OA_ERR_STATE;
+    }
+    go(selfp)
+}
+
 unsafe extern "C" fn stop(selfp: *mut sys::oa_driver) -> i32 {
     let driver = &mut *(selfp as *mut Driver);
     driver.state.stop_worker();
-    driver.state.io.cap = None;
-    driver.state.io.pb = None;
+    driver.state.memory.release();
+    driver.state.io.halt();
     sys::OA_OK
 }
 
@@ -438,25 +1196,271 @@ unsafe extern "C" fn get_latency(
     out_lat: *mut u32,
 ) -> i32 {
     let driver = &mut *(selfp as *mut Driver);
+    let _control = driver.state.control();
+    let (input, output) = driver.state.latency();
     if !in_lat.is_null() {
-        *in_lat = if driver.state.cfg.in_channels > 0 {
-            driver.state.cfg.buffer_frames
+        *in_lat = input;
+    }
+    if !out_lat.is_null() {
+        *out_lat = output;
+    }
+    sys::OA_OK
+}
+
+/// Switches a running, prepared or paused stream to `cfg`. The open PCMs are re-prepared
+/// with the new hardware parameters; only if the device refuses that are they reopened.
+/// The host is told about the new latency before the RT thread resumes, and a stream that
+/// was not running stays parked.
+unsafe fn reconfigure(selfp: *mut Driver, cfg: sys::oa_stream_config) -> i32 {
+    let driver = &mut *selfp;
+    if validate_config(&cfg).is_err() {
+        return sys::OA_ERR_UNSUPPORTED;
+    }
+    // No tuner step moves the stream while its state is read.
+    let control = (*selfp).state.control();
+    let running = driver.state.gate.is_running();
+    let streaming = driver.state.worker.is_some() && (running || driver.state.gate.is_parked());
+    if !streaming {
+        // Takes effect with the next start(), whose config the host passes along.
+        driver.state.cfg = cfg;
+        return sys::OA_OK;
+    }
+    let old = driver.state.cfg;
+    // set_buf to the tuned period still has to end the search.
+    let searching = driver.state.tune.is_some() && !driver.state.autotune;
+    if cfg.sample_rate == old.sample_rate && cfg.buffer_frames == old.buffer_frames && !searching {
+        return sys::OA_OK;
+    }
+    if let Some(steps) = driver.state.steps.as_ref() {
+        steps.quit();
+    }
+    drop(control);
+
+    driver.state.stop_worker();
+    driver.state.io.halt();
+    if cfg.sample_rate != old.sample_rate || !driver.state.autotune {
+        driver.state.start_tuner(cfg.sample_rate);
+    }
+    let mut rc = configure_tuned(driver, &cfg);
+    if rc != sys::OA_OK {
+        driver.state.io.close();
+        rc = driver.state.open_pcms(cfg.in_channels > 0);
+        if rc == sys::OA_OK {
+            rc = configure_tuned(driver, &cfg);
+        }
+    }
+    if rc != sys::OA_OK {
+        // Keep the stream alive on the old settings if the device still takes them.
+        driver.state.io.close();
+        if driver.state.open_pcms(old.in_channels > 0) == sys::OA_OK
+            && configure(driver, &old) == sys::OA_OK
+            && spawn_worker(selfp) == sys::OA_OK
+            && (!running || go(selfp) == sys::OA_OK)
+        {
+            return rc;
+        }
+        driver.state.stop_worker();
+        driver.state.memory.release();
+        driver.state.io.close();
+        return rc;
+    }
+
+    if let Some(cb) = driver.state.host.latency_changed {
+        let (input, output) = driver.state.latency();
+        cb(driver.state.host_user, input, output);
+    }
+    let mut rc = spawn_worker(selfp);
+    if rc == sys::OA_OK && running {
+        rc = go(selfp);
+    }
+    if rc != sys::OA_OK {
+        driver.state.stop_worker();
+        driver.state.memory.release();
+        driver.state.io.close();
+    }
+    rc
+}
+
+unsafe extern "C" fn set_sr(selfp: *mut sys::oa_driver, sr: u32) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    let cfg = sys::oa_stream_config {
+        sample_rate: sr,
+        ..driver.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+/// A period the host picks itself ends autotuning for this driver instance.
+unsafe extern "C" fn set_buf(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    if frames == 0 {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    driver.state.autotune = false;
+    let cfg = sys::oa_stream_config {
+        buffer_frames: frames,
+        ..driver.state.cfg
+    };
+    reconfigure(selfp as *mut Driver, cfg)
+}
+
+unsafe extern "C" fn mmap_enable(selfp: *mut sys::oa_driver, enable: sys::oa_bool) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    if driver.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    driver.state.mmap.enabled = enable != sys::OA_FALSE;
+    sys::OA_OK
+}
+
+unsafe extern "C" fn mmap_begin_period(
+    selfp: *mut sys::oa_driver,
+    period: *mut sys::oa_mmap_period,
+) -> i32 {
+    if period.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let driver = &mut *(selfp as *mut Driver);
+    let mm = &driver.state.mmap;
+    if mm.frames == 0 {
+        return sys::OA_ERR_STATE;
+    }
+    let ich = if driver.state.io.cap.is_some() {
+        mm.in_areas.len()
+    } else {
+        0
+    };
+    *period = sys::oa_mmap_period {
+        struct_size: std::mem::size_of::<sys::oa_mmap_period>() as u32,
+        frames: mm.frames,
+        in_channels: ich as u16,
+        out_channels: mm.out_areas.len() as u16,
+        sample_bits: driver.state.hw.bits,
+        sample_bytes: driver.state.hw.bytes as u16,
+        flags: if driver.state.hw.format == Format::float() {
+            sys::OA_MMAP_FLOAT
         } else {
             0
-        };
+        },
+        in_: if ich > 0 { mm.in_areas.as_ptr() } else { ptr::null() },
+        out: mm.out_areas.as_ptr(),
+    };
+    sys::OA_OK
+}
+
+unsafe extern "C" fn mmap_commit_period(selfp: *mut sys::oa_driver, frames: u32) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    let mm = &mut driver.state.mmap;
+    if mm.frames == 0 {
+        return sys::OA_ERR_STATE;
     }
-    if !out_lat.is_null() {
-        *out_lat = driver.state.cfg.buffer_frames;
+    if frames > mm.frames {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    mm.committed = Some(frames);
+    sys::OA_OK
+}
+
+unsafe extern "C" fn get_supported_formats(
+    selfp: *mut sys::oa_driver,
+    native: *mut u32,
+    supported: *mut u32,
+) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    if driver.state.native_formats == 0 && driver.state.io.pb.is_none() {
+        let name = driver
+            .state
+            .dev_name
+            .clone()
+            .unwrap_or_else(default_device_name);
+        match probe_device_formats(&name) {
+            Some(mask) => driver.state.native_formats = mask,
+            None => return sys::OA_ERR_DEVICE,
+        }
+    }
+    let mask = driver.state.native_formats;
+    if !native.is_null() {
+        *native = mask;
+    }
+    if !supported.is_null() {
+        *supported = mask | sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32);
     }
     sys::OA_OK
 }
 
-unsafe extern "C" fn set_sr(_: *mut sys::oa_driver, _: u32) -> i32 {
-    sys::OA_ERR_UNSUPPORTED
+unsafe extern "C" fn get_rt_info(selfp: *mut sys::oa_driver, out: *mut sys::oa_rt_info) -> i32 {
+    let driver = &*(selfp as *mut Driver);
+    match &driver.state.rt_info {
+        Some(info) => openasio_rt::write_info(info, out),
+        None => sys::OA_ERR_STATE,
+    }
+}
+
+unsafe extern "C" fn set_host_scratch(selfp: *mut sys::oa_driver, bytes: usize) -> i32 {
+    let driver = &mut *(selfp as *mut Driver);
+    if driver.state.worker.is_some() {
+        return sys::OA_ERR_STATE;
+    }
+    driver.state.memory.set_host_scratch(bytes)
 }
 
-unsafe extern "C" fn set_buf(_: *mut sys::oa_driver, _: u32) -> i32 {
-    sys::OA_ERR_UNSUPPORTED
+unsafe extern "C" fn get_stream_memory(selfp: *mut sys::oa_driver, out: *mut sys::oa_stream_memory) -> i32 {
+    let driver = &*(selfp as *mut Driver);
+    driver.state.memory.write(out)
+}
+
+unsafe extern "C" fn get_stream_stats(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_stream_stats,
+) -> i32 {
+    let driver = &*(selfp as *mut Driver);
+    driver.state.stats.write(out)
+}
+
+unsafe extern "C" fn get_thread_params(
+    selfp: *mut sys::oa_driver,
+    out: *mut sys::oa_thread_params,
+) -> i32 {
+    let driver = &*(selfp as *mut Driver);
+    let _control = driver.state.control();
+    let Some(info) = &driver.state.rt_info else {
+        return sys::OA_ERR_STATE;
+    };
+    let cfg = &driver.state.cfg;
+    openasio_rt::write_thread_params(&openasio_rt::thread_params(Some(info), cfg.sample_rate, cfg.buffer_frames), out)
+}
+
+/// The open device is probed through the handles it holds so a running stream is left
+/// alone; any other device is opened non-blocking for the probe only.
+unsafe extern "C" fn query_config_space(
+    selfp: *mut sys::oa_driver,
+    device: *const i8,
+    out: *mut sys::oa_config_space,
+) -> i32 {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let driver = &*(selfp as *mut Driver);
+    let named = (!device.is_null()).then(|| CStr::from_ptr(device).to_string_lossy().to_string());
+    let own = named.is_none() || named == driver.state.dev_name;
+    let name = named
+        .or_else(|| driver.state.dev_name.clone())
+        .unwrap_or_else(default_device_name);
+    let periods = driver.state.io.options().periods;
+    let probe = |held: Option<&PCM>, dir: PcmDir| match held.filter(|_| own) {
+        Some(pcm) => probe_space(pcm, dir, periods),
+        None => PCM::new(&name, dir, true).ok().and_then(|pcm| probe_space(&pcm, dir, periods)),
+    };
+    let Some(mut sp) = probe(driver.state.io.pb.as_ref(), PcmDir::Playback) else {
+        return sys::OA_ERR_DEVICE;
+    };
+    if let Some(cap) = probe(driver.state.io.cap.as_ref(), PcmDir::Capture) {
+        space::narrow(&mut sp, &cap);
+        sp.in_channels = cap.in_channels;
+        sp.in_channels_max = cap.in_channels_max;
+    }
+    sp.in_channels |= 1; // playback only
+    space::write(&sp, out)
 }
 
 #[no_mangle]
@@ -471,8 +1475,12 @@ pub unsafe extern "C" fn openasio_driver_create(
     if p.host.is_null() {
         return sys::OA_ERR_INVALID_ARG;
     }
+    let Ok(options) = engine::Options::from_env() else {
+        return sys::OA_ERR_INVALID_ARG;
+    };
 
-    let drv = Box::new(Driver {
+    let mut drv = Box::new(Driver {
+        base: sys::oa_driver { vt: ptr::null() },
         vt: sys::oa_driver_vtable {
             struct_size: std::mem::size_of::<sys::oa_driver_vtable>() as u32,
             get_caps: Some(get_caps),
@@ -485,15 +1493,31 @@ pub unsafe extern "C" fn openasio_driver_create(
             get_latency: Some(get_latency),
             set_sample_rate: Some(set_sr),
             set_buffer_frames: Some(set_buf),
+            mmap_enable: Some(mmap_enable),
+            mmap_begin_period: Some(mmap_begin_period),
+            mmap_commit_period: Some(mmap_commit_period),
+            get_supported_formats: Some(get_supported_formats),
+            get_rt_info: Some(get_rt_info),
+            get_stream_stats: Some(get_stream_stats),
+            get_thread_params: Some(get_thread_params),
+            query_config_space: Some(query_config_space),
+            enumerate_devices: Some(enumerate_devices),
+            prepare: Some(prepare),
+            pause: Some(pause),
+            resume: Some(resume),
+            set_batch_periods: None,
+            set_host_scratch: Some(set_host_scratch),
+            get_stream_memory: Some(get_stream_memory),
         },
         state: DriverState {
-            host: *p.host,
+            host: openasio_rt::host_callbacks(p),
             host_user: p.host_user,
             dev_name: None,
-            io: Io {
-                cap: None,
-                pb: None,
-            },
+            autotune: options.autotune,
+            tune: None,
+            steps: None,
+            control: Mutex::new(()),
+            io: Duplex::new(options),
             cfg: sys::oa_stream_config {
                 sample_rate: 48000,
                 buffer_frames: 128,
@@ -502,21 +1526,39 @@ pub unsafe extern "C" fn openasio_driver_create(
                 format: sys::oa_sample_format::OA_SAMPLE_F32,
                 layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
             },
-            time0: Instant::now(),
-            underruns: AtomicU32::new(0),
-            overruns: AtomicU32::new(0),
-            in_hw: Vec::new(),
-            in_buf: Vec::new(),
-            out_buf: Vec::new(),
-            out_hw: Vec::new(),
-            scratch_out: Vec::new(),
-            in_planes: Vec::new(),
-            out_planes: Vec::new(),
-            running: AtomicBool::new(false),
+            clock: StreamClock::new(48000, 128),
+            stats: StreamStats::default(),
+            hw: HwFormat::converted_f32(),
+            native_formats: 0,
+            in_hw: Buf::default(),
+            in_buf: Buf::default(),
+            out_buf: Buf::default(),
+            out_hw: Buf::default(),
+            scratch_in: Buf::default(),
+            scratch_out: Buf::default(),
+            in_planes: Buf::default(),
+            out_planes: Buf::default(),
+            hw_planar: false,
+            hw_in_planes: Buf::default(),
+            hw_out_planes: Buf::default(),
+            memory: Memory::default(),
+            mmap: MmapState {
+                enabled: false,
+                in_areas: Buf::default(),
+                out_areas: Buf::default(),
+                frames: 0,
+                committed: None,
+            },
+            rt_req: openasio_rt::requested(p),
+            rt_info: None,
+            gate: Gate::new(),
             worker: None,
+            hotplug: devices::Notify::from_host(&openasio_rt::host_callbacks(p), p.host_user),
+            devices: None,
         },
     });
 
+    drv.base.vt = &drv.vt;
     *out = Box::into_raw(drv) as *mut sys::oa_driver;
     sys::OA_OK
 }
@@ -527,3 +1569,53 @@ pub unsafe extern "C" fn openasio_driver_destroy(driver: *mut sys::oa_driver) {
         let _ = Box::from_raw(driver as *mut Driver);
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicU32, Ordering};
+
+    unsafe extern "C" fn reset_request(user: *mut c_void) {
+        (*(user as *const AtomicU32)).fetch_add(1, Ordering::SeqCst);
+    }
+
+    #[test]
+    fn recovery_asks_for_a_reset_only_when_the_device_is_gone() {
+        let resets = AtomicU32::new(0);
+        let host = sys::oa_host_callbacks {
+            process: None,
+            latency_changed: None,
+            reset_request: Some(reset_request),
+            devices_changed: None,
+            process_batch: None,
+        };
+        let params = sys::oa_create_params {
+            struct_size: std::mem::size_of::<sys::oa_create_params>() as u32,
+            host: &host,
+            host_user: &resets as *const AtomicU32 as *mut c_void,
+            rt: ptr::null(),
+            host_size: std::mem::size_of::<sys::oa_host_callbacks>() as u32,
+        };
+        let mut drv = ptr::null_mut();
+        unsafe {
+            assert_eq!(openasio_driver_create(&params, &mut drv), sys::OA_OK);
+            let s = &mut (*(drv as *mut Driver)).state;
+            s.gate.run();
+
+            // A recovered xrun: the next period reports the cost, the stream keeps running.
+            s.recovered(64);
+            assert_eq!(resets.load(Ordering::SeqCst), 0);
+            assert!(s.gate.is_running());
+            assert_eq!(s.clock.time_info(None, 0, 0).out_dropped, 64);
+
+            // With no PCM to restart the device does not come back: stop and ask for a reset.
+            assert!(!s.io.recover(Xrun::Underrun, libc::EPIPE, &s.stats));
+            assert!(s.io.failed());
+            s.recovered(0);
+            assert_eq!(resets.load(Ordering::SeqCst), 1);
+            assert!(!s.gate.is_running());
+
+            openasio_driver_destroy(drv);
+        }
+    }
+}
@@ -0,0 +1,375 @@
+//! One mapping per stream for every buffer the RT thread touches (`get_stream_memory`).
+//!
+//! `start()` lays its buffers out in a [`Plan`]: each [`Part`] starts on a cache line, and
+//! the planes of a [`Plan::planes`] part are each rounded up to one, so no two channels
+//! share a line and every plane is aligned for the SIMD kernels. [`Arena::map`] then maps
+//! the whole plan at once, on huge pages and locked if `oa_rt_params.flags` asks for it,
+//! and writes every page, so the first periods take no page faults. [`Arena::get`] hands
+//! out a part as a [`Buf`], which keeps the mapping alive; the buffers of the last stream
+//! can be dropped in any order.
+//!
+//! A stream set up again while it lives (reconfigure, an autotune step) is cut again from
+//! the same mapping when its new plan fits, which [`Plan::reserve`] guarantees for every
+//! profile a tuner may pick. The host's scratch has a mapping of its own that [`Memory`]
+//! keeps until the stream is stopped, so it never moves under the host.
+use openasio_sys as sys;
+use std::marker::PhantomData;
+use std::mem::{align_of, size_of};
+use std::ops::{Deref, DerefMut};
+use std::ptr::NonNull;
+use std::sync::Arc;
+
+/// Alignment of every part and of every plane in one.
+pub const ALIGN: usize = 64;
+const PAGE: usize = 4096;
+const HUGE_PAGE: usize = 2 << 20;
+
+/// The layout of a stream's arena, built before it is mapped.
+#[derive(Default)]
+pub struct Plan {
+    bytes: usize,
+}
+
+/// Where a buffer of `T` sits in a [`Plan`].
+pub struct Part<T> {
+    offset: usize,
+    len: usize,
+    stride: usize,
+    _t: PhantomData<T>,
+}
+
+impl<T> Clone for Part<T> {
+    fn clone(&self) -> Part<T> {
+        *self
+    }
+}
+
+impl<T> Copy for Part<T> {}
+
+impl Plan {
+    pub fn new() -> Plan {
+        Plan::default()
+    }
+
+    /// `len` elements of `T`, starting on a cache line.
+    pub fn buf<T: Copy>(&mut self, len: usize) -> Part<T> {
+        Part { len, stride: len, ..self.planes(1, len) }
+    }
+
+    /// `channels` planes of at least `len` elements each, every one starting on a cache
+    /// line. The planes follow each other at [`Buf::stride`] elements, so the part can also
+    /// hold `channels * len` interleaved elements.
+    pub fn planes<T: Copy>(&mut self, channels: usize, len: usize) -> Part<T> {
+        assert!(align_of::<T>() <= ALIGN && ALIGN % size_of::<T>().max(1) == 0);
+        let stride_bytes = (len * size_of::<T>()).next_multiple_of(ALIGN);
+        let offset = self.bytes;
+        self.bytes += channels * stride_bytes;
+        let stride = stride_bytes / size_of::<T>().max(1);
+        Part { offset, len: channels * stride, stride, _t: PhantomData }
+    }
+
+    /// Makes the plan at least `bytes` long, so a later, larger plan of the same stream
+    /// still fits the mapping (see [`Memory::map`]).
+    pub fn reserve(&mut self, bytes: usize) {
+        self.bytes = self.bytes.max(bytes);
+    }
+
+    pub fn bytes(&self) -> usize {
+        self.bytes
+    }
+}
+
+struct Region {
+    base: NonNull<u8>,
+    bytes: usize,
+    flags: u32,
+}
+
+// SAFETY: the mapping is plain memory; who writes where is up to the Bufs cut from it.
+unsafe impl Send for Region {}
+unsafe impl Sync for Region {}
+
+impl Drop for Region {
+    fn drop(&mut self) {
+        if self.bytes > 0 {
+            unsafe { libc::munmap(self.base.as_ptr() as *mut libc::c_void, self.bytes) };
+        }
+    }
+}
+
+/// A mapped [`Plan`]. Not RT-safe to create or drop.
+pub struct Arena {
+    region: Arc<Region>,
+}
+
+impl Arena {
+    /// Maps `plan` zeroed and with every page written. `flags` are `oa_rt_params.flags`:
+    /// `OA_RT_HUGE_PAGES` tries hugetlb pages first and falls back to normal ones,
+    /// `OA_RT_MLOCK` locks the mapping (a refused lock is not an error). An empty plan maps
+    /// nothing.
+    pub fn map(plan: &Plan, flags: u32) -> Result<Arena, String> {
+        let mut region = Region { base: NonNull::dangling(), bytes: 0, flags: sys::OA_RT_PREFAULT };
+        if plan.bytes > 0 {
+            let (base, bytes, huge) = map_pages(plan.bytes, flags & sys::OA_RT_HUGE_PAGES != 0)?;
+            region.base = base;
+            region.bytes = bytes;
+            if huge {
+                region.flags |= sys::OA_RT_HUGE_PAGES;
+            }
+            if flags & sys::OA_RT_MLOCK != 0 && unsafe { libc::mlock(base.as_ptr() as *const libc::c_void, bytes) } == 0 {
+                region.flags |= sys::OA_RT_MLOCK;
+            }
+            // Fresh anonymous pages read as zero but are only backed once written.
+            for at in (0..bytes).step_by(PAGE) {
+                unsafe { base.as_ptr().add(at).write_volatile(0) };
+            }
+        }
+        Ok(Arena { region: Arc::new(region) })
+    }
+
+    /// Whether `plan` can be cut from this mapping.
+    pub fn holds(&self, plan: &Plan) -> bool {
+        plan.bytes <= self.region.bytes
+    }
+
+    // Zeroes the first `bytes` for a plan cut again in place; the pages stay backed.
+    fn clear(&self, bytes: usize) {
+        unsafe { std::ptr::write_bytes(self.region.base.as_ptr(), 0, bytes.min(self.region.bytes)) };
+    }
+
+    /// The buffer `part` of a plan this arena [`holds`](Arena::holds).
+    pub fn get<T: Copy>(&self, part: Part<T>) -> Buf<T> {
+        debug_assert!(part.len == 0 || part.offset + part.len * size_of::<T>() <= self.region.bytes);
+        let ptr = if part.len == 0 {
+            NonNull::dangling()
+        } else {
+            // SAFETY: the plan placed the part, aligned, inside the mapping.
+            unsafe { NonNull::new_unchecked(self.region.base.as_ptr().add(part.offset) as *mut T) }
+        };
+        Buf { ptr, len: part.len, stride: part.stride, _region: Some(self.region.clone()) }
+    }
+
+    /// What `get_stream_memory` reports, with `scratch` as the host's part (which may sit
+    /// in a mapping of its own with `scratch_flags`).
+    pub fn memory(&self, scratch: &Buf<u8>, scratch_flags: u32) -> sys::oa_stream_memory {
+        sys::oa_stream_memory {
+            struct_size: size_of::<sys::oa_stream_memory>() as u32,
+            flags: self.region.flags & scratch_flags,
+            arena_bytes: self.region.bytes as u64,
+            host_scratch: if scratch.is_empty() { std::ptr::null_mut() } else { scratch.ptr.as_ptr() as *mut libc::c_void },
+            host_scratch_bytes: scratch.len() as u64,
+        }
+    }
+}
+
+// Private anonymous pages of at least `bytes`; hugetlb ones if `huge` and the system has
+// any to spare. Returns the mapping, its length and whether it is on huge pages.
+fn map_pages(bytes: usize, huge: bool) -> Result<(NonNull<u8>, usize, bool), String> {
+    let prot = libc::PROT_READ | libc::PROT_WRITE;
+    let anon = libc::MAP_PRIVATE | libc::MAP_ANONYMOUS;
+    if huge {
+        let len = bytes.next_multiple_of(HUGE_PAGE);
+        let p = unsafe { libc::mmap(std::ptr::null_mut(), len, prot, anon | libc::MAP_HUGETLB, -1, 0) };
+        if p != libc::MAP_FAILED {
+            return Ok((NonNull::new(p as *mut u8).unwrap(), len, true));
+        }
+    }
+    let len = bytes.next_multiple_of(PAGE);
+    let p = unsafe { libc::mmap(std::ptr::null_mut(), len, prot, anon, -1, 0) };
+    if p == libc::MAP_FAILED {
+        return Err(format!("stream arena of {len} bytes: {}", std::io::Error::last_os_error()));
+    }
+    Ok((NonNull::new(p as *mut u8).unwrap(), len, false))
+}
+
+/// A part of an [`Arena`]; `Default` is an empty one outside any arena.
+pub struct Buf<T> {
+    ptr: NonNull<T>,
+    len: usize,
+    stride: usize,
+    _region: Option<Arc<Region>>,
+}
+
+// SAFETY: a Buf owns its part of the mapping exclusively, like a Vec its allocation.
+unsafe impl<T: Send> Send for Buf<T> {}
+
+impl<T> Default for Buf<T> {
+    fn default() -> Buf<T> {
+        Buf { ptr: NonNull::dangling(), len: 0, stride: 0, _region: None }
+    }
+}
+
+impl<T> Buf<T> {
+    /// Elements from one plane to the next (the whole length for a [`Plan::buf`] part).
+    pub fn stride(&self) -> usize {
+        self.stride
+    }
+
+    /// Start of plane `c` of a [`Plan::planes`] part.
+    pub fn plane(&mut self, c: usize) -> *mut T {
+        self.ptr.as_ptr().wrapping_add(c * self.stride)
+    }
+}
+
+impl<T> Deref for Buf<T> {
+    type Target = [T];
+
+    fn deref(&self) -> &[T] {
+        // SAFETY: ptr..len is this Buf's part of the live mapping (or empty).
+        unsafe { std::slice::from_raw_parts(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+impl<T> DerefMut for Buf<T> {
+    fn deref_mut(&mut self) -> &mut [T] {
+        unsafe { std::slice::from_raw_parts_mut(self.ptr.as_ptr(), self.len) }
+    }
+}
+
+/// A driver's side of `set_host_scratch` and `get_stream_memory`: the scratch the host
+/// asked for and the arena of the stream set up last.
+#[derive(Default)]
+pub struct Memory {
+    scratch_bytes: usize,
+    arena: Option<Arena>,
+    scratch_arena: Option<Arena>, // the host's, mapped on its own until release()
+    scratch: Buf<u8>,
+}
+
+impl Memory {
+    /// Records the host's request for the next stream; the driver checks it is stopped.
+    pub fn set_host_scratch(&mut self, bytes: usize) -> sys::oa_result {
+        if bytes > sys::OA_HOST_SCRATCH_MAX {
+            return sys::OA_ERR_INVALID_ARG;
+        }
+        self.scratch_bytes = bytes;
+        sys::OA_OK
+    }
+
+    /// The arena for the driver to cut `plan` from (see [`Arena::map`]). The stream's
+    /// current one is zeroed and reused when it holds the plan, so a re-setup within it maps
+    /// nothing; otherwise a new one is mapped and the old one goes with the last of its
+    /// buffers. The host's scratch is mapped on the first call after [`Memory::release`]
+    /// and stays where it is until the next one.
+    pub fn map(&mut self, plan: Plan, flags: u32) -> Result<&Arena, String> {
+        if self.scratch_arena.is_none() && self.scratch_bytes > 0 {
+            let mut scratch = Plan::new();
+            let part = scratch.buf::<u8>(self.scratch_bytes);
+            let arena = Arena::map(&scratch, flags)?;
+            self.scratch = arena.get(part);
+            self.scratch_arena = Some(arena);
+        }
+        match self.arena.take() {
+            Some(arena) if arena.holds(&plan) => {
+                arena.clear(plan.bytes);
+                Ok(self.arena.insert(arena))
+            }
+            _ => Ok(self.arena.insert(Arena::map(&plan, flags)?)),
+        }
+    }
+
+    /// The stream is stopped: `get_stream_memory` answers `OA_ERR_STATE` and the host's
+    /// scratch is unmapped. The stream's mapping lives on while the driver's buffers hold
+    /// it.
+    pub fn release(&mut self) {
+        self.arena = None;
+        self.scratch = Buf::default();
+        self.scratch_arena = None;
+    }
+
+    /// `get_stream_memory` into a caller-sized `oa_stream_memory`, setting `struct_size` to what it filled.
+    pub unsafe fn write(&self, out: *mut sys::oa_stream_memory) -> sys::oa_result {
+        let scratch_flags = self.scratch_arena.as_ref().map_or(!0, |a| a.region.flags);
+        match &self.arena {
+            Some(arena) => crate::write_sized(&arena.memory(&self.scratch, scratch_flags), out),
+            None => sys::OA_ERR_STATE,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn memory(m: &Memory) -> Option<sys::oa_stream_memory> {
+        let mut out: sys::oa_stream_memory = unsafe { std::mem::zeroed() };
+        out.struct_size = size_of::<sys::oa_stream_memory>() as u32;
+        (unsafe { m.write(&mut out) } == sys::OA_OK).then_some(out)
+    }
+
+    #[test]
+    fn parts_and_planes_are_aligned_and_disjoint() {
+        let mut plan = Plan::new();
+        let bytes = plan.buf::<u8>(3);
+        let planes = plan.planes::<f32>(3, 17);
+        let shorts = plan.buf::<i16>(5);
+        let wide = plan.planes::<f64>(2, 1);
+        let arena = Arena::map(&plan, 0).unwrap();
+        let (mut bytes, mut planes, mut shorts, mut wide) = (arena.get(bytes), arena.get(planes), arena.get(shorts), arena.get(wide));
+
+        assert_eq!((bytes.len(), shorts.len()), (3, 5));
+        assert_eq!((planes.stride(), planes.len()), (32, 96));
+        assert_eq!((wide.stride(), wide.len()), (8, 16));
+        for c in 0..3 {
+            assert_eq!(planes.plane(c) as usize % ALIGN, 0);
+        }
+        assert_eq!(wide.plane(1) as usize % ALIGN, 0);
+        assert_eq!(bytes.as_ptr() as usize % ALIGN, 0);
+        assert_eq!(shorts.as_ptr() as usize % ALIGN, 0);
+
+        assert!(planes.iter().all(|&x| x == 0.0) && shorts.iter().all(|&x| x == 0));
+        bytes.fill(1);
+        planes.fill(2.0);
+        shorts.fill(3);
+        wide.fill(4.0);
+        assert!(bytes.iter().all(|&x| x == 1) && planes.iter().all(|&x| x == 2.0));
+        assert!(shorts.iter().all(|&x| x == 3) && wide.iter().all(|&x| x == 4.0));
+
+        let m = arena.memory(&Buf::default(), !0);
+        assert!(m.arena_bytes as usize >= plan.bytes() && m.arena_bytes as usize % PAGE == 0);
+        assert!(m.flags & sys::OA_RT_PREFAULT != 0 && m.host_scratch.is_null());
+    }
+
+    #[test]
+    fn memory_reuses_the_mapping_and_keeps_the_scratch() {
+        let mut m = Memory::default();
+        assert_eq!(m.set_host_scratch(sys::OA_HOST_SCRATCH_MAX + 1), sys::OA_ERR_INVALID_ARG);
+        assert_eq!(m.set_host_scratch(1000), sys::OA_OK);
+        assert!(memory(&m).is_none());
+
+        let mut plan = Plan::new();
+        let part = plan.buf::<f32>(256);
+        plan.reserve(64 << 10);
+        let mut first = m.map(plan, 0).unwrap().get(part);
+        first.fill(1.0);
+        let base = first.as_ptr();
+        drop(first);
+        let at = memory(&m).unwrap();
+        assert_eq!((at.arena_bytes, at.host_scratch_bytes), (64 << 10, 1000));
+        assert_eq!(at.host_scratch as usize % ALIGN, 0);
+        unsafe { *(at.host_scratch as *mut u8) = 7 };
+
+        // A smaller plan is cut again, zeroed, from the same mapping.
+        let mut plan = Plan::new();
+        let part = plan.buf::<f32>(1024);
+        let again = m.map(plan, 0).unwrap().get(part);
+        assert_eq!(again.as_ptr(), base);
+        assert!(again.iter().all(|&x| x == 0.0));
+        let now = memory(&m).unwrap();
+        assert_eq!((now.arena_bytes, now.host_scratch), (at.arena_bytes, at.host_scratch));
+        assert_eq!(unsafe { *(now.host_scratch as *const u8) }, 7);
+
+        // One that does not fit gets a new mapping; the old buffers keep theirs.
+        let mut plan = Plan::new();
+        let part = plan.buf::<f32>(32 << 10);
+        let bigger = m.map(plan, 0).unwrap().get(part);
+        assert_ne!(bigger.as_ptr(), base);
+        assert!(again.iter().all(|&x| x == 0.0));
+        let now = memory(&m).unwrap();
+        assert_eq!((now.arena_bytes, now.host_scratch), (128 << 10, at.host_scratch));
+
+        m.release();
+        assert!(memory(&m).is_none());
+        drop((again, bigger));
+    }
+}
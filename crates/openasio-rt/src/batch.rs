@@ -0,0 +1,183 @@
+//! Period descriptors for `host.process_batch` (`OA_CAP_BATCH`).
+//!
+//! A batched stream moves `count * frames` frames per wakeup through one pair of buffers.
+//! [`Batch`] cuts them into the `oa_batch_period` array the host gets, built once per
+//! stream, and fills one `oa_time_info` per period from the wakeup's single stamp.
+
+use crate::clock::{Stamp, StreamClock};
+use openasio_sys as sys;
+use std::ptr;
+
+/// What `set_batch_periods` accepts.
+pub fn valid(periods: u32) -> bool {
+    (1..=sys::OA_BATCH_MAX_PERIODS).contains(&periods)
+}
+
+/// Periods per wakeup for a stream: the host's request if it can take batches, else 1.
+/// mmap streams are never batched.
+pub fn effective(requested: u32, host: &sys::oa_host_callbacks, mmap: bool) -> u32 {
+    if host.process_batch.is_none() || mmap {
+        1
+    } else {
+        requested.clamp(1, sys::OA_BATCH_MAX_PERIODS)
+    }
+}
+
+pub struct Batch {
+    frames: u32,
+    periods: Vec<sys::oa_batch_period>,
+    times: Vec<sys::oa_time_info>,
+    // Plane pointers of every period, period-major; planar streams only.
+    in_planes: Vec<*mut u8>,
+    out_planes: Vec<*mut u8>,
+}
+
+impl Default for Batch {
+    fn default() -> Batch {
+        Batch { frames: 0, periods: Vec::new(), times: Vec::new(), in_planes: Vec::new(), out_planes: Vec::new() }
+    }
+}
+
+/// Plane pointers of `count` periods in buffers of `channels` planes `plane_bytes` apart.
+fn cut_planes((base, channels, plane_bytes): Side, count: usize, period_bytes: usize) -> Vec<*mut u8> {
+    (0..count)
+        .flat_map(|j| (0..channels).map(move |c| base.wrapping_add(c * plane_bytes + j * period_bytes)))
+        .collect()
+}
+
+/// A wakeup buffer: base, channels and the bytes from one channel's plane to the next.
+pub type Side = (*mut u8, usize, usize);
+
+impl Batch {
+    /// `count` periods of `frames` in the wakeup buffers `input` and `output`, each holding
+    /// `count * frames` frames of `(base, channels, stride)`: interleaved, or one plane per
+    /// channel if `planar`. A side without channels is passed to the host as NULL.
+    pub fn new(count: usize, frames: u32, sample_bytes: usize, planar: bool, input: Side, output: Side) -> Batch {
+        let period_bytes = frames as usize * sample_bytes;
+        // SAFETY: oa_time_info is plain numbers; every entry is rewritten by stamp().
+        let blank: sys::oa_time_info = unsafe { std::mem::zeroed() };
+        let mut b = Batch { frames, times: vec![blank; count], ..Default::default() };
+        if planar {
+            b.in_planes = cut_planes(input, count, period_bytes);
+            b.out_planes = cut_planes(output, count, period_bytes);
+        }
+        let side = |(base, channels, _): Side, planes: &[*mut u8], j: usize| -> *mut u8 {
+            if channels == 0 {
+                ptr::null_mut()
+            } else if planar {
+                planes[j * channels..].as_ptr() as *mut u8
+            } else {
+                base.wrapping_add(j * period_bytes * channels)
+            }
+        };
+        b.periods = (0..count)
+            .map(|j| sys::oa_batch_period {
+                in_: side(input, &b.in_planes, j) as *const _,
+                out: side(output, &b.out_planes, j) as *mut _,
+                frames,
+                reserved: 0,
+                time: &b.times[j],
+            })
+            .collect();
+        b
+    }
+
+    pub fn len(&self) -> usize {
+        self.periods.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.periods.is_empty()
+    }
+
+    /// Fills the time infos from the wakeup's `stamp` (see [`StreamClock::time_info`]), the
+    /// later periods as the loop predicts them, and moves the clock past the whole batch.
+    pub fn stamp(&mut self, clock: &mut StreamClock, stamp: Option<Stamp>, underruns: u32, overruns: u32) -> &mut [sys::oa_time_info] {
+        if let Some((first, rest)) = self.times.split_first_mut() {
+            *first = clock.time_info(stamp, underruns, overruns);
+            let mut prev = *first;
+            for ti in rest {
+                prev = clock.next_period(&prev, self.frames);
+                *ti = prev;
+            }
+        }
+        clock.advance(self.frames * self.periods.len() as u32);
+        &mut self.times
+    }
+
+    /// The array for `host.process_batch`, `len()` entries.
+    pub fn as_ptr(&self) -> *const sys::oa_batch_period {
+        self.periods.as_ptr()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::clock::Gap;
+
+    unsafe extern "C" fn batch(_: *mut std::os::raw::c_void, _: *const sys::oa_batch_period, _: u32, _: *const sys::oa_stream_config) -> sys::oa_bool {
+        sys::OA_TRUE
+    }
+
+    #[test]
+    fn batching_needs_the_callback_and_no_mmap() {
+        let mut host = sys::oa_host_callbacks { process: None, latency_changed: None, reset_request: None, devices_changed: None, process_batch: None };
+        assert_eq!(effective(4, &host, false), 1);
+        host.process_batch = Some(batch);
+        assert_eq!(effective(4, &host, false), 4);
+        assert_eq!(effective(4, &host, true), 1);
+        assert_eq!(effective(0, &host, false), 1);
+        assert_eq!(effective(1000, &host, false), sys::OA_BATCH_MAX_PERIODS);
+        assert!(!valid(0) && valid(1) && valid(sys::OA_BATCH_MAX_PERIODS) && !valid(sys::OA_BATCH_MAX_PERIODS + 1));
+    }
+
+    #[test]
+    fn interleaved_periods_follow_each_other() {
+        let mut input = vec![0u8; 3 * 64 * 2 * 4];
+        let (base, frames) = (input.as_mut_ptr(), 64u32);
+        let b = Batch::new(3, frames, 4, false, (base, 2, 0), (ptr::null_mut(), 0, 0));
+        assert_eq!(b.len(), 3);
+        let periods = unsafe { std::slice::from_raw_parts(b.as_ptr(), b.len()) };
+        for (j, p) in periods.iter().enumerate() {
+            assert_eq!(p.in_ as *const u8, base.wrapping_add(j * 64 * 2 * 4) as *const u8);
+            assert!(p.out.is_null());
+            assert_eq!(p.frames, frames);
+        }
+    }
+
+    #[test]
+    fn planar_periods_get_their_own_plane_pointers() {
+        let (count, frames, bytes, channels) = (4usize, 32u32, 2usize, 3usize);
+        let plane = count * frames as usize * bytes;
+        let mut output = vec![0u8; channels * plane];
+        let base = output.as_mut_ptr();
+        let b = Batch::new(count, frames, bytes, true, (ptr::null_mut(), 0, 0), (base, channels, plane));
+        let periods = unsafe { std::slice::from_raw_parts(b.as_ptr(), b.len()) };
+        for (j, p) in periods.iter().enumerate() {
+            assert!(p.in_.is_null());
+            let planes = unsafe { std::slice::from_raw_parts(p.out as *const *mut u8, channels) };
+            for (c, &pl) in planes.iter().enumerate() {
+                assert_eq!(pl, base.wrapping_add(c * plane + j * frames as usize * bytes));
+            }
+        }
+    }
+
+    #[test]
+    fn one_stamp_times_the_whole_batch() {
+        let mut b = Batch::new(3, 128, 4, false, (ptr::null_mut(), 0, 0), (ptr::null_mut(), 0, 0));
+        let mut clock = StreamClock::new(48000, 128);
+        clock.advance(1000);
+        clock.discontinuity(Gap { out_dropped: 7, ..Gap::default() });
+        let times = b.stamp(&mut clock, None, 1, 0).to_vec();
+        assert_eq!(times.iter().map(|t| t.frame_position).collect::<Vec<_>>(), [1000, 1128, 1256]);
+        // The recovery's cost and the xrun counts belong to the first period only.
+        assert_eq!((times[0].out_dropped, times[0].underruns), (7, 1));
+        assert_eq!(times[1].out_dropped, 0);
+        assert!(times[1].host_time_ns > times[0].host_time_ns && times[2].host_time_ns > times[1].host_time_ns);
+        assert_eq!(clock.position(), 1000 + 3 * 128);
+        // The periods point at the time infos stamp() filled.
+        let periods = unsafe { std::slice::from_raw_parts(b.as_ptr(), b.len()) };
+        assert_eq!(unsafe { (*periods[2].time).frame_position }, 1256);
+    }
+}
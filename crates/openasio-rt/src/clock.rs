@@ -0,0 +1,186 @@
+//! Stream timing for `oa_time_info`: frame position, period timestamps on CLOCK_MONOTONIC
+//! and the device's measured rate.
+//!
+//! Timestamps are smoothed by a second-order delay-locked loop (F. Adriaensen, "Using a DLL
+//! to filter time"), which removes DMA-position granularity and wake-up jitter and yields the
+//! device rate as a by-product.
+use openasio_sys as sys;
+use std::f64::consts::{PI, SQRT_2};
+use std::mem::size_of;
+
+/// Loop bandwidth. Low enough to reject period jitter, high enough to follow a thermal drift.
+const BANDWIDTH_HZ: f64 = 0.5;
+/// Periods fed to the loop before `rate_ratio` is reported as locked.
+const LOCK_PERIODS: u32 = 64;
+/// A measurement this many periods off the prediction restarts the loop (stall, xrun).
+const RESYNC_PERIODS: f64 = 2.0;
+
+pub fn monotonic_ns() -> u64 {
+    let mut ts = libc::timespec { tv_sec: 0, tv_nsec: 0 };
+    unsafe { libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts) };
+    timespec_ns(&ts)
+}
+
+pub fn timespec_ns(ts: &libc::timespec) -> u64 {
+    ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+}
+
+/// One measurement of the device position taken around the current period.
+#[derive(Clone, Copy, Debug)]
+pub struct Stamp {
+    /// CLOCK_MONOTONIC time of the measurement.
+    pub host_ns: u64,
+    /// Device clock at the same instant (audio timestamp), 0 if unknown.
+    pub device_ns: u64,
+    /// Where the converter was then, in frames after the period's first frame: positive for
+    /// capture (frames already sampled), negative for playback (queued frames, i.e. delay).
+    pub offset: i64,
+    /// `host_ns` comes from the device's hardware timestamp rather than a clock read.
+    pub hardware: bool,
+}
+
+/// Frames an xrun recovery cost the stream, for the `oa_time_info` of the next period.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct Gap {
+    /// Captured frames that never reached the host.
+    pub in_dropped: u32,
+    /// Host output the device discarded before playing it.
+    pub out_dropped: u32,
+    /// Device frames between two periods of host output: silence and stopped time.
+    pub out_inserted: u32,
+}
+
+impl Gap {
+    /// Adds `other` to this gap, saturating.
+    pub fn add(&mut self, other: Gap) {
+        self.in_dropped = self.in_dropped.saturating_add(other.in_dropped);
+        self.out_dropped = self.out_dropped.saturating_add(other.out_dropped);
+        self.out_inserted = self.out_inserted.saturating_add(other.out_inserted);
+    }
+}
+
+/// Frames in `ns` nanoseconds at `rate`, rounded.
+pub fn ns_frames(ns: u64, rate: u32) -> u32 {
+    ((ns as f64 * rate as f64 / 1e9).round()).min(u32::MAX as f64) as u32
+}
+
+pub struct StreamClock {
+    rate: f64,
+    period_ns: f64,
+    b: f64,
+    c: f64,
+    position: u64,
+    // Loop state: filtered time of frame `at`, and nanoseconds per device frame.
+    periods: u32,
+    at: u64,
+    t: f64,
+    spf: f64,
+    gap: Gap, // not yet reported
+}
+
+impl StreamClock {
+    pub fn new(sample_rate: u32, period_frames: u32) -> StreamClock {
+        let rate = sample_rate.max(1) as f64;
+        let w = 2.0 * PI * BANDWIDTH_HZ * period_frames.max(1) as f64 / rate;
+        StreamClock {
+            rate,
+            period_ns: period_frames.max(1) as f64 * 1e9 / rate,
+            b: SQRT_2 * w,
+            c: w * w,
+            position: 0,
+            periods: 0,
+            at: 0,
+            t: 0.0,
+            spf: 1e9 / rate,
+            gap: Gap::default(),
+        }
+    }
+
+    /// Frames handed to the host since start().
+    pub fn position(&self) -> u64 {
+        self.position
+    }
+
+    /// Forgets the loop state after a discontinuity (xrun, restart); position keeps counting.
+    pub fn resync(&mut self) {
+        self.periods = 0;
+        self.spf = 1e9 / self.rate;
+    }
+
+    /// An xrun cost the stream `gap`: reported with the next period, and the loop resyncs.
+    pub fn discontinuity(&mut self, gap: Gap) {
+        self.gap.add(gap);
+        self.resync();
+    }
+
+    /// Moves past a period of `frames` the host has processed.
+    pub fn advance(&mut self, frames: u32) {
+        self.position += frames as u64;
+    }
+
+    /// Time info for the period starting at `position()`. Without a stamp the host time is
+    /// the clock at the call and nothing is fed to the loop. Carries the [`Gap`]s reported
+    /// since the last call.
+    pub fn time_info(&mut self, stamp: Option<Stamp>, underruns: u32, overruns: u32) -> sys::oa_time_info {
+        let mut ti = sys::oa_time_info {
+            host_time_ns: monotonic_ns(),
+            device_time_ns: 0,
+            underruns,
+            overruns,
+            struct_size: size_of::<sys::oa_time_info>() as u32,
+            flags: 0,
+            frame_position: self.position,
+            rate_ratio: 1.0,
+            in_dropped: self.gap.in_dropped,
+            out_dropped: self.gap.out_dropped,
+            out_inserted: self.gap.out_inserted,
+        };
+        self.gap = Gap::default();
+        let Some(s) = stamp else { return ti; };
+        let first = s.host_ns as f64 - s.offset as f64 * self.spf;
+        self.track(first);
+        ti.host_time_ns = self.t.max(0.0) as u64;
+        if s.hardware {
+            ti.flags |= sys::OA_TIME_HW_TIMESTAMP;
+        }
+        if s.device_ns != 0 {
+            let dev = s.device_ns as f64 - s.offset as f64 * 1e9 / self.rate;
+            ti.device_time_ns = dev.max(0.0) as u64;
+            ti.flags |= sys::OA_TIME_DEVICE_TIME;
+        }
+        if self.periods >= LOCK_PERIODS {
+            ti.rate_ratio = 1e9 / (self.spf * self.rate);
+            ti.flags |= sys::OA_TIME_RATE_LOCKED;
+        }
+        ti
+    }
+
+    /// Time info for the period of `frames` that follows the one `ti` describes, as the loop
+    /// predicts it: for the later periods of a batch, which share the first one's stamp.
+    pub fn next_period(&self, ti: &sys::oa_time_info, frames: u32) -> sys::oa_time_info {
+        let mut next = *ti;
+        next.frame_position += frames as u64;
+        (next.in_dropped, next.out_dropped, next.out_inserted) = (0, 0, 0);
+        next.host_time_ns += (frames as f64 * self.spf) as u64;
+        if next.flags & sys::OA_TIME_DEVICE_TIME != 0 {
+            next.device_time_ns += (frames as f64 * 1e9 / self.rate) as u64;
+        }
+        next
+    }
+
+    // Feeds the measured time of frame `position` to the loop.
+    fn track(&mut self, measured: f64) {
+        let frames = self.position.wrapping_sub(self.at) as f64;
+        let predicted = self.t + frames * self.spf;
+        let err = measured - predicted;
+        if self.periods == 0 || frames <= 0.0 || err.abs() > RESYNC_PERIODS * self.period_ns {
+            self.resync();
+            self.t = measured;
+        } else {
+            self.t = predicted + self.b * err;
+            self.spf += self.c * err / frames;
+        }
+        self.at = self.position;
+        self.periods = self.periods.saturating_add(1);
+    }
+}
@@ -0,0 +1,438 @@
+//! Cached device list behind `enumerate_devices`, kept current by an inotify watch.
+//!
+//! A driver hands [`DeviceCache::new`] its scan. The cache runs it once, then again on a
+//! watcher thread whenever the watched directory (`/dev/snd` for ALSA) changes, and calls
+//! `host.devices_changed` when the result differs. Readers only take a short lock and never
+//! scan. A device keeps its id across rescans for as long as its name is listed.
+
+use openasio_sys as sys;
+use std::ffi::CString;
+use std::mem::size_of;
+use std::os::raw::c_void;
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+
+/// Where ALSA creates its device nodes.
+pub const ALSA_DEV_DIR: &str = "/dev/snd";
+
+/// Quiet time after the last event before rescanning: udev creates a card's nodes and
+/// then fixes up their permissions in one burst.
+const SETTLE_MS: i32 = 250;
+
+/// One device as a driver's scan reports it.
+#[derive(Clone, Debug, Default, PartialEq, Eq)]
+pub struct Device {
+    pub name: String,
+    pub description: String,
+    pub in_channels: u16,
+    pub out_channels: u16,
+    pub default: bool,
+}
+
+/// `host.devices_changed` with the host's `user` pointer.
+#[derive(Clone, Copy)]
+pub struct Notify {
+    pub cb: unsafe extern "C" fn(*mut c_void),
+    pub user: *mut c_void,
+}
+
+// SAFETY: the host registers the callback for use from driver threads.
+unsafe impl Send for Notify {}
+unsafe impl Sync for Notify {}
+
+impl Notify {
+    pub fn from_host(host: &sys::oa_host_callbacks, user: *mut c_void) -> Option<Notify> {
+        host.devices_changed.map(|cb| Notify { cb, user })
+    }
+}
+
+struct Entry {
+    id: u32,
+    dev: Device,
+}
+
+struct Shared {
+    list: Mutex<(Vec<Entry>, u32)>, // entries and the last id handed out
+    scan: Box<dyn Fn() -> Vec<Device> + Send + Sync>,
+    notify: Option<Notify>,
+}
+
+impl Shared {
+    /// Rescans and merges the result, keeping the ids of devices that are still there.
+    /// True if the list changed.
+    fn refresh(&self) -> bool {
+        let found = (self.scan)();
+        let mut guard = self.list.lock().unwrap_or_else(|e| e.into_inner());
+        let (list, last_id) = &mut *guard;
+        if list.len() == found.len() && list.iter().zip(&found).all(|(e, d)| e.dev == *d) {
+            return false;
+        }
+        let merged = found
+            .into_iter()
+            .map(|dev| {
+                let id = match list.iter().find(|e| e.dev.name == dev.name) {
+                    Some(e) => e.id,
+                    None => {
+                        *last_id += 1;
+                        *last_id
+                    }
+                };
+                Entry { id, dev }
+            })
+            .collect();
+        *list = merged;
+        true
+    }
+}
+
+pub struct DeviceCache {
+    shared: Arc<Shared>,
+    wake: i32, // eventfd that stops the watcher, -1 without one
+    watcher: Option<JoinHandle<()>>,
+}
+
+impl DeviceCache {
+    /// Scans once and starts watching `dir`. Without inotify the first scan is all there is.
+    pub fn new(
+        dir: &str,
+        scan: impl Fn() -> Vec<Device> + Send + Sync + 'static,
+        notify: Option<Notify>,
+    ) -> DeviceCache {
+        let shared = Arc::new(Shared {
+            list: Mutex::new((Vec::new(), 0)),
+            scan: Box::new(scan),
+            notify,
+        });
+        shared.refresh();
+        let mut cache = DeviceCache { shared, wake: -1, watcher: None };
+        if let Some(watch) = Watch::open(dir) {
+            let wake = watch.wake;
+            let shared = cache.shared.clone();
+            let spawned = std::thread::Builder::new()
+                .name("openasio-hotplug".into())
+                .spawn(move || watch.run(&shared));
+            match spawned {
+                Ok(handle) => {
+                    cache.wake = wake;
+                    cache.watcher = Some(handle);
+                }
+                Err(_) => unsafe {
+                    libc::close(wake);
+                },
+            }
+        }
+        cache
+    }
+
+    /// Newline-separated names, the `query_devices` format.
+    pub fn names(&self) -> String {
+        let guard = self.shared.list.lock().unwrap_or_else(|e| e.into_inner());
+        guard.0.iter().map(|e| e.dev.name.as_str()).collect::<Vec<_>>().join("\n")
+    }
+
+    /// Name of the entry flagged default, else the first one.
+    pub fn default_name(&self) -> Option<String> {
+        let guard = self.shared.list.lock().unwrap_or_else(|e| e.into_inner());
+        let list = &guard.0;
+        list.iter().find(|e| e.dev.default).or(list.first()).map(|e| e.dev.name.clone())
+    }
+
+    /// Fills a caller-sized `oa_device_info` array as `enumerate_devices` describes.
+    pub unsafe fn write(&self, out: *mut sys::oa_device_info, capacity: u32, count: *mut u32) -> sys::oa_result {
+        let guard = self.shared.list.lock().unwrap_or_else(|e| e.into_inner());
+        write(guard.0.iter().map(|e| (e.id, &e.dev)), out, capacity, count)
+    }
+}
+
+/// `enumerate_devices` for a driver that lists devices without a cache: `(id, device)` pairs.
+pub unsafe fn write<'a>(
+    list: impl ExactSizeIterator<Item = (u32, &'a Device)>,
+    out: *mut sys::oa_device_info,
+    capacity: u32,
+    count: *mut u32,
+) -> sys::oa_result {
+    if count.is_null() || (capacity > 0 && out.is_null()) {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    *count = list.len() as u32;
+    if capacity == 0 {
+        return sys::OA_OK;
+    }
+    let stride = (*out).struct_size as usize;
+    if stride < size_of::<u32>() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    for (i, (id, dev)) in list.take(capacity as usize).enumerate() {
+        let info = info_of(id, dev);
+        let dst = (out as *mut u8).add(i * stride);
+        std::ptr::copy_nonoverlapping(&info as *const _ as *const u8, dst, stride.min(size_of::<sys::oa_device_info>()));
+        *(dst as *mut u32) = stride as u32;
+    }
+    sys::OA_OK
+}
+
+impl Drop for DeviceCache {
+    fn drop(&mut self) {
+        if let Some(handle) = self.watcher.take() {
+            unsafe {
+                let one = 1u64;
+                libc::write(self.wake, &one as *const u64 as *const c_void, size_of::<u64>());
+            }
+            let _ = handle.join();
+            unsafe { libc::close(self.wake) };
+        }
+    }
+}
+
+fn info_of(id: u32, dev: &Device) -> sys::oa_device_info {
+    let mut info = sys::oa_device_info {
+        struct_size: size_of::<sys::oa_device_info>() as u32,
+        id,
+        flags: if dev.default { sys::OA_DEVICE_DEFAULT } else { 0 },
+        in_channels: dev.in_channels,
+        out_channels: dev.out_channels,
+        name: [0; sys::OA_DEVICE_NAME_MAX],
+        description: [0; sys::OA_DEVICE_NAME_MAX],
+    };
+    copy_str(&mut info.name, &dev.name);
+    copy_str(&mut info.description, &dev.description);
+    info
+}
+
+// NUL-terminated, cut at the last char that fits.
+fn copy_str(dst: &mut [std::os::raw::c_char], src: &str) {
+    let mut n = src.len().min(dst.len() - 1);
+    while !src.is_char_boundary(n) {
+        n -= 1;
+    }
+    for (d, s) in dst.iter_mut().zip(&src.as_bytes()[..n]) {
+        *d = *s as std::os::raw::c_char;
+    }
+    dst[n] = 0;
+}
+
+/// The watcher's inotify instance. If `dir` does not exist yet (no sound card so far) its
+/// parent is watched as well, and `dir` is added once something appears there.
+struct Watch {
+    inotify: i32,
+    wake: i32,
+    dir: CString,
+}
+
+enum Wake {
+    Event,
+    Timeout,
+    Stop,
+}
+
+const DIR_EVENTS: u32 = libc::IN_CREATE
+    | libc::IN_DELETE
+    | libc::IN_ATTRIB
+    | libc::IN_MOVED_FROM
+    | libc::IN_MOVED_TO
+    | libc::IN_DELETE_SELF;
+
+impl Watch {
+    fn open(dir: &str) -> Option<Watch> {
+        let cdir = CString::new(dir).ok()?;
+        unsafe {
+            let inotify = libc::inotify_init1(libc::IN_NONBLOCK | libc::IN_CLOEXEC);
+            if inotify < 0 {
+                return None;
+            }
+            let wake = libc::eventfd(0, libc::EFD_CLOEXEC);
+            if wake < 0 {
+                libc::close(inotify);
+                return None;
+            }
+            let watch = Watch { inotify, wake, dir: cdir };
+            if !watch.add_dir() {
+                let parent = std::path::Path::new(dir).parent().and_then(|p| p.to_str()).unwrap_or("/");
+                let cparent = CString::new(parent).ok()?;
+                if libc::inotify_add_watch(inotify, cparent.as_ptr(), libc::IN_CREATE | libc::IN_MOVED_TO) < 0 {
+                    libc::close(inotify);
+                    libc::close(wake);
+                    return None;
+                }
+            }
+            Some(watch)
+        }
+    }
+
+    fn add_dir(&self) -> bool {
+        unsafe { libc::inotify_add_watch(self.inotify, self.dir.as_ptr(), DIR_EVENTS) >= 0 }
+    }
+
+    fn run(self, shared: &Shared) {
+        'events: loop {
+            match self.wait(-1) {
+                Wake::Event => {}
+                Wake::Timeout => continue,
+                Wake::Stop => break,
+            }
+            loop {
+                match self.wait(SETTLE_MS) {
+                    Wake::Event => continue,
+                    Wake::Timeout => break,
+                    Wake::Stop => break 'events,
+                }
+            }
+            self.add_dir(); // no-op once watched; picks the directory up after it appears
+            if shared.refresh() {
+                if let Some(n) = shared.notify {
+                    unsafe { (n.cb)(n.user) };
+                }
+            }
+        }
+        unsafe { libc::close(self.inotify) };
+    }
+
+    // Waits for inotify events (draining them) or the stop signal.
+    fn wait(&self, timeout_ms: i32) -> Wake {
+        let mut fds = [
+            libc::pollfd { fd: self.inotify, events: libc::POLLIN, revents: 0 },
+            libc::pollfd { fd: self.wake, events: libc::POLLIN, revents: 0 },
+        ];
+        loop {
+            let rc = unsafe { libc::poll(fds.as_mut_ptr(), 2, timeout_ms) };
+            if rc < 0 {
+                if std::io::Error::last_os_error().raw_os_error() == Some(libc::EINTR) {
+                    continue;
+                }
+                return Wake::Stop;
+            }
+            if rc == 0 {
+                return Wake::Timeout;
+            }
+            if fds[1].revents != 0 {
+                return Wake::Stop;
+            }
+            let mut buf = [0u8; 4096];
+            while unsafe { libc::read(self.inotify, buf.as_mut_ptr() as *mut c_void, buf.len()) } > 0 {}
+            return Wake::Event;
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::ffi::CStr;
+    use std::mem::offset_of;
+    use std::sync::atomic::{AtomicU32, Ordering};
+    use std::time::{Duration, Instant};
+
+    fn dev(name: &str) -> Device {
+        Device { name: name.into(), description: format!("{name} card"), in_channels: 2, out_channels: 2, default: false }
+    }
+
+    /// A cache over a list the test changes, with the ids `write` reports.
+    struct Fixture {
+        found: Arc<Mutex<Vec<Device>>>,
+        cache: DeviceCache,
+    }
+
+    impl Fixture {
+        fn new(dir: &str, devices: Vec<Device>, notify: Option<Notify>) -> Fixture {
+            let found = Arc::new(Mutex::new(devices));
+            let scan = found.clone();
+            let cache = DeviceCache::new(dir, move || scan.lock().unwrap().clone(), notify);
+            Fixture { found, cache }
+        }
+
+        fn set(&self, devices: Vec<Device>) {
+            *self.found.lock().unwrap() = devices;
+        }
+
+        fn ids(&self) -> Vec<(u32, String)> {
+            let mut out: Vec<sys::oa_device_info> = (0..8).map(|_| info_of(0, &Device::default())).collect();
+            let mut count = 0;
+            assert_eq!(unsafe { self.cache.write(out.as_mut_ptr(), 8, &mut count) }, sys::OA_OK);
+            out[..count as usize]
+                .iter()
+                .map(|i| (i.id, unsafe { CStr::from_ptr(i.name.as_ptr()) }.to_str().unwrap().to_owned()))
+                .collect()
+        }
+    }
+
+    #[test]
+    fn a_device_keeps_its_id_while_it_is_listed() {
+        // No such directory or parent: no watcher, rescans only when the test asks.
+        let f = Fixture::new("/nonexistent-openasio/snd", vec![dev("a"), dev("b")], None);
+        assert!(f.cache.watcher.is_none());
+        assert_eq!(f.ids(), [(1, "a".into()), (2, "b".into())]);
+        assert!(!f.cache.shared.refresh());
+
+        f.set(vec![dev("b"), dev("c")]);
+        assert!(f.cache.shared.refresh());
+        assert_eq!(f.ids(), [(2, "b".into()), (3, "c".into())]);
+        // A device that went away comes back as a new one.
+        f.set(vec![dev("a")]);
+        assert!(f.cache.shared.refresh());
+        assert_eq!(f.ids(), [(4, "a".into())]);
+
+        // A changed description is a change too, with the id kept.
+        f.set(vec![Device { description: "renamed".into(), ..dev("a") }]);
+        assert!(f.cache.shared.refresh());
+        assert_eq!(f.ids(), [(4, "a".into())]);
+    }
+
+    #[test]
+    fn names_default_and_write_sizes() {
+        let f = Fixture::new("/nonexistent-openasio/snd", vec![dev("a"), Device { default: true, ..dev("b") }], None);
+        assert_eq!(f.cache.names(), "a\nb");
+        assert_eq!(f.cache.default_name().as_deref(), Some("b"));
+        f.set(vec![dev("x"), dev("y")]);
+        f.cache.shared.refresh();
+        assert_eq!(f.cache.default_name().as_deref(), Some("x"));
+
+        let mut count = 0;
+        assert_eq!(unsafe { f.cache.write(std::ptr::null_mut(), 0, &mut count) }, sys::OA_OK);
+        assert_eq!(count, 2);
+        // An older caller's struct, up to `flags`: entries are that far apart and no wider.
+        let stride = offset_of!(sys::oa_device_info, in_channels);
+        let mut raw = vec![0xeeu8; 2 * stride + 4];
+        unsafe { *(raw.as_mut_ptr() as *mut u32) = stride as u32 };
+        assert_eq!(unsafe { f.cache.write(raw.as_mut_ptr() as *mut _, 2, &mut count) }, sys::OA_OK);
+        let word = |at: usize| u32::from_ne_bytes(raw[at..at + 4].try_into().unwrap());
+        assert_eq!((word(0), word(4)), (stride as u32, 3));
+        assert_eq!((word(stride), word(stride + 4)), (stride as u32, 4));
+        assert_eq!(&raw[2 * stride..], [0xee; 4]);
+        unsafe { *(raw.as_mut_ptr() as *mut u32) = 2 };
+        assert_eq!(unsafe { f.cache.write(raw.as_mut_ptr() as *mut _, 1, &mut count) }, sys::OA_ERR_INVALID_ARG);
+    }
+
+    #[test]
+    fn long_names_are_cut_at_a_char() {
+        let mut name = [0; 8];
+        copy_str(&mut name, "abcdé€xyz");
+        let cut = unsafe { CStr::from_ptr(name.as_ptr()) };
+        assert_eq!(cut.to_str().unwrap(), "abcdé");
+    }
+
+    unsafe extern "C" fn changed(user: *mut c_void) {
+        (*(user as *const AtomicU32)).fetch_add(1, Ordering::SeqCst);
+    }
+
+    #[test]
+    fn a_hotplug_event_rescans_and_notifies() {
+        let dir = std::env::temp_dir().join(format!("openasio-hotplug-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let calls = Box::new(AtomicU32::new(0));
+        let notify = Notify { cb: changed, user: &*calls as *const AtomicU32 as *mut c_void };
+        let f = Fixture::new(dir.to_str().unwrap(), vec![dev("a")], Some(notify));
+        assert!(f.cache.watcher.is_some());
+
+        f.set(vec![dev("a"), dev("usb")]);
+        std::fs::write(dir.join("pcmC1D0p"), b"").unwrap();
+        let deadline = Instant::now() + Duration::from_secs(10);
+        while calls.load(Ordering::SeqCst) == 0 && Instant::now() < deadline {
+            std::thread::sleep(Duration::from_millis(20));
+        }
+        assert_eq!(calls.load(Ordering::SeqCst), 1);
+        assert_eq!(f.ids(), [(1, "a".into()), (2, "usb".into())]);
+
+        drop(f);
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+}
@@ -0,0 +1,369 @@
+//! Driver instances sharing RT threads, for processes that stream many devices at once.
+//!
+//! A stream normally runs on [`Worker::Thread`], its own RT thread. A [`Worker::shared`]
+//! stream instead joins one of a process-wide pool of loop threads. Each loop waits on the
+//! descriptors and deadlines of all its members with a single `ppoll` and services every
+//! ready member in turn, so N devices cost one wakeup per period instead of N unaligned ones,
+//! and their buffers stay in one core's cache. Members are [`Client`]s; the loop honours
+//! their [`Gate`] as their own thread would, parks them on pause and skips them while
+//! parked.
+//!
+//! Members are spread over as many loops as the driver asks for, least loaded first. Loop
+//! `i` of `n` takes the RT request of the first member to join it, pinned to the `i`-th CPU
+//! of its affinity mask when the mask names at least `n`. A loop exits when its last member
+//! leaves. Each driver library carries its own copy of this crate, so instances of one
+//! driver share loops with each other, not with those of another driver.
+use crate::gate::{futex_wait, futex_wake, Gate};
+use openasio_sys as sys;
+use std::cell::UnsafeCell;
+use std::ptr;
+use std::sync::atomic::{AtomicBool, AtomicPtr, AtomicU32, Ordering};
+use std::sync::{Arc, Mutex};
+use std::thread::JoinHandle;
+
+/// Members one loop carries.
+pub const MAX_CLIENTS: usize = 64;
+/// Loops in the pool.
+pub const MAX_LOOPS: usize = 16;
+
+/// What a member waits for before its next wakeup.
+pub enum Arm {
+    /// A wakeup can be serviced now.
+    Ready,
+    /// The descriptors it appended to `fds` have to fire first.
+    Wait,
+    /// Nothing to wait on before this CLOCK_MONOTONIC time (0: re-arm straight away).
+    At(u64),
+}
+
+/// One driver instance on a loop. Every call runs on the loop thread.
+pub trait Client: Send {
+    fn gate(&self) -> &Gate;
+    /// Readiness of the next wakeup; called only while the gate runs.
+    fn arm(&mut self, fds: &mut Vec<libc::pollfd>) -> Arm;
+    /// The loop's `ppoll` returned with events on the descriptors `arm` appended.
+    fn events(&mut self, _fds: &[libc::pollfd]) {}
+    /// One wakeup, after `arm` reported it ready.
+    fn service(&mut self);
+}
+
+/// The thread a stream runs on.
+pub enum Worker {
+    Thread(JoinHandle<()>),
+    Shared(Registration),
+}
+
+impl Worker {
+    /// Joins `client` to the least loaded of `loops` shared loops, starting it if need be.
+    /// Returns the RT setup the loop was granted. Not RT-safe.
+    pub fn shared(loops: u32, rt: Option<&sys::oa_rt_params>, client: Box<dyn Client>) -> Result<(Worker, sys::oa_rt_info), String> {
+        let loops = (loops as usize).clamp(1, MAX_LOOPS);
+        let mut pool = POOL.lock().unwrap_or_else(|e| e.into_inner());
+        if pool.len() < loops {
+            pool.resize_with(loops, || None);
+        }
+        let index = (0..loops).min_by_key(|&i| pool[i].as_ref().map_or(0, |e| e.clients)).unwrap_or(0);
+        if pool[index].is_none() {
+            pool[index] = Some(Entry::start(index, loops, rt)?);
+        }
+        let entry = pool[index].as_mut().unwrap();
+        // Only this side ever fills a slot, and only under the pool lock.
+        let Some(at) = entry.lp.slots.iter().find(|s| s.load(Ordering::Acquire).is_null()) else {
+            return Err(format!("shared loop {index} already runs {MAX_CLIENTS} streams"));
+        };
+        let slot = Box::into_raw(Box::new(Slot {
+            client: UnsafeCell::new(client),
+            leaving: AtomicBool::new(false),
+            attached: AtomicU32::new(1),
+        }));
+        at.store(slot, Ordering::Release);
+        entry.clients += 1;
+        entry.lp.kick();
+        let reg = Registration { lp: entry.lp.clone(), slot, index };
+        Ok((Worker::Shared(reg), entry.rt_info))
+    }
+
+    /// Wakes a shared loop so it sees a gate that was just opened; nothing for a thread.
+    pub fn wake(&self) {
+        if let Worker::Shared(reg) = self {
+            reg.lp.kick();
+        }
+    }
+
+    /// Waits until the stream's thread is done with it: joins its own thread (whose gate
+    /// must be stopped), or leaves the shared loop. Never call it from a loop's callbacks.
+    pub fn finish(self) {
+        match self {
+            Worker::Thread(handle) => {
+                let _ = handle.join();
+            }
+            Worker::Shared(reg) => reg.leave(),
+        }
+    }
+}
+
+/// A member's place on a shared loop.
+pub struct Registration {
+    lp: Arc<Loop>,
+    slot: *mut Slot,
+    index: usize,
+}
+
+impl Registration {
+    fn leave(self) {
+        let mut pool = POOL.lock().unwrap_or_else(|e| e.into_inner());
+        let slot = unsafe { &*self.slot };
+        slot.leaving.store(true, Ordering::Release);
+        self.lp.kick();
+        while slot.attached.load(Ordering::Acquire) != 0 {
+            futex_wait(&slot.attached, 1);
+        }
+        // SAFETY: the loop dropped its pointer before clearing `attached`.
+        drop(unsafe { Box::from_raw(self.slot) });
+        let Some(entry) = pool.get_mut(self.index).and_then(Option::as_mut) else { return };
+        entry.clients -= 1;
+        if entry.clients == 0 {
+            entry.lp.quit.store(true, Ordering::Release);
+            entry.lp.kick();
+            if let Some(thread) = entry.thread.take() {
+                let _ = thread.join();
+            }
+            pool[self.index] = None;
+        }
+    }
+}
+
+struct Slot {
+    client: UnsafeCell<Box<dyn Client>>,
+    leaving: AtomicBool,  // set by the control side; the loop lets go on its next pass
+    attached: AtomicU32,  // 1 until the loop has let go
+}
+
+struct Loop {
+    slots: [AtomicPtr<Slot>; MAX_CLIENTS],
+    wake: libc::c_int, // eventfd that breaks the loop's ppoll
+    quit: AtomicBool,
+}
+
+// SAFETY: a slot's client is only touched by the loop thread between attach and detach.
+unsafe impl Send for Loop {}
+unsafe impl Sync for Loop {}
+
+impl Loop {
+    fn kick(&self) {
+        let one = 1u64;
+        unsafe { libc::write(self.wake, &one as *const u64 as *const libc::c_void, 8) };
+    }
+}
+
+impl Drop for Loop {
+    fn drop(&mut self) {
+        unsafe { libc::close(self.wake) };
+    }
+}
+
+/// A running loop; only touched under the pool lock.
+struct Entry {
+    lp: Arc<Loop>,
+    thread: Option<JoinHandle<()>>,
+    rt_info: sys::oa_rt_info,
+    clients: usize,
+}
+
+static POOL: Mutex<Vec<Option<Entry>>> = Mutex::new(Vec::new());
+
+impl Entry {
+    fn start(index: usize, loops: usize, rt: Option<&sys::oa_rt_params>) -> Result<Entry, String> {
+        let wake = unsafe { libc::eventfd(0, libc::EFD_NONBLOCK | libc::EFD_CLOEXEC) };
+        if wake < 0 {
+            return Err(format!("eventfd: {}", std::io::Error::last_os_error()));
+        }
+        let lp = Arc::new(Loop {
+            slots: std::array::from_fn(|_| AtomicPtr::new(ptr::null_mut())),
+            wake,
+            quit: AtomicBool::new(false),
+        });
+        let req = rt.map(|r| pinned(r, index, loops));
+        let (rt_tx, rt_rx) = std::sync::mpsc::sync_channel(1);
+        let run_lp = lp.clone();
+        let thread = std::thread::Builder::new()
+            .name(format!("openasio-loop{index}"))
+            .spawn(move || {
+                let _ = rt_tx.send(crate::apply(req.as_ref()));
+                run(&run_lp);
+            })
+            .map_err(|e| e.to_string())?;
+        // Policy, affinity and locking are in place before the first member is serviced.
+        let rt_info = rt_rx.recv().map_err(|e| e.to_string())?;
+        Ok(Entry { lp, thread: Some(thread), rt_info, clients: 0 })
+    }
+}
+
+// `rt` for loop `index` of `loops`: on its own CPU of the mask if the mask has one for each.
+fn pinned(rt: &sys::oa_rt_params, index: usize, loops: usize) -> sys::oa_rt_params {
+    let cpus: Vec<usize> = (0..256).filter(|&c| rt.affinity.cpus[c / 64] >> (c % 64) & 1 != 0).collect();
+    if cpus.len() < loops {
+        return *rt;
+    }
+    let mut one = sys::oa_cpu_mask::default();
+    one.cpus[cpus[index] / 64] = 1 << (cpus[index] % 64);
+    sys::oa_rt_params { affinity: one, ..*rt }
+}
+
+// The loop thread: arms every running member, services the ready ones and otherwise
+// sleeps in one ppoll until a descriptor fires, a deadline passes or the control side
+// kicks it. Allocation-free after the first pass.
+fn run(lp: &Loop) {
+    let mut fds: Vec<libc::pollfd> = Vec::with_capacity(4 * MAX_CLIENTS + 1);
+    let mut spans = [(0usize, 0usize); MAX_CLIENTS];
+    while !lp.quit.load(Ordering::Acquire) {
+        fds.clear();
+        fds.push(libc::pollfd { fd: lp.wake, events: libc::POLLIN, revents: 0 });
+        let mut deadline = u64::MAX;
+        let mut serviced = false;
+        for (i, at) in lp.slots.iter().enumerate() {
+            spans[i] = (0, 0);
+            let p = at.load(Ordering::Acquire);
+            if p.is_null() {
+                continue;
+            }
+            let slot = unsafe { &*p };
+            if slot.leaving.load(Ordering::Acquire) {
+                at.store(ptr::null_mut(), Ordering::Release);
+                slot.attached.store(0, Ordering::Release);
+                futex_wake(&slot.attached);
+                continue;
+            }
+            let client = unsafe { &mut **slot.client.get() };
+            if !client.gate().ready() {
+                continue;
+            }
+            let start = fds.len();
+            match client.arm(&mut fds) {
+                Arm::Ready => {
+                    client.service();
+                    serviced = true;
+                }
+                Arm::Wait => spans[i] = (start, fds.len()),
+                Arm::At(t) => deadline = deadline.min(t),
+            }
+        }
+        // Whoever just ran may be due again already; arm everyone afresh first.
+        if serviced {
+            continue;
+        }
+        let timeout = if deadline == u64::MAX {
+            None
+        } else {
+            let left = deadline.saturating_sub(crate::clock::monotonic_ns());
+            if left == 0 {
+                continue;
+            }
+            Some(libc::timespec {
+                tv_sec: (left / 1_000_000_000) as libc::time_t,
+                tv_nsec: (left % 1_000_000_000) as libc::c_long,
+            })
+        };
+        let ts = timeout.as_ref().map_or(ptr::null(), |t| t as *const libc::timespec);
+        let n = unsafe { libc::ppoll(fds.as_mut_ptr(), fds.len() as libc::nfds_t, ts, ptr::null()) };
+        if n <= 0 {
+            continue;
+        }
+        if fds[0].revents != 0 {
+            let mut count = 0u64;
+            unsafe { libc::read(lp.wake, &mut count as *mut u64 as *mut libc::c_void, 8) };
+        }
+        for (i, &(a, b)) in spans.iter().enumerate() {
+            if a == b || fds[a..b].iter().all(|f| f.revents == 0) {
+                continue;
+            }
+            let p = lp.slots[i].load(Ordering::Acquire);
+            if !p.is_null() {
+                unsafe { (**(*p).client.get()).events(&fds[a..b]) };
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::time::Duration;
+
+    // A member woken every 200 us, counting its periods.
+    struct Ticker {
+        gate: Arc<Gate>,
+        periods: Arc<AtomicU32>,
+        due: u64,
+    }
+
+    impl Client for Ticker {
+        fn gate(&self) -> &Gate {
+            &self.gate
+        }
+        fn arm(&mut self, _fds: &mut Vec<libc::pollfd>) -> Arm {
+            if crate::clock::monotonic_ns() >= self.due { Arm::Ready } else { Arm::At(self.due) }
+        }
+        fn service(&mut self) {
+            self.periods.fetch_add(1, Ordering::Relaxed);
+            self.due = crate::clock::monotonic_ns() + 200_000;
+        }
+    }
+
+    fn advances(periods: &AtomicU32) -> bool {
+        let before = periods.load(Ordering::Relaxed);
+        std::thread::sleep(Duration::from_millis(20));
+        periods.load(Ordering::Relaxed) > before
+    }
+
+    fn index(worker: &Worker) -> usize {
+        match worker {
+            Worker::Shared(reg) => reg.index,
+            Worker::Thread(_) => unreachable!(),
+        }
+    }
+
+    fn running(index: usize) -> bool {
+        POOL.lock().unwrap().get(index).is_some_and(Option::is_some)
+    }
+
+    #[test]
+    fn members_join_and_leave() {
+        let members: Vec<(Arc<Gate>, Arc<AtomicU32>)> = (0..3).map(|_| Default::default()).collect();
+        let mut workers: Vec<Worker> = members
+            .iter()
+            .map(|(gate, periods)| {
+                let client = Ticker { gate: gate.clone(), periods: periods.clone(), due: 0 };
+                Worker::shared(2, None, Box::new(client)).unwrap().0
+            })
+            .collect();
+        // Least loaded first: the third member goes back to the first loop.
+        assert_eq!(workers.iter().map(index).collect::<Vec<_>>(), [0, 1, 0]);
+
+        for (worker, (gate, _)) in workers.iter().zip(&members) {
+            gate.run();
+            worker.wake();
+        }
+        assert!(members.iter().all(|(_, periods)| advances(periods)));
+
+        // A paused member parks and is skipped; the others on its loop carry on.
+        assert!(members[0].0.pause());
+        assert!(!advances(&members[0].1));
+        assert!(advances(&members[2].1));
+        members[0].0.run();
+        workers[0].wake();
+        assert!(advances(&members[0].1));
+
+        // Leaving drops the member at once, and the loop exits with its last member.
+        let last = workers.pop().unwrap();
+        last.finish();
+        assert_eq!(Arc::strong_count(&members[2].1), 1);
+        assert!(advances(&members[0].1));
+        assert!(running(0) && running(1));
+        workers.remove(1).finish();
+        assert!(!running(1));
+        workers.remove(0).finish();
+        assert!(!running(0));
+        assert!(members.iter().all(|(gate, periods)| Arc::strong_count(gate) == 1 && Arc::strong_count(periods) == 1));
+    }
+}
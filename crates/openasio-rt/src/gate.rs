@@ -0,0 +1,212 @@
+//! Run state of a driver's RT thread: running, parked or stopped.
+//!
+//! The control thread moves the state with [`Gate::run`], [`Gate::pause`] and
+//! [`Gate::stop`]; the RT thread calls [`Gate::proceed`] before every period. A parked
+//! thread sleeps in `futex(2)` until it is resumed or stopped, and [`Gate::pause`] returns
+//! only once the thread is parked, so the caller may then touch the PCMs: no period is in
+//! flight. A shared loop (`evloop`) holds many gates and checks each with [`Gate::ready`].
+
+use std::sync::atomic::{AtomicU32, Ordering};
+
+const STOPPED: u32 = 0;
+const RUNNING: u32 = 1;
+const PAUSING: u32 = 2; // asked to park after the current period
+const PARKED: u32 = 3;
+
+pub struct Gate(AtomicU32);
+
+impl Gate {
+    pub const fn new() -> Gate {
+        Gate(AtomicU32::new(STOPPED))
+    }
+
+    /// Lets the thread run periods.
+    pub fn run(&self) {
+        self.set(RUNNING);
+    }
+
+    /// Parks a thread that is about to be spawned, or one that is stopped.
+    pub fn park(&self) {
+        self.set(PARKED);
+    }
+
+    /// Makes [`Gate::proceed`] return false. Callable from the RT thread itself.
+    pub fn stop(&self) {
+        self.set(STOPPED);
+    }
+
+    /// Asks a running thread to park and waits until it has. False if the thread was not
+    /// running or stopped instead of parking.
+    pub fn pause(&self) -> bool {
+        if self.0.compare_exchange(RUNNING, PAUSING, Ordering::AcqRel, Ordering::Acquire).is_err() {
+            return false;
+        }
+        loop {
+            match self.0.load(Ordering::Acquire) {
+                PAUSING => futex_wait(&self.0, PAUSING),
+                state => return state == PARKED,
+            }
+        }
+    }
+
+    pub fn is_running(&self) -> bool {
+        self.0.load(Ordering::Acquire) == RUNNING
+    }
+
+    pub fn is_parked(&self) -> bool {
+        self.0.load(Ordering::Acquire) == PARKED
+    }
+
+    /// RT side, before each period: true to run it, false to exit. Sleeps while parked.
+    /// RT-safe while running (one atomic load).
+    pub fn proceed(&self) -> bool {
+        loop {
+            match self.0.load(Ordering::Acquire) {
+                RUNNING => return true,
+                PAUSING => {
+                    if self.0.compare_exchange(PAUSING, PARKED, Ordering::AcqRel, Ordering::Acquire).is_ok() {
+                        futex_wake(&self.0);
+                    }
+                }
+                PARKED => futex_wait(&self.0, PARKED),
+                _ => return false,
+            }
+        }
+    }
+
+    /// Shared-loop side of [`Gate::proceed`]: true to run a period now. Parks a pausing
+    /// stream but never sleeps, so one thread can serve many gates.
+    pub fn ready(&self) -> bool {
+        match self.0.load(Ordering::Acquire) {
+            RUNNING => true,
+            PAUSING => {
+                if self.0.compare_exchange(PAUSING, PARKED, Ordering::AcqRel, Ordering::Acquire).is_ok() {
+                    futex_wake(&self.0);
+                }
+                false
+            }
+            _ => false,
+        }
+    }
+
+    fn set(&self, state: u32) {
+        self.0.store(state, Ordering::Release);
+        futex_wake(&self.0);
+    }
+}
+
+impl Default for Gate {
+    fn default() -> Gate {
+        Gate::new()
+    }
+}
+
+// Sleeps while `word` holds `expected`; spurious returns are fine, callers re-check.
+pub(crate) fn futex_wait(word: &AtomicU32, expected: u32) {
+    unsafe {
+        libc::syscall(
+            libc::SYS_futex,
+            word.as_ptr(),
+            libc::FUTEX_WAIT | libc::FUTEX_PRIVATE_FLAG,
+            expected,
+            std::ptr::null::<libc::timespec>(),
+        );
+    }
+}
+
+pub(crate) fn futex_wake(word: &AtomicU32) {
+    unsafe {
+        libc::syscall(libc::SYS_futex, word.as_ptr(), libc::FUTEX_WAKE | libc::FUTEX_PRIVATE_FLAG, i32::MAX);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::AtomicU64;
+    use std::sync::Arc;
+    use std::time::Duration;
+
+    fn settles(periods: &AtomicU64) -> bool {
+        let before = periods.load(Ordering::Relaxed);
+        std::thread::sleep(Duration::from_millis(20));
+        periods.load(Ordering::Relaxed) == before
+    }
+
+    fn advances(periods: &AtomicU64) {
+        let before = periods.load(Ordering::Relaxed);
+        while periods.load(Ordering::Relaxed) < before + 3 {
+            std::thread::yield_now();
+        }
+    }
+
+    #[test]
+    fn a_parked_thread_runs_only_between_resume_and_pause() {
+        let (gate, periods) = (Arc::new(Gate::new()), Arc::new(AtomicU64::new(0)));
+        gate.park(); // prepared: spawned, but no period yet
+        let rt = {
+            let (gate, periods) = (gate.clone(), periods.clone());
+            std::thread::spawn(move || {
+                while gate.proceed() {
+                    periods.fetch_add(1, Ordering::Relaxed);
+                    std::thread::sleep(Duration::from_micros(200));
+                }
+            })
+        };
+        assert!(gate.is_parked() && settles(&periods) && periods.load(Ordering::Relaxed) == 0);
+        assert!(!gate.pause(), "only a running thread pauses");
+
+        for _ in 0..3 {
+            gate.run();
+            assert!(gate.is_running());
+            advances(&periods);
+            // Once pause() returns no period is in flight, and none starts until run().
+            assert!(gate.pause());
+            assert!(gate.is_parked() && settles(&periods));
+        }
+        gate.stop();
+        rt.join().unwrap();
+    }
+
+    #[test]
+    fn a_thread_that_stops_itself_fails_the_pause() {
+        let (gate, periods) = (Arc::new(Gate::new()), Arc::new(AtomicU64::new(0)));
+        gate.run();
+        let rt = {
+            let (gate, periods) = (gate.clone(), periods.clone());
+            std::thread::spawn(move || {
+                while gate.proceed() {
+                    periods.fetch_add(1, Ordering::Relaxed);
+                    std::thread::sleep(Duration::from_millis(5));
+                    gate.stop(); // process() returned false
+                }
+            })
+        };
+        while periods.load(Ordering::Relaxed) == 0 {
+            std::thread::yield_now();
+        }
+        assert!(!gate.pause());
+        rt.join().unwrap();
+        assert!(!gate.is_running() && !gate.is_parked());
+    }
+
+    #[test]
+    fn a_shared_loop_parks_without_sleeping() {
+        let gate = Gate::new();
+        assert!(!gate.ready());
+        gate.run();
+        assert!(gate.ready());
+        std::thread::scope(|s| {
+            let pausing = s.spawn(|| gate.pause());
+            while !gate.is_parked() {
+                // The loop parks the stream on its next pass and goes on serving others.
+                gate.ready();
+                std::thread::yield_now();
+            }
+            assert!(pausing.join().unwrap());
+        });
+        assert!(!gate.ready() && gate.is_parked());
+        gate.run();
+        assert!(gate.ready());
+    }
+}
@@ -0,0 +1,382 @@
+//! Realtime thread setup shared by the OpenASIO drivers (`oa_create_params.rt`).
+//!
+//! A driver copies the host's request in `openasio_driver_create` with [`requested`], runs
+//! [`apply`] first thing on its RT thread and hands the granted [`sys::oa_rt_info`] back to
+//! `start()` before the first `process` call; `get_rt_info` then answers with [`write_info`].
+//! [`clock`] fills the timing fields of `oa_time_info` on that thread, and [`stats`] keeps the
+//! telemetry behind `get_stream_stats`. [`ring`] carries frames between two device clocks,
+//! converted by [`resample`], which also adapts a device running at another rate.
+//! [`thread_params`] turns the granted info and the stream config into what
+//! `get_thread_params` reports to the host's worker pool, and [`space`] builds the answer
+//! to `query_config_space`. [`devices`] keeps the hotplug-tracked list behind
+//! `enumerate_devices`, and [`gate`] parks the RT thread of a prepared or paused stream.
+//! [`evloop`] lets many streams share a few RT threads instead of one each.
+//! [`batch`] cuts a batched stream's wakeup buffers into the periods of `process_batch`.
+//! [`arena`] holds every buffer of a stream in one aligned, pre-faulted mapping.
+//! [`tune`] searches and remembers the smallest period a device streams without xruns.
+#![allow(clippy::missing_safety_doc)]
+use openasio_sys as sys;
+use std::mem::{offset_of, size_of};
+
+pub mod arena;
+pub mod batch;
+pub mod clock;
+pub mod devices;
+pub mod evloop;
+pub mod gate;
+pub mod resample;
+pub mod ring;
+pub mod space;
+pub mod stats;
+pub mod tune;
+
+/// Stack touched by `OA_RT_PREFAULT`; covers the driver loop plus a typical host callback.
+const PREFAULT_STACK: usize = 256 * 1024;
+const PAGE: usize = 4096;
+
+/// The host's RT request, if `params` is new enough to carry one. Fields missing from an
+/// older (smaller) `oa_rt_params` keep their zero defaults.
+pub unsafe fn requested(params: &sys::oa_create_params) -> Option<sys::oa_rt_params> {
+    let end = offset_of!(sys::oa_create_params, rt) + size_of::<*const sys::oa_rt_params>();
+    if (params.struct_size as usize) < end || params.rt.is_null() {
+        return None;
+    }
+    let mut rt = sys::oa_rt_params::default();
+    let n = ((*params.rt).struct_size as usize).min(size_of::<sys::oa_rt_params>());
+    std::ptr::copy_nonoverlapping(params.rt as *const u8, &mut rt as *mut _ as *mut u8, n);
+    rt.struct_size = size_of::<sys::oa_rt_params>() as u32;
+    Some(rt)
+}
+
+/// Copy of the host's callbacks. Entries past the `host_size` the host declared (the 1.0
+/// layout if it declares none) are left `None`, so an older host is never read beyond its
+/// struct.
+pub unsafe fn host_callbacks(params: &sys::oa_create_params) -> sys::oa_host_callbacks {
+    let mut host = sys::oa_host_callbacks {
+        process: None,
+        latency_changed: None,
+        reset_request: None,
+        devices_changed: None,
+        process_batch: None,
+    };
+    if params.host.is_null() {
+        return host;
+    }
+    let size_end = offset_of!(sys::oa_create_params, host_size) + size_of::<u32>();
+    let declared = if (params.struct_size as usize) >= size_end && params.host_size != 0 {
+        params.host_size as usize
+    } else {
+        offset_of!(sys::oa_host_callbacks, devices_changed)
+    };
+    let n = declared.min(size_of::<sys::oa_host_callbacks>());
+    std::ptr::copy_nonoverlapping(params.host as *const u8, &mut host as *mut _ as *mut u8, n);
+    host
+}
+
+/// Applies `req` to the calling thread and reports what is in effect afterwards. Never
+/// fails: refused requests are left out of `flags` and the first errno lands in `error`.
+pub fn apply(req: Option<&sys::oa_rt_params>) -> sys::oa_rt_info {
+    let mut info = sys::oa_rt_info {
+        struct_size: size_of::<sys::oa_rt_info>() as u32,
+        ..Default::default()
+    };
+    let mut refuse = |err: i32| {
+        if info.error == 0 {
+            info.error = err;
+        }
+    };
+    let mut flags = 0;
+    if let Some(rt) = req {
+        if rt.affinity != sys::oa_cpu_mask::default() {
+            if let Err(e) = set_affinity(&rt.affinity) {
+                refuse(e);
+            }
+        }
+        if rt.policy != sys::OA_RT_POLICY_DEFAULT {
+            if let Err(e) = set_policy(rt.policy, rt.priority) {
+                refuse(e);
+            }
+        }
+        if rt.flags & sys::OA_RT_MLOCK != 0 {
+            if unsafe { libc::mlockall(libc::MCL_CURRENT | libc::MCL_FUTURE) } == 0 {
+                flags |= sys::OA_RT_MLOCK;
+            } else {
+                refuse(errno());
+            }
+        }
+        if rt.flags & sys::OA_RT_PREFAULT != 0 {
+            prefault_stack();
+            flags |= sys::OA_RT_PREFAULT;
+        }
+        if rt.flags & sys::OA_RT_FTZ_DAZ != 0 {
+            if enable_ftz_daz() {
+                flags |= sys::OA_RT_FTZ_DAZ;
+            } else {
+                refuse(libc::ENOTSUP);
+            }
+        }
+    }
+    info.flags = flags;
+    let (policy, priority) = current_policy();
+    info.policy = policy;
+    info.priority = priority;
+    info.affinity = current_affinity();
+    info
+}
+
+/// Copies `info` into a caller-sized `oa_rt_info`, setting `struct_size` to what it filled.
+pub unsafe fn write_info(info: &sys::oa_rt_info, out: *mut sys::oa_rt_info) -> sys::oa_result {
+    write_sized(info, out)
+}
+
+/// The RT thread's side of `get_thread_params`: scheduling from `info` (DEFAULT when the
+/// driver does not own its thread) and the deadline of one `frames` period at `rate`.
+pub fn thread_params(info: Option<&sys::oa_rt_info>, rate: u32, frames: u32) -> sys::oa_thread_params {
+    let mut p = sys::oa_thread_params {
+        struct_size: size_of::<sys::oa_thread_params>() as u32,
+        period_frames: frames,
+        sample_rate: rate,
+        ..Default::default()
+    };
+    if rate > 0 {
+        p.period_ns = frames as u64 * 1_000_000_000 / rate as u64;
+    }
+    if let Some(info) = info {
+        p.policy = info.policy;
+        p.priority = info.priority;
+        p.flags = info.flags;
+        p.affinity = info.affinity;
+    }
+    p
+}
+
+/// Copies `params` into a caller-sized `oa_thread_params`, setting `struct_size` to what it filled.
+pub unsafe fn write_thread_params(params: &sys::oa_thread_params, out: *mut sys::oa_thread_params) -> sys::oa_result {
+    write_sized(params, out)
+}
+
+/// The ABI structs lead with `struct_size`; a smaller (older) caller gets the prefix it knows,
+/// and every caller gets back in `struct_size` the bytes that were filled.
+pub(crate) unsafe fn write_sized<T>(src: &T, out: *mut T) -> sys::oa_result {
+    if out.is_null() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let want = *(out as *const u32) as usize;
+    if want < size_of::<u32>() {
+        return sys::OA_ERR_INVALID_ARG;
+    }
+    let n = want.min(size_of::<T>());
+    std::ptr::copy_nonoverlapping(src as *const T as *const u8, out as *mut u8, n);
+    *(out as *mut u32) = n as u32;
+    sys::OA_OK
+}
+
+fn errno() -> i32 {
+    std::io::Error::last_os_error().raw_os_error().unwrap_or(libc::EINVAL)
+}
+
+fn set_affinity(mask: &sys::oa_cpu_mask) -> Result<(), i32> {
+    unsafe {
+        let mut set: libc::cpu_set_t = std::mem::zeroed();
+        for cpu in 0..256usize {
+            if mask.cpus[cpu / 64] & (1u64 << (cpu % 64)) != 0 {
+                libc::CPU_SET(cpu, &mut set);
+            }
+        }
+        if libc::sched_setaffinity(0, size_of::<libc::cpu_set_t>(), &set) == 0 {
+            Ok(())
+        } else {
+            Err(errno())
+        }
+    }
+}
+
+fn current_affinity() -> sys::oa_cpu_mask {
+    let mut mask = sys::oa_cpu_mask::default();
+    unsafe {
+        let mut set: libc::cpu_set_t = std::mem::zeroed();
+        if libc::sched_getaffinity(0, size_of::<libc::cpu_set_t>(), &mut set) == 0 {
+            for cpu in 0..256usize {
+                if libc::CPU_ISSET(cpu, &set) {
+                    mask.cpus[cpu / 64] |= 1u64 << (cpu % 64);
+                }
+            }
+        }
+    }
+    mask
+}
+
+fn set_policy(policy: u32, priority: i32) -> Result<(), i32> {
+    let native = match policy {
+        sys::OA_RT_POLICY_FIFO => libc::SCHED_FIFO,
+        sys::OA_RT_POLICY_RR => libc::SCHED_RR,
+        sys::OA_RT_POLICY_OTHER => libc::SCHED_OTHER,
+        _ => return Err(libc::EINVAL),
+    };
+    unsafe {
+        let (lo, hi) = (libc::sched_get_priority_min(native), libc::sched_get_priority_max(native));
+        let param = libc::sched_param {
+            sched_priority: priority.clamp(lo, hi),
+        };
+        match libc::pthread_setschedparam(libc::pthread_self(), native, &param) {
+            0 => Ok(()),
+            e => Err(e),
+        }
+    }
+}
+
+fn current_policy() -> (u32, i32) {
+    unsafe {
+        let mut native = 0;
+        let mut param: libc::sched_param = std::mem::zeroed();
+        if libc::pthread_getschedparam(libc::pthread_self(), &mut native, &mut param) != 0 {
+            return (sys::OA_RT_POLICY_DEFAULT, 0);
+        }
+        let policy = match native {
+            libc::SCHED_FIFO => sys::OA_RT_POLICY_FIFO,
+            libc::SCHED_RR => sys::OA_RT_POLICY_RR,
+            _ => sys::OA_RT_POLICY_OTHER,
+        };
+        (policy, param.sched_priority)
+    }
+}
+
+/// Commits the stack pages the RT thread will run on so the first periods take no faults.
+#[inline(never)]
+fn prefault_stack() {
+    let mut stack = [0u8; PREFAULT_STACK];
+    for i in (0..PREFAULT_STACK).step_by(PAGE) {
+        unsafe { std::ptr::write_volatile(&mut stack[i], 1) };
+    }
+    std::hint::black_box(&stack);
+}
+
+/// Sets FTZ and DAZ for the calling thread (x86 MXCSR bits 15 and 6, Arm FPCR.FZ).
+fn enable_ftz_daz() -> bool {
+    #[cfg(any(target_arch = "x86_64", target_arch = "x86"))]
+    unsafe {
+        let mut csr: u32 = 0;
+        std::arch::asm!("stmxcsr [{}]", in(reg) &mut csr, options(nostack, preserves_flags));
+        csr |= 0x8040;
+        std::arch::asm!("ldmxcsr [{}]", in(reg) &csr, options(nostack, preserves_flags, readonly));
+        true
+    }
+    #[cfg(target_arch = "aarch64")]
+    unsafe {
+        let mut fpcr: u64;
+        std::arch::asm!("mrs {}, fpcr", out(reg) fpcr, options(nomem, nostack, preserves_flags));
+        fpcr |= 1 << 24;
+        std::arch::asm!("msr fpcr, {}", in(reg) fpcr, options(nomem, nostack, preserves_flags));
+        true
+    }
+    #[cfg(not(any(target_arch = "x86_64", target_arch = "x86", target_arch = "aarch64")))]
+    false
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn params() -> sys::oa_thread_params {
+        sys::oa_thread_params { struct_size: 0, priority: 7, period_frames: 128, sample_rate: 48000, ..Default::default() }
+    }
+
+    #[test]
+    fn write_sized_reports_what_it_filled() {
+        // A newer caller's larger struct: the fields past ours stay untouched.
+        #[repr(C)]
+        struct Newer {
+            known: sys::oa_thread_params,
+            extra: u64,
+        }
+        let mut newer = Newer { known: params(), extra: 0x5a5a };
+        newer.known.struct_size = size_of::<Newer>() as u32;
+        newer.known.sample_rate = 0;
+        assert_eq!(unsafe { write_thread_params(&params(), &mut newer.known) }, sys::OA_OK);
+        assert_eq!(newer.known.struct_size as usize, size_of::<sys::oa_thread_params>());
+        assert_eq!((newer.known.sample_rate, newer.extra), (48000, 0x5a5a));
+
+        // An older caller's prefix, up to `flags`: nothing past it is written.
+        let mut older = sys::oa_thread_params { struct_size: 16, ..Default::default() };
+        assert_eq!(unsafe { write_thread_params(&params(), &mut older) }, sys::OA_OK);
+        assert_eq!((older.struct_size, older.priority, older.period_frames), (16, 7, 0));
+
+        let mut bad = sys::oa_thread_params { struct_size: 2, ..Default::default() };
+        assert_eq!(unsafe { write_thread_params(&params(), &mut bad) }, sys::OA_ERR_INVALID_ARG);
+        assert_eq!(unsafe { write_thread_params(&params(), std::ptr::null_mut()) }, sys::OA_ERR_INVALID_ARG);
+    }
+
+    unsafe extern "C" fn changed(_: *mut std::os::raw::c_void) {}
+
+    fn create(host: &sys::oa_host_callbacks, struct_size: usize, host_size: u32) -> sys::oa_create_params {
+        sys::oa_create_params {
+            struct_size: struct_size as u32,
+            host,
+            host_user: std::ptr::null_mut(),
+            rt: std::ptr::null(),
+            host_size,
+        }
+    }
+
+    #[test]
+    fn host_callbacks_are_read_as_far_as_the_host_declared() {
+        let host = sys::oa_host_callbacks {
+            process: None,
+            latency_changed: None,
+            reset_request: Some(changed),
+            devices_changed: Some(changed),
+            process_batch: None,
+        };
+        let full = size_of::<sys::oa_create_params>();
+        let with_devices = offset_of!(sys::oa_host_callbacks, process_batch) as u32;
+        let copy = unsafe { host_callbacks(&create(&host, full, with_devices)) };
+        assert!(copy.reset_request.is_some() && copy.devices_changed.is_some());
+
+        // 1.0 params carry no host_size, and a 1.1 host may leave it 0: the 1.0 callbacks only.
+        let v10 = offset_of!(sys::oa_create_params, rt);
+        for params in [create(&host, v10, with_devices), create(&host, full, 0)] {
+            let copy = unsafe { host_callbacks(&params) };
+            assert!(copy.reset_request.is_some() && copy.devices_changed.is_none());
+        }
+        let bigger = size_of::<sys::oa_host_callbacks>() as u32 + 64;
+        assert!(unsafe { host_callbacks(&create(&host, full, bigger)) }.devices_changed.is_some());
+        let none = sys::oa_create_params { host: std::ptr::null(), ..create(&host, full, 0) };
+        assert!(unsafe { host_callbacks(&none) }.reset_request.is_none());
+    }
+
+    #[test]
+    fn rt_request_is_read_as_far_as_the_host_sized_it() {
+        let host = sys::oa_host_callbacks {
+            process: None,
+            latency_changed: None,
+            reset_request: None,
+            devices_changed: None,
+            process_batch: None,
+        };
+        let full = sys::oa_rt_params {
+            struct_size: size_of::<sys::oa_rt_params>() as u32,
+            policy: sys::OA_RT_POLICY_FIFO,
+            priority: 70,
+            flags: sys::OA_RT_MLOCK,
+            affinity: sys::oa_cpu_mask { cpus: [0b10, 0, 0, 0] },
+        };
+        let mut params = create(&host, size_of::<sys::oa_create_params>(), 0);
+        assert!(unsafe { requested(&params) }.is_none());
+        params.rt = &full;
+        let got = unsafe { requested(&params) }.unwrap();
+        assert_eq!((got.policy, got.priority, got.flags, got.affinity), (full.policy, 70, full.flags, full.affinity));
+
+        // An older request without flags and affinity: those stay at their defaults, and
+        // the copy reports our size.
+        let older = sys::oa_rt_params { struct_size: offset_of!(sys::oa_rt_params, flags) as u32, ..full };
+        params.rt = &older;
+        let got = unsafe { requested(&params) }.unwrap();
+        assert_eq!((got.policy, got.priority), (full.policy, 70));
+        assert_eq!((got.flags, got.affinity), (0, sys::oa_cpu_mask::default()));
+        assert_eq!(got.struct_size as usize, size_of::<sys::oa_rt_params>());
+
+        // 1.0 create params end before `rt`: it is never looked at.
+        params.struct_size = offset_of!(sys::oa_create_params, rt) as u32;
+        assert!(unsafe { requested(&params) }.is_none());
+    }
+}
@@ -0,0 +1,162 @@
+//! Owned handle on the SDK's sample-rate converter (`openasio_resample.h`) for drivers whose
+//! device runs at another rate than the stream, or whose two device clocks drift apart.
+//! Everything but [`Resampler::new`] and drop is RT-safe.
+use openasio_sys::resample as rs;
+use std::ptr;
+
+pub use rs::{OA_RESAMPLE_FAST as FAST, OA_RESAMPLE_HIGH as HIGH, OA_RESAMPLE_MEDIUM as MEDIUM};
+pub use rs::OA_RESAMPLE_MAX_RATIO as MAX_RATIO;
+
+pub struct Resampler {
+    r: *mut rs::oa_resampler,
+    channels: usize,
+}
+
+// SAFETY: the converter is plain memory owned by this handle; `&mut self` serializes use.
+unsafe impl Send for Resampler {}
+
+impl Resampler {
+    /// Converter of `channels` interleaved channels from `in_rate` to `out_rate`, whose
+    /// step [`set_trim`](Self::set_trim) can adjust if `variable`.
+    pub fn new(channels: usize, in_rate: u32, out_rate: u32, quality: rs::oa_resample_quality, variable: bool) -> Result<Resampler, String> {
+        let channels = channels.max(1);
+        let flags = if variable { rs::OA_RESAMPLE_VARIABLE } else { 0 };
+        let mut r = ptr::null_mut();
+        let rc = unsafe { rs::oa_resampler_create(channels as u32, in_rate, out_rate, quality, flags, &mut r) };
+        if rc != openasio_sys::OA_OK {
+            return Err(format!("no converter from {in_rate} Hz to {out_rate} Hz (rc={rc})"));
+        }
+        Ok(Resampler { r, channels })
+    }
+
+    pub fn channels(&self) -> usize {
+        self.channels
+    }
+
+    pub fn reset(&mut self) {
+        unsafe { rs::oa_resampler_reset(self.r) }
+    }
+
+    /// Input frames per output frame become the nominal ratio times `trim`; false if the
+    /// converter is fixed-ratio or `trim` is out of range.
+    pub fn set_trim(&mut self, trim: f64) -> bool {
+        unsafe { rs::oa_resampler_set_trim(self.r, trim) == openasio_sys::OA_OK }
+    }
+
+    /// Input frames the next [`process`](Self::process) needs for exactly `out_frames`.
+    pub fn input_for(&self, out_frames: usize) -> usize {
+        unsafe { rs::oa_resampler_input_for(self.r, out_frames) }
+    }
+
+    /// Converts interleaved `input` into `out` until either runs out; returns the frames
+    /// used of each.
+    pub fn process(&mut self, input: &[f32], out: &mut [f32]) -> (usize, usize) {
+        let (mut used, mut done) = (0, 0);
+        unsafe {
+            rs::oa_resampler_process(
+                self.r,
+                input.as_ptr(),
+                input.len() / self.channels,
+                &mut used,
+                out.as_mut_ptr(),
+                out.len() / self.channels,
+                &mut done,
+            )
+        };
+        (used, done)
+    }
+
+    /// Filter delay in output frames.
+    pub fn latency(&self) -> u32 {
+        unsafe { rs::oa_resampler_latency(self.r) }
+    }
+}
+
+impl Drop for Resampler {
+    fn drop(&mut self) {
+        unsafe { rs::oa_resampler_destroy(self.r) }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use openasio_sys::convert as cv;
+    use std::f64::consts::PI;
+
+    const PRESETS: [rs::oa_resample_quality; 3] = [FAST, MEDIUM, HIGH];
+
+    fn sine(rate: u32, hz: f64, amp: f64, frames: usize) -> Vec<f32> {
+        (0..frames).map(|i| (amp * (2.0 * PI * hz * i as f64 / rate as f64).sin()) as f32).collect()
+    }
+
+    fn convert(r: &mut Resampler, input: &[f32]) -> Vec<f32> {
+        let mut out = vec![0.0; input.len() * MAX_RATIO as usize];
+        let (used, done) = r.process(input, &mut out);
+        assert!(used <= input.len());
+        out.truncate(done);
+        out
+    }
+
+    // Largest deviation from the ideal tone once the filter has filled: distortion and
+    // noise together, passband ripple at 1 kHz being far below either.
+    fn thd_n(quality: rs::oa_resample_quality, in_rate: u32, out_rate: u32, trim: f64) -> f64 {
+        let mut r = Resampler::new(1, in_rate, out_rate, quality, trim != 1.0).unwrap();
+        if trim != 1.0 {
+            assert!(r.set_trim(trim));
+        }
+        let out = convert(&mut r, &sine(in_rate, 1000.0, 0.5, in_rate as usize));
+        assert!(out.len() > out_rate as usize / 2);
+        let ideal = |k: usize| 0.5 * (2.0 * PI * 1000.0 * k as f64 * trim / out_rate as f64).sin();
+        out.iter().enumerate().skip(1000).map(|(k, &y)| (y as f64 - ideal(k)).abs()).fold(0.0, f64::max)
+    }
+
+    #[test]
+    fn simd_matches_scalar() {
+        let input: Vec<f32> = (0..4 * 8192).map(|i| ((i * 7919 % 2003) as f32 / 1001.5) - 1.0).collect();
+        let level = unsafe { cv::oa_convert_simd_level() };
+        for &q in &PRESETS {
+            for &(from, to, variable) in &[(44100, 48000, false), (96000, 44100, false), (48000, 48000, true)] {
+                let run = |lvl| {
+                    unsafe { cv::oa_convert_set_simd_level(lvl) };
+                    let mut r = Resampler::new(4, from, to, q, variable).unwrap();
+                    if variable {
+                        assert!(r.set_trim(0.9993));
+                    }
+                    convert(&mut r, &input)
+                };
+                let reference = run(cv::OA_SIMD_SCALAR);
+                let simd = run(level);
+                assert_eq!(reference.len(), simd.len());
+                let worst = reference.iter().zip(&simd).map(|(a, b)| (a - b).abs()).fold(0.0, f32::max);
+                assert!(worst < 1e-5, "quality {q} {from}->{to}: {worst}");
+            }
+        }
+        unsafe { cv::oa_convert_set_simd_level(level) };
+    }
+
+    #[test]
+    fn distortion_drops_with_each_preset() {
+        for &(from, to, trim) in &[(44100, 48000, 1.0), (48000, 44100, 1.0), (48000, 48000, 1.001)] {
+            let got: Vec<f64> = PRESETS.iter().map(|&q| thd_n(q, from, to, trim)).collect();
+            assert!(got[0] < 1.5e-3 && got[1] < 2e-4 && got[2] < 1e-5, "{from}->{to}: {got:?}");
+            assert!(got[1] * 3.0 < got[0] && got[2] * 10.0 < got[1], "{from}->{to}: {got:?}");
+        }
+    }
+
+    #[test]
+    fn stopband_per_preset() {
+        // 96 -> 48 kHz: tones between 1.1 and 1.5 times the output's Nyquist frequency
+        // must not come through as aliases.
+        for (&q, limit) in PRESETS.iter().zip([-50.0, -70.0, -95.0]) {
+            for step in 0..5 {
+                let hz = 24000.0 * (1.1 + 0.1 * step as f64);
+                let mut r = Resampler::new(1, 96000, 48000, q, false).unwrap();
+                let out = convert(&mut r, &sine(96000, hz, 1.0, 96000));
+                let peak = out.iter().skip(500).map(|y| y.abs() as f64).fold(0.0, f64::max);
+                let db = 20.0 * (peak + 1e-12).log10();
+                assert!(db < limit, "quality {q} at {hz} Hz: {db:.1} dB");
+            }
+        }
+    }
+}
@@ -0,0 +1,252 @@
+//! Wait-free SPSC frame ring between two callbacks running on different device clocks
+//! (cpal's input and output streams, or the members of an aggregate device), and the
+//! drift-compensating reader that drains it on the consumer side.
+use crate::resample::{self, Resampler};
+use std::cell::UnsafeCell;
+use std::sync::atomic::{AtomicU32, AtomicUsize, Ordering};
+
+/// Producer and consumer indices live on separate cache lines.
+#[repr(align(64))]
+struct Padded(AtomicUsize);
+
+pub struct Ring {
+    buf: Box<[UnsafeCell<f32>]>,
+    channels: usize,
+    mask: usize,           // capacity in frames - 1
+    head: Padded,          // frames written; stored by the producer only
+    tail: Padded,          // frames consumed; stored by the consumer only
+    max_block: AtomicUsize, // largest push seen, sizes the reader's target fill
+}
+
+// SAFETY: the producer only writes frames in [head, tail + capacity) and the consumer only
+// reads [tail, head); the Release/Acquire pairs on head and tail order those accesses.
+unsafe impl Sync for Ring {}
+
+impl Ring {
+    /// Ring of at least `min_frames` interleaved frames (rounded up to a power of two).
+    pub fn new(channels: usize, min_frames: usize) -> Ring {
+        let channels = channels.max(1);
+        let cap = min_frames.max(2).next_power_of_two();
+        Ring {
+            buf: (0..cap * channels).map(|_| UnsafeCell::new(0.0)).collect(),
+            channels,
+            mask: cap - 1,
+            head: Padded(AtomicUsize::new(0)),
+            tail: Padded(AtomicUsize::new(0)),
+            max_block: AtomicUsize::new(0),
+        }
+    }
+
+    pub fn channels(&self) -> usize { self.channels }
+
+    fn capacity(&self) -> usize { self.mask + 1 }
+
+    fn samples(&self) -> *mut f32 { self.buf.as_ptr() as *mut f32 }
+
+    /// Producer: appends the whole frames in `src` and returns how many fit.
+    pub fn push(&self, src: &[f32]) -> usize {
+        let ch = self.channels;
+        let frames = src.len() / ch;
+        self.max_block.fetch_max(frames, Ordering::Relaxed);
+        let head = self.head.0.load(Ordering::Relaxed);
+        let tail = self.tail.0.load(Ordering::Acquire);
+        let n = frames.min(self.capacity() - head.wrapping_sub(tail));
+        let start = head & self.mask;
+        let first = n.min(self.capacity() - start);
+        unsafe {
+            std::ptr::copy_nonoverlapping(src.as_ptr(), self.samples().add(start * ch), first * ch);
+            std::ptr::copy_nonoverlapping(src.as_ptr().add(first * ch), self.samples(), (n - first) * ch);
+        }
+        self.head.0.store(head.wrapping_add(n), Ordering::Release);
+        n
+    }
+
+    /// Consumer: frames ready to read.
+    fn available(&self) -> usize {
+        self.head.0.load(Ordering::Acquire).wrapping_sub(self.tail.0.load(Ordering::Relaxed))
+    }
+
+    /// Consumer: the next `frames` frames as the one or two runs they occupy in the buffer.
+    /// `frames` must not exceed `available()`.
+    unsafe fn runs(&self, frames: usize) -> (&[f32], &[f32]) {
+        let ch = self.channels;
+        let start = self.tail.0.load(Ordering::Relaxed) & self.mask;
+        let first = frames.min(self.capacity() - start);
+        (
+            std::slice::from_raw_parts(self.samples().add(start * ch), first * ch),
+            std::slice::from_raw_parts(self.samples(), (frames - first) * ch),
+        )
+    }
+
+    fn consume(&self, frames: usize) {
+        let tail = self.tail.0.load(Ordering::Relaxed);
+        self.tail.0.store(tail.wrapping_add(frames), Ordering::Release);
+    }
+}
+
+/// Extra frames kept in the ring on top of one input and one output block.
+const GUARD_FRAMES: usize = 32;
+/// Largest rate trim (1000 ppm, about 1.7 cents): well above real crystal mismatch.
+const MAX_TRIM: f64 = 1000e-6;
+/// Proportional gain, ratio trim per frame of fill error (~2 s time constant at 48 kHz).
+const KP: f64 = 1e-5;
+/// Integral time of the controller; removes the steady fill offset a constant drift leaves.
+const TI_SECONDS: f64 = 8.0;
+/// Per-callback low-pass on the fill level, which saw-tooths with the input block size.
+const FILL_ALPHA: f64 = 0.02;
+
+/// Reads the ring at a rate trimmed to hold its fill level near a target, so the input
+/// device's clock drifting against the output device's neither starves nor floods it.
+/// Converts through a variable-ratio [`Resampler`], which also bridges an input device
+/// running at another nominal rate than the consumer; the trim never exceeds `MAX_TRIM`.
+pub struct DriftReader {
+    conv: Resampler,
+    ratio: f64, // nominal input frames per output frame
+    rate: f64,  // output rate
+    integ: f64, // integral part of the trim
+    fill: f64,  // low-passed fill level, input frames
+    priming: bool,
+    /// Low-passed fill plus the converter's delay, in output frames: the time input spends
+    /// between the ring and the consumer (for get_latency).
+    pub fill_frames: AtomicU32,
+}
+
+impl DriftReader {
+    /// Reader of `channels`-channel frames produced at `in_rate` and consumed at `out_rate`.
+    /// Allocates the converter, so not RT-safe.
+    pub fn new(channels: usize, in_rate: u32, out_rate: u32) -> Result<DriftReader, String> {
+        let conv = Resampler::new(channels, in_rate, out_rate, resample::MEDIUM, true)?;
+        Ok(DriftReader {
+            conv,
+            ratio: in_rate as f64 / out_rate as f64,
+            rate: out_rate as f64,
+            integ: 0.0,
+            fill: 0.0,
+            priming: true,
+            fill_frames: AtomicU32::new(0),
+        })
+    }
+
+    /// Consumer: writes `frames` interleaved frames to `dst`. Returns false on underflow;
+    /// `dst` is then silent and the reader waits for the target fill again. Silence while
+    /// the ring first fills up is not an underflow.
+    pub fn read(&mut self, ring: &Ring, dst: &mut [f32], frames: usize) -> bool {
+        let ch = ring.channels;
+        let dst = &mut dst[..frames * ch];
+        let target = ((frames as f64 * self.ratio).ceil() as usize + ring.max_block.load(Ordering::Relaxed) + GUARD_FRAMES) as f64;
+        let mut avail = ring.available();
+        if self.priming {
+            if (avail as f64) < target {
+                dst.fill(0.0);
+                return true;
+            }
+            self.priming = false;
+            self.fill = avail as f64;
+            self.conv.reset();
+        }
+        // Far above target (start-up, or the output stalled): drop the excess at once
+        // instead of slewing it out at MAX_TRIM.
+        if avail as f64 > 2.0 * target {
+            let excess = avail - target as usize;
+            ring.consume(excess);
+            avail -= excess;
+            self.fill = avail as f64;
+        }
+        self.fill += FILL_ALPHA * (avail as f64 - self.fill);
+        let err = self.fill - target;
+        self.integ = (self.integ + KP * err * frames as f64 / (TI_SECONDS * self.rate)).clamp(-MAX_TRIM, MAX_TRIM);
+        self.conv.set_trim(1.0 + (KP * err + self.integ).clamp(-MAX_TRIM, MAX_TRIM));
+
+        let need = self.conv.input_for(frames);
+        if avail < need {
+            dst.fill(0.0);
+            self.priming = true;
+            return false;
+        }
+        // The converter keeps its own history, so the ring's wrap point needs no overlap.
+        let (a, b) = unsafe { ring.runs(need) };
+        let (used_a, done_a) = self.conv.process(a, dst);
+        let (used_b, _) = self.conv.process(b, &mut dst[done_a * ch..]);
+        ring.consume(used_a + used_b);
+        let delay = self.fill / self.ratio + self.conv.latency() as f64;
+        self.fill_frames.store(delay.round() as u32, Ordering::Relaxed);
+        true
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn ring_keeps_frames_in_order_across_the_wrap() {
+        let ring = Ring::new(2, 6);
+        let src: Vec<f32> = (0..20).map(|i| i as f32).collect();
+        assert_eq!(ring.push(&src), 8);
+        assert_eq!(ring.push(&src[..2]), 0);
+        ring.consume(5);
+        assert_eq!(ring.push(&src[16..]), 2);
+        assert_eq!(ring.available(), 5);
+        let (a, b) = unsafe { ring.runs(5) };
+        assert_eq!((a.len(), b.len()), (6, 4));
+        assert_eq!([a, b].concat(), src[10..]);
+    }
+
+    // Output blocks of 256 frames against input blocks from a clock `ppm` off, which come
+    // a frame longer or shorter now and then.
+    fn stream(ppm: f64, seconds: usize) -> (Ring, DriftReader, Vec<usize>) {
+        let (ring, mut reader) = (Ring::new(1, 4096), DriftReader::new(1, 48000, 48000).unwrap());
+        let (mut out, mut owed, mut fills) = (vec![0.0; 256], 0.0, Vec::new());
+        for _ in 0..seconds * 48000 / 256 {
+            owed += 256.0 * (1.0 + ppm * 1e-6);
+            let block = owed.round() as usize;
+            assert_eq!(ring.push(&vec![0.5; block]), block, "ring flooded");
+            owed -= block as f64;
+            fills.push(ring.available());
+            assert!(reader.read(&ring, &mut out, 256), "ring starved");
+        }
+        (ring, reader, fills)
+    }
+
+    #[test]
+    fn drift_reader_holds_the_fill_near_its_target() {
+        for ppm in [-300.0, 0.0, 300.0] {
+            let (ring, reader, fills) = stream(ppm, 60);
+            // One output block, the largest input block and the guard, as the reader sees it.
+            let target = (256 + ring.max_block.load(Ordering::Relaxed) + GUARD_FRAMES) as f64;
+            let settled = &fills[fills.len() / 2..];
+            let mean = settled.iter().sum::<usize>() as f64 / settled.len() as f64;
+            assert!((mean - target).abs() < 16.0, "{ppm} ppm: mean fill {mean}, target {target}");
+            // get_latency's share: the smoothed fill plus the converter's delay.
+            let latency = reader.fill_frames.load(Ordering::Relaxed) as f64 - reader.conv.latency() as f64;
+            assert!((latency - target).abs() < 16.0, "{ppm} ppm: ring latency {latency}, target {target}");
+        }
+    }
+
+    #[test]
+    fn drift_reader_primes_drops_excess_and_reprimes_on_underflow() {
+        let (ring, mut reader) = (Ring::new(1, 4096), DriftReader::new(1, 48000, 48000).unwrap());
+        let mut out = vec![1.0; 256];
+        ring.push(&[0.5; 128]);
+        assert!(reader.read(&ring, &mut out, 256));
+        assert!(out.iter().all(|&x| x == 0.0), "silent while priming");
+        assert_eq!(ring.available(), 128);
+
+        // A backlog far over the target (256 + 128 + guard) is dropped in one step.
+        for _ in 0..20 {
+            ring.push(&[0.5; 128]);
+        }
+        assert!(reader.read(&ring, &mut out, 256));
+        // The target less the read, and the converter's look-ahead on a fresh start.
+        let target = 256 + 128 + GUARD_FRAMES;
+        assert!((target - 320..=target - 256).contains(&ring.available()), "{} frames left", ring.available());
+
+        ring.push(&[0.5; 128]);
+        assert!(reader.read(&ring, &mut out, 256));
+        out.fill(1.0);
+        assert!(!reader.read(&ring, &mut out, 256), "a drained ring underflows");
+        assert!(out.iter().all(|&x| x == 0.0));
+        ring.push(&[0.5; 256]);
+        assert!(reader.read(&ring, &mut out, 256), "priming again is not an underflow");
+    }
+}
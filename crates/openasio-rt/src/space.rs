@@ -0,0 +1,153 @@
+//! Builds the `oa_config_space` that `query_config_space` reports.
+//!
+//! A driver probes each direction of its device into a space of its own, combines them with
+//! [`narrow`] and then sets the channel masks, which differ per direction.
+
+use openasio_sys as sys;
+use std::mem::size_of;
+
+/// Rates a device is probed for, ascending. Fits in `OA_CONFIG_MAX_RATES`.
+pub const COMMON_RATES: &[u32] = &[
+    8000, 11025, 16000, 22050, 32000, 44100, 48000, 88200, 96000, 176400, 192000, 352800, 384000,
+];
+
+/// Nothing accepted yet; `struct_size` is set.
+pub fn empty() -> sys::oa_config_space {
+    sys::oa_config_space {
+        struct_size: size_of::<sys::oa_config_space>() as u32,
+        ..Default::default()
+    }
+}
+
+/// Channel-count mask with bits `min..=max`. Counts above 63 only show in `*_channels_max`.
+pub fn channel_bits(min: u32, max: u32) -> u64 {
+    (min..=max.min(63)).fold(0, |mask, n| mask | 1u64 << n)
+}
+
+/// Lists `rates` (ascending) in `space`. A discrete space also takes its bounds from them;
+/// a continuous one keeps the bounds the driver set.
+pub fn set_rates(space: &mut sys::oa_config_space, rates: impl IntoIterator<Item = u32>) {
+    space.rate_count = 0;
+    space.rates = [0; sys::OA_CONFIG_MAX_RATES];
+    for r in rates.into_iter().take(sys::OA_CONFIG_MAX_RATES) {
+        space.rates[space.rate_count as usize] = r;
+        space.rate_count += 1;
+    }
+    if space.flags & sys::OA_CONFIG_RATE_CONTINUOUS == 0 {
+        let listed = &space.rates[..space.rate_count as usize];
+        space.rate_min = listed.first().copied().unwrap_or(0);
+        space.rate_max = listed.last().copied().unwrap_or(0);
+    }
+}
+
+/// Whether `space` accepts `rate`.
+pub fn accepts_rate(space: &sys::oa_config_space, rate: u32) -> bool {
+    if space.flags & sys::OA_CONFIG_RATE_CONTINUOUS != 0 {
+        (space.rate_min..=space.rate_max).contains(&rate)
+    } else {
+        space.rates[..space.rate_count as usize].contains(&rate)
+    }
+}
+
+/// Keeps only what `other` accepts too: rates, buffer sizes, formats and layouts. Channel
+/// masks are left alone.
+pub fn narrow(space: &mut sys::oa_config_space, other: &sys::oa_config_space) {
+    let mut rates: Vec<u32> = space.rates[..space.rate_count as usize]
+        .iter()
+        .chain(&other.rates[..other.rate_count as usize])
+        .copied()
+        .filter(|&r| accepts_rate(space, r) && accepts_rate(other, r))
+        .collect();
+    rates.sort_unstable();
+    rates.dedup();
+    let both = space.flags & other.flags & sys::OA_CONFIG_RATE_CONTINUOUS;
+    space.flags = (space.flags & !sys::OA_CONFIG_RATE_CONTINUOUS) | both;
+    if both != 0 {
+        space.rate_min = space.rate_min.max(other.rate_min);
+        space.rate_max = space.rate_max.min(other.rate_max);
+    }
+    set_rates(space, rates);
+
+    space.buffer_frames_min = space.buffer_frames_min.max(other.buffer_frames_min);
+    space.buffer_frames_max = space.buffer_frames_max.min(other.buffer_frames_max);
+    space.buffer_frames_step = space.buffer_frames_step.max(other.buffer_frames_step);
+    space.native_formats &= other.native_formats;
+    space.supported_formats &= other.supported_formats;
+    space.layouts &= other.layouts;
+}
+
+/// Copies `space` into a caller-sized `oa_config_space`, setting `struct_size` to what it filled.
+pub unsafe fn write(space: &sys::oa_config_space, out: *mut sys::oa_config_space) -> sys::oa_result {
+    crate::write_sized(space, out)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn listed(space: &sys::oa_config_space) -> &[u32] {
+        &space.rates[..space.rate_count as usize]
+    }
+
+    fn discrete(rates: &[u32], frames: (u32, u32, u32), formats: u32) -> sys::oa_config_space {
+        let mut s = empty();
+        set_rates(&mut s, rates.iter().copied());
+        (s.buffer_frames_min, s.buffer_frames_max, s.buffer_frames_step) = frames;
+        (s.native_formats, s.supported_formats, s.layouts) = (formats, formats | 1, 0b11);
+        s
+    }
+
+    fn continuous(min: u32, max: u32) -> sys::oa_config_space {
+        let mut s = discrete(&[], (1, 65536, 1), !0);
+        s.flags = sys::OA_CONFIG_RATE_CONTINUOUS;
+        (s.rate_min, s.rate_max) = (min, max);
+        set_rates(&mut s, COMMON_RATES.iter().copied().filter(|r| (min..=max).contains(r)));
+        s
+    }
+
+    #[test]
+    fn rates_and_channel_masks() {
+        assert_eq!(channel_bits(1, 2), 0b110);
+        assert_eq!(channel_bits(0, 200), !0);
+        let d = discrete(&[44100, 48000, 96000], (64, 1024, 32), 0b1010);
+        assert_eq!((d.rate_min, d.rate_max), (44100, 96000));
+        assert!(accepts_rate(&d, 48000) && !accepts_rate(&d, 47999) && !accepts_rate(&d, 88200));
+        let c = continuous(1000, 768_000);
+        assert_eq!((c.rate_min, c.rate_max, listed(&c).len()), (1000, 768_000, COMMON_RATES.len()));
+        assert!(accepts_rate(&c, 47999) && !accepts_rate(&c, 999));
+        let many = discrete(&(1..100).map(|r| r * 1000).collect::<Vec<_>>(), (1, 1, 1), 0);
+        assert_eq!(many.rate_count as usize, sys::OA_CONFIG_MAX_RATES);
+    }
+
+    #[test]
+    fn narrowing_keeps_what_both_directions_accept() {
+        // Discrete against discrete: the common rates, tightest buffer bounds, shared formats.
+        let mut s = discrete(&[44100, 48000, 96000], (64, 1024, 32), 0b1010);
+        s.in_channels = 0b110;
+        narrow(&mut s, &discrete(&[48000, 96000, 192000], (32, 512, 64), 0b0110));
+        assert_eq!(listed(&s), [48000, 96000]);
+        assert_eq!((s.rate_min, s.rate_max, s.flags), (48000, 96000, 0));
+        assert_eq!((s.buffer_frames_min, s.buffer_frames_max, s.buffer_frames_step), (64, 512, 64));
+        assert_eq!((s.native_formats, s.supported_formats, s.layouts), (0b0010, 0b0011, 0b11));
+        assert_eq!(s.in_channels, 0b110, "channel masks are the driver's to set");
+
+        // Continuous against discrete: the listed rates inside the range, and discrete.
+        let mut s = continuous(8000, 96000);
+        narrow(&mut s, &discrete(&[44100, 48000, 192000], (1, 65536, 1), !0));
+        assert_eq!(listed(&s), [44100, 48000]);
+        assert_eq!((s.rate_min, s.rate_max, s.flags), (44100, 48000, 0));
+
+        // Continuous against continuous: the overlap, still continuous.
+        let mut s = continuous(8000, 96000);
+        narrow(&mut s, &continuous(22050, 768_000));
+        assert_eq!(s.flags, sys::OA_CONFIG_RATE_CONTINUOUS);
+        assert_eq!((s.rate_min, s.rate_max), (22050, 96000));
+        assert_eq!(listed(&s), [22050, 32000, 44100, 48000, 88200, 96000]);
+        assert!(accepts_rate(&s, 50000) && !accepts_rate(&s, 16000));
+
+        // Nothing in common: no rates at all.
+        let mut s = discrete(&[44100], (1, 1, 1), 0);
+        narrow(&mut s, &discrete(&[48000], (1, 1, 1), 0));
+        assert_eq!((s.rate_count, s.rate_min, s.rate_max), (0, 0, 0));
+    }
+}
@@ -0,0 +1,236 @@
+//! Lock-free stream telemetry behind `get_stream_stats`.
+//!
+//! Every field has a single writer (the RT thread, or for cpal the callback thread of the
+//! matching direction) and is updated with plain relaxed loads and stores, so recording never
+//! issues a locked instruction. Readers on other threads may see a snapshot that is a few
+//! fields apart, never a torn field.
+use crate::clock::monotonic_ns;
+use openasio_sys as sys;
+use std::mem::size_of;
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering::Relaxed};
+
+const BINS: usize = sys::OA_STATS_BINS;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Xrun {
+    /// Capture lost frames (EPIPE on read, or a full duplex ring).
+    Overrun,
+    /// Playback ran dry.
+    Underrun,
+}
+
+/// Log-linear bin of a duration: exact below 4 us, then 4 bins per octave.
+fn bin(ns: u64) -> usize {
+    let us = ns / 1000;
+    if us < 4 {
+        return us as usize;
+    }
+    let e = 63 - us.leading_zeros() as usize;
+    (4 * (e - 1) + ((us >> (e - 2)) & 3) as usize).min(BINS - 1)
+}
+
+fn bump(a: &AtomicU64, by: u64) {
+    a.store(a.load(Relaxed).wrapping_add(by), Relaxed);
+}
+
+pub struct StreamStats {
+    period_ns: AtomicU64,
+    callbacks: AtomicU64,
+    last_wake_ns: AtomicU64,
+    process_total: AtomicU64,
+    process_max: AtomicU64,
+    process_max_at: AtomicU64,
+    jitter_max: AtomicU64,
+    jitter_max_at: AtomicU64,
+    load_last: AtomicU32,
+    load_max: AtomicU32,
+    overruns: AtomicU32,
+    underruns: AtomicU32,
+    last_overrun: AtomicU64,
+    last_underrun: AtomicU64,
+    process_hist: [AtomicU64; BINS],
+    jitter_hist: [AtomicU64; BINS],
+}
+
+impl Default for StreamStats {
+    fn default() -> Self {
+        StreamStats {
+            period_ns: AtomicU64::new(0),
+            callbacks: AtomicU64::new(0),
+            last_wake_ns: AtomicU64::new(0),
+            process_total: AtomicU64::new(0),
+            process_max: AtomicU64::new(0),
+            process_max_at: AtomicU64::new(0),
+            jitter_max: AtomicU64::new(0),
+            jitter_max_at: AtomicU64::new(0),
+            load_last: AtomicU32::new(0),
+            load_max: AtomicU32::new(0),
+            overruns: AtomicU32::new(0),
+            underruns: AtomicU32::new(0),
+            last_overrun: AtomicU64::new(0),
+            last_underrun: AtomicU64::new(0),
+            process_hist: std::array::from_fn(|_| AtomicU64::new(0)),
+            jitter_hist: std::array::from_fn(|_| AtomicU64::new(0)),
+        }
+    }
+}
+
+impl StreamStats {
+    /// Clears everything for a new stream. Call from start() before the RT thread runs.
+    pub fn reset(&self, sample_rate: u32, period_frames: u32) {
+        let period = period_frames as u64 * 1_000_000_000 / sample_rate.max(1) as u64;
+        self.period_ns.store(period, Relaxed);
+        for a in [
+            &self.callbacks,
+            &self.last_wake_ns,
+            &self.process_total,
+            &self.process_max,
+            &self.process_max_at,
+            &self.jitter_max,
+            &self.jitter_max_at,
+            &self.last_overrun,
+            &self.last_underrun,
+        ] {
+            a.store(0, Relaxed);
+        }
+        for a in [&self.load_last, &self.load_max, &self.overruns, &self.underruns] {
+            a.store(0, Relaxed);
+        }
+        for a in self.process_hist.iter().chain(self.jitter_hist.iter()) {
+            a.store(0, Relaxed);
+        }
+    }
+
+    /// RT: call right before `host.process`; returns the start time for [`Self::end`].
+    pub fn begin(&self) -> u64 {
+        let now = monotonic_ns();
+        let last = self.last_wake_ns.load(Relaxed);
+        self.last_wake_ns.store(now, Relaxed);
+        if last != 0 {
+            let jitter = now.saturating_sub(last).abs_diff(self.period_ns.load(Relaxed));
+            bump(&self.jitter_hist[bin(jitter)], 1);
+            if jitter > self.jitter_max.load(Relaxed) {
+                self.jitter_max.store(jitter, Relaxed);
+                self.jitter_max_at.store(now, Relaxed);
+            }
+        }
+        now
+    }
+
+    /// RT: call right after `host.process` returned.
+    pub fn end(&self, start: u64) {
+        let took = monotonic_ns().saturating_sub(start);
+        bump(&self.callbacks, 1);
+        bump(&self.process_total, took);
+        bump(&self.process_hist[bin(took)], 1);
+        if took > self.process_max.load(Relaxed) {
+            self.process_max.store(took, Relaxed);
+            self.process_max_at.store(start, Relaxed);
+        }
+        let load = (took * 1000 / self.period_ns.load(Relaxed).max(1)).min(u32::MAX as u64) as u32;
+        self.load_last.store(load, Relaxed);
+        if load > self.load_max.load(Relaxed) {
+            self.load_max.store(load, Relaxed);
+        }
+    }
+
+    pub fn xrun(&self, kind: Xrun) {
+        let (count, at) = match kind {
+            Xrun::Overrun => (&self.overruns, &self.last_overrun),
+            Xrun::Underrun => (&self.underruns, &self.last_underrun),
+        };
+        count.store(count.load(Relaxed).wrapping_add(1), Relaxed);
+        at.store(monotonic_ns(), Relaxed);
+    }
+
+    pub fn overruns(&self) -> u32 {
+        self.overruns.load(Relaxed)
+    }
+
+    pub fn underruns(&self) -> u32 {
+        self.underruns.load(Relaxed)
+    }
+
+    /// Load of the last callback, in permille of the period.
+    pub fn load_last(&self) -> u32 {
+        self.load_last.load(Relaxed)
+    }
+
+    /// Snapshot into a caller-sized `oa_stream_stats`. Safe from any thread.
+    pub unsafe fn write(&self, out: *mut sys::oa_stream_stats) -> sys::oa_result {
+        if out.is_null() || ((*out).struct_size as usize) < size_of::<u32>() {
+            return sys::OA_ERR_INVALID_ARG;
+        }
+        // All fields are integers, so the zero pattern is a valid value.
+        let mut s: sys::oa_stream_stats = std::mem::zeroed();
+        s.bins = BINS as u32;
+        s.period_ns = self.period_ns.load(Relaxed);
+        s.callbacks = self.callbacks.load(Relaxed);
+        s.process_ns_total = self.process_total.load(Relaxed);
+        s.process_ns_max = self.process_max.load(Relaxed);
+        s.process_max_time_ns = self.process_max_at.load(Relaxed);
+        s.jitter_ns_max = self.jitter_max.load(Relaxed);
+        s.jitter_max_time_ns = self.jitter_max_at.load(Relaxed);
+        s.load_permille_last = self.load_last.load(Relaxed);
+        s.load_permille_max = self.load_max.load(Relaxed);
+        s.overruns = self.overruns.load(Relaxed);
+        s.underruns = self.underruns.load(Relaxed);
+        s.last_overrun_ns = self.last_overrun.load(Relaxed);
+        s.last_underrun_ns = self.last_underrun.load(Relaxed);
+        for i in 0..BINS {
+            s.process_hist[i] = self.process_hist[i].load(Relaxed);
+            s.jitter_hist[i] = self.jitter_hist[i].load(Relaxed);
+        }
+        let n = ((*out).struct_size as usize).min(size_of::<sys::oa_stream_stats>());
+        s.struct_size = n as u32;
+        std::ptr::copy_nonoverlapping(&s as *const _ as *const u8, out as *mut u8, n);
+        sys::OA_OK
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn snapshot(stats: &StreamStats) -> sys::oa_stream_stats {
+        let mut s: sys::oa_stream_stats = unsafe { std::mem::zeroed() };
+        s.struct_size = size_of::<sys::oa_stream_stats>() as u32;
+        assert_eq!(unsafe { stats.write(&mut s) }, sys::OA_OK);
+        s
+    }
+
+    #[test]
+    fn bins_are_exact_then_four_per_octave() {
+        let us = |n: u64| bin(n * 1000);
+        assert_eq!([0, 1, 2, 3].map(us), [0, 1, 2, 3]);
+        assert_eq!([4, 5, 6, 7, 8, 10, 12, 14, 16].map(us), [4, 5, 6, 7, 8, 9, 10, 11, 12]);
+        assert_eq!(bin(999), 0);
+        assert_eq!(us(u64::MAX / 1000), BINS - 1);
+        assert!((1..1 << 24).step_by(997).all(|n| us(n) <= us(n + 1)));
+    }
+
+    #[test]
+    fn callbacks_fill_the_histograms_and_reset_clears_them() {
+        let stats = StreamStats::default();
+        stats.reset(48000, 480); // 10 ms periods
+        for _ in 0..3 {
+            let start = stats.begin();
+            std::thread::sleep(std::time::Duration::from_millis(2));
+            stats.end(start);
+        }
+        stats.xrun(Xrun::Underrun);
+        let s = snapshot(&stats);
+        assert_eq!((s.bins, s.period_ns, s.callbacks), (BINS as u32, 10_000_000, 3));
+        assert_eq!(s.process_hist.iter().sum::<u64>(), 3);
+        assert_eq!(s.jitter_hist.iter().sum::<u64>(), 2, "no jitter before the second wakeup");
+        assert!(s.process_ns_max >= 2_000_000 && s.process_ns_total >= 3 * 2_000_000);
+        assert!(s.load_permille_max >= 200 && s.load_permille_last >= 200);
+        assert_eq!((s.overruns, s.underruns), (0, 1));
+        assert!(s.last_underrun_ns >= s.process_max_time_ns && s.last_overrun_ns == 0);
+
+        stats.reset(48000, 480);
+        let s = snapshot(&stats);
+        assert_eq!((s.callbacks, s.underruns, s.load_permille_max), (0, 0, 0));
+        assert!(s.process_hist.iter().chain(s.jitter_hist.iter()).all(|&n| n == 0));
+    }
+}
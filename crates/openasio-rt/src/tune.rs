@@ -0,0 +1,412 @@
+//! Latency autotuning: the smallest period (and period count) a machine streams without
+//! xruns, found at runtime and remembered per device.
+//!
+//! [`Tuner`] walks a ladder of [`Profile`]s ordered by latency. It starts at the bottom, or
+//! at the profile saved for the device, and the RT thread feeds it every wakeup. An xrun,
+//! or a window whose callbacks used more than [`LOAD_HIGH`] of the period, moves it one
+//! rung up and bans the rungs below for the rest of the stream. After [`SETTLE_WINDOWS`]
+//! clean windows it is settled, and the driver saves the profile with [`save`]. A stream
+//! started from a saved profile probes one rung down once it has run light for
+//! [`RELAX_WINDOWS`] windows.
+//!
+//! The RT thread only observes. A step is applied by the stream's [`Stepper`], a control
+//! thread that parks the worker, sets the device up again and lets it run, so a shared
+//! loop keeps serving its other streams meanwhile.
+//!
+//! Profiles live in `$XDG_STATE_HOME/openasio/latency-profiles` (`~/.local/state` if that is
+//! unset), one tab-separated line per driver, device and rate.
+
+use crate::gate::{futex_wait, futex_wake};
+use std::io::Write;
+use std::path::PathBuf;
+use std::sync::atomic::{AtomicU32, Ordering};
+use std::sync::Arc;
+use std::thread::JoinHandle;
+
+/// Observation window, in seconds of audio.
+const WINDOW_SECS: u64 = 2;
+pub const SETTLE_WINDOWS: u32 = 5;
+pub const RELAX_WINDOWS: u32 = 30;
+/// Callback load in permille of the period: above HIGH is too close to an xrun, below LOW
+/// leaves room for a smaller period.
+pub const LOAD_HIGH: u32 = 750;
+pub const LOAD_LOW: u32 = 250;
+
+const MIN_FRAMES: u32 = 16;
+const MAX_FRAMES: u32 = 4096;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct Profile {
+    /// Frames per period (the stream's buffer_frames).
+    pub frames: u32,
+    /// Periods in the device ring.
+    pub periods: u32,
+}
+
+pub struct Tuner {
+    rate: u32,
+    ladder: Vec<Profile>,
+    level: usize,
+    floor: usize,
+    settled: bool,
+    clean: u32,       // clean windows in a row
+    light: u32,       // of those, windows below LOAD_LOW in a row
+    window: u64,      // frames into the current window
+    window_load: u32, // highest load of the current window
+    xruns: u32,       // stream xruns already accounted for
+}
+
+impl Tuner {
+    /// A tuner for a stream at `rate` whose device takes ring sizes in `periods`
+    /// (ascending), starting from `saved` if there is one. The ladder holds every power of
+    /// two from 16 to 4096 frames with each period count, ordered by latency.
+    pub fn new(rate: u32, periods: &[u32], saved: Option<Profile>) -> Tuner {
+        let mut ladder = Vec::new();
+        let mut frames = MIN_FRAMES;
+        while frames <= MAX_FRAMES {
+            ladder.extend(periods.iter().map(|&p| Profile { frames, periods: p }));
+            frames *= 2;
+        }
+        ladder.sort_by_key(|p| p.frames as u64 * p.periods as u64);
+        let level = saved.and_then(|s| ladder.iter().position(|p| *p == s));
+        Tuner {
+            rate,
+            ladder,
+            level: level.unwrap_or(0),
+            floor: 0,
+            settled: level.is_some(),
+            clean: 0,
+            light: 0,
+            window: 0,
+            window_load: 0,
+            xruns: 0,
+        }
+    }
+
+    pub fn profile(&self) -> Profile {
+        self.ladder[self.level]
+    }
+
+    /// The longest period on the ladder: buffers sized for it fit every profile.
+    pub fn max_frames(&self) -> u32 {
+        self.ladder.iter().map(|p| p.frames).max().unwrap_or(MAX_FRAMES)
+    }
+
+    /// The profile has run clean long enough to be saved.
+    pub fn settled(&self) -> bool {
+        self.settled
+    }
+
+    fn step(&mut self, level: usize) -> Profile {
+        self.level = level;
+        self.clean = 0;
+        self.light = 0;
+        self.window = 0;
+        self.window_load = 0;
+        self.xruns = 0; // the driver resets its stats with the new config
+        self.ladder[level]
+    }
+
+    fn up(&mut self) -> Option<Profile> {
+        self.floor = self.level + 1;
+        self.settled = false;
+        (self.level + 1 < self.ladder.len()).then(|| self.step(self.level + 1))
+    }
+
+    /// RT: after every wakeup of `frames`, with the stream's xrun total so far and the load
+    /// of its last callback (permille). Returns the profile to switch to when the tuner
+    /// steps; the driver then reconfigures with it and resets its stats.
+    pub fn observe(&mut self, frames: u32, xruns: u32, load: u32) -> Option<Profile> {
+        if xruns != self.xruns {
+            self.xruns = xruns;
+            return self.up();
+        }
+        self.window_load = self.window_load.max(load);
+        self.window += frames as u64;
+        if self.window < self.rate as u64 * WINDOW_SECS {
+            return None;
+        }
+        let load = std::mem::take(&mut self.window_load);
+        self.window = 0;
+        if load > LOAD_HIGH {
+            return self.up();
+        }
+        self.clean += 1;
+        self.light = if load < LOAD_LOW { self.light + 1 } else { 0 };
+        if self.clean >= SETTLE_WINDOWS {
+            self.settled = true;
+        }
+        if self.settled && self.light >= RELAX_WINDOWS && self.level > self.floor {
+            self.settled = false;
+            return Some(self.step(self.level - 1));
+        }
+        None
+    }
+
+    /// The device refused the current profile: bans it and returns the next one up, if any.
+    pub fn refused(&mut self) -> Option<Profile> {
+        self.up()
+    }
+}
+
+const IDLE: u32 = 0;
+const DUE: u32 = 1; // the tuner stepped; the stream still runs the old profile
+const QUIT: u32 = 2;
+
+struct Handoff {
+    state: AtomicU32,
+    kicks: AtomicU32, // futex word of the stepper thread, bumped by every hand-off
+}
+
+impl Handoff {
+    fn set(&self, state: u32) {
+        self.state.store(state, Ordering::Release);
+        self.kick();
+    }
+
+    fn kick(&self) {
+        self.kicks.fetch_add(1, Ordering::AcqRel);
+        futex_wake(&self.kicks);
+    }
+}
+
+/// The thread that applies a running stream's tuner steps.
+pub struct Stepper {
+    handoff: Arc<Handoff>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl Stepper {
+    /// Starts the thread, idle. `step` applies the tuner's current profile to the stream:
+    /// true once it is done (or the stream is gone), false to be retried on the next
+    /// [`Stepper::kick`] because the stream is not running. Not RT-safe.
+    pub fn spawn(name: &str, mut step: impl FnMut() -> bool + Send + 'static) -> Result<Stepper, String> {
+        let handoff = Arc::new(Handoff { state: AtomicU32::new(IDLE), kicks: AtomicU32::new(0) });
+        let h = handoff.clone();
+        let thread = std::thread::Builder::new()
+            .name(name.into())
+            .spawn(move || loop {
+                let kicks = h.kicks.load(Ordering::Acquire);
+                match h.state.load(Ordering::Acquire) {
+                    QUIT => return,
+                    DUE if step() => {
+                        let _ = h.state.compare_exchange(DUE, IDLE, Ordering::AcqRel, Ordering::Acquire);
+                        continue;
+                    }
+                    _ => futex_wait(&h.kicks, kicks),
+                }
+            })
+            .map_err(|e| e.to_string())?;
+        Ok(Stepper { handoff, thread: Some(thread) })
+    }
+
+    /// RT: no step is pending and the thread still takes them, so the tuner may observe.
+    pub fn ready(&self) -> bool {
+        self.handoff.state.load(Ordering::Acquire) == IDLE
+    }
+
+    /// RT, after [`Tuner::observe`] returned a profile: hands the step over. Two atomics
+    /// and one futex wake.
+    pub fn request(&self) {
+        if self.handoff.state.compare_exchange(IDLE, DUE, Ordering::AcqRel, Ordering::Acquire).is_ok() {
+            self.handoff.kick();
+        }
+    }
+
+    /// A step was handed over and is not done yet. `step` checks it once it holds the
+    /// stream, since [`Stepper::quit`] may have come in between.
+    pub fn pending(&self) -> bool {
+        self.handoff.state.load(Ordering::Acquire) == DUE
+    }
+
+    /// Takes no further step; one in progress completes. The thread ends on drop.
+    pub fn quit(&self) {
+        self.handoff.set(QUIT);
+    }
+
+    /// Retries a pending step, for a stream that runs again after the host paused it.
+    pub fn kick(&self) {
+        if self.pending() {
+            self.handoff.kick();
+        }
+    }
+}
+
+// Waits for a step in progress, then ends the thread; never dropped from `step` itself.
+impl Drop for Stepper {
+    fn drop(&mut self) {
+        self.quit();
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+fn store_path() -> Option<PathBuf> {
+    let base = std::env::var_os("XDG_STATE_HOME")
+        .filter(|v| !v.is_empty())
+        .map(PathBuf::from)
+        .or_else(|| std::env::var_os("HOME").map(|h| PathBuf::from(h).join(".local/state")))?;
+    Some(base.join("openasio/latency-profiles"))
+}
+
+fn key(driver: &str, device: &str, rate: u32) -> String {
+    format!("{driver}\t{device}\t{rate}")
+}
+
+// Splits a store line into its key and profile.
+fn parse_line(line: &str) -> Option<(&str, Profile)> {
+    let (rest, periods) = line.rsplit_once('\t')?;
+    let (key, frames) = rest.rsplit_once('\t')?;
+    Some((key, Profile { frames: frames.parse().ok()?, periods: periods.parse().ok()? }))
+}
+
+/// The profile saved for `device` of `driver` at `rate`.
+pub fn load(driver: &str, device: &str, rate: u32) -> Option<Profile> {
+    let text = std::fs::read_to_string(store_path()?).ok()?;
+    let want = key(driver, device, rate);
+    text.lines().filter_map(parse_line).find(|(k, _)| *k == want).map(|(_, p)| p)
+}
+
+/// Records `profile` for `device` of `driver` at `rate`, replacing an older entry. Not for
+/// the RT thread: it rewrites the file.
+pub fn save(driver: &str, device: &str, rate: u32, profile: Profile) -> bool {
+    let Some(path) = store_path() else {
+        return false;
+    };
+    let want = key(driver, device, rate);
+    let old = std::fs::read_to_string(&path).unwrap_or_default();
+    let mut text: String = old
+        .lines()
+        .filter(|l| parse_line(l).map_or(true, |(k, _)| k != want))
+        .map(|l| format!("{l}\n"))
+        .collect();
+    text += &format!("{want}\t{}\t{}\n", profile.frames, profile.periods);
+    if text == old {
+        return true;
+    }
+    // Written aside and renamed, so a concurrent load never sees half a file.
+    let tmp = path.with_extension("tmp");
+    let written = path.parent().map_or(Ok(()), std::fs::create_dir_all).is_ok()
+        && std::fs::File::create(&tmp)
+            .and_then(|mut f| f.write_all(text.as_bytes()))
+            .is_ok();
+    written && std::fs::rename(&tmp, &path).is_ok()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::time::{Duration, Instant};
+
+    const RATE: u32 = 48000;
+
+    // One observation window of wakeups at the tuner's current period; returns its step.
+    fn window(t: &mut Tuner, xruns: u32, load: u32) -> Option<Profile> {
+        let frames = t.profile().frames;
+        (0..RATE * WINDOW_SECS as u32 / frames).find_map(|_| t.observe(frames, xruns, load))
+    }
+
+    fn p(frames: u32, periods: u32) -> Profile {
+        Profile { frames, periods }
+    }
+
+    #[test]
+    fn the_ladder_climbs_on_trouble_and_settles() {
+        let mut t = Tuner::new(RATE, &[2, 3], None);
+        assert_eq!(t.ladder[..5], [p(16, 2), p(16, 3), p(32, 2), p(32, 3), p(64, 2)]);
+        assert_eq!((t.max_frames(), t.profile(), t.settled()), (4096, p(16, 2), false));
+
+        // An xrun steps as soon as it is seen; a heavy window steps at its end.
+        assert_eq!(t.observe(16, 1, 0), Some(p(16, 3)));
+        assert_eq!(window(&mut t, 0, LOAD_HIGH + 1), Some(p(32, 2)));
+        // Loads up to LOAD_HIGH are clean; SETTLE_WINDOWS of them settle the profile.
+        for w in 0..SETTLE_WINDOWS {
+            assert!(!t.settled());
+            assert_eq!(window(&mut t, 0, LOAD_HIGH), None, "window {w}");
+        }
+        assert!(t.settled());
+        // Running light afterwards never goes back below a rung that failed.
+        for _ in 0..2 * RELAX_WINDOWS {
+            assert_eq!(window(&mut t, 0, 0), None);
+        }
+        assert_eq!(t.refused(), Some(p(32, 3)));
+        assert!(!t.settled());
+
+        let mut top = Tuner::new(RATE, &[2], Some(p(4096, 2)));
+        assert_eq!(top.observe(4096, 1, 0), None, "nothing above the top rung");
+    }
+
+    #[test]
+    fn a_saved_profile_relaxes_one_rung_when_light() {
+        let mut t = Tuner::new(RATE, &[2], Some(p(256, 2)));
+        assert_eq!((t.profile(), t.settled()), (p(256, 2), true));
+        // A window at LOAD_LOW breaks the run of light ones.
+        for _ in 0..RELAX_WINDOWS - 1 {
+            assert_eq!(window(&mut t, 0, LOAD_LOW - 1), None);
+        }
+        assert_eq!(window(&mut t, 0, LOAD_LOW), None);
+        for _ in 0..RELAX_WINDOWS - 1 {
+            assert_eq!(window(&mut t, 0, 0), None);
+        }
+        assert_eq!(window(&mut t, 0, 0), Some(p(128, 2)));
+        assert!(!t.settled());
+        // The probe fails: back up, and that rung is the floor for the rest of the stream.
+        assert_eq!(t.observe(128, 1, 0), Some(p(256, 2)));
+        for _ in 0..SETTLE_WINDOWS + RELAX_WINDOWS {
+            assert_eq!(window(&mut t, 0, 0), None);
+        }
+        assert_eq!(t.profile(), p(256, 2));
+        // A profile that is not on the ladder starts from the bottom instead.
+        assert_eq!(Tuner::new(RATE, &[2], Some(p(100, 2))).profile(), p(16, 2));
+    }
+
+    #[test]
+    fn profiles_persist_per_driver_device_and_rate() {
+        let dir = std::env::temp_dir().join(format!("openasio-tune-{}", std::process::id()));
+        std::env::set_var("XDG_STATE_HOME", &dir);
+        assert_eq!(load("alsa", "hw:1", RATE), None);
+        assert!(save("alsa", "hw:1", RATE, p(64, 2)));
+        assert!(save("alsa", "hw:1", 96000, p(128, 3)));
+        assert!(save("alsa", "hw:2", RATE, p(32, 2)));
+        assert!(save("alsa", "hw:1", RATE, p(128, 2)));
+        assert_eq!(load("alsa", "hw:1", RATE), Some(p(128, 2)));
+        assert_eq!(load("alsa", "hw:1", 96000), Some(p(128, 3)));
+        assert_eq!(load("alsa", "hw:2", RATE), Some(p(32, 2)));
+        assert_eq!(load("umc", "hw:1", RATE), None);
+        let text = std::fs::read_to_string(dir.join("openasio/latency-profiles")).unwrap();
+        assert_eq!(text.lines().count(), 3, "an entry is replaced, not repeated");
+        std::fs::remove_dir_all(&dir).unwrap();
+    }
+
+    #[test]
+    fn the_stepper_retries_until_the_stream_takes_the_step() {
+        let calls = Arc::new(AtomicU32::new(0));
+        let c = calls.clone();
+        // The first attempt finds the stream paused.
+        let st = Stepper::spawn("tune-test", move || c.fetch_add(1, Ordering::AcqRel) > 0).unwrap();
+        let wait = |n: u32| {
+            let deadline = Instant::now() + Duration::from_secs(5);
+            while calls.load(Ordering::Acquire) < n {
+                assert!(Instant::now() < deadline);
+                std::thread::sleep(Duration::from_millis(1));
+            }
+        };
+        assert!(st.ready());
+        st.request();
+        wait(1);
+        assert!(st.pending() && !st.ready());
+        st.request(); // already pending: no second hand-off
+        st.kick();
+        wait(2);
+        while st.pending() {
+            std::thread::yield_now();
+        }
+        assert!(st.ready());
+        st.quit();
+        st.request();
+        assert!(!st.ready() && !st.pending());
+        drop(st);
+        assert_eq!(calls.load(Ordering::Acquire), 2);
+    }
+}
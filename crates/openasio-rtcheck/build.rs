@@ -0,0 +1,4 @@
+fn main() {
+    // Export the interposed libc symbols (src/trace.rs) so dlopen()ed drivers bind to them.
+    println!("cargo:rustc-link-arg-bins=-rdynamic");
+}
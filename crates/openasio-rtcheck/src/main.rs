@@ -0,0 +1,888 @@
+//! openasio-rtcheck: streams an OpenASIO driver under a mock host and reports every
+//! allocation, lock and syscall made on the RT thread, plus per-callback timing.
+//!
+//! The RT thread is whichever thread calls `host.process`; it is armed on the first
+//! callback, so stream setup and thread start-up are not counted. Allocations and locks
+//! on that thread are violations; syscalls in driver code are reported (period I/O is the
+//! driver's job) and only fail the run with `--strict`. Anything inside `process` other
+//! than the harness itself is a violation.
+//!
+//! The mock host drives its RT side the way a real one would, through the SDK control
+//! plane: the main thread sends numbered commands and state snapshots, and reads a meter
+//! that `process` publishes. Each hand-off is checked for loss, reordering and tearing, and
+//! the trace covers the primitives along with the rest of `process`.
+mod trace;
+
+use openasio_sys::{self as sys, control as ctl, record as rec};
+use std::ffi::CString;
+use std::os::raw::c_void;
+use std::process::ExitCode;
+use std::sync::atomic::{AtomicPtr, AtomicU32, AtomicU64, Ordering};
+use std::time::Duration;
+use trace::{Class, Phase};
+
+const USAGE: &str = "usage: openasio-rtcheck <driver.so> [options]
+  --device NAME   device passed to open_device (default: driver default)
+  --seconds N     streaming time (default 10)
+  --rate HZ       sample rate (default: driver default config)
+  --frames N      buffer frames
+  --in N          input channels
+  --out N         output channels
+  --format F      f32 | i16 | i32 | i24 | i24in32
+  --planar        non-interleaved buffers
+  --mmap          zero-copy mode (requires OA_CAP_MMAP)
+  --batch N       N periods per wakeup through process_batch (requires OA_CAP_BATCH)
+  --load-us N     busy-wait N us per callback to emulate host DSP
+  --fifo PRIO     ask for SCHED_FIFO at PRIO on the driver thread (oa_create_params.rt)
+  --mlock         ask for mlockall and a pre-faulted stack on the driver thread
+  --huge-pages    ask for the stream's buffers on huge pages
+  --scratch N     N bytes of host scratch from the stream arena, cleared every callback
+  --strict        also fail on syscalls made by driver code
+  --record FILE   record the capture buffers (playback without input) through the SDK
+                  recorder; .caf and .rf64 pick the container, WAV otherwise";
+
+/// Timing histograms use 10 us bins up to 50 ms.
+const BIN_NS: u64 = 10_000;
+const BINS: usize = 5000;
+
+#[allow(clippy::declare_interior_mutable_const)]
+const ZERO: AtomicU32 = AtomicU32::new(0);
+
+/// Lock-free per-callback statistics, written by the RT thread only.
+struct Stats {
+    callbacks: AtomicU32,
+    last_entry_ns: AtomicU64,
+    late: AtomicU32,
+    frames_mismatch: AtomicU32,
+    short_batches: AtomicU32,
+    underruns: AtomicU32,
+    overruns: AtomicU32,
+    latency_changed: AtomicU32,
+    reset_requests: AtomicU32,
+    // oa_time_info 1.1 fields (OA_CAP_TIME_INFO_EX)
+    next_position: AtomicU64,
+    position_gaps: AtomicU32,
+    last_host_ns: AtomicU64,
+    time_backwards: AtomicU32,
+    time_flags: AtomicU32,
+    rate_ratio_bits: AtomicU64,
+    in_dropped: AtomicU64, // frames lost to xrun recovery, summed over the run
+    out_dropped: AtomicU64,
+    out_inserted: AtomicU64,
+    interval: [AtomicU32; BINS],
+    duration: [AtomicU32; BINS],
+}
+
+static STATS: Stats = Stats {
+    callbacks: AtomicU32::new(0),
+    last_entry_ns: AtomicU64::new(0),
+    late: AtomicU32::new(0),
+    frames_mismatch: AtomicU32::new(0),
+    short_batches: AtomicU32::new(0),
+    underruns: AtomicU32::new(0),
+    overruns: AtomicU32::new(0),
+    latency_changed: AtomicU32::new(0),
+    reset_requests: AtomicU32::new(0),
+    next_position: AtomicU64::new(0),
+    position_gaps: AtomicU32::new(0),
+    last_host_ns: AtomicU64::new(0),
+    time_backwards: AtomicU32::new(0),
+    time_flags: AtomicU32::new(0),
+    rate_ratio_bits: AtomicU64::new(0),
+    in_dropped: AtomicU64::new(0),
+    out_dropped: AtomicU64::new(0),
+    out_inserted: AtomicU64::new(0),
+    interval: [ZERO; BINS],
+    duration: [ZERO; BINS],
+};
+
+fn bin(hist: &[AtomicU32; BINS], ns: u64) {
+    let i = ((ns / BIN_NS) as usize).min(BINS - 1);
+    hist[i].fetch_add(1, Ordering::Relaxed);
+}
+
+/// (count, p50, p99, max) in microseconds, at bin resolution.
+fn summarize(hist: &[AtomicU32; BINS]) -> (u64, f64, f64, f64) {
+    let counts: Vec<u64> = hist.iter().map(|b| b.load(Ordering::Relaxed) as u64).collect();
+    let total: u64 = counts.iter().sum();
+    let pct = |p: f64| {
+        let want = ((total as f64) * p).ceil().max(1.0) as u64;
+        let mut seen = 0;
+        for (i, c) in counts.iter().enumerate() {
+            seen += c;
+            if seen >= want {
+                return ((i as u64 + 1) * BIN_NS) as f64 / 1000.0;
+            }
+        }
+        0.0
+    };
+    let max = counts
+        .iter()
+        .rposition(|c| *c > 0)
+        .map_or(0.0, |i| ((i as u64 + 1) * BIN_NS) as f64 / 1000.0);
+    (total, pct(0.50), pct(0.99), max)
+}
+
+fn now_ns() -> u64 {
+    let mut ts = libc::timespec {
+        tv_sec: 0,
+        tv_nsec: 0,
+    };
+    unsafe {
+        libc::clock_gettime(libc::CLOCK_MONOTONIC, &mut ts);
+    }
+    ts.tv_sec as u64 * 1_000_000_000 + ts.tv_nsec as u64
+}
+
+/// Main thread -> RT: commands every `CONTROL_MS`, one snapshot per command.
+const CONTROL_MS: u64 = 10;
+const COMMANDS: u32 = 64;
+
+#[derive(Clone, Copy)]
+struct Command {
+    seq: u64,
+}
+
+/// Consistent only if both words come from the same write.
+#[derive(Clone, Copy, Default)]
+struct Snapshot {
+    generation: u64,
+    check: u64,
+}
+
+/// RT -> main thread, once per callback.
+#[derive(Clone, Copy, Default)]
+struct Meter {
+    callbacks: u64,
+    commands: u64,
+    generation: u64,
+}
+
+fn snapshot(generation: u64) -> Snapshot {
+    Snapshot { generation, check: !generation.wrapping_mul(0x9e37_79b9_7f4a_7c15) }
+}
+
+/// Read-only state shared with the RT thread.
+struct Host {
+    drv: *mut sys::oa_driver,
+    period_ns: u64, // of a wakeup: `batch` periods
+    load_ns: u64,
+    mmap: bool,
+    time_ex: bool,
+    batch: u32,
+    commands: *mut ctl::oa_queue,  // popped by the RT thread only
+    state: *mut ctl::oa_triple,    // read by the RT thread only
+    meter: *mut ctl::oa_seqlock,   // written by the RT thread only
+    recorder: *mut rec::oa_recorder, // null without --record
+    scratch: AtomicPtr<u8>,          // host scratch in the stream arena, once started
+    scratch_bytes: AtomicU64,
+}
+
+/// Control-plane results, RT side.
+static APPLIED: AtomicU64 = AtomicU64::new(0);
+static REORDERED: AtomicU32 = AtomicU32::new(0);
+static TORN: AtomicU32 = AtomicU32::new(0);
+
+/// RT: drains the command queue, takes the latest snapshot and publishes the meter.
+unsafe fn control(h: &Host, callbacks: u32) {
+    let mut cmd = Command { seq: 0 };
+    let applied = APPLIED.load(Ordering::Relaxed);
+    let mut n = applied;
+    while ctl::oa_queue_pop(h.commands, &mut cmd as *mut Command as *mut c_void) != 0 {
+        if cmd.seq != n {
+            REORDERED.fetch_add(1, Ordering::Relaxed);
+        }
+        n = cmd.seq + 1;
+    }
+    APPLIED.store(n, Ordering::Relaxed);
+    let snap = *(ctl::oa_triple_read(h.state, std::ptr::null_mut()) as *const Snapshot);
+    if snap.check != snapshot(snap.generation).check {
+        TORN.fetch_add(1, Ordering::Relaxed);
+    }
+    let meter = Meter { callbacks: callbacks as u64, commands: n, generation: snap.generation };
+    ctl::oa_seqlock_write(h.meter, &meter as *const Meter as *const c_void);
+}
+
+/// Main thread: streams commands and snapshots to the RT side until `secs` have passed,
+/// reading the meter in between. Returns (sent, meter reads, failed or inconsistent reads).
+unsafe fn drive(h: &Host, secs: f64) -> (u64, u64, u64) {
+    let end = now_ns() + (secs * 1e9) as u64;
+    let (mut sent, mut reads, mut bad) = (0u64, 0u64, 0u64);
+    let mut last = Meter::default();
+    while now_ns() < end {
+        let cmd = Command { seq: sent };
+        if ctl::oa_queue_push(h.commands, &cmd as *const Command as *const c_void) != 0 {
+            sent += 1;
+            *(ctl::oa_triple_write_buffer(h.state) as *mut Snapshot) = snapshot(sent);
+            ctl::oa_triple_publish(h.state);
+        }
+        let mut m = Meter::default();
+        reads += 1;
+        let ok = ctl::oa_seqlock_read(h.meter, &mut m as *mut Meter as *mut c_void) != 0;
+        // Every field only grows, and the RT side cannot be ahead of what was sent.
+        if !ok || m.callbacks < last.callbacks || m.commands < last.commands || m.commands > sent || m.generation > sent {
+            bad += 1;
+        } else {
+            last = m;
+        }
+        std::thread::sleep(Duration::from_millis(CONTROL_MS).min(Duration::from_nanos(end.saturating_sub(now_ns()))));
+    }
+    (sent, reads, bad)
+}
+
+unsafe fn silence(out: *mut c_void, frames: u32, cfg: &sys::oa_stream_config) {
+    let bytes = sys::oa_sample_bytes(cfg.format) as usize * frames as usize;
+    let och = cfg.out_channels as usize;
+    if cfg.layout == sys::oa_buffer_layout::OA_BUF_INTERLEAVED {
+        std::ptr::write_bytes(out as *mut u8, 0, bytes * och);
+    } else {
+        let planes = out as *const *mut u8;
+        for c in 0..och {
+            std::ptr::write_bytes(*planes.add(c), 0, bytes);
+        }
+    }
+}
+
+/// Opens the zero-copy period, silences every output channel in place and commits it.
+unsafe fn mmap_period(h: &Host) {
+    let vt = &*(*h.drv).vt;
+    let (begin, commit) = match (
+        sys::oa_vt_get!(vt, mmap_begin_period),
+        sys::oa_vt_get!(vt, mmap_commit_period),
+    ) {
+        (Some(b), Some(c)) => (b, c),
+        _ => return,
+    };
+    let mut p: sys::oa_mmap_period = std::mem::zeroed();
+    p.struct_size = std::mem::size_of::<sys::oa_mmap_period>() as u32;
+    trace::set_phase(Phase::Driver);
+    let rc = begin(h.drv, &mut p);
+    trace::set_phase(Phase::Host);
+    if rc != sys::OA_OK {
+        return;
+    }
+    for c in 0..p.out_channels as usize {
+        let area = &*p.out.add(c);
+        for f in 0..p.frames as usize {
+            let s = (area.addr as *mut u8).add(f * area.step as usize);
+            std::ptr::write_bytes(s, 0, p.sample_bytes as usize);
+        }
+    }
+    trace::set_phase(Phase::Driver);
+    commit(h.drv, p.frames);
+    trace::set_phase(Phase::Host);
+}
+
+/// Entry of a callback (one wakeup): arms the trace and records the interval since the last.
+unsafe fn enter(h: &Host) -> (u64, u32) {
+    let t0 = now_ns();
+    trace::set_phase(Phase::Host);
+    let n = STATS.callbacks.fetch_add(1, Ordering::Relaxed);
+    trace::set_cycle(n + 1);
+    control(h, n + 1);
+    let last = STATS.last_entry_ns.swap(t0, Ordering::Relaxed);
+    if n > 0 {
+        let dt = t0.saturating_sub(last);
+        bin(&STATS.interval, dt);
+        if dt > h.period_ns * 3 / 2 {
+            STATS.late.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+    (t0, n)
+}
+
+/// Checks one period's size and timing, records it and silences its output. `first`: the
+/// stream's first.
+unsafe fn period(
+    h: &Host,
+    first: bool,
+    input: *const c_void,
+    out: *mut c_void,
+    frames: u32,
+    time: *const sys::oa_time_info,
+    cfg: *const sys::oa_stream_config,
+) {
+    if !cfg.is_null() && (*cfg).buffer_frames != frames {
+        STATS.frames_mismatch.fetch_add(1, Ordering::Relaxed);
+    }
+    if !time.is_null() {
+        STATS.underruns.store((*time).underruns, Ordering::Relaxed);
+        STATS.overruns.store((*time).overruns, Ordering::Relaxed);
+        if h.time_ex {
+            let ti = &*time;
+            if !first && ti.frame_position != STATS.next_position.load(Ordering::Relaxed) {
+                STATS.position_gaps.fetch_add(1, Ordering::Relaxed);
+            }
+            STATS.next_position.store(ti.frame_position + frames as u64, Ordering::Relaxed);
+            if ti.host_time_ns < STATS.last_host_ns.swap(ti.host_time_ns, Ordering::Relaxed) {
+                STATS.time_backwards.fetch_add(1, Ordering::Relaxed);
+            }
+            STATS.time_flags.store(ti.flags, Ordering::Relaxed);
+            STATS.rate_ratio_bits.store(ti.rate_ratio.to_bits(), Ordering::Relaxed);
+            if ti.struct_size as usize >= std::mem::size_of::<sys::oa_time_info>() {
+                STATS.in_dropped.fetch_add(ti.in_dropped as u64, Ordering::Relaxed);
+                STATS.out_dropped.fetch_add(ti.out_dropped as u64, Ordering::Relaxed);
+                STATS.out_inserted.fetch_add(ti.out_inserted as u64, Ordering::Relaxed);
+            }
+        }
+    }
+
+    if h.mmap && out.is_null() {
+        mmap_period(h);
+    } else if !out.is_null() && !cfg.is_null() {
+        silence(out, frames, &*cfg);
+    }
+    if !h.recorder.is_null() && !cfg.is_null() {
+        let buf = if (*cfg).in_channels > 0 { input } else { out as *const c_void };
+        let planar = (*cfg).layout == sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+        if !buf.is_null() && planar {
+            rec::oa_recorder_push_planar(h.recorder, buf as *const *const c_void, frames);
+        } else if !buf.is_null() {
+            rec::oa_recorder_push(h.recorder, buf, frames);
+        }
+    }
+}
+
+/// Emulated DSP load, then the end of the callback.
+fn leave(h: &Host, t0: u64) -> sys::oa_bool {
+    let scratch = h.scratch.load(Ordering::Acquire);
+    if !scratch.is_null() {
+        unsafe { std::ptr::write_bytes(scratch, 0, h.scratch_bytes.load(Ordering::Relaxed) as usize) };
+    }
+    while now_ns() - t0 < h.load_ns {
+        std::hint::spin_loop();
+    }
+    bin(&STATS.duration, now_ns() - t0);
+    trace::set_phase(Phase::Driver);
+    sys::OA_TRUE
+}
+
+unsafe extern "C" fn process(
+    user: *mut c_void,
+    input: *const c_void,
+    out: *mut c_void,
+    frames: u32,
+    time: *const sys::oa_time_info,
+    cfg: *const sys::oa_stream_config,
+) -> sys::oa_bool {
+    let h = &*(user as *const Host);
+    let (t0, n) = enter(h);
+    period(h, n == 0, input, out, frames, time, cfg);
+    leave(h, t0)
+}
+
+unsafe extern "C" fn process_batch(
+    user: *mut c_void,
+    periods: *const sys::oa_batch_period,
+    count: u32,
+    cfg: *const sys::oa_stream_config,
+) -> sys::oa_bool {
+    let h = &*(user as *const Host);
+    let (t0, n) = enter(h);
+    if count != h.batch {
+        STATS.short_batches.fetch_add(1, Ordering::Relaxed);
+    }
+    for (i, p) in std::slice::from_raw_parts(periods, count as usize).iter().enumerate() {
+        period(h, n == 0 && i == 0, p.in_, p.out, p.frames, p.time, cfg);
+    }
+    leave(h, t0)
+}
+
+unsafe extern "C" fn latency_changed(_: *mut c_void, _: u32, _: u32) {
+    STATS.latency_changed.fetch_add(1, Ordering::Relaxed);
+}
+
+unsafe extern "C" fn reset_request(_: *mut c_void) {
+    STATS.reset_requests.fetch_add(1, Ordering::Relaxed);
+}
+
+#[derive(Default)]
+struct Args {
+    driver: String,
+    device: Option<String>,
+    seconds: f64,
+    rate: Option<u32>,
+    frames: Option<u32>,
+    in_ch: Option<u16>,
+    out_ch: Option<u16>,
+    format: Option<sys::oa_sample_format>,
+    planar: bool,
+    mmap: bool,
+    batch: u32,
+    load_us: u64,
+    fifo: Option<i32>,
+    mlock: bool,
+    huge_pages: bool,
+    scratch: usize,
+    strict: bool,
+    record: Option<String>,
+}
+
+fn parse_format(s: &str) -> Option<sys::oa_sample_format> {
+    Some(match s {
+        "f32" => sys::oa_sample_format::OA_SAMPLE_F32,
+        "i16" => sys::oa_sample_format::OA_SAMPLE_I16,
+        "i32" => sys::oa_sample_format::OA_SAMPLE_I32,
+        "i24" => sys::oa_sample_format::OA_SAMPLE_I24_3LE,
+        "i24in32" => sys::oa_sample_format::OA_SAMPLE_I24_IN_32,
+        _ => return None,
+    })
+}
+
+fn parse_args() -> Result<Args, String> {
+    let mut a = Args {
+        seconds: 10.0,
+        batch: 1,
+        ..Default::default()
+    };
+    let mut it = std::env::args().skip(1);
+    fn val<T: std::str::FromStr>(it: &mut impl Iterator<Item = String>, flag: &str) -> Result<T, String> {
+        it.next()
+            .and_then(|v| v.parse().ok())
+            .ok_or_else(|| format!("{flag} needs a value"))
+    }
+    while let Some(arg) = it.next() {
+        match arg.as_str() {
+            "--device" => a.device = Some(val(&mut it, &arg)?),
+            "--seconds" => a.seconds = val(&mut it, &arg)?,
+            "--rate" => a.rate = Some(val(&mut it, &arg)?),
+            "--frames" => a.frames = Some(val(&mut it, &arg)?),
+            "--in" => a.in_ch = Some(val(&mut it, &arg)?),
+            "--out" => a.out_ch = Some(val(&mut it, &arg)?),
+            "--format" => {
+                let f: String = val(&mut it, &arg)?;
+                a.format = Some(parse_format(&f).ok_or(format!("unknown format {f}"))?);
+            }
+            "--planar" => a.planar = true,
+            "--mmap" => a.mmap = true,
+            "--batch" => a.batch = val(&mut it, &arg)?,
+            "--load-us" => a.load_us = val(&mut it, &arg)?,
+            "--fifo" => a.fifo = Some(val(&mut it, &arg)?),
+            "--mlock" => a.mlock = true,
+            "--huge-pages" => a.huge_pages = true,
+            "--scratch" => a.scratch = val(&mut it, &arg)?,
+            "--strict" => a.strict = true,
+            "--record" => a.record = Some(val(&mut it, &arg)?),
+            "-h" | "--help" => return Err(String::new()),
+            s if s.starts_with("--") => return Err(format!("unknown option {s}")),
+            s if a.driver.is_empty() => a.driver = s.to_string(),
+            s => return Err(format!("unexpected argument {s}")),
+        }
+    }
+    if a.driver.is_empty() {
+        return Err("missing driver library".into());
+    }
+    if a.batch == 0 || (a.batch > 1 && a.mmap) {
+        return Err("--batch needs N >= 1 and does not combine with --mmap".into());
+    }
+    if a.record.is_some() && a.mmap {
+        return Err("--record needs process buffers and does not combine with --mmap".into());
+    }
+    Ok(a)
+}
+
+fn check(what: &str, rc: i32) -> Result<(), String> {
+    if rc == sys::OA_OK {
+        Ok(())
+    } else {
+        Err(format!("{what} failed ({rc})"))
+    }
+}
+
+fn arg_text(e: &trace::Event) -> String {
+    match (e.class, e.func) {
+        (Class::Alloc, "free") => String::new(),
+        (Class::Alloc, _) => format!("({} bytes)", e.arg),
+        (_, "ioctl") => format!("(0x{:x})", e.arg),
+        (_, "syscall") => format!("(nr {})", e.arg),
+        (_, "futex") => format!("(op {})", e.arg),
+        _ => String::new(),
+    }
+}
+
+fn is_violation(e: &trace::Event, strict: bool) -> bool {
+    e.phase == Phase::Host || e.class != Class::Syscall || strict
+}
+
+/// Prints the report and returns the number of violations.
+fn report(
+    a: &Args,
+    cfg: &sys::oa_stream_config,
+    rt: Option<&sys::oa_rt_info>,
+    memory: Option<&sys::oa_stream_memory>,
+    stats: Option<&sys::oa_stream_stats>,
+    secs: f64,
+    plane: (u64, u64, u64),
+    recording: Option<&rec::oa_record_stats>,
+) -> u64 {
+    let layout = if cfg.layout == sys::oa_buffer_layout::OA_BUF_INTERLEAVED {
+        "interleaved"
+    } else {
+        "planar"
+    };
+    println!(
+        "{}: {} Hz, {} frames, in {} / out {}, {:?} {}{}",
+        a.driver,
+        cfg.sample_rate,
+        cfg.buffer_frames,
+        cfg.in_channels,
+        cfg.out_channels,
+        cfg.format,
+        layout,
+        if a.mmap { ", mmap" } else { "" }
+    );
+    if a.batch > 1 {
+        println!(
+            "batches of {}: callbacks count wakeups; short batches {}",
+            a.batch,
+            STATS.short_batches.load(Ordering::Relaxed)
+        );
+    }
+    if let Some(rt) = rt {
+        let policy = match rt.policy {
+            sys::OA_RT_POLICY_FIFO => "fifo",
+            sys::OA_RT_POLICY_RR => "rr",
+            _ => "other",
+        };
+        let cpus: u32 = rt.affinity.cpus.iter().map(|w| w.count_ones()).sum();
+        println!(
+            "driver thread: {policy} prio {}, {cpus} cpus, mlock {}, error {}",
+            rt.priority,
+            rt.flags & sys::OA_RT_MLOCK != 0,
+            rt.error
+        );
+    }
+    if let Some(m) = memory {
+        println!(
+            "stream memory: {} KiB arena, huge pages {}, locked {}, pre-faulted {}; host scratch {} bytes{}",
+            m.arena_bytes / 1024,
+            m.flags & sys::OA_RT_HUGE_PAGES != 0,
+            m.flags & sys::OA_RT_MLOCK != 0,
+            m.flags & sys::OA_RT_PREFAULT != 0,
+            m.host_scratch_bytes,
+            if m.host_scratch as usize % 64 == 0 { "" } else { " (misaligned)" }
+        );
+    }
+    let nominal_us = (cfg.buffer_frames * a.batch) as f64 * 1e6 / cfg.sample_rate.max(1) as f64;
+    let (_, p50, p99, max) = summarize(&STATS.interval);
+    println!(
+        "callbacks: {} in {:.1} s; interval p50 {:.0} us, p99 {:.0} us, max {:.0} us (nominal {:.0} us); late {}",
+        STATS.callbacks.load(Ordering::Relaxed),
+        secs,
+        p50,
+        p99,
+        max,
+        nominal_us,
+        STATS.late.load(Ordering::Relaxed)
+    );
+    let (_, d50, d99, dmax) = summarize(&STATS.duration);
+    println!("process time: p50 {d50:.0} us, p99 {d99:.0} us, max {dmax:.0} us");
+    if let Some(s) = stats {
+        let avg = s.process_ns_total as f64 * 100.0 / (s.callbacks.max(1) * s.period_ns.max(1)) as f64;
+        println!(
+            "driver stats: {} callbacks, load avg {avg:.1}% max {:.1}%, jitter max {} us; overruns {}, underruns {}",
+            s.callbacks,
+            s.load_permille_max as f64 / 10.0,
+            s.jitter_ns_max / 1000,
+            s.overruns,
+            s.underruns
+        );
+    }
+    let flags = STATS.time_flags.load(Ordering::Relaxed);
+    if flags != 0 || STATS.next_position.load(Ordering::Relaxed) != 0 {
+        let ratio = f64::from_bits(STATS.rate_ratio_bits.load(Ordering::Relaxed));
+        println!(
+            "timing: hw timestamps {}, rate {}; position gaps {}, host time backwards {}",
+            flags & sys::OA_TIME_HW_TIMESTAMP != 0,
+            if flags & sys::OA_TIME_RATE_LOCKED != 0 {
+                format!("{:+.1} ppm", (ratio - 1.0) * 1e6)
+            } else {
+                "not locked".to_string()
+            },
+            STATS.position_gaps.load(Ordering::Relaxed),
+            STATS.time_backwards.load(Ordering::Relaxed)
+        );
+    }
+    println!(
+        "xruns: underruns {}, overruns {}; frames != buffer_frames: {}; latency_changed {}, reset_request {}",
+        STATS.underruns.load(Ordering::Relaxed),
+        STATS.overruns.load(Ordering::Relaxed),
+        STATS.frames_mismatch.load(Ordering::Relaxed),
+        STATS.latency_changed.load(Ordering::Relaxed),
+        STATS.reset_requests.load(Ordering::Relaxed)
+    );
+    println!(
+        "recovery: input frames dropped {}; output frames dropped {}, inserted {}",
+        STATS.in_dropped.load(Ordering::Relaxed),
+        STATS.out_dropped.load(Ordering::Relaxed),
+        STATS.out_inserted.load(Ordering::Relaxed)
+    );
+
+    let (sent, reads, bad_reads) = plane;
+    let plane_errors = REORDERED.load(Ordering::Relaxed) as u64 + TORN.load(Ordering::Relaxed) as u64 + bad_reads;
+    println!(
+        "control plane: {sent} commands sent, {} applied, {} out of order; {} torn snapshots; {reads} meter reads, {bad_reads} failed",
+        APPLIED.load(Ordering::Relaxed),
+        REORDERED.load(Ordering::Relaxed),
+        TORN.load(Ordering::Relaxed)
+    );
+
+    if let Some(r) = recording {
+        println!(
+            "recording: {} frames pushed, {} written, {} dropped in {} pushes; ring fill max {}.{}%; {}{}, error {}",
+            r.frames_pushed,
+            r.frames_written,
+            r.frames_dropped,
+            r.drops,
+            r.fill_max_permille / 10,
+            r.fill_max_permille % 10,
+            if r.io == rec::OA_REC_IO_URING { "io_uring" } else { "pwrite" },
+            if r.direct != 0 { " O_DIRECT" } else { "" },
+            r.error
+        );
+    }
+
+    for (phase, title) in [(Phase::Driver, "driver code"), (Phase::Host, "inside process")] {
+        let counts = trace::counts(phase);
+        println!(
+            "RT thread, {title}: {} allocations, {} locks, {} syscalls",
+            trace::count(phase, Class::Alloc),
+            trace::count(phase, Class::Lock),
+            trace::count(phase, Class::Syscall)
+        );
+        for (name, _, c) in counts {
+            println!("  {name:<24}{c:>10}");
+        }
+    }
+
+    let (events, total) = trace::events();
+    // Group identical calls: (phase, func, arg) -> (first cycle, count).
+    let mut bad: Vec<(&trace::Event, u64)> = Vec::new();
+    for e in events.iter().filter(|e| is_violation(e, a.strict)) {
+        match bad
+            .iter_mut()
+            .find(|(b, _)| b.phase == e.phase && b.func == e.func && b.arg == e.arg)
+        {
+            Some((_, n)) => *n += 1,
+            None => bad.push((e, 1)),
+        }
+    }
+    let violations = plane_errors
+        + trace::count(Phase::Host, Class::Alloc)
+        + trace::count(Phase::Host, Class::Lock)
+        + trace::count(Phase::Host, Class::Syscall)
+        + trace::count(Phase::Driver, Class::Alloc)
+        + trace::count(Phase::Driver, Class::Lock)
+        + if a.strict {
+            trace::count(Phase::Driver, Class::Syscall)
+        } else {
+            0
+        };
+    println!("violations: {violations}");
+    for (e, n) in bad.iter().take(32) {
+        let side = if e.phase == Phase::Host { "process" } else { "driver" };
+        println!(
+            "  {side:<8} {}{}  x{n}, first in cycle {}",
+            e.func,
+            arg_text(e),
+            e.cycle
+        );
+    }
+    if total > events.len() {
+        println!("  ({} calls not itemized)", total - events.len());
+    }
+    violations
+}
+
+fn run(a: &Args) -> Result<u64, String> {
+    let lib = unsafe { sys::loader::DriverLib::load(&a.driver) }.map_err(|e| e.to_string())?;
+    let callbacks = sys::oa_host_callbacks {
+        process: Some(process),
+        latency_changed: Some(latency_changed),
+        reset_request: Some(reset_request),
+        devices_changed: None,
+        process_batch: Some(process_batch),
+    };
+    let (mut commands, mut state, mut meter) = (std::ptr::null_mut(), std::ptr::null_mut(), std::ptr::null_mut());
+    let initial = snapshot(0);
+    unsafe {
+        check("oa_queue_create", ctl::oa_queue_create(std::mem::size_of::<Command>() as u32, COMMANDS, ctl::OA_QUEUE_SPSC, &mut commands))?;
+        check("oa_triple_create", ctl::oa_triple_create(std::mem::size_of::<Snapshot>() as u32, &initial as *const Snapshot as *const c_void, &mut state))?;
+        check("oa_seqlock_create", ctl::oa_seqlock_create(std::mem::size_of::<Meter>() as u32, &mut meter))?;
+    }
+    // Filled in before start(); only read by the RT thread afterwards.
+    let host = Box::into_raw(Box::new(Host {
+        drv: std::ptr::null_mut(),
+        period_ns: 0,
+        load_ns: a.load_us * 1000,
+        mmap: a.mmap,
+        time_ex: false,
+        batch: a.batch,
+        commands,
+        state,
+        meter,
+        recorder: std::ptr::null_mut(),
+        scratch: AtomicPtr::new(std::ptr::null_mut()),
+        scratch_bytes: AtomicU64::new(0),
+    }));
+    let rt = sys::oa_rt_params {
+        struct_size: std::mem::size_of::<sys::oa_rt_params>() as u32,
+        policy: if a.fifo.is_some() { sys::OA_RT_POLICY_FIFO } else { sys::OA_RT_POLICY_DEFAULT },
+        priority: a.fifo.unwrap_or(0),
+        flags: if a.mlock { sys::OA_RT_MLOCK | sys::OA_RT_PREFAULT } else { 0 }
+            | if a.huge_pages { sys::OA_RT_HUGE_PAGES } else { 0 },
+        ..Default::default()
+    };
+    let params = sys::oa_create_params {
+        struct_size: std::mem::size_of::<sys::oa_create_params>() as u32,
+        host: &callbacks,
+        host_user: host as *mut c_void,
+        rt: if a.fifo.is_some() || a.mlock || a.huge_pages { &rt } else { std::ptr::null() },
+        host_size: std::mem::size_of::<sys::oa_host_callbacks>() as u32,
+    };
+    let mut drv: *mut sys::oa_driver = std::ptr::null_mut();
+    check("openasio_driver_create", unsafe { (lib.create)(&params, &mut drv) })?;
+    let vt = unsafe { &*(*drv).vt };
+    let result = (|| unsafe {
+        let name = a.device.as_deref().map(|d| CString::new(d).unwrap());
+        let open = vt.open_device.ok_or("driver has no open_device")?;
+        check(
+            "open_device",
+            open(drv, name.as_ref().map_or(std::ptr::null(), |n| n.as_ptr())),
+        )?;
+
+        let mut cfg = sys::oa_stream_config {
+            sample_rate: 48000,
+            buffer_frames: 128,
+            in_channels: 0,
+            out_channels: 2,
+            format: sys::oa_sample_format::OA_SAMPLE_F32,
+            layout: sys::oa_buffer_layout::OA_BUF_INTERLEAVED,
+        };
+        let get_default = vt.get_default_config.ok_or("driver has no get_default_config")?;
+        check("get_default_config", get_default(drv, &mut cfg))?;
+        cfg.sample_rate = a.rate.unwrap_or(cfg.sample_rate);
+        cfg.buffer_frames = a.frames.unwrap_or(cfg.buffer_frames);
+        cfg.in_channels = a.in_ch.unwrap_or(cfg.in_channels);
+        cfg.out_channels = a.out_ch.unwrap_or(cfg.out_channels);
+        cfg.format = a.format.unwrap_or(cfg.format);
+        if a.planar {
+            cfg.layout = sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+        }
+
+        if a.mmap {
+            let caps = vt.get_caps.map_or(0, |f| f(drv));
+            let enable = sys::oa_vt_get!(vt, mmap_enable)
+                .filter(|_| caps & sys::OA_CAP_MMAP as u32 != 0)
+                .ok_or("driver does not support mmap mode")?;
+            check("mmap_enable", enable(drv, sys::OA_TRUE))?;
+        }
+        if a.batch != 1 {
+            let caps = vt.get_caps.map_or(0, |f| f(drv));
+            let set = sys::oa_vt_get!(vt, set_batch_periods)
+                .filter(|_| caps & sys::OA_CAP_BATCH != 0)
+                .ok_or("driver does not support batched delivery")?;
+            check("set_batch_periods", set(drv, a.batch))?;
+        }
+        if a.scratch > 0 {
+            let set = sys::oa_vt_get!(vt, set_host_scratch).ok_or("driver does not hand out host scratch")?;
+            check("set_host_scratch", set(drv, a.scratch))?;
+        }
+        if let Some(path) = &a.record {
+            let container = match path.rsplit('.').next() {
+                Some("caf") => rec::OA_REC_CAF,
+                Some("rf64") => rec::OA_REC_RF64,
+                _ => rec::OA_REC_WAV,
+            };
+            let params = rec::oa_record_params {
+                container,
+                io: rec::OA_REC_IO_AUTO,
+                flags: rec::OA_REC_DIRECT,
+                format: cfg.format,
+                channels: if cfg.in_channels > 0 { cfg.in_channels } else { cfg.out_channels } as u32,
+                sample_rate: cfg.sample_rate,
+                ring_ms: 0,
+                chunk_bytes: 0,
+                queue_depth: 0,
+                prealloc_bytes: 0,
+            };
+            let cpath = CString::new(path.as_str()).map_err(|e| e.to_string())?;
+            check("oa_recorder_create", rec::oa_recorder_create(cpath.as_ptr(), &params, &mut (*host).recorder))?;
+        }
+        (*host).drv = drv;
+        (*host).time_ex = vt.get_caps.map_or(0, |f| f(drv)) & sys::OA_CAP_TIME_INFO_EX != 0;
+        (*host).period_ns = (cfg.buffer_frames * a.batch) as u64 * 1_000_000_000 / cfg.sample_rate.max(1) as u64;
+
+        let start = vt.start.ok_or("driver has no start")?;
+        trace::enable(true);
+        check("start", start(drv, &cfg))?;
+        let rt_info = sys::oa_vt_get!(vt, get_rt_info).and_then(|get| {
+            let mut info = sys::oa_rt_info {
+                struct_size: std::mem::size_of::<sys::oa_rt_info>() as u32,
+                ..Default::default()
+            };
+            (get(drv, &mut info) == sys::OA_OK).then_some(info)
+        });
+        let memory = sys::oa_vt_get!(vt, get_stream_memory).and_then(|get| {
+            let mut m = std::mem::MaybeUninit::<sys::oa_stream_memory>::zeroed();
+            (*m.as_mut_ptr()).struct_size = std::mem::size_of::<sys::oa_stream_memory>() as u32;
+            (get(drv, m.as_mut_ptr()) == sys::OA_OK).then(|| m.assume_init())
+        });
+        if let Some(m) = memory.filter(|m| !m.host_scratch.is_null()) {
+            (*host).scratch_bytes.store(m.host_scratch_bytes, Ordering::Relaxed);
+            (*host).scratch.store(m.host_scratch as *mut u8, Ordering::Release);
+        }
+        let plane = drive(&*host, a.seconds);
+        trace::enable(false);
+        let stats = sys::oa_vt_get!(vt, get_stream_stats).and_then(|get| {
+            let mut s = std::mem::MaybeUninit::<sys::oa_stream_stats>::zeroed();
+            (*s.as_mut_ptr()).struct_size = std::mem::size_of::<sys::oa_stream_stats>() as u32;
+            (get(drv, s.as_mut_ptr()) == sys::OA_OK).then(|| s.assume_init())
+        });
+        if let Some(stop) = vt.stop {
+            stop(drv);
+        }
+        if let Some(close) = vt.close_device {
+            close(drv);
+        }
+        let recording = (!(*host).recorder.is_null()).then(|| {
+            rec::oa_recorder_finish((*host).recorder);
+            let mut r = rec::oa_record_stats::default();
+            rec::oa_recorder_stats((*host).recorder, &mut r);
+            r
+        });
+        Ok::<_, String>(report(a, &cfg, rt_info.as_ref(), memory.as_ref(), stats.as_ref(), a.seconds, plane, recording.as_ref()))
+    })();
+    trace::enable(false);
+    unsafe {
+        (lib.destroy)(drv);
+        rec::oa_recorder_destroy((*host).recorder);
+        drop(Box::from_raw(host));
+        ctl::oa_queue_destroy(commands);
+        ctl::oa_triple_destroy(state);
+        ctl::oa_seqlock_destroy(meter);
+    }
+    result
+}
+
+fn main() -> ExitCode {
+    trace::init();
+    let args = match parse_args() {
+        Ok(a) => a,
+        Err(e) => {
+            if !e.is_empty() {
+                eprintln!("openasio-rtcheck: {e}");
+            }
+            eprintln!("{USAGE}");
+            return ExitCode::from(2);
+        }
+    };
+    match run(&args) {
+        Ok(0) => ExitCode::SUCCESS,
+        Ok(_) => ExitCode::from(1),
+        Err(e) => {
+            eprintln!("openasio-rtcheck: {e}");
+            ExitCode::from(2)
+        }
+    }
+}
@@ -0,0 +1,506 @@
+//! Interposed libc entry points that record what the RT thread calls.
+//!
+//! The harness binary is linked with `-rdynamic`, so these definitions win symbol lookup for
+//! the driver library and everything it pulls in (alsa-lib, libstd, ...). Allocation calls
+//! forward to glibc's `__libc_*` entry points, everything else to `dlsym(RTLD_NEXT)`.
+//! Recording never allocates or locks: counters are atomics and events go to a fixed ring.
+#![allow(clippy::missing_safety_doc)]
+use std::cell::Cell;
+use std::os::raw::{c_char, c_int, c_long, c_uint, c_ulong, c_void};
+use std::sync::atomic::{AtomicBool, AtomicPtr, AtomicU32, AtomicU64, AtomicU8, AtomicUsize, Ordering};
+
+/// Who is running on the current thread.
+#[derive(Clone, Copy, PartialEq, Eq, Debug)]
+#[repr(u8)]
+pub enum Phase {
+    /// Not the RT thread (or not armed yet): nothing is recorded.
+    Off = 0,
+    /// RT thread, driver code between two `process` calls.
+    Driver = 1,
+    /// RT thread, inside the host's `process`.
+    Host = 2,
+}
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+pub enum Class {
+    Alloc,
+    Lock,
+    Syscall,
+}
+
+#[derive(Clone, Copy)]
+#[repr(usize)]
+enum F {
+    Malloc,
+    Calloc,
+    Realloc,
+    Free,
+    Memalign,
+    MutexLock,
+    RwlockRdlock,
+    RwlockWrlock,
+    CondWait,
+    CondTimedwait,
+    SemWait,
+    Futex,
+    Syscall,
+    Read,
+    Write,
+    Ioctl,
+    Poll,
+    Ppoll,
+    Nanosleep,
+    ClockNanosleep,
+    Usleep,
+    SchedYield,
+    Open,
+    Openat,
+    Close,
+    Mmap,
+    Munmap,
+}
+
+/// Name and class of each traced function, indexed by `F`.
+pub const FUNCS: &[(&str, Class)] = &[
+    ("malloc", Class::Alloc),
+    ("calloc", Class::Alloc),
+    ("realloc", Class::Alloc),
+    ("free", Class::Alloc),
+    ("memalign", Class::Alloc),
+    ("pthread_mutex_lock", Class::Lock),
+    ("pthread_rwlock_rdlock", Class::Lock),
+    ("pthread_rwlock_wrlock", Class::Lock),
+    ("pthread_cond_wait", Class::Lock),
+    ("pthread_cond_timedwait", Class::Lock),
+    ("sem_wait", Class::Lock),
+    ("futex", Class::Lock),
+    ("syscall", Class::Syscall),
+    ("read", Class::Syscall),
+    ("write", Class::Syscall),
+    ("ioctl", Class::Syscall),
+    ("poll", Class::Syscall),
+    ("ppoll", Class::Syscall),
+    ("nanosleep", Class::Syscall),
+    ("clock_nanosleep", Class::Syscall),
+    ("usleep", Class::Syscall),
+    ("sched_yield", Class::Syscall),
+    ("open", Class::Syscall),
+    ("openat", Class::Syscall),
+    ("close", Class::Syscall),
+    ("mmap", Class::Syscall),
+    ("munmap", Class::Syscall),
+];
+const NFUNCS: usize = F::Munmap as usize + 1;
+
+/// One recorded call. `arg` is the size for allocations, the request for `ioctl`, the
+/// number for `syscall` and 0 otherwise.
+#[derive(Clone, Copy)]
+pub struct Event {
+    pub func: &'static str,
+    pub class: Class,
+    pub phase: Phase,
+    pub cycle: u32,
+    pub arg: u64,
+}
+
+struct Slot {
+    func: AtomicU8,
+    phase: AtomicU8,
+    cycle: AtomicU32,
+    arg: AtomicU64,
+}
+
+const EVENT_CAP: usize = 4096;
+
+#[allow(clippy::declare_interior_mutable_const)]
+const ZERO: AtomicU64 = AtomicU64::new(0);
+#[allow(clippy::declare_interior_mutable_const)]
+const ROW: [AtomicU64; NFUNCS] = [ZERO; NFUNCS];
+#[allow(clippy::declare_interior_mutable_const)]
+const EMPTY_SLOT: Slot = Slot {
+    func: AtomicU8::new(0),
+    phase: AtomicU8::new(0),
+    cycle: AtomicU32::new(0),
+    arg: AtomicU64::new(0),
+};
+#[allow(clippy::declare_interior_mutable_const)]
+const NULL_FN: AtomicPtr<c_void> = AtomicPtr::new(std::ptr::null_mut());
+
+static ENABLED: AtomicBool = AtomicBool::new(false);
+static CYCLE: AtomicU32 = AtomicU32::new(0);
+static COUNTS: [[AtomicU64; NFUNCS]; 3] = [ROW; 3];
+static EVENTS: [Slot; EVENT_CAP] = [EMPTY_SLOT; EVENT_CAP];
+static NEXT_EVENT: AtomicUsize = AtomicUsize::new(0);
+static NEXT: [AtomicPtr<c_void>; NFUNCS] = [NULL_FN; NFUNCS];
+
+thread_local! {
+    static PHASE: Cell<u8> = const { Cell::new(0) };
+}
+
+/// Resolves the forwarded symbols up front so the RT thread never runs `dlsym`.
+pub fn init() {
+    for f in 0..NFUNCS {
+        // Allocations go to __libc_*; futex is recorded from syscall(), not a symbol.
+        if !matches!(FUNCS[f].1, Class::Alloc) && f != F::Futex as usize {
+            unsafe {
+                next(f);
+            }
+        }
+    }
+}
+
+/// Turns recording on or off globally (armed threads keep their phase).
+pub fn enable(on: bool) {
+    ENABLED.store(on, Ordering::Release);
+}
+
+pub fn set_phase(p: Phase) {
+    PHASE.with(|c| c.set(p as u8));
+}
+
+/// Marks the start of callback `n` (events carry the cycle they happened in).
+pub fn set_cycle(n: u32) {
+    CYCLE.store(n, Ordering::Relaxed);
+}
+
+pub fn count(phase: Phase, class: Class) -> u64 {
+    FUNCS
+        .iter()
+        .enumerate()
+        .filter(|(_, (_, c))| *c == class)
+        .map(|(f, _)| COUNTS[phase as usize][f].load(Ordering::Relaxed))
+        .sum()
+}
+
+/// Per-function call counts for `phase`, skipping functions never called.
+pub fn counts(phase: Phase) -> Vec<(&'static str, Class, u64)> {
+    FUNCS
+        .iter()
+        .enumerate()
+        .map(|(f, (name, class))| (*name, *class, COUNTS[phase as usize][f].load(Ordering::Relaxed)))
+        .filter(|e| e.2 > 0)
+        .collect()
+}
+
+/// Recorded events (the first `EVENT_CAP`) and the total number of calls seen.
+pub fn events() -> (Vec<Event>, usize) {
+    let total = NEXT_EVENT.load(Ordering::Acquire);
+    let list = EVENTS[..total.min(EVENT_CAP)]
+        .iter()
+        .map(|s| {
+            let (func, class) = FUNCS[s.func.load(Ordering::Relaxed) as usize];
+            Event {
+                func,
+                class,
+                phase: match s.phase.load(Ordering::Relaxed) {
+                    1 => Phase::Driver,
+                    2 => Phase::Host,
+                    _ => Phase::Off,
+                },
+                cycle: s.cycle.load(Ordering::Relaxed),
+                arg: s.arg.load(Ordering::Relaxed),
+            }
+        })
+        .collect();
+    (list, total)
+}
+
+#[inline]
+fn record(f: F, arg: u64) {
+    let phase = PHASE.try_with(|c| c.get()).unwrap_or(0);
+    if phase == 0 || !ENABLED.load(Ordering::Relaxed) {
+        return;
+    }
+    COUNTS[phase as usize][f as usize].fetch_add(1, Ordering::Relaxed);
+    let i = NEXT_EVENT.fetch_add(1, Ordering::AcqRel);
+    if let Some(slot) = EVENTS.get(i) {
+        slot.func.store(f as u8, Ordering::Relaxed);
+        slot.phase.store(phase, Ordering::Relaxed);
+        slot.cycle.store(CYCLE.load(Ordering::Relaxed), Ordering::Relaxed);
+        slot.arg.store(arg, Ordering::Relaxed);
+    }
+}
+
+unsafe fn next(f: usize) -> *mut c_void {
+    let p = NEXT[f].load(Ordering::Acquire);
+    if !p.is_null() {
+        return p;
+    }
+    let mut name = [0u8; 32];
+    let sym = FUNCS[f].0.as_bytes();
+    name[..sym.len()].copy_from_slice(sym);
+    let p = libc::dlsym(libc::RTLD_NEXT, name.as_ptr() as *const c_char);
+    NEXT[f].store(p, Ordering::Release);
+    p
+}
+
+macro_rules! forward {
+    ($f:expr, fn($($t:ty),*) -> $r:ty, $($a:expr),*) => {{
+        let real: unsafe extern "C" fn($($t),*) -> $r = std::mem::transmute(next($f as usize));
+        real($($a),*)
+    }};
+}
+
+extern "C" {
+    fn __libc_malloc(size: usize) -> *mut c_void;
+    fn __libc_calloc(n: usize, size: usize) -> *mut c_void;
+    fn __libc_realloc(p: *mut c_void, size: usize) -> *mut c_void;
+    fn __libc_free(p: *mut c_void);
+    fn __libc_memalign(align: usize, size: usize) -> *mut c_void;
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn malloc(size: usize) -> *mut c_void {
+    record(F::Malloc, size as u64);
+    __libc_malloc(size)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn calloc(n: usize, size: usize) -> *mut c_void {
+    record(F::Calloc, n.saturating_mul(size) as u64);
+    __libc_calloc(n, size)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn realloc(p: *mut c_void, size: usize) -> *mut c_void {
+    record(F::Realloc, size as u64);
+    __libc_realloc(p, size)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn free(p: *mut c_void) {
+    if !p.is_null() {
+        record(F::Free, 0);
+    }
+    __libc_free(p)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn memalign(align: usize, size: usize) -> *mut c_void {
+    record(F::Memalign, size as u64);
+    __libc_memalign(align, size)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn aligned_alloc(align: usize, size: usize) -> *mut c_void {
+    record(F::Memalign, size as u64);
+    __libc_memalign(align, size)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn posix_memalign(out: *mut *mut c_void, align: usize, size: usize) -> c_int {
+    if !align.is_power_of_two() || align % std::mem::size_of::<*mut c_void>() != 0 {
+        return libc::EINVAL;
+    }
+    record(F::Memalign, size as u64);
+    let p = __libc_memalign(align, size);
+    if p.is_null() {
+        return libc::ENOMEM;
+    }
+    *out = p;
+    0
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn pthread_mutex_lock(m: *mut libc::pthread_mutex_t) -> c_int {
+    record(F::MutexLock, 0);
+    forward!(F::MutexLock, fn(*mut libc::pthread_mutex_t) -> c_int, m)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn pthread_rwlock_rdlock(l: *mut libc::pthread_rwlock_t) -> c_int {
+    record(F::RwlockRdlock, 0);
+    forward!(F::RwlockRdlock, fn(*mut libc::pthread_rwlock_t) -> c_int, l)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn pthread_rwlock_wrlock(l: *mut libc::pthread_rwlock_t) -> c_int {
+    record(F::RwlockWrlock, 0);
+    forward!(F::RwlockWrlock, fn(*mut libc::pthread_rwlock_t) -> c_int, l)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn pthread_cond_wait(
+    c: *mut libc::pthread_cond_t,
+    m: *mut libc::pthread_mutex_t,
+) -> c_int {
+    record(F::CondWait, 0);
+    forward!(F::CondWait, fn(*mut libc::pthread_cond_t, *mut libc::pthread_mutex_t) -> c_int, c, m)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn pthread_cond_timedwait(
+    c: *mut libc::pthread_cond_t,
+    m: *mut libc::pthread_mutex_t,
+    t: *const libc::timespec,
+) -> c_int {
+    record(F::CondTimedwait, 0);
+    forward!(
+        F::CondTimedwait,
+        fn(*mut libc::pthread_cond_t, *mut libc::pthread_mutex_t, *const libc::timespec) -> c_int,
+        c,
+        m,
+        t
+    )
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn sem_wait(s: *mut libc::sem_t) -> c_int {
+    record(F::SemWait, 0);
+    forward!(F::SemWait, fn(*mut libc::sem_t) -> c_int, s)
+}
+
+// libstd's Mutex/Condvar/park go straight to futex(2) through syscall(3).
+#[no_mangle]
+pub unsafe extern "C" fn syscall(
+    num: c_long,
+    a1: c_long,
+    a2: c_long,
+    a3: c_long,
+    a4: c_long,
+    a5: c_long,
+    a6: c_long,
+) -> c_long {
+    if num == libc::SYS_futex {
+        record(F::Futex, a2 as u64);
+    } else {
+        record(F::Syscall, num as u64);
+    }
+    forward!(
+        F::Syscall,
+        fn(c_long, c_long, c_long, c_long, c_long, c_long, c_long) -> c_long,
+        num,
+        a1,
+        a2,
+        a3,
+        a4,
+        a5,
+        a6
+    )
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn read(fd: c_int, buf: *mut c_void, n: usize) -> isize {
+    record(F::Read, n as u64);
+    forward!(F::Read, fn(c_int, *mut c_void, usize) -> isize, fd, buf, n)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn write(fd: c_int, buf: *const c_void, n: usize) -> isize {
+    record(F::Write, n as u64);
+    forward!(F::Write, fn(c_int, *const c_void, usize) -> isize, fd, buf, n)
+}
+
+// Variadic in C; every ioctl the ALSA/USB stack issues takes at most one pointer argument.
+#[no_mangle]
+pub unsafe extern "C" fn ioctl(fd: c_int, req: c_ulong, arg: *mut c_void) -> c_int {
+    record(F::Ioctl, req as u64);
+    forward!(F::Ioctl, fn(c_int, c_ulong, *mut c_void) -> c_int, fd, req, arg)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn poll(fds: *mut libc::pollfd, n: libc::nfds_t, timeout: c_int) -> c_int {
+    record(F::Poll, 0);
+    forward!(F::Poll, fn(*mut libc::pollfd, libc::nfds_t, c_int) -> c_int, fds, n, timeout)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn ppoll(
+    fds: *mut libc::pollfd,
+    n: libc::nfds_t,
+    t: *const libc::timespec,
+    mask: *const libc::sigset_t,
+) -> c_int {
+    record(F::Ppoll, 0);
+    forward!(
+        F::Ppoll,
+        fn(*mut libc::pollfd, libc::nfds_t, *const libc::timespec, *const libc::sigset_t) -> c_int,
+        fds,
+        n,
+        t,
+        mask
+    )
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn nanosleep(req: *const libc::timespec, rem: *mut libc::timespec) -> c_int {
+    record(F::Nanosleep, 0);
+    forward!(F::Nanosleep, fn(*const libc::timespec, *mut libc::timespec) -> c_int, req, rem)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn clock_nanosleep(
+    clock: libc::clockid_t,
+    flags: c_int,
+    req: *const libc::timespec,
+    rem: *mut libc::timespec,
+) -> c_int {
+    record(F::ClockNanosleep, 0);
+    forward!(
+        F::ClockNanosleep,
+        fn(libc::clockid_t, c_int, *const libc::timespec, *mut libc::timespec) -> c_int,
+        clock,
+        flags,
+        req,
+        rem
+    )
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn usleep(us: c_uint) -> c_int {
+    record(F::Usleep, us as u64);
+    forward!(F::Usleep, fn(c_uint) -> c_int, us)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn sched_yield() -> c_int {
+    record(F::SchedYield, 0);
+    forward!(F::SchedYield, fn() -> c_int,)
+}
+
+// Variadic in C; the optional mode is passed through as a plain integer.
+#[no_mangle]
+pub unsafe extern "C" fn open(path: *const c_char, flags: c_int, mode: c_uint) -> c_int {
+    record(F::Open, 0);
+    forward!(F::Open, fn(*const c_char, c_int, c_uint) -> c_int, path, flags, mode)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn openat(dir: c_int, path: *const c_char, flags: c_int, mode: c_uint) -> c_int {
+    record(F::Openat, 0);
+    forward!(F::Openat, fn(c_int, *const c_char, c_int, c_uint) -> c_int, dir, path, flags, mode)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn close(fd: c_int) -> c_int {
+    record(F::Close, 0);
+    forward!(F::Close, fn(c_int) -> c_int, fd)
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn mmap(
+    addr: *mut c_void,
+    len: usize,
+    prot: c_int,
+    flags: c_int,
+    fd: c_int,
+    off: libc::off_t,
+) -> *mut c_void {
+    record(F::Mmap, len as u64);
+    forward!(
+        F::Mmap,
+        fn(*mut c_void, usize, c_int, c_int, c_int, libc::off_t) -> *mut c_void,
+        addr,
+        len,
+        prot,
+        flags,
+        fd,
+        off
+    )
+}
+
+#[no_mangle]
+pub unsafe extern "C" fn munmap(addr: *mut c_void, len: usize) -> c_int {
+    record(F::Munmap, len as u64);
+    forward!(F::Munmap, fn(*mut c_void, usize) -> c_int, addr, len)
+}
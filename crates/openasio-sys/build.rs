@@ -1 +1,23 @@
-fn main(){ println!("cargo:rerun-if-changed=../../sdk/include/openasio/openasio.h"); println!("cargo:include=../../sdk/include"); }
+fn main() {
+    println!("cargo:rerun-if-changed=../../sdk/include/openasio/openasio.h");
+    println!("cargo:rerun-if-changed=../../sdk/include/openasio/openasio_convert.h");
+    println!("cargo:rerun-if-changed=../../sdk/src/openasio_convert.c");
+    println!("cargo:rerun-if-changed=../../sdk/include/openasio/openasio_workgroup.h");
+    println!("cargo:rerun-if-changed=../../sdk/src/openasio_workgroup.c");
+    println!("cargo:rerun-if-changed=../../sdk/include/openasio/openasio_control.h");
+    println!("cargo:rerun-if-changed=../../sdk/src/openasio_control.c");
+    println!("cargo:rerun-if-changed=../../sdk/include/openasio/openasio_record.h");
+    println!("cargo:rerun-if-changed=../../sdk/src/openasio_record.c");
+    println!("cargo:rerun-if-changed=../../sdk/include/openasio/openasio_resample.h");
+    println!("cargo:rerun-if-changed=../../sdk/src/openasio_resample.c");
+    cc::Build::new()
+        .file("../../sdk/src/openasio_convert.c")
+        .file("../../sdk/src/openasio_workgroup.c")
+        .file("../../sdk/src/openasio_control.c")
+        .file("../../sdk/src/openasio_record.c")
+        .file("../../sdk/src/openasio_resample.c")
+        .include("../../sdk/include")
+        .flag_if_supported("-std=c99")
+        .compile("openasio");
+    println!("cargo:include=../../sdk/include");
+}
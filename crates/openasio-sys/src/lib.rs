@@ -1,9 +1,9 @@
-//! Raw FFI for OpenASIO v1.0.0
+//! Raw FFI for OpenASIO v1.1.0
 #![allow(non_camel_case_types, non_snake_case, non_upper_case_globals)]
 use std::os::raw::{c_char, c_int, c_void};
 
 pub const OA_VERSION_MAJOR: u32 = 1;
-pub const OA_VERSION_MINOR: u32 = 0;
+pub const OA_VERSION_MINOR: u32 = 1;
 pub const OA_VERSION_PATCH: u32 = 0;
 
 pub type oa_bool = i32;
@@ -24,14 +24,32 @@ pub const OA_CAP_INPUT: u32 = 1<<1;
 pub const OA_CAP_FULL_DUPLEX: u32 = 1<<2;
 pub const OA_CAP_SET_SAMPLERATE: u32 = 1<<3;
 pub const OA_CAP_SET_BUFFRAMES: u32 = 1<<4;
+pub const OA_CAP_MMAP: u32 = 1<<5;
+pub const OA_CAP_TIME_INFO_EX: u32 = 1<<6;
+pub const OA_CAP_BATCH: u32 = 1<<7;
 
-#[repr(C)] #[derive(Clone, Copy, Debug)]
-pub enum oa_sample_format { OA_SAMPLE_F32 = 1, OA_SAMPLE_I16 = 2 }
+#[repr(C)] #[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum oa_sample_format {
+    OA_SAMPLE_F32 = 1, OA_SAMPLE_I16 = 2, OA_SAMPLE_U16 = 3,
+    OA_SAMPLE_I32 = 4, OA_SAMPLE_I24_3LE = 5, OA_SAMPLE_I24_IN_32 = 6,
+}
 
-#[repr(C)] #[derive(Clone, Copy, Debug)]
+/// `OA_FORMAT_BIT`: bit for `f` in the `get_supported_formats` masks.
+pub const fn oa_format_bit(f: oa_sample_format) -> u32 { 1u32 << (f as u32) }
+
+/// Bytes per sample container.
+pub const fn oa_sample_bytes(f: oa_sample_format) -> u32 {
+    match f {
+        oa_sample_format::OA_SAMPLE_I16 | oa_sample_format::OA_SAMPLE_U16 => 2,
+        oa_sample_format::OA_SAMPLE_I24_3LE => 3,
+        oa_sample_format::OA_SAMPLE_F32 | oa_sample_format::OA_SAMPLE_I32 | oa_sample_format::OA_SAMPLE_I24_IN_32 => 4,
+    }
+}
+
+#[repr(C)] #[derive(Clone, Copy, Debug, PartialEq, Eq)]
 pub enum oa_buffer_layout { OA_BUF_INTERLEAVED = 1, OA_BUF_NONINTERLEAVED = 2 }
 
-#[repr(C)] #[derive(Clone, Copy)]
+#[repr(C)] #[derive(Clone, Copy, Debug, PartialEq, Eq)]
 pub struct oa_stream_config {
     pub sample_rate: u32,
     pub buffer_frames: u32,
@@ -44,6 +62,44 @@ pub struct oa_stream_config {
 #[repr(C)] #[derive(Clone, Copy)]
 pub struct oa_time_info {
     pub host_time_ns: u64, pub device_time_ns: u64, pub underruns: u32, pub overruns: u32,
+    // 1.1, valid with OA_CAP_TIME_INFO_EX
+    pub struct_size: u32, pub flags: u32, pub frame_position: u64, pub rate_ratio: f64,
+    // read only if struct_size covers them
+    pub in_dropped: u32, pub out_dropped: u32, pub out_inserted: u32,
+}
+
+pub const OA_TIME_HW_TIMESTAMP: u32 = 1<<0;
+pub const OA_TIME_DEVICE_TIME: u32 = 1<<1;
+pub const OA_TIME_RATE_LOCKED: u32 = 1<<2;
+
+#[repr(C)] #[derive(Clone, Copy)]
+pub struct oa_mmap_channel { pub addr: *mut c_void, pub step: u32 }
+
+pub const OA_MMAP_FLOAT: u32 = 1<<0;
+pub const OA_MMAP_BIG_ENDIAN: u32 = 1<<1;
+
+#[repr(C)] #[derive(Clone, Copy)]
+pub struct oa_mmap_period {
+    pub struct_size: u32,
+    pub frames: u32,
+    pub in_channels: u16,
+    pub out_channels: u16,
+    pub sample_bits: u16,
+    pub sample_bytes: u16,
+    pub flags: u32,
+    pub in_: *const oa_mmap_channel,
+    pub out: *const oa_mmap_channel,
+}
+
+pub const OA_BATCH_MAX_PERIODS: u32 = 64;
+
+#[repr(C)] #[derive(Clone, Copy, Debug)]
+pub struct oa_batch_period {
+    pub in_: *const c_void,
+    pub out: *mut c_void,
+    pub frames: u32,
+    pub reserved: u32,
+    pub time: *const oa_time_info,
 }
 
 #[repr(C)] #[derive(Clone, Copy)]
@@ -51,9 +107,86 @@ pub struct oa_host_callbacks {
     pub process: Option<unsafe extern "C" fn(user:*mut c_void,in_ptr:*const c_void,out_ptr:*mut c_void,frames:u32,time:*const oa_time_info,cfg:*const oa_stream_config)->oa_bool>,
     pub latency_changed: Option<unsafe extern "C" fn(user:*mut c_void,in_latency:u32,out_latency:u32)>,
     pub reset_request: Option<unsafe extern "C" fn(user:*mut c_void)>,
+    // 1.1 additions (present if oa_create_params::host_size covers them)
+    pub devices_changed: Option<unsafe extern "C" fn(user:*mut c_void)>,
+    pub process_batch: Option<unsafe extern "C" fn(user:*mut c_void,periods:*const oa_batch_period,count:u32,cfg:*const oa_stream_config)->oa_bool>,
+}
+
+pub const OA_RT_POLICY_DEFAULT: u32 = 0;
+pub const OA_RT_POLICY_OTHER: u32 = 1;
+pub const OA_RT_POLICY_FIFO: u32 = 2;
+pub const OA_RT_POLICY_RR: u32 = 3;
+
+pub const OA_RT_MLOCK: u32 = 1<<0;
+pub const OA_RT_PREFAULT: u32 = 1<<1;
+pub const OA_RT_FTZ_DAZ: u32 = 1<<2;
+pub const OA_RT_HUGE_PAGES: u32 = 1<<3;
+
+#[repr(C)] #[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct oa_cpu_mask { pub cpus: [u64; 4] }
+
+#[repr(C)] #[derive(Clone, Copy, Debug, Default)]
+pub struct oa_rt_params { pub struct_size: u32, pub policy: u32, pub priority: i32, pub flags: u32, pub affinity: oa_cpu_mask }
+
+#[repr(C)] #[derive(Clone, Copy, Debug, Default)]
+pub struct oa_rt_info { pub struct_size: u32, pub policy: u32, pub priority: i32, pub flags: u32, pub affinity: oa_cpu_mask, pub error: i32 }
+
+#[repr(C)] #[derive(Clone, Copy, Debug, Default)]
+pub struct oa_thread_params {
+    pub struct_size: u32, pub policy: u32, pub priority: i32, pub flags: u32, pub affinity: oa_cpu_mask,
+    pub period_ns: u64, pub period_frames: u32, pub sample_rate: u32,
+}
+
+#[repr(C)] #[derive(Clone, Copy, Debug)]
+pub struct oa_stream_memory {
+    pub struct_size: u32, pub flags: u32, pub arena_bytes: u64,
+    pub host_scratch: *mut c_void, pub host_scratch_bytes: u64,
+}
+pub const OA_HOST_SCRATCH_MAX: usize = 256 << 20;
+
+pub const OA_DEVICE_NAME_MAX: usize = 128;
+pub const OA_DEVICE_DEFAULT: u32 = 1 << 0;
+
+#[repr(C)] #[derive(Clone, Copy, Debug)]
+pub struct oa_device_info {
+    pub struct_size: u32, pub id: u32, pub flags: u32, pub in_channels: u16, pub out_channels: u16,
+    pub name: [c_char; OA_DEVICE_NAME_MAX], pub description: [c_char; OA_DEVICE_NAME_MAX],
 }
 
-#[repr(C)] pub struct oa_create_params { pub struct_size:u32, pub host:*const oa_host_callbacks, pub host_user:*mut c_void }
+pub const fn oa_layout_bit(l: oa_buffer_layout) -> u32 { 1u32 << (l as u32) }
+pub const OA_CONFIG_MAX_RATES: usize = 16;
+pub const OA_CONFIG_RATE_CONTINUOUS: u32 = 1 << 0;
+
+#[repr(C)] #[derive(Clone, Copy, Debug, Default)]
+pub struct oa_config_space {
+    pub struct_size: u32, pub flags: u32,
+    pub rate_count: u32, pub rates: [u32; OA_CONFIG_MAX_RATES], pub rate_min: u32, pub rate_max: u32,
+    pub buffer_frames_min: u32, pub buffer_frames_max: u32, pub buffer_frames_step: u32,
+    pub in_channels_max: u32, pub out_channels_max: u32, pub in_channels: u64, pub out_channels: u64,
+    pub native_formats: u32, pub supported_formats: u32, pub layouts: u32,
+}
+
+pub const OA_STATS_BINS: usize = 64;
+
+#[repr(C)] #[derive(Clone, Copy, Debug)]
+pub struct oa_stream_stats {
+    pub struct_size: u32, pub bins: u32, pub period_ns: u64, pub callbacks: u64,
+    pub process_ns_total: u64, pub process_ns_max: u64, pub process_max_time_ns: u64,
+    pub jitter_ns_max: u64, pub jitter_max_time_ns: u64,
+    pub load_permille_last: u32, pub load_permille_max: u32, pub overruns: u32, pub underruns: u32,
+    pub last_overrun_ns: u64, pub last_underrun_ns: u64,
+    pub process_hist: [u64; OA_STATS_BINS], pub jitter_hist: [u64; OA_STATS_BINS],
+}
+
+/// Lower edge of histogram bin `i` of `oa_stream_stats`, in microseconds.
+pub const fn oa_stats_bin_floor_us(i: u32) -> u64 { if i < 4 { i as u64 } else { ((4 + (i & 3)) as u64) << (i / 4 - 1) } }
+
+#[repr(C)] pub struct oa_create_params {
+    pub struct_size:u32, pub host:*const oa_host_callbacks, pub host_user:*mut c_void,
+    // 1.1 additions
+    pub rt: *const oa_rt_params,
+    pub host_size: u32,
+}
 
 #[repr(C)]
 pub struct oa_driver_vtable {
@@ -68,6 +201,33 @@ pub struct oa_driver_vtable {
     pub get_latency: Option<unsafe extern "C" fn(*mut oa_driver,*mut u32,*mut u32)->i32>,
     pub set_sample_rate: Option<unsafe extern "C" fn(*mut oa_driver,u32)->i32>,
     pub set_buffer_frames: Option<unsafe extern "C" fn(*mut oa_driver,u32)->i32>,
+    // 1.1 additions
+    pub mmap_enable: Option<unsafe extern "C" fn(*mut oa_driver,oa_bool)->i32>,
+    pub mmap_begin_period: Option<unsafe extern "C" fn(*mut oa_driver,*mut oa_mmap_period)->i32>,
+    pub mmap_commit_period: Option<unsafe extern "C" fn(*mut oa_driver,u32)->i32>,
+    pub get_supported_formats: Option<unsafe extern "C" fn(*mut oa_driver,*mut u32,*mut u32)->i32>,
+    pub get_rt_info: Option<unsafe extern "C" fn(*mut oa_driver,*mut oa_rt_info)->i32>,
+    pub get_stream_stats: Option<unsafe extern "C" fn(*mut oa_driver,*mut oa_stream_stats)->i32>,
+    pub get_thread_params: Option<unsafe extern "C" fn(*mut oa_driver,*mut oa_thread_params)->i32>,
+    pub query_config_space: Option<unsafe extern "C" fn(*mut oa_driver,*const i8,*mut oa_config_space)->i32>,
+    pub enumerate_devices: Option<unsafe extern "C" fn(*mut oa_driver,*mut oa_device_info,u32,*mut u32)->i32>,
+    pub prepare: Option<unsafe extern "C" fn(*mut oa_driver,*const oa_stream_config)->i32>,
+    pub pause: Option<unsafe extern "C" fn(*mut oa_driver)->i32>,
+    pub resume: Option<unsafe extern "C" fn(*mut oa_driver)->i32>,
+    pub set_batch_periods: Option<unsafe extern "C" fn(*mut oa_driver,u32)->i32>,
+    pub set_host_scratch: Option<unsafe extern "C" fn(*mut oa_driver,usize)->i32>,
+    pub get_stream_memory: Option<unsafe extern "C" fn(*mut oa_driver,*mut oa_stream_memory)->i32>,
+}
+
+/// Rust counterpart of `OA_VT_HAS`: the entry if the driver's vtable is large enough to contain it.
+#[macro_export]
+macro_rules! oa_vt_get {
+    ($vt:expr, $entry:ident) => {{
+        let vt: &$crate::oa_driver_vtable = $vt;
+        let end = ::std::mem::offset_of!($crate::oa_driver_vtable, $entry)
+            + ::std::mem::size_of_val(&vt.$entry);
+        if vt.struct_size as usize >= end { vt.$entry } else { None }
+    }};
 }
 
 #[repr(C)] pub struct oa_driver { pub vt: *const oa_driver_vtable }
@@ -75,6 +235,278 @@ pub struct oa_driver_vtable {
 pub type openasio_driver_create_fn = unsafe extern "C" fn(params:*const oa_create_params,out:*mut *mut oa_driver)->c_int;
 pub type openasio_driver_destroy_fn = unsafe extern "C" fn(driver:*mut oa_driver);
 
+/// Sample conversion and (de)interleave kernels from `openasio_convert.h` (SIMD, RT-safe).
+pub mod convert {
+    use super::*;
+
+    pub type oa_simd_level = i32;
+    pub const OA_SIMD_SCALAR: oa_simd_level = 0;
+    pub const OA_SIMD_SSE2: oa_simd_level = 1;
+    pub const OA_SIMD_AVX2: oa_simd_level = 2;
+    pub const OA_SIMD_NEON: oa_simd_level = 3;
+
+    #[repr(C)] #[derive(Clone, Copy, Debug)]
+    pub struct oa_dither { pub state: u32 }
+
+    extern "C" {
+        pub fn oa_convert_simd_level() -> oa_simd_level;
+        pub fn oa_convert_set_simd_level(level: oa_simd_level) -> oa_result;
+        pub fn oa_dither_init(d: *mut oa_dither, seed: u32);
+        pub fn oa_f32_to_i16(dst: *mut i16, src: *const f32, n: usize);
+        pub fn oa_f32_to_i32(dst: *mut i32, src: *const f32, n: usize);
+        pub fn oa_f32_to_i24_in_32(dst: *mut i32, src: *const f32, n: usize);
+        pub fn oa_f32_to_i24_3le(dst: *mut u8, src: *const f32, n: usize);
+        pub fn oa_i16_to_f32(dst: *mut f32, src: *const i16, n: usize);
+        pub fn oa_i32_to_f32(dst: *mut f32, src: *const i32, n: usize);
+        pub fn oa_i24_in_32_to_f32(dst: *mut f32, src: *const i32, n: usize);
+        pub fn oa_i24_3le_to_f32(dst: *mut f32, src: *const u8, n: usize);
+        pub fn oa_convert_from_f32(dst_format: oa_sample_format, dst: *mut c_void, src: *const f32, n: usize, dither: *mut oa_dither) -> oa_result;
+        pub fn oa_convert_to_f32(dst: *mut f32, src_format: oa_sample_format, src: *const c_void, n: usize) -> oa_result;
+        pub fn oa_interleave_f32(dst: *mut f32, planes: *const *const f32, channels: u32, frames: usize);
+        pub fn oa_deinterleave_f32(planes: *const *mut f32, src: *const f32, channels: u32, frames: usize);
+        pub fn oa_interleave_bytes(dst: *mut c_void, planes: *const *const c_void, channels: u32, frames: usize, sample_bytes: u32);
+        pub fn oa_deinterleave_bytes(planes: *const *mut c_void, src: *const c_void, channels: u32, frames: usize, sample_bytes: u32);
+    }
+
+    // Slice wrappers: `n` is the shorter of the two lengths.
+    pub fn i32_to_f32(src: &[i32], dst: &mut [f32]) { unsafe { oa_i32_to_f32(dst.as_mut_ptr(), src.as_ptr(), src.len().min(dst.len())) } }
+    pub fn f32_to_i32(src: &[f32], dst: &mut [i32]) { unsafe { oa_f32_to_i32(dst.as_mut_ptr(), src.as_ptr(), src.len().min(dst.len())) } }
+    pub fn i16_to_f32(src: &[i16], dst: &mut [f32]) { unsafe { oa_i16_to_f32(dst.as_mut_ptr(), src.as_ptr(), src.len().min(dst.len())) } }
+    pub fn f32_to_i16(src: &[f32], dst: &mut [i16]) { unsafe { oa_f32_to_i16(dst.as_mut_ptr(), src.as_ptr(), src.len().min(dst.len())) } }
+
+    /// `planes[c][f]` -> `dst[f * planes.len() + c]`, `frames` per plane.
+    ///
+    /// # Safety
+    /// Every plane must hold `frames` samples and `dst` `frames * planes.len()`.
+    pub unsafe fn interleave_f32(dst: *mut f32, planes: &[*const f32], frames: usize) {
+        oa_interleave_f32(dst, planes.as_ptr(), planes.len() as u32, frames)
+    }
+    /// # Safety
+    /// Every plane must hold `frames` samples and `src` `frames * planes.len()`.
+    pub unsafe fn deinterleave_f32(planes: &[*mut f32], src: *const f32, frames: usize) {
+        oa_deinterleave_f32(planes.as_ptr(), src, planes.len() as u32, frames)
+    }
+
+    #[cfg(test)]
+    mod tests {
+        use super::*;
+
+        // Samples every kernel has to agree on, repeated so that each lands in every vector
+        // lane and in the scalar tail.
+        fn edges() -> Vec<f32> {
+            let one_up = f32::from_bits(1.0f32.to_bits() + 1);
+            let special = [
+                0.0, -0.0, 1.0, -1.0, one_up, -one_up, 0.999_999_94, 2.0, -2.0, f32::NAN, -f32::NAN,
+                f32::INFINITY, f32::NEG_INFINITY, f32::MIN_POSITIVE / 4.0, -f32::MIN_POSITIVE / 4.0,
+                0.5 / 32768.0, 1.5 / 32768.0, -0.5 / 8388608.0, 0.25, -0.75,
+            ];
+            (0..7 * special.len()).map(|i| special[(i * 3 + i / special.len()) % special.len()]).collect()
+        }
+
+        struct Out {
+            i16: Vec<i16>,
+            i32: Vec<i32>,
+            i24: Vec<i32>,
+            i24_3le: Vec<u8>,
+            from_ints: Vec<Vec<u32>>,
+            planes: [Vec<u32>; 2],
+        }
+
+        fn run(src: &[f32], ints: &[i32]) -> Out {
+            let n = src.len();
+            let mut o = Out { i16: vec![0; n], i32: vec![0; n], i24: vec![0; n], i24_3le: vec![0; 3 * n], from_ints: Vec::new(), planes: [vec![0; n / 2], vec![0; n / 2]] };
+            let shorts: Vec<i16> = ints.iter().map(|&v| v as i16).collect();
+            let bytes: Vec<u8> = ints.iter().flat_map(|v| v.to_le_bytes()[..3].to_vec()).collect();
+            let mut f = vec![0.0f32; n];
+            unsafe {
+                oa_f32_to_i16(o.i16.as_mut_ptr(), src.as_ptr(), n);
+                oa_f32_to_i32(o.i32.as_mut_ptr(), src.as_ptr(), n);
+                oa_f32_to_i24_in_32(o.i24.as_mut_ptr(), src.as_ptr(), n);
+                oa_f32_to_i24_3le(o.i24_3le.as_mut_ptr(), src.as_ptr(), n);
+                oa_i16_to_f32(f.as_mut_ptr(), shorts.as_ptr(), n);
+                o.from_ints.push(f.iter().map(|x| x.to_bits()).collect());
+                oa_i32_to_f32(f.as_mut_ptr(), ints.as_ptr(), n);
+                o.from_ints.push(f.iter().map(|x| x.to_bits()).collect());
+                oa_i24_in_32_to_f32(f.as_mut_ptr(), ints.as_ptr(), n);
+                o.from_ints.push(f.iter().map(|x| x.to_bits()).collect());
+                oa_i24_3le_to_f32(f.as_mut_ptr(), bytes.as_ptr(), n);
+                o.from_ints.push(f.iter().map(|x| x.to_bits()).collect());
+                let (mut l, mut r) = (vec![0.0f32; n / 2], vec![0.0f32; n / 2]);
+                deinterleave_f32(&[l.as_mut_ptr(), r.as_mut_ptr()], src.as_ptr(), n / 2);
+                let mut back = vec![0.0f32; n / 2 * 2];
+                interleave_f32(back.as_mut_ptr(), &[l.as_ptr(), r.as_ptr()], n / 2);
+                assert!(back.iter().zip(src).all(|(a, b)| a.to_bits() == b.to_bits()));
+                o.planes = [l.iter().map(|x| x.to_bits()).collect(), r.iter().map(|x| x.to_bits()).collect()];
+            }
+            o
+        }
+
+        #[test]
+        fn simd_kernels_match_scalar() {
+            let all = edges();
+            let ints: Vec<i32> = (0..all.len() as i32).map(|i| i.wrapping_mul(0x9e37_79b9u32 as i32) ^ (i << 7)).collect();
+            let best = unsafe { oa_convert_simd_level() };
+
+            unsafe { oa_convert_set_simd_level(OA_SIMD_SCALAR) };
+            let reference: Vec<Out> = (0..=all.len()).map(|n| run(&all[..n], &ints[..n])).collect();
+            let full = &reference[all.len()];
+            for (x, (&a, &b)) in all.iter().zip(full.i16.iter().zip(&full.i32)) {
+                match *x {
+                    x if x.is_nan() => assert_eq!((a, b), (0, 0)),
+                    x if x >= 1.0 => assert_eq!((a, b), (i16::MAX, i32::MAX)),
+                    x if x <= -1.0 => assert_eq!((a, b), (i16::MIN, i32::MIN)),
+                    _ => {}
+                }
+            }
+
+            for level in [OA_SIMD_SSE2, OA_SIMD_AVX2, OA_SIMD_NEON] {
+                if unsafe { oa_convert_set_simd_level(level) } != OA_OK {
+                    continue;
+                }
+                for (n, want) in reference.iter().enumerate() {
+                    let got = run(&all[..n], &ints[..n]);
+                    assert_eq!(got.i16, want.i16, "level {level}, {n} samples");
+                    assert_eq!(got.i32, want.i32, "level {level}, {n} samples");
+                    assert_eq!(got.i24, want.i24, "level {level}, {n} samples");
+                    assert_eq!(got.i24_3le, want.i24_3le, "level {level}, {n} samples");
+                    assert_eq!(got.from_ints, want.from_ints, "level {level}, {n} samples");
+                    assert_eq!(got.planes, want.planes, "level {level}, {n} samples");
+                }
+            }
+            unsafe { oa_convert_set_simd_level(best) };
+        }
+    }
+}
+
+pub mod workgroup {
+    use super::*;
+
+    pub const OA_WORKGROUP_MAX_WORKERS: u32 = 64;
+    pub const OA_WORKGROUP_MAX_JOBS: u32 = 65535;
+
+    #[repr(C)] pub struct oa_workgroup { _p: [u8; 0] }
+    pub type oa_work_fn = unsafe extern "C" fn(ctx: *mut c_void, index: u32, worker: u32);
+
+    extern "C" {
+        pub fn oa_workgroup_create(params: *const oa_thread_params, workers: u32, out: *mut *mut oa_workgroup) -> oa_result;
+        pub fn oa_workgroup_destroy(wg: *mut oa_workgroup);
+        pub fn oa_workgroup_size(wg: *const oa_workgroup) -> u32;
+        pub fn oa_workgroup_error(wg: *const oa_workgroup) -> i32;
+        pub fn oa_workgroup_run(wg: *mut oa_workgroup, f: oa_work_fn, ctx: *mut c_void, count: u32) -> oa_result;
+    }
+}
+
+/// Lock-free UI/RT hand-offs from `openasio_control.h`: command queue, triple buffer, seqlock.
+pub mod control {
+    use super::*;
+
+    pub type oa_queue_mode = i32;
+    pub const OA_QUEUE_SPSC: oa_queue_mode = 0;
+    pub const OA_QUEUE_MPSC: oa_queue_mode = 1;
+    pub const OA_SEQLOCK_TRIES: u32 = 64;
+
+    #[repr(C)] pub struct oa_queue { _p: [u8; 0] }
+    #[repr(C)] pub struct oa_triple { _p: [u8; 0] }
+    #[repr(C)] pub struct oa_seqlock { _p: [u8; 0] }
+
+    extern "C" {
+        pub fn oa_queue_create(item_size: u32, capacity: u32, mode: oa_queue_mode, out: *mut *mut oa_queue) -> oa_result;
+        pub fn oa_queue_destroy(q: *mut oa_queue);
+        pub fn oa_queue_capacity(q: *const oa_queue) -> u32;
+        pub fn oa_queue_push(q: *mut oa_queue, item: *const c_void) -> oa_bool;
+        pub fn oa_queue_pop(q: *mut oa_queue, item: *mut c_void) -> oa_bool;
+        pub fn oa_triple_create(size: u32, initial: *const c_void, out: *mut *mut oa_triple) -> oa_result;
+        pub fn oa_triple_destroy(t: *mut oa_triple);
+        pub fn oa_triple_write_buffer(t: *mut oa_triple) -> *mut c_void;
+        pub fn oa_triple_publish(t: *mut oa_triple);
+        pub fn oa_triple_read(t: *mut oa_triple, fresh: *mut oa_bool) -> *const c_void;
+        pub fn oa_seqlock_create(size: u32, out: *mut *mut oa_seqlock) -> oa_result;
+        pub fn oa_seqlock_destroy(s: *mut oa_seqlock);
+        pub fn oa_seqlock_write(s: *mut oa_seqlock, value: *const c_void);
+        pub fn oa_seqlock_read(s: *const oa_seqlock, out: *mut c_void) -> oa_bool;
+    }
+}
+
+pub mod record {
+    use super::*;
+    use std::os::raw::c_char;
+
+    pub type oa_record_container = i32;
+    pub const OA_REC_WAV: oa_record_container = 0;
+    pub const OA_REC_RF64: oa_record_container = 1;
+    pub const OA_REC_CAF: oa_record_container = 2;
+    pub type oa_record_io = i32;
+    pub const OA_REC_IO_AUTO: oa_record_io = 0;
+    pub const OA_REC_IO_URING: oa_record_io = 1;
+    pub const OA_REC_IO_PWRITE: oa_record_io = 2;
+    pub const OA_REC_DIRECT: u32 = 1 << 0;
+    pub const OA_REC_BLOCK: u32 = 4096;
+
+    #[repr(C)] #[derive(Clone, Copy, Debug)]
+    pub struct oa_record_params {
+        pub container: oa_record_container,
+        pub io: oa_record_io,
+        pub flags: u32,
+        pub format: oa_sample_format,
+        pub channels: u32,
+        pub sample_rate: u32,
+        pub ring_ms: u32,
+        pub chunk_bytes: u32,
+        pub queue_depth: u32,
+        pub prealloc_bytes: u64,
+    }
+    #[repr(C)] #[derive(Clone, Copy, Debug, Default)]
+    pub struct oa_record_stats {
+        pub frames_pushed: u64,
+        pub frames_written: u64,
+        pub frames_dropped: u64,
+        pub drops: u32,
+        pub fill_permille: u32,
+        pub fill_max_permille: u32,
+        pub error: i32,
+        pub io: oa_record_io,
+        pub direct: oa_bool,
+    }
+    #[repr(C)] pub struct oa_recorder { _p: [u8; 0] }
+
+    extern "C" {
+        pub fn oa_recorder_create(path: *const c_char, params: *const oa_record_params, out: *mut *mut oa_recorder) -> oa_result;
+        pub fn oa_recorder_push(rec: *mut oa_recorder, interleaved: *const c_void, frames: u32) -> oa_bool;
+        pub fn oa_recorder_push_planar(rec: *mut oa_recorder, planes: *const *const c_void, frames: u32) -> oa_bool;
+        pub fn oa_recorder_stats(rec: *const oa_recorder, out: *mut oa_record_stats);
+        pub fn oa_recorder_finish(rec: *mut oa_recorder) -> oa_result;
+        pub fn oa_recorder_destroy(rec: *mut oa_recorder);
+    }
+}
+
+/// Polyphase sample-rate converter from `openasio_resample.h` (SIMD, RT-safe after create).
+pub mod resample {
+    use super::*;
+
+    pub type oa_resample_quality = i32;
+    pub const OA_RESAMPLE_FAST: oa_resample_quality = 0;
+    pub const OA_RESAMPLE_MEDIUM: oa_resample_quality = 1;
+    pub const OA_RESAMPLE_HIGH: oa_resample_quality = 2;
+    pub const OA_RESAMPLE_VARIABLE: u32 = 1 << 0;
+    pub const OA_RESAMPLE_MAX_PHASES: u32 = 1024;
+    pub const OA_RESAMPLE_MAX_TRIM: f64 = 0.05;
+    pub const OA_RESAMPLE_MAX_RATIO: u32 = 8;
+
+    #[repr(C)] pub struct oa_resampler { _p: [u8; 0] }
+
+    extern "C" {
+        pub fn oa_resampler_create(channels: u32, in_rate: u32, out_rate: u32, quality: oa_resample_quality, flags: u32, out: *mut *mut oa_resampler) -> oa_result;
+        pub fn oa_resampler_destroy(r: *mut oa_resampler);
+        pub fn oa_resampler_reset(r: *mut oa_resampler);
+        pub fn oa_resampler_set_trim(r: *mut oa_resampler, trim: f64) -> oa_result;
+        pub fn oa_resampler_variable(r: *const oa_resampler) -> oa_bool;
+        pub fn oa_resampler_input_for(r: *const oa_resampler, out_frames: usize) -> usize;
+        pub fn oa_resampler_output_for(r: *const oa_resampler, in_frames: usize) -> usize;
+        pub fn oa_resampler_process(r: *mut oa_resampler, input: *const f32, in_frames: usize, in_used: *mut usize, out: *mut f32, out_frames: usize, out_done: *mut usize);
+        pub fn oa_resampler_latency(r: *const oa_resampler) -> u32;
+    }
+}
+
 pub mod loader {
     use super::*; use libloading::{Library, Symbol};
     pub struct DriverLib { pub lib: Library, pub create: openasio_driver_create_fn, pub destroy: openasio_driver_destroy_fn }
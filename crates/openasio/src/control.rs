@@ -0,0 +1,234 @@
+//! Lock-free hand-offs between control threads and [`crate::HostProcess::process`]
+//! (`openasio_control.h`). Every call on an endpoint is RT-safe; only creating and dropping
+//! them allocates. Values cross as plain bytes, hence `T: Copy`.
+//!
+//! - [`spsc`] / [`mpsc`]: bounded command queue.
+//! - [`triple_buffer`]: latest-snapshot hand-off.
+//! - [`seqlock`]: one writer publishing a small value often, any number of readers.
+use anyhow::{anyhow, Result};
+use openasio_sys::{self as sys, control as c};
+use std::marker::PhantomData;
+use std::mem::{size_of, MaybeUninit};
+use std::os::raw::c_void;
+use std::sync::Arc;
+
+struct Queue(*mut c::oa_queue);
+// SAFETY: the C queue is shared by design; the endpoint types below keep each side on one thread.
+unsafe impl Send for Queue {}
+unsafe impl Sync for Queue {}
+impl Drop for Queue { fn drop(&mut self) { unsafe { c::oa_queue_destroy(self.0) } } }
+
+fn queue<T>(capacity: u32, mode: c::oa_queue_mode) -> Result<Arc<Queue>> {
+    let mut q = std::ptr::null_mut();
+    let rc = unsafe { c::oa_queue_create(size_of::<T>() as u32, capacity, mode, &mut q) };
+    if rc < 0 { return Err(anyhow!("oa_queue_create rc={rc}")); }
+    Ok(Arc::new(Queue(q)))
+}
+
+/// Queue for one producer thread; `push` is wait-free. Capacity rounds up to a power of two.
+pub fn spsc<T: Copy + Send>(capacity: u32) -> Result<(Producer<T>, Consumer<T>)> {
+    let q = queue::<T>(capacity, c::OA_QUEUE_SPSC)?;
+    Ok((Producer{ q: q.clone(), _t: PhantomData }, Consumer{ q, _t: PhantomData }))
+}
+
+/// Queue for producers on any number of threads; clone the [`Sender`] for each.
+pub fn mpsc<T: Copy + Send>(capacity: u32) -> Result<(Sender<T>, Consumer<T>)> {
+    let q = queue::<T>(capacity, c::OA_QUEUE_MPSC)?;
+    Ok((Sender{ q: q.clone(), _t: PhantomData }, Consumer{ q, _t: PhantomData }))
+}
+
+/// The producing end of an [`spsc`] queue.
+pub struct Producer<T> { q: Arc<Queue>, _t: PhantomData<fn(T)> }
+impl<T: Copy + Send> Producer<T> {
+    /// `Err(item)` if the queue is full.
+    pub fn push(&mut self, item: T) -> Result<(), T> {
+        if unsafe { c::oa_queue_push(self.q.0, &item as *const T as *const c_void) } != 0 { Ok(()) } else { Err(item) }
+    }
+}
+
+/// A producing end of an [`mpsc`] queue.
+pub struct Sender<T> { q: Arc<Queue>, _t: PhantomData<fn(T)> }
+impl<T> Clone for Sender<T> { fn clone(&self) -> Self { Sender{ q: self.q.clone(), _t: PhantomData } } }
+impl<T: Copy + Send> Sender<T> {
+    /// `Err(item)` if the queue is full.
+    pub fn push(&self, item: T) -> Result<(), T> {
+        if unsafe { c::oa_queue_push(self.q.0, &item as *const T as *const c_void) } != 0 { Ok(()) } else { Err(item) }
+    }
+}
+
+/// The consuming end of a queue, typically moved into the host's `process`.
+pub struct Consumer<T> { q: Arc<Queue>, _t: PhantomData<fn() -> T> }
+impl<T: Copy + Send> Consumer<T> {
+    pub fn pop(&mut self) -> Option<T> {
+        let mut item = MaybeUninit::<T>::uninit();
+        // SAFETY: a popped item is the bytes of a T pushed by a producer.
+        unsafe { (c::oa_queue_pop(self.q.0, item.as_mut_ptr() as *mut c_void) != 0).then(|| item.assume_init()) }
+    }
+    pub fn capacity(&self) -> u32 { unsafe { c::oa_queue_capacity(self.q.0) } }
+}
+
+struct Triple(*mut c::oa_triple);
+unsafe impl Send for Triple {}
+unsafe impl Sync for Triple {}
+impl Drop for Triple { fn drop(&mut self) { unsafe { c::oa_triple_destroy(self.0) } } }
+
+/// Triple buffer starting at `initial`. The reader always sees the latest complete
+/// snapshot; the writer never waits for it. `T` must align to at most 64 bytes.
+pub fn triple_buffer<T: Copy + Send>(initial: T) -> Result<(TripleWriter<T>, TripleReader<T>)> {
+    assert!(std::mem::align_of::<T>() <= 64, "snapshot over-aligned");
+    let mut t = std::ptr::null_mut();
+    let rc = unsafe { c::oa_triple_create(size_of::<T>() as u32, &initial as *const T as *const c_void, &mut t) };
+    if rc < 0 { return Err(anyhow!("oa_triple_create rc={rc}")); }
+    let t = Arc::new(Triple(t));
+    Ok((TripleWriter{ t: t.clone(), _t: PhantomData }, TripleReader{ t, _t: PhantomData }))
+}
+
+pub struct TripleWriter<T> { t: Arc<Triple>, _t: PhantomData<fn(T)> }
+impl<T: Copy + Send> TripleWriter<T> {
+    pub fn write(&mut self, value: T) {
+        unsafe {
+            (c::oa_triple_write_buffer(self.t.0) as *mut T).write(value);
+            c::oa_triple_publish(self.t.0);
+        }
+    }
+}
+
+pub struct TripleReader<T> { t: Arc<Triple>, _t: PhantomData<fn() -> T> }
+impl<T: Copy + Send> TripleReader<T> {
+    /// The latest snapshot.
+    pub fn read(&mut self) -> &T { self.poll().0 }
+    /// The latest snapshot, and whether it is newer than the one the last call returned.
+    pub fn poll(&mut self) -> (&T, bool) {
+        let mut fresh = sys::OA_FALSE;
+        // SAFETY: every buffer holds a T (the initial value or a written one), and the front
+        // one is the reader's alone until its next call, which needs `&mut self`.
+        unsafe { (&*(c::oa_triple_read(self.t.0, &mut fresh) as *const T), fresh != 0) }
+    }
+}
+
+struct Seq(*mut c::oa_seqlock);
+unsafe impl Send for Seq {}
+unsafe impl Sync for Seq {}
+impl Drop for Seq { fn drop(&mut self) { unsafe { c::oa_seqlock_destroy(self.0) } } }
+
+/// Seqlock holding `initial`. Clone the [`SeqReader`] for each reading thread.
+pub fn seqlock<T: Copy + Send>(initial: T) -> Result<(SeqWriter<T>, SeqReader<T>)> {
+    let mut s = std::ptr::null_mut();
+    let rc = unsafe { c::oa_seqlock_create(size_of::<T>() as u32, &mut s) };
+    if rc < 0 { return Err(anyhow!("oa_seqlock_create rc={rc}")); }
+    let s = Arc::new(Seq(s));
+    let mut w = SeqWriter{ s: s.clone(), _t: PhantomData };
+    w.write(initial);
+    Ok((w, SeqReader{ s, _t: PhantomData }))
+}
+
+pub struct SeqWriter<T> { s: Arc<Seq>, _t: PhantomData<fn(T)> }
+impl<T: Copy + Send> SeqWriter<T> {
+    /// Wait-free; readers never hold it up.
+    pub fn write(&mut self, value: T) { unsafe { c::oa_seqlock_write(self.s.0, &value as *const T as *const c_void) } }
+}
+
+pub struct SeqReader<T> { s: Arc<Seq>, _t: PhantomData<fn() -> T> }
+impl<T> Clone for SeqReader<T> { fn clone(&self) -> Self { SeqReader{ s: self.s.clone(), _t: PhantomData } } }
+impl<T: Copy + Send> SeqReader<T> {
+    /// A consistent copy; `None` if `OA_SEQLOCK_TRIES` reads in a row overlapped a write.
+    pub fn read(&self) -> Option<T> {
+        let mut out = MaybeUninit::<T>::uninit();
+        // SAFETY: a consistent read copies the bytes of a T the writer stored.
+        unsafe { (c::oa_seqlock_read(self.s.0, out.as_mut_ptr() as *mut c_void) != 0).then(|| out.assume_init()) }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicBool, Ordering};
+
+    #[test]
+    fn queue_fills_empties_and_wraps() {
+        let (mut tx, mut rx) = spsc::<u32>(5).unwrap();
+        assert_eq!(rx.capacity(), 8);
+        assert_eq!(rx.pop(), None);
+        for i in 0..8 { tx.push(i).unwrap(); }
+        assert_eq!(tx.push(8), Err(8));
+        assert_eq!(rx.pop(), Some(0));
+        tx.push(8).unwrap();
+        for i in 1..9 { assert_eq!(rx.pop(), Some(i)); }
+        assert_eq!(rx.pop(), None);
+        // Uneven bursts walk the indices round the ring many times over.
+        let (mut next_in, mut next_out) = (9, 9);
+        for round in 0..1000u32 {
+            for _ in 0..round % 8 + 1 { tx.push(next_in).unwrap(); next_in += 1; }
+            while let Some(v) = rx.pop() { assert_eq!(v, next_out); next_out += 1; }
+        }
+        assert_eq!(next_out, next_in);
+    }
+
+    #[test]
+    fn mpsc_keeps_every_producer_in_order() {
+        let (tx, mut rx) = mpsc::<(u32, u32)>(16).unwrap();
+        let producers: Vec<_> = (0..3).map(|p| {
+            let tx = tx.clone();
+            std::thread::spawn(move || for i in 0..5000 { while tx.push((p, i)).is_err() { std::thread::yield_now() } })
+        }).collect();
+        let mut next = [0u32; 3];
+        while next.iter().any(|&n| n < 5000) {
+            match rx.pop() {
+                Some((p, i)) => { assert_eq!(i, next[p as usize]); next[p as usize] += 1; }
+                None => std::thread::yield_now(),
+            }
+        }
+        producers.into_iter().for_each(|t| t.join().unwrap());
+        assert_eq!(rx.pop(), None);
+    }
+
+    #[test]
+    fn triple_buffer_hands_over_the_latest_snapshot() {
+        let (mut w, mut r) = triple_buffer([7u64; 4]).unwrap();
+        assert_eq!(r.poll(), (&[7; 4], false));
+        for v in 1..=3 { w.write([v; 4]); }
+        assert_eq!(r.poll(), (&[3; 4], true));
+        assert_eq!(r.poll(), (&[3; 4], false));
+        w.write([4; 4]);
+        assert_eq!(*r.read(), [4; 4]);
+
+        let writer = std::thread::spawn(move || for v in 5..200_000u64 { w.write([v; 4]) });
+        let mut last = 4;
+        while last < 199_999 {
+            let snap = *r.read();
+            assert!(snap.iter().all(|&x| x == snap[0]), "torn snapshot {snap:?}");
+            assert!(snap[0] >= last, "went back from {last} to {}", snap[0]);
+            last = snap[0];
+            std::thread::yield_now();
+        }
+        writer.join().unwrap();
+    }
+
+    #[test]
+    fn seqlock_reader_never_sees_a_torn_value() {
+        let (mut w, r) = seqlock([0u64; 16]).unwrap();
+        assert_eq!(r.read(), Some([0; 16]));
+        let done = Arc::new(AtomicBool::new(false));
+        let readers: Vec<_> = (0..2).map(|_| {
+            let (r, done) = (r.clone(), done.clone());
+            std::thread::spawn(move || {
+                let (mut last, mut reads) = (0, 0u64);
+                while !done.load(Ordering::Acquire) {
+                    if let Some(v) = r.read() {
+                        assert!(v.iter().all(|&x| x == v[0]), "torn value {v:?}");
+                        assert!(v[0] >= last);
+                        (last, reads) = (v[0], reads + 1);
+                    }
+                }
+                reads
+            })
+        }).collect();
+        for v in 1..=300_000u64 {
+            w.write([v; 16]);
+            if v % 1024 == 0 { std::thread::yield_now() }
+        }
+        done.store(true, Ordering::Release);
+        for t in readers { assert!(t.join().unwrap() > 0); }
+        assert_eq!(r.read(), Some([300_000; 16]));
+    }
+}
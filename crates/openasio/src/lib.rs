@@ -1,9 +1,15 @@
-//! Safe host-side wrapper for OpenASIO v1.0.0
+//! Safe host-side wrapper for OpenASIO v1.1.0
 use anyhow::{anyhow, Context, Result};
 use openasio_sys as sys;
 use std::ffi::{CStr, CString};
 use std::os::raw::c_void;
 use std::ptr::NonNull;
+use std::sync::Mutex;
+
+pub mod control;
+pub mod record;
+pub mod typed;
+pub use typed::{Interleaved, Period, Planar, Planes, PlanesMut, TypedHost};
 
 #[derive(Clone, Copy, Debug)]
 pub struct StreamConfig {
@@ -14,20 +20,117 @@ pub struct StreamConfig {
     pub interleaved: bool,
 }
 
+impl StreamConfig {
+    /// Whether `space` (from [`Driver::config_space`]) accepts this config, format aside.
+    pub fn fits(&self, space: &sys::oa_config_space) -> bool {
+        let continuous = space.flags & sys::OA_CONFIG_RATE_CONTINUOUS != 0;
+        let rate_ok = if continuous { (space.rate_min..=space.rate_max).contains(&self.sample_rate) }
+            else { space.rates[..space.rate_count as usize].contains(&self.sample_rate) };
+        let step = space.buffer_frames_step.max(1);
+        let buf_ok = (space.buffer_frames_min..=space.buffer_frames_max).contains(&self.buffer_frames)
+            && (self.buffer_frames - space.buffer_frames_min) % step == 0;
+        let ch_ok = |n: u16, mask: u64, max: u32| if n < 64 { mask & (1u64 << n) != 0 } else { n as u32 <= max };
+        let layout = if self.interleaved { sys::oa_buffer_layout::OA_BUF_INTERLEAVED } else { sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED };
+        rate_ok && buf_ok
+            && ch_ok(self.in_channels, space.in_channels, space.in_channels_max)
+            && ch_ok(self.out_channels, space.out_channels, space.out_channels_max)
+            && space.layouts & sys::oa_layout_bit(layout) != 0
+    }
+}
+
+/// One entry of [`Driver::devices`].
+#[derive(Clone, Debug)]
+pub struct DeviceInfo {
+    /// Stable while the device stays plugged in.
+    pub id: u32,
+    /// What [`Driver::open_by_name`] takes.
+    pub name: String,
+    pub description: String,
+    /// Most channels the device offers per direction, 0 if unknown.
+    pub in_channels: u16,
+    pub out_channels: u16,
+    pub is_default: bool,
+}
+
 pub trait HostProcess: Send {
     /// Called on the driver's RT thread. Must be RT-safe.
     fn process(&mut self, inputs: *const c_void, outputs: *mut c_void, frames: u32, cfg: &StreamConfig) -> bool;
+    /// New input/output latency in frames after a sample rate or buffer size change. Drivers
+    /// call it from the reconfiguring thread while `process` is paused.
+    fn latency_changed(&mut self, _input: u32, _output: u32) {}
+    /// Several consecutive periods at once, each with its own `in_`, `out` and time, on a
+    /// stream started after [`Driver::set_batch_periods`]. Runs `process` on each by default.
+    fn process_batch(&mut self, periods: &[sys::oa_batch_period], cfg: &StreamConfig) -> bool {
+        periods.iter().fold(true, |keep, p| self.process(p.in_, p.out, p.frames, cfg) && keep)
+    }
+}
+
+/// Zero-copy access to the device buffers (`OA_CAP_MMAP`), handed out by
+/// [`Driver::enable_mmap`]. Only usable on the RT thread from inside `HostProcess::process`.
+#[derive(Clone, Copy)]
+pub struct MmapAccess {
+    drv: *mut sys::oa_driver,
+    begin: unsafe extern "C" fn(*mut sys::oa_driver, *mut sys::oa_mmap_period) -> i32,
+    commit: unsafe extern "C" fn(*mut sys::oa_driver, u32) -> i32,
+}
+
+// SAFETY: the handle is only dereferenced on the driver's RT thread while the driver is alive.
+unsafe impl Send for MmapAccess {}
+
+impl MmapAccess {
+    /// Device areas for the current period, in the device's native sample format.
+    pub fn begin(&self) -> Option<sys::oa_mmap_period> {
+        let mut p = std::mem::MaybeUninit::<sys::oa_mmap_period>::zeroed();
+        unsafe {
+            (*p.as_mut_ptr()).struct_size = std::mem::size_of::<sys::oa_mmap_period>() as u32;
+            if (self.begin)(self.drv, p.as_mut_ptr()) < 0 { return None; }
+            Some(p.assume_init())
+        }
+    }
+    /// Hands `frames` of the open period back to the device.
+    pub fn commit(&self, frames: u32) -> bool { unsafe { (self.commit)(self.drv, frames) >= 0 } }
 }
 
-struct HostThunk {
-    inner: Box<dyn HostProcess>,
+// `H` is the host itself on the typed path and Box<dyn HostProcess> on the dyn one. The RT
+// thread, the hotplug thread and the control side each use their own fields at the same
+// time, so nobody takes a reference to the whole thunk: every access projects the one field
+// it needs from the raw pointer.
+struct HostThunk<H: ?Sized> {
+    // Control side only.
     cfg: sys::oa_stream_config,
+    // Drivers may keep the pointer from oa_create_params, so it lives as long as the driver.
+    callbacks: sys::oa_host_callbacks,
+    // Runs on the driver's hotplug thread, concurrently with `process`.
+    hotplug: Mutex<Option<Box<dyn Fn() + Send>>>,
+    // Last, so the driver can hold any thunk as HostThunk<dyn Send>.
+    inner: H,
 }
 
+impl<H> HostThunk<H> {
+    /// The host of the thunk the driver passes as `user`, for its RT and latency callbacks.
+    unsafe fn host<'a>(user: *mut c_void) -> &'a mut H {
+        &mut *std::ptr::addr_of_mut!((*(user as *mut HostThunk<H>)).inner)
+    }
+}
+
+type DynThunk = HostThunk<Box<dyn HostProcess>>;
+
 pub struct Driver {
     _lib: sys::loader::DriverLib,
     drv: NonNull<sys::oa_driver>,
-    _host_thunk: Box<HostThunk>,
+    // From Box::into_raw, freed in drop once the driver is closed.
+    thunk: NonNull<HostThunk<dyn Send>>,
+    typed: bool,
+}
+
+fn stream_config(cfg: &sys::oa_stream_config) -> StreamConfig {
+    StreamConfig {
+        sample_rate: cfg.sample_rate,
+        buffer_frames: cfg.buffer_frames,
+        in_channels: cfg.in_channels,
+        out_channels: cfg.out_channels,
+        interleaved: matches!(cfg.layout, sys::oa_buffer_layout::OA_BUF_INTERLEAVED),
+    }
 }
 
 unsafe extern "C" fn cb_process(
@@ -38,42 +141,85 @@ unsafe extern "C" fn cb_process(
     _time: *const sys::oa_time_info,
     cfg: *const sys::oa_stream_config,
 ) -> i32 {
-    let ctx = &mut *(user as *mut HostThunk);
-    let cfg_rust = StreamConfig {
-        sample_rate: (*cfg).sample_rate,
-        buffer_frames: (*cfg).buffer_frames,
-        in_channels: (*cfg).in_channels,
-        out_channels: (*cfg).out_channels,
-        interleaved: matches!((*cfg).layout, sys::oa_buffer_layout::OA_BUF_INTERLEAVED),
-    };
-    if ctx.inner.process(in_ptr, out_ptr, frames, &cfg_rust) { sys::OA_TRUE } else { sys::OA_FALSE }
-}
-unsafe extern "C" fn cb_latency_changed(_user: *mut c_void, _in: u32, _out: u32) {}
+    if DynThunk::host(user).process(in_ptr, out_ptr, frames, &stream_config(&*cfg)) { sys::OA_TRUE } else { sys::OA_FALSE }
+}
+unsafe extern "C" fn cb_process_batch(
+    user: *mut c_void,
+    periods: *const sys::oa_batch_period,
+    count: u32,
+    cfg: *const sys::oa_stream_config,
+) -> i32 {
+    let periods = std::slice::from_raw_parts(periods, count as usize);
+    if DynThunk::host(user).process_batch(periods, &stream_config(&*cfg)) { sys::OA_TRUE } else { sys::OA_FALSE }
+}
+unsafe extern "C" fn cb_latency_changed(user: *mut c_void, input: u32, output: u32) {
+    DynThunk::host(user).latency_changed(input, output);
+}
 unsafe extern "C" fn cb_reset_request(_user: *mut c_void) {}
+unsafe extern "C" fn cb_devices_changed<H>(user: *mut c_void) {
+    let hotplug = &*std::ptr::addr_of!((*(user as *const HostThunk<H>)).hotplug);
+    if let Some(f) = hotplug.lock().unwrap_or_else(|e| e.into_inner()).as_ref() { f(); }
+}
 
 impl Driver {
     pub fn load(path: &str, host: Box<dyn HostProcess>, default_cfg: StreamConfig, interleaved: bool) -> Result<Self> {
+        Self::load_with_rt(path, host, default_cfg, interleaved, None)
+    }
+    /// Like [`Driver::load`], asking the driver to set up its RT thread as `rt` describes
+    /// (scheduling policy, CPU affinity, memory locking). See [`Driver::rt_info`].
+    pub fn load_with_rt(path: &str, host: Box<dyn HostProcess>, default_cfg: StreamConfig, interleaved: bool, rt: Option<sys::oa_rt_params>) -> Result<Self> {
+        let callbacks = sys::oa_host_callbacks { process: Some(cb_process), latency_changed: Some(cb_latency_changed), reset_request: Some(cb_reset_request), devices_changed: Some(cb_devices_changed::<Box<dyn HostProcess>>), process_batch: Some(cb_process_batch) };
+        let layout = if interleaved { sys::oa_buffer_layout::OA_BUF_INTERLEAVED } else { sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED };
+        Self::create(path, host, callbacks, default_cfg, layout, rt, false)
+    }
+    /// Like [`Driver::load`] for a [`TypedHost`]: the driver calls `H::process` directly,
+    /// with slices of its float32 buffers in `H::Layout` (`default_cfg.interleaved` is
+    /// ignored) and its `oa_time_info`. Nothing is converted or boxed per period.
+    pub fn load_typed<H: TypedHost>(path: &str, host: H, default_cfg: StreamConfig) -> Result<Self> {
+        Self::load_typed_with_rt(path, host, default_cfg, None)
+    }
+    /// [`Driver::load_typed`] with the RT thread request of [`Driver::load_with_rt`].
+    pub fn load_typed_with_rt<H: TypedHost>(path: &str, host: H, default_cfg: StreamConfig, rt: Option<sys::oa_rt_params>) -> Result<Self> {
+        Self::create(path, host, typed::callbacks::<H>(), default_cfg, <H::Layout as typed::Layout>::LAYOUT, rt, true)
+    }
+    fn create<H: Send + 'static>(path: &str, host: H, callbacks: sys::oa_host_callbacks, default_cfg: StreamConfig, layout: sys::oa_buffer_layout, rt: Option<sys::oa_rt_params>, typed: bool) -> Result<Self> {
         unsafe {
             let lib = sys::loader::DriverLib::load(path).with_context(|| format!("dlopen({path})"))?;
             let mut drv_ptr: *mut sys::oa_driver = std::ptr::null_mut();
-            let callbacks = sys::oa_host_callbacks { process: Some(cb_process), latency_changed: Some(cb_latency_changed), reset_request: Some(cb_reset_request) };
-            let mut host_thunk = Box::new(HostThunk{
+            let raw = Box::into_raw(Box::new(HostThunk{
                 inner: host,
+                callbacks,
+                hotplug: Mutex::new(None),
                 cfg: sys::oa_stream_config{
                     sample_rate: default_cfg.sample_rate,
                     buffer_frames: default_cfg.buffer_frames,
                     in_channels: default_cfg.in_channels,
                     out_channels: default_cfg.out_channels,
                     format: sys::oa_sample_format::OA_SAMPLE_F32,
-                    layout: if interleaved { sys::oa_buffer_layout::OA_BUF_INTERLEAVED } else { sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED },
+                    layout,
                 },
-            });
-            let params = sys::oa_create_params{ struct_size: std::mem::size_of::<sys::oa_create_params>() as u32, host: &callbacks, host_user: (&mut *host_thunk) as *mut _ as *mut c_void };
+            }));
+            let thunk: NonNull<HostThunk<dyn Send>> = NonNull::new_unchecked(raw);
+            let rt = rt.map(|r| sys::oa_rt_params{ struct_size: std::mem::size_of::<sys::oa_rt_params>() as u32, ..r });
+            let params = sys::oa_create_params{
+                struct_size: std::mem::size_of::<sys::oa_create_params>() as u32,
+                host: std::ptr::addr_of!((*raw).callbacks),
+                host_user: raw as *mut c_void,
+                rt: rt.as_ref().map_or(std::ptr::null(), |r| r as *const _),
+                host_size: std::mem::size_of::<sys::oa_host_callbacks>() as u32,
+            };
             let rc = (lib.create)(&params as *const _, &mut drv_ptr as *mut _);
-            if rc < 0 || drv_ptr.is_null(){ return Err(anyhow!("openasio_driver_create rc={rc}")); }
-            Ok(Self{ _lib: lib, drv: NonNull::new(drv_ptr).unwrap(), _host_thunk: host_thunk })
+            if rc < 0 || drv_ptr.is_null(){
+                drop(Box::from_raw(raw));
+                return Err(anyhow!("openasio_driver_create rc={rc}"));
+            }
+            Ok(Self{ _lib: lib, drv: NonNull::new(drv_ptr).unwrap(), thunk, typed })
         }
     }
+    // The stream config the next start requests, without touching the rest of the thunk.
+    fn cfg(&self) -> *mut sys::oa_stream_config {
+        unsafe { std::ptr::addr_of_mut!((*self.thunk.as_ptr()).cfg) }
+    }
     pub fn caps(&self) -> u32 {
         unsafe { let vt = &*(*self.drv.as_ptr()).vt; (vt.get_caps.unwrap())(self.drv.as_ptr()) }
     }
@@ -87,6 +233,40 @@ impl Driver {
             Ok(list.lines().map(|s| s.to_string()).collect())
         }
     }
+    /// The driver's device list with ids, channel counts and the default device. Drivers
+    /// without `enumerate_devices` get their `query_devices` names with ids in list order.
+    pub fn devices(&self) -> Result<Vec<DeviceInfo>> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let Some(enumerate) = sys::oa_vt_get!(vt, enumerate_devices) else {
+                let names = self.enumerate_devices()?;
+                return Ok(names.into_iter().enumerate().map(|(i, name)| DeviceInfo{
+                    id: i as u32 + 1, is_default: i == 0, name, description: String::new(), in_channels: 0, out_channels: 0,
+                }).collect());
+            };
+            // The list may grow between the two calls; the second one then reports the new count.
+            let mut count = 0u32;
+            let rc = enumerate(self.drv.as_ptr(), std::ptr::null_mut(), 0, &mut count);
+            if rc < 0 { return Err(anyhow!("enumerate_devices rc={rc}")); }
+            let blank: sys::oa_device_info = std::mem::zeroed();
+            let mut infos = vec![sys::oa_device_info{ struct_size: std::mem::size_of::<sys::oa_device_info>() as u32, ..blank }; count as usize + 4];
+            let rc = enumerate(self.drv.as_ptr(), infos.as_mut_ptr(), infos.len() as u32, &mut count);
+            if rc < 0 { return Err(anyhow!("enumerate_devices rc={rc}")); }
+            infos.truncate(count as usize);
+            let text = |b: &[std::os::raw::c_char]| CStr::from_ptr(b.as_ptr()).to_string_lossy().to_string();
+            Ok(infos.iter().map(|d| DeviceInfo{
+                id: d.id, name: text(&d.name), description: text(&d.description),
+                in_channels: d.in_channels, out_channels: d.out_channels,
+                is_default: d.flags & sys::OA_DEVICE_DEFAULT != 0,
+            }).collect())
+        }
+    }
+    /// Called from a driver thread whenever the device list changes; call [`Driver::devices`]
+    /// again to see how. Replaces the previous handler. Not called for drivers without hotplug.
+    pub fn set_hotplug_handler(&self, handler: Option<Box<dyn Fn() + Send>>) {
+        let hotplug = unsafe { &*std::ptr::addr_of!((*self.thunk.as_ptr()).hotplug) };
+        *hotplug.lock().unwrap_or_else(|e| e.into_inner()) = handler;
+    }
     pub fn open_default(&mut self) -> Result<()> { self.open_by_name(None) }
     pub fn open_by_name(&mut self, name: Option<&str>) -> Result<()> {
         unsafe {
@@ -104,15 +284,277 @@ impl Driver {
             let mut c = std::mem::MaybeUninit::<sys::oa_stream_config>::uninit();
             let rc = (vt.get_default_config.unwrap())(self.drv.as_ptr(), c.as_mut_ptr());
             if rc < 0 { return Err(anyhow!("get_default_config rc={rc}")); }
-            let c = c.assume_init();
-            Ok(StreamConfig{
-                sample_rate: c.sample_rate, buffer_frames: c.buffer_frames,
-                in_channels: c.in_channels, out_channels: c.out_channels,
-                interleaved: matches!(c.layout, sys::oa_buffer_layout::OA_BUF_INTERLEAVED),
-            })
+            Ok(stream_config(&c.assume_init()))
+        }
+    }
+    /// Native and accepted sample formats of the open device, as `oa_format_bit` masks.
+    pub fn supported_formats(&self) -> Result<(u32, u32)> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let f32_bit = sys::oa_format_bit(sys::oa_sample_format::OA_SAMPLE_F32);
+            let Some(get) = sys::oa_vt_get!(vt, get_supported_formats) else { return Ok((0, f32_bit)); };
+            let (mut native, mut supported) = (0u32, 0u32);
+            let rc = get(self.drv.as_ptr(), &mut native, &mut supported);
+            if rc < 0 { return Err(anyhow!("get_supported_formats rc={rc}")); }
+            Ok((native, supported))
+        }
+    }
+    /// Every config `device` accepts (`None`: the open device), so one can be chosen without
+    /// trial starts. See [`StreamConfig::fits`].
+    pub fn config_space(&self, device: Option<&str>) -> Result<sys::oa_config_space> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let Some(query) = sys::oa_vt_get!(vt, query_config_space) else { return Err(anyhow!("driver has no query_config_space")); };
+            let c = device.map(|s| CString::new(s).unwrap());
+            let ptr = c.as_ref().map(|c| c.as_ptr()).unwrap_or(std::ptr::null());
+            let mut space = sys::oa_config_space{ struct_size: std::mem::size_of::<sys::oa_config_space>() as u32, ..Default::default() };
+            let rc = query(self.drv.as_ptr(), ptr, &mut space);
+            if rc < 0 { return Err(anyhow!("query_config_space rc={rc}")); }
+            Ok(space)
+        }
+    }
+    /// Sample format requested by the next `start` (float32 by default). A [`TypedHost`]
+    /// only streams float32; other formats panic for it.
+    pub fn set_format(&mut self, format: sys::oa_sample_format) {
+        assert!(!self.typed || format == sys::oa_sample_format::OA_SAMPLE_F32, "typed hosts stream float32");
+        unsafe { (*self.cfg()).format = format };
+    }
+    /// Switches the next `start` to zero-copy mmap mode. Call while stopped.
+    pub fn enable_mmap(&mut self, enable: bool) -> Result<MmapAccess> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            if self.caps() & sys::OA_CAP_MMAP == 0 { return Err(anyhow!("driver lacks OA_CAP_MMAP")); }
+            let (Some(en), Some(begin), Some(commit)) = (sys::oa_vt_get!(vt, mmap_enable), sys::oa_vt_get!(vt, mmap_begin_period), sys::oa_vt_get!(vt, mmap_commit_period))
+                else { return Err(anyhow!("driver vtable lacks mmap entries")); };
+            let rc = en(self.drv.as_ptr(), if enable { sys::OA_TRUE } else { sys::OA_FALSE });
+            if rc < 0 { return Err(anyhow!("mmap_enable rc={rc}")); }
+            Ok(MmapAccess{ drv: self.drv.as_ptr(), begin, commit })
+        }
+    }
+    /// Asks the next `start` to deliver `periods` periods per wakeup through
+    /// `HostProcess::process_batch` (`OA_CAP_BATCH`); 1 turns batching off. Call while stopped.
+    /// Latency grows by the same factor.
+    pub fn set_batch_periods(&mut self, periods: u32) -> Result<()> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let Some(set) = sys::oa_vt_get!(vt, set_batch_periods).filter(|_| self.caps() & sys::OA_CAP_BATCH != 0)
+                else { return Err(anyhow!("driver lacks OA_CAP_BATCH")); };
+            let rc = set(self.drv.as_ptr(), periods);
+            if rc < 0 { return Err(anyhow!("set_batch_periods rc={rc}")); }
+            Ok(())
+        }
+    }
+    /// Asks the next `start` to set aside `bytes` of host scratch beside the stream's buffer arena
+    /// (0 for none); [`Driver::stream_memory`] then says where it is. Call while stopped.
+    pub fn set_host_scratch(&mut self, bytes: usize) -> Result<()> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let Some(set) = sys::oa_vt_get!(vt, set_host_scratch) else { return Err(anyhow!("driver has no set_host_scratch")); };
+            let rc = set(self.drv.as_ptr(), bytes);
+            if rc < 0 { return Err(anyhow!("set_host_scratch rc={rc}")); }
+            Ok(())
+        }
+    }
+    /// Changes the sample rate, in place while streaming if the driver has
+    /// `OA_CAP_SET_SAMPLERATE`; the new latency arrives through `HostProcess::latency_changed`.
+    pub fn set_sample_rate(&mut self, sample_rate: u32) -> Result<()> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            if self.caps() & sys::OA_CAP_SET_SAMPLERATE == 0 { return Err(anyhow!("driver lacks OA_CAP_SET_SAMPLERATE")); }
+            let rc = (vt.set_sample_rate.unwrap())(self.drv.as_ptr(), sample_rate);
+            if rc < 0 { return Err(anyhow!("set_sample_rate rc={rc}")); }
+            (*self.cfg()).sample_rate = sample_rate;
+            Ok(())
+        }
+    }
+    /// Changes the period size; see [`Driver::set_sample_rate`].
+    pub fn set_buffer_frames(&mut self, frames: u32) -> Result<()> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            if self.caps() & sys::OA_CAP_SET_BUFFRAMES == 0 { return Err(anyhow!("driver lacks OA_CAP_SET_BUFFRAMES")); }
+            let rc = (vt.set_buffer_frames.unwrap())(self.drv.as_ptr(), frames);
+            if rc < 0 { return Err(anyhow!("set_buffer_frames rc={rc}")); }
+            (*self.cfg()).buffer_frames = frames;
+            Ok(())
+        }
+    }
+    /// Input/output latency in frames as the driver reports it.
+    pub fn latency(&self) -> Result<(u32, u32)> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let (mut input, mut output) = (0u32, 0u32);
+            let rc = (vt.get_latency.unwrap())(self.drv.as_ptr(), &mut input, &mut output);
+            if rc < 0 { return Err(anyhow!("get_latency rc={rc}")); }
+            Ok((input, output))
+        }
+    }
+    /// Opens and configures the device and parks the RT thread, so that [`Driver::start`] or
+    /// [`Driver::resume`] only has to start the device. Errors if the driver lacks warm start.
+    pub fn prepare(&mut self) -> Result<()> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let Some(prepare) = sys::oa_vt_get!(vt, prepare) else { return Err(anyhow!("driver has no prepare")); };
+            let rc = prepare(self.drv.as_ptr(), self.cfg());
+            if rc < 0 { return Err(anyhow!("prepare rc={rc}")); }
+            Ok(())
+        }
+    }
+    /// Stops `process` after the current period; the device stays open and configured.
+    pub fn pause(&mut self) -> Result<()> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let Some(pause) = sys::oa_vt_get!(vt, pause) else { return Err(anyhow!("driver has no pause")); };
+            let rc = pause(self.drv.as_ptr());
+            if rc < 0 { return Err(anyhow!("pause rc={rc}")); }
+            Ok(())
+        }
+    }
+    /// Restarts a prepared or paused stream.
+    pub fn resume(&mut self) -> Result<()> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let Some(resume) = sys::oa_vt_get!(vt, resume) else { return Err(anyhow!("driver has no resume")); };
+            let rc = resume(self.drv.as_ptr());
+            if rc < 0 { return Err(anyhow!("resume rc={rc}")); }
+            Ok(())
+        }
+    }
+    pub fn start(&mut self) -> Result<()> { unsafe { let vt = &*(*self.drv.as_ptr()).vt; (vt.start.unwrap())(self.drv.as_ptr(), self.cfg()); Ok(()) } }
+    /// RT thread setup the running stream was granted; `None` while stopped or when the
+    /// driver does not manage its own thread.
+    pub fn rt_info(&self) -> Option<sys::oa_rt_info> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let get = sys::oa_vt_get!(vt, get_rt_info)?;
+            let mut info = sys::oa_rt_info{ struct_size: std::mem::size_of::<sys::oa_rt_info>() as u32, ..Default::default() };
+            if get(self.drv.as_ptr(), &mut info) < 0 { return None; }
+            Some(info)
+        }
+    }
+    /// Telemetry of the current or last stream (`get_stream_stats`). Cheap and safe to poll
+    /// from a monitoring thread while streaming.
+    pub fn stream_stats(&self) -> Option<sys::oa_stream_stats> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let get = sys::oa_vt_get!(vt, get_stream_stats)?;
+            let mut s = std::mem::MaybeUninit::<sys::oa_stream_stats>::zeroed();
+            (*s.as_mut_ptr()).struct_size = std::mem::size_of::<sys::oa_stream_stats>() as u32;
+            if get(self.drv.as_ptr(), s.as_mut_ptr()) < 0 { return None; }
+            Some(s.assume_init())
+        }
+    }
+    /// Scheduling and period of the running stream's RT thread, to create a [`WorkGroup`]
+    /// with. `None` while stopped.
+    pub fn thread_params(&self) -> Option<sys::oa_thread_params> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let get = sys::oa_vt_get!(vt, get_thread_params)?;
+            let mut p = sys::oa_thread_params{ struct_size: std::mem::size_of::<sys::oa_thread_params>() as u32, ..Default::default() };
+            if get(self.drv.as_ptr(), &mut p) < 0 { return None; }
+            Some(p)
+        }
+    }
+    /// The prepared or running stream's buffer arena and the host scratch beside it; `None`
+    /// while stopped or when the driver has none. The scratch is valid until `stop`.
+    pub fn stream_memory(&self) -> Option<sys::oa_stream_memory> {
+        unsafe {
+            let vt = &*(*self.drv.as_ptr()).vt;
+            let get = sys::oa_vt_get!(vt, get_stream_memory)?;
+            let mut m = std::mem::MaybeUninit::<sys::oa_stream_memory>::zeroed();
+            (*m.as_mut_ptr()).struct_size = std::mem::size_of::<sys::oa_stream_memory>() as u32;
+            if get(self.drv.as_ptr(), m.as_mut_ptr()) < 0 { return None; }
+            Some(m.assume_init())
         }
     }
-    pub fn start(&mut self) -> Result<()> { unsafe { let vt = &*(*self.drv.as_ptr()).vt; (vt.start.unwrap())(self.drv.as_ptr(), &(*self._host_thunk).cfg as *const _); Ok(()) } }
     pub fn stop(&mut self) { unsafe { let vt = &*(*self.drv.as_ptr()).vt; let _=(vt.stop.unwrap())(self.drv.as_ptr()); } }
 }
-impl Drop for Driver { fn drop(&mut self) { unsafe { let vt=&*(*self.drv.as_ptr()).vt; let _=(vt.close_device.unwrap())(self.drv.as_ptr()); } } }
+impl Drop for Driver {
+    fn drop(&mut self) {
+        unsafe {
+            let vt=&*(*self.drv.as_ptr()).vt;
+            let _=(vt.close_device.unwrap())(self.drv.as_ptr());
+            drop(Box::from_raw(self.thunk.as_ptr()));
+        }
+    }
+}
+
+/// RT helper threads that let `process` spread independent jobs over several cores
+/// (`openasio_workgroup.h`). Create it outside `process`, typically from
+/// [`Driver::thread_params`] once the stream runs, and move it into the [`HostProcess`].
+pub struct WorkGroup { wg: NonNull<sys::workgroup::oa_workgroup> }
+unsafe impl Send for WorkGroup {}
+impl WorkGroup {
+    /// `workers` helper threads (0 = one per usable CPU, minus the caller's) scheduled like
+    /// the thread `params` describes; plain threads with `None`.
+    pub fn new(params: Option<&sys::oa_thread_params>, workers: u32) -> Result<Self> {
+        let mut wg = std::ptr::null_mut();
+        let rc = unsafe { sys::workgroup::oa_workgroup_create(params.map_or(std::ptr::null(), |p| p as *const _), workers, &mut wg) };
+        if rc < 0 { return Err(anyhow!("oa_workgroup_create rc={rc}")); }
+        Ok(Self{ wg: NonNull::new(wg).unwrap() })
+    }
+    /// Threads that run jobs, the caller of [`WorkGroup::run`] included.
+    pub fn size(&self) -> u32 { unsafe { sys::workgroup::oa_workgroup_size(self.wg.as_ptr()) } }
+    /// errno of the first scheduling request the system refused, 0 if all were granted.
+    pub fn error(&self) -> i32 { unsafe { sys::workgroup::oa_workgroup_error(self.wg.as_ptr()) } }
+    /// Runs `job(index, worker)` for every index in `0..count` and returns once all are done;
+    /// the calling thread is worker 0. RT-safe. `false` if `count` exceeds `OA_WORKGROUP_MAX_JOBS`.
+    pub fn run<F: Fn(u32, u32) + Sync>(&mut self, count: u32, job: F) -> bool {
+        unsafe extern "C" fn call<F: Fn(u32, u32) + Sync>(ctx: *mut c_void, index: u32, worker: u32) {
+            (*(ctx as *const F))(index, worker)
+        }
+        unsafe { sys::workgroup::oa_workgroup_run(self.wg.as_ptr(), call::<F>, &job as *const F as *mut c_void, count) >= 0 }
+    }
+}
+impl Drop for WorkGroup { fn drop(&mut self) { unsafe { sys::workgroup::oa_workgroup_destroy(self.wg.as_ptr()) } } }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::atomic::{AtomicU32, Ordering};
+
+    // Every index of every batch runs exactly once, on a worker the group has, whether the
+    // batch is smaller than the group, uneven, or as large as a batch may be.
+    #[test]
+    fn workgroup_runs_each_job_once() {
+        let mut wg = WorkGroup::new(None, 3).unwrap();
+        assert_eq!(wg.size(), 4);
+        let max = sys::workgroup::OA_WORKGROUP_MAX_JOBS;
+        let runs: Vec<AtomicU32> = (0..max).map(|_| AtomicU32::new(0)).collect();
+        for round in 0..200u32 {
+            let count = [0, 1, 2, 3, 5, 64, 1000, max][round as usize % 8];
+            let size = wg.size();
+            assert!(wg.run(count, |i, worker| {
+                assert!(worker < size);
+                runs[i as usize].fetch_add(1, Ordering::Relaxed);
+            }));
+            for (i, n) in runs.iter().enumerate() {
+                assert_eq!(n.swap(0, Ordering::Relaxed), (i < count as usize) as u32, "round {round} job {i}");
+            }
+        }
+        assert!(!wg.run(max + 1, |_, _| {}));
+    }
+
+    // The CPUs this process may run on, from `Cpus_allowed_list` ("0-3,6").
+    fn allowed_cpus() -> Vec<u32> {
+        let status = std::fs::read_to_string("/proc/self/status").unwrap();
+        let list = status.lines().find_map(|l| l.strip_prefix("Cpus_allowed_list:")).unwrap();
+        list.trim().split(',').flat_map(|range| {
+            let (a, b) = range.split_once('-').unwrap_or((range, range));
+            a.parse().unwrap()..=b.parse::<u32>().unwrap()
+        }).collect()
+    }
+
+    #[test]
+    fn workgroup_leaves_a_single_pinned_cpu_alone() {
+        // Pinned to one of the process's own CPUs, the helpers get exactly the rest.
+        let cpus = allowed_cpus();
+        let mut p = sys::oa_thread_params{ struct_size: std::mem::size_of::<sys::oa_thread_params>() as u32, ..Default::default() };
+        p.affinity.cpus[cpus[0] as usize / 64] = 1 << (cpus[0] % 64);
+        let others = cpus.len() as u32 - 1;
+        let wg = WorkGroup::new(Some(&p), 0).unwrap();
+        assert_eq!(wg.size(), others.min(sys::workgroup::OA_WORKGROUP_MAX_WORKERS - 1) + 1);
+        if others == 0 {
+            assert!(WorkGroup::new(Some(&p), 2).is_err());
+        }
+    }
+}
@@ -0,0 +1,152 @@
+//! Capture to disk (`openasio_record.h`). [`record`] creates the file and returns the two
+//! ends: a [`RecordInput`] to move into `process`, where each push is one copy into a ring
+//! with no syscalls, and the [`Recorder`], polled for backpressure and finished from a
+//! control thread. The SDK's writer thread drains the ring with io_uring into WAV/RF64/CAF.
+use crate::typed::Planes;
+use anyhow::{anyhow, Result};
+use openasio_sys::{self as sys, record as r};
+use std::ffi::CString;
+use std::os::raw::c_void;
+use std::path::Path;
+use std::sync::Arc;
+
+pub use r::oa_record_stats as RecordStats;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Container {
+    /// Promoted to RF64 on finish past 4 GiB.
+    Wav,
+    Rf64,
+    /// Readable up to the last completed write even if never finished.
+    Caf,
+}
+
+/// Tuning of [`record`]; zeros take the SDK defaults.
+#[derive(Clone, Debug)]
+pub struct RecordOptions {
+    pub container: Container,
+    /// Use O_DIRECT where the filesystem allows it.
+    pub direct: bool,
+    /// Fail instead of falling back to pwrite when io_uring is unavailable.
+    pub require_uring: bool,
+    pub ring_ms: u32,
+    pub chunk_bytes: u32,
+    pub queue_depth: u32,
+    pub prealloc_bytes: u64,
+}
+
+impl Default for RecordOptions {
+    fn default() -> Self {
+        Self{ container: Container::Wav, direct: true, require_uring: false, ring_ms: 0, chunk_bytes: 0, queue_depth: 0, prealloc_bytes: 0 }
+    }
+}
+
+struct Rec(*mut r::oa_recorder);
+// SAFETY: pushes come from the single RecordInput; everything else is thread-safe in C.
+unsafe impl Send for Rec {}
+unsafe impl Sync for Rec {}
+impl Drop for Rec { fn drop(&mut self) { unsafe { r::oa_recorder_destroy(self.0) } } }
+
+/// Starts recording `channels` interleaved channels of `format` at `sample_rate` to `path`.
+pub fn record(path: impl AsRef<Path>, format: sys::oa_sample_format, channels: u32, sample_rate: u32, opts: &RecordOptions) -> Result<(Recorder, RecordInput)> {
+    let cpath = CString::new(path.as_ref().to_string_lossy().as_bytes())?;
+    let params = r::oa_record_params{
+        container: match opts.container { Container::Wav => r::OA_REC_WAV, Container::Rf64 => r::OA_REC_RF64, Container::Caf => r::OA_REC_CAF },
+        io: if opts.require_uring { r::OA_REC_IO_URING } else { r::OA_REC_IO_AUTO },
+        flags: if opts.direct { r::OA_REC_DIRECT } else { 0 },
+        format, channels, sample_rate,
+        ring_ms: opts.ring_ms, chunk_bytes: opts.chunk_bytes, queue_depth: opts.queue_depth, prealloc_bytes: opts.prealloc_bytes,
+    };
+    let mut rec = std::ptr::null_mut();
+    let rc = unsafe { r::oa_recorder_create(cpath.as_ptr(), &params, &mut rec) };
+    if rc < 0 { return Err(anyhow!("oa_recorder_create({}) rc={rc}", path.as_ref().display())); }
+    let rec = Arc::new(Rec(rec));
+    let frame_bytes = sys::oa_sample_bytes(format) * channels;
+    Ok((Recorder{ rec: rec.clone() }, RecordInput{ rec, frame_bytes, channels }))
+}
+
+/// The control end: statistics and finishing.
+pub struct Recorder { rec: Arc<Rec> }
+impl Recorder {
+    /// Counters and ring fill; `frames_dropped` growing means the disk is not keeping up.
+    pub fn stats(&self) -> RecordStats {
+        let mut s = RecordStats::default();
+        unsafe { r::oa_recorder_stats(self.rec.0, &mut s) };
+        s
+    }
+    /// Writes out what was pushed, finalizes the header and closes the file. Stop pushing
+    /// first. Dropping both ends finishes too, without reporting errors.
+    pub fn finish(&mut self) -> Result<RecordStats> {
+        let rc = unsafe { r::oa_recorder_finish(self.rec.0) };
+        let s = self.stats();
+        if rc < 0 { return Err(anyhow!("recording failed: errno {}", s.error)); }
+        Ok(s)
+    }
+}
+
+/// The RT end; every call is RT-safe. A push that does not fit in the ring is dropped
+/// whole and returns `false`.
+pub struct RecordInput { rec: Arc<Rec>, frame_bytes: u32, channels: u32 }
+impl RecordInput {
+    /// Whole interleaved frames of the recorder's format, e.g. a `process` buffer.
+    pub fn push<T: Copy>(&mut self, interleaved: &[T]) -> bool {
+        let frames = std::mem::size_of_val(interleaved) as u32 / self.frame_bytes;
+        unsafe { r::oa_recorder_push(self.rec.0, interleaved.as_ptr() as *const c_void, frames) != 0 }
+    }
+    /// A float32 planar period, interleaved on the way into the ring. Panics unless it has
+    /// the recorder's channel count.
+    pub fn push_planes(&mut self, planes: &Planes<'_>) -> bool {
+        assert_eq!(planes.channels(), self.channels as usize, "planes recorded");
+        unsafe { r::oa_recorder_push_planar(self.rec.0, planes.raw() as *const *const c_void, planes.frames() as u32) != 0 }
+    }
+    /// # Safety
+    /// `planes` holds one pointer per channel to `frames` samples each, as `process` gets them.
+    pub unsafe fn push_planar_raw(&mut self, planes: *const *const c_void, frames: u32) -> bool {
+        r::oa_recorder_push_planar(self.rec.0, planes, frames) != 0
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // Pushes a known signal, interleaved and planar, through a small chunk and preallocation
+    // step, and reads the file back.
+    fn round_trip(container: Container) {
+        let path = std::env::temp_dir().join(format!("openasio-record-{}-{container:?}", std::process::id()));
+        let opts = RecordOptions{ container, chunk_bytes: 64 << 10, prealloc_bytes: 256 << 10, ..Default::default() };
+        let (mut rec, mut input) = record(&path, sys::oa_sample_format::OA_SAMPLE_F32, 3, 48000, &opts).unwrap();
+        let mut sent = Vec::new();
+        for round in 0..1000u32 {
+            let frames = if round == 999 { 77 } else { 256 };
+            let period: Vec<f32> = (0..frames * 3).map(|i| (round * 1000 + i) as f32).collect();
+            let planes: Vec<Vec<f32>> = (0..3).map(|c| period.iter().skip(c).step_by(3).copied().collect()).collect();
+            let ptrs: Vec<*const c_void> = planes.iter().map(|p| p.as_ptr() as *const c_void).collect();
+            while !if round % 2 == 0 { input.push(&period) } else { unsafe { input.push_planar_raw(ptrs.as_ptr(), frames) } } {
+                std::thread::sleep(std::time::Duration::from_millis(1));
+            }
+            sent.extend_from_slice(&period);
+        }
+        let stats = rec.finish().unwrap();
+        assert_eq!(stats.frames_pushed, sent.len() as u64 / 3);
+        assert_eq!(stats.frames_written, stats.frames_pushed);
+
+        let file = std::fs::read(&path).unwrap();
+        std::fs::remove_file(&path).unwrap();
+        let block = r::OA_REC_BLOCK as usize;
+        let bytes = sent.len() * 4;
+        assert_eq!(file.len(), block + bytes);
+        match container {
+            Container::Caf => assert_eq!(u64::from_be_bytes(file[block - 12..block - 4].try_into().unwrap()), bytes as u64 + 4),
+            _ => assert_eq!(u32::from_le_bytes(file[block - 4..block].try_into().unwrap()), bytes as u32),
+        }
+        let got: Vec<f32> = file[block..].chunks_exact(4).map(|b| f32::from_le_bytes(b.try_into().unwrap())).collect();
+        assert!(got == sent, "{container:?} data differs");
+    }
+
+    #[test]
+    fn wav_round_trip() { round_trip(Container::Wav) }
+
+    #[test]
+    fn caf_round_trip() { round_trip(Container::Caf) }
+}
@@ -0,0 +1,147 @@
+//! Monomorphised host path: [`TypedHost`] gets borrowed f32 views of the driver's buffers
+//! and its `oa_time_info`, with the layout fixed at compile time. See [`crate::Driver::load_typed`].
+use crate::HostThunk;
+use openasio_sys as sys;
+use std::marker::PhantomData;
+use std::os::raw::c_void;
+
+/// Buffer layout of a [`TypedHost`]: [`Interleaved`] or [`Planar`].
+pub trait Layout: 'static {
+    const LAYOUT: sys::oa_buffer_layout;
+    /// Capture samples of one period.
+    type In<'a>;
+    /// Playback samples of one period.
+    type Out<'a>;
+    /// # Safety
+    /// `in_ptr`/`out_ptr` are what the driver passed to `process` for `cfg`, valid for 'a.
+    #[doc(hidden)]
+    unsafe fn views<'a>(in_ptr: *const c_void, out_ptr: *mut c_void, frames: u32, cfg: &sys::oa_stream_config) -> (Self::In<'a>, Self::Out<'a>);
+}
+
+/// `frames * channels` samples, frame-major.
+pub struct Interleaved;
+/// One plane of `frames` samples per channel.
+pub struct Planar;
+
+impl Layout for Interleaved {
+    const LAYOUT: sys::oa_buffer_layout = sys::oa_buffer_layout::OA_BUF_INTERLEAVED;
+    type In<'a> = &'a [f32];
+    type Out<'a> = &'a mut [f32];
+    unsafe fn views<'a>(in_ptr: *const c_void, out_ptr: *mut c_void, frames: u32, cfg: &sys::oa_stream_config) -> (&'a [f32], &'a mut [f32]) {
+        let input = if in_ptr.is_null() { &[][..] } else { std::slice::from_raw_parts(in_ptr as *const f32, frames as usize * cfg.in_channels as usize) };
+        let output = if out_ptr.is_null() { &mut [][..] } else { std::slice::from_raw_parts_mut(out_ptr as *mut f32, frames as usize * cfg.out_channels as usize) };
+        (input, output)
+    }
+}
+
+impl Layout for Planar {
+    const LAYOUT: sys::oa_buffer_layout = sys::oa_buffer_layout::OA_BUF_NONINTERLEAVED;
+    type In<'a> = Planes<'a>;
+    type Out<'a> = PlanesMut<'a>;
+    unsafe fn views<'a>(in_ptr: *const c_void, out_ptr: *mut c_void, frames: u32, cfg: &sys::oa_stream_config) -> (Planes<'a>, PlanesMut<'a>) {
+        let input = Planes{ planes: in_ptr as *const *const f32, channels: if in_ptr.is_null() { 0 } else { cfg.in_channels as usize }, frames: frames as usize, _borrow: PhantomData };
+        let output = PlanesMut{ planes: out_ptr as *const *mut f32, channels: if out_ptr.is_null() { 0 } else { cfg.out_channels as usize }, frames: frames as usize, _borrow: PhantomData };
+        (input, output)
+    }
+}
+
+/// Capture planes of one period. Slices are made on access; nothing is collected.
+#[derive(Clone, Copy)]
+pub struct Planes<'a> { planes: *const *const f32, channels: usize, frames: usize, _borrow: PhantomData<&'a [f32]> }
+
+impl<'a> Planes<'a> {
+    pub fn channels(&self) -> usize { self.channels }
+    pub fn frames(&self) -> usize { self.frames }
+    /// Samples of `channel`; panics past [`Planes::channels`].
+    pub fn channel(&self, channel: usize) -> &'a [f32] {
+        assert!(channel < self.channels, "capture channel {channel} of {}", self.channels);
+        unsafe { std::slice::from_raw_parts(*self.planes.add(channel), self.frames) }
+    }
+    pub fn iter(&self) -> impl Iterator<Item = &'a [f32]> + '_ { (0..self.channels).map(|c| self.channel(c)) }
+    pub(crate) fn raw(&self) -> *const *const f32 { self.planes }
+}
+
+/// Playback planes of one period. The driver's planes never overlap, so every channel can
+/// be borrowed mutably at once through [`PlanesMut::iter_mut`].
+pub struct PlanesMut<'a> { planes: *const *mut f32, channels: usize, frames: usize, _borrow: PhantomData<&'a mut [f32]> }
+
+impl<'a> PlanesMut<'a> {
+    pub fn channels(&self) -> usize { self.channels }
+    pub fn frames(&self) -> usize { self.frames }
+    /// Samples of `channel`; panics past [`PlanesMut::channels`].
+    pub fn channel(&self, channel: usize) -> &[f32] {
+        assert!(channel < self.channels, "playback channel {channel} of {}", self.channels);
+        unsafe { std::slice::from_raw_parts(*self.planes.add(channel), self.frames) }
+    }
+    pub fn channel_mut(&mut self, channel: usize) -> &mut [f32] {
+        assert!(channel < self.channels, "playback channel {channel} of {}", self.channels);
+        unsafe { std::slice::from_raw_parts_mut(*self.planes.add(channel), self.frames) }
+    }
+    pub fn iter_mut(&mut self) -> impl Iterator<Item = &mut [f32]> + '_ {
+        let (planes, frames) = (self.planes, self.frames);
+        (0..self.channels).map(move |c| unsafe { std::slice::from_raw_parts_mut(*planes.add(c), frames) })
+    }
+}
+
+/// One period as the driver hands it to `process`, borrowed for the length of the call.
+pub struct Period<'a, L: Layout> {
+    pub input: L::In<'a>,
+    pub output: L::Out<'a>,
+    pub frames: u32,
+    /// As filled by the driver; the 1.1 fields are valid with `OA_CAP_TIME_INFO_EX`.
+    pub time: &'a sys::oa_time_info,
+    pub cfg: &'a sys::oa_stream_config,
+}
+
+/// Host for [`crate::Driver::load_typed`]. Streams float32 in the layout `Layout`. Its callbacks are
+/// called directly from the driver's C entry points, with no `dyn` call or conversion between.
+pub trait TypedHost: Send + 'static {
+    type Layout: Layout;
+    /// Called on the driver's RT thread. Must be RT-safe. mmap streams get empty views.
+    fn process(&mut self, period: Period<'_, Self::Layout>) -> bool;
+    /// As [`crate::HostProcess::latency_changed`].
+    fn latency_changed(&mut self, _input: u32, _output: u32) {}
+    /// A batch of consecutive periods ([`crate::Driver::set_batch_periods`]). Runs `process` on
+    /// each by default.
+    fn process_batch(&mut self, periods: &[sys::oa_batch_period], cfg: &sys::oa_stream_config) -> bool {
+        periods.iter().fold(true, |keep, p| unsafe {
+            let (input, output) = Self::Layout::views(p.in_, p.out, p.frames, cfg);
+            self.process(Period{ input, output, frames: p.frames, time: &*p.time, cfg }) && keep
+        })
+    }
+}
+
+unsafe extern "C" fn cb_process<H: TypedHost>(
+    user: *mut c_void,
+    in_ptr: *const c_void,
+    out_ptr: *mut c_void,
+    frames: u32,
+    time: *const sys::oa_time_info,
+    cfg: *const sys::oa_stream_config,
+) -> i32 {
+    let cfg = &*cfg;
+    let (input, output) = H::Layout::views(in_ptr, out_ptr, frames, cfg);
+    if HostThunk::<H>::host(user).process(Period{ input, output, frames, time: &*time, cfg }) { sys::OA_TRUE } else { sys::OA_FALSE }
+}
+unsafe extern "C" fn cb_process_batch<H: TypedHost>(
+    user: *mut c_void,
+    periods: *const sys::oa_batch_period,
+    count: u32,
+    cfg: *const sys::oa_stream_config,
+) -> i32 {
+    let periods = std::slice::from_raw_parts(periods, count as usize);
+    if HostThunk::<H>::host(user).process_batch(periods, &*cfg) { sys::OA_TRUE } else { sys::OA_FALSE }
+}
+unsafe extern "C" fn cb_latency_changed<H: TypedHost>(user: *mut c_void, input: u32, output: u32) {
+    HostThunk::<H>::host(user).latency_changed(input, output);
+}
+
+pub(crate) fn callbacks<H: TypedHost>() -> sys::oa_host_callbacks {
+    sys::oa_host_callbacks {
+        process: Some(cb_process::<H>),
+        latency_changed: Some(cb_latency_changed::<H>),
+        reset_request: Some(crate::cb_reset_request),
+        devices_changed: Some(crate::cb_devices_changed::<H>),
+        process_batch: Some(cb_process_batch::<H>),
+    }
+}
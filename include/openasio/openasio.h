@@ -1,19 +1,19 @@
 /*
  OpenASIO: permissive, ASIO-like realtime audio driver ABI.
- Version: 0.2.0 (draft) — NOT affiliated with Steinberg ASIO®.
+ Version: 1.1.0 — NOT affiliated with Steinberg ASIO®.
  License: MIT OR Apache-2.0
 */
 #ifndef OPENASIO_H
 #define OPENASIO_H
 #ifdef __cplusplus
-extern "C" { 
+extern "C" {
 #endif
 
 #include <stdint.h>
 #include <stddef.h>
 
-#define OA_VERSION_MAJOR 0
-#define OA_VERSION_MINOR 2
+#define OA_VERSION_MAJOR 1
+#define OA_VERSION_MINOR 1
 #define OA_VERSION_PATCH 0
 
 #if defined(_WIN32) || defined(__CYGWIN__)
@@ -30,33 +30,52 @@ typedef int32_t oa_bool;
 enum { OA_FALSE = 0, OA_TRUE = 1 };
 
 typedef enum {
-  OA_OK             =  0,
-  OA_ERR_GENERIC    = -1,
-  OA_ERR_UNSUPPORTED= -2,
-  OA_ERR_INVALID_ARG= -3,
-  OA_ERR_DEVICE     = -4,
-  OA_ERR_BACKEND    = -5,
-  OA_ERR_STATE      = -6,
+  OA_OK              =  0,
+  OA_ERR_GENERIC     = -1,
+  OA_ERR_UNSUPPORTED = -2,
+  OA_ERR_INVALID_ARG = -3,
+  OA_ERR_DEVICE      = -4,
+  OA_ERR_BACKEND     = -5,
+  OA_ERR_STATE       = -6,
 } oa_result;
 
 typedef enum {
-  OA_SAMPLE_F32 = 1,   // native float32 [-1,+1]
-  OA_SAMPLE_I16 = 2,
-  OA_SAMPLE_U16 = 3,
+  OA_SAMPLE_F32       = 1, // native float32 [-1,+1]
+  OA_SAMPLE_I16       = 2,
+  OA_SAMPLE_U16       = 3,
+  OA_SAMPLE_I32       = 4, // signed 32-bit, full scale
+  OA_SAMPLE_I24_3LE   = 5, // packed 24-bit little endian, 3 bytes per sample
+  OA_SAMPLE_I24_IN_32 = 6, // 24-bit in the low bits of a 32-bit container (ALSA S24_LE)
 } oa_sample_format;
 
+// Bit for `format` in the masks returned by get_supported_formats.
+#define OA_FORMAT_BIT(format) (1u << (uint32_t)(format))
+
+// Bytes per sample container (0 for unknown formats).
+static inline uint32_t oa_sample_bytes(oa_sample_format f) {
+  switch (f) {
+    case OA_SAMPLE_I16: case OA_SAMPLE_U16: return 2;
+    case OA_SAMPLE_I24_3LE: return 3;
+    case OA_SAMPLE_F32: case OA_SAMPLE_I32: case OA_SAMPLE_I24_IN_32: return 4;
+    default: return 0;
+  }
+}
+
 typedef enum {
-  OA_BUF_INTERLEAVED   = 1, // frames*channels
-  OA_BUF_NONINTERLEAVED= 2, // array of channel pointers
+  OA_BUF_INTERLEAVED    = 1, // frames*channels
+  OA_BUF_NONINTERLEAVED = 2, // array of channel pointers
 } oa_buffer_layout;
 
 // Capability bitfield (bitwise OR)
 typedef enum {
-  OA_CAP_OUTPUT        = 1<<0,
-  OA_CAP_INPUT         = 1<<1,
-  OA_CAP_FULL_DUPLEX   = 1<<2,
-  OA_CAP_SET_SAMPLERATE= 1<<3,
-  OA_CAP_SET_BUFFRAMES = 1<<4,
+  OA_CAP_OUTPUT         = 1<<0,
+  OA_CAP_INPUT          = 1<<1,
+  OA_CAP_FULL_DUPLEX    = 1<<2,
+  OA_CAP_SET_SAMPLERATE = 1<<3,
+  OA_CAP_SET_BUFFRAMES  = 1<<4,
+  OA_CAP_MMAP           = 1<<5, // zero-copy device buffers (mmap_* entries)
+  OA_CAP_TIME_INFO_EX   = 1<<6, // oa_time_info carries the 1.1 fields
+  OA_CAP_BATCH          = 1<<7, // several periods per wakeup (set_batch_periods)
 } oa_caps;
 
 typedef struct {
@@ -68,16 +87,73 @@ typedef struct {
   oa_buffer_layout layout;  // interleaved/non-interleaved
 } oa_stream_config;
 
+// Timing of the period passed to process(). With OA_TIME_HW_TIMESTAMP, host_time_ns is when
+// the period's first frame passed the converter: sampled (streams with input) or played
+// (output only).
 typedef struct {
-  uint64_t host_time_ns;    // host monotonic time
+  uint64_t host_time_ns;    // host monotonic time (CLOCK_MONOTONIC on POSIX)
   uint64_t device_time_ns;  // device clock (0 if unknown)
   uint32_t underruns;       // since last callback
   uint32_t overruns;        // since last callback
+  // ---- 1.1 additions (present only if get_caps() has OA_CAP_TIME_INFO_EX) ----
+  uint32_t struct_size;     // sizeof(oa_time_info) as filled by the driver
+  uint32_t flags;           // OA_TIME_*
+  uint64_t frame_position;  // frames passed to process() since start(), before this period
+  double   rate_ratio;      // measured device rate / nominal sample_rate (1.0 until locked)
+  // Frames lost to xrun recovery since the previous callback; read only if struct_size
+  // covers them. A recorder inserts in_dropped frames ahead of this period's input to keep
+  // a take on the device timeline.
+  uint32_t in_dropped;      // captured but never passed to process, just before this input
+  uint32_t out_dropped;     // earlier process output the device discarded unplayed
+  uint32_t out_inserted;    // device time (silence, stopped) ahead of this period's output
 } oa_time_info;
 
+enum {
+  OA_TIME_HW_TIMESTAMP = 1u << 0, // host_time_ns derives from a device timestamp
+  OA_TIME_DEVICE_TIME  = 1u << 1, // device_time_ns is valid
+  OA_TIME_RATE_LOCKED  = 1u << 2, // rate_ratio has converged
+};
+
+// One channel inside a device DMA area (mirrors snd_pcm_channel_area_t).
+typedef struct {
+  void    *addr;            // first sample of this channel for the current period
+  uint32_t step;            // distance between consecutive samples, in bytes
+} oa_mmap_channel;
+
+typedef enum {
+  OA_MMAP_FLOAT      = 1<<0, // IEEE float samples (otherwise signed integer)
+  OA_MMAP_BIG_ENDIAN = 1<<1,
+} oa_mmap_flags;
+
+// Device area for one period; valid between mmap_begin_period and mmap_commit_period.
+typedef struct {
+  uint32_t struct_size;     // set by host to sizeof(oa_mmap_period)
+  uint32_t frames;          // frames available in both directions
+  uint16_t in_channels;     // entries in `in` (0 if not capturing)
+  uint16_t out_channels;    // entries in `out` (0 if not playing)
+  uint16_t sample_bits;     // significant bits per sample
+  uint16_t sample_bytes;    // bytes per sample container
+  uint32_t flags;           // OR of oa_mmap_flags
+  const oa_mmap_channel *in;
+  const oa_mmap_channel *out;
+} oa_mmap_period;
+
 struct oa_driver;
 typedef struct oa_driver oa_driver;
 
+// Most periods one process_batch call may carry.
+#define OA_BATCH_MAX_PERIODS 64
+
+// One period of a batch, in the same terms process() gets it. The periods of a batch are
+// consecutive: periods[i + 1].time->frame_position follows on periods[i].
+typedef struct {
+  const void *in;           // as process(): samples, or const void** planes; NULL without input
+  void *out;                // samples, or void** planes
+  uint32_t frames;          // cfg->buffer_frames
+  uint32_t reserved;
+  const oa_time_info *time;
+} oa_batch_period;
+
 // Host callbacks: invoked by the driver on its RT thread.
 typedef struct {
   // In non-interleaved mode: `in` is const void** (one per input ch), `out` is void** (one per output ch).
@@ -90,13 +166,168 @@ typedef struct {
                      const oa_stream_config *cfg);
   void (*latency_changed)(void *user, uint32_t input_latency, uint32_t output_latency); // optional
   void (*reset_request)(void *user); // optional
+  // ---- 1.1 additions (read only if oa_create_params.host_size covers them) ----
+  // Optional. The device list changed (hotplug). Called on a driver thread, never the RT
+  // one, once the host has enumerated devices; enumerate_devices has the new list.
+  void (*devices_changed)(void *user);
+  // Optional. Replaces process() once set_batch_periods has asked for more than one period
+  // per wakeup: `count` (1..the requested number) consecutive periods, all due now. Must
+  // return as process() does; OA_FALSE stops the stream after this batch.
+  oa_bool (*process_batch)(void *user,
+                           const oa_batch_period *periods,
+                           uint32_t count,
+                           const oa_stream_config *cfg);
 } oa_host_callbacks;
 
+// Scheduling for the driver's RT thread (1.1). OA_RT_POLICY_DEFAULT leaves it as created.
+typedef enum {
+  OA_RT_POLICY_DEFAULT = 0,
+  OA_RT_POLICY_OTHER   = 1, // SCHED_OTHER
+  OA_RT_POLICY_FIFO    = 2, // SCHED_FIFO at `priority`
+  OA_RT_POLICY_RR      = 3, // SCHED_RR at `priority`
+} oa_rt_policy;
+
+enum {
+  OA_RT_MLOCK    = 1u << 0, // mlockall(MCL_CURRENT | MCL_FUTURE) before streaming
+  OA_RT_PREFAULT = 1u << 1, // commit the RT thread's stack pages before streaming
+  OA_RT_FTZ_DAZ  = 1u << 2, // flush denormals to zero on the RT thread
+  OA_RT_HUGE_PAGES = 1u << 3, // put the stream's buffer arena on huge pages if the system has them
+};
+
+// Up to 256 CPUs; bit (n % 64) of cpus[n / 64] is CPU n.
+typedef struct {
+  uint64_t cpus[4];
+} oa_cpu_mask;
+
+// Requested RT thread setup. Applied on the RT thread before the first process() call.
+typedef struct {
+  uint32_t struct_size;  // sizeof(oa_rt_params)
+  uint32_t policy;       // oa_rt_policy
+  int32_t  priority;     // FIFO/RR priority, clamped to the policy's range
+  uint32_t flags;        // OA_RT_*
+  oa_cpu_mask affinity;  // all zero = inherit
+} oa_rt_params;
+
+// What the RT thread actually got (see get_rt_info).
+typedef struct {
+  uint32_t struct_size;  // set by the caller to sizeof(oa_rt_info); returns the bytes filled
+  uint32_t policy;       // oa_rt_policy in effect
+  int32_t  priority;
+  uint32_t flags;        // OA_RT_* that took effect
+  oa_cpu_mask affinity;  // CPUs the thread may run on
+  int32_t  error;        // errno of the first refused request, 0 if all were granted
+} oa_rt_info;
+
+// What a host worker pool needs to run beside the driver's RT thread (get_thread_params,
+// consumed by oa_workgroup_create in openasio_workgroup.h).
+typedef struct {
+  uint32_t struct_size;   // set by the caller to sizeof(oa_thread_params); returns the bytes filled
+  uint32_t policy;        // oa_rt_policy of the RT thread; DEFAULT if not known
+  int32_t  priority;
+  uint32_t flags;         // OA_RT_* in effect on the RT thread
+  oa_cpu_mask affinity;   // CPUs the RT thread may run on, all zero if not known
+  uint64_t period_ns;     // one period: process() and all work it fans out must fit in it
+  uint32_t period_frames;
+  uint32_t sample_rate;
+} oa_thread_params;
+
+// The buffer arena of a prepared or running stream (get_stream_memory). Every per-stream
+// buffer of the driver lives in one mapping sized by start(), each channel 64-byte aligned,
+// and all of its pages are touched before the first process() call. Re-setups of the live
+// stream reuse the mapping when they fit it. The host scratch (set_host_scratch) is mapped
+// on its own the same way: 64-byte aligned, zeroed when start() maps it, and the host's
+// alone, at the same address across reconfiguration, until stop().
+typedef struct {
+  uint32_t struct_size;        // set by the caller to sizeof(oa_stream_memory); returns the bytes filled
+  uint32_t flags;              // OA_RT_PREFAULT, plus OA_RT_MLOCK / OA_RT_HUGE_PAGES if granted
+  uint64_t arena_bytes;        // the mapping of the driver's buffers
+  void    *host_scratch;       // NULL if no scratch was asked for
+  uint64_t host_scratch_bytes;
+} oa_stream_memory;
+
+#define OA_HOST_SCRATCH_MAX (256u << 20) // largest set_host_scratch request
+
+#define OA_DEVICE_NAME_MAX 128
+
+enum {
+  OA_DEVICE_DEFAULT = 1u << 0, // the device open_device(NULL) picks
+};
+
+// One entry of the cached device list (enumerate_devices).
+typedef struct {
+  uint32_t struct_size;  // set by the caller in out[0]; also the stride of the array
+  uint32_t id;           // stable while the device stays present; the driver never reuses it
+  uint32_t flags;        // OA_DEVICE_*
+  uint16_t in_channels;  // most capture channels, 0 if none or unknown
+  uint16_t out_channels; // most playback channels, 0 if none or unknown
+  char name[OA_DEVICE_NAME_MAX];        // for open_device and query_config_space
+  char description[OA_DEVICE_NAME_MAX];
+} oa_device_info;
+
+// Bit for `layout` in oa_config_space.layouts.
+#define OA_LAYOUT_BIT(layout) (1u << (uint32_t)(layout))
+
+#define OA_CONFIG_MAX_RATES 16
+
+enum {
+  OA_CONFIG_RATE_CONTINUOUS = 1u << 0, // every rate in [rate_min, rate_max] is accepted
+};
+
+// Every oa_stream_config value a device accepts (query_config_space). Each field is valid
+// in combination with any value of the others.
+typedef struct {
+  uint32_t struct_size;        // set by the caller to sizeof(oa_config_space); returns the bytes filled
+  uint32_t flags;              // OA_CONFIG_*
+  uint32_t rate_count;         // entries in `rates`, ascending; the common ones if CONTINUOUS
+  uint32_t rates[OA_CONFIG_MAX_RATES];
+  uint32_t rate_min, rate_max;
+  uint32_t buffer_frames_min, buffer_frames_max;
+  uint32_t buffer_frames_step; // accepted sizes are min + k*step; 1 for any size in range
+  uint32_t in_channels_max, out_channels_max;
+  uint64_t in_channels;        // bit n: n capture channels accepted (bit 0: no capture)
+  uint64_t out_channels;       // bit n: n playback channels accepted (counts >= 64: up to max)
+  uint32_t native_formats;     // OA_FORMAT_BIT() masks as in get_supported_formats
+  uint32_t supported_formats;
+  uint32_t layouts;            // OA_LAYOUT_BIT() of the accepted oa_buffer_layout values
+} oa_config_space;
+
+// Stream telemetry (get_stream_stats), maintained lock-free by the RT thread since start().
+// Times are ns (CLOCK_MONOTONIC for the *_time_ns fields). Histograms count callbacks per
+// log-linear microsecond bin: exact below 4 us, then 4 bins per octave (oa_stats_bin_floor_us).
+#define OA_STATS_BINS 64
+typedef struct {
+  uint32_t struct_size;         // set by the caller to sizeof(oa_stream_stats); returns the bytes filled
+  uint32_t bins;                // OA_STATS_BINS
+  uint64_t period_ns;           // nominal period
+  uint64_t callbacks;
+  uint64_t process_ns_total;    // sum of process() durations (average load = total / (callbacks * period))
+  uint64_t process_ns_max;
+  uint64_t process_max_time_ns; // when the slowest process() started
+  uint64_t jitter_ns_max;       // largest |wake-up interval - period|
+  uint64_t jitter_max_time_ns;
+  uint32_t load_permille_last;  // last process() duration / period
+  uint32_t load_permille_max;
+  uint32_t overruns;            // capture xruns
+  uint32_t underruns;           // playback xruns
+  uint64_t last_overrun_ns;     // 0 if none
+  uint64_t last_underrun_ns;
+  uint64_t process_hist[OA_STATS_BINS]; // process() duration
+  uint64_t jitter_hist[OA_STATS_BINS];  // |wake-up interval - period|
+} oa_stream_stats;
+
+// Lower edge of histogram bin `i`, in microseconds.
+static inline uint64_t oa_stats_bin_floor_us(uint32_t i) {
+  return i < 4 ? i : (uint64_t)(4 + (i & 3)) << (i / 4 - 1);
+}
+
 // Creation parameters for a driver instance
 typedef struct {
   uint32_t struct_size;      // set to sizeof(oa_create_params)
   const oa_host_callbacks *host;
   void *host_user;
+  // ---- 1.1 additions (read only if struct_size covers them) ----
+  const oa_rt_params *rt;    // NULL = driver default; copied by openasio_driver_create
+  uint32_t host_size;        // sizeof(*host); 0 = the 1.0 layout (up to reset_request)
 } oa_create_params;
 
 // Function table implemented by the driver
@@ -107,6 +338,7 @@ typedef struct {
   uint32_t (*get_caps)(oa_driver *self);
 
   // Optional device enumeration: newline-separated names into buf. Returns OA_OK or error.
+  // Drivers with enumerate_devices answer from the same cache.
   oa_result (*query_devices)(oa_driver *self, char *buf, size_t buf_len);
 
   // Open by name (NULL or "" = default). Returns >=0 device_id or <0 error.
@@ -123,11 +355,82 @@ typedef struct {
   // Latency reporting in frames (<=0 if unknown).
   oa_result (*get_latency)(oa_driver *self, uint32_t *in_latency, uint32_t *out_latency);
 
-  // Optional reconfiguration while stopped.
+  // Optional reconfiguration (OA_CAP_SET_SAMPLERATE / OA_CAP_SET_BUFFRAMES). While stopped
+  // the value is recorded; while running the stream is switched over and the new latency is
+  // reported through host.latency_changed before process() resumes.
   oa_result (*set_sample_rate)(oa_driver *self, uint32_t sr);
   oa_result (*set_buffer_frames)(oa_driver *self, uint32_t frames);
+
+  // ---- 1.1 additions. Check OA_VT_HAS(vt, entry) before use. ----
+
+  // Zero-copy device buffers (OA_CAP_MMAP). Enable while stopped; the next start()
+  // streams in mmap mode and calls host.process with in == out == NULL. From inside
+  // process the host calls mmap_begin_period to get the device area for the period in
+  // the device's native format, then mmap_commit_period with the frames it consumed
+  // (capture) and produced (playback). A period the host does not commit is played as
+  // silence.
+  oa_result (*mmap_enable)(oa_driver *self, oa_bool enable);
+  oa_result (*mmap_begin_period)(oa_driver *self, oa_mmap_period *period);
+  oa_result (*mmap_commit_period)(oa_driver *self, uint32_t frames);
+
+  // Sample formats of the open device as masks of OA_FORMAT_BIT(). `native` formats are
+  // streamed without conversion; `supported` is everything start() accepts.
+  oa_result (*get_supported_formats)(oa_driver *self, uint32_t *native, uint32_t *supported);
+
+  // RT thread setup granted for the running stream (oa_create_params.rt). Valid once
+  // start() has returned; OA_ERR_STATE while stopped.
+  oa_result (*get_rt_info)(oa_driver *self, oa_rt_info *out);
+
+  // Telemetry of the current (or last) stream. Callable from any thread at any time; it
+  // reads relaxed counters and never blocks or slows the RT thread.
+  oa_result (*get_stream_stats)(oa_driver *self, oa_stream_stats *out);
+
+  // Scheduling and deadline of the running stream's RT thread, for a host worker pool that
+  // has to keep up with it. Valid once start() has returned; OA_ERR_STATE while stopped.
+  oa_result (*get_thread_params)(oa_driver *self, oa_thread_params *out);
+
+  // Config space of `device` (a query_devices name; NULL for the open device or, with none
+  // open, the default), so that a host can pick a config start() accepts without trying.
+  // Does not disturb a running stream or the open device. Not RT-safe.
+  oa_result (*query_config_space)(oa_driver *self, const char *device, oa_config_space *out);
+
+  // Cached device list: up to `capacity` entries into `out` and the full length into
+  // `*count` (capacity 0 just counts). The first call scans and starts a hotplug watcher
+  // that keeps the cache current and calls host.devices_changed; later calls do not scan.
+  oa_result (*enumerate_devices)(oa_driver *self, oa_device_info *out, uint32_t capacity,
+                                 uint32_t *count);
+
+  // Warm start. prepare() opens and configures the device for `cfg` and parks the RT thread
+  // without streaming; resume() then pre-fills silence and starts the device, and pause()
+  // parks the thread again after its current period and rewinds the device, keeping it
+  // open and configured. A paused RT thread sleeps; it never polls. start() on a prepared
+  // or paused stream with the same config is a resume(), stop() leaves any of these states.
+  // OA_ERR_STATE for resume() unless prepared or paused and for pause() unless running.
+  oa_result (*prepare)(oa_driver *self, const oa_stream_config *cfg);
+  oa_result (*pause)(oa_driver *self);
+  oa_result (*resume)(oa_driver *self);
+
+  // Batched delivery (OA_CAP_BATCH), for hosts that trade latency for fewer wakeups. While
+  // stopped, asks the next start() to wake once per `periods` periods (1..OA_BATCH_MAX_PERIODS;
+  // 1 turns it off) and hand them to host.process_batch, which the host must supply. The
+  // device buffer, get_latency and get_thread_params then scale with the batch; batches
+  // that do not fit the device come shorter. mmap streams keep one period per wakeup.
+  // OA_ERR_UNSUPPORTED without host.process_batch, OA_ERR_STATE unless stopped.
+  oa_result (*set_batch_periods)(oa_driver *self, uint32_t periods);
+
+  // Stream memory. While stopped, set_host_scratch asks the next start() to set aside
+  // `bytes` (0..OA_HOST_SCRATCH_MAX; 0 for none) of host scratch next to the stream's
+  // buffer arena, so memory the host touches in process() is pre-faulted, and locked or on huge
+  // pages as oa_rt_params.flags asked for the driver's own buffers. get_stream_memory
+  // describes the arena once start() or prepare() has returned; OA_ERR_STATE while stopped.
+  oa_result (*set_host_scratch)(oa_driver *self, size_t bytes);
+  oa_result (*get_stream_memory)(oa_driver *self, oa_stream_memory *out);
 } oa_driver_vtable;
 
+// True if the driver's vtable is large enough to contain `entry` (and it is set).
+#define OA_VT_HAS(vt, entry) \
+  ((vt)->struct_size >= offsetof(oa_driver_vtable, entry) + sizeof((vt)->entry) && (vt)->entry)
+
 // Opaque driver instance
 struct oa_driver {
   const oa_driver_vtable *vt;
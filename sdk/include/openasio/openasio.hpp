@@ -0,0 +1,427 @@
+/*
+ OpenASIO C++ host wrapper (header-only, C++17).
+ oa::Driver owns an oa_driver and wraps its vtable; oa::Stream<P> turns the C process()
+ callback into a typed call on a host processor P. Stream::start() picks the process()
+ specialisation for the config's layout and sample format once, so the RT thread reaches
+ P::process through one indirect call with typed views of the buffers: no branching on
+ cfg, no casts in host code, no allocation.
+ License: MIT OR Apache-2.0
+*/
+#ifndef OPENASIO_HPP
+#define OPENASIO_HPP
+#include "openasio.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+namespace oa {
+
+// Packed 24-bit little-endian sample (OA_SAMPLE_I24_3LE).
+struct i24 {
+  uint8_t bytes[3];
+
+  int32_t value() const {
+    uint32_t u = bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16;
+    return (int32_t)(u << 8) >> 8;
+  }
+  void set(int32_t v) {
+    bytes[0] = (uint8_t)v;
+    bytes[1] = (uint8_t)(v >> 8);
+    bytes[2] = (uint8_t)(v >> 16);
+  }
+};
+static_assert(sizeof(i24) == 3 && alignof(i24) == 1, "i24 must be 3 packed bytes");
+
+// Sample container type for each oa_sample_format.
+template <oa_sample_format F> struct sample_traits;
+template <> struct sample_traits<OA_SAMPLE_F32> { using type = float; };
+template <> struct sample_traits<OA_SAMPLE_I16> { using type = int16_t; };
+template <> struct sample_traits<OA_SAMPLE_U16> { using type = uint16_t; };
+template <> struct sample_traits<OA_SAMPLE_I32> { using type = int32_t; };
+template <> struct sample_traits<OA_SAMPLE_I24_3LE> { using type = i24; };
+template <> struct sample_traits<OA_SAMPLE_I24_IN_32> { using type = int32_t; }; // low 24 bits
+
+template <oa_sample_format F> using sample_t = typename sample_traits<F>::type;
+
+// Contiguous run of samples (std::span without C++20).
+template <class T> class span {
+ public:
+  constexpr span() = default;
+  constexpr span(T *data, size_t size) : data_(data), size_(size) {}
+
+  constexpr T *data() const { return data_; }
+  constexpr size_t size() const { return size_; }
+  constexpr bool empty() const { return size_ == 0; }
+  constexpr T &operator[](size_t i) const { return data_[i]; }
+  constexpr T *begin() const { return data_; }
+  constexpr T *end() const { return data_ + size_; }
+
+ private:
+  T *data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// One direction of an OA_BUF_INTERLEAVED period: frames*channels samples, frame-major.
+// `T` is const for input. Without channels in that direction it is empty.
+template <class T> class interleaved {
+ public:
+  interleaved(T *data, uint32_t frames, uint16_t channels)
+      : data_(data), frames_(frames), channels_(channels) {}
+
+  uint32_t frames() const { return frames_; }
+  uint16_t channels() const { return channels_; }
+  span<T> samples() const { return {data_, (size_t)frames_ * channels_}; }
+  span<T> frame(uint32_t i) const { return {data_ + (size_t)i * channels_, channels_}; }
+  T &operator()(uint32_t frame, uint16_t channel) const {
+    return data_[(size_t)frame * channels_ + channel];
+  }
+
+ private:
+  T *data_;
+  uint32_t frames_;
+  uint16_t channels_;
+};
+
+// One direction of an OA_BUF_NONINTERLEAVED period: a plane of `frames` samples per channel.
+template <class T> class planar {
+ public:
+  planar(T *const *planes, uint32_t frames, uint16_t channels)
+      : planes_(planes), frames_(frames), channels_(channels) {}
+
+  uint32_t frames() const { return frames_; }
+  uint16_t channels() const { return channels_; }
+  span<T> operator[](uint16_t channel) const { return {planes_[channel], frames_}; }
+  T &operator()(uint32_t frame, uint16_t channel) const { return planes_[channel][frame]; }
+
+ private:
+  T *const *planes_;
+  uint32_t frames_;
+  uint16_t channels_;
+};
+
+template <oa_buffer_layout L, class T>
+using buffer_t = std::conditional_t<L == OA_BUF_INTERLEAVED, interleaved<T>, planar<T>>;
+
+// What P::process() gets for one period of a stream with layout L and sample format F.
+template <oa_buffer_layout L, oa_sample_format F> struct period {
+  using sample = sample_t<F>;
+  static constexpr oa_buffer_layout layout = L;
+  static constexpr oa_sample_format format = F;
+
+  buffer_t<L, const sample> in;
+  buffer_t<L, sample> out;
+  uint32_t frames;
+  const oa_time_info &time;
+  const oa_stream_config &cfg;
+};
+
+namespace detail {
+
+template <class P, class Period, class = void> struct can_process : std::false_type {};
+template <class P, class Period>
+struct can_process<P, Period,
+                   std::void_t<decltype(bool(std::declval<P &>().process(
+                       std::declval<const Period &>())))>> : std::true_type {};
+
+template <class P, class = void> struct has_latency_changed : std::false_type {};
+template <class P>
+struct has_latency_changed<P, std::void_t<decltype(std::declval<P &>().latency_changed(
+                                  uint32_t(), uint32_t()))>> : std::true_type {};
+
+template <class P, class = void> struct has_reset_request : std::false_type {};
+template <class P>
+struct has_reset_request<P, std::void_t<decltype(std::declval<P &>().reset_request())>>
+    : std::true_type {};
+
+template <class P, class = void> struct has_devices_changed : std::false_type {};
+template <class P>
+struct has_devices_changed<P, std::void_t<decltype(std::declval<P &>().devices_changed())>>
+    : std::true_type {};
+
+template <class T> inline T *samples(void *p) { return static_cast<T *>(p); }
+template <class T> inline const T *samples(const void *p) { return static_cast<const T *>(p); }
+
+} // namespace detail
+
+// Owns a driver instance; move-only. The destroy function stops a running stream.
+class Driver {
+ public:
+  Driver() = default;
+  Driver(oa_driver *driver, openasio_driver_destroy_fn destroy) : d_(driver), destroy_(destroy) {}
+  Driver(Driver &&o) noexcept : d_(std::exchange(o.d_, nullptr)), destroy_(o.destroy_) {}
+  Driver &operator=(Driver &&o) noexcept {
+    if (this != &o) {
+      reset();
+      d_ = std::exchange(o.d_, nullptr);
+      destroy_ = o.destroy_;
+    }
+    return *this;
+  }
+  Driver(const Driver &) = delete;
+  Driver &operator=(const Driver &) = delete;
+  ~Driver() { reset(); }
+
+  // Runs the driver's factory. `out` is left empty on error.
+  static oa_result create(openasio_driver_create_fn create, openasio_driver_destroy_fn destroy,
+                          const oa_create_params &params, Driver &out) {
+    oa_driver *d = nullptr;
+    int32_t rc = create(&params, &d);
+    if (rc != OA_OK) return (oa_result)rc;
+    if (!d || !d->vt) return OA_ERR_GENERIC;
+    out = Driver(d, destroy);
+    return OA_OK;
+  }
+
+  void reset() {
+    if (d_ && destroy_) destroy_(d_);
+    d_ = nullptr;
+  }
+
+  explicit operator bool() const { return d_ != nullptr; }
+  oa_driver *get() const { return d_; }
+  const oa_driver_vtable &vt() const { return *d_->vt; }
+
+  uint32_t caps() const { return vt().get_caps(d_); }
+  // Device id (>= 0) or an oa_result error. NULL or "" opens the default device.
+  int32_t open(const char *name = nullptr) { return vt().open_device(d_, name); }
+  oa_result close() { return vt().close_device(d_); }
+  oa_result default_config(oa_stream_config &out) const { return vt().get_default_config(d_, &out); }
+  oa_result stop() { return vt().stop(d_); }
+  oa_result latency(uint32_t &in, uint32_t &out) const { return vt().get_latency(d_, &in, &out); }
+  oa_result set_sample_rate(uint32_t sr) {
+    return vt().set_sample_rate ? vt().set_sample_rate(d_, sr) : OA_ERR_UNSUPPORTED;
+  }
+  oa_result set_buffer_frames(uint32_t frames) {
+    return vt().set_buffer_frames ? vt().set_buffer_frames(d_, frames) : OA_ERR_UNSUPPORTED;
+  }
+
+  // 1.1 entries; OA_ERR_UNSUPPORTED from drivers without them. The struct_size of each
+  // out-parameter is filled in here.
+  oa_result supported_formats(uint32_t &native, uint32_t &supported) const {
+    if (!OA_VT_HAS(&vt(), get_supported_formats)) return OA_ERR_UNSUPPORTED;
+    return vt().get_supported_formats(d_, &native, &supported);
+  }
+  oa_result rt_info(oa_rt_info &out) const {
+    if (!OA_VT_HAS(&vt(), get_rt_info)) return OA_ERR_UNSUPPORTED;
+    out.struct_size = sizeof(out);
+    return vt().get_rt_info(d_, &out);
+  }
+  oa_result stream_stats(oa_stream_stats &out) const {
+    if (!OA_VT_HAS(&vt(), get_stream_stats)) return OA_ERR_UNSUPPORTED;
+    out.struct_size = sizeof(out);
+    return vt().get_stream_stats(d_, &out);
+  }
+  oa_result thread_params(oa_thread_params &out) const {
+    if (!OA_VT_HAS(&vt(), get_thread_params)) return OA_ERR_UNSUPPORTED;
+    out.struct_size = sizeof(out);
+    return vt().get_thread_params(d_, &out);
+  }
+  oa_result config_space(const char *device, oa_config_space &out) const {
+    if (!OA_VT_HAS(&vt(), query_config_space)) return OA_ERR_UNSUPPORTED;
+    out.struct_size = sizeof(out);
+    return vt().query_config_space(d_, device, &out);
+  }
+  oa_result devices(oa_device_info *out, uint32_t capacity, uint32_t &count) const {
+    if (!OA_VT_HAS(&vt(), enumerate_devices)) return OA_ERR_UNSUPPORTED;
+    if (capacity > 0) out[0].struct_size = sizeof(*out);
+    return vt().enumerate_devices(d_, out, capacity, &count);
+  }
+  oa_result pause() {
+    return OA_VT_HAS(&vt(), pause) ? vt().pause(d_) : OA_ERR_UNSUPPORTED;
+  }
+  oa_result resume() {
+    return OA_VT_HAS(&vt(), resume) ? vt().resume(d_) : OA_ERR_UNSUPPORTED;
+  }
+
+  // start() and prepare() go through Stream, which has to pick the process() path first.
+ private:
+  template <class P> friend class Stream;
+
+  oa_driver *d_ = nullptr;
+  openasio_driver_destroy_fn destroy_ = nullptr;
+};
+
+#ifndef _WIN32
+// A driver shared object and its factory symbols.
+class Library {
+ public:
+  Library() = default;
+  Library(Library &&o) noexcept
+      : handle_(std::exchange(o.handle_, nullptr)), create_(o.create_), destroy_(o.destroy_) {}
+  Library &operator=(Library &&o) noexcept {
+    if (this != &o) {
+      reset();
+      handle_ = std::exchange(o.handle_, nullptr);
+      create_ = o.create_;
+      destroy_ = o.destroy_;
+    }
+    return *this;
+  }
+  Library(const Library &) = delete;
+  Library &operator=(const Library &) = delete;
+  // Instances created from the library must be gone first.
+  ~Library() { reset(); }
+
+  // OA_ERR_BACKEND if dlopen fails (see dlerror()), OA_ERR_UNSUPPORTED without the factories.
+  static oa_result open(const char *path, Library &out) {
+    void *h = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!h) return OA_ERR_BACKEND;
+    auto create = reinterpret_cast<openasio_driver_create_fn>(dlsym(h, "openasio_driver_create"));
+    auto destroy =
+        reinterpret_cast<openasio_driver_destroy_fn>(dlsym(h, "openasio_driver_destroy"));
+    if (!create || !destroy) {
+      dlclose(h);
+      return OA_ERR_UNSUPPORTED;
+    }
+    out.reset();
+    out.handle_ = h;
+    out.create_ = create;
+    out.destroy_ = destroy;
+    return OA_OK;
+  }
+
+  void reset() {
+    if (handle_) dlclose(handle_);
+    handle_ = nullptr;
+  }
+
+  oa_result create(const oa_create_params &params, Driver &out) const {
+    if (!handle_) return OA_ERR_STATE;
+    return Driver::create(create_, destroy_, params, out);
+  }
+
+ private:
+  void *handle_ = nullptr;
+  openasio_driver_create_fn create_ = nullptr;
+  openasio_driver_destroy_fn destroy_ = nullptr;
+};
+#endif
+
+// The host side of a driver for processor P. P provides
+//
+//   bool process(const oa::period<L, F> &p);
+//
+// for the layouts and formats it handles, as a template or as overloads; the stream then
+// only starts configs with one of those. P may also provide latency_changed(in, out),
+// reset_request() and devices_changed(). Returning false from process() stops the stream.
+//
+// The driver calls into the Stream, so it must outlive the Driver and stays where it is
+// (no copy or move). mmap streams pass no buffers; process() then sees empty views.
+template <class P> class Stream {
+ public:
+  explicit Stream(P &processor) : proc_(&processor) {
+    host_.process = &on_process;
+    if constexpr (detail::has_latency_changed<P>::value) host_.latency_changed = &on_latency_changed;
+    if constexpr (detail::has_reset_request<P>::value) host_.reset_request = &on_reset_request;
+    if constexpr (detail::has_devices_changed<P>::value) host_.devices_changed = &on_devices_changed;
+  }
+  Stream(const Stream &) = delete;
+  Stream &operator=(const Stream &) = delete;
+
+  // For openasio_driver_create / Driver::create / Library::create. `rt` may be NULL.
+  oa_create_params create_params(const oa_rt_params *rt = nullptr) const {
+    oa_create_params p{};
+    p.struct_size = sizeof(p);
+    p.host = &host_;
+    p.host_user = const_cast<Stream *>(this);
+    p.rt = rt;
+    p.host_size = sizeof(host_);
+    return p;
+  }
+
+  // P has a process() overload for this layout and format.
+  static bool supports(oa_buffer_layout layout, oa_sample_format format) {
+    return select(layout, format) != nullptr;
+  }
+
+  // Selects the process() path for `cfg` and starts (or prepares) the driver with it.
+  // OA_ERR_UNSUPPORTED, without calling the driver, if P does not handle the config.
+  oa_result start(Driver &d, const oa_stream_config &cfg) { return begin(d, cfg, false); }
+  oa_result prepare(Driver &d, const oa_stream_config &cfg) { return begin(d, cfg, true); }
+
+ private:
+  using dispatch_fn = oa_bool (*)(P &, const void *, void *, uint32_t, const oa_time_info *,
+                                  const oa_stream_config *);
+
+  oa_result begin(Driver &d, const oa_stream_config &cfg, bool prepare_only) {
+    dispatch_fn fn = select(cfg.layout, cfg.format);
+    if (!fn) return OA_ERR_UNSUPPORTED;
+    if (prepare_only && !OA_VT_HAS(&d.vt(), prepare)) return OA_ERR_UNSUPPORTED;
+    // Stored before the driver's RT thread can run the new config; a stream that is still
+    // running keeps a valid path either way.
+    dispatch_.store(fn, std::memory_order_release);
+    return prepare_only ? d.vt().prepare(d.d_, &cfg) : d.vt().start(d.d_, &cfg);
+  }
+
+  template <oa_buffer_layout L, oa_sample_format F>
+  static oa_bool dispatch(P &proc, const void *in, void *out, uint32_t frames,
+                          const oa_time_info *time, const oa_stream_config *cfg) {
+    using T = sample_t<F>;
+    if constexpr (L == OA_BUF_INTERLEAVED) {
+      period<L, F> p{{detail::samples<T>(in), frames, in ? cfg->in_channels : uint16_t(0)},
+                     {detail::samples<T>(out), frames, out ? cfg->out_channels : uint16_t(0)},
+                     frames, *time, *cfg};
+      return proc.process(p) ? OA_TRUE : OA_FALSE;
+    } else {
+      period<L, F> p{{static_cast<const T *const *>(in), frames,
+                      in ? cfg->in_channels : uint16_t(0)},
+                     {static_cast<T *const *>(out), frames, out ? cfg->out_channels : uint16_t(0)},
+                     frames, *time, *cfg};
+      return proc.process(p) ? OA_TRUE : OA_FALSE;
+    }
+  }
+
+  template <oa_buffer_layout L, oa_sample_format F> static constexpr dispatch_fn entry() {
+    if constexpr (detail::can_process<P, period<L, F>>::value) return &dispatch<L, F>;
+    else return nullptr;
+  }
+
+  template <oa_buffer_layout L> static dispatch_fn select_format(oa_sample_format format) {
+    switch (format) {
+      case OA_SAMPLE_F32: return entry<L, OA_SAMPLE_F32>();
+      case OA_SAMPLE_I16: return entry<L, OA_SAMPLE_I16>();
+      case OA_SAMPLE_U16: return entry<L, OA_SAMPLE_U16>();
+      case OA_SAMPLE_I32: return entry<L, OA_SAMPLE_I32>();
+      case OA_SAMPLE_I24_3LE: return entry<L, OA_SAMPLE_I24_3LE>();
+      case OA_SAMPLE_I24_IN_32: return entry<L, OA_SAMPLE_I24_IN_32>();
+      default: return nullptr;
+    }
+  }
+
+  static dispatch_fn select(oa_buffer_layout layout, oa_sample_format format) {
+    switch (layout) {
+      case OA_BUF_INTERLEAVED: return select_format<OA_BUF_INTERLEAVED>(format);
+      case OA_BUF_NONINTERLEAVED: return select_format<OA_BUF_NONINTERLEAVED>(format);
+      default: return nullptr;
+    }
+  }
+
+  // RT: the only per-period work the wrapper adds is this load and call.
+  static oa_bool on_process(void *user, const void *in, void *out, uint32_t frames,
+                            const oa_time_info *time, const oa_stream_config *cfg) {
+    auto *s = static_cast<Stream *>(user);
+    dispatch_fn fn = s->dispatch_.load(std::memory_order_acquire);
+    return fn ? fn(*s->proc_, in, out, frames, time, cfg) : OA_FALSE;
+  }
+  static void on_latency_changed(void *user, uint32_t in, uint32_t out) {
+    static_cast<Stream *>(user)->proc_->latency_changed(in, out);
+  }
+  static void on_reset_request(void *user) { static_cast<Stream *>(user)->proc_->reset_request(); }
+  static void on_devices_changed(void *user) {
+    static_cast<Stream *>(user)->proc_->devices_changed();
+  }
+
+  P *proc_;
+  oa_host_callbacks host_{};
+  std::atomic<dispatch_fn> dispatch_{nullptr};
+};
+
+} // namespace oa
+#endif // OPENASIO_HPP
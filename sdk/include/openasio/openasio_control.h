@@ -0,0 +1,69 @@
+/*
+ OpenASIO control plane: lock-free hand-offs between the host's UI/control threads and its
+ process() callback, so neither side ever waits for the other.
+ - oa_queue: bounded FIFO of fixed-size commands (parameter changes, buffer swaps), one
+   consumer and one (SPSC) or several (MPSC) producers.
+ - oa_triple: triple buffer; the writer publishes whole snapshots and the reader always
+   gets the latest complete one (state from the UI into process, or back out).
+ - oa_seqlock: one writer, any number of readers, for small values written every period
+   and read now and then (meters, transport position).
+ Indices and sequence words sit on their own cache lines. Everything but create/destroy is
+ RT-safe: no allocation, no locks, no syscalls.
+ License: MIT OR Apache-2.0
+*/
+#ifndef OPENASIO_CONTROL_H
+#define OPENASIO_CONTROL_H
+#include "openasio.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  OA_QUEUE_SPSC = 0, // one producer thread: push is wait-free
+  OA_QUEUE_MPSC = 1, // producers on any threads: push is lock-free (one compare-and-swap)
+} oa_queue_mode;
+
+typedef struct oa_queue oa_queue;
+
+// Queue of `capacity` (rounded up to a power of two) items of `item_size` bytes. Not RT-safe.
+OA_API oa_result oa_queue_create(uint32_t item_size, uint32_t capacity, oa_queue_mode mode,
+                                 oa_queue **out);
+OA_API void oa_queue_destroy(oa_queue *q);
+OA_API uint32_t oa_queue_capacity(const oa_queue *q);
+// Producer: copies `item` in. OA_FALSE if the queue is full.
+OA_API oa_bool oa_queue_push(oa_queue *q, const void *item);
+// Consumer (one thread): copies the oldest item out. OA_FALSE if the queue is empty.
+OA_API oa_bool oa_queue_pop(oa_queue *q, void *item);
+
+typedef struct oa_triple oa_triple;
+
+// Triple buffer of `size`-byte snapshots, all three starting as `initial` (zeros if NULL).
+// Not RT-safe.
+OA_API oa_result oa_triple_create(uint32_t size, const void *initial, oa_triple **out);
+OA_API void oa_triple_destroy(oa_triple *t);
+// Writer (one thread): the buffer to fill next. It holds an older snapshot, so write all of
+// it, then publish.
+OA_API void *oa_triple_write_buffer(oa_triple *t);
+// Writer: makes the filled buffer the latest snapshot.
+OA_API void oa_triple_publish(oa_triple *t);
+// Reader (one thread): the latest published snapshot, valid until its next read. `*fresh`
+// (may be NULL) tells whether it is newer than what the previous read returned.
+OA_API const void *oa_triple_read(oa_triple *t, oa_bool *fresh);
+
+typedef struct oa_seqlock oa_seqlock;
+
+#define OA_SEQLOCK_TRIES 64 // reads overlapped by this many writes in a row give up
+
+// Seqlock over a `size`-byte value, starting as zeros. Not RT-safe.
+OA_API oa_result oa_seqlock_create(uint32_t size, oa_seqlock **out);
+OA_API void oa_seqlock_destroy(oa_seqlock *s);
+// Writer (one thread): wait-free, never delayed by readers.
+OA_API void oa_seqlock_write(oa_seqlock *s, const void *value);
+// Any thread: copies a consistent value into `out`. OA_FALSE, with `out` unspecified, if
+// every try overlapped a write.
+OA_API oa_bool oa_seqlock_read(const oa_seqlock *s, void *out);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // OPENASIO_CONTROL_H
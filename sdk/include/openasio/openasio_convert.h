@@ -0,0 +1,67 @@
+/*
+ OpenASIO sample conversion and (de)interleave kernels.
+ Scalar, SSE2, AVX2 and NEON paths; the fastest one the CPU supports is selected once at
+ load time, so every call is RT-safe (no allocation, no locks, no syscalls).
+ License: MIT OR Apache-2.0
+*/
+#ifndef OPENASIO_CONVERT_H
+#define OPENASIO_CONVERT_H
+#include "openasio.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  OA_SIMD_SCALAR = 0,
+  OA_SIMD_SSE2   = 1,
+  OA_SIMD_AVX2   = 2,
+  OA_SIMD_NEON   = 3,
+} oa_simd_level;
+
+// Kernel set currently in use.
+OA_API oa_simd_level oa_convert_simd_level(void);
+// Restrict dispatch to `level` (for benchmarks/tests). Levels the CPU lacks are refused
+// with OA_ERR_UNSUPPORTED. Not RT-safe with respect to concurrent conversions.
+OA_API oa_result oa_convert_set_simd_level(oa_simd_level level);
+
+// TPDF dither state (xorshift32). One per stream; not shared between threads.
+typedef struct {
+  uint32_t state;
+} oa_dither;
+
+OA_API void oa_dither_init(oa_dither *d, uint32_t seed);
+
+// float32 [-1,+1) <-> integer. Float-to-int rounds to nearest, clamps out-of-range input
+// (infinities included) to the integer limits and writes NaN as 0, the same on every SIMD
+// level. `n` counts samples, not frames.
+OA_API void oa_f32_to_i16(int16_t *dst, const float *src, size_t n);
+OA_API void oa_f32_to_i32(int32_t *dst, const float *src, size_t n);
+OA_API void oa_f32_to_i24_in_32(int32_t *dst, const float *src, size_t n);
+OA_API void oa_f32_to_i24_3le(uint8_t *dst, const float *src, size_t n);
+OA_API void oa_i16_to_f32(float *dst, const int16_t *src, size_t n);
+OA_API void oa_i32_to_f32(float *dst, const int32_t *src, size_t n);
+OA_API void oa_i24_in_32_to_f32(float *dst, const int32_t *src, size_t n);
+OA_API void oa_i24_3le_to_f32(float *dst, const uint8_t *src, size_t n);
+
+// Format-generic entry points. `dither` (NULL = off) adds +-1 LSB TPDF noise for 16 and
+// 24-bit targets. Returns OA_ERR_UNSUPPORTED for unknown formats.
+OA_API oa_result oa_convert_from_f32(oa_sample_format dst_format, void *dst,
+                                     const float *src, size_t n, oa_dither *dither);
+OA_API oa_result oa_convert_to_f32(float *dst, oa_sample_format src_format,
+                                   const void *src, size_t n);
+
+// planes[c][f] <-> dst[f*channels + c] for any channel count.
+OA_API void oa_interleave_f32(float *dst, const float *const *planes,
+                              uint32_t channels, size_t frames);
+OA_API void oa_deinterleave_f32(float *const *planes, const float *src,
+                                uint32_t channels, size_t frames);
+// Same for arbitrary sample containers (1..8 bytes), e.g. native integer formats.
+OA_API void oa_interleave_bytes(void *dst, const void *const *planes, uint32_t channels,
+                                size_t frames, uint32_t sample_bytes);
+OA_API void oa_deinterleave_bytes(void *const *planes, const void *src, uint32_t channels,
+                                  size_t frames, uint32_t sample_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // OPENASIO_CONVERT_H
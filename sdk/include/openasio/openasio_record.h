@@ -0,0 +1,83 @@
+/*
+ OpenASIO recorder: streams interleaved periods from process() to a WAV/RF64/CAF file.
+ process() pushes each period into a ring with one copy and no syscalls; a writer thread
+ drains the ring in large aligned chunks with io_uring (pwrite where io_uring is missing),
+ into a file opened with O_DIRECT and preallocated ahead of the write position. Memory is
+ fixed at create time: when the writer falls behind and the ring fills, pushes are refused
+ and counted instead of blocking the RT thread.
+ License: MIT OR Apache-2.0
+*/
+#ifndef OPENASIO_RECORD_H
+#define OPENASIO_RECORD_H
+#include "openasio.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  OA_REC_WAV  = 0, // RIFF/WAVE, promoted to RF64 on finish if the file passes 4 GiB
+  OA_REC_RF64 = 1, // RF64 from the start
+  OA_REC_CAF  = 2, // Core Audio Format; the data size stays "to end of file" until finish
+} oa_record_container;
+
+typedef enum {
+  OA_REC_IO_AUTO   = 0, // io_uring if the kernel allows it, else pwrite
+  OA_REC_IO_URING  = 1,
+  OA_REC_IO_PWRITE = 2, // blocking pwrite on the writer thread
+} oa_record_io;
+
+#define OA_REC_DIRECT (1u << 0) // O_DIRECT; falls back to buffered I/O where the filesystem refuses it
+
+#define OA_REC_BLOCK 4096u // header size, write alignment and chunk granularity
+
+typedef struct {
+  oa_record_container container;
+  oa_record_io io;
+  uint32_t flags;           // OA_REC_*
+  oa_sample_format format;  // as pushed; OA_SAMPLE_U16 and OA_SAMPLE_I24_IN_32 are refused
+  uint32_t channels;
+  uint32_t sample_rate;
+  uint32_t ring_ms;         // ring length as audio time; 0 = 2000
+  uint32_t chunk_bytes;     // bytes per write, rounded to OA_REC_BLOCK; 0 = 1 MiB
+  uint32_t queue_depth;     // io_uring writes in flight; 0 = 4
+  uint64_t prealloc_bytes;  // fallocate step ahead of the write position; 0 = 256 MiB
+} oa_record_params;
+
+typedef struct {
+  uint64_t frames_pushed;   // accepted by oa_recorder_push*
+  uint64_t frames_written;  // completed on disk
+  uint64_t frames_dropped;  // refused because the ring was full or the recorder finished
+  uint32_t drops;           // pushes that were refused
+  uint32_t fill_permille;   // ring fill now
+  uint32_t fill_max_permille;
+  int32_t error;            // errno of the first failed write, 0 if none
+  oa_record_io io;          // backend in use
+  oa_bool direct;           // whether O_DIRECT was granted
+} oa_record_stats;
+
+typedef struct oa_recorder oa_recorder;
+
+// Creates `path`, writes a provisional header, allocates and pre-faults the ring, and starts
+// the writer thread. OA_ERR_UNSUPPORTED for an unsupported format or OA_REC_IO_URING
+// without io_uring; OA_ERR_BACKEND if the file cannot be created. Not RT-safe.
+OA_API oa_result oa_recorder_create(const char *path, const oa_record_params *params,
+                                    oa_recorder **out);
+// RT-safe, one producer thread: copies `frames` interleaved frames into the ring. OA_FALSE,
+// dropping the whole period, if it does not fit.
+OA_API oa_bool oa_recorder_push(oa_recorder *rec, const void *interleaved, uint32_t frames);
+// As oa_recorder_push for non-interleaved periods; interleaves straight into the ring.
+OA_API oa_bool oa_recorder_push_planar(oa_recorder *rec, const void *const *planes,
+                                       uint32_t frames);
+// Any thread, any time.
+OA_API void oa_recorder_stats(const oa_recorder *rec, oa_record_stats *out);
+// Writes out everything pushed so far, finalizes the header and closes the file. Later
+// pushes are refused, and one racing with finish may be lost, so stop pushing first.
+// Returns the first write error as OA_ERR_BACKEND. Not RT-safe; idempotent.
+OA_API oa_result oa_recorder_finish(oa_recorder *rec);
+// Finishes if needed and frees the recorder. No push may be in progress.
+OA_API void oa_recorder_destroy(oa_recorder *rec);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // OPENASIO_RECORD_H
@@ -0,0 +1,68 @@
+/*
+ OpenASIO sample-rate converter: polyphase windowed-sinc (Kaiser) filtering of interleaved
+ float frames, for devices that run at another rate than the stream and for clock-drift
+ correction between devices.
+ - Fixed ratio: one filter phase per output position of the reduced ratio in:out, stepped
+   in integers, so the conversion never drifts.
+ - Variable ratio (OA_RESAMPLE_VARIABLE, and ratios whose reduced form needs more than
+   OA_RESAMPLE_MAX_PHASES phases): a finer bank interpolated between phases, whose step
+   oa_resampler_set_trim can change on every call.
+ The filter runs on the SIMD level of the conversion kernels (oa_convert_simd_level).
+ Tables and history are allocated by create; every other call is RT-safe (no allocation,
+ no locks, no syscalls).
+ License: MIT OR Apache-2.0
+*/
+#ifndef OPENASIO_RESAMPLE_H
+#define OPENASIO_RESAMPLE_H
+#include "openasio.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  OA_RESAMPLE_FAST   = 0, // 16 taps at unity ratio, about 55 dB stopband
+  OA_RESAMPLE_MEDIUM = 1, // 32 taps, about 75 dB
+  OA_RESAMPLE_HIGH   = 2, // 64 taps, about 100 dB
+} oa_resample_quality;
+
+#define OA_RESAMPLE_VARIABLE (1u << 0) // allow oa_resampler_set_trim
+
+#define OA_RESAMPLE_MAX_PHASES 1024u // largest reduced output rate run as a fixed ratio
+#define OA_RESAMPLE_MAX_TRIM 0.05    // oa_resampler_set_trim takes 1 +- this
+#define OA_RESAMPLE_MAX_RATIO 8u     // in_rate and out_rate at most this far apart
+
+typedef struct oa_resampler oa_resampler;
+
+// Converter of `channels` interleaved channels from `in_rate` to `out_rate`. Downsampling
+// widens the filter by the ratio, so its cost per output frame stays about the same. Not
+// RT-safe.
+OA_API oa_result oa_resampler_create(uint32_t channels, uint32_t in_rate, uint32_t out_rate,
+                                     oa_resample_quality quality, uint32_t flags,
+                                     oa_resampler **out);
+OA_API void oa_resampler_destroy(oa_resampler *r);
+// Back to the state after create: silent history, no trim.
+OA_API void oa_resampler_reset(oa_resampler *r);
+// Input frames per output frame become (in_rate / out_rate) * trim. OA_ERR_STATE for a
+// fixed-ratio converter, OA_ERR_INVALID_ARG outside OA_RESAMPLE_MAX_TRIM.
+OA_API oa_result oa_resampler_set_trim(oa_resampler *r, double trim);
+// OA_TRUE if the converter interpolates phases (asked for, or the ratio required it).
+OA_API oa_bool oa_resampler_variable(const oa_resampler *r);
+
+// Input frames the next oa_resampler_process needs to produce exactly `out_frames`.
+OA_API size_t oa_resampler_input_for(const oa_resampler *r, size_t out_frames);
+// Output frames the next oa_resampler_process produces from `in_frames` frames of input.
+OA_API size_t oa_resampler_output_for(const oa_resampler *r, size_t in_frames);
+// Converts until `out_frames` frames are written or the input runs out, and reports how
+// many of each it used. Input is only taken as far as the output needs it, so with
+// oa_resampler_input_for frames both sides come out even.
+OA_API void oa_resampler_process(oa_resampler *r, const float *in, size_t in_frames,
+                                 size_t *in_used, float *out, size_t out_frames,
+                                 size_t *out_done);
+// Delay through the filter, in output frames: how long after an input frame the converter
+// can emit its time.
+OA_API uint32_t oa_resampler_latency(const oa_resampler *r);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // OPENASIO_RESAMPLE_H
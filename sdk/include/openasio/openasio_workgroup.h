@@ -0,0 +1,52 @@
+/*
+ OpenASIO worker group: real-time helper threads for the host's `process`.
+ The group runs beside a driver's RT thread with the scheduling and deadline it reports in
+ get_thread_params. Inside `process` the host forks a batch of independent jobs with
+ oa_workgroup_run; the calling thread joins in as worker 0 and returns once every job is
+ done. Jobs are split into one contiguous range per worker, and a worker that runs dry
+ steals half of another's remaining range, so an uneven graph still balances.
+ License: MIT OR Apache-2.0
+*/
+#ifndef OPENASIO_WORKGROUP_H
+#define OPENASIO_WORKGROUP_H
+#include "openasio.h"
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OA_WORKGROUP_MAX_WORKERS 64    // including the calling thread
+#define OA_WORKGROUP_MAX_JOBS    65535 // per oa_workgroup_run
+
+typedef struct oa_workgroup oa_workgroup;
+
+// One job. `index` is in [0, count); `worker` in [0, oa_workgroup_size()) names the thread
+// running it (0 = the caller), for per-worker scratch. Same rules as host.process.
+typedef void (*oa_work_fn)(void *ctx, uint32_t index, uint32_t worker);
+
+// Spawns `workers` helper threads (0 = one per CPU the RT thread may use, minus one) with
+// the policy, priority and OA_RT_FTZ_DAZ / OA_RT_PREFAULT flags of `params`, which may be
+// NULL for plain threads. If the RT thread is pinned to a single CPU the workers run on the
+// process's other CPUs; with none left the default is no workers (oa_workgroup_size is 1 and
+// the caller runs every job), and an explicit `workers` count fails with OA_ERR_UNSUPPORTED.
+// A refused scheduling request does not fail; see oa_workgroup_error. Not RT-safe.
+OA_API oa_result oa_workgroup_create(const oa_thread_params *params, uint32_t workers,
+                                     oa_workgroup **out);
+// Stops and joins the workers. Not RT-safe; no oa_workgroup_run may be in progress.
+OA_API void oa_workgroup_destroy(oa_workgroup *wg);
+// Threads that run jobs, the caller included.
+OA_API uint32_t oa_workgroup_size(const oa_workgroup *wg);
+// errno of the first scheduling or affinity request the system refused, 0 if all were granted.
+OA_API int32_t oa_workgroup_error(const oa_workgroup *wg);
+
+// Runs fn(ctx, i, worker) for every i in [0, count) and returns when all have finished.
+// RT-safe: no allocation or locks. Workers spin for a short while after each batch (an
+// eighth of the period, at most 100 us) and then sleep, so a batch that finds them asleep
+// costs the caller one futex wake (a mutex and condition broadcast off Linux). The caller
+// then spins for the other workers' jobs and, if they are still running after 16384 rounds,
+// yields its CPU between checks so a worker sharing it can finish. One thread at a time.
+OA_API oa_result oa_workgroup_run(oa_workgroup *wg, oa_work_fn fn, void *ctx, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // OPENASIO_WORKGROUP_H
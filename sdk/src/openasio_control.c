@@ -0,0 +1,268 @@
+/*
+ OpenASIO control plane: bounded command queue, triple buffer and seqlock.
+ License: MIT OR Apache-2.0
+*/
+#include "openasio/openasio_control.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+  #include <malloc.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+  #include <xmmintrin.h>
+  #define OA_PAUSE() _mm_pause()
+#elif defined(__aarch64__)
+  #define OA_PAUSE() __asm__ __volatile__("yield")
+#else
+  #define OA_PAUSE() ((void)0)
+#endif
+
+#define OA_LINE 64
+#define OA_ALIGNED __attribute__((aligned(OA_LINE)))
+
+static size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+// Zeroed, cache-line aligned.
+static void *alloc_lines(size_t bytes) {
+  bytes = round_up(bytes, OA_LINE);
+#if defined(_WIN32)
+  void *p = _aligned_malloc(bytes, OA_LINE);
+#else
+  void *p = NULL;
+  if (posix_memalign(&p, OA_LINE, bytes) != 0) p = NULL;
+#endif
+  if (p) memset(p, 0, bytes);
+  return p;
+}
+
+static void free_lines(void *p) {
+#if defined(_WIN32)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+// ---- queue ----
+// Bounded ring of cells, each with a sequence number (Vyukov). A cell is free for the
+// producer holding ticket `pos` when its sequence is `pos`, and full for the consumer when
+// it is `pos + 1`. Producers claim tickets off `head` (with a CAS in MPSC mode); the
+// consumer owns `tail`.
+
+typedef struct {
+  uint64_t seq;
+  // item bytes follow
+} oa_queue_cell;
+
+struct oa_queue {
+  OA_ALIGNED uint64_t head;
+  OA_ALIGNED uint64_t tail;
+  OA_ALIGNED uint64_t mask;
+  uint32_t item_size;
+  uint32_t stride;
+  oa_queue_mode mode;
+  unsigned char *cells;
+};
+
+static oa_queue_cell *queue_cell(const oa_queue *q, uint64_t pos) {
+  return (oa_queue_cell *)(q->cells + (size_t)(pos & q->mask) * q->stride);
+}
+
+OA_API oa_result oa_queue_create(uint32_t item_size, uint32_t capacity, oa_queue_mode mode,
+                                 oa_queue **out) {
+  if (!out) return OA_ERR_INVALID_ARG;
+  *out = NULL;
+  if (item_size == 0 || capacity == 0 || capacity > (1u << 30) ||
+      (mode != OA_QUEUE_SPSC && mode != OA_QUEUE_MPSC))
+    return OA_ERR_INVALID_ARG;
+  uint32_t cap = 1;
+  while (cap < capacity) cap <<= 1;
+  oa_queue *q = alloc_lines(sizeof(*q));
+  if (!q) return OA_ERR_GENERIC;
+  q->stride = (uint32_t)round_up(sizeof(oa_queue_cell) + item_size, sizeof(uint64_t));
+  q->cells = alloc_lines((size_t)cap * q->stride);
+  if (!q->cells) {
+    free_lines(q);
+    return OA_ERR_GENERIC;
+  }
+  q->mask = cap - 1;
+  q->item_size = item_size;
+  q->mode = mode;
+  for (uint64_t i = 0; i < cap; i++) queue_cell(q, i)->seq = i;
+  *out = q;
+  return OA_OK;
+}
+
+OA_API void oa_queue_destroy(oa_queue *q) {
+  if (!q) return;
+  free_lines(q->cells);
+  free_lines(q);
+}
+
+OA_API uint32_t oa_queue_capacity(const oa_queue *q) { return (uint32_t)(q->mask + 1); }
+
+OA_API oa_bool oa_queue_push(oa_queue *q, const void *item) {
+  uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  oa_queue_cell *cell;
+  for (;;) {
+    cell = queue_cell(q, pos);
+    uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - pos);
+    if (diff < 0) return OA_FALSE; // the consumer has not freed this cell yet: full
+    if (diff > 0) {                // another producer took this ticket
+      pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (q->mode == OA_QUEUE_SPSC) {
+      __atomic_store_n(&q->head, pos + 1, __ATOMIC_RELAXED);
+      break;
+    }
+    if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED))
+      break;
+  }
+  memcpy(cell + 1, item, q->item_size);
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return OA_TRUE;
+}
+
+OA_API oa_bool oa_queue_pop(oa_queue *q, void *item) {
+  uint64_t pos = q->tail;
+  oa_queue_cell *cell = queue_cell(q, pos);
+  if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + 1) return OA_FALSE;
+  memcpy(item, cell + 1, q->item_size);
+  // Free for the producer that draws ticket pos + capacity.
+  __atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+  q->tail = pos + 1;
+  return OA_TRUE;
+}
+
+// ---- triple buffer ----
+// Three buffers: the writer's back buffer, the reader's front buffer, and the middle one
+// swapped between them. `middle` holds the middle buffer's index plus OA_TRIPLE_NEW when it
+// was published after the reader's last swap.
+
+#define OA_TRIPLE_INDEX 3u
+#define OA_TRIPLE_NEW   4u
+
+struct oa_triple {
+  OA_ALIGNED uint32_t middle;
+  OA_ALIGNED uint32_t back;  // writer only
+  OA_ALIGNED uint32_t front; // reader only
+  OA_ALIGNED size_t stride;
+  unsigned char *bufs;
+};
+
+OA_API oa_result oa_triple_create(uint32_t size, const void *initial, oa_triple **out) {
+  if (!out) return OA_ERR_INVALID_ARG;
+  *out = NULL;
+  if (size == 0) return OA_ERR_INVALID_ARG;
+  oa_triple *t = alloc_lines(sizeof(*t));
+  if (!t) return OA_ERR_GENERIC;
+  t->stride = round_up(size, OA_LINE);
+  t->bufs = alloc_lines(3 * t->stride);
+  if (!t->bufs) {
+    free_lines(t);
+    return OA_ERR_GENERIC;
+  }
+  if (initial)
+    for (int i = 0; i < 3; i++) memcpy(t->bufs + i * t->stride, initial, size);
+  t->back = 0;
+  t->middle = 1;
+  t->front = 2;
+  *out = t;
+  return OA_OK;
+}
+
+OA_API void oa_triple_destroy(oa_triple *t) {
+  if (!t) return;
+  free_lines(t->bufs);
+  free_lines(t);
+}
+
+OA_API void *oa_triple_write_buffer(oa_triple *t) { return t->bufs + t->back * t->stride; }
+
+OA_API void oa_triple_publish(oa_triple *t) {
+  uint32_t old = __atomic_exchange_n(&t->middle, t->back | OA_TRIPLE_NEW, __ATOMIC_ACQ_REL);
+  t->back = old & OA_TRIPLE_INDEX;
+}
+
+OA_API const void *oa_triple_read(oa_triple *t, oa_bool *fresh) {
+  oa_bool swapped = OA_FALSE;
+  if (__atomic_load_n(&t->middle, __ATOMIC_RELAXED) & OA_TRIPLE_NEW) {
+    uint32_t old = __atomic_exchange_n(&t->middle, t->front, __ATOMIC_ACQ_REL);
+    t->front = old & OA_TRIPLE_INDEX;
+    swapped = OA_TRUE;
+  }
+  if (fresh) *fresh = swapped;
+  return t->bufs + t->front * t->stride;
+}
+
+// ---- seqlock ----
+// The sequence is odd while a write is under way. The value is stored as relaxed atomic
+// words, so a reader racing a write sees a torn copy it then discards, never a data race.
+
+struct oa_seqlock {
+  OA_ALIGNED uint64_t seq;
+  OA_ALIGNED uint32_t size;
+  uint32_t words;
+  uint64_t *data;
+};
+
+OA_API oa_result oa_seqlock_create(uint32_t size, oa_seqlock **out) {
+  if (!out) return OA_ERR_INVALID_ARG;
+  *out = NULL;
+  if (size == 0) return OA_ERR_INVALID_ARG;
+  oa_seqlock *s = alloc_lines(sizeof(*s));
+  if (!s) return OA_ERR_GENERIC;
+  s->words = (uint32_t)(round_up(size, sizeof(uint64_t)) / sizeof(uint64_t));
+  s->data = alloc_lines((size_t)s->words * sizeof(uint64_t));
+  if (!s->data) {
+    free_lines(s);
+    return OA_ERR_GENERIC;
+  }
+  s->size = size;
+  *out = s;
+  return OA_OK;
+}
+
+OA_API void oa_seqlock_destroy(oa_seqlock *s) {
+  if (!s) return;
+  free_lines(s->data);
+  free_lines(s);
+}
+
+OA_API void oa_seqlock_write(oa_seqlock *s, const void *value) {
+  const unsigned char *src = value;
+  uint64_t seq = s->seq;
+  __atomic_store_n(&s->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for (uint32_t i = 0; i < s->words; i++) {
+    uint64_t w = 0;
+    size_t n = s->size - i * sizeof(w);
+    memcpy(&w, src + i * sizeof(w), n < sizeof(w) ? n : sizeof(w));
+    __atomic_store_n(&s->data[i], w, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&s->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+OA_API oa_bool oa_seqlock_read(const oa_seqlock *s, void *out) {
+  unsigned char *dst = out;
+  for (int tries = 0; tries < OA_SEQLOCK_TRIES; tries++) {
+    uint64_t before = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    if (before & 1) {
+      OA_PAUSE();
+      continue;
+    }
+    for (uint32_t i = 0; i < s->words; i++) {
+      uint64_t w = __atomic_load_n(&s->data[i], __ATOMIC_RELAXED);
+      size_t n = s->size - i * sizeof(w);
+      memcpy(dst + i * sizeof(w), &w, n < sizeof(w) ? n : sizeof(w));
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == before) return OA_TRUE;
+    OA_PAUSE();
+  }
+  return OA_FALSE;
+}
@@ -0,0 +1,576 @@
+/*
+ OpenASIO sample conversion and (de)interleave kernels.
+ License: MIT OR Apache-2.0
+*/
+#include "openasio/openasio_convert.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+  #define OA_HAVE_X86 1
+  #include <immintrin.h>
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+  #define OA_HAVE_NEON 1
+  #include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define OA_TARGET(t) __attribute__((target(t)))
+#else
+  #define OA_TARGET(t)
+#endif
+
+#define OA_BLOCK 64 // samples per stack block in the composite kernels
+
+static const float k_scale16 = 32768.0f;
+static const float k_scale24 = 8388608.0f;
+static const float k_scale32 = 2147483648.0f;
+
+typedef struct {
+  void (*f32_to_i16)(int16_t *, const float *, size_t);
+  void (*f32_to_i32)(int32_t *, const float *, size_t);
+  void (*f32_to_i24_in_32)(int32_t *, const float *, size_t);
+  void (*i16_to_f32)(float *, const int16_t *, size_t);
+  void (*i32_to_f32)(float *, const int32_t *, size_t);
+  void (*i24_in_32_to_f32)(float *, const int32_t *, size_t);
+  void (*interleave2)(float *, const float *, const float *, size_t);
+  void (*deinterleave2)(float *, float *, const float *, size_t);
+} oa_kernels;
+
+/* ---------------------------------------------------------------- scalar */
+
+static inline int32_t quantize(float v, float scale, int32_t lo, int32_t hi) {
+  float x = v * scale;
+  if (x != x) return 0;               // NaN
+  if (x >= (float)hi) return hi;      // (float)INT32_MAX rounds up to 2^31: still exclusive
+  if (x <= (float)lo) return lo;
+  return (int32_t)lrintf(x);
+}
+
+static void f32_to_i16_scalar(int16_t *dst, const float *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] = (int16_t)quantize(src[i], k_scale16, -32768, 32767);
+}
+static void f32_to_i32_scalar(int32_t *dst, const float *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] = quantize(src[i], k_scale32, INT32_MIN, INT32_MAX);
+}
+static void f32_to_i24_in_32_scalar(int32_t *dst, const float *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] = quantize(src[i], k_scale24, -8388608, 8388607);
+}
+static void i16_to_f32_scalar(float *dst, const int16_t *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] = (float)src[i] * (1.0f / k_scale16);
+}
+static void i32_to_f32_scalar(float *dst, const int32_t *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] = (float)src[i] * (1.0f / k_scale32);
+}
+// The container's top byte is not guaranteed to be a sign extension: shift it out.
+static void i24_in_32_to_f32_scalar(float *dst, const int32_t *src, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    dst[i] = (float)(int32_t)((uint32_t)src[i] << 8) * (1.0f / k_scale32);
+}
+static void interleave2_scalar(float *dst, const float *l, const float *r, size_t frames) {
+  for (size_t f = 0; f < frames; ++f) { dst[2 * f] = l[f]; dst[2 * f + 1] = r[f]; }
+}
+static void deinterleave2_scalar(float *l, float *r, const float *src, size_t frames) {
+  for (size_t f = 0; f < frames; ++f) { l[f] = src[2 * f]; r[f] = src[2 * f + 1]; }
+}
+
+static const oa_kernels k_scalar = {
+  f32_to_i16_scalar, f32_to_i32_scalar, f32_to_i24_in_32_scalar,
+  i16_to_f32_scalar, i32_to_f32_scalar, i24_in_32_to_f32_scalar,
+  interleave2_scalar, deinterleave2_scalar,
+};
+
+/* ------------------------------------------------------------------- x86 */
+#if OA_HAVE_X86
+
+// `v * scale` with NaN lanes zeroed, as the scalar quantize does. Without it max_ps turns
+// NaN into the lower clamp and cvtps into INT32_MIN: a full-scale click.
+OA_TARGET("sse2") static inline __m128 scaled_sse2(const float *src, __m128 scale) {
+  __m128 x = _mm_mul_ps(_mm_loadu_ps(src), scale);
+  return _mm_and_ps(x, _mm_cmpord_ps(x, x));
+}
+
+OA_TARGET("sse2") static void f32_to_i16_sse2(int16_t *dst, const float *src, size_t n) {
+  const __m128 scale = _mm_set1_ps(k_scale16);
+  const __m128 lo = _mm_set1_ps(-32768.0f), hi = _mm_set1_ps(32767.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 a = _mm_min_ps(_mm_max_ps(scaled_sse2(src + i, scale), lo), hi);
+    __m128 b = _mm_min_ps(_mm_max_ps(scaled_sse2(src + i + 4, scale), lo), hi);
+    __m128i r = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+    _mm_storeu_si128((__m128i *)(dst + i), r);
+  }
+  f32_to_i16_scalar(dst + i, src + i, n - i);
+}
+
+// cvtps returns 0x80000000 for positive overflow; XOR with the ">= 2^31" mask turns it
+// into INT32_MAX. Negative overflow already yields INT32_MIN.
+OA_TARGET("sse2") static void f32_to_i32_sse2(int32_t *dst, const float *src, size_t n) {
+  const __m128 scale = _mm_set1_ps(k_scale32);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = scaled_sse2(src + i, scale);
+    __m128i r = _mm_xor_si128(_mm_cvtps_epi32(x), _mm_castps_si128(_mm_cmpge_ps(x, scale)));
+    _mm_storeu_si128((__m128i *)(dst + i), r);
+  }
+  f32_to_i32_scalar(dst + i, src + i, n - i);
+}
+
+OA_TARGET("sse2") static void f32_to_i24_in_32_sse2(int32_t *dst, const float *src, size_t n) {
+  const __m128 scale = _mm_set1_ps(k_scale24);
+  const __m128 lo = _mm_set1_ps(-8388608.0f), hi = _mm_set1_ps(8388607.0f);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 x = _mm_min_ps(_mm_max_ps(scaled_sse2(src + i, scale), lo), hi);
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_cvtps_epi32(x));
+  }
+  f32_to_i24_in_32_scalar(dst + i, src + i, n - i);
+}
+
+OA_TARGET("sse2") static void i16_to_f32_sse2(float *dst, const int16_t *src, size_t n) {
+  const __m128 scale = _mm_set1_ps(1.0f / k_scale16);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+  }
+  i16_to_f32_scalar(dst + i, src + i, n - i);
+}
+
+OA_TARGET("sse2") static void i32_to_f32_sse2(float *dst, const int32_t *src, size_t n) {
+  const __m128 scale = _mm_set1_ps(1.0f / k_scale32);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  i32_to_f32_scalar(dst + i, src + i, n - i);
+}
+
+OA_TARGET("sse2") static void i24_in_32_to_f32_sse2(float *dst, const int32_t *src, size_t n) {
+  const __m128 scale = _mm_set1_ps(1.0f / k_scale32);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_slli_epi32(_mm_loadu_si128((const __m128i *)(src + i)), 8);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  i24_in_32_to_f32_scalar(dst + i, src + i, n - i);
+}
+
+OA_TARGET("sse2") static void interleave2_sse2(float *dst, const float *l, const float *r, size_t frames) {
+  size_t f = 0;
+  for (; f + 4 <= frames; f += 4) {
+    __m128 a = _mm_loadu_ps(l + f), b = _mm_loadu_ps(r + f);
+    _mm_storeu_ps(dst + 2 * f, _mm_unpacklo_ps(a, b));
+    _mm_storeu_ps(dst + 2 * f + 4, _mm_unpackhi_ps(a, b));
+  }
+  interleave2_scalar(dst + 2 * f, l + f, r + f, frames - f);
+}
+
+OA_TARGET("sse2") static void deinterleave2_sse2(float *l, float *r, const float *src, size_t frames) {
+  size_t f = 0;
+  for (; f + 4 <= frames; f += 4) {
+    __m128 a = _mm_loadu_ps(src + 2 * f), b = _mm_loadu_ps(src + 2 * f + 4);
+    _mm_storeu_ps(l + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps(r + f, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  deinterleave2_scalar(l + f, r + f, src + 2 * f, frames - f);
+}
+
+static const oa_kernels k_sse2 = {
+  f32_to_i16_sse2, f32_to_i32_sse2, f32_to_i24_in_32_sse2,
+  i16_to_f32_sse2, i32_to_f32_sse2, i24_in_32_to_f32_sse2,
+  interleave2_sse2, deinterleave2_sse2,
+};
+
+OA_TARGET("avx2") static inline __m256 scaled_avx2(const float *src, __m256 scale) {
+  __m256 x = _mm256_mul_ps(_mm256_loadu_ps(src), scale);
+  return _mm256_and_ps(x, _mm256_cmp_ps(x, x, _CMP_ORD_Q));
+}
+
+OA_TARGET("avx2") static void f32_to_i16_avx2(int16_t *dst, const float *src, size_t n) {
+  const __m256 scale = _mm256_set1_ps(k_scale16);
+  const __m256 lo = _mm256_set1_ps(-32768.0f), hi = _mm256_set1_ps(32767.0f);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256 a = _mm256_min_ps(_mm256_max_ps(scaled_avx2(src + i, scale), lo), hi);
+    __m256 b = _mm256_min_ps(_mm256_max_ps(scaled_avx2(src + i + 8, scale), lo), hi);
+    __m256i r = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+    r = _mm256_permute4x64_epi64(r, _MM_SHUFFLE(3, 1, 2, 0)); // packs works per 128-bit lane
+    _mm256_storeu_si256((__m256i *)(dst + i), r);
+  }
+  f32_to_i16_sse2(dst + i, src + i, n - i);
+}
+
+OA_TARGET("avx2") static void f32_to_i32_avx2(int32_t *dst, const float *src, size_t n) {
+  const __m256 scale = _mm256_set1_ps(k_scale32);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = scaled_avx2(src + i, scale);
+    __m256i over = _mm256_castps_si256(_mm256_cmp_ps(x, scale, _CMP_GE_OQ));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(_mm256_cvtps_epi32(x), over));
+  }
+  f32_to_i32_sse2(dst + i, src + i, n - i);
+}
+
+OA_TARGET("avx2") static void f32_to_i24_in_32_avx2(int32_t *dst, const float *src, size_t n) {
+  const __m256 scale = _mm256_set1_ps(k_scale24);
+  const __m256 lo = _mm256_set1_ps(-8388608.0f), hi = _mm256_set1_ps(8388607.0f);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 x = _mm256_min_ps(_mm256_max_ps(scaled_avx2(src + i, scale), lo), hi);
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_cvtps_epi32(x));
+  }
+  f32_to_i24_in_32_sse2(dst + i, src + i, n - i);
+}
+
+OA_TARGET("avx2") static void i16_to_f32_avx2(float *dst, const int16_t *src, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / k_scale16);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  i16_to_f32_scalar(dst + i, src + i, n - i);
+}
+
+OA_TARGET("avx2") static void i32_to_f32_avx2(float *dst, const int32_t *src, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / k_scale32);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  i32_to_f32_sse2(dst + i, src + i, n - i);
+}
+
+OA_TARGET("avx2") static void i24_in_32_to_f32_avx2(float *dst, const int32_t *src, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / k_scale32);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)(src + i)), 8);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  i24_in_32_to_f32_sse2(dst + i, src + i, n - i);
+}
+
+OA_TARGET("avx2") static void interleave2_avx2(float *dst, const float *l, const float *r, size_t frames) {
+  size_t f = 0;
+  for (; f + 8 <= frames; f += 8) {
+    __m256 a = _mm256_loadu_ps(l + f), b = _mm256_loadu_ps(r + f);
+    __m256 lo = _mm256_unpacklo_ps(a, b), hi = _mm256_unpackhi_ps(a, b);
+    _mm256_storeu_ps(dst + 2 * f, _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps(dst + 2 * f + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  interleave2_sse2(dst + 2 * f, l + f, r + f, frames - f);
+}
+
+OA_TARGET("avx2") static void deinterleave2_avx2(float *l, float *r, const float *src, size_t frames) {
+  size_t f = 0;
+  for (; f + 8 <= frames; f += 8) {
+    __m256 a = _mm256_loadu_ps(src + 2 * f), b = _mm256_loadu_ps(src + 2 * f + 8);
+    __m256 lo = _mm256_permute2f128_ps(a, b, 0x20), hi = _mm256_permute2f128_ps(a, b, 0x31);
+    _mm256_storeu_ps(l + f, _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm256_storeu_ps(r + f, _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  deinterleave2_sse2(l + f, r + f, src + 2 * f, frames - f);
+}
+
+static const oa_kernels k_avx2 = {
+  f32_to_i16_avx2, f32_to_i32_avx2, f32_to_i24_in_32_avx2,
+  i16_to_f32_avx2, i32_to_f32_avx2, i24_in_32_to_f32_avx2,
+  interleave2_avx2, deinterleave2_avx2,
+};
+#endif /* OA_HAVE_X86 */
+
+/* ------------------------------------------------------------------ NEON */
+#if OA_HAVE_NEON
+
+// vcvtnq rounds to nearest, saturates and turns NaN into 0, so no explicit clamp is needed
+// for 32-bit; vmaxq keeps NaN for it.
+static void f32_to_i16_neon(int16_t *dst, const float *src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int32x4_t a = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), k_scale16));
+    int32x4_t b = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i + 4), k_scale16));
+    vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+  }
+  f32_to_i16_scalar(dst + i, src + i, n - i);
+}
+static void f32_to_i32_neon(int32_t *dst, const float *src, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    vst1q_s32(dst + i, vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(src + i), k_scale32)));
+  f32_to_i32_scalar(dst + i, src + i, n - i);
+}
+static void f32_to_i24_in_32_neon(int32_t *dst, const float *src, size_t n) {
+  const float32x4_t lo = vdupq_n_f32(-8388608.0f), hi = vdupq_n_f32(8388607.0f);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    float32x4_t x = vminq_f32(vmaxq_f32(vmulq_n_f32(vld1q_f32(src + i), k_scale24), lo), hi);
+    vst1q_s32(dst + i, vcvtnq_s32_f32(x));
+  }
+  f32_to_i24_in_32_scalar(dst + i, src + i, n - i);
+}
+static void i16_to_f32_neon(float *dst, const int16_t *src, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int16x8_t v = vld1q_s16(src + i);
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / k_scale16));
+    vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / k_scale16));
+  }
+  i16_to_f32_scalar(dst + i, src + i, n - i);
+}
+static void i32_to_f32_neon(float *dst, const int32_t *src, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(vld1q_s32(src + i)), 1.0f / k_scale32));
+  i32_to_f32_scalar(dst + i, src + i, n - i);
+}
+static void i24_in_32_to_f32_neon(float *dst, const int32_t *src, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int32x4_t v = vshlq_n_s32(vld1q_s32(src + i), 8);
+    vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(v), 1.0f / k_scale32));
+  }
+  i24_in_32_to_f32_scalar(dst + i, src + i, n - i);
+}
+static void interleave2_neon(float *dst, const float *l, const float *r, size_t frames) {
+  size_t f = 0;
+  for (; f + 4 <= frames; f += 4) {
+    float32x4x2_t v = { { vld1q_f32(l + f), vld1q_f32(r + f) } };
+    vst2q_f32(dst + 2 * f, v);
+  }
+  interleave2_scalar(dst + 2 * f, l + f, r + f, frames - f);
+}
+static void deinterleave2_neon(float *l, float *r, const float *src, size_t frames) {
+  size_t f = 0;
+  for (; f + 4 <= frames; f += 4) {
+    float32x4x2_t v = vld2q_f32(src + 2 * f);
+    vst1q_f32(l + f, v.val[0]);
+    vst1q_f32(r + f, v.val[1]);
+  }
+  deinterleave2_scalar(l + f, r + f, src + 2 * f, frames - f);
+}
+
+static const oa_kernels k_neon = {
+  f32_to_i16_neon, f32_to_i32_neon, f32_to_i24_in_32_neon,
+  i16_to_f32_neon, i32_to_f32_neon, i24_in_32_to_f32_neon,
+  interleave2_neon, deinterleave2_neon,
+};
+#endif /* OA_HAVE_NEON */
+
+/* -------------------------------------------------------------- dispatch */
+
+static oa_simd_level g_level = OA_SIMD_SCALAR;
+static const oa_kernels *volatile g_kernels;
+
+static oa_simd_level detect_level(void) {
+#if OA_HAVE_NEON
+  return OA_SIMD_NEON;
+#elif OA_HAVE_X86 && (defined(__GNUC__) || defined(__clang__))
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return OA_SIMD_AVX2;
+  if (__builtin_cpu_supports("sse2")) return OA_SIMD_SSE2;
+  return OA_SIMD_SCALAR;
+#elif defined(_M_X64)
+  return OA_SIMD_SSE2;
+#else
+  return OA_SIMD_SCALAR;
+#endif
+}
+
+static const oa_kernels *kernels_for(oa_simd_level level) {
+  switch (level) {
+#if OA_HAVE_X86
+    case OA_SIMD_AVX2: return &k_avx2;
+    case OA_SIMD_SSE2: return &k_sse2;
+#endif
+#if OA_HAVE_NEON
+    case OA_SIMD_NEON: return &k_neon;
+#endif
+    default: return &k_scalar;
+  }
+}
+
+// Resolved at load time so the first conversion on an RT thread does no CPU probing.
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((constructor))
+#endif
+static void convert_init(void) {
+  if (!g_kernels) {
+    g_level = detect_level();
+    g_kernels = kernels_for(g_level);
+  }
+}
+
+static inline const oa_kernels *K(void) {
+  const oa_kernels *k = g_kernels;
+  if (!k) { convert_init(); k = g_kernels; }
+  return k;
+}
+
+oa_simd_level oa_convert_simd_level(void) {
+  K();
+  return g_level;
+}
+
+oa_result oa_convert_set_simd_level(oa_simd_level level) {
+  oa_simd_level best = detect_level();
+  if (level != OA_SIMD_SCALAR && level != best &&
+      !(best == OA_SIMD_AVX2 && level == OA_SIMD_SSE2))
+    return OA_ERR_UNSUPPORTED;
+  g_level = level;
+  g_kernels = kernels_for(level);
+  return OA_OK;
+}
+
+/* ---------------------------------------------------------------- public */
+
+void oa_f32_to_i16(int16_t *dst, const float *src, size_t n) { K()->f32_to_i16(dst, src, n); }
+void oa_f32_to_i32(int32_t *dst, const float *src, size_t n) { K()->f32_to_i32(dst, src, n); }
+void oa_f32_to_i24_in_32(int32_t *dst, const float *src, size_t n) { K()->f32_to_i24_in_32(dst, src, n); }
+void oa_i16_to_f32(float *dst, const int16_t *src, size_t n) { K()->i16_to_f32(dst, src, n); }
+void oa_i32_to_f32(float *dst, const int32_t *src, size_t n) { K()->i32_to_f32(dst, src, n); }
+void oa_i24_in_32_to_f32(float *dst, const int32_t *src, size_t n) { K()->i24_in_32_to_f32(dst, src, n); }
+
+void oa_f32_to_i24_3le(uint8_t *dst, const float *src, size_t n) {
+  int32_t tmp[OA_BLOCK];
+  while (n > 0) {
+    size_t m = n < OA_BLOCK ? n : OA_BLOCK;
+    K()->f32_to_i24_in_32(tmp, src, m);
+    for (size_t i = 0; i < m; ++i) {
+      uint32_t v = (uint32_t)tmp[i];
+      dst[3 * i] = (uint8_t)v;
+      dst[3 * i + 1] = (uint8_t)(v >> 8);
+      dst[3 * i + 2] = (uint8_t)(v >> 16);
+    }
+    src += m; dst += 3 * m; n -= m;
+  }
+}
+
+void oa_i24_3le_to_f32(float *dst, const uint8_t *src, size_t n) {
+  int32_t tmp[OA_BLOCK];
+  while (n > 0) {
+    size_t m = n < OA_BLOCK ? n : OA_BLOCK;
+    for (size_t i = 0; i < m; ++i)
+      tmp[i] = (int32_t)((uint32_t)src[3 * i] | (uint32_t)src[3 * i + 1] << 8 |
+                         (uint32_t)src[3 * i + 2] << 16);
+    K()->i24_in_32_to_f32(dst, tmp, m);
+    src += 3 * m; dst += m; n -= m;
+  }
+}
+
+void oa_dither_init(oa_dither *d, uint32_t seed) { d->state = seed ? seed : 0x9E3779B9u; }
+
+static inline float dither_uniform(oa_dither *d) { // [-0.5, 0.5)
+  uint32_t x = d->state;
+  x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+  d->state = x;
+  return (float)(x >> 8) * (1.0f / 16777216.0f) - 0.5f;
+}
+
+// Adds +-1 LSB triangular noise into a stack block, then runs the plain kernel on it.
+static void dither_block(float *tmp, const float *src, size_t m, float lsb, oa_dither *d) {
+  for (size_t i = 0; i < m; ++i)
+    tmp[i] = src[i] + (dither_uniform(d) + dither_uniform(d)) * lsb;
+}
+
+oa_result oa_convert_from_f32(oa_sample_format fmt, void *dst, const float *src, size_t n,
+                              oa_dither *dither) {
+  float tmp[OA_BLOCK];
+  float lsb;
+  switch (fmt) {
+    case OA_SAMPLE_F32: memmove(dst, src, n * sizeof(float)); return OA_OK;
+    case OA_SAMPLE_I32:
+      oa_f32_to_i32((int32_t *)dst, src, n);
+      return OA_OK;
+    case OA_SAMPLE_I16: lsb = 1.0f / k_scale16; break;
+    case OA_SAMPLE_I24_3LE: case OA_SAMPLE_I24_IN_32: lsb = 1.0f / k_scale24; break;
+    default: return OA_ERR_UNSUPPORTED;
+  }
+  uint8_t *out = (uint8_t *)dst;
+  size_t bytes = oa_sample_bytes(fmt);
+  while (n > 0) {
+    size_t m = n < OA_BLOCK ? n : OA_BLOCK;
+    const float *in = src;
+    if (dither) { dither_block(tmp, src, m, lsb, dither); in = tmp; }
+    if (fmt == OA_SAMPLE_I16) oa_f32_to_i16((int16_t *)out, in, m);
+    else if (fmt == OA_SAMPLE_I24_3LE) oa_f32_to_i24_3le(out, in, m);
+    else oa_f32_to_i24_in_32((int32_t *)out, in, m);
+    src += m; out += m * bytes; n -= m;
+  }
+  return OA_OK;
+}
+
+oa_result oa_convert_to_f32(float *dst, oa_sample_format fmt, const void *src, size_t n) {
+  switch (fmt) {
+    case OA_SAMPLE_F32: memmove(dst, src, n * sizeof(float)); return OA_OK;
+    case OA_SAMPLE_I16: oa_i16_to_f32(dst, (const int16_t *)src, n); return OA_OK;
+    case OA_SAMPLE_I32: oa_i32_to_f32(dst, (const int32_t *)src, n); return OA_OK;
+    case OA_SAMPLE_I24_IN_32: oa_i24_in_32_to_f32(dst, (const int32_t *)src, n); return OA_OK;
+    case OA_SAMPLE_I24_3LE: oa_i24_3le_to_f32(dst, (const uint8_t *)src, n); return OA_OK;
+    default: return OA_ERR_UNSUPPORTED;
+  }
+}
+
+void oa_interleave_f32(float *dst, const float *const *planes, uint32_t channels, size_t frames) {
+  if (channels == 1) { memcpy(dst, planes[0], frames * sizeof(float)); return; }
+  if (channels == 2) { K()->interleave2(dst, planes[0], planes[1], frames); return; }
+  // Column-at-a-time keeps the source streams sequential; writes stay within one block.
+  for (size_t f0 = 0; f0 < frames; f0 += OA_BLOCK) {
+    size_t m = frames - f0 < OA_BLOCK ? frames - f0 : OA_BLOCK;
+    for (uint32_t c = 0; c < channels; ++c) {
+      const float *p = planes[c] + f0;
+      float *d = dst + f0 * channels + c;
+      for (size_t f = 0; f < m; ++f) d[f * channels] = p[f];
+    }
+  }
+}
+
+void oa_deinterleave_f32(float *const *planes, const float *src, uint32_t channels, size_t frames) {
+  if (channels == 1) { memcpy(planes[0], src, frames * sizeof(float)); return; }
+  if (channels == 2) { K()->deinterleave2(planes[0], planes[1], src, frames); return; }
+  for (size_t f0 = 0; f0 < frames; f0 += OA_BLOCK) {
+    size_t m = frames - f0 < OA_BLOCK ? frames - f0 : OA_BLOCK;
+    for (uint32_t c = 0; c < channels; ++c) {
+      float *p = planes[c] + f0;
+      const float *s = src + f0 * channels + c;
+      for (size_t f = 0; f < m; ++f) p[f] = s[f * channels];
+    }
+  }
+}
+
+void oa_interleave_bytes(void *dst, const void *const *planes, uint32_t channels,
+                         size_t frames, uint32_t sample_bytes) {
+  if (sample_bytes == 4) {
+    oa_interleave_f32((float *)dst, (const float *const *)planes, channels, frames);
+    return;
+  }
+  uint8_t *d = (uint8_t *)dst;
+  size_t stride = (size_t)channels * sample_bytes;
+  for (uint32_t c = 0; c < channels; ++c) {
+    const uint8_t *p = (const uint8_t *)planes[c];
+    uint8_t *o = d + (size_t)c * sample_bytes;
+    for (size_t f = 0; f < frames; ++f) memcpy(o + f * stride, p + f * sample_bytes, sample_bytes);
+  }
+}
+
+void oa_deinterleave_bytes(void *const *planes, const void *src, uint32_t channels,
+                           size_t frames, uint32_t sample_bytes) {
+  if (sample_bytes == 4) {
+    oa_deinterleave_f32((float *const *)planes, (const float *)src, channels, frames);
+    return;
+  }
+  const uint8_t *s = (const uint8_t *)src;
+  size_t stride = (size_t)channels * sample_bytes;
+  for (uint32_t c = 0; c < channels; ++c) {
+    uint8_t *p = (uint8_t *)planes[c];
+    const uint8_t *i = s + (size_t)c * sample_bytes;
+    for (size_t f = 0; f < frames; ++f) memcpy(p + f * sample_bytes, i + f * stride, sample_bytes);
+  }
+}
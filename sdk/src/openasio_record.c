@@ -0,0 +1,671 @@
+/*
+ OpenASIO recorder: RT ring into an io_uring (or pwrite) writer, WAV/RF64/CAF.
+ License: MIT OR Apache-2.0
+*/
+#define _GNU_SOURCE
+#include "openasio/openasio_record.h"
+#include "openasio/openasio_convert.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+
+OA_API oa_result oa_recorder_create(const char *path, const oa_record_params *params,
+                                    oa_recorder **out) {
+  (void)path; (void)params;
+  if (out) *out = NULL;
+  return OA_ERR_UNSUPPORTED;
+}
+OA_API oa_bool oa_recorder_push(oa_recorder *rec, const void *interleaved, uint32_t frames) {
+  (void)rec; (void)interleaved; (void)frames;
+  return OA_FALSE;
+}
+OA_API oa_bool oa_recorder_push_planar(oa_recorder *rec, const void *const *planes,
+                                       uint32_t frames) {
+  (void)rec; (void)planes; (void)frames;
+  return OA_FALSE;
+}
+OA_API void oa_recorder_stats(const oa_recorder *rec, oa_record_stats *out) {
+  (void)rec;
+  if (out) memset(out, 0, sizeof(*out));
+}
+OA_API oa_result oa_recorder_finish(oa_recorder *rec) { (void)rec; return OA_ERR_UNSUPPORTED; }
+OA_API void oa_recorder_destroy(oa_recorder *rec) { (void)rec; }
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+  #include <sys/syscall.h>
+  #if defined(__NR_io_uring_setup) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+      #include <linux/io_uring.h>
+      #define OA_HAVE_URING 1
+    #endif
+  #endif
+#endif
+#ifndef OA_HAVE_URING
+  #define OA_HAVE_URING 0
+#endif
+#ifndef O_DIRECT
+  #define O_DIRECT 0
+#endif
+#ifndef MFD_CLOEXEC
+  #define MFD_CLOEXEC 1u
+#endif
+#ifndef FALLOC_FL_KEEP_SIZE
+  #define FALLOC_FL_KEEP_SIZE 1
+#endif
+
+#define OA_LINE 64
+#define OA_ALIGNED __attribute__((aligned(OA_LINE)))
+#define OA_REC_MAX_DEPTH 64
+
+typedef struct {
+  uint64_t pos; // ring position (= data offset) of the first byte
+  uint32_t len;
+  int32_t res;  // bytes written or -errno, once done
+  int done;
+  struct iovec iov;
+} oa_rec_slot;
+
+#if OA_HAVE_URING
+typedef struct {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_bytes, cq_bytes, sqe_bytes;
+} oa_uring;
+#endif
+
+struct oa_recorder {
+  // RT side.
+  OA_ALIGNED uint64_t head; // bytes pushed
+  uint64_t frames_pushed;
+  uint64_t frames_dropped;
+  uint32_t drops;
+  uint32_t fill_max; // bytes, high-water mark of head - tail
+  uint32_t closed;
+  // Writer side.
+  OA_ALIGNED uint64_t tail; // bytes on disk, always a chunk multiple until finish
+  int32_t error;
+  uint32_t quit;
+  // Fixed at create.
+  OA_ALIGNED unsigned char *ring;
+  uint64_t ring_bytes; // a multiple of both the chunk and the frame size
+  int mirrored;        // ring mapped twice back to back: every push is one contiguous copy
+  const void **scratch; // plane pointers for a planar push across the end of an unmirrored ring
+  uint32_t frame_bytes, sample_bytes, channels;
+  uint32_t chunk, depth;
+  uint64_t poll_ns;
+  uint64_t prealloc_step, prealloc_end;
+  int prealloc_ok;
+  oa_record_params params;
+  oa_record_io io;
+  oa_bool direct;
+  int fd;
+  unsigned char *block; // OA_REC_BLOCK aligned scratch for the header
+  pthread_t writer;
+  int started, finished;
+  oa_result result;
+  oa_rec_slot slots[OA_REC_MAX_DEPTH];
+#if OA_HAVE_URING
+  oa_uring uring;
+#endif
+};
+
+static uint64_t round_up(uint64_t n, uint64_t to) { return (n + to - 1) / to * to; }
+static uint64_t gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+static void note_error(oa_recorder *rec, int err) {
+  int32_t none = 0;
+  __atomic_compare_exchange_n(&rec->error, &none, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static void sleep_ns(uint64_t ns) {
+  struct timespec ts = {(time_t)(ns / 1000000000u), (long)(ns % 1000000000u)};
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+  }
+}
+
+/* ---------------------------------------------------------------- ring */
+
+// Maps `bytes` twice in a row on Linux, so a copy running off the end lands at the start.
+static unsigned char *ring_map(size_t bytes, int *mirrored) {
+  *mirrored = 0;
+#if defined(__linux__) && defined(SYS_memfd_create)
+  int fd = (int)syscall(SYS_memfd_create, "openasio-record", MFD_CLOEXEC);
+  if (fd >= 0) {
+    unsigned char *base = NULL;
+    if (ftruncate(fd, (off_t)bytes) == 0) {
+      void *p = mmap(NULL, 2 * bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p != MAP_FAILED) {
+        base = p;
+        if (mmap(base, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+            mmap(base + bytes, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) ==
+                MAP_FAILED) {
+          munmap(base, 2 * bytes);
+          base = NULL;
+        }
+      }
+    }
+    close(fd);
+    if (base) {
+      *mirrored = 1;
+      return base;
+    }
+  }
+#endif
+  void *p = NULL;
+  if (posix_memalign(&p, OA_REC_BLOCK, bytes) != 0) return NULL;
+  return p;
+}
+
+static void ring_unmap(unsigned char *ring, size_t bytes, int mirrored) {
+  if (!ring) return;
+  munlock(ring, bytes);
+  if (mirrored)
+    munmap(ring, 2 * bytes);
+  else
+    free(ring);
+}
+
+/* ---------------------------------------------------------------- headers */
+
+static void le16(unsigned char *p, uint32_t v) { p[0] = (unsigned char)v; p[1] = (unsigned char)(v >> 8); }
+static void le32(unsigned char *p, uint32_t v) { le16(p, v); le16(p + 2, v >> 16); }
+static void le64(unsigned char *p, uint64_t v) { le32(p, (uint32_t)v); le32(p + 4, (uint32_t)(v >> 32)); }
+static void be32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)(v >> 24); p[1] = (unsigned char)(v >> 16);
+  p[2] = (unsigned char)(v >> 8);  p[3] = (unsigned char)v;
+}
+static void be64(unsigned char *p, uint64_t v) { be32(p, (uint32_t)(v >> 32)); be32(p + 4, (uint32_t)v); }
+static void tag(unsigned char *p, const char *t) { memcpy(p, t, 4); }
+
+// One OA_REC_BLOCK: the format chunks, padding, and the data chunk header ending exactly at
+// the block boundary so that sample data stays block aligned for O_DIRECT. `data` is the
+// final size in bytes, or UINT64_MAX while recording.
+static void build_header(const oa_recorder *rec, unsigned char *h, uint64_t data) {
+  const oa_record_params *p = &rec->params;
+  int is_float = p->format == OA_SAMPLE_F32;
+  uint32_t bits = rec->sample_bytes * 8;
+  uint64_t known = data == UINT64_MAX ? 0 : data;
+  memset(h, 0, OA_REC_BLOCK);
+  if (p->container == OA_REC_CAF) {
+    union { double d; uint64_t u; } rate = {(double)p->sample_rate};
+    tag(h, "caff");
+    h[4] = 0; h[5] = 1; // version 1, flags 0
+    tag(h + 8, "desc");
+    be64(h + 12, 32);
+    be64(h + 20, rate.u);
+    tag(h + 28, "lpcm");
+    be32(h + 32, (is_float ? 1u : 0u) | 2u); // kCAFLinearPCMFormatFlagIsFloat | IsLittleEndian
+    be32(h + 36, rec->frame_bytes);
+    be32(h + 40, 1);
+    be32(h + 44, p->channels);
+    be32(h + 48, bits);
+    tag(h + 52, "free");
+    be64(h + 56, OA_REC_BLOCK - 64 - 16);
+    tag(h + OA_REC_BLOCK - 16, "data");
+    // -1: the data runs to the end of the file, so a recording cut short still opens.
+    be64(h + OA_REC_BLOCK - 12, data == UINT64_MAX ? UINT64_MAX : data + 4);
+    be32(h + OA_REC_BLOCK - 4, 0); // edit count
+    return;
+  }
+  uint64_t riff = OA_REC_BLOCK - 8 + known + (known & 1);
+  int rf64 = p->container == OA_REC_RF64 || riff > 0xffffffffu;
+  tag(h, rf64 ? "RF64" : "RIFF");
+  le32(h + 4, rf64 ? 0xffffffffu : (uint32_t)riff);
+  tag(h + 8, "WAVE");
+  // ds64 in RF64 files, otherwise a JUNK chunk of the same size to turn into one.
+  tag(h + 12, rf64 ? "ds64" : "JUNK");
+  le32(h + 16, 28);
+  if (rf64) {
+    le64(h + 20, riff);
+    le64(h + 28, known);
+    le64(h + 36, known / rec->frame_bytes);
+  }
+  tag(h + 48, "fmt ");
+  le32(h + 52, 40);
+  le16(h + 56, 0xfffe); // WAVE_FORMAT_EXTENSIBLE
+  le16(h + 58, p->channels);
+  le32(h + 60, p->sample_rate);
+  le32(h + 64, p->sample_rate * rec->frame_bytes);
+  le16(h + 68, rec->frame_bytes);
+  le16(h + 70, bits);
+  le16(h + 72, 22);
+  le16(h + 74, bits);
+  le32(h + 76, 0); // no speaker positions: one track per channel
+  static const unsigned char guid_tail[14] = {0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80,
+                                              0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71};
+  le16(h + 80, is_float ? 3 : 1); // KSDATAFORMAT_SUBTYPE_IEEE_FLOAT / _PCM
+  memcpy(h + 82, guid_tail, sizeof guid_tail);
+  tag(h + 96, "JUNK");
+  le32(h + 100, OA_REC_BLOCK - 104 - 8);
+  tag(h + OA_REC_BLOCK - 8, "data");
+  le32(h + OA_REC_BLOCK - 4, rf64 ? 0xffffffffu : (uint32_t)known);
+}
+
+static int pwrite_all(int fd, const unsigned char *buf, size_t len, uint64_t off) {
+  while (len > 0) {
+    ssize_t n = pwrite(fd, buf, len, (off_t)off);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return errno;
+    }
+    if (n == 0) return ENOSPC;
+    buf += n;
+    len -= (size_t)n;
+    off += (uint64_t)n;
+  }
+  return 0;
+}
+
+// Allocates the file's blocks up to at least `end`, one `prealloc_step` at a time, without
+// changing its size. The writer asks for a full step past each write's end, so its extending
+// writes never wait on block allocation.
+static void prealloc(oa_recorder *rec, uint64_t end) {
+#if defined(__linux__)
+  while (rec->prealloc_ok && end > rec->prealloc_end) {
+    if (fallocate(rec->fd, FALLOC_FL_KEEP_SIZE, (off_t)rec->prealloc_end,
+                  (off_t)rec->prealloc_step) != 0) {
+      rec->prealloc_ok = 0; // not supported here, or out of space: the writes will tell
+      break;
+    }
+    rec->prealloc_end += rec->prealloc_step;
+  }
+#else
+  (void)rec; (void)end;
+#endif
+}
+
+/* ---------------------------------------------------------------- io_uring */
+
+#if OA_HAVE_URING
+static int uring_init(oa_uring *u, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+  memset(u, 0, sizeof(*u));
+  u->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (u->fd < 0) return errno;
+  u->sq_bytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cq_bytes = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single) u->sq_bytes = u->cq_bytes = u->sq_bytes > u->cq_bytes ? u->sq_bytes : u->cq_bytes;
+  u->sq_ring = mmap(NULL, u->sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                    IORING_OFF_SQ_RING);
+  if (u->sq_ring == MAP_FAILED) goto fail;
+  u->cq_ring = single ? u->sq_ring
+                      : mmap(NULL, u->cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             u->fd, IORING_OFF_CQ_RING);
+  if (u->cq_ring == MAP_FAILED) goto fail;
+  u->sqe_bytes = p.sq_entries * sizeof(struct io_uring_sqe);
+  u->sqes = mmap(NULL, u->sqe_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd,
+                 IORING_OFF_SQES);
+  if (u->sqes == MAP_FAILED) goto fail;
+  unsigned char *sq = u->sq_ring, *cq = u->cq_ring;
+  u->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  u->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  u->sq_array = (unsigned *)(sq + p.sq_off.array);
+  u->cq_head = (unsigned *)(cq + p.cq_off.head);
+  u->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  u->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return 0;
+fail:;
+  int err = errno;
+  if (u->sq_ring && u->sq_ring != MAP_FAILED) munmap(u->sq_ring, u->sq_bytes);
+  if (!single && u->cq_ring && u->cq_ring != MAP_FAILED) munmap(u->cq_ring, u->cq_bytes);
+  close(u->fd);
+  u->fd = -1;
+  return err;
+}
+
+static void uring_exit(oa_uring *u) {
+  if (u->fd < 0) return;
+  munmap(u->sqes, u->sqe_bytes);
+  if (u->cq_ring != u->sq_ring) munmap(u->cq_ring, u->cq_bytes);
+  munmap(u->sq_ring, u->sq_bytes);
+  close(u->fd);
+  u->fd = -1;
+}
+
+static void uring_queue_write(oa_uring *u, int fd, oa_rec_slot *s, uint64_t seq) {
+  unsigned tail = *u->sq_tail, idx = tail & *u->sq_mask;
+  struct io_uring_sqe *sqe = &u->sqes[idx];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_WRITEV; // 5.1+, unlike IORING_OP_WRITE
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)&s->iov;
+  sqe->len = 1;
+  sqe->off = OA_REC_BLOCK + s->pos;
+  sqe->user_data = seq;
+  u->sq_array[idx] = idx;
+  __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int uring_enter(oa_uring *u, unsigned submit, unsigned wait) {
+  for (;;) {
+    long rc = syscall(__NR_io_uring_enter, u->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0,
+                      NULL, 0);
+    if (rc >= 0) return 0;
+    if (errno != EINTR) return errno;
+  }
+}
+#endif
+
+/* ---------------------------------------------------------------- writer */
+
+// Marks write `seq` done and frees the ring up to the oldest write still in flight.
+static void complete(oa_recorder *rec, uint64_t seq, int32_t res, uint64_t *oldest) {
+  oa_rec_slot *s = &rec->slots[seq % rec->depth];
+  s->res = res;
+  s->done = 1;
+  while (rec->slots[*oldest % rec->depth].done) {
+    oa_rec_slot *o = &rec->slots[*oldest % rec->depth];
+    if (o->res != (int32_t)o->len) note_error(rec, o->res < 0 ? -o->res : ENOSPC);
+    o->done = 0;
+    __atomic_store_n(&rec->tail, o->pos + o->len, __ATOMIC_RELEASE);
+    ++*oldest;
+  }
+}
+
+static void *writer_main(void *arg) {
+  oa_recorder *rec = arg;
+#if defined(__linux__)
+  pthread_setname_np(pthread_self(), "oa-record");
+#endif
+  uint64_t submitted = 0, next = 0, oldest = 0; // bytes queued; write sequence numbers
+  for (;;) {
+    int quit = __atomic_load_n(&rec->quit, __ATOMIC_ACQUIRE);
+    uint64_t head = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+    int failed = __atomic_load_n(&rec->error, __ATOMIC_RELAXED) != 0;
+    unsigned queued = 0;
+    // After a failed write, stop writing: the ring fills and pushes are counted as drops.
+    while (!failed && next - oldest < rec->depth && head - submitted >= rec->chunk) {
+      oa_rec_slot *s = &rec->slots[next % rec->depth];
+      s->pos = submitted;
+      s->len = rec->chunk;
+      s->iov.iov_base = rec->ring + submitted % rec->ring_bytes;
+      s->iov.iov_len = rec->chunk;
+      prealloc(rec, OA_REC_BLOCK + submitted + rec->chunk + rec->prealloc_step);
+      if (rec->io == OA_REC_IO_PWRITE) {
+        int err = pwrite_all(rec->fd, s->iov.iov_base, rec->chunk, OA_REC_BLOCK + submitted);
+        submitted += rec->chunk;
+        complete(rec, next++, err ? -err : (int32_t)rec->chunk, &oldest);
+        failed = err != 0;
+        continue;
+      }
+#if OA_HAVE_URING
+      uring_queue_write(&rec->uring, rec->fd, s, next++);
+      submitted += rec->chunk;
+      queued++;
+#endif
+    }
+    unsigned inflight = (unsigned)(next - oldest);
+#if OA_HAVE_URING
+    if (rec->io == OA_REC_IO_URING && inflight) {
+      // Nothing more can be queued until a write completes or more audio arrives.
+      int err = uring_enter(&rec->uring, queued, 1);
+      if (err) {
+        note_error(rec, err);
+        break;
+      }
+      oa_uring *u = &rec->uring;
+      unsigned h = *u->cq_head, t = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+      for (; h != t; ++h) {
+        struct io_uring_cqe *c = &u->cqes[h & *u->cq_mask];
+        complete(rec, c->user_data, c->res, &oldest);
+      }
+      __atomic_store_n(u->cq_head, h, __ATOMIC_RELEASE);
+      continue;
+    }
+#else
+    (void)queued;
+#endif
+    if (quit && inflight == 0) break;
+    sleep_ns(rec->poll_ns);
+  }
+  return NULL;
+}
+
+/* ---------------------------------------------------------------- API */
+
+OA_API oa_result oa_recorder_create(const char *path, const oa_record_params *params,
+                                    oa_recorder **out) {
+  if (!out) return OA_ERR_INVALID_ARG;
+  *out = NULL;
+  if (!path || !params || params->channels == 0 || params->channels > 0xffffu ||
+      params->sample_rate == 0 || params->container > OA_REC_CAF || params->io > OA_REC_IO_PWRITE)
+    return OA_ERR_INVALID_ARG;
+  // Both containers store integers left-justified and signed.
+  if (params->format == OA_SAMPLE_U16 || params->format == OA_SAMPLE_I24_IN_32 ||
+      oa_sample_bytes(params->format) == 0)
+    return OA_ERR_UNSUPPORTED;
+#if !OA_HAVE_URING
+  if (params->io == OA_REC_IO_URING) return OA_ERR_UNSUPPORTED;
+#endif
+  oa_recorder *rec = NULL;
+  if (posix_memalign((void **)&rec, OA_LINE, sizeof(*rec)) != 0) return OA_ERR_GENERIC;
+  memset(rec, 0, sizeof(*rec));
+  rec->params = *params;
+  rec->fd = -1;
+#if OA_HAVE_URING
+  rec->uring.fd = -1;
+#endif
+  rec->channels = params->channels;
+  rec->sample_bytes = oa_sample_bytes(params->format);
+  rec->frame_bytes = rec->sample_bytes * rec->channels;
+  if (rec->frame_bytes > 0xffffu) {
+    free(rec);
+    return OA_ERR_INVALID_ARG;
+  }
+  long page = sysconf(_SC_PAGESIZE);
+  uint64_t unit = page > (long)OA_REC_BLOCK ? (uint64_t)page : OA_REC_BLOCK;
+  rec->chunk = (uint32_t)round_up(params->chunk_bytes ? params->chunk_bytes : 1u << 20, unit);
+  rec->depth = params->queue_depth ? params->queue_depth : 4;
+  if (rec->depth > OA_REC_MAX_DEPTH) rec->depth = OA_REC_MAX_DEPTH;
+  // Chunks never straddle the end of the ring, and neither do frames.
+  uint64_t lcm = rec->chunk / gcd(rec->chunk, rec->frame_bytes) * rec->frame_bytes;
+  uint64_t ms = params->ring_ms ? params->ring_ms : 2000;
+  uint64_t want = ms * params->sample_rate / 1000 * rec->frame_bytes;
+  uint64_t least = (uint64_t)(rec->depth + 1) * rec->chunk;
+  rec->ring_bytes = round_up(want > least ? want : least, lcm);
+  uint64_t rate_bytes = (uint64_t)params->sample_rate * rec->frame_bytes;
+  rec->poll_ns = (uint64_t)rec->chunk * 500000000u / rate_bytes; // half a chunk of audio
+  if (rec->poll_ns < 1000000u) rec->poll_ns = 1000000u;
+  if (rec->poll_ns > 50000000u) rec->poll_ns = 50000000u;
+  rec->prealloc_step = round_up(params->prealloc_bytes ? params->prealloc_bytes : 256u << 20, rec->chunk);
+  rec->prealloc_ok = 1;
+
+  oa_result rc = OA_ERR_GENERIC;
+  rec->ring = ring_map(rec->ring_bytes, &rec->mirrored);
+  if (!rec->ring) goto fail;
+  // Touch every page now so the RT copies never fault; keep them resident if allowed.
+  memset(rec->ring, 0, rec->ring_bytes);
+  mlock(rec->ring, rec->ring_bytes);
+  if (!rec->mirrored) {
+    rec->scratch = calloc(rec->channels, sizeof(*rec->scratch));
+    if (!rec->scratch) goto fail;
+  }
+  if (posix_memalign((void **)&rec->block, OA_REC_BLOCK, OA_REC_BLOCK) != 0) {
+    rec->block = NULL;
+    goto fail;
+  }
+
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  if (params->flags & OA_REC_DIRECT) {
+    rec->fd = open(path, flags | O_DIRECT, 0644);
+    rec->direct = rec->fd >= 0 && O_DIRECT != 0;
+  }
+  if (rec->fd < 0) rec->fd = open(path, flags, 0644);
+  rc = OA_ERR_BACKEND;
+  if (rec->fd < 0) goto fail;
+  build_header(rec, rec->block, UINT64_MAX);
+  if (pwrite_all(rec->fd, rec->block, OA_REC_BLOCK, 0) != 0) goto fail;
+  rec->prealloc_end = OA_REC_BLOCK;
+  prealloc(rec, OA_REC_BLOCK + rec->prealloc_step);
+
+  rec->io = OA_REC_IO_PWRITE;
+#if OA_HAVE_URING
+  if (params->io != OA_REC_IO_PWRITE) {
+    if (uring_init(&rec->uring, rec->depth) == 0) {
+      rec->io = OA_REC_IO_URING;
+    } else if (params->io == OA_REC_IO_URING) {
+      rc = OA_ERR_UNSUPPORTED;
+      goto fail;
+    }
+  }
+#endif
+  rc = OA_ERR_GENERIC;
+  if (pthread_create(&rec->writer, NULL, writer_main, rec) != 0) goto fail;
+  rec->started = 1;
+  *out = rec;
+  return OA_OK;
+
+fail:
+  if (rec->fd >= 0) {
+    close(rec->fd);
+    unlink(path);
+  }
+#if OA_HAVE_URING
+  uring_exit(&rec->uring);
+#endif
+  free(rec->block);
+  free(rec->scratch);
+  ring_unmap(rec->ring, rec->ring_bytes, rec->mirrored);
+  free(rec);
+  return rc;
+}
+
+// Room for `frames` more frames, or counts them as dropped. Returns the write position.
+static int reserve(oa_recorder *rec, uint32_t frames, uint64_t *head, uint64_t *bytes) {
+  *bytes = (uint64_t)frames * rec->frame_bytes;
+  *head = rec->head;
+  uint64_t used = *head - __atomic_load_n(&rec->tail, __ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&rec->closed, __ATOMIC_ACQUIRE) || used + *bytes > rec->ring_bytes) {
+    __atomic_store_n(&rec->frames_dropped, rec->frames_dropped + frames, __ATOMIC_RELAXED);
+    __atomic_store_n(&rec->drops, rec->drops + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  if (used + *bytes > rec->fill_max)
+    __atomic_store_n(&rec->fill_max, (uint32_t)(used + *bytes), __ATOMIC_RELAXED);
+  return 1;
+}
+
+static void commit(oa_recorder *rec, uint64_t head, uint64_t bytes, uint32_t frames) {
+  __atomic_store_n(&rec->frames_pushed, rec->frames_pushed + frames, __ATOMIC_RELAXED);
+  __atomic_store_n(&rec->head, head + bytes, __ATOMIC_RELEASE);
+}
+
+OA_API oa_bool oa_recorder_push(oa_recorder *rec, const void *interleaved, uint32_t frames) {
+  uint64_t head, bytes;
+  if (frames == 0) return OA_TRUE;
+  if (!reserve(rec, frames, &head, &bytes)) return OA_FALSE;
+  uint64_t pos = head % rec->ring_bytes;
+  uint64_t first = rec->mirrored || pos + bytes <= rec->ring_bytes ? bytes : rec->ring_bytes - pos;
+  memcpy(rec->ring + pos, interleaved, first);
+  if (first < bytes) memcpy(rec->ring, (const unsigned char *)interleaved + first, bytes - first);
+  commit(rec, head, bytes, frames);
+  return OA_TRUE;
+}
+
+OA_API oa_bool oa_recorder_push_planar(oa_recorder *rec, const void *const *planes,
+                                       uint32_t frames) {
+  uint64_t head, bytes;
+  if (frames == 0) return OA_TRUE;
+  if (!reserve(rec, frames, &head, &bytes)) return OA_FALSE;
+  uint64_t pos = head % rec->ring_bytes;
+  uint32_t first = rec->mirrored || pos + bytes <= rec->ring_bytes
+                       ? frames
+                       : (uint32_t)((rec->ring_bytes - pos) / rec->frame_bytes);
+  oa_interleave_bytes(rec->ring + pos, planes, rec->channels, first, rec->sample_bytes);
+  if (first < frames) {
+    for (uint32_t c = 0; c < rec->channels; ++c)
+      rec->scratch[c] = (const unsigned char *)planes[c] + (size_t)first * rec->sample_bytes;
+    oa_interleave_bytes(rec->ring, rec->scratch, rec->channels, frames - first, rec->sample_bytes);
+  }
+  commit(rec, head, bytes, frames);
+  return OA_TRUE;
+}
+
+OA_API void oa_recorder_stats(const oa_recorder *rec, oa_record_stats *out) {
+  if (!out) return;
+  memset(out, 0, sizeof(*out));
+  if (!rec) return;
+  uint64_t tail = __atomic_load_n(&rec->tail, __ATOMIC_ACQUIRE);
+  uint64_t head = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+  out->frames_pushed = __atomic_load_n(&rec->frames_pushed, __ATOMIC_RELAXED);
+  out->frames_written = tail / rec->frame_bytes;
+  out->frames_dropped = __atomic_load_n(&rec->frames_dropped, __ATOMIC_RELAXED);
+  out->drops = __atomic_load_n(&rec->drops, __ATOMIC_RELAXED);
+  out->fill_permille = (uint32_t)((head - tail) * 1000 / rec->ring_bytes);
+  out->fill_max_permille =
+      (uint32_t)((uint64_t)__atomic_load_n(&rec->fill_max, __ATOMIC_RELAXED) * 1000 / rec->ring_bytes);
+  out->error = __atomic_load_n(&rec->error, __ATOMIC_RELAXED);
+  out->io = rec->io;
+  out->direct = rec->direct;
+}
+
+OA_API oa_result oa_recorder_finish(oa_recorder *rec) {
+  if (!rec) return OA_ERR_INVALID_ARG;
+  if (rec->finished) return rec->result;
+  __atomic_store_n(&rec->closed, 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&rec->quit, 1, __ATOMIC_RELEASE);
+  if (rec->started) pthread_join(rec->writer, NULL);
+  rec->started = 0;
+  // The writer leaves less than a chunk, which never wraps. O_DIRECT writes whole blocks:
+  // write the last one padded with whatever the ring holds and cut the file back after.
+  uint64_t head = __atomic_load_n(&rec->head, __ATOMIC_ACQUIRE);
+  uint64_t tail = rec->tail;
+  if (!rec->error && head > tail) {
+    uint64_t len = round_up(head - tail, OA_REC_BLOCK);
+    int err = pwrite_all(rec->fd, rec->ring + tail % rec->ring_bytes, len, OA_REC_BLOCK + tail);
+    if (err)
+      note_error(rec, err);
+    else
+      __atomic_store_n(&rec->tail, head, __ATOMIC_RELEASE);
+  }
+  uint64_t data = rec->tail;
+  build_header(rec, rec->block, data);
+  int err = pwrite_all(rec->fd, rec->block, OA_REC_BLOCK, 0);
+  uint64_t pad = rec->params.container == OA_REC_CAF ? 0 : data & 1; // RIFF chunks are even
+  if (!err && ftruncate(rec->fd, (off_t)(OA_REC_BLOCK + data + pad)) != 0) err = errno;
+  if (!err && fsync(rec->fd) != 0) err = errno;
+  if (err) note_error(rec, err);
+  close(rec->fd);
+  rec->fd = -1;
+#if OA_HAVE_URING
+  uring_exit(&rec->uring);
+#endif
+  rec->finished = 1;
+  rec->result = rec->error ? OA_ERR_BACKEND : OA_OK;
+  return rec->result;
+}
+
+OA_API void oa_recorder_destroy(oa_recorder *rec) {
+  if (!rec) return;
+  oa_recorder_finish(rec);
+  free(rec->block);
+  free(rec->scratch);
+  ring_unmap(rec->ring, rec->ring_bytes, rec->mirrored);
+  free(rec);
+}
+
+#endif
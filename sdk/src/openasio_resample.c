@@ -0,0 +1,390 @@
+/*
+ OpenASIO sample-rate converter.
+ License: MIT OR Apache-2.0
+*/
+#include "openasio/openasio_resample.h"
+#include "openasio/openasio_convert.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+  #include <malloc.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+  #define OA_HAVE_X86 1
+  #include <immintrin.h>
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+  #define OA_HAVE_NEON 1
+  #include <arm_neon.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+  #define OA_TARGET(t) __attribute__((target(t)))
+#else
+  #define OA_TARGET(t)
+#endif
+
+#define OA_LINE 64
+#define OA_TAP_STEP 8    // taps are a multiple of this, so the kernels need no tail
+#define OA_HIST_BLOCK 256 // input frames taken per history top-up, beyond the filter length
+
+// Filter length at unity ratio, Kaiser beta, cutoff (the -6 dB point) as a fraction of the
+// lower Nyquist frequency, and phases of the variable-ratio bank. The transition band is
+// centred on the cutoff; beta sets the stopband past it, about 55, 75 and 100 dB.
+static const struct {
+  uint32_t taps;
+  double beta;
+  double rolloff;
+  uint32_t phases;
+} k_quality[] = {
+  {16, 5.0, 0.80, 128},
+  {32, 7.5, 0.90, 256},
+  {64, 10.0, 0.94, 512},
+};
+
+struct oa_resampler {
+  uint32_t channels;
+  uint32_t taps;
+  uint32_t phases;  // rows of `coef`, less the extra one interpolation reads
+  uint32_t in_rate, out_rate;
+  oa_bool variable;
+  // Fixed ratio: each output advances num/den input frames; `frac` counts in 1/den.
+  uint32_t num, den;
+  // Variable ratio: the step and `frac` are 32.32 fixed point.
+  uint64_t nominal_step, step;
+  uint32_t frac;
+  // History: `cap` frames per channel, planar, valid up to `fill`. The next output's
+  // window starts at `ipos`, which may lie past `fill` when the step skips input.
+  size_t ipos, fill, cap;
+  float *coef; // (phases + 1) x taps; the last row is the first shifted by one frame
+  float *row;  // interpolated phase
+  float *hist;
+  float **planes; // per-call plane pointers into `hist`
+};
+
+static void *alloc_lines(size_t bytes) {
+  bytes = (bytes + OA_LINE - 1) / OA_LINE * OA_LINE;
+#if defined(_WIN32)
+  void *p = _aligned_malloc(bytes, OA_LINE);
+#else
+  void *p = NULL;
+  if (posix_memalign(&p, OA_LINE, bytes) != 0) p = NULL;
+#endif
+  if (p) memset(p, 0, bytes);
+  return p;
+}
+
+static void free_lines(void *p) {
+#if defined(_WIN32)
+  _aligned_free(p);
+#else
+  free(p);
+#endif
+}
+
+/* --------------------------------------------------------------- kernels */
+
+typedef float (*dot_fn)(const float *a, const float *b, size_t n);
+// dst = a + (b - a) * t, at the same vector width the dot kernel then reads dst with.
+typedef void (*lerp_fn)(float *dst, const float *a, const float *b, float t, size_t n);
+
+typedef struct {
+  dot_fn dot;
+  lerp_fn lerp;
+} kernels;
+
+static float dot_scalar(const float *a, const float *b, size_t n) {
+  float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  for (size_t i = 0; i < n; i += 4) {
+    s0 += a[i] * b[i];
+    s1 += a[i + 1] * b[i + 1];
+    s2 += a[i + 2] * b[i + 2];
+    s3 += a[i + 3] * b[i + 3];
+  }
+  return (s0 + s1) + (s2 + s3);
+}
+
+static void lerp_scalar(float *dst, const float *a, const float *b, float t, size_t n) {
+  for (size_t i = 0; i < n; ++i) dst[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+#if OA_HAVE_X86
+OA_TARGET("sse2") static float dot_sse2(const float *a, const float *b, size_t n) {
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  for (size_t i = 0; i < n; i += 8) {
+    s0 = _mm_add_ps(s0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+  }
+  __m128 s = _mm_add_ps(s0, s1);
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+OA_TARGET("sse2") static void lerp_sse2(float *dst, const float *a, const float *b, float t, size_t n) {
+  const __m128 tv = _mm_set1_ps(t);
+  for (size_t i = 0; i < n; i += 4) {
+    __m128 va = _mm_loadu_ps(a + i);
+    _mm_storeu_ps(dst + i, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + i), va), tv)));
+  }
+}
+
+OA_TARGET("avx2") static float dot_avx2(const float *a, const float *b, size_t n) {
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+  }
+  if (i < n) s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+  __m256 s8 = _mm256_add_ps(s0, s1);
+  __m128 s = _mm_add_ps(_mm256_castps256_ps128(s8), _mm256_extractf128_ps(s8, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+  return _mm_cvtss_f32(s);
+}
+
+OA_TARGET("avx2") static void lerp_avx2(float *dst, const float *a, const float *b, float t, size_t n) {
+  const __m256 tv = _mm256_set1_ps(t);
+  for (size_t i = 0; i < n; i += 8) {
+    __m256 va = _mm256_loadu_ps(a + i);
+    _mm256_storeu_ps(dst + i, _mm256_add_ps(va, _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(b + i), va), tv)));
+  }
+}
+#endif /* OA_HAVE_X86 */
+
+#if OA_HAVE_NEON
+static float dot_neon(const float *a, const float *b, size_t n) {
+  float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+  for (size_t i = 0; i < n; i += 8) {
+    s0 = vmlaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+    s1 = vmlaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  return vaddvq_f32(vaddq_f32(s0, s1));
+}
+
+static void lerp_neon(float *dst, const float *a, const float *b, float t, size_t n) {
+  for (size_t i = 0; i < n; i += 4) {
+    float32x4_t va = vld1q_f32(a + i);
+    vst1q_f32(dst + i, vmlaq_n_f32(va, vsubq_f32(vld1q_f32(b + i), va), t));
+  }
+}
+#endif /* OA_HAVE_NEON */
+
+// Follows oa_convert_set_simd_level, so benchmarks can compare levels.
+static kernels kernel_set(void) {
+  switch (oa_convert_simd_level()) {
+#if OA_HAVE_X86
+    case OA_SIMD_AVX2: return (kernels){dot_avx2, lerp_avx2};
+    case OA_SIMD_SSE2: return (kernels){dot_sse2, lerp_sse2};
+#endif
+#if OA_HAVE_NEON
+    case OA_SIMD_NEON: return (kernels){dot_neon, lerp_neon};
+#endif
+    default: return (kernels){dot_scalar, lerp_scalar};
+  }
+}
+
+/* ---------------------------------------------------------------- filter */
+
+// Modified Bessel function of the first kind, order 0 (power series).
+static double bessel_i0(double x) {
+  double sum = 1.0, term = 1.0, q = x * x / 4.0;
+  for (int k = 1; k < 64 && term > sum * 1e-17; ++k) {
+    term *= q / ((double)k * k);
+    sum += term;
+  }
+  return sum;
+}
+
+// Phase p of the bank is the filter delayed by p/phases of an input frame. Tap j weighs
+// input frame j of the window, whose output sample falls at taps/2 - 1 + p/phases.
+static void design(float *coef, uint32_t taps, uint32_t phases, double cutoff, double beta) {
+  const double pi = 3.14159265358979323846;
+  double half = taps / 2.0, center = half - 1.0, norm = bessel_i0(beta);
+  for (uint32_t p = 0; p <= phases; ++p) {
+    float *row = coef + (size_t)p * taps;
+    double sum = 0.0;
+    for (uint32_t j = 0; j < taps; ++j) {
+      double d = center + (double)p / phases - j;
+      double x = d / half;
+      double w = fabs(x) < 1.0 ? bessel_i0(beta * sqrt(1.0 - x * x)) / norm : 0.0;
+      double a = pi * cutoff * d;
+      double h = cutoff * (fabs(a) < 1e-12 ? 1.0 : sin(a) / a) * w;
+      row[j] = (float)h;
+      sum += h;
+    }
+    // Unity gain at DC in every phase, so no phase modulates the level.
+    for (uint32_t j = 0; j < taps; ++j) row[j] = (float)(row[j] / sum);
+  }
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  while (b) { uint32_t t = a % b; a = b; b = t; }
+  return a;
+}
+
+/* ---------------------------------------------------------------- public */
+
+oa_result oa_resampler_create(uint32_t channels, uint32_t in_rate, uint32_t out_rate,
+                              oa_resample_quality quality, uint32_t flags, oa_resampler **out) {
+  if (!out) return OA_ERR_INVALID_ARG;
+  *out = NULL;
+  if (channels == 0 || in_rate == 0 || out_rate == 0 || (unsigned)quality > OA_RESAMPLE_HIGH)
+    return OA_ERR_INVALID_ARG;
+  if (in_rate > out_rate * (uint64_t)OA_RESAMPLE_MAX_RATIO ||
+      out_rate > in_rate * (uint64_t)OA_RESAMPLE_MAX_RATIO)
+    return OA_ERR_UNSUPPORTED;
+
+  oa_resampler *r = (oa_resampler *)alloc_lines(sizeof *r);
+  if (!r) return OA_ERR_GENERIC;
+  uint32_t g = gcd(in_rate, out_rate);
+  r->channels = channels;
+  r->in_rate = in_rate;
+  r->out_rate = out_rate;
+  r->num = in_rate / g;
+  r->den = out_rate / g;
+  r->variable = (flags & OA_RESAMPLE_VARIABLE) || r->den > OA_RESAMPLE_MAX_PHASES;
+  r->phases = r->variable ? k_quality[quality].phases : r->den;
+  r->nominal_step = (uint64_t)(((double)in_rate / out_rate) * 4294967296.0 + 0.5);
+  r->step = r->nominal_step;
+
+  // Downsampling lowers the cutoff below the output's Nyquist frequency; the filter grows
+  // by the same factor to keep its transition band.
+  double down = in_rate > out_rate ? (double)in_rate / out_rate : 1.0;
+  uint32_t taps = (uint32_t)ceil(k_quality[quality].taps * down);
+  r->taps = (taps + OA_TAP_STEP - 1) / OA_TAP_STEP * OA_TAP_STEP;
+  r->cap = r->taps + OA_HIST_BLOCK;
+  r->coef = (float *)alloc_lines((size_t)(r->phases + 1) * r->taps * sizeof(float));
+  r->row = (float *)alloc_lines(r->taps * sizeof(float));
+  r->hist = (float *)alloc_lines(r->cap * channels * sizeof(float));
+  r->planes = (float **)alloc_lines(channels * sizeof(float *));
+  if (!r->coef || !r->row || !r->hist || !r->planes) {
+    oa_resampler_destroy(r);
+    return OA_ERR_GENERIC;
+  }
+  design(r->coef, r->taps, r->phases, k_quality[quality].rolloff / down, k_quality[quality].beta);
+  oa_resampler_reset(r);
+  *out = r;
+  return OA_OK;
+}
+
+void oa_resampler_destroy(oa_resampler *r) {
+  if (!r) return;
+  free_lines(r->coef);
+  free_lines(r->row);
+  free_lines(r->hist);
+  free_lines(r->planes);
+  free_lines(r);
+}
+
+// The history starts with the leading half of the window silent, so the first output
+// falls on the first input frame.
+void oa_resampler_reset(oa_resampler *r) {
+  memset(r->hist, 0, r->cap * r->channels * sizeof(float));
+  r->fill = r->taps / 2 - 1;
+  r->ipos = 0;
+  r->frac = 0;
+  r->step = r->nominal_step;
+}
+
+oa_result oa_resampler_set_trim(oa_resampler *r, double trim) {
+  if (!r->variable) return OA_ERR_STATE;
+  if (!(fabs(trim - 1.0) <= OA_RESAMPLE_MAX_TRIM)) return OA_ERR_INVALID_ARG;
+  r->step = (uint64_t)((double)r->nominal_step * trim + 0.5);
+  return OA_OK;
+}
+
+oa_bool oa_resampler_variable(const oa_resampler *r) { return r->variable; }
+
+// Start of the window `k` outputs from now.
+static size_t window_at(const oa_resampler *r, size_t k) {
+  if (r->variable) return r->ipos + (size_t)(((uint64_t)r->frac + (uint64_t)k * r->step) >> 32);
+  return r->ipos + (size_t)(((uint64_t)r->frac + (uint64_t)k * r->num) / r->den);
+}
+
+size_t oa_resampler_input_for(const oa_resampler *r, size_t out_frames) {
+  if (out_frames == 0) return 0;
+  size_t end = window_at(r, out_frames - 1) + r->taps;
+  return end > r->fill ? end - r->fill : 0;
+}
+
+size_t oa_resampler_output_for(const oa_resampler *r, size_t in_frames) {
+  size_t avail = r->fill + in_frames;
+  if (avail < r->ipos + r->taps) return 0;
+  // Outputs k = 0.. whose window start stays within `room` frames of ipos.
+  uint64_t room = avail - r->taps - r->ipos;
+  if (r->variable) return (size_t)((((room + 1) << 32) - 1 - r->frac) / r->step) + 1;
+  return (size_t)(((room + 1) * r->den - 1 - r->frac) / r->num) + 1;
+}
+
+// Drops history before the window, or all of it when the window starts past it.
+static void compact(oa_resampler *r) {
+  size_t drop = r->ipos < r->fill ? r->ipos : r->fill;
+  if (drop == 0) return;
+  for (uint32_t c = 0; c < r->channels; ++c) {
+    float *h = r->hist + (size_t)c * r->cap;
+    memmove(h, h + drop, (r->fill - drop) * sizeof(float));
+  }
+  r->fill -= drop;
+  r->ipos -= drop;
+}
+
+void oa_resampler_process(oa_resampler *r, const float *in, size_t in_frames, size_t *in_used,
+                          float *out, size_t out_frames, size_t *out_done) {
+  const kernels k = kernel_set();
+  const uint32_t ch = r->channels, taps = r->taps;
+  size_t used = 0, done = 0;
+  while (done < out_frames) {
+    if (r->ipos + taps > r->fill) {
+      if (used == in_frames) break;
+      compact(r);
+      if (r->ipos > 0) { // input no output needs
+        size_t skip = r->ipos < in_frames - used ? r->ipos : in_frames - used;
+        used += skip;
+        r->ipos -= skip;
+        continue;
+      }
+      size_t m = in_frames - used, room = r->cap - r->fill;
+      size_t want = oa_resampler_input_for(r, out_frames - done);
+      if (m > room) m = room;
+      if (m > want) m = want;
+      for (uint32_t c = 0; c < ch; ++c) r->planes[c] = r->hist + (size_t)c * r->cap + r->fill;
+      oa_deinterleave_f32(r->planes, in + used * ch, ch, m);
+      r->fill += m;
+      used += m;
+      continue;
+    }
+    const float *row;
+    if (r->variable) {
+      uint64_t at = (uint64_t)r->frac * r->phases;
+      uint32_t p = (uint32_t)(at >> 32);
+      float t = (float)(uint32_t)at * (1.0f / 4294967296.0f);
+      const float *a = r->coef + (size_t)p * taps, *b = a + taps;
+      k.lerp(r->row, a, b, t, taps);
+      row = r->row;
+    } else {
+      row = r->coef + (size_t)r->frac * taps;
+    }
+    float *o = out + done * ch;
+    for (uint32_t c = 0; c < ch; ++c) o[c] = k.dot(r->hist + (size_t)c * r->cap + r->ipos, row, taps);
+    if (r->variable) {
+      uint64_t f = (uint64_t)r->frac + r->step;
+      r->ipos += (size_t)(f >> 32);
+      r->frac = (uint32_t)f;
+    } else {
+      uint32_t f = r->frac + r->num;
+      r->ipos += f / r->den;
+      r->frac = f % r->den;
+    }
+    ++done;
+  }
+  if (in_used) *in_used = used;
+  if (out_done) *out_done = done;
+}
+
+uint32_t oa_resampler_latency(const oa_resampler *r) {
+  return (uint32_t)(((uint64_t)(r->taps / 2) * r->out_rate + r->in_rate - 1) / r->in_rate);
+}
@@ -0,0 +1,390 @@
+/*
+ OpenASIO worker group: RT helper threads with a work-stealing fork/join.
+ License: MIT OR Apache-2.0
+*/
+#define _GNU_SOURCE
+#include "openasio/openasio_workgroup.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+
+OA_API oa_result oa_workgroup_create(const oa_thread_params *params, uint32_t workers,
+                                     oa_workgroup **out) {
+  (void)params; (void)workers;
+  if (out) *out = NULL;
+  return OA_ERR_UNSUPPORTED;
+}
+OA_API void oa_workgroup_destroy(oa_workgroup *wg) { (void)wg; }
+OA_API uint32_t oa_workgroup_size(const oa_workgroup *wg) { (void)wg; return 0; }
+OA_API int32_t oa_workgroup_error(const oa_workgroup *wg) { (void)wg; return 0; }
+OA_API oa_result oa_workgroup_run(oa_workgroup *wg, oa_work_fn fn, void *ctx, uint32_t count) {
+  (void)wg; (void)fn; (void)ctx; (void)count;
+  return OA_ERR_UNSUPPORTED;
+}
+
+#else
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+  #include <xmmintrin.h>
+#endif
+
+#define OA_LINE 64
+#define OA_ALIGNED __attribute__((aligned(OA_LINE)))
+#define OA_SPIN_MAX_NS 100000u
+#define OA_PREFAULT_STACK (64 * 1024)
+#define OA_JOIN_SPINS (1u << 14) // before the caller starts yielding to a worker on its CPU
+
+// A worker's jobs [begin, end) of batch `tag` in one word, so that the owner taking the
+// front and a thief splitting off the back race through the same compare-and-swap. The tag
+// keeps a worker that is late from the previous batch off this one's ranges.
+typedef struct {
+  OA_ALIGNED uint64_t range;
+} oa_wg_slot;
+
+typedef struct {
+  oa_workgroup *wg;
+  uint32_t index;
+} oa_wg_arg;
+
+struct oa_workgroup {
+  oa_wg_slot slots[OA_WORKGROUP_MAX_WORKERS];
+  // Written by the caller before it publishes `epoch`.
+  OA_ALIGNED uint32_t epoch;
+  uint32_t quit;
+  oa_work_fn fn;
+  void *ctx;
+  OA_ALIGNED uint32_t done;
+  OA_ALIGNED uint32_t sleepers;
+  int32_t error;
+  uint32_t size;
+  uint32_t flags;
+  uint64_t spin_ns;
+  uint32_t started;
+  pthread_t threads[OA_WORKGROUP_MAX_WORKERS];
+  oa_wg_arg args[OA_WORKGROUP_MAX_WORKERS];
+  oa_cpu_mask affinity; // applied to the workers, all zero to leave them unpinned
+#if !defined(__linux__)
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+#endif
+};
+
+static inline uint64_t pack(uint32_t tag, uint32_t begin, uint32_t end) {
+  return (uint64_t)tag << 32 | (uint64_t)begin << 16 | end;
+}
+static inline uint32_t tag_of(uint64_t w) { return (uint32_t)(w >> 32); }
+static inline uint32_t begin_of(uint64_t w) { return (uint32_t)(w >> 16) & 0xffffu; }
+static inline uint32_t end_of(uint64_t w) { return (uint32_t)w & 0xffffu; }
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void note_error(oa_workgroup *wg, int err) {
+  int32_t none = 0;
+  __atomic_compare_exchange_n(&wg->error, &none, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/* ---------------------------------------------------------------- fork/join */
+
+// Takes the next job from the front of worker `me`'s own range.
+static int claim_own(oa_workgroup *wg, uint32_t me, uint32_t tag, uint32_t *index) {
+  uint64_t *range = &wg->slots[me].range;
+  uint64_t w = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+  for (;;) {
+    uint32_t b = begin_of(w), e = end_of(w);
+    if (tag_of(w) != tag || b >= e) return 0;
+    if (__atomic_compare_exchange_n(range, &w, pack(tag, b + 1, e), 1, __ATOMIC_ACQ_REL,
+                                    __ATOMIC_ACQUIRE)) {
+      *index = b;
+      return 1;
+    }
+  }
+}
+
+// Splits the back half off the first other range that has any jobs left. The first stolen
+// job is returned, the rest becomes `me`'s own range (which is empty, so nobody races us).
+static int steal(oa_workgroup *wg, uint32_t me, uint32_t tag, uint32_t *index) {
+  for (uint32_t k = 1; k < wg->size; ++k) {
+    uint32_t victim = me + k < wg->size ? me + k : me + k - wg->size;
+    uint64_t *range = &wg->slots[victim].range;
+    uint64_t w = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+    for (;;) {
+      uint32_t b = begin_of(w), e = end_of(w);
+      if (tag_of(w) != tag || b >= e) break;
+      uint32_t mid = e - b > 1 ? b + (e - b) / 2 : b; // a single job left: take it
+      if (__atomic_compare_exchange_n(range, &w, mid == b ? pack(tag, e, e) : pack(tag, b, mid),
+                                      1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        *index = mid;
+        if (mid + 1 < e)
+          __atomic_store_n(&wg->slots[me].range, pack(tag, mid + 1, e), __ATOMIC_RELEASE);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void participate(oa_workgroup *wg, uint32_t me, uint32_t tag, oa_work_fn fn, void *ctx) {
+  uint32_t i;
+  while (claim_own(wg, me, tag, &i) || steal(wg, me, tag, &i)) {
+    fn(ctx, i, me);
+    __atomic_fetch_add(&wg->done, 1, __ATOMIC_RELEASE);
+  }
+}
+
+/* ---------------------------------------------------------------- sleep/wake */
+
+static void wake_all(oa_workgroup *wg) {
+#if defined(__linux__)
+  syscall(SYS_futex, &wg->epoch, FUTEX_WAKE_PRIVATE, 0x7fffffff, NULL, NULL, 0);
+#else
+  pthread_mutex_lock(&wg->lock);
+  pthread_cond_broadcast(&wg->cond);
+  pthread_mutex_unlock(&wg->lock);
+#endif
+}
+
+// Returns the first epoch after `seen`: spins for spin_ns, then sleeps. `sleepers` and
+// `epoch` are both seq_cst so that either the caller sees the sleeper or we see the epoch.
+static uint32_t wait_epoch(oa_workgroup *wg, uint32_t seen) {
+  uint64_t deadline = now_ns() + wg->spin_ns;
+  for (uint32_t n = 1;; ++n) {
+    uint32_t e = __atomic_load_n(&wg->epoch, __ATOMIC_ACQUIRE);
+    if (e != seen) return e;
+    if ((n & 63) == 0 && now_ns() >= deadline) break;
+    cpu_relax();
+  }
+  for (;;) {
+    __atomic_fetch_add(&wg->sleepers, 1, __ATOMIC_SEQ_CST);
+#if defined(__linux__)
+    if (__atomic_load_n(&wg->epoch, __ATOMIC_SEQ_CST) == seen)
+      syscall(SYS_futex, &wg->epoch, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+#else
+    pthread_mutex_lock(&wg->lock);
+    while (__atomic_load_n(&wg->epoch, __ATOMIC_SEQ_CST) == seen)
+      pthread_cond_wait(&wg->cond, &wg->lock);
+    pthread_mutex_unlock(&wg->lock);
+#endif
+    __atomic_fetch_sub(&wg->sleepers, 1, __ATOMIC_SEQ_CST);
+    uint32_t e = __atomic_load_n(&wg->epoch, __ATOMIC_ACQUIRE);
+    if (e != seen) return e;
+  }
+}
+
+/* ---------------------------------------------------------------- workers */
+
+static uint32_t mask_count(const oa_cpu_mask *m) {
+  uint32_t n = 0;
+  for (int i = 0; i < 4; ++i) n += (uint32_t)__builtin_popcountll(m->cpus[i]);
+  return n;
+}
+
+// The CPUs this process may run on, except the ones in `skip`.
+static void other_cpus(const oa_cpu_mask *skip, oa_cpu_mask *out) {
+  memset(out, 0, sizeof *out);
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof set, &set) == 0) {
+    for (int cpu = 0; cpu < 256 && cpu < CPU_SETSIZE; ++cpu)
+      if (CPU_ISSET(cpu, &set)) out->cpus[cpu / 64] |= 1ull << (cpu % 64);
+  }
+#endif
+  if (!mask_count(out)) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long cpu = 0; cpu < online && cpu < 256; ++cpu) out->cpus[cpu / 64] |= 1ull << (cpu % 64);
+  }
+  for (int i = 0; i < 4; ++i) out->cpus[i] &= ~skip->cpus[i];
+}
+
+static void enable_ftz_daz(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_setcsr(_mm_getcsr() | 0x8040);
+#elif defined(__aarch64__)
+  uint64_t fpcr;
+  __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+  fpcr |= 1ull << 24;
+  __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#endif
+}
+
+__attribute__((noinline)) static void prefault_stack(void) {
+  volatile char stack[OA_PREFAULT_STACK];
+  for (size_t i = 0; i < sizeof stack; i += 4096) stack[i] = 1;
+}
+
+static void *worker_main(void *p) {
+  oa_wg_arg *arg = (oa_wg_arg *)p;
+  oa_workgroup *wg = arg->wg;
+#if defined(__linux__)
+  if (mask_count(&wg->affinity)) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 256 && cpu < CPU_SETSIZE; ++cpu)
+      if (wg->affinity.cpus[cpu / 64] & (1ull << (cpu % 64))) CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+    if (rc) note_error(wg, rc);
+  }
+#endif
+  if (wg->flags & OA_RT_FTZ_DAZ) enable_ftz_daz();
+  if (wg->flags & OA_RT_PREFAULT) prefault_stack();
+
+  uint32_t seen = 0;
+  for (;;) {
+    seen = wait_epoch(wg, seen);
+    if (__atomic_load_n(&wg->quit, __ATOMIC_ACQUIRE)) break;
+    participate(wg, arg->index, seen, __atomic_load_n(&wg->fn, __ATOMIC_RELAXED),
+                __atomic_load_n(&wg->ctx, __ATOMIC_RELAXED));
+  }
+  return NULL;
+}
+
+// Same scheduling as the RT thread; falls back to an inherited one if that is refused.
+static int spawn(oa_workgroup *wg, uint32_t index, const oa_thread_params *params) {
+  wg->args[index].wg = wg;
+  wg->args[index].index = index;
+  pthread_t *t = &wg->threads[index];
+  int native = -1;
+  if (params && params->policy == OA_RT_POLICY_FIFO) native = SCHED_FIFO;
+  if (params && params->policy == OA_RT_POLICY_RR) native = SCHED_RR;
+  if (native >= 0) {
+    pthread_attr_t attr;
+    struct sched_param sp;
+    int lo = sched_get_priority_min(native), hi = sched_get_priority_max(native);
+    memset(&sp, 0, sizeof sp);
+    sp.sched_priority = params->priority < lo ? lo : params->priority > hi ? hi : params->priority;
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, native);
+    pthread_attr_setschedparam(&attr, &sp);
+    int rc = pthread_create(t, &attr, worker_main, &wg->args[index]);
+    pthread_attr_destroy(&attr);
+    if (rc == 0) return 0;
+    note_error(wg, rc);
+  }
+  return pthread_create(t, NULL, worker_main, &wg->args[index]);
+}
+
+/* ---------------------------------------------------------------- API */
+
+OA_API oa_result oa_workgroup_create(const oa_thread_params *params, uint32_t workers,
+                                     oa_workgroup **out) {
+  if (!out) return OA_ERR_INVALID_ARG;
+  *out = NULL;
+  if (params && params->struct_size < sizeof(oa_thread_params)) return OA_ERR_INVALID_ARG;
+
+  void *mem = NULL;
+  if (posix_memalign(&mem, OA_LINE, sizeof(oa_workgroup))) return OA_ERR_GENERIC;
+  oa_workgroup *wg = (oa_workgroup *)mem;
+  memset(wg, 0, sizeof *wg);
+#if !defined(__linux__)
+  pthread_mutex_init(&wg->lock, NULL);
+  pthread_cond_init(&wg->cond, NULL);
+#endif
+
+  // A thread pinned to one CPU would only get helpers competing with it there, so they go
+  // on every other CPU instead. With none left the caller runs every job itself.
+  uint32_t cpus = params ? mask_count(&params->affinity) : 0;
+  uint32_t helpers;
+  if (cpus == 1) {
+    other_cpus(&params->affinity, &wg->affinity);
+    helpers = mask_count(&wg->affinity);
+    if (!helpers && workers) {
+      oa_workgroup_destroy(wg);
+      return OA_ERR_UNSUPPORTED;
+    }
+  } else {
+    if (cpus > 1) wg->affinity = params->affinity;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    helpers = (cpus > 1 ? cpus : online > 0 ? (uint32_t)online : 1) - 1;
+  }
+  if (workers == 0) workers = helpers;
+  if (workers > OA_WORKGROUP_MAX_WORKERS - 1) workers = OA_WORKGROUP_MAX_WORKERS - 1;
+  wg->size = workers + 1;
+  wg->flags = params ? params->flags : 0;
+  wg->spin_ns = OA_SPIN_MAX_NS;
+  if (params && params->period_ns && params->period_ns / 8 < OA_SPIN_MAX_NS)
+    wg->spin_ns = params->period_ns / 8;
+
+  for (uint32_t i = 1; i < wg->size; ++i) {
+    if (spawn(wg, i, params)) {
+      wg->size = i;
+      oa_workgroup_destroy(wg);
+      return OA_ERR_GENERIC;
+    }
+    wg->started = i;
+  }
+  *out = wg;
+  return OA_OK;
+}
+
+OA_API void oa_workgroup_destroy(oa_workgroup *wg) {
+  if (!wg) return;
+  __atomic_store_n(&wg->quit, 1, __ATOMIC_RELEASE);
+  __atomic_fetch_add(&wg->epoch, 1, __ATOMIC_SEQ_CST);
+  wake_all(wg);
+  for (uint32_t i = 1; i <= wg->started; ++i) pthread_join(wg->threads[i], NULL);
+#if !defined(__linux__)
+  pthread_cond_destroy(&wg->cond);
+  pthread_mutex_destroy(&wg->lock);
+#endif
+  free(wg);
+}
+
+OA_API uint32_t oa_workgroup_size(const oa_workgroup *wg) { return wg ? wg->size : 0; }
+
+OA_API int32_t oa_workgroup_error(const oa_workgroup *wg) {
+  return wg ? __atomic_load_n(&wg->error, __ATOMIC_RELAXED) : 0;
+}
+
+OA_API oa_result oa_workgroup_run(oa_workgroup *wg, oa_work_fn fn, void *ctx, uint32_t count) {
+  if (!wg || !fn || count > OA_WORKGROUP_MAX_JOBS) return OA_ERR_INVALID_ARG;
+  if (wg->size == 1 || count <= 1) {
+    for (uint32_t i = 0; i < count; ++i) fn(ctx, i, 0);
+    return OA_OK;
+  }
+  uint32_t tag = __atomic_load_n(&wg->epoch, __ATOMIC_RELAXED) + 1;
+  __atomic_store_n(&wg->fn, fn, __ATOMIC_RELAXED);
+  __atomic_store_n(&wg->ctx, ctx, __ATOMIC_RELAXED);
+  __atomic_store_n(&wg->done, 0, __ATOMIC_RELAXED);
+  for (uint32_t p = 0; p < wg->size; ++p) {
+    uint32_t b = (uint32_t)((uint64_t)count * p / wg->size);
+    uint32_t e = (uint32_t)((uint64_t)count * (p + 1) / wg->size);
+    __atomic_store_n(&wg->slots[p].range, pack(tag, b, e), __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&wg->epoch, tag, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&wg->sleepers, __ATOMIC_SEQ_CST)) wake_all(wg);
+
+  participate(wg, 0, tag, fn, ctx);
+  // A job still running elsewhere takes at most its own length. Only a worker that shares
+  // our CPU at our priority can keep it from finishing, and that one needs us to yield, so
+  // the spin turns into sched_yield after OA_JOIN_SPINS rounds.
+  for (uint32_t n = 0; __atomic_load_n(&wg->done, __ATOMIC_ACQUIRE) != count; ++n) {
+    if (n < OA_JOIN_SPINS) cpu_relax();
+    else sched_yield();
+  }
+  return OA_OK;
+}
+
+#endif